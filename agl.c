@@ -2,5 +2,11 @@
 #include "agl_gfx.h"
 #define AGL_MATH_IMPLEMENTATION
 #include "agl_math.h"
+#define AGL_SCENE_IMPLEMENTATION
+#include "agl_scene.h"
+#define AGL_ANIM_IMPLEMENTATION
+#include "agl_anim.h"
+#define AGL_PHYS_IMPLEMENTATION
+#include "agl_phys.h"
 #define AGL_PLUGIN_IMPLEMENTATION
 #include "agl_plugin.h"
\ No newline at end of file
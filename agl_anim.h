@@ -0,0 +1,760 @@
+// agl_anim.h - v0.1.0 - AGL Animation Library
+//
+// PURPOSE
+//   Compressed animation clips and pose sampling for skinned crowds. Clips are built from keyframed tracks, e.g. the
+//   channels reported by the glTF loader, and sampled into poses: per joint translation, rotation and scale stored as
+//   separate x[], y[], z[] ... arrays, ready for agl_scene_set_local and for blending 8 joints at a time.
+//
+// USAGE
+//   #define AGL_ANIM_IMPLEMENTATION before including this file in *one* C or C++ file to create the implementation.
+//   agl_anim_clip_create resamples every track at a fixed rate, then keeps only the keys needed to stay within the
+//   track's error budget under linear interpolation (nlerp for rotations). Kept keys are quantised: rotations to
+//   the smallest three components at 15 bits, translations and scales to 16 bits within the track's range, so a key
+//   costs 8 bytes including its frame number. Clips are read-only once created, so any number of threads can sample
+//   the same clip into their own poses.
+//
+//
+// MIT License
+//   Copyright (c) 2026 Athang Gupte
+//   Permission is hereby granted, free of charge, to any person obtaining a copy
+//   of this software and associated documentation files (the "Software"), to deal
+//   in the Software without restriction, including without limitation the rights
+//   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//   copies of the Software, and to permit persons to whom the Software is
+//   furnished to do so, subject to the following conditions:
+//   The above copyright notice and this permission notice shall be included in all
+//   copies or substantial portions of the Software.
+//   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//   SOFTWARE.
+
+#ifndef AGL_ANIM_H
+#define AGL_ANIM_H
+
+#ifndef	AGL_API
+#	if defined(_WIN32)
+#		if defined(AGL_EXPORTS)
+#			define AGL_API __declspec(dllexport)
+#		elif defined(AGL_IMPORTS)
+#			define AGL_API __declspec(dllimport)
+#		else
+#			define AGL_API extern
+#		endif
+#	else
+#		define AGL_API extern
+#	endif
+#endif // AGL_API
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum agl_anim_path_t {
+    AGL_ANIM_PATH_TRANSLATION,
+    AGL_ANIM_PATH_ROTATION,
+    AGL_ANIM_PATH_SCALE,
+} agl_anim_path_t;
+
+typedef enum agl_anim_interpolation_t {
+    AGL_ANIM_INTERPOLATION_LINEAR,
+    AGL_ANIM_INTERPOLATION_STEP,
+    AGL_ANIM_INTERPOLATION_CUBICSPLINE, // glTF cubic Hermite spline, values are (in-tangent, value, out-tangent) triplets
+} agl_anim_interpolation_t;
+
+// One animated property of one joint
+typedef struct agl_anim_track_desc_t {
+    uint32_t joint;
+    agl_anim_path_t path;
+    agl_anim_interpolation_t interpolation;
+    uint32_t keyCount;
+    const float *times; // seconds, increasing
+    const float *values; // 3 floats per key, 4 (x, y, z, w) for rotations, three times as many for cubic splines
+    float tolerance; // largest error kept: a distance for translations and scales, an angle in radians for rotations. 0 for the clip default
+} agl_anim_track_desc_t;
+
+typedef struct agl_anim_clip_params_t {
+    float sampleRate; // rate tracks are resampled at before fitting, 0 for 30 Hz
+    float translationTolerance; // defaults for tracks without their own tolerance, 0 for 1e-3
+    float rotationTolerance;
+    float scaleTolerance;
+} agl_anim_clip_params_t;
+
+typedef struct agl_anim_clip_t agl_anim_clip_t;
+
+// Per joint local transforms, one array per component. The arrays hold `capacity` entries, `jointCount` rounded up to 8.
+typedef struct agl_anim_pose_t {
+    uint32_t jointCount;
+    uint32_t capacity;
+    float *tx, *ty, *tz;
+    float *rx, *ry, *rz, *rw;
+    float *sx, *sy, *sz;
+} agl_anim_pose_t;
+
+// Builds a clip for a skeleton of `jointCount` joints, `params` may be NULL. Returns NULL if a track is invalid.
+AGL_API agl_anim_clip_t *agl_anim_clip_create(uint32_t jointCount, const agl_anim_track_desc_t *tracks, uint32_t trackCount, const agl_anim_clip_params_t *params);
+AGL_API void agl_anim_clip_destroy(agl_anim_clip_t *clip);
+AGL_API float agl_anim_clip_duration(const agl_anim_clip_t *clip);
+// Bytes used by the clip, and the number of keys its tracks kept after fitting
+AGL_API size_t agl_anim_clip_size(const agl_anim_clip_t *clip);
+AGL_API uint32_t agl_anim_clip_key_count(const agl_anim_clip_t *clip);
+
+// Creates a pose with every joint at the identity
+AGL_API agl_anim_pose_t *agl_anim_pose_create(uint32_t jointCount);
+AGL_API void agl_anim_pose_destroy(agl_anim_pose_t *pose);
+AGL_API void agl_anim_pose_set_joint(agl_anim_pose_t *pose, uint32_t joint, const float pos[3], const float rot[4], const float scale[3]);
+AGL_API void agl_anim_pose_get_joint(const agl_anim_pose_t *pose, uint32_t joint, float pos[3], float rot[4], float scale[3]);
+AGL_API void agl_anim_pose_copy(agl_anim_pose_t *dst, const agl_anim_pose_t *src);
+
+// Samples `clip` at `time` seconds, wrapped to the clip duration. Only the animated properties are written, so a pose
+// initialised with the rest pose keeps it for the joints the clip does not animate.
+AGL_API void agl_anim_sample(const agl_anim_clip_t *clip, float time, agl_anim_pose_t *pose);
+// Samples one clip for many characters, `times[i]` into `poses[i]`
+AGL_API void agl_anim_sample_many(const agl_anim_clip_t *clip, const float *times, agl_anim_pose_t *const *poses, uint32_t count);
+// dst = a blended towards b by `weight` in [0, 1]: translations and scales are lerped, rotations nlerped along the
+// shortest arc. `dst` may be `a` or `b`, all three must have the same joint count.
+AGL_API void agl_anim_blend(agl_anim_pose_t *dst, const agl_anim_pose_t *a, const agl_anim_pose_t *b, float weight);
+
+#endif // AGL_ANIM_H
+
+#ifdef AGL_ANIM_IMPLEMENTATION
+
+#ifndef AGL_ANIM_IMPLEMENTED
+#define AGL_ANIM_IMPLEMENTED
+
+#include <immintrin.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agl_math.h"
+
+#define AGL__ANIM_DEFAULT_RATE 30.f
+#define AGL__ANIM_DEFAULT_TOLERANCE 1e-3f
+#define AGL__ANIM_MAX_FRAMES 65535u
+#define AGL__ANIM_QUAT_RANGE 0.70710678f // the smallest three components of a unit quaternion are within +-1/sqrt(2)
+#define AGL__ANIM_BATCH 64
+
+typedef struct agl__anim_track_t {
+    uint32_t joint;
+    uint32_t path;
+    uint32_t step;
+    uint32_t firstKey;
+    uint32_t keyCount;
+    float min[3]; // translations and scales: value = min + word * extent / 65535
+    float extent[3];
+} agl__anim_track_t;
+
+// Tracks are sorted rotations first, then translations, then scales, so sampling handles each kind in one run.
+// Every key has a frame number and 3 quantised words, all in the same allocation as the clip.
+struct agl_anim_clip_t {
+    float duration;
+    float sampleRate;
+    uint32_t jointCount;
+    uint32_t trackCount;
+    uint32_t rotationTrackCount;
+    uint32_t translationTrackCount;
+    uint32_t keyCount;
+    size_t size;
+    agl__anim_track_t *tracks;
+    uint16_t *frames;
+    uint16_t (*words)[3];
+};
+
+static uint32_t agl__AnimComponents(uint32_t path) {
+    return path == AGL_ANIM_PATH_ROTATION ? 4 : 3;
+}
+
+static void agl__AnimNormalize(float q[4]) {
+    float len = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    float inv = len > 0.f ? 1.f / len : 0.f;
+    for (int k = 0; k < 4; k++)
+        q[k] *= inv;
+    if (len <= 0.f)
+        q[3] = 1.f;
+}
+
+// Source track value at `time` with its own interpolation, clamped to the first and last key
+static void agl__AnimEvaluate(const agl_anim_track_desc_t *track, float time, float *out) {
+    uint32_t n = agl__AnimComponents(track->path);
+    uint32_t stride = track->interpolation == AGL_ANIM_INTERPOLATION_CUBICSPLINE ? 3 * n : n;
+    uint32_t offset = track->interpolation == AGL_ANIM_INTERPOLATION_CUBICSPLINE ? n : 0; // the value of a triplet
+    uint32_t last = track->keyCount - 1;
+    if (time <= track->times[0] || last == 0) {
+        memcpy(out, track->values + offset, n * sizeof(float));
+        return;
+    }
+    if (time >= track->times[last]) {
+        memcpy(out, track->values + last * stride + offset, n * sizeof(float));
+        return;
+    }
+    uint32_t lo = 0, hi = last;
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (track->times[mid] <= time)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    float dt = track->times[hi] - track->times[lo];
+    float s = dt > 0.f ? (time - track->times[lo]) / dt : 0.f;
+    const float *a = track->values + lo * stride, *b = track->values + hi * stride;
+    switch (track->interpolation) {
+    case AGL_ANIM_INTERPOLATION_STEP:
+        memcpy(out, a, n * sizeof(float));
+        return;
+    case AGL_ANIM_INTERPOLATION_CUBICSPLINE: {
+        float s2 = s * s, s3 = s2 * s;
+        float h00 = 2.f * s3 - 3.f * s2 + 1.f, h10 = (s3 - 2.f * s2 + s) * dt;
+        float h01 = -2.f * s3 + 3.f * s2, h11 = (s3 - s2) * dt;
+        for (uint32_t k = 0; k < n; k++)
+            out[k] = h00 * a[n + k] + h10 * a[2 * n + k] + h01 * b[n + k] + h11 * b[k];
+        break;
+    }
+    default:
+        if (track->path == AGL_ANIM_PATH_ROTATION) {
+            float sign = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0.f ? -1.f : 1.f;
+            for (uint32_t k = 0; k < 4; k++)
+                out[k] = a[k] + (sign * b[k] - a[k]) * s;
+        } else {
+            for (uint32_t k = 0; k < n; k++)
+                out[k] = a[k] + (b[k] - a[k]) * s;
+        }
+        break;
+    }
+    if (track->path == AGL_ANIM_PATH_ROTATION)
+        agl__AnimNormalize(out);
+}
+
+static uint16_t agl__AnimQuantize(float v, float min, float extent, float steps) {
+    float q = extent > 0.f ? (v - min) / extent * steps + 0.5f : 0.f;
+    return (uint16_t)(q < 0.f ? 0.f : q > steps ? steps : q);
+}
+
+// Smallest three: the largest component is dropped and rebuilt from the others, its index goes in the top bits of
+// the first two words
+static void agl__AnimPackQuat(uint16_t words[3], const float q[4]) {
+    uint32_t largest = 0;
+    for (uint32_t k = 1; k < 4; k++)
+        largest = fabsf(q[k]) > fabsf(q[largest]) ? k : largest;
+    float sign = q[largest] < 0.f ? -1.f : 1.f;
+    for (uint32_t k = 0, w = 0; k < 4; k++) {
+        if (k != largest)
+            words[w++] = agl__AnimQuantize(sign * q[k], -AGL__ANIM_QUAT_RANGE, 2.f * AGL__ANIM_QUAT_RANGE, 32767.f);
+    }
+    words[0] |= (uint16_t)((largest & 1) << 15);
+    words[1] |= (uint16_t)((largest >> 1) << 15);
+}
+
+static void agl__AnimUnpackQuat(float q[4], const uint16_t words[3]) {
+    uint32_t largest = (uint32_t)(words[0] >> 15) | (uint32_t)(words[1] >> 15) << 1;
+    float sum = 0.f;
+    for (uint32_t k = 0, w = 0; k < 4; k++) {
+        if (k == largest)
+            continue;
+        q[k] = (float)(words[w++] & 0x7FFF) * (2.f * AGL__ANIM_QUAT_RANGE / 32767.f) - AGL__ANIM_QUAT_RANGE;
+        sum += q[k] * q[k];
+    }
+    q[largest] = sqrtf(sum < 1.f ? 1.f - sum : 0.f);
+}
+
+static void agl__AnimUnpackVector(float v[3], const uint16_t words[3], const agl__anim_track_t *track) {
+    for (int k = 0; k < 3; k++)
+        v[k] = track->min[k] + (float)words[k] * (track->extent[k] / 65535.f);
+}
+
+// Distance between a value interpolated from the fitted keys and the source value, in the unit of the track's tolerance
+static float agl__AnimError(uint32_t path, const float *a, const float *b, float s, const float *reference) {
+    if (path == AGL_ANIM_PATH_ROTATION) {
+        float q[4];
+        float sign = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0.f ? -1.f : 1.f;
+        for (int k = 0; k < 4; k++)
+            q[k] = a[k] + (sign * b[k] - a[k]) * s;
+        agl__AnimNormalize(q);
+        float d = fabsf(q[0] * reference[0] + q[1] * reference[1] + q[2] * reference[2] + q[3] * reference[3]);
+        return 2.f * acosf(d < 1.f ? d : 1.f);
+    }
+    float d2 = 0.f;
+    for (int k = 0; k < 3; k++) {
+        float d = a[k] + (b[k] - a[k]) * s - reference[k];
+        d2 += d * d;
+    }
+    return sqrtf(d2);
+}
+
+// Greedy key reduction over the frames of one track: a key is kept where extending the current segment by one more
+// frame would interpolate some frame in between further than `tolerance` from its source value.
+// `source` holds the resampled values, `decoded` the same values after quantisation, which is what the keys will hold.
+static uint32_t agl__AnimFitKeys(uint32_t *keys, uint32_t path, uint32_t frameCount, const float *source, const float *decoded, float tolerance, uint32_t step) {
+    uint32_t n = agl__AnimComponents(path);
+    uint32_t keyCount = 0;
+    keys[keyCount++] = 0;
+    if (frameCount == 1)
+        return keyCount;
+    uint32_t start = 0;
+    for (uint32_t end = 2; end < frameCount; end++) {
+        int fits = 1;
+        for (uint32_t f = start + 1; f < end && fits; f++) {
+            float s = step ? 0.f : (float)(f - start) / (float)(end - start);
+            fits = agl__AnimError(path, decoded + n * start, decoded + n * end, s, source + n * f) <= tolerance;
+        }
+        if (!fits) {
+            start = end - 1;
+            keys[keyCount++] = start;
+        }
+    }
+    keys[keyCount++] = frameCount - 1;
+    return keyCount;
+}
+
+static int agl__AnimCompareTracks(const void *a, const void *b) {
+    static const int order[3] = { 1, 0, 2 }; // rotations, translations, scales
+    const agl_anim_track_desc_t *ta = *(const agl_anim_track_desc_t *const*)a, *tb = *(const agl_anim_track_desc_t *const*)b;
+    if (ta->path != tb->path)
+        return order[ta->path] - order[tb->path];
+    return ta->joint < tb->joint ? -1 : ta->joint > tb->joint;
+}
+
+agl_anim_clip_t *agl_anim_clip_create(uint32_t jointCount, const agl_anim_track_desc_t *tracks, uint32_t trackCount, const agl_anim_clip_params_t *params) {
+    float rate = params && params->sampleRate > 0.f ? params->sampleRate : AGL__ANIM_DEFAULT_RATE;
+    float tolerances[3] = {
+        params && params->translationTolerance > 0.f ? params->translationTolerance : AGL__ANIM_DEFAULT_TOLERANCE,
+        params && params->rotationTolerance > 0.f ? params->rotationTolerance : AGL__ANIM_DEFAULT_TOLERANCE,
+        params && params->scaleTolerance > 0.f ? params->scaleTolerance : AGL__ANIM_DEFAULT_TOLERANCE,
+    };
+    float duration = 0.f;
+    for (uint32_t t = 0; t < trackCount; t++) {
+        const agl_anim_track_desc_t *track = &tracks[t];
+        if (track->joint >= jointCount || (uint32_t)track->path > AGL_ANIM_PATH_SCALE || (uint32_t)track->interpolation > AGL_ANIM_INTERPOLATION_CUBICSPLINE ||
+            track->keyCount == 0 || !track->times || !track->values)
+            return NULL;
+        duration = track->times[track->keyCount - 1] > duration ? track->times[track->keyCount - 1] : duration;
+    }
+    uint32_t frameCount = (uint32_t)ceilf(duration * rate) + 1;
+    if (frameCount > AGL__ANIM_MAX_FRAMES) {
+        frameCount = AGL__ANIM_MAX_FRAMES;
+        rate = (float)(frameCount - 1) / duration;
+    }
+    const agl_anim_track_desc_t **sorted = (const agl_anim_track_desc_t**)malloc(trackCount * sizeof(*sorted) + 1);
+    for (uint32_t t = 0; t < trackCount; t++)
+        sorted[t] = &tracks[t];
+    qsort(sorted, trackCount, sizeof(*sorted), agl__AnimCompareTracks);
+    // Fit every track first, so the clip can be allocated at its final size
+    float *source = (float*)malloc(8 * frameCount * sizeof(float));
+    float *decoded = source + 4 * frameCount;
+    uint32_t *fittedCount = (uint32_t*)malloc(trackCount * sizeof(uint32_t) + 1);
+    uint32_t *fittedKeys = (uint32_t*)malloc((size_t)trackCount * frameCount * sizeof(uint32_t) + 1);
+    uint16_t (*fittedWords)[3] = (uint16_t(*)[3])malloc((size_t)trackCount * frameCount * sizeof(uint16_t[3]) + 1);
+    agl__anim_track_t *compiled = (agl__anim_track_t*)calloc(trackCount + 1, sizeof(agl__anim_track_t));
+    uint32_t totalKeys = 0;
+    for (uint32_t t = 0; t < trackCount; t++) {
+        const agl_anim_track_desc_t *desc = sorted[t];
+        agl__anim_track_t *track = &compiled[t];
+        uint32_t n = agl__AnimComponents(desc->path);
+        track->joint = desc->joint;
+        track->path = desc->path;
+        track->step = desc->interpolation == AGL_ANIM_INTERPOLATION_STEP;
+        for (uint32_t f = 0; f < frameCount; f++) {
+            agl__AnimEvaluate(desc, (float)f / rate, source + n * f);
+            // Keep neighbouring rotations in the same hemisphere, so the fitted segments take the short way round
+            if (n == 4 && f > 0) {
+                const float *prev = source + 4 * (f - 1);
+                float *q = source + 4 * f;
+                if (prev[0] * q[0] + prev[1] * q[1] + prev[2] * q[2] + prev[3] * q[3] < 0.f)
+                    for (int k = 0; k < 4; k++)
+                        q[k] = -q[k];
+            }
+        }
+        uint16_t (*words)[3] = fittedWords + (size_t)t * frameCount;
+        if (n == 4) {
+            for (uint32_t f = 0; f < frameCount; f++) {
+                agl__AnimPackQuat(words[f], source + 4 * f);
+                agl__AnimUnpackQuat(decoded + 4 * f, words[f]);
+            }
+        } else {
+            for (int k = 0; k < 3; k++) {
+                float lo = source[k], hi = source[k];
+                for (uint32_t f = 1; f < frameCount; f++) {
+                    lo = source[3 * f + k] < lo ? source[3 * f + k] : lo;
+                    hi = source[3 * f + k] > hi ? source[3 * f + k] : hi;
+                }
+                track->min[k] = lo;
+                track->extent[k] = hi - lo;
+            }
+            for (uint32_t f = 0; f < frameCount; f++) {
+                for (int k = 0; k < 3; k++)
+                    words[f][k] = agl__AnimQuantize(source[3 * f + k], track->min[k], track->extent[k], 65535.f);
+                agl__AnimUnpackVector(decoded + 3 * f, words[f], track);
+            }
+        }
+        float tolerance = desc->tolerance > 0.f ? desc->tolerance : tolerances[desc->path];
+        fittedCount[t] = agl__AnimFitKeys(fittedKeys + (size_t)t * frameCount, desc->path, frameCount, source, decoded, tolerance, track->step);
+        totalKeys += fittedCount[t];
+    }
+    size_t size = sizeof(agl_anim_clip_t) + trackCount * sizeof(agl__anim_track_t) + totalKeys * (sizeof(uint16_t) + sizeof(uint16_t[3]));
+    agl_anim_clip_t *clip = (agl_anim_clip_t*)malloc(size);
+    clip->duration = duration;
+    clip->sampleRate = rate;
+    clip->jointCount = jointCount;
+    clip->trackCount = trackCount;
+    clip->rotationTrackCount = 0;
+    clip->translationTrackCount = 0;
+    clip->keyCount = totalKeys;
+    clip->size = size;
+    clip->tracks = (agl__anim_track_t*)(clip + 1);
+    clip->words = (uint16_t(*)[3])(clip->tracks + trackCount);
+    clip->frames = (uint16_t*)(clip->words + totalKeys);
+    uint32_t key = 0;
+    for (uint32_t t = 0; t < trackCount; t++) {
+        agl__anim_track_t *track = &clip->tracks[t];
+        *track = compiled[t];
+        track->firstKey = key;
+        track->keyCount = fittedCount[t];
+        const uint32_t *frames = fittedKeys + (size_t)t * frameCount;
+        for (uint32_t k = 0; k < fittedCount[t]; k++, key++) {
+            clip->frames[key] = (uint16_t)frames[k];
+            memcpy(clip->words[key], fittedWords[(size_t)t * frameCount + frames[k]], sizeof(uint16_t[3]));
+        }
+        clip->rotationTrackCount += track->path == AGL_ANIM_PATH_ROTATION;
+        clip->translationTrackCount += track->path == AGL_ANIM_PATH_TRANSLATION;
+    }
+    free(compiled);
+    free(fittedWords);
+    free(fittedKeys);
+    free(fittedCount);
+    free(source);
+    free(sorted);
+    return clip;
+}
+
+void agl_anim_clip_destroy(agl_anim_clip_t *clip) {
+    free(clip);
+}
+
+float agl_anim_clip_duration(const agl_anim_clip_t *clip) {
+    return clip->duration;
+}
+
+size_t agl_anim_clip_size(const agl_anim_clip_t *clip) {
+    return clip->size;
+}
+
+uint32_t agl_anim_clip_key_count(const agl_anim_clip_t *clip) {
+    return clip->keyCount;
+}
+
+agl_anim_pose_t *agl_anim_pose_create(uint32_t jointCount) {
+    uint32_t capacity = (jointCount + 7) & ~7u;
+    agl_anim_pose_t *pose = (agl_anim_pose_t*)malloc(sizeof(agl_anim_pose_t) + 10 * capacity * sizeof(float));
+    float *data = (float*)(pose + 1);
+    pose->jointCount = jointCount;
+    pose->capacity = capacity;
+    float **streams[] = { &pose->tx, &pose->ty, &pose->tz, &pose->rx, &pose->ry, &pose->rz, &pose->rw, &pose->sx, &pose->sy, &pose->sz };
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++) {
+        *streams[i] = data + i * capacity;
+        float identity = i >= 6 ? 1.f : 0.f; // rw and the scales
+        for (uint32_t j = 0; j < capacity; j++)
+            (*streams[i])[j] = identity;
+    }
+    return pose;
+}
+
+void agl_anim_pose_destroy(agl_anim_pose_t *pose) {
+    free(pose);
+}
+
+void agl_anim_pose_set_joint(agl_anim_pose_t *pose, uint32_t joint, const float pos[3], const float rot[4], const float scale[3]) {
+    pose->tx[joint] = pos[0]; pose->ty[joint] = pos[1]; pose->tz[joint] = pos[2];
+    pose->rx[joint] = rot[0]; pose->ry[joint] = rot[1]; pose->rz[joint] = rot[2]; pose->rw[joint] = rot[3];
+    pose->sx[joint] = scale[0]; pose->sy[joint] = scale[1]; pose->sz[joint] = scale[2];
+}
+
+void agl_anim_pose_get_joint(const agl_anim_pose_t *pose, uint32_t joint, float pos[3], float rot[4], float scale[3]) {
+    pos[0] = pose->tx[joint]; pos[1] = pose->ty[joint]; pos[2] = pose->tz[joint];
+    rot[0] = pose->rx[joint]; rot[1] = pose->ry[joint]; rot[2] = pose->rz[joint]; rot[3] = pose->rw[joint];
+    scale[0] = pose->sx[joint]; scale[1] = pose->sy[joint]; scale[2] = pose->sz[joint];
+}
+
+void agl_anim_pose_copy(agl_anim_pose_t *dst, const agl_anim_pose_t *src) {
+    memcpy(dst->tx, src->tx, 10 * src->capacity * sizeof(float));
+}
+
+// Last key of a track at or before `frame`, and how far `frame` is towards the next one
+static uint32_t agl__AnimFindKey(const agl_anim_clip_t *clip, const agl__anim_track_t *track, float frame, float *s) {
+    const uint16_t *frames = clip->frames + track->firstKey;
+    uint32_t lo = 0, hi = track->keyCount - 1;
+    if (hi == 0 || frame >= (float)frames[hi]) {
+        *s = 0.f;
+        return hi;
+    }
+    // Branchless search for the last key at or before `frame`, the key count differs per track so branches mispredict
+    uint32_t count = hi;
+    while (count > 1) {
+        uint32_t half = count / 2;
+        lo = (float)frames[lo + half] <= frame ? lo + half : lo;
+        count -= half;
+    }
+    hi = lo + 1;
+    *s = track->step ? 0.f : (frame - (float)frames[lo]) / (float)(frames[hi] - frames[lo]);
+    return lo;
+}
+
+// 8 smallest-three rotations from their quantised words, the SIMD form of agl__AnimUnpackQuat
+static AGL_TARGET_AVX2 void agl__AnimUnpackQuat8(__m256 q[4], const uint32_t *w0, const uint32_t *w1, const uint32_t *w2) {
+    const __m256i mask = _mm256_set1_epi32(0x7FFF);
+    const __m256 scale = _mm256_set1_ps(2.f * AGL__ANIM_QUAT_RANGE / 32767.f), offset = _mm256_set1_ps(AGL__ANIM_QUAT_RANGE);
+    __m256i i0 = _mm256_loadu_si256((const __m256i*)w0), i1 = _mm256_loadu_si256((const __m256i*)w1), i2 = _mm256_loadu_si256((const __m256i*)w2);
+    __m256i largest = _mm256_or_si256(_mm256_srli_epi32(i0, 15), _mm256_slli_epi32(_mm256_srli_epi32(i1, 15), 1));
+    __m256 c0 = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(i0, mask)), scale), offset);
+    __m256 c1 = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(i1, mask)), scale), offset);
+    __m256 c2 = _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(i2, mask)), scale), offset);
+    __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c0, c0), _mm256_mul_ps(c1, c1)), _mm256_mul_ps(c2, c2));
+    __m256 d = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), sum), _mm256_setzero_ps()));
+    __m256 is0 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_setzero_si256()));
+    __m256 is1 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_set1_epi32(1)));
+    __m256 is2 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_set1_epi32(2)));
+    __m256 is3 = _mm256_castsi256_ps(_mm256_cmpeq_epi32(largest, _mm256_set1_epi32(3)));
+    // The stored components fill the other slots in order
+    q[0] = _mm256_blendv_ps(c0, d, is0);
+    q[1] = _mm256_blendv_ps(_mm256_blendv_ps(c1, c0, is0), d, is1);
+    q[2] = _mm256_blendv_ps(_mm256_blendv_ps(c2, c1, _mm256_or_ps(is0, is1)), d, is2);
+    q[3] = _mm256_blendv_ps(c2, d, is3);
+}
+
+// Decodes the key pairs of `n` rotation tracks and nlerps them by `s` along the shortest arc
+static void agl__AnimNlerpRotations(float out[4][AGL__ANIM_BATCH], uint32_t a[3][AGL__ANIM_BATCH], uint32_t b[3][AGL__ANIM_BATCH],
+    const float *s, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        const uint16_t wa[3] = { (uint16_t)a[0][i], (uint16_t)a[1][i], (uint16_t)a[2][i] };
+        const uint16_t wb[3] = { (uint16_t)b[0][i], (uint16_t)b[1][i], (uint16_t)b[2][i] };
+        float qa[4], qb[4], q[4];
+        agl__AnimUnpackQuat(qa, wa);
+        agl__AnimUnpackQuat(qb, wb);
+        float sign = qa[0] * qb[0] + qa[1] * qb[1] + qa[2] * qb[2] + qa[3] * qb[3] < 0.f ? -1.f : 1.f;
+        for (int c = 0; c < 4; c++)
+            q[c] = qa[c] + (sign * qb[c] - qa[c]) * s[i];
+        agl__AnimNormalize(q);
+        for (int c = 0; c < 4; c++)
+            out[c][i] = q[c];
+    }
+}
+
+// The same 8 tracks at a time, `n` is a multiple of 8
+static AGL_TARGET_AVX2 void agl__AnimNlerpRotationsAvx2(float out[4][AGL__ANIM_BATCH], uint32_t a[3][AGL__ANIM_BATCH], uint32_t b[3][AGL__ANIM_BATCH],
+    const float *s, uint32_t n) {
+    const __m256 signBit = _mm256_set1_ps(-0.f);
+    for (uint32_t i = 0; i < n; i += 8) {
+        __m256 qa[4], qb[4];
+        agl__AnimUnpackQuat8(qa, a[0] + i, a[1] + i, a[2] + i);
+        agl__AnimUnpackQuat8(qb, b[0] + i, b[1] + i, b[2] + i);
+        __m256 t = _mm256_loadu_ps(s + i);
+        __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(qa[0], qb[0]), _mm256_mul_ps(qa[1], qb[1])), _mm256_add_ps(_mm256_mul_ps(qa[2], qb[2]), _mm256_mul_ps(qa[3], qb[3])));
+        // Shortest arc: flip b where the dot product is negative
+        __m256 flip = _mm256_and_ps(dot, signBit);
+        __m256 q[4];
+        for (int c = 0; c < 4; c++)
+            q[c] = _mm256_fmadd_ps(_mm256_sub_ps(_mm256_xor_ps(qb[c], flip), qa[c]), t, qa[c]);
+        __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(q[0], q[0]), _mm256_mul_ps(q[1], q[1])), _mm256_add_ps(_mm256_mul_ps(q[2], q[2]), _mm256_mul_ps(q[3], q[3])));
+        __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(len2));
+        for (int c = 0; c < 4; c++)
+            _mm256_storeu_ps(out[c] + i, _mm256_mul_ps(q[c], inv));
+    }
+}
+
+// Up to AGL__ANIM_BATCH rotation tracks: the keys are found one track at a time, then decoded and nlerped together
+static void agl__AnimSampleRotations(const agl_anim_clip_t *clip, const agl__anim_track_t *tracks, uint32_t n, float frame, agl_anim_pose_t *pose, bool avx2) {
+    uint32_t a[3][AGL__ANIM_BATCH], b[3][AGL__ANIM_BATCH];
+    float s[AGL__ANIM_BATCH];
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t k = agl__AnimFindKey(clip, &tracks[i], frame, &s[i]);
+        uint32_t next = k + 1 < tracks[i].keyCount ? k + 1 : k;
+        const uint16_t *wa = clip->words[tracks[i].firstKey + k], *wb = clip->words[tracks[i].firstKey + next];
+        for (int c = 0; c < 3; c++) {
+            a[c][i] = wa[c];
+            b[c][i] = wb[c];
+        }
+    }
+    uint32_t padded = (n + 7) & ~7u;
+    for (uint32_t i = n; i < padded; i++) {
+        for (int c = 0; c < 3; c++)
+            a[c][i] = b[c][i] = 0;
+        s[i] = 0.f;
+    }
+    float out[4][AGL__ANIM_BATCH];
+    if (avx2)
+        agl__AnimNlerpRotationsAvx2(out, a, b, s, padded);
+    else
+        agl__AnimNlerpRotations(out, a, b, s, n);
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t j = tracks[i].joint;
+        pose->rx[j] = out[0][i];
+        pose->ry[j] = out[1][i];
+        pose->rz[j] = out[2][i];
+        pose->rw[j] = out[3][i];
+    }
+}
+
+// Lerps the key words of `n` translation or scale tracks by `s` and decodes the result: min + (wa + (wb - wa) * s) * step,
+// lerping the words saves decoding both keys
+static void agl__AnimLerpVectors(float out[3][AGL__ANIM_BATCH], uint32_t a[3][AGL__ANIM_BATCH], uint32_t b[3][AGL__ANIM_BATCH],
+    const float *s, float min[3][AGL__ANIM_BATCH], float step[3][AGL__ANIM_BATCH], uint32_t n) {
+    for (int c = 0; c < 3; c++) {
+        for (uint32_t i = 0; i < n; i++) {
+            float va = (float)a[c][i];
+            out[c][i] = min[c][i] + (va + ((float)b[c][i] - va) * s[i]) * step[c][i];
+        }
+    }
+}
+
+// The same 8 tracks at a time, `n` is a multiple of 8
+static AGL_TARGET_AVX2 void agl__AnimLerpVectorsAvx2(float out[3][AGL__ANIM_BATCH], uint32_t a[3][AGL__ANIM_BATCH], uint32_t b[3][AGL__ANIM_BATCH],
+    const float *s, float min[3][AGL__ANIM_BATCH], float step[3][AGL__ANIM_BATCH], uint32_t n) {
+    for (uint32_t i = 0; i < n; i += 8) {
+        __m256 t = _mm256_loadu_ps(s + i);
+        for (int c = 0; c < 3; c++) {
+            __m256 va = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(a[c] + i)));
+            __m256 vb = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(b[c] + i)));
+            __m256 v = _mm256_fmadd_ps(_mm256_sub_ps(vb, va), t, va);
+            _mm256_storeu_ps(out[c] + i, _mm256_fmadd_ps(v, _mm256_loadu_ps(step[c] + i), _mm256_loadu_ps(min[c] + i)));
+        }
+    }
+}
+
+// Up to AGL__ANIM_BATCH translation or scale tracks, decoded and lerped together into `dst`
+static void agl__AnimSampleVectors(const agl_anim_clip_t *clip, const agl__anim_track_t *tracks, uint32_t n, float frame, float *const dst[3], bool avx2) {
+    uint32_t a[3][AGL__ANIM_BATCH], b[3][AGL__ANIM_BATCH];
+    float s[AGL__ANIM_BATCH], min[3][AGL__ANIM_BATCH], step[3][AGL__ANIM_BATCH];
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t k = agl__AnimFindKey(clip, &tracks[i], frame, &s[i]);
+        uint32_t next = k + 1 < tracks[i].keyCount ? k + 1 : k;
+        const uint16_t *wa = clip->words[tracks[i].firstKey + k], *wb = clip->words[tracks[i].firstKey + next];
+        for (int c = 0; c < 3; c++) {
+            a[c][i] = wa[c];
+            b[c][i] = wb[c];
+            min[c][i] = tracks[i].min[c];
+            step[c][i] = tracks[i].extent[c] / 65535.f;
+        }
+    }
+    uint32_t padded = (n + 7) & ~7u;
+    for (uint32_t i = n; i < padded; i++) {
+        for (int c = 0; c < 3; c++) {
+            a[c][i] = b[c][i] = 0;
+            min[c][i] = step[c][i] = 0.f;
+        }
+        s[i] = 0.f;
+    }
+    float out[3][AGL__ANIM_BATCH];
+    if (avx2)
+        agl__AnimLerpVectorsAvx2(out, a, b, s, min, step, padded);
+    else
+        agl__AnimLerpVectors(out, a, b, s, min, step, n);
+    for (uint32_t i = 0; i < n; i++) {
+        for (int c = 0; c < 3; c++)
+            dst[c][tracks[i].joint] = out[c][i];
+    }
+}
+
+void agl_anim_sample(const agl_anim_clip_t *clip, float time, agl_anim_pose_t *pose) {
+    float t = clip->duration > 0.f ? fmodf(time, clip->duration) : 0.f;
+    if (t < 0.f)
+        t += clip->duration;
+    float frame = t * clip->sampleRate;
+    const agl__anim_track_t *tracks = clip->tracks;
+    uint32_t rotations = clip->rotationTrackCount;
+    uint32_t translations = clip->translationTrackCount;
+    uint32_t scales = clip->trackCount - rotations - translations;
+    float *const translationDst[3] = { pose->tx, pose->ty, pose->tz };
+    float *const scaleDst[3] = { pose->sx, pose->sy, pose->sz };
+    const bool avx2 = (agl_cpu_features() & AGL_CPU_FEATURE_AVX2_BIT) != 0;
+    for (uint32_t i = 0; i < rotations; i += AGL__ANIM_BATCH)
+        agl__AnimSampleRotations(clip, tracks + i, rotations - i < AGL__ANIM_BATCH ? rotations - i : AGL__ANIM_BATCH, frame, pose, avx2);
+    tracks += rotations;
+    for (uint32_t i = 0; i < translations; i += AGL__ANIM_BATCH)
+        agl__AnimSampleVectors(clip, tracks + i, translations - i < AGL__ANIM_BATCH ? translations - i : AGL__ANIM_BATCH, frame, translationDst, avx2);
+    tracks += translations;
+    for (uint32_t i = 0; i < scales; i += AGL__ANIM_BATCH)
+        agl__AnimSampleVectors(clip, tracks + i, scales - i < AGL__ANIM_BATCH ? scales - i : AGL__ANIM_BATCH, frame, scaleDst, avx2);
+}
+
+void agl_anim_sample_many(const agl_anim_clip_t *clip, const float *times, agl_anim_pose_t *const *poses, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++)
+        agl_anim_sample(clip, times[i], poses[i]);
+}
+
+static void agl__AnimBlendSse2(agl_anim_pose_t *dst, const agl_anim_pose_t *a, const agl_anim_pose_t *b, float weight) {
+    const __m128 t = _mm_set1_ps(weight);
+    const __m128 signBit = _mm_set1_ps(-0.f);
+    float *const dstVectors[6] = { dst->tx, dst->ty, dst->tz, dst->sx, dst->sy, dst->sz };
+    const float *const aVectors[6] = { a->tx, a->ty, a->tz, a->sx, a->sy, a->sz };
+    const float *const bVectors[6] = { b->tx, b->ty, b->tz, b->sx, b->sy, b->sz };
+    // Poses are padded to a multiple of 8 joints, so neither variant has a tail
+    for (uint32_t i = 0; i < dst->capacity; i += 4) {
+        for (int c = 0; c < 6; c++) {
+            __m128 va = _mm_loadu_ps(aVectors[c] + i), vb = _mm_loadu_ps(bVectors[c] + i);
+            _mm_storeu_ps(dstVectors[c] + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), t)));
+        }
+        __m128 ax = _mm_loadu_ps(a->rx + i), ay = _mm_loadu_ps(a->ry + i), az = _mm_loadu_ps(a->rz + i), aw = _mm_loadu_ps(a->rw + i);
+        __m128 bx = _mm_loadu_ps(b->rx + i), by = _mm_loadu_ps(b->ry + i), bz = _mm_loadu_ps(b->rz + i), bw = _mm_loadu_ps(b->rw + i);
+        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+        __m128 flip = _mm_and_ps(dot, signBit);
+        bx = _mm_xor_ps(bx, flip); by = _mm_xor_ps(by, flip); bz = _mm_xor_ps(bz, flip); bw = _mm_xor_ps(bw, flip);
+        __m128 x = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), t));
+        __m128 y = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), t));
+        __m128 z = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), t));
+        __m128 w = _mm_add_ps(aw, _mm_mul_ps(_mm_sub_ps(bw, aw), t));
+        __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+        __m128 inv = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(len2));
+        _mm_storeu_ps(dst->rx + i, _mm_mul_ps(x, inv));
+        _mm_storeu_ps(dst->ry + i, _mm_mul_ps(y, inv));
+        _mm_storeu_ps(dst->rz + i, _mm_mul_ps(z, inv));
+        _mm_storeu_ps(dst->rw + i, _mm_mul_ps(w, inv));
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__AnimBlendAvx2(agl_anim_pose_t *dst, const agl_anim_pose_t *a, const agl_anim_pose_t *b, float weight) {
+    const __m256 t = _mm256_set1_ps(weight);
+    const __m256 signBit = _mm256_set1_ps(-0.f);
+    float *const dstVectors[6] = { dst->tx, dst->ty, dst->tz, dst->sx, dst->sy, dst->sz };
+    const float *const aVectors[6] = { a->tx, a->ty, a->tz, a->sx, a->sy, a->sz };
+    const float *const bVectors[6] = { b->tx, b->ty, b->tz, b->sx, b->sy, b->sz };
+    for (uint32_t i = 0; i < dst->capacity; i += 8) {
+        for (int c = 0; c < 6; c++) {
+            __m256 va = _mm256_loadu_ps(aVectors[c] + i), vb = _mm256_loadu_ps(bVectors[c] + i);
+            _mm256_storeu_ps(dstVectors[c] + i, _mm256_add_ps(va, _mm256_mul_ps(_mm256_sub_ps(vb, va), t)));
+        }
+        __m256 ax = _mm256_loadu_ps(a->rx + i), ay = _mm256_loadu_ps(a->ry + i), az = _mm256_loadu_ps(a->rz + i), aw = _mm256_loadu_ps(a->rw + i);
+        __m256 bx = _mm256_loadu_ps(b->rx + i), by = _mm256_loadu_ps(b->ry + i), bz = _mm256_loadu_ps(b->rz + i), bw = _mm256_loadu_ps(b->rw + i);
+        __m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_add_ps(_mm256_mul_ps(az, bz), _mm256_mul_ps(aw, bw)));
+        __m256 flip = _mm256_and_ps(dot, signBit);
+        bx = _mm256_xor_ps(bx, flip); by = _mm256_xor_ps(by, flip); bz = _mm256_xor_ps(bz, flip); bw = _mm256_xor_ps(bw, flip);
+        __m256 x = _mm256_add_ps(ax, _mm256_mul_ps(_mm256_sub_ps(bx, ax), t));
+        __m256 y = _mm256_add_ps(ay, _mm256_mul_ps(_mm256_sub_ps(by, ay), t));
+        __m256 z = _mm256_add_ps(az, _mm256_mul_ps(_mm256_sub_ps(bz, az), t));
+        __m256 w = _mm256_add_ps(aw, _mm256_mul_ps(_mm256_sub_ps(bw, aw), t));
+        __m256 len2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_add_ps(_mm256_mul_ps(z, z), _mm256_mul_ps(w, w)));
+        __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(len2));
+        _mm256_storeu_ps(dst->rx + i, _mm256_mul_ps(x, inv));
+        _mm256_storeu_ps(dst->ry + i, _mm256_mul_ps(y, inv));
+        _mm256_storeu_ps(dst->rz + i, _mm256_mul_ps(z, inv));
+        _mm256_storeu_ps(dst->rw + i, _mm256_mul_ps(w, inv));
+    }
+}
+
+void agl_anim_blend(agl_anim_pose_t *dst, const agl_anim_pose_t *a, const agl_anim_pose_t *b, float weight) {
+    if (agl_cpu_features() & AGL_CPU_FEATURE_AVX2_BIT)
+        agl__AnimBlendAvx2(dst, a, b, weight);
+    else
+        agl__AnimBlendSse2(dst, a, b, weight);
+}
+
+#undef AGL__ANIM_DEFAULT_RATE
+#undef AGL__ANIM_DEFAULT_TOLERANCE
+#undef AGL__ANIM_MAX_FRAMES
+#undef AGL__ANIM_QUAT_RANGE
+#undef AGL__ANIM_BATCH
+
+#endif // AGL_ANIM_IMPLEMENTED
+
+#endif // AGL_ANIM_IMPLEMENTATION
@@ -109,8 +109,56 @@ enum agl_gfx_buffer_flag_bits {
     AGL_GFX_BUFFER_FLAG_DYNAMIC_BIT = 0x0001,
     AGL_GFX_BUFFER_FLAG_MAP_PERSISTENT_BIT = 0x0002,
     AGL_GFX_BUFFER_FLAG_MAP_COHERENT_BIT = 0x0004,
+    AGL_GFX_BUFFER_FLAG_MAP_WRITE_BIT = 0x0008,
 };
 
+enum agl_gfx_load_flag_bits {
+    AGL_GFX_LOAD_FLAG_CACHE_BIT = 0x0001, // Keep a binary cache of the decoded meshes next to the source file
+    AGL_GFX_LOAD_FLAG_OPTIMIZE_BIT = 0x0002, // Run agl_gfx_optimize_mesh on every loaded mesh
+    AGL_GFX_LOAD_FLAG_OPTIMIZE_OVERDRAW_BIT = 0x0004, // Also reorder for overdraw, implies AGL_GFX_LOAD_FLAG_OPTIMIZE_BIT
+    AGL_GFX_LOAD_FLAG_GENERATE_LODS_BIT = 0x0008, // Hand every mesh to the callback with AGL_GFX_MESH_FLAG_GENERATE_LODS_BIT set
+    AGL_GFX_LOAD_FLAG_MESHLETS_BIT = 0x0010, // Hand every mesh to the callback with AGL_GFX_MESH_FLAG_MESHLETS_BIT set
+};
+
+enum agl_gfx_mesh_flag_bits {
+    AGL_GFX_MESH_FLAG_GENERATE_LODS_BIT = 0x0001, // Build a chain of simplified index ranges, picked by agl_gfx_draw_mesh from the projected size
+    AGL_GFX_MESH_FLAG_OCCLUDER_BIT = 0x0002, // Keep a CPU copy of the triangles so draws of this mesh can hide others, see agl_gfx_set_occlusion_culling
+    AGL_GFX_MESH_FLAG_MESHLETS_BIT = 0x0004, // Split the triangles into meshlets that agl_gfx_draw_mesh culls one by one
+};
+
+enum agl_gfx_mesh_optimize_flag_bits {
+    AGL_GFX_MESH_OPTIMIZE_OVERDRAW_BIT = 0x0001,
+};
+
+#ifndef AGL_GFX_MAX_MESH_LODS
+#define AGL_GFX_MAX_MESH_LODS 6
+#endif
+
+// Resolution of the software depth buffer occluders are rasterised into, the width must be a multiple of 8
+#ifndef AGL_GFX_OCCLUSION_WIDTH
+#define AGL_GFX_OCCLUSION_WIDTH 256
+#endif
+#ifndef AGL_GFX_OCCLUSION_HEIGHT
+#define AGL_GFX_OCCLUSION_HEIGHT 128
+#endif
+
+// Size limits of the meshlets built for AGL_GFX_MESH_FLAG_MESHLETS_BIT
+#ifndef AGL_GFX_MESHLET_MAX_VERTICES
+#define AGL_GFX_MESHLET_MAX_VERTICES 64
+#endif
+#ifndef AGL_GFX_MESHLET_MAX_TRIANGLES
+#define AGL_GFX_MESHLET_MAX_TRIANGLES 124
+#endif
+
+// Largest simplification error, in pixels, that agl_gfx_draw_mesh accepts when picking a LOD
+#ifndef AGL_GFX_LOD_PIXEL_ERROR
+#define AGL_GFX_LOD_PIXEL_ERROR 1.0f
+#endif
+
+#ifndef AGL_GFX_MESH_CACHE_EXT
+#define AGL_GFX_MESH_CACHE_EXT ".aglmesh"
+#endif
+
 typedef struct agl_gfx_create_params_t {
     const char *appname;
     agl_uint width;
@@ -119,6 +167,7 @@ typedef struct agl_gfx_create_params_t {
     agl_uint bufferPoolSize;
     agl_uint meshPoolSize;
     agl_uint quadPoolSize;
+    agl_uint meshDrawPoolSize; // mesh draws queued for batched culling before they are flushed, defaults to 1024
     struct {
         void *allocationBase;
         agl_uint64 allocationSize;
@@ -129,7 +178,7 @@ typedef struct agl_gfx_image_params_t {
     agl_uint width;
     agl_uint height;
     agl_gfx_image_format_t format;
-    void *pixelData;
+    void *pixelData; // floats for the 16F formats, which are encoded to half floats on upload
 } agl_gfx_image_params_t;
 
 typedef struct agl_gfx_buffer_params_t {
@@ -145,9 +194,36 @@ typedef struct agl_gfx_mesh_params_t {
     agl_float *uvData;
     agl_float *normalData;
     agl_float *colorData;
+    agl_float *jointData; // 4 joint indices per vertex stored as whole numbers, into the palette of agl_gfx_draw_skinned_mesh
+    agl_float *weightData; // 4 joint weights per vertex summing to 1, required with jointData
     agl_uint *indexData;
+    agl_uint flags; // agl_gfx_mesh_flag_bits
 } agl_gfx_mesh_params_t;
 
+typedef struct agl_gfx_draw_stats_t {
+    agl_uint meshesSubmitted; // agl_gfx_draw_mesh calls
+    agl_uint meshesCulled; // of those, draws skipped because their bounding sphere was outside the camera frustum
+    agl_uint meshesOccluded; // of those, draws skipped because their bounding box was hidden behind occluders
+    agl_uint meshletsSubmitted; // meshlets of the full detail draws of AGL_GFX_MESH_FLAG_MESHLETS_BIT meshes that reached culling
+    agl_uint meshletsCulled; // of those, meshlets left out of the index stream for being off screen or back facing
+} agl_gfx_draw_stats_t;
+
+typedef struct agl_gfx_particles_params_t {
+    agl_gfx_buffer_t buffer; // holds the particle streams, e.g. the storage of an agl_phys_particles_t
+    agl_uint count; // particles to draw
+    agl_uint xOffset, yOffset, zOffset; // byte offsets of the float world space position streams
+    agl_uint sizeOffset; // byte offset of the float stream of billboard widths
+    agl_uint colorOffset; // byte offset of the agl_color stream
+    agl_gfx_image_t texture; // optional, multiplied by the colour
+} agl_gfx_particles_params_t;
+
+typedef struct agl_gfx_mesh_optimize_stats_t {
+    agl_uint vertexCountBefore;
+    agl_uint vertexCountAfter;
+    agl_float acmrBefore; // average post-transform cache misses per triangle
+    agl_float acmrAfter;
+} agl_gfx_mesh_optimize_stats_t;
+
 typedef enum agl_gfx_key_t {
     AGL_GFX_KEY_NONE,
     AGL_GFX_KEY_SPACE,
@@ -235,6 +311,12 @@ typedef struct agl_gfx_loader_t agl_gfx_loader_t;
 typedef struct agl_gfx_load_params_t agl_gfx_load_params_t;
 typedef void (*agl_gfx_loader_mesh_callback_func)(agl_gfx_context_t context, const agl_gfx_mesh_params_t *params, const char *name);
 typedef void (*agl_gfx_loader_image_callback_func)(agl_gfx_context_t context, const agl_gfx_image_params_t *params, const char *name);
+typedef struct agl_gfx_node_params_t agl_gfx_node_params_t;
+typedef void (*agl_gfx_loader_node_callback_func)(agl_gfx_context_t context, const agl_gfx_node_params_t *params, const char *name);
+typedef struct agl_gfx_skin_params_t agl_gfx_skin_params_t;
+typedef void (*agl_gfx_loader_skin_callback_func)(agl_gfx_context_t context, const agl_gfx_skin_params_t *params, const char *name);
+typedef struct agl_gfx_animation_params_t agl_gfx_animation_params_t;
+typedef void (*agl_gfx_loader_animation_callback_func)(agl_gfx_context_t context, const agl_gfx_animation_params_t *params, const char *name);
 typedef int (*agl_gfx_loader_load_func)(agl_gfx_context_t context, const char* path, agl_gfx_load_params_t *params);
 
 struct agl_gfx_loader_t {
@@ -243,11 +325,58 @@ struct agl_gfx_loader_t {
 	unsigned char reserved[8];
 };
 
+// A node of the file's transform hierarchy, e.g. to build an agl_scene.h scene from.
+// Nodes are reported after all meshes of the load, parents before their children.
+struct agl_gfx_node_params_t {
+	int parent; // index of the parent among the nodes reported by this load, -1 for roots
+	agl_float3 pos;
+	agl_float4 rot; // quaternion (x, y, z, w)
+	agl_float3 scale;
+	int firstMesh; // index of the node's first mesh among the meshCallback calls of this load, -1 if it has none
+	agl_uint meshCount;
+	int skin; // index of the skin posing the node's meshes among the skinCallback calls of this load, -1 if it has none
+};
+
+// A skeleton of the file, reported after the nodes. The palette of agl_gfx_draw_skinned_mesh is built from it: palette[j] is the
+// inverse world matrix of the mesh node times the world matrix of jointNodes[j] times inverse bind matrix j.
+struct agl_gfx_skin_params_t {
+	agl_uint jointCount;
+	const int *jointNodes; // index of each joint among the nodes reported by this load
+	const agl_float *inverseBindMatrices; // 16 floats per joint, column-major, NULL when they are all identity
+};
+
+// One keyframed property of a node. The path and interpolation values match agl_anim_path_t and agl_anim_interpolation_t,
+// so a channel maps directly onto an agl_anim_track_desc_t.
+typedef struct agl_gfx_animation_channel_t {
+	int node; // index of the animated node among the nodes reported by this load
+	agl_uint path; // 0 translation, 1 rotation, 2 scale
+	agl_uint interpolation; // 0 linear, 1 step, 2 cubic spline
+	agl_uint keyCount;
+	const agl_float *times; // seconds
+	const agl_float *values; // 3 floats per key, 4 for rotations, three times as many for cubic splines
+} agl_gfx_animation_channel_t;
+
+// An animation of the file, reported after the skins
+struct agl_gfx_animation_params_t {
+	agl_uint channelCount;
+	const agl_gfx_animation_channel_t *channels;
+};
+
 struct agl_gfx_load_params_t {
 	agl_gfx_loader_mesh_callback_func meshCallback;
 	agl_gfx_loader_image_callback_func imageCallback;
+	agl_uint flags; // agl_gfx_load_flag_bits
+	agl_gfx_loader_node_callback_func nodeCallback; // optional, the mesh cache does not store nodes so it is bypassed when set
+	agl_gfx_loader_skin_callback_func skinCallback; // optional, bypasses the mesh cache like nodeCallback
+	agl_gfx_loader_animation_callback_func animationCallback; // optional, bypasses the mesh cache like nodeCallback
 };
 
+typedef struct agl_gfx_file_map_t {
+    const void *data;
+    agl_uint64 size;
+    void *handle;
+} agl_gfx_file_map_t;
+
 typedef agl_float agl_gfx_time_t;
 typedef void (*agl_gfx_update_func)(agl_gfx_context_t context, agl_gfx_time_t deltaTime);
 typedef void (*agl_gfx_user_pointer_delete_func)(void *udata);
@@ -335,16 +464,54 @@ AGL_API agl_gfx_buffer_t agl_gfx_create_buffer(agl_gfx_context_t context, const
 /// @param context The graphics context in which the buffer was created
 /// @param buffer The buffer to destroy
 AGL_API void agl_gfx_destroy_buffer(agl_gfx_context_t context, agl_gfx_buffer_t buffer);
+/// @brief Maps the storage of a buffer into client memory so that it can be written directly without an intermediate copy
+/// @note The buffer must have been created with `AGL_GFX_BUFFER_FLAG_MAP_WRITE_BIT`. Buffers created with
+///   `AGL_GFX_BUFFER_FLAG_MAP_PERSISTENT_BIT` stay mapped until they are destroyed and return the same pointer every time.
+/// @param context The graphics context in which the buffer was created
+/// @param buffer The buffer to map
+/// @return A pointer to the start of the buffer storage, or NULL on failure
+AGL_API void* agl_gfx_map_buffer(agl_gfx_context_t context, agl_gfx_buffer_t buffer);
+/// @brief Unmaps a buffer previously mapped with `agl_gfx_map_buffer`. Does nothing for persistently mapped buffers.
+/// @param context The graphics context in which the buffer was created
+/// @param buffer The buffer to unmap
+AGL_API void agl_gfx_unmap_buffer(agl_gfx_context_t context, agl_gfx_buffer_t buffer);
+/// @brief Blocks until the GPU has finished the draws that read a buffer, e.g. `agl_gfx_draw_particles`.
+///   A persistently mapped buffer must be waited on before it is written again, unless the draws have been waited on already.
+/// @param context The graphics context in which the buffer was created
+/// @param buffer The buffer to wait on
+AGL_API void agl_gfx_wait_buffer(agl_gfx_context_t context, agl_gfx_buffer_t buffer);
 
 /// @brief Creates a new mesh in the specified graphics context with the given parameters
+///   The vertex streams are written straight into the mapped GPU buffer, so the attribute arrays can point
+///   to caller-owned or memory-mapped data and no scratch memory is used.
+///   With AGL_GFX_MESH_FLAG_GENERATE_LODS_BIT an indexed mesh also gets up to AGL_GFX_MAX_MESH_LODS - 1 simplified levels,
+///   each with about half the triangles of the previous one, stored after the full index range in the same index buffer.
+///   Simplification only collapses vertices onto existing neighbours, so open borders and attribute seams are kept intact.
+///   With AGL_GFX_MESH_FLAG_MESHLETS_BIT the triangles of an indexed mesh are grouped, in index order, into meshlets of at most
+///   AGL_GFX_MESHLET_MAX_VERTICES vertices and AGL_GFX_MESHLET_MAX_TRIANGLES triangles, each with a bounding sphere and normal cone.
+///   Full detail draws then only submit the meshlets that are on screen and front facing. Run agl_gfx_optimize_mesh first so
+///   neighbouring triangles are close in the index buffer, otherwise meshlets are scattered and rarely culled.
 /// @param context The graphics context in which to create the mesh
 /// @param params Pointer to a structure containing the parameters for creating the mesh
-/// @return A handle to the created mesh, or NULL on failure
+/// @return A handle to the created mesh, or NULL on failure, including when an index is not below `vertexCount` or the vertex
+///   buffer cannot be mapped
 AGL_API agl_gfx_mesh_t agl_gfx_create_mesh(agl_gfx_context_t context, const agl_gfx_mesh_params_t *params);
 /// @brief Destroys a mesh in the specified graphics context
 /// @param context The graphics context in which the mesh was created
 /// @param mesh The mesh to destroy
 AGL_API void agl_gfx_destroy_mesh(agl_gfx_context_t context, agl_gfx_mesh_t mesh);
+/// @brief Optimises a triangle list mesh for rendering: welds bit-identical vertices, reorders triangles for the post-transform
+///   vertex cache (Forsyth), optionally reorders triangle clusters to reduce overdraw, and renumbers vertices in order of first use
+/// @note Non-indexed meshes are treated as one index per vertex and come out indexed.
+/// @param params The mesh to optimise
+/// @param flags Combination of agl_gfx_mesh_optimize_flag_bits
+/// @param optimized Receives the optimised mesh, which must be released with `agl_gfx_free_optimized_mesh`
+/// @param stats Optional, receives vertex counts and ACMR before and after
+/// @return AGL_GFX_SUCCESS on success, AGL_GFX_ERROR if the mesh is not a triangle list or an index is not below `vertexCount`
+AGL_API int agl_gfx_optimize_mesh(const agl_gfx_mesh_params_t *params, agl_uint flags, agl_gfx_mesh_params_t *optimized, agl_gfx_mesh_optimize_stats_t *stats);
+/// @brief Releases the streams of a mesh produced by `agl_gfx_optimize_mesh`
+/// @param optimized The mesh to release
+AGL_API void agl_gfx_free_optimized_mesh(agl_gfx_mesh_params_t *optimized);
 
 // Camera control
 
@@ -376,13 +543,95 @@ AGL_API void agl_gfx_set_camera_perspective(agl_gfx_canvas_t canvas, agl_float f
 
 AGL_API void agl_gfx_clear(agl_gfx_canvas_t canvas, agl_float r, agl_float g, agl_float b, agl_float a);
 AGL_API void agl_gfx_draw_screen_quad(agl_gfx_canvas_t canvas, const agl_float2 pos, const agl_float2 size, agl_float angle, agl_color color, agl_gfx_image_t texture);
+/// @brief Queues a mesh draw. Queued draws are frustum culled in batches against their bounding spheres, and the visible ones are
+///   submitted in order when the queue fills up, when the camera changes and at the end of the frame.
+/// @param canvas The canvas to draw to
+/// @param mesh The mesh to draw
+/// @param pos World space position
+/// @param rot World space rotation as a quaternion (x, y, z, w)
+/// @param scale Uniform scale
+/// @param color Tint colour, or NULL for white
 AGL_API void agl_gfx_draw_mesh(agl_gfx_canvas_t canvas, agl_gfx_mesh_t mesh, const agl_float3 pos, const agl_float4 rot, agl_float scale, const agl_float4 color);
+/// @brief Queues `count` instances of a mesh, each with its own world matrix, e.g. gathered with agl_scene_gather_world.
+///   Instances are frustum culled one by one and the visible ones of a call are drawn with a single instanced draw,
+///   always from the full detail index range.
+/// @param canvas The canvas to draw to
+/// @param mesh The mesh to draw
+/// @param transforms `count` column-major 4x4 world matrices, 4 columns each, copied before the call returns
+/// @param count Number of instances
+/// @param color Tint colour shared by the instances, or NULL for white
+AGL_API void agl_gfx_draw_mesh_instanced(agl_gfx_canvas_t canvas, agl_gfx_mesh_t mesh, const agl_float4 *transforms, agl_uint count, const agl_float4 color);
+/// @brief Queues a draw of a mesh created with joint and weight data, posed by a joint palette.
+///   Every vertex is moved by the weighted blend of its joints' palette matrices in the vertex shader, then by the draw transform.
+///   The palettes of the skinned draws of a flush are uploaded together into one storage buffer.
+/// @note Culling uses a sphere enclosing the mesh bounds under every palette matrix, and skinned draws skip meshlet culling.
+///   Skinned occluders are posed on the CPU with agl_skin_vertices before they are rasterised.
+/// @param canvas The canvas to draw to
+/// @param mesh The mesh to draw
+/// @param pos World space position
+/// @param rot World space rotation as a quaternion (x, y, z, w)
+/// @param scale Uniform scale
+/// @param color Tint colour, or NULL for white
+/// @param joints `jointCount` column-major 4x4 matrices taking the bind pose to the current pose in mesh space, i.e. the inverse
+///   world matrix of the mesh node times the joint world matrix times the inverse bind matrix. Copied before the call returns.
+/// @param jointCount Number of palette matrices, every joint index of the mesh must be below it
+AGL_API void agl_gfx_draw_skinned_mesh(agl_gfx_canvas_t canvas, agl_gfx_mesh_t mesh, const agl_float3 pos, const agl_float4 rot, agl_float scale, const agl_float4 color,
+    const agl_float4 *joints, agl_uint jointCount);
+/// @brief Draws camera facing particles straight from the separate x[], y[], z[], size[] and color[] arrays of a buffer.
+///   Nothing is copied: with a buffer created with AGL_GFX_BUFFER_FLAG_MAP_WRITE_BIT, AGL_GFX_BUFFER_FLAG_MAP_PERSISTENT_BIT and
+///   AGL_GFX_BUFFER_FLAG_MAP_COHERENT_BIT, the mapped pointer can be handed to agl_phys_particles_create as its storage
+///   and the simulation writes the data the GPU reads.
+/// @note Mesh draws queued so far are drawn first. The particles are depth tested and blended without writing depth, so opaque
+///   geometry should be queued before them. The draw fences the buffer: call `agl_gfx_wait_buffer` before updating it again.
+/// @param canvas The canvas to draw to
+/// @param params The buffer, the particle count and the byte offsets of the streams, all multiples of 4
+AGL_API void agl_gfx_draw_particles(agl_gfx_canvas_t canvas, const agl_gfx_particles_params_t *params);
+/// @brief Enables or disables occlusion culling of mesh draws.
+///   While enabled, the draws of meshes created with AGL_GFX_MESH_FLAG_OCCLUDER_BIT are recorded each frame. At the start of the
+///   next frame a worker thread rasterises them at AGL_GFX_OCCLUSION_WIDTH x AGL_GFX_OCCLUSION_HEIGHT into a software depth buffer
+///   and builds a max depth pyramid, in parallel with the update callback. Draws whose bounding box is behind that pyramid are skipped.
+/// @note The pyramid is built from the previous frame's camera and occluder transforms, so very fast camera motion can hide an
+///   object for a frame. Occluders should be closed, counter-clockwise wound and must not extend beyond what they actually hide.
+///   Only the first camera drawn each frame is occlusion culled, draws made after switching to another camera (split screen,
+///   a second view) are frustum culled only, so the main view should be drawn first.
+/// @param canvas The canvas to configure
+/// @param enabled AGL_TRUE to enable occlusion culling
+AGL_API void agl_gfx_set_occlusion_culling(agl_gfx_canvas_t canvas, agl_bool enabled);
+/// @brief Retrieves the draw counters of the last completed frame
+/// @param canvas The canvas to query
+/// @param stats Receives the number of submitted, frustum culled and occluded mesh draws
+AGL_API void agl_gfx_get_draw_stats(agl_gfx_canvas_t canvas, agl_gfx_draw_stats_t *stats);
 AGL_API void agl_gfx_draw_text(agl_gfx_canvas_t canvas, const agl_float2 startpos, agl_float height, agl_color color, const char *text);
 
+// File mapping
+
+/// @brief Maps a file read-only into memory, so that loaders can reference its contents without reading it into a heap copy
+/// @param path Path of the file to map
+/// @param map Pointer to a structure that will receive the mapped address and size of the file
+/// @return AGL_GFX_SUCCESS on success, AGL_GFX_ERROR if the file could not be opened or mapped
+AGL_API int agl_gfx_map_file(const char *path, agl_gfx_file_map_t *map);
+/// @brief Unmaps a file previously mapped with `agl_gfx_map_file`. All pointers into the mapping become invalid.
+/// @param map The mapping to release
+AGL_API void agl_gfx_unmap_file(agl_gfx_file_map_t *map);
+
 // Loader
 
 AGL_API void agl_gfx_register_loader(agl_gfx_context_t context, agl_gfx_loader_t *loader);
 // AGL_API agl_gfx_loader_t* agl_gfx_find_loader(const char *ext);
+/// @brief Reports a file a loader reads besides the one it was given, such as an external buffer, so the mesh cache tracks it
+/// @note Loaders should call this for every such file before decoding it. Outside of a cached `agl_gfx_load_file` it does nothing.
+/// @param context The context the loader was called with
+/// @param path Path of the file, as the loader opens it
+AGL_API void agl_gfx_loader_add_dependency(agl_gfx_context_t context, const char *path);
+/// @brief Loads a file with the loader registered for its extension, reporting its contents through the callbacks in `params`
+/// @note With `AGL_GFX_LOAD_FLAG_CACHE_BIT` the decoded meshes are also written to `<path>` AGL_GFX_MESH_CACHE_EXT. As long as the
+///   source file and the files the loader reported with `agl_gfx_loader_add_dependency` are unchanged, later loads map the cache
+///   and pass pointers into it to `meshCallback` without running the loader. A file counts as unchanged when its size matches
+///   and either its modification time or its content hash does. Images are not cached.
+/// @param context The graphics context passed on to the loader and callbacks
+/// @param path Path of the file to load
+/// @param params Callbacks and flags for the load
+/// @return 1 on success, 0 on failure
 AGL_API int agl_gfx_load_file(agl_gfx_context_t context, const char *path, agl_gfx_load_params_t *params);
 
 // Debug utilities
@@ -397,10 +646,15 @@ AGL_API void agl_gfxh_show_font_texture(agl_gfx_canvas_t canvas, const agl_float
 
 #define _CRT_SECURE_NO_WARNINGS
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include "agl_math.h"
+
 #if AGL_GFX_ENABLE_ASSERTS
 #include <stdio.h>
 #define agl__gfx_errorf(fmt,...) (printf("[Error] %s:%d : " fmt "\n", __FUNCTION__, __LINE__, ##__VA_ARGS__))
@@ -451,6 +705,11 @@ static void agl__ScratchFree(agl__ScratchAllocator *allocator) {
 #elif defined(__linux__) || defined(__unix__)
 #   define GL_GLEXT_PROTOTYPES
 #   include <GL/gl.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <pthread.h>
 #endif
 
 #if defined(_WIN32)
@@ -469,11 +728,13 @@ typedef uint8_t GLubyte;
 typedef uint64_t GLuint64;
 typedef int64_t GLsizeiptr;
 typedef int64_t GLintptr;
+typedef struct __GLsync *GLsync;
 // OpenGL function forward declarations
 GLAPI void APIENTRY glDisable (GLenum cap);
 GLAPI void APIENTRY glEnable (GLenum cap);
 GLAPI void APIENTRY glBlendFunc (GLenum sfactor, GLenum dfactor);
 GLAPI void APIENTRY glDepthFunc (GLenum func);
+GLAPI void APIENTRY glDepthMask (GLboolean flag);
 GLAPI void APIENTRY glCullFace (GLenum mode);
 GLAPI void APIENTRY glFrontFace (GLenum mode);
 GLAPI void APIENTRY glDeleteTextures (GLsizei n, const GLuint *textures);
@@ -506,8 +767,11 @@ typedef void (APIENTRY *PFNGLCREATEBUFFERSPROC) (GLsizei n, GLuint *buffers);
 typedef void (APIENTRY *PFNGLDELETEBUFFERSPROC) (GLsizei n, const GLuint *buffers);
 typedef void (APIENTRY *PFNGLNAMEDBUFFERSTORAGEPROC) (GLuint buffer, GLsizeiptr size, const void *data, GLbitfield flags);
 typedef void (APIENTRY *PFNGLNAMEDBUFFERSUBDATAPROC) (GLuint buffer, GLintptr offset, GLsizeiptr size, const void *data);
+typedef void *(APIENTRY *PFNGLMAPNAMEDBUFFERRANGEPROC) (GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access);
+typedef GLboolean (APIENTRY *PFNGLUNMAPNAMEDBUFFERPROC) (GLuint buffer);
 typedef void (APIENTRY *PFNGLBINDBUFFERPROC) (GLenum target, GLuint buffer);
 typedef void (APIENTRY *PFNGLBINDBUFFERBASEPROC) (GLenum target, GLuint index, GLuint buffer);
+typedef void (APIENTRY *PFNGLPROGRAMUNIFORM1IPROC) (GLuint program, GLint location, GLint v0);
 typedef void (APIENTRY *PFNGLPROGRAMUNIFORM2FPROC) (GLuint program, GLint location, GLfloat v0, GLfloat v1);
 typedef void (APIENTRY *PFNGLPROGRAMUNIFORM4FVPROC) (GLuint program, GLint location, GLsizei count, const GLfloat *value);
 typedef void (APIENTRY *PFNGLPROGRAMUNIFORM4UIVPROC) (GLuint program, GLint location, GLsizei count, const GLuint *value);
@@ -521,6 +785,11 @@ typedef void (APIENTRY *PFNGLMAKETEXTUREHANDLERESIDENTARBPROC) (GLuint64 handle)
 typedef void (APIENTRY *PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC) (GLuint64 handle);
 typedef void (APIENTRY *PFNGLBINDTEXTUREUNITPROC) (GLuint unit, GLuint texture);
 typedef void (APIENTRY *PFNGLOBJECTLABELPROC) (GLenum identifier, GLuint name, GLsizei length, const GLchar *label);
+typedef void (APIENTRY *PFNGLDRAWARRAYSINSTANCEDPROC) (GLenum mode, GLint first, GLsizei count, GLsizei instancecount);
+typedef void (APIENTRY *PFNGLDRAWELEMENTSINSTANCEDPROC) (GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount);
+typedef GLsync (APIENTRY *PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRY *PFNGLCLIENTWAITSYNCPROC) (GLsync sync, GLbitfield flags, GLuint64 timeout);
+typedef void (APIENTRY *PFNGLDELETESYNCPROC) (GLsync sync);
 // OpenGL constants
 #define GL_FALSE                          0
 #define GL_TRUE                           1
@@ -577,6 +846,9 @@ typedef void (APIENTRY *PFNGLOBJECTLABELPROC) (GLenum identifier, GLuint name, G
 #define GL_COMPILE_STATUS                 0x8B81
 #define GL_LINK_STATUS                    0x8B82
 
+#define GL_MAP_READ_BIT                   0x0001
+#define GL_MAP_WRITE_BIT                  0x0002
+#define GL_MAP_INVALIDATE_BUFFER_BIT      0x0008
 #define GL_MAP_PERSISTENT_BIT             0x0040
 #define GL_MAP_COHERENT_BIT               0x0080
 #define GL_DYNAMIC_STORAGE_BIT            0x0100
@@ -607,6 +879,7 @@ typedef void (APIENTRY *PFNGLOBJECTLABELPROC) (GLenum identifier, GLuint name, G
 #define GL_INT                            0x1404
 #define GL_UNSIGNED_INT                   0x1405
 #define GL_FLOAT                          0x1406
+#define GL_HALF_FLOAT                     0x140B
 
 #define GL_TEXTURE                        0x1702
 #define GL_TEXTURE_2D                     0x0DE1
@@ -626,6 +899,11 @@ typedef void (APIENTRY *PFNGLOBJECTLABELPROC) (GLenum identifier, GLuint name, G
 #define GL_SHADER_STORAGE_BUFFER          0x90D2
 #define GL_ELEMENT_ARRAY_BUFFER           0x8893
 
+#define GL_SYNC_GPU_COMMANDS_COMPLETE     0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT        0x00000001
+#define GL_TIMEOUT_EXPIRED                0x911B
+#define GL_WAIT_FAILED                    0x911D
+
 #define GL_DEBUG_OUTPUT_SYNCHRONOUS       0x8242
 #define GL_DEBUG_TYPE_ERROR               0x824C
 #define GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR 0x824D
@@ -755,14 +1033,74 @@ typedef struct agl__gfx_buffer_t {
     agl_id id;
     GLuint buf;
     agl_uint size;
+    agl_uint flags;
+    void *mapped;
+    GLsync fence; // set by the last draw that reads the buffer, cleared by agl_gfx_wait_buffer
 } agl__gfx_buffer_t;
 
+typedef struct agl__gfx_mesh_lod_t {
+    agl_uint indexOffset;
+    agl_uint indexCount;
+    agl_float error; // object space deviation from the full resolution mesh
+} agl__gfx_mesh_lod_t;
+
+typedef struct agl__gfx_meshlet_t {
+    agl_uint indexOffset;
+    agl_uint triangleCount;
+    agl_float center[3];
+    agl_float radius;
+    agl_float coneAxis[3]; // average normal, all triangle normals are within the cone angle of it
+    agl_float coneCos; // cosine of the cone angle, <= 0 when the normals span a half space or more
+    agl_float coneSin;
+} agl__gfx_meshlet_t;
+
+// Instances queued by one agl_gfx_draw_mesh_instanced call, their matrices are canvas->instanceTransforms[first..first+count)
+typedef struct agl__gfx_instance_batch_t {
+    agl_gfx_mesh_t mesh;
+    agl_uint first;
+    agl_uint count;
+    agl_float4 color;
+} agl__gfx_instance_batch_t;
+
+// Index range a visible mesh draw is submitted with, from the mesh index buffer or from the per frame meshlet stream
+typedef struct agl__gfx_draw_range_t {
+    agl_bool stream;
+    agl_uint first;
+    agl_uint count;
+} agl__gfx_draw_range_t;
+
+typedef struct agl__gfx_mesh_draw_t {
+    agl_gfx_mesh_t mesh;
+    agl_float3 pos;
+    agl_float4 rot;
+    agl_float scale;
+    agl_float4 color;
+    agl_uint jointFirst; // palette of a skinned draw in canvas->joints
+    agl_uint jointCount; // 0 for rigid draws
+} agl__gfx_mesh_draw_t;
+
 typedef struct agl__gfx_mesh_t {
     agl_id id;
     agl_id vertexBufId;
     GLuint ibo;
     agl_uint vertexCount;
     agl_uint indexCount;
+    agl_float boundsMin[3];
+    agl_float boundsMax[3];
+    agl_float boundsCenter[3];
+    agl_float boundsRadius;
+    agl_uint lodCount;
+    agl__gfx_mesh_lod_t lods[AGL_GFX_MAX_MESH_LODS];
+    // CPU copy of the triangles for AGL_GFX_MESH_FLAG_OCCLUDER_BIT, positions, skinning streams and indices in one allocation
+    agl_float *occluderPositions;
+    agl_float *occluderJoints; // NULL unless the mesh is skinned
+    agl_float *occluderWeights;
+    agl_uint *occluderIndices;
+    agl_uint occluderIndexCount;
+    // AGL_GFX_MESH_FLAG_MESHLETS_BIT: meshlets followed by a CPU copy of the full detail indices, in one allocation
+    agl__gfx_meshlet_t *meshlets;
+    agl_uint *meshletIndices;
+    agl_uint meshletCount;
 } agl__gfx_mesh_t;
 
 typedef struct agl__gfx_loader_t {
@@ -771,6 +1109,59 @@ typedef struct agl__gfx_loader_t {
 	struct agl__gfx_loader_t *next;
 } agl__gfx_loader_t;
 
+// Mesh cache file: header | entries | dependencies | payload
+// Each payload holds the vertex buffer exactly as agl_gfx_create_mesh uploads it (agl__gfx_mesh_buffer_info_t followed by
+// the attribute streams), then the indices and the mesh name, each aligned to AGL__MESH_CACHE_ALIGN.
+// The dependencies stamp the source file and every file the loader reported, their paths are stored in the payload.
+#define AGL__MESH_CACHE_MAGIC 0x4D4C4741 // "AGLM"
+#define AGL__MESH_CACHE_VERSION 3
+#define AGL__MESH_CACHE_ALIGN 64
+
+typedef struct agl__gfx_mesh_cache_header_t {
+    agl_uint magic;
+    agl_uint version;
+    agl_uint bufferInfoSize; // rejects caches written with a different buffer layout
+    agl_uint loadFlags;
+    agl_uint64 pathHash;
+    agl_uint meshCount;
+    agl_uint dependencyCount;
+} agl__gfx_mesh_cache_header_t;
+
+// A file is unchanged when its size and modification time match, or its size and content hash do after a touch or a copy
+typedef struct agl__gfx_mesh_cache_stamp_t {
+    agl_uint64 size;
+    agl_uint64 time;
+    agl_uint64 hash;
+} agl__gfx_mesh_cache_stamp_t;
+
+typedef struct agl__gfx_mesh_cache_dependency_t {
+    agl__gfx_mesh_cache_stamp_t stamp;
+    agl_uint64 pathOffset;
+} agl__gfx_mesh_cache_dependency_t;
+
+typedef struct agl__gfx_mesh_cache_entry_t {
+    agl_uint64 vertexOffset;
+    agl_uint64 indexOffset;
+    agl_uint64 nameOffset;
+    agl_uint vertexSize;
+    agl_uint vertexCount;
+    agl_uint indexCount;
+    agl_uint reserved;
+} agl__gfx_mesh_cache_entry_t;
+
+typedef struct agl__gfx_mesh_cache_writer_t {
+    agl__gfx_mesh_cache_entry_t *entries; // offsets are relative to the payload while writing
+    agl_uint entryCount;
+    agl_uint entryCapacity;
+    agl__gfx_mesh_cache_dependency_t *dependencies; // path offsets are relative to the payload while writing
+    agl_uint dependencyCount;
+    agl_uint dependencyCapacity;
+    agl_bool failed; // a dependency could not be stamped, the cache is not written
+    char *payload;
+    agl_uint64 payloadSize;
+    agl_uint64 payloadCapacity;
+} agl__gfx_mesh_cache_writer_t;
+
 _STATIC_ASSERT(sizeof(agl__gfx_loader_t) == sizeof(agl_gfx_loader_t));
 
 DEFINE_POOL(agl__gfx_image_t, agl__ImagePool);
@@ -807,6 +1198,8 @@ typedef struct agl__gfx_context_t {
     agl__ScratchAllocator scratchAllocator;
 	// Loaders
 	agl__gfx_loader_t *firstLoader;
+	const agl_gfx_load_params_t *loadParams; // caller's params while a load with post-processing is in flight
+	agl__gfx_mesh_cache_writer_t *cacheWriter;
 } agl__gfx_context_t;
 
 typedef struct agl__gfx_quad_t {
@@ -828,6 +1221,55 @@ typedef struct agl__gfx_camera_t {
     agl_float3 rot[3];
 } agl__gfx_camera_t;
 
+#define AGL__HIZ_MAX_LEVELS 16
+
+typedef struct agl__gfx_occluder_t {
+    mat4f_t mvp;
+    const agl_float *positions;
+    const agl_uint *indices;
+    agl_uint vertexCount;
+    agl_uint indexCount;
+} agl__gfx_occluder_t;
+
+typedef struct agl__gfx_occlusion_t {
+    agl_bool enabled;
+    agl_bool busy; // the worker is rasterising
+    agl_bool ready; // the pyramid holds this frame's occluders
+    // Occluder draws recorded during the frame, rasterised at the start of the next one
+    agl__gfx_mesh_draw_t *recorded;
+    agl_uint recordedCount;
+    agl_uint recordedCapacity;
+    agl_float4 (*recordedJoints)[4]; // palettes of the recorded skinned draws
+    agl_uint recordedJointCount;
+    agl_uint recordedJointCapacity;
+    mat4f_t recordedViewProj;
+    // The occlusion view is the first camera flushed in a frame, only its flushes record occluders and are occlusion tested
+    mat4f_t frameViewProj;
+    agl_bool frameViewSet;
+    // Worker input
+    agl__gfx_occluder_t *occluders;
+    agl_uint occluderCount;
+    agl_uint occluderCapacity;
+    vec4f_t *screenVerts;
+    agl_uint screenVertCapacity;
+    agl_float *skinnedPositions; // posed vertices of the skinned occluders
+    agl_uint skinnedCapacity;
+    mat4f_t viewProj;
+    // Worker output, every level of the max depth pyramid in one allocation
+    agl_float *hiZ;
+    agl_uint levelCount;
+    agl_uint levelOffset[AGL__HIZ_MAX_LEVELS];
+    agl_uint levelWidth[AGL__HIZ_MAX_LEVELS];
+    agl_uint levelHeight[AGL__HIZ_MAX_LEVELS];
+#if defined(_WIN32)
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+} agl__gfx_occlusion_t;
+
+_STATIC_ASSERT(AGL_GFX_OCCLUSION_WIDTH % 8 == 0);
+
 typedef struct agl__gfx_canvas_t {
     agl__gfx_context_t *context;
     agl_uint width;
@@ -846,12 +1288,50 @@ typedef struct agl__gfx_canvas_t {
     agl_uint fontTexRows;
     // 3D Renderer
     agl__gfx_camera_t camera;
+    GLuint particleProg;
     GLuint meshProg;
     GLuint meshVao;
+    agl__gfx_mesh_draw_t *meshDraws;
+    agl_float *meshDrawSpheres; // world space bounding spheres of the queued draws as x[], y[], z[], radius[]
+    uint8_t *meshDrawVisible;
+    agl_uint meshDrawsTotal;
+    agl_uint meshDrawsUsed;
+    agl_gfx_draw_stats_t drawStats;
+    agl_gfx_draw_stats_t lastDrawStats;
+    agl__gfx_occlusion_t occlusion;
+    agl__gfx_draw_range_t *meshDrawRanges;
+    // Meshlet culling scratch, and the compacted indices of the surviving meshlets uploaded once per flush
+    agl_float *meshletSpheres; // x[], y[], z[], radius[]
+    uint8_t *meshletVisible;
+    agl_uint meshletScratchCapacity;
+    agl_uint *meshletStream;
+    agl_uint meshletStreamUsed;
+    agl_uint meshletStreamCapacity;
+    GLuint meshletIbo;
+    agl_uint meshletIboCapacity;
+    // Instanced draws, culled per instance and compacted into the instance buffer at flush time
+    agl__gfx_instance_batch_t *instanceBatches;
+    agl_uint instanceBatchesUsed;
+    agl_uint instanceBatchesCapacity;
+    agl_float4 (*instanceTransforms)[4];
+    agl_float *instanceSpheres; // x[], y[], z[], radius[]
+    uint8_t *instanceVisible;
+    agl_uint instancesUsed;
+    agl_uint instancesCapacity;
+    GLuint instanceBuf;
+    agl_uint instanceBufCapacity;
+    // Joint palettes of the queued skinned draws, uploaded once per flush
+    agl_float4 (*joints)[4];
+    agl_uint jointsUsed;
+    agl_uint jointsCapacity;
+    GLuint jointBuf;
+    agl_uint jointBufCapacity;
     // Global State
     GLuint activeProg;
     GLuint activeVao;
     agl_gfx_mesh_t activeMesh;
+    GLuint activeIbo;
+    GLint activeJointBase;
     // agl_gfx_material_t activeMaterial;
 } agl__gfx_canvas_t;
 
@@ -860,6 +1340,8 @@ typedef struct agl__gfx_mesh_buffer_info_t {
     agl_uint UVStart;
     agl_uint NormalStart;
     agl_uint ColorStart;
+    agl_uint JointStart;
+    agl_uint WeightStart;
 } agl__gfx_mesh_buffer_info_t;
 
 typedef enum agl__fontglyph_t {
@@ -1318,8 +1800,11 @@ static PFNGLCREATEBUFFERSPROC glCreateBuffersProc;
 static PFNGLDELETEBUFFERSPROC glDeleteBuffersProc;
 static PFNGLNAMEDBUFFERSTORAGEPROC glNamedBufferStorageProc;
 static PFNGLNAMEDBUFFERSUBDATAPROC glNamedBufferSubDataProc;
+static PFNGLMAPNAMEDBUFFERRANGEPROC glMapNamedBufferRangeProc;
+static PFNGLUNMAPNAMEDBUFFERPROC glUnmapNamedBufferProc;
 static PFNGLBINDBUFFERPROC glBindBufferProc;
 static PFNGLBINDBUFFERBASEPROC glBindBufferBaseProc;
+static PFNGLPROGRAMUNIFORM1IPROC glProgramUniform1iProc;
 static PFNGLPROGRAMUNIFORM2FPROC glProgramUniform2fProc;
 static PFNGLPROGRAMUNIFORM4FVPROC glProgramUniform4fvProc;
 static PFNGLPROGRAMUNIFORM4UIVPROC glProgramUniform4uivProc;
@@ -1333,6 +1818,11 @@ static PFNGLMAKETEXTUREHANDLERESIDENTARBPROC glMakeTextureHandleResidentARBProc;
 static PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC glMakeTextureHandleNonResidentARBProc;
 static PFNGLBINDTEXTUREUNITPROC glBindTextureUnitProc;
 static PFNGLOBJECTLABELPROC glObjectLabelProc;
+static PFNGLDRAWARRAYSINSTANCEDPROC glDrawArraysInstancedProc;
+static PFNGLDRAWELEMENTSINSTANCEDPROC glDrawElementsInstancedProc;
+static PFNGLFENCESYNCPROC glFenceSyncProc;
+static PFNGLCLIENTWAITSYNCPROC glClientWaitSyncProc;
+static PFNGLDELETESYNCPROC glDeleteSyncProc;
 
 GLAPI void APIENTRY glDebugMessageCallback(GLDEBUGPROC callback, const void *userParam) {
     return glDebugMessageCallbackProc(callback, userParam);
@@ -1414,6 +1904,14 @@ GLAPI void APIENTRY glNamedBufferSubData(GLuint buffer, GLintptr offset, GLsizei
     return glNamedBufferSubDataProc(buffer, offset, size, data);
 }
 
+GLAPI void* APIENTRY glMapNamedBufferRange(GLuint buffer, GLintptr offset, GLsizeiptr length, GLbitfield access) {
+    return glMapNamedBufferRangeProc(buffer, offset, length, access);
+}
+
+GLAPI GLboolean APIENTRY glUnmapNamedBuffer(GLuint buffer) {
+    return glUnmapNamedBufferProc(buffer);
+}
+
 GLAPI void APIENTRY glBindBuffer(GLenum target, GLuint buffer) {
     return glBindBufferProc(target, buffer);
 }
@@ -1422,6 +1920,10 @@ GLAPI void APIENTRY glBindBufferBase(GLenum target, GLuint index, GLuint buffer)
     return glBindBufferBaseProc(target, index, buffer);
 }
 
+GLAPI void APIENTRY glProgramUniform1i(GLuint program, GLint location, GLint v0) {
+    return glProgramUniform1iProc(program, location, v0);
+}
+
 GLAPI void APIENTRY glProgramUniform2f(GLuint program, GLint location, GLfloat v0, GLfloat v1) {
     return glProgramUniform2fProc(program, location, v0, v1);
 }
@@ -1474,6 +1976,26 @@ GLAPI void APIENTRY glObjectLabel(GLenum identifier, GLuint name, GLsizei length
     return glObjectLabelProc(identifier, name, length, label);
 }
 
+GLAPI void APIENTRY glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount) {
+    return glDrawArraysInstancedProc(mode, first, count, instancecount);
+}
+
+GLAPI void APIENTRY glDrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount) {
+    return glDrawElementsInstancedProc(mode, count, type, indices, instancecount);
+}
+
+GLAPI GLsync APIENTRY glFenceSync(GLenum condition, GLbitfield flags) {
+    return glFenceSyncProc(condition, flags);
+}
+
+GLAPI GLenum APIENTRY glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout) {
+    return glClientWaitSyncProc(sync, flags, timeout);
+}
+
+GLAPI void APIENTRY glDeleteSync(GLsync sync) {
+    return glDeleteSyncProc(sync);
+}
+
 #define AGL_LOAD_PROC(proctype, procname) \
     procname##Proc = (proctype)agl__loadProc(#procname)
 
@@ -1498,8 +2020,11 @@ int agl__loadGLFunctions() {
     AGL_LOAD_PROC(PFNGLDELETEBUFFERSPROC, glDeleteBuffers);
     AGL_LOAD_PROC(PFNGLNAMEDBUFFERSTORAGEPROC, glNamedBufferStorage);
     AGL_LOAD_PROC(PFNGLNAMEDBUFFERSUBDATAPROC, glNamedBufferSubData);
+    AGL_LOAD_PROC(PFNGLMAPNAMEDBUFFERRANGEPROC, glMapNamedBufferRange);
+    AGL_LOAD_PROC(PFNGLUNMAPNAMEDBUFFERPROC, glUnmapNamedBuffer);
     AGL_LOAD_PROC(PFNGLBINDBUFFERPROC, glBindBuffer);
     AGL_LOAD_PROC(PFNGLBINDBUFFERBASEPROC, glBindBufferBase);
+    AGL_LOAD_PROC(PFNGLPROGRAMUNIFORM1IPROC, glProgramUniform1i);
     AGL_LOAD_PROC(PFNGLPROGRAMUNIFORM2FPROC, glProgramUniform2f);
     AGL_LOAD_PROC(PFNGLPROGRAMUNIFORM4FVPROC, glProgramUniform4fv);
     AGL_LOAD_PROC(PFNGLPROGRAMUNIFORM4UIVPROC, glProgramUniform4uiv);
@@ -1513,9 +2038,237 @@ int agl__loadGLFunctions() {
     AGL_LOAD_PROC(PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC, glMakeTextureHandleNonResidentARB);
     AGL_LOAD_PROC(PFNGLBINDTEXTUREUNITPROC, glBindTextureUnit);
     AGL_LOAD_PROC(PFNGLOBJECTLABELPROC, glObjectLabel);
+    AGL_LOAD_PROC(PFNGLDRAWARRAYSINSTANCEDPROC, glDrawArraysInstanced);
+    AGL_LOAD_PROC(PFNGLDRAWELEMENTSINSTANCEDPROC, glDrawElementsInstanced);
+    AGL_LOAD_PROC(PFNGLFENCESYNCPROC, glFenceSync);
+    AGL_LOAD_PROC(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync);
+    AGL_LOAD_PROC(PFNGLDELETESYNCPROC, glDeleteSync);
     return AGL_GFX_SUCCESS;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                Occlusion Culling
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Edge functions and depth plane of a triangle over its clamped pixel bounds. Edge i is opposite vertex i:
+// e(x, y) = a * x + b * y + c, positive inside a counter-clockwise triangle.
+typedef struct agl__gfx_raster_triangle_t {
+    int minx, maxx, miny, maxy;
+    agl_float a[3], b[3], c[3];
+    agl_float za, zb, zc;
+} agl__gfx_raster_triangle_t;
+
+// Each row is walked 4 pixels at a time, testing the edge functions at the pixel centres
+static void agl__RasterizeOccluderRowsSse2(agl_float *depth, const agl__gfx_raster_triangle_t *t) {
+    const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    for (int y = t->miny; y <= t->maxy; y++) {
+        agl_float yc = (agl_float)y + 0.5f;
+        __m128 e0Row = _mm_set1_ps(t->b[0] * yc + t->c[0]);
+        __m128 e1Row = _mm_set1_ps(t->b[1] * yc + t->c[1]);
+        __m128 e2Row = _mm_set1_ps(t->b[2] * yc + t->c[2]);
+        __m128 zRow = _mm_set1_ps(t->zb * yc + t->zc);
+        agl_float *row = depth + y * AGL_GFX_OCCLUSION_WIDTH;
+        for (int x = t->minx & ~3; x <= t->maxx; x += 4) {
+            __m128 px = _mm_add_ps(_mm_set1_ps((agl_float)x), lane);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t->a[0]), px), e0Row);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t->a[1]), px), e1Row);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t->a[2]), px), e2Row);
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t->za), px), zRow);
+            __m128 d = _mm_loadu_ps(row + x);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(d, z)), _mm_andnot_ps(inside, d)));
+        }
+    }
+}
+
+// The same 8 pixels at a time
+static AGL_TARGET_AVX2 void agl__RasterizeOccluderRowsAvx2(agl_float *depth, const agl__gfx_raster_triangle_t *t) {
+    const __m256 lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    for (int y = t->miny; y <= t->maxy; y++) {
+        agl_float yc = (agl_float)y + 0.5f;
+        __m256 e0Row = _mm256_set1_ps(t->b[0] * yc + t->c[0]);
+        __m256 e1Row = _mm256_set1_ps(t->b[1] * yc + t->c[1]);
+        __m256 e2Row = _mm256_set1_ps(t->b[2] * yc + t->c[2]);
+        __m256 zRow = _mm256_set1_ps(t->zb * yc + t->zc);
+        agl_float *row = depth + y * AGL_GFX_OCCLUSION_WIDTH;
+        for (int x = t->minx & ~7; x <= t->maxx; x += 8) {
+            __m256 px = _mm256_add_ps(_mm256_set1_ps((agl_float)x), lane);
+            __m256 e0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t->a[0]), px), e0Row);
+            __m256 e1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t->a[1]), px), e1Row);
+            __m256 e2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t->a[2]), px), e2Row);
+            __m256 inside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+                _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+            if (_mm256_movemask_ps(inside) == 0)
+                continue;
+            __m256 z = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t->za), px), zRow);
+            __m256 d = _mm256_loadu_ps(row + x);
+            _mm256_storeu_ps(row + x, _mm256_blendv_ps(d, _mm256_min_ps(d, z), inside));
+        }
+    }
+}
+
+// Rasterises a triangle given in occlusion buffer pixels (y up) with z in [0, 1], keeping the nearest depth per pixel
+static void agl__RasterizeOccluderTriangle(agl_float *depth, const agl_float *v0, const agl_float *v1, const agl_float *v2, agl_bool avx2) {
+    agl_float area = (v1[0] - v0[0]) * (v2[1] - v0[1]) - (v2[0] - v0[0]) * (v1[1] - v0[1]);
+    if (!(area > 0.f))
+        return; // back facing or degenerate
+    agl__gfx_raster_triangle_t t;
+    agl_float fminx = fminf(v0[0], fminf(v1[0], v2[0])), fmaxx = fmaxf(v0[0], fmaxf(v1[0], v2[0]));
+    agl_float fminy = fminf(v0[1], fminf(v1[1], v2[1])), fmaxy = fmaxf(v0[1], fmaxf(v1[1], v2[1]));
+    t.minx = (int)fmaxf(floorf(fminx), 0.f), t.maxx = (int)fminf(floorf(fmaxx), (agl_float)(AGL_GFX_OCCLUSION_WIDTH - 1));
+    t.miny = (int)fmaxf(floorf(fminy), 0.f), t.maxy = (int)fminf(floorf(fmaxy), (agl_float)(AGL_GFX_OCCLUSION_HEIGHT - 1));
+    if (t.minx > t.maxx || t.miny > t.maxy)
+        return;
+    const agl_float *v[3] = { v0, v1, v2 };
+    for (int i = 0; i < 3; i++) {
+        const agl_float *p = v[(i + 1) % 3], *q = v[(i + 2) % 3];
+        t.a[i] = p[1] - q[1];
+        t.b[i] = q[0] - p[0];
+        t.c[i] = (q[1] - p[1]) * p[0] - (q[0] - p[0]) * p[1];
+    }
+    // Depth is affine in screen space: z = sum(e_i * z_i) / area
+    t.za = (t.a[0] * v0[2] + t.a[1] * v1[2] + t.a[2] * v2[2]) / area;
+    t.zb = (t.b[0] * v0[2] + t.b[1] * v1[2] + t.b[2] * v2[2]) / area;
+    t.zc = (t.c[0] * v0[2] + t.c[1] * v1[2] + t.c[2] * v2[2]) / area;
+    if (avx2)
+        agl__RasterizeOccluderRowsAvx2(depth, &t);
+    else
+        agl__RasterizeOccluderRowsSse2(depth, &t);
+}
+
+// Worker thread body: rasterises the occluders into level 0 and builds the max depth pyramid above it
+static void agl__RasterizeOccluders(agl__gfx_occlusion_t *occ) {
+    agl_float *depth = occ->hiZ;
+    const agl_bool avx2 = (agl_cpu_features() & AGL_CPU_FEATURE_AVX2_BIT) != 0;
+    for (agl_uint i = 0; i < AGL_GFX_OCCLUSION_WIDTH * AGL_GFX_OCCLUSION_HEIGHT; i++)
+        depth[i] = 1.f;
+    for (agl_uint o = 0; o < occ->occluderCount; o++) {
+        const agl__gfx_occluder_t *occluder = &occ->occluders[o];
+        vec4f_t *screen = occ->screenVerts;
+        // Clip space first, then to the buffer in place
+        agl_mat4_project_points(screen, &occluder->mvp, occluder->positions, occluder->vertexCount);
+        for (agl_uint v = 0; v < occluder->vertexCount; v++) {
+            agl_float *clip = screen[v]._m;
+            if (clip[3] <= 1e-5f || clip[2] < -clip[3]) {
+                clip[3] = 0.f; // in front of the near plane, triangles using it are dropped
+                continue;
+            }
+            agl_float invW = 1.f / clip[3];
+            clip[0] = (clip[0] * invW * 0.5f + 0.5f) * AGL_GFX_OCCLUSION_WIDTH;
+            clip[1] = (clip[1] * invW * 0.5f + 0.5f) * AGL_GFX_OCCLUSION_HEIGHT;
+            clip[2] = clip[2] * invW * 0.5f + 0.5f;
+            clip[3] = 1.f;
+        }
+        for (agl_uint i = 0; i + 2 < occluder->indexCount; i += 3) {
+            const agl_float *v0 = screen[occluder->indices[i]]._m, *v1 = screen[occluder->indices[i + 1]]._m, *v2 = screen[occluder->indices[i + 2]]._m;
+            if (v0[3] != 0.f && v1[3] != 0.f && v2[3] != 0.f)
+                agl__RasterizeOccluderTriangle(depth, v0, v1, v2, avx2);
+        }
+    }
+    for (agl_uint l = 1; l < occ->levelCount; l++) {
+        const agl_float *src = occ->hiZ + occ->levelOffset[l - 1];
+        agl_float *dst = occ->hiZ + occ->levelOffset[l];
+        agl_uint sw = occ->levelWidth[l - 1], sh = occ->levelHeight[l - 1];
+        for (agl_uint y = 0; y < occ->levelHeight[l]; y++) {
+            agl_uint y0 = 2 * y, y1 = 2 * y + 1 < sh ? 2 * y + 1 : sh - 1;
+            for (agl_uint x = 0; x < occ->levelWidth[l]; x++) {
+                agl_uint x0 = 2 * x, x1 = 2 * x + 1 < sw ? 2 * x + 1 : sw - 1;
+                agl_float m0 = fmaxf(src[y0 * sw + x0], src[y0 * sw + x1]);
+                agl_float m1 = fmaxf(src[y1 * sw + x0], src[y1 * sw + x1]);
+                dst[y * occ->levelWidth[l] + x] = fmaxf(m0, m1);
+            }
+        }
+    }
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI agl__OcclusionThread(LPVOID param) {
+    agl__RasterizeOccluders((agl__gfx_occlusion_t*)param);
+    return 0;
+}
+#else
+static void *agl__OcclusionThread(void *param) {
+    agl__RasterizeOccluders((agl__gfx_occlusion_t*)param);
+    return NULL;
+}
+#endif
+
+static void agl__StartOcclusionThread(agl__gfx_occlusion_t *occ) {
+#if defined(_WIN32)
+    occ->thread = CreateThread(NULL, 0, agl__OcclusionThread, occ, 0, NULL);
+    occ->busy = occ->thread != NULL;
+#else
+    occ->busy = pthread_create(&occ->thread, NULL, agl__OcclusionThread, occ) == 0;
+#endif
+    if (!occ->busy) {
+        agl__RasterizeOccluders(occ);
+        occ->ready = AGL_TRUE;
+    }
+}
+
+// Waits for the occlusion pass started at the beginning of the frame, after which its depth pyramid can be tested against
+static void agl__WaitOcclusionPass(agl__gfx_occlusion_t *occ) {
+    if (!occ->busy)
+        return;
+#if defined(_WIN32)
+    WaitForSingleObject(occ->thread, INFINITE);
+    CloseHandle(occ->thread);
+#else
+    pthread_join(occ->thread, NULL);
+#endif
+    occ->busy = AGL_FALSE;
+    occ->ready = AGL_TRUE;
+}
+
+// Projects the corners of a local space box with `mvp` and checks whether the pyramid has something nearer everywhere it covers.
+// Boxes crossing the near plane are never occluded.
+static agl_bool agl__IsBoxOccluded(const agl__gfx_occlusion_t *occ, const mat4f_t *mvp, const agl_float *boxMin, const agl_float *boxMax) {
+    agl_float minx = FLT_MAX, miny = FLT_MAX, maxx = -FLT_MAX, maxy = -FLT_MAX, minz = FLT_MAX;
+    agl_float corners[8 * 3];
+    vec4f_t clips[8];
+    for (int i = 0; i < 8; i++) {
+        corners[3 * i + 0] = (i & 1) ? boxMax[0] : boxMin[0];
+        corners[3 * i + 1] = (i & 2) ? boxMax[1] : boxMin[1];
+        corners[3 * i + 2] = (i & 4) ? boxMax[2] : boxMin[2];
+    }
+    agl_mat4_project_points(clips, mvp, corners, 8);
+    for (int i = 0; i < 8; i++) {
+        const agl_float *clip = clips[i]._m;
+        if (clip[3] <= 1e-5f || clip[2] < -clip[3])
+            return AGL_FALSE;
+        agl_float invW = 1.f / clip[3];
+        agl_float sx = (clip[0] * invW * 0.5f + 0.5f) * AGL_GFX_OCCLUSION_WIDTH;
+        agl_float sy = (clip[1] * invW * 0.5f + 0.5f) * AGL_GFX_OCCLUSION_HEIGHT;
+        minx = fminf(minx, sx); maxx = fmaxf(maxx, sx);
+        miny = fminf(miny, sy); maxy = fmaxf(maxy, sy);
+        minz = fminf(minz, clip[2] * invW * 0.5f + 0.5f);
+    }
+    if (maxx < 0.f || maxy < 0.f || minx >= AGL_GFX_OCCLUSION_WIDTH || miny >= AGL_GFX_OCCLUSION_HEIGHT)
+        return AGL_FALSE; // off screen, left to frustum culling
+    agl_uint x0 = (agl_uint)fmaxf(minx, 0.f), x1 = (agl_uint)fminf(maxx, AGL_GFX_OCCLUSION_WIDTH - 1);
+    agl_uint y0 = (agl_uint)fmaxf(miny, 0.f), y1 = (agl_uint)fminf(maxy, AGL_GFX_OCCLUSION_HEIGHT - 1);
+    // Coarsest level at which the rectangle spans at most 4x4 texels
+    agl_uint level = 0;
+    while (level + 1 < occ->levelCount && (x1 - x0 > 3 || y1 - y0 > 3)) {
+        x0 >>= 1; x1 >>= 1;
+        y0 >>= 1; y1 >>= 1;
+        level++;
+    }
+    const agl_float *depth = occ->hiZ + occ->levelOffset[level];
+    agl_uint width = occ->levelWidth[level];
+    for (agl_uint y = y0; y <= y1; y++) {
+        for (agl_uint x = x0; x <= x1; x++) {
+            if (depth[y * width + x] >= minz)
+                return AGL_FALSE;
+        }
+    }
+    return AGL_TRUE;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 //                                AGL GFX API
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1650,6 +2403,53 @@ static const char *quad_shader_source_frag =  "#version 450 core""\n"
         "FragColor *= fs_in.color;"
     "}";
 
+static const char *particle_shader_source_vert = "#version 450 core""\n"
+    "#define AGL_GFX_FLAG_TEXTURED 0x1""\n"
+    "layout (location = 0) out VS_OUT {"
+        "flat uvec2 tex;"
+        "flat uint flags;"
+        "vec4 color;"
+        "vec4 uv;"
+    "} vs_out;"
+    "layout (location = 1) uniform mat4 CameraView;"
+    "layout (location = 2) uniform mat4 CameraProj;"
+    "layout (location = 3) uniform uvec4 Streams;" // word offsets of x[], y[], z[] and size[]
+    "layout (location = 4) uniform uvec4 ColorTexture;" // word offset of color[], texture handle, flags
+    "layout (binding = 5, std430) readonly buffer ParticleData { uint particleData[]; };"
+    "vec4 UnpackColor(uint color) {"
+        "return vec4(color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF, color >> 24) / 255.0;"
+    "}"
+    "void main() {"
+        "vec2 vertices[6] = {"
+            "vec2(-0.5,  0.5),"
+            "vec2(-0.5, -0.5),"
+            "vec2( 0.5,  0.5),"
+            "vec2( 0.5,  0.5),"
+            "vec2(-0.5, -0.5),"
+            "vec2( 0.5, -0.5),"
+        "};"
+        "vec2 uvs[6] = {"
+            "vec2(0, 0),"
+            "vec2(0, 1),"
+            "vec2(1, 0),"
+            "vec2(1, 0),"
+            "vec2(0, 1),"
+            "vec2(1, 1),"
+        "};"
+        "uint vertIdx = gl_VertexID % 6;"
+        "uint i = gl_VertexID / 6;"
+        "vec3 pos = vec3(uintBitsToFloat(particleData[Streams.x + i]), uintBitsToFloat(particleData[Streams.y + i]), uintBitsToFloat(particleData[Streams.z + i]));"
+        "float size = uintBitsToFloat(particleData[Streams.w + i]);"
+        // Billboards are expanded in view space, so they always face the camera
+        "vec4 viewPos = CameraView * vec4(pos, 1.0);"
+        "viewPos.xy += vertices[vertIdx] * size;"
+        "gl_Position = CameraProj * viewPos;"
+        "vs_out.tex = ColorTexture.yz;"
+        "vs_out.flags = ColorTexture.w;"
+        "vs_out.uv = vec4(uvs[vertIdx], 0, 0);"
+        "vs_out.color = UnpackColor(particleData[ColorTexture.x + i]);"
+    "}";
+
 static const char *mesh_shader_source_vert = "#version 450 core""\n"
     "layout (location = 0) out VS_OUT {"
 		"vec3 normal;"
@@ -1660,11 +2460,17 @@ static const char *mesh_shader_source_vert = "#version 450 core""\n"
     "layout (location = 1) uniform mat4 CameraView;"
     "layout (location = 2) uniform mat4 CameraProj;"
     "layout (location = 3) uniform mat4 Transform;"
+    "layout (location = 5) uniform int InstanceBase;" // -1 for single draws, which use Transform
+    "layout (location = 6) uniform int JointBase;" // -1 for rigid draws, else the draw's palette in jointMatrices
+    "layout (binding = 3, std430) readonly buffer InstanceData { mat4 instanceTransforms[]; };"
+    "layout (binding = 4, std430) readonly buffer JointData { mat4 jointMatrices[]; };"
     "layout (binding = 2, std430) readonly buffer VertexData {"
         "uint PositionStart;"
         "uint UVStart;"
         "uint NormalStart;"
         "uint ColorStart;"
+        "uint JointStart;"
+        "uint WeightStart;"
         "float vs_data[];"
     "};"
     "vec3 ExtractPosition(uint index) {"
@@ -1689,9 +2495,20 @@ static const char *mesh_shader_source_vert = "#version 450 core""\n"
         "uint i = ColorStart + 4 * index;"
         "return vec4(vs_data[i], vs_data[i+1], vs_data[i+2], vs_data[i+3]);"
     "}"
+    "mat4 ExtractSkin(uint index) {"
+        "uint j = JointStart + 4 * index;"
+        "uint w = WeightStart + 4 * index;"
+        "return vs_data[w] * jointMatrices[JointBase + int(vs_data[j])] +"
+            "vs_data[w+1] * jointMatrices[JointBase + int(vs_data[j+1])] +"
+            "vs_data[w+2] * jointMatrices[JointBase + int(vs_data[j+2])] +"
+            "vs_data[w+3] * jointMatrices[JointBase + int(vs_data[j+3])];"
+    "}"
     "void main() {"
-        "gl_Position = CameraProj * CameraView * Transform * vec4(ExtractPosition(gl_VertexID), 1.0);"
-        "vs_out.normal = normalize(mat3(Transform) * ExtractNormal(gl_VertexID));"
+        "mat4 model = InstanceBase < 0 ? Transform : instanceTransforms[InstanceBase + gl_InstanceID];"
+        "if (JointBase >= 0 && JointStart != -1)"
+            "model = model * ExtractSkin(gl_VertexID);"
+        "gl_Position = CameraProj * CameraView * model * vec4(ExtractPosition(gl_VertexID), 1.0);"
+        "vs_out.normal = normalize(mat3(model) * ExtractNormal(gl_VertexID));"
         "vs_out.uv = ExtractUV(gl_VertexID);"
         "vs_out.color = ExtractColor(gl_VertexID);"
     "}";
@@ -1732,6 +2549,7 @@ void agl__CreateFontImage(agl_gfx_context_t context);
 static void agl__CreateGraphicsResources(agl__gfx_context_t *context) {
     GLuint quadProg = agl__CreateShaderProgram(quad_shader_source_vert, quad_shader_source_frag);
     GLuint meshProg = agl__CreateShaderProgram(mesh_shader_source_vert, mesh_shader_source_frag);
+    GLuint particleProg = agl__CreateShaderProgram(particle_shader_source_vert, quad_shader_source_frag);
 
     GLuint vao;
     glCreateVertexArrays(1, &vao);
@@ -1749,6 +2567,10 @@ static void agl__CreateGraphicsResources(agl__gfx_context_t *context) {
     context->canvas->quadVao = vao;
     context->canvas->quadBuf = quadBuf;
     context->canvas->meshProg = meshProg;
+    context->canvas->particleProg = particleProg;
+    glProgramUniform1i(meshProg, 5, -1);
+    glProgramUniform1i(meshProg, 6, -1);
+    context->canvas->activeJointBase = -1;
     context->canvas->meshVao = vao;
     context->canvas->activeVao = vao;
     context->canvas->activeMesh = AGL_GFX_INVALID_ID;
@@ -1758,8 +2580,12 @@ static void agl__CreateGraphicsResources(agl__gfx_context_t *context) {
 static void agl__DestroyGraphicsResources(agl__gfx_context_t *context) {
     agl_gfx_destroy_image(context, context->canvas->fontImage);
     glDeleteProgram(context->canvas->quadProg);
+    glDeleteProgram(context->canvas->particleProg);
     glDeleteBuffers(1, &context->canvas->quadBuf);
     glDeleteVertexArrays(1, &context->canvas->quadVao);
+    glDeleteBuffers(1, &context->canvas->meshletIbo);
+    glDeleteBuffers(1, &context->canvas->instanceBuf);
+    glDeleteBuffers(1, &context->canvas->jointBuf);
 }
 
 agl_gfx_context_t agl_gfx_create_context(const agl_gfx_create_params_t *params) {
@@ -1802,6 +2628,17 @@ agl_gfx_context_t agl_gfx_create_context(const agl_gfx_create_params_t *params)
     canvas->quadsTotal = quadPoolSize;
     canvas->quadsUsed = 0;
 
+    agl_uint meshDrawPoolSize = params->meshDrawPoolSize == 0 ? 1024 : params->meshDrawPoolSize;
+    canvas->meshDraws = (agl__gfx_mesh_draw_t*)malloc(meshDrawPoolSize * sizeof(agl__gfx_mesh_draw_t));
+    canvas->meshDrawSpheres = (agl_float*)malloc(4 * meshDrawPoolSize * sizeof(agl_float));
+    canvas->meshDrawVisible = (uint8_t*)malloc(meshDrawPoolSize);
+    canvas->meshDrawRanges = (agl__gfx_draw_range_t*)malloc(meshDrawPoolSize * sizeof(agl__gfx_draw_range_t));
+    canvas->meshDrawsTotal = meshDrawPoolSize;
+    canvas->meshDrawsUsed = 0;
+    memset(&canvas->drawStats, 0, sizeof(canvas->drawStats));
+    memset(&canvas->lastDrawStats, 0, sizeof(canvas->lastDrawStats));
+    memset(&canvas->occlusion, 0, sizeof(canvas->occlusion));
+
     agl__loadGLFunctions();
     
 #if _DEBUG
@@ -1827,11 +2664,30 @@ agl_gfx_context_t agl_gfx_create_context(const agl_gfx_create_params_t *params)
 
 void agl_gfx_destroy_context(agl_gfx_context_t context) {
     if (context->deletefn) context->deletefn(context->udata);
+    agl__WaitOcclusionPass(&context->canvas->occlusion);
     agl__DestroyGraphicsResources(context);
     agl__MeshPoolShutdown(&context->meshPool);
     agl__ImagePoolShutdown(&context->imagePool);
     agl__BufferPoolShutdown(&context->bufferPool);
     free(context->canvas->quads);
+    free(context->canvas->meshDraws);
+    free(context->canvas->meshDrawSpheres);
+    free(context->canvas->meshDrawVisible);
+    free(context->canvas->meshDrawRanges);
+    free(context->canvas->meshletSpheres);
+    free(context->canvas->meshletVisible);
+    free(context->canvas->meshletStream);
+    free(context->canvas->instanceBatches);
+    free(context->canvas->instanceTransforms);
+    free(context->canvas->instanceSpheres);
+    free(context->canvas->instanceVisible);
+    free(context->canvas->joints);
+    free(context->canvas->occlusion.recorded);
+    free(context->canvas->occlusion.recordedJoints);
+    free(context->canvas->occlusion.skinnedPositions);
+    free(context->canvas->occlusion.occluders);
+    free(context->canvas->occlusion.screenVerts);
+    free(context->canvas->occlusion.hiZ);
     free(context);
 }
 
@@ -1940,10 +2796,10 @@ static GLenum agl__GetImageDataType(agl_gfx_image_format_t format) {
     case AGL_GFX_IMAGE_FORMAT_R8G8_SNORM:      return GL_BYTE;
     case AGL_GFX_IMAGE_FORMAT_R8G8B8_SNORM:    return GL_BYTE;
     case AGL_GFX_IMAGE_FORMAT_R8G8B8A8_SNORM:  return GL_BYTE;
-    case AGL_GFX_IMAGE_FORMAT_R16F:            return GL_FLOAT;
-    case AGL_GFX_IMAGE_FORMAT_R16G16F:         return GL_FLOAT;
-    case AGL_GFX_IMAGE_FORMAT_R16G16B16F:      return GL_FLOAT;
-    case AGL_GFX_IMAGE_FORMAT_R16G16B16A16F:   return GL_FLOAT;
+    case AGL_GFX_IMAGE_FORMAT_R16F:            return GL_HALF_FLOAT;
+    case AGL_GFX_IMAGE_FORMAT_R16G16F:         return GL_HALF_FLOAT;
+    case AGL_GFX_IMAGE_FORMAT_R16G16B16F:      return GL_HALF_FLOAT;
+    case AGL_GFX_IMAGE_FORMAT_R16G16B16A16F:   return GL_HALF_FLOAT;
     default: ;
     }
     return GL_NONE;
@@ -1963,7 +2819,22 @@ agl_gfx_image_t agl_gfx_create_image(agl_gfx_context_t context, const agl_gfx_im
     glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTextureStorage2D(tex, 1, internalFormat, params->width, params->height);
-    glTextureSubImage2D(tex, 0, 0, 0, params->width, params->height, format, type, params->pixelData);
+    if (type == GL_HALF_FLOAT && params->pixelData) {
+        // Half float pixels are passed as floats and encoded here, which halves the upload. Rows are padded to the
+        // default unpack alignment of 4.
+        int components = params->format - AGL_GFX_IMAGE_FORMAT_R16F + 1;
+        size_t rowSize = ((size_t)params->width * components * 2 + 3) & ~(size_t)3;
+        unsigned char *halves = (unsigned char*)malloc(rowSize * params->height);
+        const float *pixels = (const float*)params->pixelData;
+        for (agl_uint y = 0; y < params->height; ++y) {
+            agl_convert_from_f32(halves + y * rowSize, 2, 1, pixels + (size_t)y * params->width * components, 1,
+                AGL_COMPONENT_TYPE_F16, false, (size_t)params->width * components);
+        }
+        glTextureSubImage2D(tex, 0, 0, 0, params->width, params->height, format, type, halves);
+        free(halves);
+    } else {
+        glTextureSubImage2D(tex, 0, 0, 0, params->width, params->height, format, type, params->pixelData);
+    }
     image->tex = tex;
     image->width = params->width;
     image->height = params->height;
@@ -1990,9 +2861,17 @@ static GLuint agl__ConvertBufferFlags(agl_uint flags) {
     glflags |= (flags & AGL_GFX_BUFFER_FLAG_DYNAMIC_BIT) ? GL_DYNAMIC_STORAGE_BIT : 0;
     glflags |= (flags & AGL_GFX_BUFFER_FLAG_MAP_PERSISTENT_BIT) ? GL_MAP_PERSISTENT_BIT : 0;
     glflags |= (flags & AGL_GFX_BUFFER_FLAG_MAP_COHERENT_BIT) ? GL_MAP_COHERENT_BIT : 0;
+    glflags |= (flags & AGL_GFX_BUFFER_FLAG_MAP_WRITE_BIT) ? GL_MAP_WRITE_BIT : 0;
     return glflags;
 }
 
+static GLbitfield agl__ConvertBufferMapAccess(agl_uint flags) {
+    GLbitfield access = GL_MAP_WRITE_BIT;
+    access |= (flags & AGL_GFX_BUFFER_FLAG_MAP_PERSISTENT_BIT) ? GL_MAP_PERSISTENT_BIT : 0;
+    access |= (flags & AGL_GFX_BUFFER_FLAG_MAP_COHERENT_BIT) ? GL_MAP_COHERENT_BIT : 0;
+    return access;
+}
+
 agl_gfx_buffer_t agl_gfx_create_buffer(agl_gfx_context_t context, const agl_gfx_buffer_params_t *params) {
     agl__gfx_buffer_t *buffer = agl__BufferPoolAlloc(&context->bufferPool);
     if (!buffer)
@@ -2002,6 +2881,9 @@ agl_gfx_buffer_t agl_gfx_create_buffer(agl_gfx_context_t context, const agl_gfx_
     glNamedBufferStorage(ssbo, params->size, params->data, agl__ConvertBufferFlags(params->flags));
     buffer->buf = ssbo;
     buffer->size = params->size;
+    buffer->flags = params->flags;
+    buffer->mapped = NULL;
+    buffer->fence = NULL;
     return buffer->id;
 }
 
@@ -2009,71 +2891,560 @@ void agl_gfx_destroy_buffer(agl_gfx_context_t context, agl_gfx_buffer_t id) {
     agl__gfx_buffer_t *buffer = agl__BufferPoolGet(&context->bufferPool, id);
     if (!buffer)
         return;
+    if (buffer->mapped)
+        glUnmapNamedBuffer(buffer->buf);
+    buffer->mapped = NULL;
+    if (buffer->fence)
+        glDeleteSync(buffer->fence);
+    buffer->fence = NULL;
     glDeleteBuffers(1, &buffer->buf);
     agl__BufferPoolFree(&context->bufferPool, buffer);
 }
 
-agl_gfx_mesh_t agl_gfx_create_mesh(agl_gfx_context_t context, const agl_gfx_mesh_params_t *params) {
-    agl__gfx_mesh_t *mesh = agl__MeshPoolAlloc(&context->meshPool);
-    if (!mesh)
-        return AGL_GFX_INVALID_ID;
-    agl_gfx_buffer_params_t bufferParams;
-    agl_uint maxBufSize = sizeof(agl__gfx_mesh_buffer_info_t)
-                      + sizeof(agl_float3) * params->vertexCount /* position */
-                      + sizeof(agl_float2) * params->vertexCount /* uv       */
-                      + sizeof(agl_float3) * params->vertexCount /* normal   */
-                      + sizeof(agl_float4) * params->vertexCount /* color    */;
-    agl__gfx_mesh_buffer_info_t * const bufferInfo = (agl__gfx_mesh_buffer_info_t*)agl__ScratchAlloc(&context->scratchAllocator, maxBufSize);
-    agl_float * const data = (agl_float*)(bufferInfo + 1);
+void* agl_gfx_map_buffer(agl_gfx_context_t context, agl_gfx_buffer_t id) {
+    agl__gfx_buffer_t *buffer = agl__BufferPoolGet(&context->bufferPool, id);
+    if (!buffer)
+        return NULL;
+    agl__gfx_assertf(buffer->flags & AGL_GFX_BUFFER_FLAG_MAP_WRITE_BIT, "Buffer %u was not created with AGL_GFX_BUFFER_FLAG_MAP_WRITE_BIT!", id.id);
+    if (buffer->mapped)
+        return buffer->mapped;
+    buffer->mapped = glMapNamedBufferRange(buffer->buf, 0, buffer->size, agl__ConvertBufferMapAccess(buffer->flags));
+    return buffer->mapped;
+}
+
+void agl_gfx_unmap_buffer(agl_gfx_context_t context, agl_gfx_buffer_t id) {
+    agl__gfx_buffer_t *buffer = agl__BufferPoolGet(&context->bufferPool, id);
+    if (!buffer || !buffer->mapped)
+        return;
+    if (buffer->flags & AGL_GFX_BUFFER_FLAG_MAP_PERSISTENT_BIT)
+        return;
+    glUnmapNamedBuffer(buffer->buf);
+    buffer->mapped = NULL;
+}
+
+void agl_gfx_wait_buffer(agl_gfx_context_t context, agl_gfx_buffer_t id) {
+    agl__gfx_buffer_t *buffer = agl__BufferPoolGet(&context->bufferPool, id);
+    if (!buffer || !buffer->fence)
+        return;
+    // The first wait flushes, so the fence is sure to be submitted before waiting on it again
+    GLenum status = glClientWaitSync(buffer->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    while (status == GL_TIMEOUT_EXPIRED)
+        status = glClientWaitSync(buffer->fence, 0, 1000000);
+    agl__gfx_assertf(status != GL_WAIT_FAILED, "Waiting on buffer %u failed!", id.id);
+    glDeleteSync(buffer->fence);
+    buffer->fence = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                Mesh Simplification
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Symmetric 4x4 plane quadric (Garland & Heckbert), accumulated in double precision
+typedef struct agl__gfx_quadric_t {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+} agl__gfx_quadric_t;
+
+typedef struct agl__gfx_collapse_t {
+    agl_uint from;
+    agl_uint to;
+    double cost;
+} agl__gfx_collapse_t;
+
+static void agl__QuadricAddPlane(agl__gfx_quadric_t *q, double a, double b, double c, double d) {
+    q->a2 += a * a; q->ab += a * b; q->ac += a * c; q->ad += a * d;
+    q->b2 += b * b; q->bc += b * c; q->bd += b * d;
+    q->c2 += c * c; q->cd += c * d;
+    q->d2 += d * d;
+}
+
+static void agl__QuadricAdd(agl__gfx_quadric_t *q, const agl__gfx_quadric_t *r) {
+    q->a2 += r->a2; q->ab += r->ab; q->ac += r->ac; q->ad += r->ad;
+    q->b2 += r->b2; q->bc += r->bc; q->bd += r->bd;
+    q->c2 += r->c2; q->cd += r->cd;
+    q->d2 += r->d2;
+}
+
+// Sum of squared distances from `p` to the planes accumulated in `q`
+static double agl__QuadricError(const agl__gfx_quadric_t *q, const agl_float *p) {
+    double x = p[0], y = p[1], z = p[2];
+    double e = q->a2 * x * x + q->b2 * y * y + q->c2 * z * z + q->d2 +
+        2.0 * (q->ab * x * y + q->ac * x * z + q->bc * y * z + q->ad * x + q->bd * y + q->cd * z);
+    return e > 0.0 ? e : 0.0;
+}
+
+static void agl__TriangleNormal(agl_float *n, const agl_float *p0, const agl_float *p1, const agl_float *p2) {
+    agl_float e0[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    agl_float e1[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+    n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+    n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+}
+
+static int agl__CompareCollapses(const void *a, const void *b) {
+    double ca = ((const agl__gfx_collapse_t*)a)->cost;
+    double cb = ((const agl__gfx_collapse_t*)b)->cost;
+    return ca < cb ? -1 : (ca > cb ? 1 : 0);
+}
+
+// Finds the slot of the directed edge (a, b) in an open addressing table of packed edges, empty slots are all ones
+static agl_uint64 *agl__EdgeSlot(agl_uint64 *table, agl_uint tableSize, agl_uint a, agl_uint b) {
+    agl_uint64 key = ((agl_uint64)a << 32) | b;
+    agl_uint slot = ((a * 0x9E3779B1u) ^ (b * 0x85EBCA6Bu)) & (tableSize - 1);
+    while (table[slot] != ~(agl_uint64)0 && table[slot] != key)
+        slot = (slot + 1) & (tableSize - 1);
+    return &table[slot];
+}
+
+// Locks the vertices simplification must not move: those sharing their position with another vertex (attribute seams)
+// and those on open borders, so the simplified levels neither tear apart nor shrink their outline
+static void agl__LockBoundaryVertices(agl_bool *locked, const agl_uint *indices, agl_uint indexCount, const agl_float *positions, agl_uint vertexCount) {
+    agl_uint tableSize = 1;
+    while (tableSize < vertexCount * 2)
+        tableSize *= 2;
+    agl_uint *table = (agl_uint*)malloc(tableSize * sizeof(agl_uint));
+    agl_uint *group = (agl_uint*)malloc(vertexCount * sizeof(agl_uint));
+    agl_uint *groupSize = (agl_uint*)calloc(vertexCount, sizeof(agl_uint));
+    memset(table, 0xFF, tableSize * sizeof(agl_uint));
+    for (agl_uint v = 0; v < vertexCount; v++) {
+        const agl_uint *words = (const agl_uint*)(positions + 3 * v);
+        agl_uint hash = 2166136261u;
+        for (int i = 0; i < 3; i++)
+            hash = (hash ^ words[i]) * 16777619u;
+        agl_uint slot = hash & (tableSize - 1);
+        while (table[slot] != (agl_uint)-1 && memcmp(positions + 3 * table[slot], positions + 3 * v, sizeof(agl_float3)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+        if (table[slot] == (agl_uint)-1)
+            table[slot] = v;
+        group[v] = table[slot];
+        groupSize[group[v]]++;
+    }
+    for (agl_uint v = 0; v < vertexCount; v++)
+        locked[v] = groupSize[group[v]] > 1;
+    free(table);
+    // An edge between two positions is open when no triangle walks it in the opposite direction
+    agl_uint edgeTableSize = 1;
+    while (edgeTableSize < indexCount * 2)
+        edgeTableSize *= 2;
+    agl_uint64 *edges = (agl_uint64*)malloc(edgeTableSize * sizeof(agl_uint64));
+    memset(edges, 0xFF, edgeTableSize * sizeof(agl_uint64));
+    for (agl_uint i = 0; i < indexCount; i++) {
+        agl_uint a = group[indices[i]], b = group[indices[i - i % 3 + (i + 1) % 3]];
+        *agl__EdgeSlot(edges, edgeTableSize, a, b) = ((agl_uint64)a << 32) | b;
+    }
+    for (agl_uint i = 0; i < indexCount; i++) {
+        agl_uint a = indices[i], b = indices[i - i % 3 + (i + 1) % 3];
+        if (*agl__EdgeSlot(edges, edgeTableSize, group[b], group[a]) == ~(agl_uint64)0)
+            locked[a] = locked[b] = AGL_TRUE;
+    }
+    free(edges);
+    free(groupSize);
+    free(group);
+}
+
+// Checks whether moving `from` onto `to` would fold over any of the surviving triangles around `from`
+static agl_bool agl__CollapseFlips(const agl_uint *indices, const agl_uint *adjacency, agl_uint adjCount, const agl_uint *remap,
+    const agl_float *positions, agl_uint from, agl_uint to) {
+    for (agl_uint j = 0; j < adjCount; j++) {
+        const agl_uint *tri = &indices[3 * adjacency[j]];
+        agl_uint v[3] = { remap[tri[0]], remap[tri[1]], remap[tri[2]] };
+        if (v[0] == to || v[1] == to || v[2] == to || v[0] == v[1] || v[1] == v[2] || v[2] == v[0])
+            continue; // collapses away
+        agl_float before[3], after[3];
+        agl__TriangleNormal(before, positions + 3 * v[0], positions + 3 * v[1], positions + 3 * v[2]);
+        for (int k = 0; k < 3; k++)
+            v[k] = v[k] == from ? to : v[k];
+        agl__TriangleNormal(after, positions + 3 * v[0], positions + 3 * v[1], positions + 3 * v[2]);
+        agl_float d = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+        agl_float l = (before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+            (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+        if (d <= 0.f || d * d < 0.04f * l) // more than ~78 degrees of rotation
+            return AGL_TRUE;
+    }
+    return AGL_FALSE;
+}
+
+// Builds the LOD chain of an indexed triangle list. Level 0 is a copy of `indices`, every further level collapses vertices
+// onto a neighbour in order of increasing quadric error until it has at most half the triangles of the level before it.
+// Levels are written back to back to `dst`, which must hold 2 * indexCount indices. Returns the number of levels.
+static agl_uint agl__BuildMeshLods(agl_uint *dst, agl__gfx_mesh_lod_t *lods, const agl_uint *indices, agl_uint indexCount,
+    const agl_float *positions, agl_uint vertexCount) {
+    memcpy(dst, indices, indexCount * sizeof(agl_uint));
+    lods[0].indexOffset = 0;
+    lods[0].indexCount = indexCount;
+    lods[0].error = 0.f;
+    agl_uint target = indexCount / 6 * 3;
+    if (target == 0)
+        return 1;
+    agl_uint lodCount = 1;
+    agl_uint offset = indexCount;
+    agl_uint currentCount = indexCount;
+    agl_uint *current = (agl_uint*)malloc(indexCount * sizeof(agl_uint));
+    agl_bool *locked = (agl_bool*)malloc(vertexCount * sizeof(agl_bool));
+    agl_bool *touched = (agl_bool*)malloc(vertexCount * sizeof(agl_bool));
+    agl_uint *remap = (agl_uint*)malloc(vertexCount * sizeof(agl_uint));
+    agl_uint *adjOffset = (agl_uint*)malloc((vertexCount + 1) * sizeof(agl_uint));
+    agl_uint *adjacency = (agl_uint*)malloc(indexCount * sizeof(agl_uint));
+    agl__gfx_quadric_t *quadrics = (agl__gfx_quadric_t*)calloc(vertexCount, sizeof(agl__gfx_quadric_t));
+    agl__gfx_collapse_t *collapses = (agl__gfx_collapse_t*)malloc(2 * indexCount * sizeof(agl__gfx_collapse_t));
+    memcpy(current, indices, indexCount * sizeof(agl_uint));
+    agl__LockBoundaryVertices(locked, indices, indexCount, positions, vertexCount);
+    for (agl_uint i = 0; i < indexCount; i += 3) {
+        const agl_float *p0 = positions + 3 * indices[i];
+        agl_float n[3];
+        agl__TriangleNormal(n, p0, positions + 3 * indices[i + 1], positions + 3 * indices[i + 2]);
+        agl_float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.f)
+            continue;
+        n[0] /= length; n[1] /= length; n[2] /= length;
+        double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        for (int k = 0; k < 3; k++)
+            agl__QuadricAddPlane(&quadrics[indices[i + k]], n[0], n[1], n[2], d);
+    }
+    double maxError = 0.0;
+    while (lodCount < AGL_GFX_MAX_MESH_LODS) {
+        // Candidate collapses along every edge, both directions, cheapest first
+        agl_uint candidateCount = 0;
+        for (agl_uint i = 0; i < currentCount; i++) {
+            agl_uint a = current[i], b = current[i - i % 3 + (i + 1) % 3];
+            if (!locked[a]) {
+                agl__gfx_collapse_t *c = &collapses[candidateCount++];
+                c->from = a;
+                c->to = b;
+                c->cost = agl__QuadricError(&quadrics[a], positions + 3 * b) + agl__QuadricError(&quadrics[b], positions + 3 * b);
+            }
+            if (!locked[b]) {
+                agl__gfx_collapse_t *c = &collapses[candidateCount++];
+                c->from = b;
+                c->to = a;
+                c->cost = agl__QuadricError(&quadrics[a], positions + 3 * a) + agl__QuadricError(&quadrics[b], positions + 3 * a);
+            }
+        }
+        if (candidateCount == 0)
+            break;
+        qsort(collapses, candidateCount, sizeof(agl__gfx_collapse_t), agl__CompareCollapses);
+        // Triangles around each vertex
+        memset(adjOffset, 0, (vertexCount + 1) * sizeof(agl_uint));
+        for (agl_uint i = 0; i < currentCount; i++)
+            adjOffset[current[i] + 1]++;
+        for (agl_uint v = 0; v < vertexCount; v++)
+            adjOffset[v + 1] += adjOffset[v];
+        for (agl_uint i = 0; i < currentCount; i++)
+            adjacency[adjOffset[current[i]]++] = i / 3;
+        for (agl_uint v = vertexCount; v > 0; v--)
+            adjOffset[v] = adjOffset[v - 1];
+        adjOffset[0] = 0;
+        // Collapse greedily, every vertex takes part in at most one collapse per pass so the flip test stays exact
+        for (agl_uint v = 0; v < vertexCount; v++) {
+            remap[v] = v;
+            touched[v] = AGL_FALSE;
+        }
+        agl_uint triangleCount = currentCount / 3;
+        agl_uint collapsed = 0;
+        for (agl_uint i = 0; i < candidateCount && triangleCount > target / 3; i++) {
+            agl_uint from = collapses[i].from, to = collapses[i].to;
+            if (touched[from] || touched[to])
+                continue;
+            const agl_uint *adj = &adjacency[adjOffset[from]];
+            agl_uint adjCount = adjOffset[from + 1] - adjOffset[from];
+            if (agl__CollapseFlips(current, adj, adjCount, remap, positions, from, to))
+                continue;
+            for (agl_uint j = 0; j < adjCount; j++) {
+                const agl_uint *tri = &current[3 * adj[j]];
+                if (remap[tri[0]] == to || remap[tri[1]] == to || remap[tri[2]] == to)
+                    triangleCount--;
+            }
+            remap[from] = to;
+            touched[from] = touched[to] = AGL_TRUE;
+            agl__QuadricAdd(&quadrics[to], &quadrics[from]);
+            maxError = collapses[i].cost > maxError ? collapses[i].cost : maxError;
+            collapsed++;
+        }
+        if (collapsed == 0)
+            break;
+        // Drop the triangles that became degenerate
+        agl_uint count = 0;
+        for (agl_uint i = 0; i < currentCount; i += 3) {
+            agl_uint a = remap[current[i]], b = remap[current[i + 1]], c = remap[current[i + 2]];
+            if (a != b && b != c && c != a) {
+                current[count++] = a;
+                current[count++] = b;
+                current[count++] = c;
+            }
+        }
+        currentCount = count;
+        if (currentCount <= target) {
+            memcpy(dst + offset, current, currentCount * sizeof(agl_uint));
+            lods[lodCount].indexOffset = offset;
+            lods[lodCount].indexCount = currentCount;
+            lods[lodCount].error = (agl_float)sqrt(maxError);
+            lodCount++;
+            offset += currentCount;
+            target = currentCount / 6 * 3;
+            if (target == 0)
+                break;
+        }
+    }
+    free(collapses);
+    free(quadrics);
+    free(adjacency);
+    free(adjOffset);
+    free(remap);
+    free(touched);
+    free(locked);
+    free(current);
+    return lodCount;
+}
+
+// Bounding box, and a bounding sphere around its centre, good enough for culling and measuring the projected size
+static void agl__ComputeMeshBounds(agl__gfx_mesh_t *mesh, const agl_float *positions, agl_uint vertexCount) {
+    memset(mesh->boundsMin, 0, sizeof(mesh->boundsMin));
+    memset(mesh->boundsMax, 0, sizeof(mesh->boundsMax));
+    if (vertexCount)
+        agl_bounds_minmax3(mesh->boundsMin, mesh->boundsMax, positions, vertexCount);
+    agl_float r2 = 0.f;
+    agl_float *center = mesh->boundsCenter;
+    for (int k = 0; k < 3; k++)
+        center[k] = 0.5f * (mesh->boundsMin[k] + mesh->boundsMax[k]);
+    for (agl_uint v = 0; v < vertexCount; v++) {
+        const agl_float *p = positions + 3 * v;
+        agl_float d2 = (p[0] - center[0]) * (p[0] - center[0]) + (p[1] - center[1]) * (p[1] - center[1]) + (p[2] - center[2]) * (p[2] - center[2]);
+        r2 = d2 > r2 ? d2 : r2;
+    }
+    mesh->boundsRadius = sqrtf(r2);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                Meshlets
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Unit normal of a triangle, false for degenerate ones
+static agl_bool agl__MeshletTriangleNormal(agl_float n[3], const agl_float *positions, const agl_uint *tri) {
+    agl__TriangleNormal(n, positions + 3 * tri[0], positions + 3 * tri[1], positions + 3 * tri[2]);
+    agl_float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (!(length > 0.f))
+        return AGL_FALSE;
+    n[0] /= length; n[1] /= length; n[2] /= length;
+    return AGL_TRUE;
+}
+
+// Splits the triangle list into meshlets of at most AGL_GFX_MESHLET_MAX_VERTICES unique vertices and AGL_GFX_MESHLET_MAX_TRIANGLES
+// triangles. Triangles are taken in order, so the index buffer needs no reordering and locality comes from the vertex cache
+// optimisation of agl_gfx_optimize_mesh. `meshlets` must hold indexCount / 3 entries, returns the number written.
+static agl_uint agl__BuildMeshlets(agl__gfx_meshlet_t *meshlets, const agl_uint *indices, agl_uint indexCount, const agl_float *positions, agl_uint vertexCount) {
+    agl_uint *stamps = (agl_uint*)malloc(vertexCount * sizeof(agl_uint));
+    memset(stamps, 0xFF, vertexCount * sizeof(agl_uint));
+    agl_uint meshletCount = 0, meshletVertices = 0;
+    agl__gfx_meshlet_t *meshlet = NULL;
+    for (agl_uint i = 0; i + 2 < indexCount; i += 3) {
+        const agl_uint *tri = indices + i;
+        agl_uint newVertices = (stamps[tri[0]] != meshletCount - 1) + (stamps[tri[1]] != meshletCount - 1 && tri[1] != tri[0])
+            + (stamps[tri[2]] != meshletCount - 1 && tri[2] != tri[0] && tri[2] != tri[1]);
+        if (!meshlet || meshletVertices + newVertices > AGL_GFX_MESHLET_MAX_VERTICES || meshlet->triangleCount == AGL_GFX_MESHLET_MAX_TRIANGLES) {
+            meshlet = &meshlets[meshletCount++];
+            meshlet->indexOffset = i;
+            meshlet->triangleCount = 0;
+            meshletVertices = 0;
+            newVertices = 1 + (tri[1] != tri[0]) + (tri[2] != tri[0] && tri[2] != tri[1]);
+        }
+        for (int k = 0; k < 3; k++)
+            stamps[tri[k]] = meshletCount - 1;
+        meshletVertices += newVertices;
+        meshlet->triangleCount++;
+    }
+    free(stamps);
+    // Bounding sphere around the box of the meshlet, and the cone containing its triangle normals
+    for (agl_uint m = 0; m < meshletCount; m++) {
+        meshlet = &meshlets[m];
+        const agl_uint *tris = indices + meshlet->indexOffset;
+        agl_uint count = 3 * meshlet->triangleCount;
+        agl_float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (agl_uint i = 0; i < count; i++) {
+            const agl_float *p = positions + 3 * tris[i];
+            for (int k = 0; k < 3; k++) {
+                lo[k] = fminf(lo[k], p[k]);
+                hi[k] = fmaxf(hi[k], p[k]);
+            }
+        }
+        agl_float r2 = 0.f;
+        for (int k = 0; k < 3; k++)
+            meshlet->center[k] = 0.5f * (lo[k] + hi[k]);
+        for (agl_uint i = 0; i < count; i++) {
+            const agl_float *p = positions + 3 * tris[i];
+            agl_float dx = p[0] - meshlet->center[0], dy = p[1] - meshlet->center[1], dz = p[2] - meshlet->center[2];
+            r2 = fmaxf(r2, dx * dx + dy * dy + dz * dz);
+        }
+        meshlet->radius = sqrtf(r2);
+        agl_float axis[3] = { 0.f, 0.f, 0.f };
+        for (agl_uint i = 0; i < count; i += 3) {
+            agl_float n[3];
+            if (agl__MeshletTriangleNormal(n, positions, tris + i)) {
+                axis[0] += n[0]; axis[1] += n[1]; axis[2] += n[2];
+            }
+        }
+        agl_float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        meshlet->coneCos = -1.f; // disabled until proven to be narrower than a half space
+        meshlet->coneSin = 0.f;
+        if (length > 0.f) {
+            agl_float cosAngle = 1.f;
+            for (int k = 0; k < 3; k++)
+                meshlet->coneAxis[k] = axis[k] / length;
+            for (agl_uint i = 0; i < count; i += 3) {
+                agl_float n[3];
+                if (agl__MeshletTriangleNormal(n, positions, tris + i))
+                    cosAngle = fminf(cosAngle, n[0] * meshlet->coneAxis[0] + n[1] * meshlet->coneAxis[1] + n[2] * meshlet->coneAxis[2]);
+            }
+            if (cosAngle > 0.f) {
+                meshlet->coneCos = cosAngle;
+                meshlet->coneSin = sqrtf(1.f - cosAngle * cosAngle);
+            }
+        }
+    }
+    return meshletCount;
+}
+
+// True when every triangle of the meshlet faces away from `eye` (local space): the eye must be behind the plane of every normal
+// in the cone, for every point of the bounding sphere, i.e. |d| * cos(angle(d, axis) + coneAngle) >= radius with d = center - eye.
+static agl_bool agl__IsMeshletBackFacing(const agl__gfx_meshlet_t *meshlet, const agl_float eye[3]) {
+    if (meshlet->coneCos <= 0.f)
+        return AGL_FALSE;
+    agl_float d[3] = { meshlet->center[0] - eye[0], meshlet->center[1] - eye[1], meshlet->center[2] - eye[2] };
+    agl_float d2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    agl_float along = d[0] * meshlet->coneAxis[0] + d[1] * meshlet->coneAxis[1] + d[2] * meshlet->coneAxis[2];
+    agl_float across = sqrtf(fmaxf(d2 - along * along, 0.f));
+    return along * meshlet->coneCos - across * meshlet->coneSin >= meshlet->radius;
+}
+
+// Lays out the attribute streams of a mesh vertex buffer, returns the size of the buffer in bytes
+static agl_uint agl__LayoutMeshBuffer(const agl_gfx_mesh_params_t *params, agl__gfx_mesh_buffer_info_t *bufferInfo) {
     agl_uint offset = 0;
-    // Positions
-    agl__gfx_assertf(params->positionData, "Mesh positions array cannot but NULL!");
     bufferInfo->PositionStart = offset;
-    memcpy(data + offset, params->positionData, sizeof(agl_float3) * params->vertexCount);
     offset += 3 * params->vertexCount;
-    // UVs
-    if (params->uvData) {
-        bufferInfo->UVStart = offset;
-        memcpy(data + offset, params->uvData, sizeof(agl_float2) * params->vertexCount);
-        offset += 2 * params->vertexCount;
-    } else {
-        bufferInfo->UVStart = -1;
-    }
-    // Normals
-    if (params->normalData) {
-        bufferInfo->NormalStart = offset;
-        memcpy(data + offset, params->normalData, sizeof(agl_float3) * params->vertexCount);
-        offset += 3 * params->vertexCount;
-    } else {
-        bufferInfo->NormalStart = -1;
+    bufferInfo->UVStart = params->uvData ? offset : -1;
+    offset += params->uvData ? 2 * params->vertexCount : 0;
+    bufferInfo->NormalStart = params->normalData ? offset : -1;
+    offset += params->normalData ? 3 * params->vertexCount : 0;
+    bufferInfo->ColorStart = params->colorData ? offset : -1;
+    offset += params->colorData ? 4 * params->vertexCount : 0;
+    agl_bool skinned = params->jointData && params->weightData;
+    bufferInfo->JointStart = skinned ? offset : -1;
+    offset += skinned ? 4 * params->vertexCount : 0;
+    bufferInfo->WeightStart = skinned ? offset : -1;
+    offset += skinned ? 4 * params->vertexCount : 0;
+    return (agl_uint)(sizeof(agl__gfx_mesh_buffer_info_t) + sizeof(agl_float) * offset);
+}
+
+// Writes the buffer info followed by each attribute stream to `dst`, which is either the mapped GPU buffer or a cache payload
+static void agl__WriteMeshBuffer(void *dst, const agl__gfx_mesh_buffer_info_t *bufferInfo, const agl_gfx_mesh_params_t *params) {
+    agl__gfx_mesh_buffer_info_t *header = (agl__gfx_mesh_buffer_info_t*)dst;
+    agl_float * const data = (agl_float*)(header + 1);
+    *header = *bufferInfo;
+    memcpy(data + bufferInfo->PositionStart, params->positionData, sizeof(agl_float3) * params->vertexCount);
+    if (params->uvData)
+        memcpy(data + bufferInfo->UVStart, params->uvData, sizeof(agl_float2) * params->vertexCount);
+    if (params->normalData)
+        memcpy(data + bufferInfo->NormalStart, params->normalData, sizeof(agl_float3) * params->vertexCount);
+    if (params->colorData)
+        memcpy(data + bufferInfo->ColorStart, params->colorData, sizeof(agl_float4) * params->vertexCount);
+    if (bufferInfo->JointStart != (agl_uint)-1) {
+        memcpy(data + bufferInfo->JointStart, params->jointData, sizeof(agl_float4) * params->vertexCount);
+        memcpy(data + bufferInfo->WeightStart, params->weightData, sizeof(agl_float4) * params->vertexCount);
     }
-    // Colors
-    if (params->colorData) {
-        bufferInfo->ColorStart = offset;
-        memcpy(data + offset, params->colorData, sizeof(agl_float4) * params->vertexCount);
-        offset += 4 * params->vertexCount;
-    } else {
-        bufferInfo->ColorStart = -1;
+}
+
+// The CPU passes (optimisation, LODs, meshlets, occluders) index the vertex streams directly, so indices coming from a file
+// are checked once up front instead of in every pass
+static agl_bool agl__MeshIndicesInRange(const agl_uint *indices, agl_uint indexCount, agl_uint vertexCount) {
+    agl_uint maxIndex = 0;
+    for (agl_uint i = 0; i < indexCount; i++)
+        maxIndex = indices[i] > maxIndex ? indices[i] : maxIndex;
+    return indexCount == 0 || maxIndex < vertexCount;
+}
+
+agl_gfx_mesh_t agl_gfx_create_mesh(agl_gfx_context_t context, const agl_gfx_mesh_params_t *params) {
+    if (params->indexData && !agl__MeshIndicesInRange(params->indexData, params->indexCount, params->vertexCount)) {
+        printf("Mesh index out of range of its %u vertices\n", params->vertexCount);
+        return AGL_GFX_INVALID_ID;
     }
-    agl_uint bufSize = (agl_uint)((uintptr_t)(data + offset) - (uintptr_t)bufferInfo);
-    agl__gfx_assertf(bufSize <= maxBufSize, "Mesh buffer overflow!");
-    bufferParams.size = bufSize;
-    bufferParams.data = bufferInfo;
-    bufferParams.flags = 0;
+    agl__gfx_mesh_t *mesh = agl__MeshPoolAlloc(&context->meshPool);
+    if (!mesh)
+        return AGL_GFX_INVALID_ID;
+    agl__gfx_assertf(params->positionData, "Mesh positions array cannot but NULL!");
+    // Layout the streams first so the buffer can be allocated at its final size and written in place
+    agl__gfx_mesh_buffer_info_t bufferInfo;
+    agl_gfx_buffer_params_t bufferParams;
+    bufferParams.size = agl__LayoutMeshBuffer(params, &bufferInfo);
+    bufferParams.data = NULL;
+    bufferParams.flags = AGL_GFX_BUFFER_FLAG_MAP_WRITE_BIT;
     mesh->vertexBufId = agl_gfx_create_buffer(context, &bufferParams);
     mesh->vertexCount = params->vertexCount;
-    agl__ScratchFree(&context->scratchAllocator);
-    // Index Buffer
+    // Stream each attribute range directly into the mapped buffer
+    void *mapped = agl_gfx_map_buffer(context, mesh->vertexBufId);
+    if (!mapped) {
+        printf("Failed to map mesh vertex buffer\n");
+        agl_gfx_destroy_buffer(context, mesh->vertexBufId);
+        agl__MeshPoolFree(&context->meshPool, mesh);
+        return AGL_GFX_INVALID_ID;
+    }
+    agl__WriteMeshBuffer(mapped, &bufferInfo, params);
+    agl_gfx_unmap_buffer(context, mesh->vertexBufId);
+    agl__ComputeMeshBounds(mesh, params->positionData, params->vertexCount);
+    // Index Buffer, followed by the simplified levels if requested
+    mesh->lodCount = 1;
+    mesh->lods[0].indexOffset = 0;
+    mesh->lods[0].indexCount = params->indexData ? params->indexCount : 0;
+    mesh->lods[0].error = 0.f;
     if (params->indexData) {
+        agl_uint *lodIndices = NULL;
+        agl_uint totalCount = params->indexCount;
+        if ((params->flags & AGL_GFX_MESH_FLAG_GENERATE_LODS_BIT) && params->indexCount % 3 == 0) {
+            lodIndices = (agl_uint*)malloc(2 * sizeof(agl_uint) * params->indexCount);
+            mesh->lodCount = agl__BuildMeshLods(lodIndices, mesh->lods, params->indexData, params->indexCount, params->positionData, params->vertexCount);
+            totalCount = mesh->lods[mesh->lodCount - 1].indexOffset + mesh->lods[mesh->lodCount - 1].indexCount;
+        }
         GLuint ibo;
         glCreateBuffers(1, &ibo);
-        glNamedBufferStorage(ibo, sizeof(GLuint) * params->indexCount, params->indexData, 0);
+        glNamedBufferStorage(ibo, sizeof(GLuint) * totalCount, lodIndices ? lodIndices : params->indexData, 0);
+        free(lodIndices);
         mesh->ibo = ibo;
         mesh->indexCount = params->indexCount;
     } else {
         mesh->ibo = 0;
         mesh->indexCount = 0;
     }
+    mesh->meshlets = NULL;
+    mesh->meshletIndices = NULL;
+    mesh->meshletCount = 0;
+    if ((params->flags & AGL_GFX_MESH_FLAG_MESHLETS_BIT) && params->indexData && params->indexCount >= 3 && params->indexCount % 3 == 0) {
+        agl__gfx_meshlet_t *meshlets = (agl__gfx_meshlet_t*)malloc(params->indexCount / 3 * sizeof(agl__gfx_meshlet_t));
+        mesh->meshletCount = agl__BuildMeshlets(meshlets, params->indexData, params->indexCount, params->positionData, params->vertexCount);
+        mesh->meshlets = (agl__gfx_meshlet_t*)malloc(mesh->meshletCount * sizeof(agl__gfx_meshlet_t) + params->indexCount * sizeof(agl_uint));
+        mesh->meshletIndices = (agl_uint*)(mesh->meshlets + mesh->meshletCount);
+        memcpy(mesh->meshlets, meshlets, mesh->meshletCount * sizeof(agl__gfx_meshlet_t));
+        memcpy(mesh->meshletIndices, params->indexData, params->indexCount * sizeof(agl_uint));
+        free(meshlets);
+    }
+    mesh->occluderPositions = NULL;
+    mesh->occluderJoints = NULL;
+    mesh->occluderWeights = NULL;
+    mesh->occluderIndices = NULL;
+    mesh->occluderIndexCount = 0;
+    if (params->flags & AGL_GFX_MESH_FLAG_OCCLUDER_BIT) {
+        agl_uint indexCount = params->indexData ? params->indexCount : params->vertexCount;
+        agl_bool skinned = params->jointData && params->weightData;
+        agl_uint floatsPerVertex = skinned ? 11 : 3;
+        mesh->occluderPositions = (agl_float*)malloc(sizeof(agl_float) * floatsPerVertex * params->vertexCount + sizeof(agl_uint) * indexCount);
+        mesh->occluderIndices = (agl_uint*)(mesh->occluderPositions + floatsPerVertex * params->vertexCount);
+        mesh->occluderIndexCount = indexCount;
+        memcpy(mesh->occluderPositions, params->positionData, sizeof(agl_float3) * params->vertexCount);
+        if (skinned) {
+            mesh->occluderJoints = mesh->occluderPositions + 3 * params->vertexCount;
+            mesh->occluderWeights = mesh->occluderJoints + 4 * params->vertexCount;
+            memcpy(mesh->occluderJoints, params->jointData, sizeof(agl_float4) * params->vertexCount);
+            memcpy(mesh->occluderWeights, params->weightData, sizeof(agl_float4) * params->vertexCount);
+        }
+        for (agl_uint i = 0; i < indexCount; i++)
+            mesh->occluderIndices[i] = params->indexData ? params->indexData[i] : i;
+    }
     return mesh->id;
 }
 
@@ -2081,16 +3452,422 @@ void agl_gfx_destroy_mesh(agl_gfx_context_t context, agl_gfx_mesh_t id) {
     agl__gfx_mesh_t *mesh = agl__MeshPoolGet(&context->meshPool, id);
     if (!mesh)
         return;
+    if (mesh->occluderPositions) {
+        agl__WaitOcclusionPass(&context->canvas->occlusion); // the worker may be reading the triangles
+        free(mesh->occluderPositions);
+    }
+    free(mesh->meshlets);
+    if (context->canvas->activeIbo == mesh->ibo)
+        context->canvas->activeIbo = 0; // the name may be handed out again
     glDeleteBuffers(1, &mesh->ibo);
     agl_gfx_destroy_buffer(context, mesh->vertexBufId);
     agl__MeshPoolFree(&context->meshPool, mesh);
 }
 
-static GLuint agl__SwitchProgram(agl__gfx_canvas_t *canvas, GLuint prog) {
-    GLuint prev = canvas->activeProg;
-    if (prev != prog) {
-        glUseProgram(prog);
-        canvas->activeProg = prog;
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//                                Mesh Optimisation
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define AGL__VCACHE_SIZE 32
+#define AGL__VCACHE_VALENCE_TABLE_SIZE 32
+
+// Average cache miss ratio (misses per triangle) for a FIFO post-transform cache of AGL__VCACHE_SIZE entries
+static agl_float agl__ComputeACMR(const agl_uint *indices, agl_uint indexCount, agl_uint vertexCount) {
+    if (indexCount < 3)
+        return 0.f;
+    if (!indices)
+        return 3.f;
+    agl_uint *timestamps = (agl_uint*)calloc(vertexCount, sizeof(agl_uint));
+    agl_uint time = AGL__VCACHE_SIZE + 1;
+    agl_uint misses = 0;
+    for (agl_uint i = 0; i < indexCount; i++) {
+        agl_uint v = indices[i];
+        if (time - timestamps[v] > AGL__VCACHE_SIZE) {
+            timestamps[v] = time++;
+            misses++;
+        }
+    }
+    free(timestamps);
+    return (agl_float)misses / (agl_float)(indexCount / 3);
+}
+
+static agl_uint agl__HashVertex(const agl_gfx_mesh_params_t *params, agl_uint v) {
+    agl_uint hash = 2166136261u;
+    const agl_uint *words = (const agl_uint*)(params->positionData + 3 * v);
+    for (int i = 0; i < 3; i++)
+        hash = (hash ^ words[i]) * 16777619u;
+    if (params->uvData) {
+        words = (const agl_uint*)(params->uvData + 2 * v);
+        hash = (hash ^ words[0]) * 16777619u;
+        hash = (hash ^ words[1]) * 16777619u;
+    }
+    if (params->normalData) {
+        words = (const agl_uint*)(params->normalData + 3 * v);
+        for (int i = 0; i < 3; i++)
+            hash = (hash ^ words[i]) * 16777619u;
+    }
+    if (params->colorData) {
+        words = (const agl_uint*)(params->colorData + 4 * v);
+        for (int i = 0; i < 4; i++)
+            hash = (hash ^ words[i]) * 16777619u;
+    }
+    if (params->jointData && params->weightData) {
+        words = (const agl_uint*)(params->jointData + 4 * v);
+        for (int i = 0; i < 4; i++)
+            hash = (hash ^ words[i]) * 16777619u;
+        words = (const agl_uint*)(params->weightData + 4 * v);
+        for (int i = 0; i < 4; i++)
+            hash = (hash ^ words[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static agl_bool agl__VertexEqual(const agl_gfx_mesh_params_t *params, agl_uint a, agl_uint b) {
+    return memcmp(params->positionData + 3 * a, params->positionData + 3 * b, sizeof(agl_float3)) == 0 &&
+        (!params->uvData || memcmp(params->uvData + 2 * a, params->uvData + 2 * b, sizeof(agl_float2)) == 0) &&
+        (!params->normalData || memcmp(params->normalData + 3 * a, params->normalData + 3 * b, sizeof(agl_float3)) == 0) &&
+        (!params->colorData || memcmp(params->colorData + 4 * a, params->colorData + 4 * b, sizeof(agl_float4)) == 0) &&
+        (!params->jointData || !params->weightData || (memcmp(params->jointData + 4 * a, params->jointData + 4 * b, sizeof(agl_float4)) == 0 &&
+            memcmp(params->weightData + 4 * a, params->weightData + 4 * b, sizeof(agl_float4)) == 0));
+}
+
+// Maps every vertex to the first bit-identical vertex, numbered densely in order of first occurrence.
+// Returns the number of unique vertices, `unique` receives the original index of each of them.
+static agl_uint agl__WeldVertices(const agl_gfx_mesh_params_t *params, agl_uint *remap, agl_uint *unique) {
+    agl_uint tableSize = 1;
+    while (tableSize < params->vertexCount * 2)
+        tableSize *= 2;
+    agl_uint *table = (agl_uint*)malloc(tableSize * sizeof(agl_uint));
+    memset(table, 0xFF, tableSize * sizeof(agl_uint));
+    agl_uint uniqueCount = 0;
+    for (agl_uint v = 0; v < params->vertexCount; v++) {
+        agl_uint slot = agl__HashVertex(params, v) & (tableSize - 1);
+        while (table[slot] != (agl_uint)-1 && !agl__VertexEqual(params, table[slot], v))
+            slot = (slot + 1) & (tableSize - 1);
+        if (table[slot] == (agl_uint)-1) {
+            table[slot] = v;
+            remap[v] = uniqueCount;
+            unique[uniqueCount++] = v;
+        } else {
+            remap[v] = remap[table[slot]];
+        }
+    }
+    free(table);
+    return uniqueCount;
+}
+
+static agl_float agl__vcacheScoreTable[AGL__VCACHE_SIZE];
+static agl_float agl__vcacheValenceTable[AGL__VCACHE_VALENCE_TABLE_SIZE];
+
+// Vertex score from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+static agl_float agl__VertexScore(int cachePos, agl_uint liveTriangles) {
+    if (liveTriangles == 0)
+        return -1.f;
+    agl_float score = cachePos >= 0 ? agl__vcacheScoreTable[cachePos] : 0.f;
+    score += liveTriangles < AGL__VCACHE_VALENCE_TABLE_SIZE ? agl__vcacheValenceTable[liveTriangles] : 2.f / sqrtf((agl_float)liveTriangles);
+    return score;
+}
+
+// Reorders triangles for post-transform cache locality, writes the new index order to `dst`
+static void agl__OptimizeVertexCache(agl_uint *dst, const agl_uint *indices, agl_uint indexCount, agl_uint vertexCount) {
+    if (agl__vcacheValenceTable[1] == 0.f) {
+        for (int i = 0; i < AGL__VCACHE_SIZE; i++) // the last triangle's vertices get a fixed score so it is not simply repeated
+            agl__vcacheScoreTable[i] = i < 3 ? 0.75f : powf(1.f - (agl_float)(i - 3) / (AGL__VCACHE_SIZE - 3), 1.5f);
+        for (int i = 1; i < AGL__VCACHE_VALENCE_TABLE_SIZE; i++)
+            agl__vcacheValenceTable[i] = 2.f / sqrtf((agl_float)i);
+    }
+    agl_uint triCount = indexCount / 3;
+    agl_uint *live = (agl_uint*)calloc(vertexCount, sizeof(agl_uint));
+    agl_uint *adjOffset = (agl_uint*)malloc((vertexCount + 1) * sizeof(agl_uint));
+    agl_uint *adjacency = (agl_uint*)malloc(indexCount * sizeof(agl_uint));
+    int *cachePos = (int*)malloc(vertexCount * sizeof(int));
+    agl_float *vertexScore = (agl_float*)malloc(vertexCount * sizeof(agl_float));
+    agl_float *triScore = (agl_float*)malloc(triCount * sizeof(agl_float));
+    agl_bool *emitted = (agl_bool*)calloc(triCount, sizeof(agl_bool));
+    // Triangle adjacency per vertex, the first live[v] entries are the triangles not emitted yet
+    for (agl_uint i = 0; i < indexCount; i++)
+        live[indices[i]]++;
+    adjOffset[0] = 0;
+    for (agl_uint v = 0; v < vertexCount; v++)
+        adjOffset[v + 1] = adjOffset[v] + live[v];
+    memset(live, 0, vertexCount * sizeof(agl_uint));
+    for (agl_uint i = 0; i < indexCount; i++) {
+        agl_uint v = indices[i];
+        adjacency[adjOffset[v] + live[v]++] = i / 3;
+    }
+    for (agl_uint v = 0; v < vertexCount; v++) {
+        cachePos[v] = -1;
+        vertexScore[v] = agl__VertexScore(-1, live[v]);
+    }
+    agl_uint bestTri = 0;
+    for (agl_uint t = 0; t < triCount; t++) {
+        triScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+        if (triScore[t] > triScore[bestTri])
+            bestTri = t;
+    }
+    agl_uint cache[AGL__VCACHE_SIZE + 3];
+    agl_uint cacheCount = 0;
+    agl_uint scanCursor = 0;
+    for (agl_uint emittedCount = 0; emittedCount < triCount; emittedCount++) {
+        if (bestTri == (agl_uint)-1) {
+            // Nothing adjacent to the cache is left, continue with the next triangle in input order
+            while (emitted[scanCursor])
+                scanCursor++;
+            bestTri = scanCursor;
+        }
+        const agl_uint *tri = &indices[3 * bestTri];
+        memcpy(&dst[3 * emittedCount], tri, 3 * sizeof(agl_uint));
+        emitted[bestTri] = AGL_TRUE;
+        // Move the triangle's vertices to the front of the LRU cache and retire the triangle from their adjacency
+        agl_uint newCache[AGL__VCACHE_SIZE + 3];
+        agl_uint newCount = 0;
+        for (int k = 0; k < 3; k++) {
+            agl_uint v = tri[k];
+            agl_uint *adj = &adjacency[adjOffset[v]];
+            for (agl_uint j = 0; j < live[v]; j++) {
+                if (adj[j] == bestTri) {
+                    adj[j] = adj[--live[v]];
+                    break;
+                }
+            }
+            if (cachePos[v] != -2) {
+                newCache[newCount++] = v;
+                cachePos[v] = -2; // marks vertices already placed
+            }
+        }
+        for (agl_uint j = 0; j < cacheCount; j++) {
+            if (cachePos[cache[j]] != -2)
+                newCache[newCount++] = cache[j];
+        }
+        // Update the scores of everything that was or is in the cache, and pick the best triangle touching it
+        bestTri = (agl_uint)-1;
+        agl_float bestScore = -1.f;
+        for (agl_uint j = 0; j < newCount; j++) {
+            agl_uint v = newCache[j];
+            cachePos[v] = j < AGL__VCACHE_SIZE ? (int)j : -1;
+            agl_float score = agl__VertexScore(cachePos[v], live[v]);
+            agl_float delta = score - vertexScore[v];
+            vertexScore[v] = score;
+            const agl_uint *adj = &adjacency[adjOffset[v]];
+            for (agl_uint k = 0; k < live[v]; k++) {
+                agl_uint t = adj[k];
+                triScore[t] += delta;
+                if (triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    bestTri = t;
+                }
+            }
+        }
+        cacheCount = newCount < AGL__VCACHE_SIZE ? newCount : AGL__VCACHE_SIZE;
+        memcpy(cache, newCache, cacheCount * sizeof(agl_uint));
+    }
+    free(live);
+    free(adjOffset);
+    free(adjacency);
+    free(cachePos);
+    free(vertexScore);
+    free(triScore);
+    free(emitted);
+}
+
+typedef struct agl__gfx_tri_cluster_t {
+    agl_uint start;
+    agl_uint count;
+    agl_float sortKey;
+} agl__gfx_tri_cluster_t;
+
+static int agl__CompareClusters(const void *a, const void *b) {
+    const agl__gfx_tri_cluster_t *ca = (const agl__gfx_tri_cluster_t*)a;
+    const agl__gfx_tri_cluster_t *cb = (const agl__gfx_tri_cluster_t*)b;
+    if (ca->sortKey != cb->sortKey)
+        return ca->sortKey > cb->sortKey ? -1 : 1;
+    return ca->start < cb->start ? -1 : 1;
+}
+
+// Reorders clusters of a cache-optimised index buffer so outward facing clusters are drawn first, following
+// Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw". Clusters are split where
+// a triangle misses the cache with all three vertices, so the cache behaviour inside each cluster is preserved.
+static void agl__OptimizeOverdraw(agl_uint *indices, agl_uint indexCount, const agl_float *positions, agl_uint vertexCount) {
+    agl_uint triCount = indexCount / 3;
+    agl__gfx_tri_cluster_t *clusters = (agl__gfx_tri_cluster_t*)malloc(triCount * sizeof(agl__gfx_tri_cluster_t));
+    agl_uint *timestamps = (agl_uint*)calloc(vertexCount, sizeof(agl_uint));
+    agl_uint time = AGL__VCACHE_SIZE + 1;
+    agl_uint clusterCount = 0;
+    for (agl_uint t = 0; t < triCount; t++) {
+        agl_uint misses = 0;
+        for (int k = 0; k < 3; k++) {
+            agl_uint v = indices[3 * t + k];
+            if (time - timestamps[v] > AGL__VCACHE_SIZE) {
+                timestamps[v] = time++;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3) {
+            clusters[clusterCount].start = t;
+            clusters[clusterCount].count = 0;
+            clusterCount++;
+        }
+        clusters[clusterCount - 1].count++;
+    }
+    free(timestamps);
+    // Mesh centroid
+    agl_float meshCenter[3] = { 0.f, 0.f, 0.f };
+    for (agl_uint v = 0; v < vertexCount; v++) {
+        meshCenter[0] += positions[3 * v + 0];
+        meshCenter[1] += positions[3 * v + 1];
+        meshCenter[2] += positions[3 * v + 2];
+    }
+    for (int k = 0; k < 3; k++)
+        meshCenter[k] /= (agl_float)(vertexCount ? vertexCount : 1);
+    // Area weighted cluster centroid and normal, sorted by how much the cluster faces away from the mesh centre
+    for (agl_uint c = 0; c < clusterCount; c++) {
+        agl_float center[3] = { 0.f, 0.f, 0.f };
+        agl_float normal[3] = { 0.f, 0.f, 0.f };
+        agl_float area = 0.f;
+        for (agl_uint t = clusters[c].start; t < clusters[c].start + clusters[c].count; t++) {
+            const agl_float *p0 = &positions[3 * indices[3 * t + 0]];
+            const agl_float *p1 = &positions[3 * indices[3 * t + 1]];
+            const agl_float *p2 = &positions[3 * indices[3 * t + 2]];
+            agl_float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            agl_float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            agl_float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+            agl_float a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++) {
+                center[k] += (p0[k] + p1[k] + p2[k]) * (a / 3.f);
+                normal[k] += n[k];
+            }
+            area += a;
+        }
+        agl_float len = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        agl_float key = 0.f;
+        if (area > 0.f && len > 0.f) {
+            for (int k = 0; k < 3; k++)
+                key += (center[k] / area - meshCenter[k]) * (normal[k] / len);
+        }
+        clusters[c].sortKey = key;
+    }
+    qsort(clusters, clusterCount, sizeof(agl__gfx_tri_cluster_t), agl__CompareClusters);
+    agl_uint *sorted = (agl_uint*)malloc(indexCount * sizeof(agl_uint));
+    agl_uint offset = 0;
+    for (agl_uint c = 0; c < clusterCount; c++) {
+        memcpy(&sorted[offset], &indices[3 * clusters[c].start], 3 * clusters[c].count * sizeof(agl_uint));
+        offset += 3 * clusters[c].count;
+    }
+    memcpy(indices, sorted, indexCount * sizeof(agl_uint));
+    free(sorted);
+    free(clusters);
+}
+
+// Renumbers vertices in order of first use so vertex fetches walk memory linearly. `remap` receives the new
+// index of every old vertex (-1 for unused ones), returns the number of vertices in use.
+static agl_uint agl__OptimizeVertexFetch(agl_uint *indices, agl_uint indexCount, agl_uint *remap, agl_uint vertexCount) {
+    memset(remap, 0xFF, vertexCount * sizeof(agl_uint));
+    agl_uint next = 0;
+    for (agl_uint i = 0; i < indexCount; i++) {
+        agl_uint v = indices[i];
+        if (remap[v] == (agl_uint)-1)
+            remap[v] = next++;
+        indices[i] = remap[v];
+    }
+    return next;
+}
+
+// Gathers the attribute streams of `src` for each vertex in `order` into `dst`, whose stream pointers must be set up
+static void agl__GatherVertices(agl_gfx_mesh_params_t *dst, const agl_gfx_mesh_params_t *src, const agl_uint *order, agl_uint count) {
+    for (agl_uint i = 0; i < count; i++) {
+        agl_uint v = order[i];
+        memcpy(dst->positionData + 3 * i, src->positionData + 3 * v, sizeof(agl_float3));
+        if (dst->uvData)
+            memcpy(dst->uvData + 2 * i, src->uvData + 2 * v, sizeof(agl_float2));
+        if (dst->normalData)
+            memcpy(dst->normalData + 3 * i, src->normalData + 3 * v, sizeof(agl_float3));
+        if (dst->colorData)
+            memcpy(dst->colorData + 4 * i, src->colorData + 4 * v, sizeof(agl_float4));
+        if (dst->jointData) {
+            memcpy(dst->jointData + 4 * i, src->jointData + 4 * v, sizeof(agl_float4));
+            memcpy(dst->weightData + 4 * i, src->weightData + 4 * v, sizeof(agl_float4));
+        }
+    }
+}
+
+// Allocates a mesh with the same streams as `layout` in a single block, so it can be released with agl_gfx_free_optimized_mesh
+static void agl__AllocMeshStreams(agl_gfx_mesh_params_t *mesh, const agl_gfx_mesh_params_t *layout, agl_uint vertexCount, agl_uint indexCount) {
+    agl_bool skinned = layout->jointData && layout->weightData;
+    agl_uint floatsPerVertex = 3 + (layout->uvData ? 2 : 0) + (layout->normalData ? 3 : 0) + (layout->colorData ? 4 : 0) + (skinned ? 8 : 0);
+    agl_float *block = (agl_float*)malloc(sizeof(agl_float) * floatsPerVertex * vertexCount + sizeof(agl_uint) * indexCount);
+    mesh->vertexCount = vertexCount;
+    mesh->indexCount = indexCount;
+    mesh->positionData = block;
+    block += 3 * vertexCount;
+    mesh->uvData = layout->uvData ? block : NULL;
+    block += layout->uvData ? 2 * vertexCount : 0;
+    mesh->normalData = layout->normalData ? block : NULL;
+    block += layout->normalData ? 3 * vertexCount : 0;
+    mesh->colorData = layout->colorData ? block : NULL;
+    block += layout->colorData ? 4 * vertexCount : 0;
+    mesh->jointData = skinned ? block : NULL;
+    block += skinned ? 4 * vertexCount : 0;
+    mesh->weightData = skinned ? block : NULL;
+    block += skinned ? 4 * vertexCount : 0;
+    mesh->indexData = (agl_uint*)block;
+}
+
+int agl_gfx_optimize_mesh(const agl_gfx_mesh_params_t *params, agl_uint flags, agl_gfx_mesh_params_t *optimized, agl_gfx_mesh_optimize_stats_t *stats) {
+    agl_uint indexCount = params->indexData ? params->indexCount : params->vertexCount;
+    memset(optimized, 0, sizeof(*optimized));
+    if (!params->positionData || params->vertexCount == 0 || indexCount < 3 || indexCount % 3 != 0)
+        return AGL_GFX_ERROR;
+    if (params->indexData && !agl__MeshIndicesInRange(params->indexData, indexCount, params->vertexCount))
+        return AGL_GFX_ERROR;
+    if (stats) {
+        stats->vertexCountBefore = params->vertexCount;
+        stats->acmrBefore = agl__ComputeACMR(params->indexData, indexCount, params->vertexCount);
+    }
+    // Weld duplicate vertices and gather the unique ones
+    agl_uint *remap = (agl_uint*)malloc(params->vertexCount * sizeof(agl_uint));
+    agl_uint *order = (agl_uint*)malloc(params->vertexCount * sizeof(agl_uint));
+    agl_uint weldedCount = agl__WeldVertices(params, remap, order);
+    agl_gfx_mesh_params_t welded;
+    agl__AllocMeshStreams(&welded, params, weldedCount, indexCount);
+    agl__GatherVertices(&welded, params, order, weldedCount);
+    for (agl_uint i = 0; i < indexCount; i++)
+        welded.indexData[i] = remap[params->indexData ? params->indexData[i] : i];
+    // Triangle order: vertex cache, then optionally overdraw
+    agl_uint *cacheOrder = (agl_uint*)malloc(indexCount * sizeof(agl_uint));
+    agl__OptimizeVertexCache(cacheOrder, welded.indexData, indexCount, weldedCount);
+    if (flags & AGL_GFX_MESH_OPTIMIZE_OVERDRAW_BIT)
+        agl__OptimizeOverdraw(cacheOrder, indexCount, welded.positionData, weldedCount);
+    // Vertex order: first use
+    agl_uint usedCount = agl__OptimizeVertexFetch(cacheOrder, indexCount, remap, weldedCount);
+    for (agl_uint v = 0; v < weldedCount; v++) {
+        if (remap[v] != (agl_uint)-1)
+            order[remap[v]] = v;
+    }
+    agl__AllocMeshStreams(optimized, params, usedCount, indexCount);
+    agl__GatherVertices(optimized, &welded, order, usedCount);
+    memcpy(optimized->indexData, cacheOrder, indexCount * sizeof(agl_uint));
+    optimized->flags = params->flags;
+    free(cacheOrder);
+    free(welded.positionData);
+    free(order);
+    free(remap);
+    if (stats) {
+        stats->vertexCountAfter = usedCount;
+        stats->acmrAfter = agl__ComputeACMR(optimized->indexData, indexCount, usedCount);
+    }
+    return AGL_GFX_SUCCESS;
+}
+
+void agl_gfx_free_optimized_mesh(agl_gfx_mesh_params_t *optimized) {
+    free(optimized->positionData);
+    memset(optimized, 0, sizeof(*optimized));
+}
+
+static GLuint agl__SwitchProgram(agl__gfx_canvas_t *canvas, GLuint prog) {
+    GLuint prev = canvas->activeProg;
+    if (prev != prog) {
+        glUseProgram(prog);
+        canvas->activeProg = prog;
         // agl__gfx_debugf("Switched shaders : [%d] => [%d]", prev, prog);
     }
     return prev;
@@ -2109,6 +3886,536 @@ static void agl__FlushQuads(agl__gfx_canvas_t *canvas) {
     canvas->quadsUsed = 0;
 }
 
+// The inverse of the camera transform, whose columns are the camera axes
+static void agl__MakeViewMatrix(mat4f_t *view, const agl_float3 pos, const agl_float3 rot[3]) {
+    mat4f_t camera = { {
+        { rot[0][0], rot[0][1], rot[0][2], 0.f },
+        { rot[1][0], rot[1][1], rot[1][2], 0.f },
+        { rot[2][0], rot[2][1], rot[2][2], 0.f },
+        { pos[0], pos[1], pos[2], 1.f },
+    } };
+    mat4v_t m = mat4v_load(&camera);
+    m = mat4v_inverse_rigid(&m);
+    mat4v_store(&m, view);
+}
+
+// Model matrix of a draw: translation, rotation and uniform scale
+static mat4v_t agl__MakeDrawMatrix(const agl__gfx_mesh_draw_t *draw) {
+    vec3f_t pos = vec3f(draw->pos[0], draw->pos[1], draw->pos[2]);
+    vec3v_t t = vec3v_load(pos._m), s = { _mm_set1_ps(draw->scale) };
+    quatv_t r = quatv_load(draw->rot);
+    return mat4v_from_trs(&t, &r, &s);
+}
+
+// Rotates `v` by the unit quaternion `rot` (x, y, z, w)
+static void agl__RotateVector(agl_float out[3], const agl_float4 rot, const agl_float v[3]) {
+    agl_float t[3] = {
+        2.f * (rot[1] * v[2] - rot[2] * v[1]),
+        2.f * (rot[2] * v[0] - rot[0] * v[2]),
+        2.f * (rot[0] * v[1] - rot[1] * v[0]),
+    };
+    out[0] = v[0] + rot[3] * t[0] + (rot[1] * t[2] - rot[2] * t[1]);
+    out[1] = v[1] + rot[3] * t[1] + (rot[2] * t[0] - rot[0] * t[2]);
+    out[2] = v[2] + rot[3] * t[2] + (rot[0] * t[1] - rot[1] * t[0]);
+}
+
+// World space bounding sphere (x, y, z, radius) of a mesh space sphere drawn with the given transform: the centre is pos + rot * (center * scale)
+static void agl__TransformBoundingSphere(agl_float sphere[4], const agl_float center[3], agl_float radius, const agl_float3 pos, const agl_float4 rot, agl_float scale) {
+    agl_float c[3] = { center[0] * scale, center[1] * scale, center[2] * scale };
+    agl__RotateVector(sphere, rot, c);
+    sphere[0] += pos[0];
+    sphere[1] += pos[1];
+    sphere[2] += pos[2];
+    sphere[3] = radius * fabsf(scale);
+}
+
+// Mesh space sphere of a draw. A skinned vertex is a weighted average of the vertex under each of its joints, so it stays inside
+// the mesh sphere transformed by some palette matrix: the result encloses those spheres for every joint of the palette.
+static void agl__GetDrawBounds(agl_float sphere[4], const agl__gfx_canvas_t *canvas, const agl__gfx_mesh_draw_t *draw, const agl__gfx_mesh_t *pmesh) {
+    memcpy(sphere, pmesh->boundsCenter, sizeof(agl_float3));
+    sphere[3] = pmesh->boundsRadius;
+    if (draw->jointCount == 0)
+        return;
+    const agl_float *c = pmesh->boundsCenter;
+    agl_float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (agl_uint j = 0; j < draw->jointCount; j++) {
+        const agl_float4 *m = canvas->joints[draw->jointFirst + j];
+        agl_float scale2 = 0.f;
+        for (int k = 0; k < 3; k++)
+            scale2 = fmaxf(scale2, m[k][0] * m[k][0] + m[k][1] * m[k][1] + m[k][2] * m[k][2]);
+        agl_float r = pmesh->boundsRadius * sqrtf(scale2);
+        for (int k = 0; k < 3; k++) {
+            agl_float p = m[0][k] * c[0] + m[1][k] * c[1] + m[2][k] * c[2] + m[3][k];
+            lo[k] = fminf(lo[k], p - r);
+            hi[k] = fmaxf(hi[k], p + r);
+        }
+    }
+    agl_float radius = 0.f;
+    for (int k = 0; k < 3; k++) {
+        sphere[k] = 0.5f * (lo[k] + hi[k]);
+        radius += (hi[k] - lo[k]) * (hi[k] - lo[k]);
+    }
+    sphere[3] = 0.5f * sqrtf(radius);
+}
+
+// Picks the coarsest level whose simplification error projects to at most AGL_GFX_LOD_PIXEL_ERROR pixels. The error is
+// measured against the bounding sphere: a level is usable while error / radius * (projected radius in pixels) stays small.
+static agl_uint agl__SelectMeshLod(const agl__gfx_canvas_t *canvas, const agl__gfx_mesh_t *mesh, const agl_float sphere[4]) {
+    if (mesh->lodCount < 2 || mesh->boundsRadius <= 0.f || canvas->camera.fovY <= 0.f)
+        return 0;
+    agl_float d[3] = { sphere[0] - canvas->camera.pos[0], sphere[1] - canvas->camera.pos[1], sphere[2] - canvas->camera.pos[2] };
+    agl_float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) - sphere[3];
+    if (distance <= canvas->camera.nearZ)
+        return 0;
+    agl_float projectedRadius = sphere[3] / (distance * tanf(0.5f * canvas->camera.fovY)) * (0.5f * (agl_float)canvas->height);
+    agl_float pixelsPerError = projectedRadius / mesh->boundsRadius;
+    agl_uint lod = 0;
+    while (lod + 1 < mesh->lodCount && mesh->lods[lod + 1].error * pixelsPerError <= AGL_GFX_LOD_PIXEL_ERROR)
+        lod++;
+    return lod;
+}
+
+// viewProj * the model matrix of a draw
+static void agl__MakeDrawMvp(mat4f_t *mvp, const mat4f_t *viewProj, const agl__gfx_mesh_draw_t *draw) {
+    mat4v_t vp = mat4v_load(viewProj), model = agl__MakeDrawMatrix(draw);
+    mat4v_t m = mat4v_mul(&vp, &model);
+    mat4v_store(&m, mvp);
+}
+
+// Hands the occluder draws recorded last frame to the occlusion worker, which runs while the update callback does
+static void agl__BeginOcclusionPass(agl__gfx_canvas_t *canvas) {
+    agl__gfx_occlusion_t *occ = &canvas->occlusion;
+    agl__WaitOcclusionPass(occ);
+    occ->ready = AGL_FALSE;
+    occ->frameViewSet = AGL_FALSE;
+    occ->occluderCount = 0;
+    agl_uint maxVertexCount = 0;
+    // Skinned occluders are posed here, on the main thread, so the worker only ever sees plain triangles
+    agl_uint skinnedNeeded = 0, skinnedUsed = 0;
+    for (agl_uint i = 0; i < occ->recordedCount; i++) {
+        agl__gfx_mesh_t *pmesh = agl__MeshPoolGet(&canvas->context->meshPool, occ->recorded[i].mesh);
+        if (pmesh && pmesh->occluderJoints && occ->recorded[i].jointCount)
+            skinnedNeeded += 3 * pmesh->vertexCount;
+    }
+    if (skinnedNeeded > occ->skinnedCapacity) {
+        occ->skinnedCapacity = skinnedNeeded;
+        occ->skinnedPositions = (agl_float*)realloc(occ->skinnedPositions, skinnedNeeded * sizeof(agl_float));
+    }
+    for (agl_uint i = 0; i < occ->recordedCount; i++) {
+        const agl__gfx_mesh_draw_t *draw = &occ->recorded[i];
+        agl__gfx_mesh_t *pmesh = agl__MeshPoolGet(&canvas->context->meshPool, draw->mesh);
+        if (!pmesh || !pmesh->occluderPositions)
+            continue;
+        if (occ->occluderCount == occ->occluderCapacity) {
+            occ->occluderCapacity = occ->occluderCapacity ? occ->occluderCapacity * 2 : 64;
+            occ->occluders = (agl__gfx_occluder_t*)realloc(occ->occluders, occ->occluderCapacity * sizeof(agl__gfx_occluder_t));
+        }
+        agl__gfx_occluder_t *occluder = &occ->occluders[occ->occluderCount++];
+        agl__MakeDrawMvp(&occluder->mvp, &occ->recordedViewProj, draw);
+        occluder->positions = pmesh->occluderPositions;
+        if (pmesh->occluderJoints && draw->jointCount) {
+            agl_float *posed = occ->skinnedPositions + skinnedUsed;
+            agl_skin_vertices(posed, NULL, pmesh->occluderPositions, NULL, pmesh->occluderJoints, pmesh->occluderWeights,
+                &occ->recordedJoints[draw->jointFirst][0][0], draw->jointCount, pmesh->vertexCount);
+            skinnedUsed += 3 * pmesh->vertexCount;
+            occluder->positions = posed;
+        }
+        occluder->indices = pmesh->occluderIndices;
+        occluder->vertexCount = pmesh->vertexCount;
+        occluder->indexCount = pmesh->occluderIndexCount;
+        maxVertexCount = pmesh->vertexCount > maxVertexCount ? pmesh->vertexCount : maxVertexCount;
+    }
+    occ->recordedCount = 0;
+    occ->recordedJointCount = 0;
+    if (!occ->enabled || occ->occluderCount == 0)
+        return;
+    if (maxVertexCount > occ->screenVertCapacity) {
+        occ->screenVertCapacity = maxVertexCount;
+        occ->screenVerts = (vec4f_t*)realloc(occ->screenVerts, maxVertexCount * sizeof(vec4f_t));
+    }
+    occ->viewProj = occ->recordedViewProj;
+    agl__StartOcclusionThread(occ);
+}
+
+// True if a flush with this view-projection belongs to the occlusion view. Other cameras of the frame, such as a second split
+// screen view, neither feed the pyramid nor get tested against it, since its depths are only meaningful in the one view.
+static agl_bool agl__IsOcclusionView(agl__gfx_occlusion_t *occ, const mat4f_t *viewProj) {
+    if (!occ->frameViewSet) {
+        occ->frameViewProj = *viewProj;
+        occ->frameViewSet = AGL_TRUE;
+    }
+    return memcmp(&occ->frameViewProj, viewProj, sizeof(*viewProj)) == 0;
+}
+
+// Records the frustum visible occluder draws of a flush for the next frame's occlusion pass
+static void agl__RecordOccluders(agl__gfx_canvas_t *canvas, const mat4f_t *viewProj) {
+    agl__gfx_occlusion_t *occ = &canvas->occlusion;
+    for (agl_uint i = 0; i < canvas->meshDrawsUsed; i++) {
+        agl__gfx_mesh_t *pmesh = agl__MeshPoolGet(&canvas->context->meshPool, canvas->meshDraws[i].mesh);
+        if (!canvas->meshDrawVisible[i] || !pmesh || !pmesh->occluderPositions)
+            continue;
+        if (occ->recordedCount == occ->recordedCapacity) {
+            occ->recordedCapacity = occ->recordedCapacity ? occ->recordedCapacity * 2 : 64;
+            occ->recorded = (agl__gfx_mesh_draw_t*)realloc(occ->recorded, occ->recordedCapacity * sizeof(agl__gfx_mesh_draw_t));
+        }
+        agl__gfx_mesh_draw_t *recorded = &occ->recorded[occ->recordedCount++];
+        *recorded = canvas->meshDraws[i];
+        if (recorded->jointCount == 0)
+            continue;
+        // The canvas palettes are reused by the next flush, the pass needs its own copy
+        agl_uint needed = occ->recordedJointCount + recorded->jointCount;
+        if (needed > occ->recordedJointCapacity) {
+            occ->recordedJointCapacity = needed > 2 * occ->recordedJointCapacity ? needed : 2 * occ->recordedJointCapacity;
+            occ->recordedJoints = (agl_float4(*)[4])realloc(occ->recordedJoints, occ->recordedJointCapacity * sizeof(agl_float4[4]));
+        }
+        memcpy(occ->recordedJoints[occ->recordedJointCount], canvas->joints[recorded->jointFirst], recorded->jointCount * sizeof(agl_float4[4]));
+        recorded->jointFirst = occ->recordedJointCount;
+        occ->recordedJointCount = needed;
+    }
+    occ->recordedViewProj = *viewProj;
+}
+
+// Clears the visibility of draws whose bounding box is hidden by the pyramid, returns how many were hidden
+static agl_uint agl__OcclusionCullDraws(agl__gfx_canvas_t *canvas) {
+    agl__gfx_occlusion_t *occ = &canvas->occlusion;
+    agl__WaitOcclusionPass(occ);
+    if (!occ->ready)
+        return 0;
+    agl_uint occluded = 0;
+    for (agl_uint i = 0; i < canvas->meshDrawsUsed; i++) {
+        const agl__gfx_mesh_draw_t *draw = &canvas->meshDraws[i];
+        agl__gfx_mesh_t *pmesh = agl__MeshPoolGet(&canvas->context->meshPool, draw->mesh);
+        if (!canvas->meshDrawVisible[i] || !pmesh)
+            continue;
+        mat4f_t mvp;
+        agl__MakeDrawMvp(&mvp, &occ->viewProj, draw);
+        const agl_float *boundsMin = pmesh->boundsMin, *boundsMax = pmesh->boundsMax;
+        agl_float posedMin[3], posedMax[3];
+        if (draw->jointCount) {
+            agl_float sphere[4];
+            agl__GetDrawBounds(sphere, canvas, draw, pmesh);
+            for (int k = 0; k < 3; k++) {
+                posedMin[k] = sphere[k] - sphere[3];
+                posedMax[k] = sphere[k] + sphere[3];
+            }
+            boundsMin = posedMin;
+            boundsMax = posedMax;
+        }
+        if (agl__IsBoxOccluded(occ, &mvp, boundsMin, boundsMax)) {
+            canvas->meshDrawVisible[i] = 0;
+            occluded++;
+        }
+    }
+    return occluded;
+}
+
+// Appends the indices of the meshlets of a full detail draw that are inside the frustum and front facing to the meshlet
+// stream, returns how many were appended
+static agl_uint agl__CullMeshlets(agl__gfx_canvas_t *canvas, const agl__gfx_mesh_draw_t *draw, const agl__gfx_mesh_t *pmesh, const vec4f_t planes[6]) {
+    agl_uint count = pmesh->meshletCount;
+    if (count > canvas->meshletScratchCapacity) {
+        canvas->meshletScratchCapacity = count;
+        canvas->meshletSpheres = (agl_float*)realloc(canvas->meshletSpheres, 4 * count * sizeof(agl_float));
+        canvas->meshletVisible = (uint8_t*)realloc(canvas->meshletVisible, count);
+    }
+    agl_uint needed = canvas->meshletStreamUsed + pmesh->lods[0].indexCount;
+    if (needed > canvas->meshletStreamCapacity) {
+        canvas->meshletStreamCapacity = needed > 2 * canvas->meshletStreamCapacity ? needed : 2 * canvas->meshletStreamCapacity;
+        canvas->meshletStream = (agl_uint*)realloc(canvas->meshletStream, canvas->meshletStreamCapacity * sizeof(agl_uint));
+    }
+    agl_float *x = canvas->meshletSpheres;
+    agl_float *y = x + count;
+    agl_float *z = y + count;
+    agl_float *radius = z + count;
+    for (agl_uint m = 0; m < count; m++) {
+        agl_float sphere[4];
+        agl__TransformBoundingSphere(sphere, pmesh->meshlets[m].center, pmesh->meshlets[m].radius, draw->pos, draw->rot, draw->scale);
+        x[m] = sphere[0];
+        y[m] = sphere[1];
+        z[m] = sphere[2];
+        radius[m] = sphere[3];
+    }
+    agl_cull_spheres(canvas->meshletVisible, x, y, z, radius, count, planes, 6);
+    // Camera in mesh space for the cone test, which a mirroring scale would turn inside out
+    agl_bool testCones = draw->scale > 0.f;
+    agl_float eye[3];
+    if (testCones) {
+        agl_float rel[3] = { canvas->camera.pos[0] - draw->pos[0], canvas->camera.pos[1] - draw->pos[1], canvas->camera.pos[2] - draw->pos[2] };
+        agl_float4 inverse = { -draw->rot[0], -draw->rot[1], -draw->rot[2], draw->rot[3] };
+        agl__RotateVector(eye, inverse, rel);
+        eye[0] /= draw->scale;
+        eye[1] /= draw->scale;
+        eye[2] /= draw->scale;
+    }
+    agl_uint *dst = canvas->meshletStream + canvas->meshletStreamUsed;
+    agl_uint written = 0, culled = 0;
+    for (agl_uint m = 0; m < count; m++) {
+        const agl__gfx_meshlet_t *meshlet = &pmesh->meshlets[m];
+        if (!canvas->meshletVisible[m] || (testCones && agl__IsMeshletBackFacing(meshlet, eye))) {
+            culled++;
+            continue;
+        }
+        memcpy(dst + written, pmesh->meshletIndices + meshlet->indexOffset, 3 * meshlet->triangleCount * sizeof(agl_uint));
+        written += 3 * meshlet->triangleCount;
+    }
+    canvas->meshletStreamUsed += written;
+    canvas->drawStats.meshletsSubmitted += count;
+    canvas->drawStats.meshletsCulled += culled;
+    return written;
+}
+
+// Uploads the meshlet stream built by the flush, growing its index buffer when needed
+static void agl__UploadMeshletStream(agl__gfx_canvas_t *canvas) {
+    if (canvas->meshletStreamUsed == 0)
+        return;
+    if (canvas->meshletStreamUsed > canvas->meshletIboCapacity) {
+        if (canvas->activeIbo == canvas->meshletIbo)
+            canvas->activeIbo = 0;
+        glDeleteBuffers(1, &canvas->meshletIbo);
+        canvas->meshletIboCapacity = canvas->meshletStreamCapacity;
+        glCreateBuffers(1, &canvas->meshletIbo);
+        glNamedBufferStorage(canvas->meshletIbo, sizeof(GLuint) * canvas->meshletIboCapacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+    }
+    glNamedBufferSubData(canvas->meshletIbo, 0, sizeof(GLuint) * canvas->meshletStreamUsed, canvas->meshletStream);
+}
+
+// Uploads the joint palettes of the flush, growing their storage buffer when needed
+static void agl__UploadJoints(agl__gfx_canvas_t *canvas) {
+    if (canvas->jointsUsed == 0)
+        return;
+    if (canvas->jointsUsed > canvas->jointBufCapacity) {
+        glDeleteBuffers(1, &canvas->jointBuf);
+        canvas->jointBufCapacity = canvas->jointsCapacity;
+        glCreateBuffers(1, &canvas->jointBuf);
+        glNamedBufferStorage(canvas->jointBuf, sizeof(agl_float4[4]) * canvas->jointBufCapacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+    }
+    glNamedBufferSubData(canvas->jointBuf, 0, sizeof(agl_float4[4]) * canvas->jointsUsed, canvas->joints);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, canvas->jointBuf);
+}
+
+static void agl__SetJointBase(agl__gfx_canvas_t *canvas, GLint jointBase) {
+    if (canvas->activeJointBase != jointBase) {
+        // int JointBase;
+        glProgramUniform1i(canvas->meshProg, 6, jointBase);
+        canvas->activeJointBase = jointBase;
+    }
+}
+
+static void agl__BindMeshBuffers(agl__gfx_canvas_t *canvas, agl_gfx_mesh_t mesh, const agl__gfx_mesh_t *pmesh, GLuint ibo) {
+	// Bind mesh buffer
+    agl__gfx_buffer_t *pbuf = agl__BufferPoolGet(&canvas->context->bufferPool, pmesh->vertexBufId);
+    if (canvas->activeMesh.id != mesh.id) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, pbuf->buf);
+        canvas->activeMesh.id = mesh.id;
+    }
+    if (ibo && canvas->activeIbo != ibo) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        canvas->activeIbo = ibo;
+    }
+}
+
+static void agl__SubmitMeshDraw(agl__gfx_canvas_t *canvas, const agl__gfx_mesh_draw_t *draw, agl__gfx_mesh_t *pmesh, const agl__gfx_draw_range_t *range) {
+    if (range->count == 0)
+        return;
+    GLuint ibo = range->stream ? canvas->meshletIbo : pmesh->ibo;
+    agl__BindMeshBuffers(canvas, draw->mesh, pmesh, ibo);
+    {
+        mat4f_t mat;
+        mat4v_t model = agl__MakeDrawMatrix(draw);
+        mat4v_store(&model, &mat);
+        // mat4 Transform;
+        glProgramUniformMatrix4fv(canvas->meshProg, 3, 1, GL_FALSE, &mat._m[0][0]);
+        // vec4 TintColor
+        glProgramUniform4fv(canvas->meshProg, 4, 1, &draw->color[0]);
+    }
+    agl__SetJointBase(canvas, draw->jointCount ? (GLint)draw->jointFirst : -1);
+    if (ibo) {
+        glDrawElements(GL_TRIANGLES, range->count, GL_UNSIGNED_INT, (const void*)(size_t)(sizeof(GLuint) * range->first));
+        // agl__gfx_tracef("Draw Call (Mesh) : %d verts, %d indxs", pmesh->vertexCount, range->count);
+    } else {
+        glDrawArrays(GL_TRIANGLES, range->first, range->count);
+        // agl__gfx_tracef("Draw Call (Mesh) : %d verts", pmesh->vertexCount);
+    }
+}
+
+// Culls the queued instances one by one, compacts the visible matrices of each batch to the front of the instance array
+// and returns how many are left. Instance bounds are the mesh sphere scaled by the longest axis of the matrix.
+static agl_uint agl__CullInstances(agl__gfx_canvas_t *canvas, const vec4f_t planes[6]) {
+    agl_uint count = canvas->instancesUsed;
+    agl_float *x = canvas->instanceSpheres;
+    agl_float *y = x + canvas->instancesCapacity;
+    agl_float *z = y + canvas->instancesCapacity;
+    agl_float *radius = z + canvas->instancesCapacity;
+    for (agl_uint b = 0; b < canvas->instanceBatchesUsed; b++) {
+        const agl__gfx_instance_batch_t *batch = &canvas->instanceBatches[b];
+        agl__gfx_mesh_t *pmesh = agl__MeshPoolGet(&canvas->context->meshPool, batch->mesh);
+        for (agl_uint i = batch->first; i < batch->first + batch->count; i++) {
+            const agl_float4 *m = canvas->instanceTransforms[i];
+            if (!pmesh) {
+                radius[i] = -FLT_MAX; // destroyed meshes never pass the test
+                continue;
+            }
+            const agl_float *c = pmesh->boundsCenter;
+            x[i] = m[0][0] * c[0] + m[1][0] * c[1] + m[2][0] * c[2] + m[3][0];
+            y[i] = m[0][1] * c[0] + m[1][1] * c[1] + m[2][1] * c[2] + m[3][1];
+            z[i] = m[0][2] * c[0] + m[1][2] * c[1] + m[2][2] * c[2] + m[3][2];
+            agl_float scale2 = 0.f;
+            for (int k = 0; k < 3; k++)
+                scale2 = fmaxf(scale2, m[k][0] * m[k][0] + m[k][1] * m[k][1] + m[k][2] * m[k][2]);
+            radius[i] = pmesh->boundsRadius * sqrtf(scale2);
+        }
+    }
+    if (canvas->camera.fovY > 0.f) {
+        agl_cull_spheres(canvas->instanceVisible, x, y, z, radius, count, planes, 6);
+    } else {
+        for (agl_uint i = 0; i < count; i++)
+            canvas->instanceVisible[i] = radius[i] >= 0.f;
+    }
+    agl_uint written = 0;
+    for (agl_uint b = 0; b < canvas->instanceBatchesUsed; b++) {
+        agl__gfx_instance_batch_t *batch = &canvas->instanceBatches[b];
+        agl_uint first = written;
+        for (agl_uint i = batch->first; i < batch->first + batch->count; i++) {
+            if (!canvas->instanceVisible[i])
+                continue;
+            if (written != i)
+                memcpy(canvas->instanceTransforms[written], canvas->instanceTransforms[i], sizeof(agl_float4[4]));
+            written++;
+        }
+        batch->first = first;
+        batch->count = written - first;
+    }
+    canvas->drawStats.meshesSubmitted += count;
+    canvas->drawStats.meshesCulled += count - written;
+    return written;
+}
+
+// Uploads the visible instance matrices and issues one instanced draw per batch, the mesh program must be active
+static void agl__SubmitInstances(agl__gfx_canvas_t *canvas, agl_uint visibleCount) {
+    if (visibleCount > canvas->instanceBufCapacity) {
+        glDeleteBuffers(1, &canvas->instanceBuf);
+        canvas->instanceBufCapacity = canvas->instancesCapacity;
+        glCreateBuffers(1, &canvas->instanceBuf);
+        glNamedBufferStorage(canvas->instanceBuf, sizeof(agl_float4[4]) * canvas->instanceBufCapacity, NULL, GL_DYNAMIC_STORAGE_BIT);
+    }
+    glNamedBufferSubData(canvas->instanceBuf, 0, sizeof(agl_float4[4]) * visibleCount, canvas->instanceTransforms);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, canvas->instanceBuf);
+    agl__SetJointBase(canvas, -1);
+    for (agl_uint b = 0; b < canvas->instanceBatchesUsed; b++) {
+        const agl__gfx_instance_batch_t *batch = &canvas->instanceBatches[b];
+        agl__gfx_mesh_t *pmesh = agl__MeshPoolGet(&canvas->context->meshPool, batch->mesh);
+        if (batch->count == 0 || !pmesh)
+            continue;
+        agl__BindMeshBuffers(canvas, batch->mesh, pmesh, pmesh->ibo);
+        // int InstanceBase;
+        glProgramUniform1i(canvas->meshProg, 5, (GLint)batch->first);
+        // vec4 TintColor
+        glProgramUniform4fv(canvas->meshProg, 4, 1, &batch->color[0]);
+        if (pmesh->ibo) {
+            glDrawElementsInstanced(GL_TRIANGLES, pmesh->lods[0].indexCount, GL_UNSIGNED_INT, NULL, batch->count);
+        } else {
+            glDrawArraysInstanced(GL_TRIANGLES, 0, pmesh->vertexCount, batch->count);
+        }
+    }
+    glProgramUniform1i(canvas->meshProg, 5, -1);
+}
+
+// Culls the queued mesh draws against the camera frustum in one batch and submits the visible ones in order
+static void agl__FlushMeshDraws(agl__gfx_canvas_t *canvas) {
+    agl_uint count = canvas->meshDrawsUsed;
+    if (count == 0 && canvas->instancesUsed == 0)
+        return;
+    agl_float *x = canvas->meshDrawSpheres;
+    agl_float *y = x + canvas->meshDrawsTotal;
+    agl_float *z = y + canvas->meshDrawsTotal;
+    agl_float *radius = z + canvas->meshDrawsTotal;
+    for (agl_uint i = 0; i < count; i++) {
+        const agl__gfx_mesh_draw_t *draw = &canvas->meshDraws[i];
+        agl__gfx_mesh_t *pmesh = agl__MeshPoolGet(&canvas->context->meshPool, draw->mesh);
+        agl_float sphere[4] = { 0.f, 0.f, 0.f, -FLT_MAX }; // destroyed meshes never pass the test
+        if (pmesh) {
+            agl_float local[4];
+            agl__GetDrawBounds(local, canvas, draw, pmesh);
+            agl__TransformBoundingSphere(sphere, local, local[3], draw->pos, draw->rot, draw->scale);
+        }
+        x[i] = sphere[0];
+        y[i] = sphere[1];
+        z[i] = sphere[2];
+        radius[i] = sphere[3];
+    }
+    mat4f_t view, proj, viewProj;
+    agl__MakeViewMatrix(&view, canvas->camera.pos, canvas->camera.rot);
+    mat4f_perspective(&proj, canvas->camera.fovY, (agl_float)canvas->width / (agl_float)canvas->height, canvas->camera.nearZ, canvas->camera.farZ);
+    {
+        mat4v_t v = mat4v_load(&view), p = mat4v_load(&proj);
+        mat4v_t vp = mat4v_mul(&p, &v);
+        mat4v_store(&vp, &viewProj);
+    }
+    vec4f_t planes[6];
+    mat4f_frustum_planes(planes, &viewProj);
+    size_t visibleCount = count;
+    if (canvas->camera.fovY > 0.f) {
+        visibleCount = agl_cull_spheres(canvas->meshDrawVisible, x, y, z, radius, count, planes, 6);
+    } else {
+        memset(canvas->meshDrawVisible, 1, count); // no projection set up yet, nothing to cull against
+    }
+    canvas->drawStats.meshesSubmitted += count;
+    canvas->drawStats.meshesCulled += count - (agl_uint)visibleCount;
+    if (canvas->occlusion.enabled && agl__IsOcclusionView(&canvas->occlusion, &viewProj)) {
+        // Occluders are recorded before the occlusion test so hiding each other cannot make them flicker
+        agl__RecordOccluders(canvas, &viewProj);
+        agl_uint occluded = agl__OcclusionCullDraws(canvas);
+        canvas->drawStats.meshesOccluded += occluded;
+        visibleCount -= occluded;
+    }
+    // Pick the index range of every visible draw, full detail draws of meshlet meshes are culled into the meshlet stream
+    canvas->meshletStreamUsed = 0;
+    for (agl_uint i = 0; i < count; i++) {
+        const agl__gfx_mesh_draw_t *draw = &canvas->meshDraws[i];
+        agl__gfx_mesh_t *pmesh = agl__MeshPoolGet(&canvas->context->meshPool, draw->mesh);
+        if (!canvas->meshDrawVisible[i] || !pmesh)
+            continue;
+        agl__gfx_draw_range_t *range = &canvas->meshDrawRanges[i];
+        range->stream = AGL_FALSE;
+        range->first = 0;
+        range->count = pmesh->vertexCount;
+        if (!pmesh->ibo)
+            continue;
+        agl_float sphere[4] = { x[i], y[i], z[i], radius[i] };
+        const agl__gfx_mesh_lod_t *lod = &pmesh->lods[agl__SelectMeshLod(canvas, pmesh, sphere)];
+        range->first = lod->indexOffset;
+        range->count = lod->indexCount;
+        // Meshlet bounds and cones only hold in the bind pose
+        if (lod == &pmesh->lods[0] && pmesh->meshletCount && draw->jointCount == 0 && canvas->camera.fovY > 0.f) {
+            range->stream = AGL_TRUE;
+            range->first = canvas->meshletStreamUsed;
+            range->count = agl__CullMeshlets(canvas, draw, pmesh, planes);
+        }
+    }
+    agl__UploadMeshletStream(canvas);
+    agl__UploadJoints(canvas);
+    agl_uint visibleInstances = canvas->instancesUsed ? agl__CullInstances(canvas, planes) : 0;
+    if (visibleCount || visibleInstances) {
+        // mat4 CameraView;
+        glProgramUniformMatrix4fv(canvas->meshProg, 1, 1, GL_FALSE, &view._m[0][0]);
+        // mat4 CameraProj;
+        glProgramUniformMatrix4fv(canvas->meshProg, 2, 1, GL_FALSE, &proj._m[0][0]);
+        agl__SwitchProgram(canvas, canvas->meshProg);
+    }
+    for (agl_uint i = 0; i < count; i++) {
+        agl__gfx_mesh_t *pmesh = agl__MeshPoolGet(&canvas->context->meshPool, canvas->meshDraws[i].mesh);
+        if (!canvas->meshDrawVisible[i] || !pmesh)
+            continue;
+        agl__SubmitMeshDraw(canvas, &canvas->meshDraws[i], pmesh, &canvas->meshDrawRanges[i]);
+    }
+    if (visibleInstances)
+        agl__SubmitInstances(canvas, visibleInstances);
+    canvas->meshDrawsUsed = 0;
+    canvas->jointsUsed = 0;
+    canvas->instancesUsed = 0;
+    canvas->instanceBatchesUsed = 0;
+}
+
 void agl_gfx_main_loop(agl_gfx_context_t context) {
 #if _WIN32
     LARGE_INTEGER StartTime, EndTime, ElapsedMicros;
@@ -2147,8 +4454,13 @@ void agl_gfx_main_loop(agl_gfx_context_t context) {
         glProgramUniform2f(context->canvas->quadProg, 0, context->canvas->width, context->canvas->height);
         glProgramUniform4uiv(context->canvas->quadProg, 1, 1, &context->canvas->fontGlyphWidth);
         
+        agl__BeginOcclusionPass(context->canvas);
 		context->updatefn(context, dt);
+        agl__FlushMeshDraws(context->canvas);
         agl__FlushQuads(context->canvas);
+        agl__WaitOcclusionPass(&context->canvas->occlusion);
+        context->canvas->lastDrawStats = context->canvas->drawStats;
+        memset(&context->canvas->drawStats, 0, sizeof(context->canvas->drawStats));
 
         SwapBuffers(context->hdc);
     }
@@ -2173,12 +4485,14 @@ void agl_gfx_draw_screen_quad(agl_gfx_canvas_t canvas, const agl_float2 pos, con
 
 
 void agl_gfx_set_camera_position(agl_gfx_canvas_t canvas, const agl_float3 pos) {
+    agl__FlushMeshDraws(canvas); // queued draws use the camera they were issued with
     canvas->camera.pos[0] = pos[0];
     canvas->camera.pos[1] = pos[1];
     canvas->camera.pos[2] = pos[2];
 }
 
 void agl_gfx_set_camera_look_at(agl_gfx_canvas_t canvas, const agl_float3 tgt, const agl_float3 worldUp) {
+    agl__FlushMeshDraws(canvas);
     agl_float pos[3] = { canvas->camera.pos[0], canvas->camera.pos[1], canvas->camera.pos[2] };
     agl_float rt[3] = { 0, 0, 0 };
     agl_float up[3] = { worldUp[0], worldUp[1], worldUp[2] };
@@ -2225,96 +4539,133 @@ void agl_gfx_set_camera_look_at(agl_gfx_canvas_t canvas, const agl_float3 tgt, c
 }
 
 void agl_gfx_set_camera_perspective(agl_gfx_canvas_t canvas, agl_float fovY, agl_float nearZ, agl_float farZ) {
+    agl__FlushMeshDraws(canvas);
     canvas->camera.aspect = (agl_float)canvas->width / (agl_float)canvas->height;
     canvas->camera.fovY = fovY;
     canvas->camera.nearZ = nearZ;
     canvas->camera.farZ = farZ;
 }
 
-static void agl__MakeViewMatrix(agl_float4 mat[4], const agl_float3 pos, const agl_float3 rot[3]) {
-    memset(mat, 0, sizeof(agl_float4[4]));
-    for (int i = 0; i < 3; i++) for (int j = 0; j < 3; j++) {
-        mat[j][i] = rot[i][j];
+void agl_gfx_draw_mesh(agl_gfx_canvas_t canvas, agl_gfx_mesh_t mesh, const agl_float3 pos, const agl_float4 rot, agl_float scale, const agl_float4 color)
+{
+    if (canvas->meshDrawsUsed == canvas->meshDrawsTotal) {
+        agl__FlushMeshDraws(canvas);
     }
-    for (int i = 0; i < 3; i++) {
-        mat[3][i] = -(pos[0]*rot[0][i] + pos[1]*rot[1][i] + pos[2]*rot[2][i]);
-    }
-    mat[3][3] = 1.f;
-}
-
-static void agl__MakePerspectiveMatrix(agl_float4 mat[4], agl_float aspect, agl_float fovY, agl_float nearZ, agl_float farZ) {
-    agl_float n = nearZ, f = farZ;
-    agl_float t = tanf(fovY / 2) * n;
-    agl_float b = -t;
-    agl_float r = t * aspect;
-    agl_float l = -t * aspect;
-    memset(mat, 0, sizeof(agl_float4[4]));
-    mat[0][0] = 2 * n / (r - l);
-    mat[1][1] = 2 * n / (t - b);
-    mat[2][0] = (r + l) / (r - l);
-    mat[2][1] = (t + b) / (t - b);
-    mat[2][2] = -(f + n) / (f - n);
-    mat[2][3] = -1;
-    mat[3][2] = -2 * f * n / (f - n);
-}
-
-static void agl__MakeTransformMatrix(agl_float4 mat[4], const agl_float3 pos, const agl_float4 quat, const float scale) {
-    memset(mat, 0, sizeof(agl_float4[4]));
-    agl_float q0 = quat[3], q1 = quat[0], q2 = quat[1], q3 = quat[2];
-    mat[0][0] = 1 - 2*q2*q2 - 2*q3*q3;
-	mat[1][0] = 2*q1*q2 - 2*q0*q3;
-	mat[2][0] = 2*q1*q3 + 2*q0*q2;
-	mat[0][1] = 2*q1*q2 + 2*q0*q3;
-	mat[1][1] = 1 - 2*q1*q1 - 2*q3*q3;
-	mat[2][1] = 2*q2*q3 - 2*q0*q1;
-	mat[0][2] = 2*q1*q3 - 2*q0*q2;
-	mat[1][2] = 2*q2*q3 + 2*q0*q1;
-	mat[2][2] = 1 - 2*q1*q1 - 2*q2*q2;
-    for (int i = 0; i < 3; i++) {
-		mat[0][i] *= scale;
-		mat[1][i] *= scale;
-		mat[2][i] *= scale;
-        mat[3][i] = pos[i];
+    agl__gfx_mesh_draw_t *draw = &canvas->meshDraws[canvas->meshDrawsUsed++];
+    draw->mesh = mesh;
+    memcpy(draw->pos, pos, sizeof(agl_float3));
+    memcpy(draw->rot, rot, sizeof(agl_float4));
+    draw->scale = scale;
+    if (color == NULL)
+        color = (agl_float4){1,1,1,1};
+    memcpy(draw->color, color, sizeof(agl_float4));
+    draw->jointFirst = 0;
+    draw->jointCount = 0;
+}
+
+void agl_gfx_draw_skinned_mesh(agl_gfx_canvas_t canvas, agl_gfx_mesh_t mesh, const agl_float3 pos, const agl_float4 rot, agl_float scale, const agl_float4 color,
+    const agl_float4 *joints, agl_uint jointCount) {
+    agl_gfx_draw_mesh(canvas, mesh, pos, rot, scale, color);
+    if (jointCount == 0)
+        return;
+    agl_uint needed = canvas->jointsUsed + jointCount;
+    if (needed > canvas->jointsCapacity) {
+        canvas->jointsCapacity = needed > 2 * canvas->jointsCapacity ? needed : 2 * canvas->jointsCapacity;
+        canvas->joints = (agl_float4(*)[4])realloc(canvas->joints, canvas->jointsCapacity * sizeof(agl_float4[4]));
     }
-    mat[3][3] = 1.f;
+    agl__gfx_mesh_draw_t *draw = &canvas->meshDraws[canvas->meshDrawsUsed - 1];
+    draw->jointFirst = canvas->jointsUsed;
+    draw->jointCount = jointCount;
+    memcpy(canvas->joints[canvas->jointsUsed], joints, jointCount * sizeof(agl_float4[4]));
+    canvas->jointsUsed = needed;
 }
 
-void agl_gfx_draw_mesh(agl_gfx_canvas_t canvas, agl_gfx_mesh_t mesh, const agl_float3 pos, const agl_float4 rot, agl_float scale, const agl_float4 color)
-{
-	// Bind mesh buffer
-    agl__gfx_mesh_t *pmesh = agl__MeshPoolGet(&canvas->context->meshPool, mesh);
-    agl__gfx_buffer_t *pbuf = agl__BufferPoolGet(&canvas->context->bufferPool, pmesh->vertexBufId);
-    if (canvas->activeMesh.id != mesh.id) {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, pbuf->buf);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pmesh->ibo);
-        canvas->activeMesh.id = mesh.id;
+void agl_gfx_draw_mesh_instanced(agl_gfx_canvas_t canvas, agl_gfx_mesh_t mesh, const agl_float4 *transforms, agl_uint count, const agl_float4 color) {
+    if (count == 0)
+        return;
+    if (canvas->instanceBatchesUsed == canvas->instanceBatchesCapacity) {
+        canvas->instanceBatchesCapacity = canvas->instanceBatchesCapacity ? 2 * canvas->instanceBatchesCapacity : 64;
+        canvas->instanceBatches = (agl__gfx_instance_batch_t*)realloc(canvas->instanceBatches, canvas->instanceBatchesCapacity * sizeof(agl__gfx_instance_batch_t));
     }
-    {
-        agl_float4 mat[4];
-        // mat4 CameraView;
-        agl__MakeViewMatrix(mat, canvas->camera.pos, canvas->camera.rot);
-        glProgramUniformMatrix4fv(canvas->meshProg, 1, 1, GL_FALSE, &mat[0][0]);
-        // mat4 CameraProj;
-        agl__MakePerspectiveMatrix(mat, (agl_float)canvas->width / (agl_float)canvas->height, canvas->camera.fovY, canvas->camera.nearZ, canvas->camera.farZ);
-        glProgramUniformMatrix4fv(canvas->meshProg, 2, 1, GL_FALSE, &mat[0][0]);
-        // mat4 Transform;
-        agl__MakeTransformMatrix(mat, pos, rot, scale);
-        glProgramUniformMatrix4fv(canvas->meshProg, 3, 1, GL_FALSE, &mat[0][0]);
-        // vec4 TintColor
-        if (color == NULL)
-            color = (agl_float4){1,1,1,1};
-        glProgramUniform4fv(canvas->meshProg, 4, 1, &color[0]);
-    }
-    agl__SwitchProgram(canvas, canvas->meshProg);
-    if (pmesh->ibo) {
-        glDrawElements(GL_TRIANGLES, pmesh->indexCount, GL_UNSIGNED_INT, 0);
-        // agl__gfx_tracef("Draw Call (Mesh) : %d verts, %d indxs", pmesh->vertexCount, pmesh->indexCount);
-    } else {
-        glDrawArrays(GL_TRIANGLES, 0, pmesh->vertexCount);
-        // agl__gfx_tracef("Draw Call (Mesh) : %d verts", pmesh->vertexCount);
+    agl_uint needed = canvas->instancesUsed + count;
+    if (needed > canvas->instancesCapacity) {
+        agl_uint capacity = needed > 2 * canvas->instancesCapacity ? needed : 2 * canvas->instancesCapacity;
+        canvas->instanceTransforms = (agl_float4(*)[4])realloc(canvas->instanceTransforms, capacity * sizeof(agl_float4[4]));
+        free(canvas->instanceSpheres);
+        canvas->instanceSpheres = (agl_float*)malloc(4 * capacity * sizeof(agl_float));
+        canvas->instanceVisible = (uint8_t*)realloc(canvas->instanceVisible, capacity);
+        canvas->instancesCapacity = capacity;
+    }
+    agl__gfx_instance_batch_t *batch = &canvas->instanceBatches[canvas->instanceBatchesUsed++];
+    batch->mesh = mesh;
+    batch->first = canvas->instancesUsed;
+    batch->count = count;
+    if (color == NULL)
+        color = (agl_float4){1,1,1,1};
+    memcpy(batch->color, color, sizeof(agl_float4));
+    memcpy(canvas->instanceTransforms[canvas->instancesUsed], transforms, count * sizeof(agl_float4[4]));
+    canvas->instancesUsed = needed;
+}
+
+void agl_gfx_draw_particles(agl_gfx_canvas_t canvas, const agl_gfx_particles_params_t *params) {
+    agl__gfx_buffer_t *buffer = agl__BufferPoolGet(&canvas->context->bufferPool, params->buffer);
+    if (!buffer || params->count == 0)
+        return;
+    agl__gfx_assertf(((params->xOffset | params->yOffset | params->zOffset | params->sizeOffset | params->colorOffset) & 3) == 0,
+        "Particle stream offsets must be multiples of 4!");
+    agl__FlushMeshDraws(canvas);
+    mat4f_t view, proj;
+    agl__MakeViewMatrix(&view, canvas->camera.pos, canvas->camera.rot);
+    mat4f_perspective(&proj, canvas->camera.fovY, (agl_float)canvas->width / (agl_float)canvas->height, canvas->camera.nearZ, canvas->camera.farZ);
+    agl__gfx_image_t *image = agl__ImagePoolGet(&canvas->context->imagePool, params->texture);
+    GLuint64 handle = image ? image->handle : 0;
+    // uvec4 Streams, in 4 byte words
+    agl_uint streams[4] = { params->xOffset / 4, params->yOffset / 4, params->zOffset / 4, params->sizeOffset / 4 };
+    // uvec4 ColorTexture
+    agl_uint colorTexture[4] = { params->colorOffset / 4, (agl_uint)handle, (agl_uint)(handle >> 32), image ? AGL_GFX_FLAG_TEXTURED : 0 };
+    glProgramUniformMatrix4fv(canvas->particleProg, 1, 1, GL_FALSE, &view._m[0][0]);
+    glProgramUniformMatrix4fv(canvas->particleProg, 2, 1, GL_FALSE, &proj._m[0][0]);
+    glProgramUniform4uiv(canvas->particleProg, 3, 1, streams);
+    glProgramUniform4uiv(canvas->particleProg, 4, 1, colorTexture);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, buffer->buf);
+    agl__SwitchProgram(canvas, canvas->particleProg);
+    glDepthMask(GL_FALSE);
+    glDrawArrays(GL_TRIANGLES, 0, params->count * 6);
+    glDepthMask(GL_TRUE);
+    if (buffer->fence)
+        glDeleteSync(buffer->fence);
+    buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void agl_gfx_set_occlusion_culling(agl_gfx_canvas_t canvas, agl_bool enabled) {
+    agl__gfx_occlusion_t *occ = &canvas->occlusion;
+    agl__FlushMeshDraws(canvas);
+    agl__WaitOcclusionPass(occ);
+    occ->enabled = enabled;
+    occ->ready = AGL_FALSE;
+    occ->recordedCount = 0;
+    if (enabled && !occ->hiZ) {
+        agl_uint width = AGL_GFX_OCCLUSION_WIDTH, height = AGL_GFX_OCCLUSION_HEIGHT, size = 0;
+        for (occ->levelCount = 0; occ->levelCount < AGL__HIZ_MAX_LEVELS; occ->levelCount++) {
+            occ->levelOffset[occ->levelCount] = size;
+            occ->levelWidth[occ->levelCount] = width;
+            occ->levelHeight[occ->levelCount] = height;
+            size += width * height;
+            if (width == 1 && height == 1) {
+                occ->levelCount++;
+                break;
+            }
+            width = width > 1 ? (width + 1) / 2 : 1;
+            height = height > 1 ? (height + 1) / 2 : 1;
+        }
+        occ->hiZ = (agl_float*)malloc(size * sizeof(agl_float));
     }
 }
 
+void agl_gfx_get_draw_stats(agl_gfx_canvas_t canvas, agl_gfx_draw_stats_t *stats) {
+    *stats = canvas->lastDrawStats;
+}
+
 static uint32_t agl__GetFontGlyph(char c) {
     switch (c) {
     case ' ': return AGL_FONT_GLYPH_SPACE;
@@ -2430,13 +4781,8 @@ void agl_gfx_register_loader(agl_gfx_context_t context, agl_gfx_loader_t *loader
 	context->firstLoader = _loader;
 }
 
-int agl_gfx_load_file(agl_gfx_context_t context, const char *path, agl_gfx_load_params_t *params) {
-	const char *ext = strrchr(path, '.');
+static agl__gfx_loader_t* agl__FindLoader(agl__gfx_context_t *context, const char *ext) {
 	size_t extLen = strlen(ext);
-	if (!ext) {
-		printf("File has no extension: %s\n", path);
-		return 0;
-	}
 	agl__gfx_loader_t *loader = context->firstLoader;
 	while (loader) {
 		const char *exts = loader->exts;
@@ -2445,19 +4791,418 @@ int agl_gfx_load_file(agl_gfx_context_t context, const char *path, agl_gfx_load_
 			size_t len = extEnd - exts;
 			printf("Checking loader for extension (%s): %.*s\n", ext, (int)len, exts);
 			if (_strnicmp(ext, exts, len > extLen ? len : extLen) == 0) {
-				return loader->load(context, path, params);
+				return loader;
 			}
 			exts = extEnd + 1;
 			extEnd = strchr(exts, ';');
 		}
 		if (_stricmp(ext, exts) == 0) {
 			printf("Checking loader for extension (%s): %s\n", ext, exts);
-			return loader->load(context, path, params);
+			return loader;
 		}
 		loader = loader->next;
 	}
-	printf("No loader found for file: %s\n", path);
-	return 0;
+	return NULL;
+}
+
+// FNV-1a
+static agl_uint64 agl__HashString(const char *str) {
+    agl_uint64 hash = 14695981039346656037ULL;
+    for (const unsigned char *c = (const unsigned char*)str; *c; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static agl_uint64 agl__Rotl64(agl_uint64 x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Content hash for change detection, not collision resistance. Four independent multiply lanes keep it memory bound.
+static agl_uint64 agl__HashBytes(const void *data, agl_uint64 size) {
+    const agl_uint64 prime = 0x9E3779B97F4A7C15ULL;
+    const unsigned char *bytes = (const unsigned char*)data;
+    agl_uint64 lanes[4] = { prime, prime ^ 1, prime ^ 2, prime ^ 3 };
+    agl_uint64 i = 0;
+    for (; i + 32 <= size; i += 32) {
+        agl_uint64 words[4];
+        memcpy(words, bytes + i, sizeof(words));
+        for (int l = 0; l < 4; l++)
+            lanes[l] = agl__Rotl64((lanes[l] ^ words[l]) * prime, 31);
+    }
+    agl_uint64 hash = size;
+    for (int l = 0; l < 4; l++)
+        hash = (hash ^ lanes[l]) * prime;
+    for (; i < size; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    // murmur3 finaliser
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static int agl__GetFileStamp(const char *path, agl_uint64 *size, agl_uint64 *time) {
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA attrs;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &attrs))
+        return AGL_GFX_ERROR;
+    *size = ((agl_uint64)attrs.nFileSizeHigh << 32) | attrs.nFileSizeLow;
+    *time = ((agl_uint64)attrs.ftLastWriteTime.dwHighDateTime << 32) | attrs.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+        return AGL_GFX_ERROR;
+    *size = (agl_uint64)st.st_size;
+    *time = (agl_uint64)st.st_mtim.tv_sec * 1000000000ULL + (agl_uint64)st.st_mtim.tv_nsec;
+#endif
+    return AGL_GFX_SUCCESS;
+}
+
+static int agl__HashFile(const char *path, agl_uint64 size, agl_uint64 *hash) {
+    if (size == 0) {
+        *hash = agl__HashBytes(NULL, 0); // empty files cannot be mapped
+        return AGL_GFX_SUCCESS;
+    }
+    agl_gfx_file_map_t map;
+    if (agl_gfx_map_file(path, &map) != AGL_GFX_SUCCESS)
+        return AGL_GFX_ERROR;
+    *hash = agl__HashBytes(map.data, map.size);
+    agl_gfx_unmap_file(&map);
+    return AGL_GFX_SUCCESS;
+}
+
+static agl_bool agl__MeshCacheStampCurrent(const char *path, const agl__gfx_mesh_cache_stamp_t *stamp) {
+    agl_uint64 size, time, hash;
+    if (agl__GetFileStamp(path, &size, &time) != AGL_GFX_SUCCESS || size != stamp->size)
+        return AGL_FALSE;
+    if (time == stamp->time)
+        return AGL_TRUE;
+    return agl__HashFile(path, size, &hash) == AGL_GFX_SUCCESS && hash == stamp->hash;
+}
+
+// Reserves an aligned block at the end of the cache payload and returns its offset
+static agl_uint64 agl__MeshCacheReserve(agl__gfx_mesh_cache_writer_t *writer, agl_uint64 size) {
+    agl_uint64 offset = (writer->payloadSize + AGL__MESH_CACHE_ALIGN - 1) & ~(agl_uint64)(AGL__MESH_CACHE_ALIGN - 1);
+    if (offset + size > writer->payloadCapacity) {
+        agl_uint64 capacity = writer->payloadCapacity ? writer->payloadCapacity : MiB(1);
+        while (capacity < offset + size)
+            capacity *= 2;
+        writer->payload = (char*)realloc(writer->payload, (size_t)capacity);
+        writer->payloadCapacity = capacity;
+    }
+    memset(writer->payload + writer->payloadSize, 0, (size_t)(offset - writer->payloadSize));
+    writer->payloadSize = offset + size;
+    return offset;
+}
+
+static void agl__MeshCacheRecord(agl__gfx_mesh_cache_writer_t *writer, const agl_gfx_mesh_params_t *params, const char *name) {
+    if (writer->entryCount == writer->entryCapacity) {
+        writer->entryCapacity = writer->entryCapacity ? writer->entryCapacity * 2 : 16;
+        writer->entries = (agl__gfx_mesh_cache_entry_t*)realloc(writer->entries, writer->entryCapacity * sizeof(agl__gfx_mesh_cache_entry_t));
+    }
+    agl__gfx_mesh_cache_entry_t *entry = &writer->entries[writer->entryCount++];
+    agl__gfx_mesh_buffer_info_t bufferInfo;
+    size_t nameSize = strlen(name ? name : "") + 1;
+    memset(entry, 0, sizeof(*entry));
+    entry->vertexCount = params->vertexCount;
+    entry->indexCount = params->indexData ? params->indexCount : 0;
+    entry->vertexSize = agl__LayoutMeshBuffer(params, &bufferInfo);
+    entry->vertexOffset = agl__MeshCacheReserve(writer, entry->vertexSize);
+    agl__WriteMeshBuffer(writer->payload + entry->vertexOffset, &bufferInfo, params);
+    entry->indexOffset = agl__MeshCacheReserve(writer, sizeof(agl_uint) * entry->indexCount);
+    if (entry->indexCount)
+        memcpy(writer->payload + entry->indexOffset, params->indexData, sizeof(agl_uint) * entry->indexCount);
+    entry->nameOffset = agl__MeshCacheReserve(writer, nameSize);
+    memcpy(writer->payload + entry->nameOffset, name ? name : "", nameSize);
+}
+
+// Stamps a file the cache depends on. Stamping before decoding means an edit made during the load leaves the cache stale.
+static void agl__MeshCacheAddDependency(agl__gfx_mesh_cache_writer_t *writer, const char *path) {
+    if (writer->dependencyCount == writer->dependencyCapacity) {
+        writer->dependencyCapacity = writer->dependencyCapacity ? writer->dependencyCapacity * 2 : 4;
+        writer->dependencies = (agl__gfx_mesh_cache_dependency_t*)realloc(writer->dependencies,
+            writer->dependencyCapacity * sizeof(agl__gfx_mesh_cache_dependency_t));
+    }
+    agl__gfx_mesh_cache_dependency_t *dependency = &writer->dependencies[writer->dependencyCount++];
+    agl__gfx_mesh_cache_stamp_t *stamp = &dependency->stamp;
+    size_t pathSize = strlen(path) + 1;
+    memset(dependency, 0, sizeof(*dependency));
+    if (agl__GetFileStamp(path, &stamp->size, &stamp->time) != AGL_GFX_SUCCESS ||
+        agl__HashFile(path, stamp->size, &stamp->hash) != AGL_GFX_SUCCESS) {
+        printf("Not caching, failed to stamp dependency: %s\n", path);
+        writer->failed = AGL_TRUE;
+    }
+    dependency->pathOffset = agl__MeshCacheReserve(writer, pathSize);
+    memcpy(writer->payload + dependency->pathOffset, path, pathSize);
+}
+
+void agl_gfx_loader_add_dependency(agl_gfx_context_t context, const char *path) {
+    if (context->cacheWriter && path)
+        agl__MeshCacheAddDependency(context->cacheWriter, path);
+}
+
+// Mesh flags implied by the load flags
+static agl_uint agl__MeshFlagsFromLoadFlags(agl_uint loadFlags) {
+    agl_uint flags = 0;
+    if (loadFlags & AGL_GFX_LOAD_FLAG_GENERATE_LODS_BIT)
+        flags |= AGL_GFX_MESH_FLAG_GENERATE_LODS_BIT;
+    if (loadFlags & AGL_GFX_LOAD_FLAG_MESHLETS_BIT)
+        flags |= AGL_GFX_MESH_FLAG_MESHLETS_BIT;
+    return flags;
+}
+
+// Last stage of the load pipeline: records the mesh into the cache being written, if any, and hands it to the caller
+static void agl__LoadedMeshCallback(agl_gfx_context_t context, const agl_gfx_mesh_params_t *params, const char *name) {
+    if (context->cacheWriter)
+        agl__MeshCacheRecord(context->cacheWriter, params, name);
+    if (context->loadParams->meshCallback) {
+        agl_gfx_mesh_params_t meshParams = *params;
+        meshParams.flags |= agl__MeshFlagsFromLoadFlags(context->loadParams->flags);
+        context->loadParams->meshCallback(context, &meshParams, name);
+    }
+}
+
+static void agl__OptimizeMeshCallback(agl_gfx_context_t context, const agl_gfx_mesh_params_t *params, const char *name) {
+    agl_gfx_mesh_params_t optimized;
+    agl_gfx_mesh_optimize_stats_t stats;
+    agl_uint flags = (context->loadParams->flags & AGL_GFX_LOAD_FLAG_OPTIMIZE_OVERDRAW_BIT) ? AGL_GFX_MESH_OPTIMIZE_OVERDRAW_BIT : 0;
+    if (agl_gfx_optimize_mesh(params, flags, &optimized, &stats) != AGL_GFX_SUCCESS) {
+        agl__LoadedMeshCallback(context, params, name);
+        return;
+    }
+    printf("Optimized mesh %s: %u -> %u vertices, ACMR %.3f -> %.3f\n", name ? name : "",
+        stats.vertexCountBefore, stats.vertexCountAfter, stats.acmrBefore, stats.acmrAfter);
+    agl__LoadedMeshCallback(context, &optimized, name);
+    agl_gfx_free_optimized_mesh(&optimized);
+}
+
+static void agl__WriteMeshCache(agl__gfx_mesh_cache_writer_t *writer, const char *cachePath, const agl__gfx_mesh_cache_header_t *key) {
+    char tempPath[1024];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", cachePath);
+    FILE *file = fopen(tempPath, "wb");
+    if (!file) {
+        printf("Failed to write mesh cache: %s\n", cachePath);
+        return;
+    }
+    agl__gfx_mesh_cache_header_t header = *key;
+    header.meshCount = writer->entryCount;
+    header.dependencyCount = writer->dependencyCount;
+    agl_uint64 tableSize = sizeof(header) + sizeof(agl__gfx_mesh_cache_entry_t) * writer->entryCount +
+        sizeof(agl__gfx_mesh_cache_dependency_t) * writer->dependencyCount;
+    agl_uint64 payloadStart = (tableSize + AGL__MESH_CACHE_ALIGN - 1) & ~(agl_uint64)(AGL__MESH_CACHE_ALIGN - 1);
+    for (agl_uint i = 0; i < writer->entryCount; i++) {
+        writer->entries[i].vertexOffset += payloadStart;
+        writer->entries[i].indexOffset += payloadStart;
+        writer->entries[i].nameOffset += payloadStart;
+    }
+    for (agl_uint i = 0; i < writer->dependencyCount; i++)
+        writer->dependencies[i].pathOffset += payloadStart;
+    static const char padding[AGL__MESH_CACHE_ALIGN];
+    size_t written = fwrite(&header, sizeof(header), 1, file);
+    written += fwrite(writer->entries, sizeof(agl__gfx_mesh_cache_entry_t), writer->entryCount, file);
+    written += fwrite(writer->dependencies, sizeof(agl__gfx_mesh_cache_dependency_t), writer->dependencyCount, file);
+    written += fwrite(padding, 1, (size_t)(payloadStart - tableSize), file);
+    written += fwrite(writer->payload, 1, (size_t)writer->payloadSize, file);
+    int failed = fclose(file) != 0 ||
+        written != 1 + writer->entryCount + writer->dependencyCount + (payloadStart - tableSize) + writer->payloadSize;
+    remove(cachePath);
+    if (failed || rename(tempPath, cachePath) != 0) {
+        printf("Failed to write mesh cache: %s\n", cachePath);
+        remove(tempPath);
+    }
+}
+
+// Returns the attribute stream starting at `start` in a cached vertex buffer, or NULL if it is absent or out of bounds
+static agl_float* agl__MeshCacheStream(const agl__gfx_mesh_cache_entry_t *entry, const agl__gfx_mesh_buffer_info_t *info, agl_uint start, agl_uint components) {
+    if (start == (agl_uint)-1)
+        return NULL;
+    agl_uint64 floatCount = (entry->vertexSize - sizeof(agl__gfx_mesh_buffer_info_t)) / sizeof(agl_float);
+    if ((agl_uint64)start + (agl_uint64)components * entry->vertexCount > floatCount)
+        return NULL;
+    return (agl_float*)(info + 1) + start;
+}
+
+// Reports the meshes of an up-to-date cache file through the caller's callback, straight from the mapping.
+// Returns AGL_GFX_ERROR if the cache is missing, stale or malformed.
+static int agl__ReadMeshCache(agl_gfx_context_t context, const char *cachePath, const agl__gfx_mesh_cache_header_t *key, const agl_gfx_load_params_t *params) {
+    agl_gfx_file_map_t map;
+    if (agl_gfx_map_file(cachePath, &map) != AGL_GFX_SUCCESS)
+        return AGL_GFX_ERROR;
+    const char *base = (const char*)map.data;
+    const agl__gfx_mesh_cache_header_t *header = (const agl__gfx_mesh_cache_header_t*)base;
+    if (map.size < sizeof(*header) || memcmp(header, key, offsetof(agl__gfx_mesh_cache_header_t, meshCount)) != 0 ||
+        map.size < sizeof(*header) + sizeof(agl__gfx_mesh_cache_entry_t) * (agl_uint64)header->meshCount +
+            sizeof(agl__gfx_mesh_cache_dependency_t) * (agl_uint64)header->dependencyCount) {
+        agl_gfx_unmap_file(&map);
+        return AGL_GFX_ERROR;
+    }
+    const agl__gfx_mesh_cache_entry_t *entries = (const agl__gfx_mesh_cache_entry_t*)(header + 1);
+    const agl__gfx_mesh_cache_dependency_t *dependencies = (const agl__gfx_mesh_cache_dependency_t*)(entries + header->meshCount);
+    // Stale if any file the meshes were decoded from changed, the source itself is always the first dependency
+    agl_bool current = header->dependencyCount > 0;
+    for (agl_uint i = 0; i < header->dependencyCount && current; i++) {
+        const agl__gfx_mesh_cache_dependency_t *dependency = &dependencies[i];
+        current = dependency->pathOffset < map.size &&
+            memchr(base + dependency->pathOffset, '\0', (size_t)(map.size - dependency->pathOffset)) != NULL &&
+            agl__MeshCacheStampCurrent(base + dependency->pathOffset, &dependency->stamp);
+    }
+    if (!current) {
+        agl_gfx_unmap_file(&map);
+        return AGL_GFX_ERROR;
+    }
+    // Validate everything up front so a truncated cache never reports a partial set of meshes
+    for (agl_uint i = 0; i < header->meshCount; i++) {
+        const agl__gfx_mesh_cache_entry_t *entry = &entries[i];
+        const agl__gfx_mesh_buffer_info_t *info = (const agl__gfx_mesh_buffer_info_t*)(base + entry->vertexOffset);
+        agl_bool valid = entry->vertexSize >= sizeof(*info) &&
+            entry->vertexOffset + entry->vertexSize <= map.size &&
+            entry->indexOffset + sizeof(agl_uint) * (agl_uint64)entry->indexCount <= map.size &&
+            entry->nameOffset < map.size && memchr(base + entry->nameOffset, '\0', (size_t)(map.size - entry->nameOffset)) != NULL;
+        valid = valid && agl__MeshCacheStream(entry, info, info->PositionStart, 3) != NULL;
+        if (!valid) {
+            printf("Ignoring malformed mesh cache: %s\n", cachePath);
+            agl_gfx_unmap_file(&map);
+            return AGL_GFX_ERROR;
+        }
+    }
+    for (agl_uint i = 0; i < header->meshCount && params->meshCallback; i++) {
+        const agl__gfx_mesh_cache_entry_t *entry = &entries[i];
+        const agl__gfx_mesh_buffer_info_t *info = (const agl__gfx_mesh_buffer_info_t*)(base + entry->vertexOffset);
+        agl_gfx_mesh_params_t meshParams;
+        meshParams.vertexCount = entry->vertexCount;
+        meshParams.indexCount = entry->indexCount;
+        meshParams.positionData = agl__MeshCacheStream(entry, info, info->PositionStart, 3);
+        meshParams.uvData = agl__MeshCacheStream(entry, info, info->UVStart, 2);
+        meshParams.normalData = agl__MeshCacheStream(entry, info, info->NormalStart, 3);
+        meshParams.colorData = agl__MeshCacheStream(entry, info, info->ColorStart, 4);
+        meshParams.jointData = agl__MeshCacheStream(entry, info, info->JointStart, 4);
+        meshParams.weightData = agl__MeshCacheStream(entry, info, info->WeightStart, 4);
+        meshParams.indexData = entry->indexCount ? (agl_uint*)(base + entry->indexOffset) : NULL;
+        meshParams.flags = agl__MeshFlagsFromLoadFlags(params->flags);
+        params->meshCallback(context, &meshParams, base + entry->nameOffset);
+    }
+    agl_gfx_unmap_file(&map);
+    return AGL_GFX_SUCCESS;
+}
+
+// Runs a loader with the post-processing requested in `params->flags`: optimisation, then the mesh cache.
+// An up-to-date cache skips both the loader and the optimiser, so their cost is only paid once per source change.
+static int agl__LoadFileProcessed(agl_gfx_context_t context, agl__gfx_loader_t *loader, const char *path, agl_gfx_load_params_t *params) {
+    char cachePath[1024];
+    agl__gfx_mesh_cache_header_t key;
+    agl_bool useCache = (params->flags & AGL_GFX_LOAD_FLAG_CACHE_BIT) != 0 && !params->nodeCallback && !params->skinCallback &&
+        !params->animationCallback;
+    if (useCache) {
+        memset(&key, 0, sizeof(key));
+        key.magic = AGL__MESH_CACHE_MAGIC;
+        key.version = AGL__MESH_CACHE_VERSION;
+        key.bufferInfoSize = sizeof(agl__gfx_mesh_buffer_info_t);
+        key.loadFlags = params->flags;
+        key.pathHash = agl__HashString(path);
+        useCache = snprintf(cachePath, sizeof(cachePath), "%s" AGL_GFX_MESH_CACHE_EXT, path) < (int)sizeof(cachePath);
+        if (useCache && agl__ReadMeshCache(context, cachePath, &key, params) == AGL_GFX_SUCCESS)
+            return 1;
+    }
+    // Cache miss, run the loader through the pipeline and record what comes out of it
+    agl__gfx_mesh_cache_writer_t writer;
+    memset(&writer, 0, sizeof(writer));
+    if (useCache)
+        agl__MeshCacheAddDependency(&writer, path);
+    agl_gfx_load_params_t pipelineParams = *params;
+    pipelineParams.meshCallback = (params->flags & (AGL_GFX_LOAD_FLAG_OPTIMIZE_BIT | AGL_GFX_LOAD_FLAG_OPTIMIZE_OVERDRAW_BIT)) ?
+        agl__OptimizeMeshCallback : agl__LoadedMeshCallback;
+    const agl_gfx_load_params_t *prevParams = context->loadParams;
+    agl__gfx_mesh_cache_writer_t *prevWriter = context->cacheWriter;
+    context->loadParams = params;
+    context->cacheWriter = useCache ? &writer : NULL;
+    int result = loader->load(context, path, &pipelineParams);
+    context->loadParams = prevParams;
+    context->cacheWriter = prevWriter;
+    if (useCache && result == 1 && !writer.failed)
+        agl__WriteMeshCache(&writer, cachePath, &key);
+    free(writer.entries);
+    free(writer.dependencies);
+    free(writer.payload);
+    return result;
+}
+
+int agl_gfx_load_file(agl_gfx_context_t context, const char *path, agl_gfx_load_params_t *params) {
+	const char *ext = strrchr(path, '.');
+	if (!ext) {
+		printf("File has no extension: %s\n", path);
+		return 0;
+	}
+	agl__gfx_loader_t *loader = agl__FindLoader(context, ext);
+	if (!loader) {
+		printf("No loader found for file: %s\n", path);
+		return 0;
+	}
+	if (params->flags)
+		return agl__LoadFileProcessed(context, loader, path, params);
+	return loader->load(context, path, params);
+}
+
+int agl_gfx_map_file(const char *path, agl_gfx_file_map_t *map) {
+    map->data = NULL;
+    map->size = 0;
+    map->handle = NULL;
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return AGL_GFX_ERROR;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return AGL_GFX_ERROR;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file); // the mapping keeps the file open
+    if (mapping == NULL)
+        return AGL_GFX_ERROR;
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) {
+        CloseHandle(mapping);
+        return AGL_GFX_ERROR;
+    }
+    map->data = data;
+    map->size = (agl_uint64)size.QuadPart;
+    map->handle = mapping;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return AGL_GFX_ERROR;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return AGL_GFX_ERROR;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (data == MAP_FAILED)
+        return AGL_GFX_ERROR;
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+    map->data = data;
+    map->size = (agl_uint64)st.st_size;
+#endif
+    return AGL_GFX_SUCCESS;
+}
+
+void agl_gfx_unmap_file(agl_gfx_file_map_t *map) {
+    if (map->data == NULL)
+        return;
+#if defined(_WIN32)
+    UnmapViewOfFile(map->data);
+    CloseHandle((HANDLE)map->handle);
+#else
+    munmap((void*)map->data, (size_t)map->size);
+#endif
+    map->data = NULL;
+    map->size = 0;
+    map->handle = NULL;
 }
 
 #define AGL_FONT_GLYPH_BITMAP_TYPE uint32_t
@@ -6,8 +6,9 @@
 // USAGE
 //   Scalar types are named <basetype>f_t, e.g. vec3f_t, quatf_t.
 //   Vector types are named <basetype>v_t, e.g. vec3v_t, quatv_t.
-//   Scalar operations are inline so do not require a separate implementation file. Vector operations require an implementation file.
-//   To use the vector operations, #define AGL_MATH_IMPLEMENTATION before including this file in *one* C or C++ file to create the implementation.
+//   Scalar operations are inline. Vector operations, the per-thread RNG behind vec3f_urand/vec3f_srand and the copies of
+//   the inline functions for calls the compiler does not inline all live in an implementation file, so every program
+//   needs one: #define AGL_MATH_IMPLEMENTATION before including this file in *one* C or C++ file to create it.
 //
 //
 // MIT License
@@ -58,6 +59,8 @@
 #include <math.h>
 #include <float.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #define alignas(n) __attribute__((aligned(n)))
 
@@ -80,6 +83,30 @@
 #define VEC4_FMT FLOAT_FMT ", " FLOAT_FMT ", " FLOAT_FMT ", " FLOAT_FMT
 #define VEC4_ARG(v) (v)._m[0], (v)._m[1], (v)._m[2], (v)._m[3]
 
+// CPU dispatch
+// Nothing in agl needs more than SSE2 at compile time. The batched kernels are also compiled for wider instruction sets
+// with the AGL_TARGET_* attributes, and the best variant the CPU supports is picked through function pointers on first use.
+// Code using the vec3x8_t / quatx8_t types or its own AGL_TARGET_AVX2 functions must check agl_cpu_features() first.
+
+typedef enum agl_cpu_feature_bits {
+    AGL_CPU_FEATURE_AVX2_BIT = 0x0001,   // AVX2, FMA and F16C, with YMM state saved by the OS
+    AGL_CPU_FEATURE_AVX512_BIT = 0x0002, // AVX-512 F, BW, DQ and VL, with ZMM state saved by the OS
+} agl_cpu_feature_bits;
+
+#if defined(__GNUC__) || defined(__clang__)
+#	define AGL_TARGET_AVX2 __attribute__((target("avx,avx2,fma,f16c")))
+#	define AGL_TARGET_AVX512 __attribute__((target("avx,avx2,fma,f16c,avx512f,avx512bw,avx512dq,avx512vl")))
+#else
+#	define AGL_TARGET_AVX2
+#	define AGL_TARGET_AVX512
+#endif
+
+// Features the kernels are currently using, a combination of agl_cpu_feature_bits
+AGL_API uint32_t agl_cpu_features(void);
+// Restricts the kernels to the detected features that are also in `mask`, e.g. 0 for the SSE2 paths. For tests and
+// benchmarks, it must not race with running kernels. Returns the features now in use.
+AGL_API uint32_t agl_cpu_set_features(uint32_t mask);
+
 AGL_INLINE bool float_eq(float a, float b, float eps) {
     float diff = fabsf(a - b);
     if (diff < eps)
@@ -95,20 +122,56 @@ AGL_INLINE void swapf(float *a, float *b) {
 }
 
 AGL_INLINE float clampf(float f, float fmin, float fmax) {
-    float r = min(f, fmax);
-    r = max(r, fmin);
+    float r = (f < fmax) ? f : fmax;
+    r = (r > fmin) ? r : fmin;
+    return r;
+}
+
+// Random numbers
+// xoshiro128 generators with 8 interleaved streams, so the batch fills (agl_rng_fill_*) step 4 or 8 of them per register.
+// Single draws use stream 0. A seed gives the same sequence on every platform and path, the AVX2 fills only differ by
+// the FMA rounding of their transcendentals.
+typedef struct agl_rng_t {
+    uint32_t s[4][8]; // state word j of stream k in s[j][k]
+} agl_rng_t;
+
+AGL_API void agl_rng_seed(agl_rng_t *rng, uint64_t seed);
+// The calling thread's generator, used by vec3f_urand and vec3f_srand. Threads are seeded from a fixed seed and the
+// order in which they first call it, reseed it for sequences that do not depend on thread scheduling.
+AGL_API agl_rng_t *agl_rng_thread(void);
+
+// xoshiro128** step of stream 0, all 32 bits are usable
+AGL_INLINE uint32_t agl_rng_u32(agl_rng_t *rng) {
+    uint32_t *s0 = &rng->s[0][0], *s1 = &rng->s[1][0], *s2 = &rng->s[2][0], *s3 = &rng->s[3][0];
+    uint32_t r = *s1 * 5;
+    r = ((r << 7) | (r >> 25)) * 9;
+    uint32_t t = *s1 << 9;
+    *s2 ^= *s0;
+    *s3 ^= *s1;
+    *s1 ^= *s2;
+    *s0 ^= *s3;
+    *s2 ^= t;
+    *s3 = (*s3 << 11) | (*s3 >> 21);
     return r;
 }
 
+// Uniform in [0, 1), from the top 24 bits
+AGL_INLINE float agl_rng_float(agl_rng_t *rng) {
+    return (float)(agl_rng_u32(rng) >> 8) * (1.f / 16777216.f);
+}
+
 typedef struct vec3f_t vec3f_t;
 typedef struct vec4f_t vec4f_t;
 typedef struct quatf_t quatf_t;
 typedef struct mat3f_t mat3f_t;
+typedef struct mat4f_t mat4f_t;
 
 struct vec3f_t { float _m[4]; };
 struct vec4f_t { float _m[4]; };
 struct quatf_t { float _m[4]; };
 struct mat3f_t { float _m[4][3]; };
+// Column-major like mat3f_t, _m[column][row], the layout glUniformMatrix4fv takes without transposing
+struct mat4f_t { float _m[4][4]; };
 
 #define vec3f(x,y,z)    ((vec3f_t){(x),(y),(z),(0)})
 #define vec4f(x,y,z,w)  ((vec4f_t){(x),(y),(z),(w)})
@@ -209,22 +272,19 @@ AGL_INLINE void vec3f_recip(vec3f_t *vr, const vec3f_t *v) {
     vr->_m[2] = 1.f / v->_m[2];
 }
 
+// Components in [0, 1) from agl_rng_thread()
 AGL_INLINE vec3f_t vec3f_urand() {
-    const float RAND_MAX_F = (float)RAND_MAX;
-    return (vec3f_t) {
-        ((float)rand()) / RAND_MAX_F,
-        ((float)rand()) / RAND_MAX_F,
-        ((float)rand()) / RAND_MAX_F,
-    };
+    agl_rng_t *rng = agl_rng_thread();
+    float x = agl_rng_float(rng);
+    float y = agl_rng_float(rng);
+    float z = agl_rng_float(rng);
+    return vec3f(x, y, z);
 }
 
+// Components in [-1, 1) from agl_rng_thread()
 AGL_INLINE vec3f_t vec3f_srand() {
-    const float RAND_MAX_F = (float)RAND_MAX;
-    return (vec3f_t) {
-        ((float)rand()) / RAND_MAX_F * 2.f - 1.f,
-        ((float)rand()) / RAND_MAX_F * 2.f - 1.f,
-        ((float)rand()) / RAND_MAX_F * 2.f - 1.f,
-    };
+    vec3f_t v = vec3f_urand();
+    return vec3f(v._m[0] * 2.f - 1.f, v._m[1] * 2.f - 1.f, v._m[2] * 2.f - 1.f);
 }
 
 AGL_INLINE void quatf_inv(quatf_t *q) {
@@ -325,10 +385,12 @@ AGL_INLINE void quatf_fromvectors(quatf_t *q, const vec3f_t *a, const vec3f_t *b
         return;
     }
     if (float_eq(costheta, -1.f, 1e-6)) {
+        const vec3f_t unitx = vec3f(1,0,0);
+        const vec3f_t unitz = vec3f(0,0,1);
         if (float_eq(u._m[2], 1.f, FLT_EPSILON)) // u is parallel to (0,0,1)
-            vec3f_cross(&axis, &u, &vec3f(1,0,0));
+            vec3f_cross(&axis, &u, &unitx);
         else
-            vec3f_cross(&axis, &u, &vec3f(0,0,1));
+            vec3f_cross(&axis, &u, &unitz);
     }
     float theta = acosf(costheta);
     vec3f_normalize(&axis);
@@ -400,48 +462,1081 @@ AGL_INLINE void vec3f_mulmat3f(vec3f_t *v, const vec3f_t *a, const mat3f_t *m) {
     v->_m[2] = a->_m[0] * m->_m[2][0] + a->_m[1] * m->_m[2][1] + a->_m[2] * m->_m[2][2];
 }
 
+// Rotation matrix to unit quaternion, branching on the largest diagonal term for precision (Shepperd)
+AGL_INLINE void quatf_frommat3f(quatf_t *q, const mat3f_t *m) {
+    float m00 = m->_m[0][0], m11 = m->_m[1][1], m22 = m->_m[2][2];
+    float trace = m00 + m11 + m22;
+    if (trace > 0.f) {
+        float s = 0.5f / sqrtf(trace + 1.f);
+        *q = quatf((m->_m[1][2] - m->_m[2][1]) * s, (m->_m[2][0] - m->_m[0][2]) * s, (m->_m[0][1] - m->_m[1][0]) * s, 0.25f / s);
+    } else if (m00 > m11 && m00 > m22) {
+        float s = 2.f * sqrtf(1.f + m00 - m11 - m22);
+        *q = quatf(0.25f * s, (m->_m[1][0] + m->_m[0][1]) / s, (m->_m[2][0] + m->_m[0][2]) / s, (m->_m[1][2] - m->_m[2][1]) / s);
+    } else if (m11 > m22) {
+        float s = 2.f * sqrtf(1.f + m11 - m00 - m22);
+        *q = quatf((m->_m[1][0] + m->_m[0][1]) / s, 0.25f * s, (m->_m[2][1] + m->_m[1][2]) / s, (m->_m[2][0] - m->_m[0][2]) / s);
+    } else {
+        float s = 2.f * sqrtf(1.f + m22 - m00 - m11);
+        *q = quatf((m->_m[2][0] + m->_m[0][2]) / s, (m->_m[2][1] + m->_m[1][2]) / s, 0.25f * s, (m->_m[0][1] - m->_m[1][0]) / s);
+    }
+    quatf_normalize(q);
+}
+
+AGL_INLINE void mat4f_identity(mat4f_t *m) {
+    *m = (mat4f_t){0};
+    m->_m[0][0] = m->_m[1][1] = m->_m[2][2] = m->_m[3][3] = 1.f;
+}
+
+// translation * rotation * scale, the SIMD version is mat4v_from_trs
+AGL_INLINE void mat4f_fromtrs(mat4f_t *m, const vec3f_t *t, const quatf_t *r, const vec3f_t *s) {
+    mat3f_t rot;
+    mat3f_fromquat(&rot, r);
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 3; k++)
+            m->_m[c][k] = rot._m[c][k] * s->_m[c];
+        m->_m[c][3] = 0.f;
+    }
+    m->_m[3][0] = t->_m[0];
+    m->_m[3][1] = t->_m[1];
+    m->_m[3][2] = t->_m[2];
+    m->_m[3][3] = 1.f;
+}
+
+AGL_INLINE void mat4f_transpose(mat4f_t *m) {
+    for (int c = 0; c < 4; c++) for (int r = c + 1; r < 4; r++)
+        swapf(&m->_m[c][r], &m->_m[r][c]);
+}
+
+// m may alias a or b, the SIMD version is mat4v_mul
+AGL_INLINE void mat4f_mul(mat4f_t *m, const mat4f_t *a, const mat4f_t *b) {
+    mat4f_t r;
+    for (int c = 0; c < 4; c++) for (int k = 0; k < 4; k++) {
+        r._m[c][k] = a->_m[0][k] * b->_m[c][0] + a->_m[1][k] * b->_m[c][1] + a->_m[2][k] * b->_m[c][2] + a->_m[3][k] * b->_m[c][3];
+    }
+    *m = r;
+}
+
+// v(4,1) = m(4,4) * b(4,1)
+AGL_INLINE void mat4f_mulvec4f(vec4f_t *v, const mat4f_t *m, const vec4f_t *b) {
+    vec4f_t r;
+    for (int k = 0; k < 4; k++)
+        r._m[k] = m->_m[0][k] * b->_m[0] + m->_m[1][k] * b->_m[1] + m->_m[2][k] * b->_m[2] + m->_m[3][k] * b->_m[3];
+    *v = r;
+}
+
+// Symmetric OpenGL projection looking down -z, depth maps to [-1, 1] between nearZ and farZ
+AGL_INLINE void mat4f_perspective(mat4f_t *m, float fovY, float aspect, float nearZ, float farZ) {
+    float f = 1.f / tanf(fovY / 2);
+    *m = (mat4f_t){0};
+    m->_m[0][0] = f / aspect;
+    m->_m[1][1] = f;
+    m->_m[2][2] = -(farZ + nearZ) / (farZ - nearZ);
+    m->_m[2][3] = -1.f;
+    m->_m[3][2] = -2.f * farZ * nearZ / (farZ - nearZ);
+}
+
+// Double precision
+// Positions for large worlds, where floats step by 2 mm at 16 km from the origin. The simulation keeps vec3d_t and
+// rendering stays in float by subtracting a double origin near the camera first: vec3d_rebase, or agl_vec3d_rebase and
+// agl_mat4_rebase for whole buffers. The origin is the camera position itself, with the camera drawn at the float
+// origin, or one that only moves now and then (vec3d_recenter) so rebased static data stays valid between moves.
+
+typedef struct vec3d_t { double _m[4]; } vec3d_t;
+
+#define vec3d(x,y,z)    ((vec3d_t){(x),(y),(z),(0)})
+
+AGL_INLINE void vec3d_scale(vec3d_t *v, double s) {
+    v->_m[0] *= s;
+    v->_m[1] *= s;
+    v->_m[2] *= s;
+}
+
+AGL_INLINE void vec3d_add(vec3d_t *v, const vec3d_t *b) {
+    v->_m[0] += b->_m[0];
+    v->_m[1] += b->_m[1];
+    v->_m[2] += b->_m[2];
+}
+
+AGL_INLINE void vec3d_addscaled(vec3d_t *v, const vec3d_t *b, double s) {
+    v->_m[0] += s * b->_m[0];
+    v->_m[1] += s * b->_m[1];
+    v->_m[2] += s * b->_m[2];
+}
+
+AGL_INLINE void vec3d_sub(vec3d_t *v, const vec3d_t *b) {
+    v->_m[0] -= b->_m[0];
+    v->_m[1] -= b->_m[1];
+    v->_m[2] -= b->_m[2];
+}
+
+AGL_INLINE double vec3d_dot(const vec3d_t *a, const vec3d_t *b) {
+    return a->_m[0] * b->_m[0]
+         + a->_m[1] * b->_m[1]
+         + a->_m[2] * b->_m[2];
+}
+
+AGL_INLINE double vec3d_sqrlen(const vec3d_t *v) {
+    return vec3d_dot(v, v);
+}
+
+AGL_INLINE double vec3d_len(const vec3d_t *v) {
+    return sqrt(vec3d_sqrlen(v));
+}
+
+AGL_INLINE vec3d_t vec3d_fromvec3f(const vec3f_t *v) {
+    return vec3d(v->_m[0], v->_m[1], v->_m[2]);
+}
+
+// p - origin rounded once to float, exact to float precision however far both are from the world origin
+AGL_INLINE vec3f_t vec3d_rebase(const vec3d_t *p, const vec3d_t *origin) {
+    return vec3f((float)(p->_m[0] - origin->_m[0]), (float)(p->_m[1] - origin->_m[1]), (float)(p->_m[2] - origin->_m[2]));
+}
+
+// Floating origin: moves `origin` onto `camera` once the camera is more than `radius` away and returns true, so data
+// rebased against the old origin can be rebuilt. In between the camera stays within `radius` of the float origin.
+AGL_INLINE bool vec3d_recenter(vec3d_t *origin, const vec3d_t *camera, double radius) {
+    vec3d_t d = *camera;
+    vec3d_sub(&d, origin);
+    if (vec3d_sqrlen(&d) <= radius * radius)
+        return false;
+    *origin = vec3d(camera->_m[0], camera->_m[1], camera->_m[2]);
+    return true;
+}
+
+// Geometry
+// Single item tests for picking, culling and physics broadphase, with 8-wide versions in the AVX2 section (aabbx8_t and
+// friends) and batched kernels over arrays (agl_ray_aabbs and friends). Planes are vec4f_t (nx, ny, nz, d) with unit
+// normals, n . p + d >= 0 in front. Rays cover origin + t * dir for t in [0, tmax], `dir` need not be unit length and
+// hit distances are in units of it. Touching counts as overlapping.
+
+typedef struct aabbf_t { vec3f_t min, max; } aabbf_t;
+typedef struct spheref_t { float _m[4]; } spheref_t; // centre in xyz, radius in w
+typedef struct rayf_t { vec3f_t origin, dir; } rayf_t;
+
+#define spheref(x,y,z,r)    ((spheref_t){(x),(y),(z),(r)})
+
+AGL_INLINE float planef_distance(const vec4f_t *plane, const vec3f_t *p) {
+    return plane->_m[0] * p->_m[0] + plane->_m[1] * p->_m[1] + plane->_m[2] * p->_m[2] + plane->_m[3];
+}
+
+// The 6 frustum planes of a view-projection matrix, taken from its rows (Gribb & Hartmann) and facing into the frustum:
+// left, right, bottom, top, near, far
+AGL_INLINE void mat4f_frustum_planes(vec4f_t planes[6], const mat4f_t *viewProj) {
+    for (int i = 0; i < 6; i++) {
+        int row = i / 2;
+        float sign = (i & 1) ? -1.f : 1.f;
+        for (int c = 0; c < 4; c++)
+            planes[i]._m[c] = viewProj->_m[c][3] + sign * viewProj->_m[c][row];
+        float length = sqrtf(planes[i]._m[0] * planes[i]._m[0] + planes[i]._m[1] * planes[i]._m[1] + planes[i]._m[2] * planes[i]._m[2]);
+        for (int c = 0; c < 4; c++)
+            planes[i]._m[c] /= length;
+    }
+}
+
+AGL_INLINE bool aabbf_overlaps(const aabbf_t *a, const aabbf_t *b) {
+    return a->min._m[0] <= b->max._m[0] && a->max._m[0] >= b->min._m[0]
+        && a->min._m[1] <= b->max._m[1] && a->max._m[1] >= b->min._m[1]
+        && a->min._m[2] <= b->max._m[2] && a->max._m[2] >= b->min._m[2];
+}
+
+AGL_INLINE bool aabbf_contains(const aabbf_t *a, const vec3f_t *p) {
+    return p->_m[0] >= a->min._m[0] && p->_m[0] <= a->max._m[0]
+        && p->_m[1] >= a->min._m[1] && p->_m[1] <= a->max._m[1]
+        && p->_m[2] >= a->min._m[2] && p->_m[2] <= a->max._m[2];
+}
+
+AGL_INLINE bool spheref_overlaps(const spheref_t *a, const spheref_t *b) {
+    float dx = a->_m[0] - b->_m[0], dy = a->_m[1] - b->_m[1], dz = a->_m[2] - b->_m[2];
+    float r = a->_m[3] + b->_m[3];
+    return dx * dx + dy * dy + dz * dz <= r * r;
+}
+
+// Compares the squared distance from the centre to the closest point of the box
+AGL_INLINE bool aabbf_overlaps_sphere(const aabbf_t *a, const spheref_t *s) {
+    float d2 = 0.f;
+    for (int k = 0; k < 3; k++) {
+        float c = s->_m[k];
+        float e = c < a->min._m[k] ? a->min._m[k] - c : (c > a->max._m[k] ? c - a->max._m[k] : 0.f);
+        d2 += e * e;
+    }
+    return d2 <= s->_m[3] * s->_m[3];
+}
+
+// False when the box lies entirely behind one of the planes, tested with the corner furthest along each normal
+AGL_INLINE bool aabbf_in_planes(const aabbf_t *a, const vec4f_t *planes, int planeCount) {
+    for (int p = 0; p < planeCount; p++) {
+        const float *n = planes[p]._m;
+        float x = n[0] >= 0.f ? a->max._m[0] : a->min._m[0];
+        float y = n[1] >= 0.f ? a->max._m[1] : a->min._m[1];
+        float z = n[2] >= 0.f ? a->max._m[2] : a->min._m[2];
+        if (n[0] * x + n[1] * y + n[2] * z + n[3] < 0.f)
+            return false;
+    }
+    return true;
+}
+
+// False when the sphere lies entirely behind one of the planes
+AGL_INLINE bool spheref_in_planes(const spheref_t *s, const vec4f_t *planes, int planeCount) {
+    for (int p = 0; p < planeCount; p++) {
+        const float *n = planes[p]._m;
+        if (n[0] * s->_m[0] + n[1] * s->_m[1] + n[2] * s->_m[2] + n[3] < -s->_m[3])
+            return false;
+    }
+    return true;
+}
+
+// Slab test, *t is the entry distance or 0 when the origin is inside the box. Axes the ray doesn't move along divide by
+// zero into infinite slabs, or NaN ones when the origin lies on a face, which the comparison order below skips so a
+// ray running along a face touches the box.
+AGL_INLINE bool rayf_intersect_aabb(const rayf_t *r, const aabbf_t *a, float tmax, float *t) {
+    float tnear = 0.f, tfar = tmax;
+    for (int k = 0; k < 3; k++) {
+        float inv = 1.f / r->dir._m[k];
+        float t0 = (a->min._m[k] - r->origin._m[k]) * inv, t1 = (a->max._m[k] - r->origin._m[k]) * inv;
+        float lo = t1 < t0 ? t1 : t0, hi = t0 > t1 ? t0 : t1;
+        tnear = lo > tnear ? lo : tnear;
+        tfar = hi < tfar ? hi : tfar;
+    }
+    if (!(tnear <= tfar))
+        return false;
+    *t = tnear;
+    return true;
+}
+
+// *t is the entry distance or 0 when the origin is inside the sphere
+AGL_INLINE bool rayf_intersect_sphere(const rayf_t *r, const spheref_t *s, float tmax, float *t) {
+    float ox = r->origin._m[0] - s->_m[0], oy = r->origin._m[1] - s->_m[1], oz = r->origin._m[2] - s->_m[2];
+    float a = vec3f_dot(&r->dir, &r->dir);
+    float b = ox * r->dir._m[0] + oy * r->dir._m[1] + oz * r->dir._m[2];
+    float c = ox * ox + oy * oy + oz * oz - s->_m[3] * s->_m[3];
+    if (c <= 0.f) {
+        *t = 0.f;
+        return true;
+    }
+    float disc = b * b - a * c;
+    if (!(disc >= 0.f && b <= 0.f)) // misses, or starts outside moving away
+        return false;
+    float hit = (-b - sqrtf(disc)) / a;
+    if (!(hit <= tmax))
+        return false;
+    *t = hit;
+    return true;
+}
+
+// Moller-Trumbore, hits both faces. *u and *v are the barycentric weights of b and c at the hit, either may be NULL.
+// A ray parallel to the triangle divides by zero and fails the tests through the infinite or NaN coordinates.
+AGL_INLINE bool rayf_intersect_triangle(const rayf_t *r, const vec3f_t *a, const vec3f_t *b, const vec3f_t *c, float tmax,
+    float *t, float *u, float *v) {
+    vec3f_t e1, e2, p, s, q;
+    vec3f_sub2(&e1, b, a);
+    vec3f_sub2(&e2, c, a);
+    vec3f_cross(&p, &r->dir, &e2);
+    float inv = 1.f / vec3f_dot(&e1, &p);
+    vec3f_sub2(&s, &r->origin, a);
+    float bu = vec3f_dot(&s, &p) * inv;
+    vec3f_cross(&q, &s, &e1);
+    float bv = vec3f_dot(&r->dir, &q) * inv;
+    float hit = vec3f_dot(&e2, &q) * inv;
+    if (!(bu >= 0.f && bv >= 0.f && bu + bv <= 1.f && hit >= 0.f && hit <= tmax))
+        return false;
+    *t = hit;
+    if (u)
+        *u = bu;
+    if (v)
+        *v = bv;
+    return true;
+}
+
 typedef struct vec3v_t vec3v_t;
 typedef struct vec4v_t vec4v_t;
 typedef struct quatv_t quatv_t;
+typedef struct mat4v_t mat4v_t;
 
 struct vec3v_t { __m128 _m; };
 struct vec4v_t { __m128 _m; };
 struct quatv_t { __m128 _m; };
+// One column per register
+struct mat4v_t { __m128 _m[4]; };
 
 AGL_API vec3v_t vec3v_load_aligned(const vec3f_t *f);
 AGL_API vec3v_t vec3v_load_unaligned(const float *f);
 AGL_API void vec3v_store_aligned(const vec3v_t *v, vec3f_t *f);
 AGL_API void vec3v_store_unaligned(const vec3v_t *v, float *f);
-vec4v_t vec4v_load_aligned(const vec4f_t *f);
-vec4v_t vec4v_load_unaligned(const float *f);
+AGL_API vec4v_t vec4v_load_aligned(const vec4f_t *f);
+AGL_API vec4v_t vec4v_load_unaligned(const float *f);
 AGL_API void vec4v_store_aligned(const vec4v_t *v, vec4f_t *f);
 AGL_API void vec4v_store_unaligned(const vec4v_t *v, float *f);
-quatv_t quatv_load_aligned(const quatf_t *f);
-quatv_t quatv_load_unaligned(const float *f);
-void quatv_store_aligned(const quatv_t *v, quatf_t *f);
-void quatv_store_unaligned(const quatv_t *v, float *f);
-
-#define vec3v_load(f) (vec3v_load_unaligned(f));
-#define vec3v_store(v, f) (vec3v_store_unaligned((v), (f)));
-#define vec4v_load(f) (vec4v_load_unaligned(f));
-#define vec4v_store(v, f) (vec4v_store_unaligned((v), (f)));
-#define quatv_load(f) (quatv_load_unaligned(f));
-#define quatv_store(v, f) (quatv_store_unaligned((v), (f)));
-
-vec3v_t vec3v_add(const vec3v_t *a, const vec3v_t *b);
-vec4v_t vec4v_add(const vec4v_t *a, const vec4v_t *b);
-vec3v_t vec3v_sub(const vec3v_t *a, const vec3v_t *b);
-vec4v_t vec4v_sub(const vec4v_t *a, const vec4v_t *b);
-float vec3v_dot(const vec3v_t *a, const vec3v_t *b);
-void vec3v_dot3(const vec3v_t *a, const vec3v_t *b, vec3v_t *r);
-void vec4v_dot(const vec4v_t *a, const vec4v_t *b, vec4v_t *r);
-void vec4v_dot4(const vec4v_t *a, const vec4v_t *b, vec4v_t *r);
-void vec3v_cross(const vec3v_t *a, const vec3v_t *b, vec3v_t *r);
-void vec4v_cross(const vec4v_t *a, const vec4v_t *b, vec4v_t *r);
-
-void quatv_conjugate(const quatv_t *q, quatv_t *qc);
-quatv_t quatv_from_axis_angle(const vec4v_t *axisangle);
-vec4v_t quatv_to_axis_angle(const quatv_t *q);
+AGL_API quatv_t quatv_load_aligned(const quatf_t *f);
+AGL_API quatv_t quatv_load_unaligned(const float *f);
+AGL_API void quatv_store_aligned(const quatv_t *v, quatf_t *f);
+AGL_API void quatv_store_unaligned(const quatv_t *v, float *f);
+
+#define vec3v_load(f) (vec3v_load_unaligned(f))
+#define vec3v_store(v, f) (vec3v_store_unaligned((v), (f)))
+#define vec4v_load(f) (vec4v_load_unaligned(f))
+#define vec4v_store(v, f) (vec4v_store_unaligned((v), (f)))
+#define quatv_load(f) (quatv_load_unaligned(f))
+#define quatv_store(v, f) (quatv_store_unaligned((v), (f)))
+
+// All operations stay in registers. The w lane of a vec3v_t is ignored on input and 0 on output unless noted.
+AGL_API vec3v_t vec3v_add(const vec3v_t *a, const vec3v_t *b);
+AGL_API vec4v_t vec4v_add(const vec4v_t *a, const vec4v_t *b);
+AGL_API vec3v_t vec3v_sub(const vec3v_t *a, const vec3v_t *b);
+AGL_API vec4v_t vec4v_sub(const vec4v_t *a, const vec4v_t *b);
+AGL_API vec3v_t vec3v_mul(const vec3v_t *a, const vec3v_t *b);
+AGL_API vec4v_t vec4v_mul(const vec4v_t *a, const vec4v_t *b);
+AGL_API vec3v_t vec3v_scale(const vec3v_t *a, float s);
+AGL_API vec4v_t vec4v_scale(const vec4v_t *a, float s);
+AGL_API float vec3v_dot(const vec3v_t *a, const vec3v_t *b);
+// xyz dot product in x, y and z, w is 0
+AGL_API void vec3v_dot3(const vec3v_t *a, const vec3v_t *b, vec3v_t *r);
+// xyzw dot product in x, the other lanes are 0
+AGL_API void vec4v_dot(const vec4v_t *a, const vec4v_t *b, vec4v_t *r);
+// xyzw dot product in all four lanes
+AGL_API void vec4v_dot4(const vec4v_t *a, const vec4v_t *b, vec4v_t *r);
+AGL_API void vec3v_cross(const vec3v_t *a, const vec3v_t *b, vec3v_t *r);
+// Cross product of the xyz parts, w is 0
+AGL_API void vec4v_cross(const vec4v_t *a, const vec4v_t *b, vec4v_t *r);
+// Reciprocal square root estimate refined by one Newton-Raphson step, about 22 bits of precision
+AGL_API vec3v_t vec3v_normalize(const vec3v_t *a);
+AGL_API vec4v_t vec4v_normalize(const vec4v_t *a);
+// m * v, like mat3f_mulvec3f
+AGL_API vec3v_t mat3f_mulvec3v(const mat3f_t *m, const vec3v_t *v);
+
+AGL_API void quatv_conjugate(const quatv_t *q, quatv_t *qc);
+// a * b, like quatf_mul2
+AGL_API quatv_t quatv_mul(const quatv_t *a, const quatv_t *b);
+AGL_API quatv_t quatv_normalize(const quatv_t *q);
+// Rotates v by the unit quaternion q, like quatf_apply
+AGL_API vec3v_t quatv_apply(const quatv_t *q, const vec3v_t *v);
+// Unit axis in xyz and angle in radians in w, like quatf_fromaxisangle
+AGL_API quatv_t quatv_from_axis_angle(const vec4v_t *axisangle);
+// The inverse of quatv_from_axis_angle for unit quaternions, the axis is (1, 0, 0) when the angle is 0
+AGL_API vec4v_t quatv_to_axis_angle(const quatv_t *q);
+AGL_API mat4v_t mat4v_load(const mat4f_t *f);
+AGL_API void mat4v_store(const mat4v_t *v, mat4f_t *f);
+AGL_API mat4v_t mat4v_transpose(const mat4v_t *m);
+// a * b, like mat4f_mul
+AGL_API mat4v_t mat4v_mul(const mat4v_t *a, const mat4v_t *b);
+AGL_API vec4v_t mat4v_mulvec4v(const mat4v_t *m, const vec4v_t *v);
+// Affine transforms of a point (w = 1) and of a direction (w = 0), the row below the 3x4 part is not used
+AGL_API vec3v_t mat4v_transform_point(const mat4v_t *m, const vec3v_t *p);
+AGL_API vec3v_t mat4v_transform_vector(const mat4v_t *m, const vec3v_t *v);
+// translation * rotation * scale, like mat4f_fromtrs
+AGL_API mat4v_t mat4v_from_trs(const vec3v_t *t, const quatv_t *r, const vec3v_t *s);
+// The inverse of mat4v_from_trs for matrices without shear. A negative determinant is folded into the x scale.
+AGL_API void mat4v_to_trs(const mat4v_t *m, vec3v_t *t, quatv_t *r, vec3v_t *s);
+// Inverse of an affine matrix from the adjugate of its 3x3 part, much cheaper than a general 4x4 inverse
+AGL_API mat4v_t mat4v_inverse_affine(const mat4v_t *m);
+// Inverse of a rotation and translation only, e.g. a camera transform to a view matrix: the 3x3 part is transposed
+AGL_API mat4v_t mat4v_inverse_rigid(const mat4v_t *m);
+
+// Batched SoA
+// vec3x8_t and quatx8_t hold 8 vectors or quaternions, one AVX register per component, so each operation works on
+// all 8 at full SIMD width. They require AGL_CPU_FEATURE_AVX2_BIT. Load and store transpose from and to arrays of vec3f_t / quatf_t or tightly packed xyz floats.
+
+typedef struct vec3x8_t { __m256 x, y, z; } vec3x8_t;
+typedef struct quatx8_t { __m256 x, y, z, w; } quatx8_t;
+
+// Transposes 8 elements of 4 floats, `stride` floats apart, lane k of the result holds element k
+AGL_INLINE AGL_TARGET_AVX2 void agl__transpose8x4_strided(__m256 out[4], const float *p, size_t stride) {
+    __m256 r0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 0 * stride)), _mm_loadu_ps(p + 4 * stride), 1);
+    __m256 r1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 1 * stride)), _mm_loadu_ps(p + 5 * stride), 1);
+    __m256 r2 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 2 * stride)), _mm_loadu_ps(p + 6 * stride), 1);
+    __m256 r3 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 3 * stride)), _mm_loadu_ps(p + 7 * stride), 1);
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+    out[0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0));
+    out[1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+    out[2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0));
+    out[3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+}
+
+// Transposes 8 consecutive 4 float elements
+AGL_INLINE AGL_TARGET_AVX2 void agl__transpose8x4(__m256 out[4], const float *p) {
+    agl__transpose8x4_strided(out, p, 4);
+}
+
+AGL_INLINE AGL_TARGET_AVX2 void agl__untranspose8x4(float *p, __m256 x, __m256 y, __m256 z, __m256 w) {
+    __m256 t0 = _mm256_unpacklo_ps(x, y), t1 = _mm256_unpackhi_ps(x, y);
+    __m256 t2 = _mm256_unpacklo_ps(z, w), t3 = _mm256_unpackhi_ps(z, w);
+    __m256 r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0)), r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+    __m256 r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0)), r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+    _mm_storeu_ps(p + 0, _mm256_castps256_ps128(r0)); _mm_storeu_ps(p + 16, _mm256_extractf128_ps(r0, 1));
+    _mm_storeu_ps(p + 4, _mm256_castps256_ps128(r1)); _mm_storeu_ps(p + 20, _mm256_extractf128_ps(r1, 1));
+    _mm_storeu_ps(p + 8, _mm256_castps256_ps128(r2)); _mm_storeu_ps(p + 24, _mm256_extractf128_ps(r2, 1));
+    _mm_storeu_ps(p + 12, _mm256_castps256_ps128(r3)); _mm_storeu_ps(p + 28, _mm256_extractf128_ps(r3, 1));
+}
+
+AGL_INLINE AGL_TARGET_AVX2 vec3x8_t vec3x8_load(const vec3f_t *v) {
+    __m256 m[4];
+    agl__transpose8x4(m, v->_m);
+    return (vec3x8_t){ m[0], m[1], m[2] };
+}
+
+// The padding component of each vec3f_t is written as 0
+AGL_INLINE AGL_TARGET_AVX2 void vec3x8_store(vec3f_t *v, const vec3x8_t *a) {
+    agl__untranspose8x4(v->_m, a->x, a->y, a->z, _mm256_setzero_ps());
+}
+
+// 8 tightly packed xyz points (24 floats), e.g. a vertex position stream
+AGL_INLINE AGL_TARGET_AVX2 vec3x8_t vec3x8_load_packed(const float *p) {
+    __m256 m03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 0)), _mm_loadu_ps(p + 12), 1); // x0 y0 z0 x1
+    __m256 m14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 16), 1); // y1 z1 x2 y2
+    __m256 m25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 20), 1); // z2 x3 y3 z3
+    __m256 xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2,1,3,2)); // x2 y2 x3 y3
+    __m256 yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1,0,2,1)); // y0 z0 y1 z1
+    return (vec3x8_t){
+        _mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2,0,3,0)),
+        _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3,1,2,0)),
+        _mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3,0,3,1)),
+    };
+}
+
+AGL_INLINE AGL_TARGET_AVX2 void vec3x8_store_packed(float *p, const vec3x8_t *a) {
+    __m256 xy = _mm256_shuffle_ps(a->x, a->y, _MM_SHUFFLE(2,0,2,0)); // x0 x2 y0 y2
+    __m256 yz = _mm256_shuffle_ps(a->y, a->z, _MM_SHUFFLE(3,1,3,1)); // y1 y3 z1 z3
+    __m256 zx = _mm256_shuffle_ps(a->z, a->x, _MM_SHUFFLE(3,1,2,0)); // z0 z2 x1 x3
+    __m256 m03 = _mm256_shuffle_ps(xy, zx, _MM_SHUFFLE(2,0,2,0));
+    __m256 m14 = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3,1,2,0));
+    __m256 m25 = _mm256_shuffle_ps(zx, yz, _MM_SHUFFLE(3,1,3,1));
+    _mm_storeu_ps(p + 0, _mm256_castps256_ps128(m03)); _mm_storeu_ps(p + 12, _mm256_extractf128_ps(m03, 1));
+    _mm_storeu_ps(p + 4, _mm256_castps256_ps128(m14)); _mm_storeu_ps(p + 16, _mm256_extractf128_ps(m14, 1));
+    _mm_storeu_ps(p + 8, _mm256_castps256_ps128(m25)); _mm_storeu_ps(p + 20, _mm256_extractf128_ps(m25, 1));
+}
+
+AGL_INLINE AGL_TARGET_AVX2 quatx8_t quatx8_load(const quatf_t *q) {
+    __m256 m[4];
+    agl__transpose8x4(m, q->_m);
+    return (quatx8_t){ m[0], m[1], m[2], m[3] };
+}
+
+AGL_INLINE AGL_TARGET_AVX2 void quatx8_store(quatf_t *q, const quatx8_t *a) {
+    agl__untranspose8x4(q->_m, a->x, a->y, a->z, a->w);
+}
+
+AGL_INLINE AGL_TARGET_AVX2 vec3x8_t vec3x8_add(const vec3x8_t *a, const vec3x8_t *b) {
+    return (vec3x8_t){ _mm256_add_ps(a->x, b->x), _mm256_add_ps(a->y, b->y), _mm256_add_ps(a->z, b->z) };
+}
+
+AGL_INLINE AGL_TARGET_AVX2 vec3x8_t vec3x8_sub(const vec3x8_t *a, const vec3x8_t *b) {
+    return (vec3x8_t){ _mm256_sub_ps(a->x, b->x), _mm256_sub_ps(a->y, b->y), _mm256_sub_ps(a->z, b->z) };
+}
+
+AGL_INLINE AGL_TARGET_AVX2 vec3x8_t vec3x8_scale(const vec3x8_t *a, __m256 s) {
+    return (vec3x8_t){ _mm256_mul_ps(a->x, s), _mm256_mul_ps(a->y, s), _mm256_mul_ps(a->z, s) };
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 vec3x8_dot(const vec3x8_t *a, const vec3x8_t *b) {
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a->x, b->x), _mm256_mul_ps(a->y, b->y)), _mm256_mul_ps(a->z, b->z));
+}
+
+AGL_INLINE AGL_TARGET_AVX2 vec3x8_t vec3x8_cross(const vec3x8_t *a, const vec3x8_t *b) {
+    return (vec3x8_t){
+        _mm256_sub_ps(_mm256_mul_ps(a->y, b->z), _mm256_mul_ps(a->z, b->y)),
+        _mm256_sub_ps(_mm256_mul_ps(a->z, b->x), _mm256_mul_ps(a->x, b->z)),
+        _mm256_sub_ps(_mm256_mul_ps(a->x, b->y), _mm256_mul_ps(a->y, b->x)),
+    };
+}
+
+// Divides by the exact length, like vec3f_normalize
+AGL_INLINE AGL_TARGET_AVX2 vec3x8_t vec3x8_normalize(const vec3x8_t *a) {
+    __m256 len = _mm256_sqrt_ps(vec3x8_dot(a, a));
+    return (vec3x8_t){ _mm256_div_ps(a->x, len), _mm256_div_ps(a->y, len), _mm256_div_ps(a->z, len) };
+}
+
+// Rotates by unit quaternions, the result of quatf_apply: v + w * t + q.xyz x t with t = 2 * q.xyz x v
+AGL_INLINE AGL_TARGET_AVX2 vec3x8_t quatx8_apply(const quatx8_t *q, const vec3x8_t *v) {
+    vec3x8_t u = { q->x, q->y, q->z };
+    vec3x8_t t = vec3x8_cross(&u, v);
+    t = vec3x8_add(&t, &t);
+    vec3x8_t c = vec3x8_cross(&u, &t);
+    return (vec3x8_t){
+        _mm256_add_ps(_mm256_add_ps(v->x, _mm256_mul_ps(q->w, t.x)), c.x),
+        _mm256_add_ps(_mm256_add_ps(v->y, _mm256_mul_ps(q->w, t.y)), c.y),
+        _mm256_add_ps(_mm256_add_ps(v->z, _mm256_mul_ps(q->w, t.z)), c.z),
+    };
+}
+
+// The same matrix applied to 8 vectors, the result of mat3f_mulvec3f
+AGL_INLINE AGL_TARGET_AVX2 vec3x8_t mat3f_mulvec3x8(const mat3f_t *m, const vec3x8_t *b) {
+    vec3x8_t r;
+    __m256 *out[3] = { &r.x, &r.y, &r.z };
+    for (int k = 0; k < 3; k++) {
+        *out[k] = _mm256_add_ps(_mm256_add_ps(
+            _mm256_mul_ps(_mm256_set1_ps(m->_m[0][k]), b->x), _mm256_mul_ps(_mm256_set1_ps(m->_m[1][k]), b->y)),
+            _mm256_mul_ps(_mm256_set1_ps(m->_m[2][k]), b->z));
+    }
+    return r;
+}
+
+// The same affine matrix applied to 8 points, like mat4v_transform_point
+AGL_INLINE AGL_TARGET_AVX2 vec3x8_t mat4f_mulpoint3x8(const mat4f_t *m, const vec3x8_t *b) {
+    vec3x8_t r;
+    __m256 *out[3] = { &r.x, &r.y, &r.z };
+    for (int k = 0; k < 3; k++) {
+        *out[k] = _mm256_fmadd_ps(_mm256_set1_ps(m->_m[0][k]), b->x, _mm256_fmadd_ps(_mm256_set1_ps(m->_m[1][k]), b->y,
+            _mm256_fmadd_ps(_mm256_set1_ps(m->_m[2][k]), b->z, _mm256_set1_ps(m->_m[3][k]))));
+    }
+    return r;
+}
+
+// vec3dx4_t holds 4 double vectors the same way, one AVX register of 4 doubles per component
+typedef struct vec3dx4_t { __m256d x, y, z; } vec3dx4_t;
+
+AGL_INLINE AGL_TARGET_AVX2 vec3dx4_t vec3dx4_load(const vec3d_t *v) {
+    __m256d r0 = _mm256_loadu_pd(v[0]._m), r1 = _mm256_loadu_pd(v[1]._m);
+    __m256d r2 = _mm256_loadu_pd(v[2]._m), r3 = _mm256_loadu_pd(v[3]._m);
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1); // x0 x1 z0 z1, y0 y1 w0 w1
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3);
+    return (vec3dx4_t){
+        _mm256_permute2f128_pd(t0, t2, 0x20),
+        _mm256_permute2f128_pd(t1, t3, 0x20),
+        _mm256_permute2f128_pd(t0, t2, 0x31),
+    };
+}
+
+// The padding component of each vec3d_t is written as 0
+AGL_INLINE AGL_TARGET_AVX2 void vec3dx4_store(vec3d_t *v, const vec3dx4_t *a) {
+    __m256d zero = _mm256_setzero_pd();
+    __m256d t0 = _mm256_permute2f128_pd(a->x, a->z, 0x20), t2 = _mm256_permute2f128_pd(a->x, a->z, 0x31);
+    __m256d t1 = _mm256_permute2f128_pd(a->y, zero, 0x20), t3 = _mm256_permute2f128_pd(a->y, zero, 0x31);
+    _mm256_storeu_pd(v[0]._m, _mm256_unpacklo_pd(t0, t1));
+    _mm256_storeu_pd(v[1]._m, _mm256_unpackhi_pd(t0, t1));
+    _mm256_storeu_pd(v[2]._m, _mm256_unpacklo_pd(t2, t3));
+    _mm256_storeu_pd(v[3]._m, _mm256_unpackhi_pd(t2, t3));
+}
+
+AGL_INLINE AGL_TARGET_AVX2 vec3dx4_t vec3dx4_add(const vec3dx4_t *a, const vec3dx4_t *b) {
+    return (vec3dx4_t){ _mm256_add_pd(a->x, b->x), _mm256_add_pd(a->y, b->y), _mm256_add_pd(a->z, b->z) };
+}
+
+AGL_INLINE AGL_TARGET_AVX2 vec3dx4_t vec3dx4_sub(const vec3dx4_t *a, const vec3dx4_t *b) {
+    return (vec3dx4_t){ _mm256_sub_pd(a->x, b->x), _mm256_sub_pd(a->y, b->y), _mm256_sub_pd(a->z, b->z) };
+}
+
+AGL_INLINE AGL_TARGET_AVX2 vec3dx4_t vec3dx4_scale(const vec3dx4_t *a, __m256d s) {
+    return (vec3dx4_t){ _mm256_mul_pd(a->x, s), _mm256_mul_pd(a->y, s), _mm256_mul_pd(a->z, s) };
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256d vec3dx4_dot(const vec3dx4_t *a, const vec3dx4_t *b) {
+    return _mm256_fmadd_pd(a->x, b->x, _mm256_fmadd_pd(a->y, b->y, _mm256_mul_pd(a->z, b->z)));
+}
+
+// a - origin rounded to float and stored as 4 vec3f_t, like vec3d_rebase
+AGL_INLINE AGL_TARGET_AVX2 void vec3dx4_rebase(vec3f_t *dst, const vec3dx4_t *a, const vec3d_t *origin) {
+    __m128 x = _mm256_cvtpd_ps(_mm256_sub_pd(a->x, _mm256_set1_pd(origin->_m[0])));
+    __m128 y = _mm256_cvtpd_ps(_mm256_sub_pd(a->y, _mm256_set1_pd(origin->_m[1])));
+    __m128 z = _mm256_cvtpd_ps(_mm256_sub_pd(a->z, _mm256_set1_pd(origin->_m[2])));
+    __m128 w = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(dst[0]._m, x);
+    _mm_storeu_ps(dst[1]._m, y);
+    _mm_storeu_ps(dst[2]._m, z);
+    _mm_storeu_ps(dst[3]._m, w);
+}
+
+// Geometry, 8 at a time
+// The tests of the Geometry section for 8 boxes, spheres or triangles against one query. They return a lane mask with
+// all bits set where the test passes and, for the ray tests, the hit distances of those lanes in *t. The arithmetic
+// follows the single item tests step by step.
+typedef struct aabbx8_t { vec3x8_t min, max; } aabbx8_t;
+typedef struct spherex8_t { __m256 x, y, z, r; } spherex8_t;
+typedef struct trianglex8_t { vec3x8_t a, b, c; } trianglex8_t;
+
+AGL_INLINE AGL_TARGET_AVX2 aabbx8_t aabbx8_load(const aabbf_t *a) {
+    __m256 lo[4], hi[4];
+    agl__transpose8x4_strided(lo, a->min._m, 8);
+    agl__transpose8x4_strided(hi, a->max._m, 8);
+    return (aabbx8_t){ { lo[0], lo[1], lo[2] }, { hi[0], hi[1], hi[2] } };
+}
+
+AGL_INLINE AGL_TARGET_AVX2 spherex8_t spherex8_load(const spheref_t *s) {
+    __m256 m[4];
+    agl__transpose8x4(m, s->_m);
+    return (spherex8_t){ m[0], m[1], m[2], m[3] };
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 aabbx8_overlaps(const aabbx8_t *a, const aabbf_t *b) {
+    __m256 x = _mm256_and_ps(_mm256_cmp_ps(a->min.x, _mm256_set1_ps(b->max._m[0]), _CMP_LE_OQ), _mm256_cmp_ps(a->max.x, _mm256_set1_ps(b->min._m[0]), _CMP_GE_OQ));
+    __m256 y = _mm256_and_ps(_mm256_cmp_ps(a->min.y, _mm256_set1_ps(b->max._m[1]), _CMP_LE_OQ), _mm256_cmp_ps(a->max.y, _mm256_set1_ps(b->min._m[1]), _CMP_GE_OQ));
+    __m256 z = _mm256_and_ps(_mm256_cmp_ps(a->min.z, _mm256_set1_ps(b->max._m[2]), _CMP_LE_OQ), _mm256_cmp_ps(a->max.z, _mm256_set1_ps(b->min._m[2]), _CMP_GE_OQ));
+    return _mm256_and_ps(_mm256_and_ps(x, y), z);
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 spherex8_overlaps(const spherex8_t *a, const spheref_t *b) {
+    __m256 dx = _mm256_sub_ps(a->x, _mm256_set1_ps(b->_m[0]));
+    __m256 dy = _mm256_sub_ps(a->y, _mm256_set1_ps(b->_m[1]));
+    __m256 dz = _mm256_sub_ps(a->z, _mm256_set1_ps(b->_m[2]));
+    __m256 r = _mm256_add_ps(a->r, _mm256_set1_ps(b->_m[3]));
+    __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    return _mm256_cmp_ps(d2, _mm256_mul_ps(r, r), _CMP_LE_OQ);
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 aabbx8_in_planes(const aabbx8_t *a, const vec4f_t *planes, int planeCount) {
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (int p = 0; p < planeCount; p++) {
+        const float *n = planes[p]._m;
+        __m256 x = n[0] >= 0.f ? a->max.x : a->min.x;
+        __m256 y = n[1] >= 0.f ? a->max.y : a->min.y;
+        __m256 z = n[2] >= 0.f ? a->max.z : a->min.z;
+        __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(n[0]), x),
+            _mm256_mul_ps(_mm256_set1_ps(n[1]), y)), _mm256_mul_ps(_mm256_set1_ps(n[2]), z)), _mm256_set1_ps(n[3]));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_NLT_UQ));
+    }
+    return inside;
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 spherex8_in_planes(const spherex8_t *s, const vec4f_t *planes, int planeCount) {
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    __m256 negr = _mm256_sub_ps(_mm256_setzero_ps(), s->r);
+    for (int p = 0; p < planeCount; p++) {
+        const float *n = planes[p]._m;
+        __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(n[0]), s->x),
+            _mm256_mul_ps(_mm256_set1_ps(n[1]), s->y)), _mm256_mul_ps(_mm256_set1_ps(n[2]), s->z)), _mm256_set1_ps(n[3]));
+        inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negr, _CMP_NLT_UQ));
+    }
+    return inside;
+}
+
+// min and max return their second operand when either is NaN, which gives the same slab order as rayf_intersect_aabb
+AGL_INLINE AGL_TARGET_AVX2 __m256 rayf_intersect_aabbx8(const rayf_t *r, const aabbx8_t *a, __m256 tmax, __m256 *t) {
+    __m256 lo3[3] = { a->min.x, a->min.y, a->min.z }, hi3[3] = { a->max.x, a->max.y, a->max.z };
+    __m256 tnear = _mm256_setzero_ps(), tfar = tmax;
+    for (int k = 0; k < 3; k++) {
+        __m256 inv = _mm256_set1_ps(1.f / r->dir._m[k]), o = _mm256_set1_ps(r->origin._m[k]);
+        __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(lo3[k], o), inv), t1 = _mm256_mul_ps(_mm256_sub_ps(hi3[k], o), inv);
+        tnear = _mm256_max_ps(_mm256_min_ps(t1, t0), tnear);
+        tfar = _mm256_min_ps(_mm256_max_ps(t0, t1), tfar);
+    }
+    *t = tnear;
+    return _mm256_cmp_ps(tnear, tfar, _CMP_LE_OQ);
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 rayf_intersect_spherex8(const rayf_t *r, const spherex8_t *s, __m256 tmax, __m256 *t) {
+    __m256 ox = _mm256_sub_ps(_mm256_set1_ps(r->origin._m[0]), s->x);
+    __m256 oy = _mm256_sub_ps(_mm256_set1_ps(r->origin._m[1]), s->y);
+    __m256 oz = _mm256_sub_ps(_mm256_set1_ps(r->origin._m[2]), s->z);
+    __m256 dx = _mm256_set1_ps(r->dir._m[0]), dy = _mm256_set1_ps(r->dir._m[1]), dz = _mm256_set1_ps(r->dir._m[2]);
+    __m256 a = _mm256_set1_ps(vec3f_dot(&r->dir, &r->dir));
+    __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, dx), _mm256_mul_ps(oy, dy)), _mm256_mul_ps(oz, dz));
+    __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ox, ox), _mm256_mul_ps(oy, oy)), _mm256_mul_ps(oz, oz)),
+        _mm256_mul_ps(s->r, s->r));
+    __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, c));
+    __m256 hit = _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(), b), _mm256_sqrt_ps(disc)), a);
+    __m256 inside = _mm256_cmp_ps(c, _mm256_setzero_ps(), _CMP_LE_OQ);
+    __m256 outside = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(disc, _mm256_setzero_ps(), _CMP_GE_OQ),
+        _mm256_cmp_ps(b, _mm256_setzero_ps(), _CMP_LE_OQ)), _mm256_cmp_ps(hit, tmax, _CMP_LE_OQ));
+    *t = _mm256_andnot_ps(inside, hit);
+    return _mm256_or_ps(inside, outside);
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 rayf_intersect_trianglex8(const rayf_t *r, const trianglex8_t *tri, __m256 tmax, __m256 *t,
+    __m256 *u, __m256 *v) {
+    vec3x8_t dir = { _mm256_set1_ps(r->dir._m[0]), _mm256_set1_ps(r->dir._m[1]), _mm256_set1_ps(r->dir._m[2]) };
+    vec3x8_t origin = { _mm256_set1_ps(r->origin._m[0]), _mm256_set1_ps(r->origin._m[1]), _mm256_set1_ps(r->origin._m[2]) };
+    vec3x8_t e1 = vec3x8_sub(&tri->b, &tri->a), e2 = vec3x8_sub(&tri->c, &tri->a);
+    vec3x8_t p = vec3x8_cross(&dir, &e2);
+    __m256 inv = _mm256_div_ps(_mm256_set1_ps(1.f), vec3x8_dot(&e1, &p));
+    vec3x8_t s = vec3x8_sub(&origin, &tri->a);
+    __m256 bu = _mm256_mul_ps(vec3x8_dot(&s, &p), inv);
+    vec3x8_t q = vec3x8_cross(&s, &e1);
+    __m256 bv = _mm256_mul_ps(vec3x8_dot(&dir, &q), inv);
+    __m256 hit = _mm256_mul_ps(vec3x8_dot(&e2, &q), inv);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 mask = _mm256_and_ps(_mm256_cmp_ps(bu, zero, _CMP_GE_OQ), _mm256_cmp_ps(bv, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(bu, bv), _mm256_set1_ps(1.f), _CMP_LE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_and_ps(_mm256_cmp_ps(hit, zero, _CMP_GE_OQ), _mm256_cmp_ps(hit, tmax, _CMP_LE_OQ)));
+    *t = hit;
+    if (u)
+        *u = bu;
+    if (v)
+        *v = bv;
+    return mask;
+}
+
+// Fast approximations
+// Polynomial approximations (Cephes style range reduction and minimax polynomials) of 4 floats per SSE2 register, and of
+// 8 per AVX2 register in the *8 variants, which need AGL_CPU_FEATURE_AVX2_BIT and may differ from the *4 variants by FMA
+// rounding. Largest error against the correctly rounded result, as checked by tests/math_test.c:
+//   agl_sin4, agl_cos4, agl_sincos4   2 ulp for |x| <= pi, absolute 1e-7 up to |x| = 8192, degrading beyond
+//   agl_acos4                         2 ulp on [-1, 1], NaN outside
+//   agl_atan2_4                       3 ulp, atan2(0, 0) is 0, infinite inputs are not handled
+//   agl_exp4                          2 ulp on [-87, 88], 0 below and +inf above, NaN is not propagated
+//   agl_log4                          2 ulp for normal x > 0
+//   agl_rsqrt4, agl_sqrt4             4 ulp for normal x > 0 (estimate plus one Newton-Raphson step), sqrt(0) is 0
+
+// sin and cos of x, from one range reduction to [-pi/4, pi/4] shared by both
+AGL_INLINE void agl_sincos4(__m128 x, __m128 *s, __m128 *c) {
+    const __m128 signmask = _mm_set1_ps(-0.f);
+    __m128 signsin = _mm_and_ps(x, signmask);
+    x = _mm_andnot_ps(signmask, x);
+    // Octant j rounded up to even, the remainder is x - j * pi / 4 in three parts (Cody-Waite)
+    __m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+    j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+    __m128 y = _mm_cvtepi32_ps(j);
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(0.78515625f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(2.4187564849853515625e-4f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(3.77489497744594108e-8f)));
+    // Octants 2 and 6 swap the polynomials, 4 to 7 negate sin and 2 to 5 negate cos
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_set1_epi32(2)));
+    signsin = _mm_xor_ps(signsin, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29)));
+    __m128 signcos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+    __m128 z = _mm_mul_ps(x, x);
+    __m128 pc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), z), _mm_set1_ps(-1.388731625493765e-3f));
+    pc = _mm_add_ps(_mm_mul_ps(pc, z), _mm_set1_ps(4.166664568298827e-2f));
+    pc = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(pc, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z)), _mm_set1_ps(1.f));
+    __m128 ps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), z), _mm_set1_ps(8.3321608736e-3f));
+    ps = _mm_add_ps(_mm_mul_ps(ps, z), _mm_set1_ps(-1.6666654611e-1f));
+    ps = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ps, z), x), x);
+    *s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps)), signsin);
+    *c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc)), signcos);
+}
+
+AGL_INLINE __m128 agl_sin4(__m128 x) {
+    __m128 s, c;
+    agl_sincos4(x, &s, &c);
+    return s;
+}
+
+AGL_INLINE __m128 agl_cos4(__m128 x) {
+    __m128 s, c;
+    agl_sincos4(x, &s, &c);
+    return c;
+}
+
+// asin(a) = a + a * z * P(z) with z = a * a for a <= 0.5, larger a go through acos(a) = 2 * asin(sqrt((1 - a) / 2))
+AGL_INLINE __m128 agl_acos4(__m128 x) {
+    const __m128 signmask = _mm_set1_ps(-0.f);
+    __m128 a = _mm_andnot_ps(signmask, x);
+    __m128 big = _mm_cmpgt_ps(a, _mm_set1_ps(0.5f));
+    __m128 zbig = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(_mm_set1_ps(1.f), a));
+    __m128 z = _mm_or_ps(_mm_and_ps(big, zbig), _mm_andnot_ps(big, _mm_mul_ps(a, a)));
+    __m128 s = _mm_or_ps(_mm_and_ps(big, _mm_sqrt_ps(zbig)), _mm_andnot_ps(big, a));
+    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(4.2163199048e-2f), z), _mm_set1_ps(2.4181311049e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(4.5470025998e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(7.4953002686e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.6666752422e-1f));
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, z), s), s);
+    // acos(|x|), then acos(x) = pi - acos(|x|) for negative x
+    r = _mm_or_ps(_mm_and_ps(big, _mm_add_ps(r, r)), _mm_andnot_ps(big, _mm_sub_ps(_mm_set1_ps(1.57079632679f), r)));
+    __m128 neg = _mm_cmplt_ps(x, _mm_setzero_ps());
+    return _mm_or_ps(_mm_and_ps(neg, _mm_sub_ps(_mm_set1_ps(3.14159265359f), r)), _mm_andnot_ps(neg, r));
+}
+
+// atan of the ratio of the smaller to the larger magnitude, moved to the right octant
+AGL_INLINE __m128 agl_atan2_4(__m128 y, __m128 x) {
+    const __m128 signmask = _mm_set1_ps(-0.f);
+    __m128 ax = _mm_andnot_ps(signmask, x), ay = _mm_andnot_ps(signmask, y);
+    __m128 hi = _mm_max_ps(ax, ay), lo = _mm_min_ps(ax, ay);
+    __m128 zero = _mm_cmpeq_ps(hi, _mm_setzero_ps());
+    __m128 a = _mm_div_ps(lo, _mm_or_ps(hi, _mm_and_ps(zero, _mm_set1_ps(1.f))));
+    // Above tan(pi / 8), atan(a) = pi / 4 + atan((a - 1) / (a + 1))
+    __m128 mid = _mm_cmpgt_ps(a, _mm_set1_ps(0.414213562373f));
+    __m128 am = _mm_div_ps(_mm_sub_ps(a, _mm_set1_ps(1.f)), _mm_add_ps(a, _mm_set1_ps(1.f)));
+    a = _mm_or_ps(_mm_and_ps(mid, am), _mm_andnot_ps(mid, a));
+    __m128 z = _mm_mul_ps(a, a);
+    __m128 p = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(8.05374449538e-2f), z), _mm_set1_ps(1.38776856032e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.99777106478e-1f));
+    p = _mm_sub_ps(_mm_mul_ps(p, z), _mm_set1_ps(3.33329491539e-1f));
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, z), a), a);
+    r = _mm_add_ps(r, _mm_and_ps(mid, _mm_set1_ps(0.785398163397f)));
+    __m128 steep = _mm_cmpgt_ps(ay, ax);
+    r = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(_mm_set1_ps(1.57079632679f), r)), _mm_andnot_ps(steep, r));
+    __m128 left = _mm_cmplt_ps(x, _mm_setzero_ps());
+    r = _mm_or_ps(_mm_and_ps(left, _mm_sub_ps(_mm_set1_ps(3.14159265359f), r)), _mm_andnot_ps(left, r));
+    return _mm_xor_ps(r, _mm_and_ps(y, signmask));
+}
+
+// 2^n * exp(r) with n = round(x / ln 2) and |r| <= ln 2 / 2
+AGL_INLINE __m128 agl_exp4(__m128 x) {
+    __m128 under = _mm_cmplt_ps(x, _mm_set1_ps(-87.3365447505f));
+    __m128 over = _mm_cmpgt_ps(x, _mm_set1_ps(88.7228391117f));
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-87.3365447505f)), _mm_set1_ps(88.7228391117f));
+    __m128 t = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504089f)), _mm_set1_ps(0.5f));
+    __m128 n = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+    n = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, t), _mm_set1_ps(1.f))); // floor
+    x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+    x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.9875691500e-4f), x), _mm_set1_ps(1.3981999507e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(8.3334519073e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(4.1665795894e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(1.6666665459e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(5.0000001201e-1f));
+    p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, x), x), x), _mm_set1_ps(1.f));
+    // At the top of the range n is 128, so the scale is applied as two halves
+    __m128i e = _mm_cvttps_epi32(n);
+    __m128i e0 = _mm_srai_epi32(e, 1), e1 = _mm_sub_epi32(e, e0);
+    p = _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e0, _mm_set1_epi32(127)), 23)));
+    p = _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(e1, _mm_set1_epi32(127)), 23)));
+    p = _mm_andnot_ps(under, p);
+    return _mm_or_ps(_mm_andnot_ps(over, p), _mm_and_ps(over, _mm_set1_ps(INFINITY)));
+}
+
+// e * ln 2 + log(m) with x = m * 2^e and m in [sqrt(1/2), sqrt(2))
+AGL_INLINE __m128 agl_log4(__m128 x) {
+    __m128i bits = _mm_castps_si128(x);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+    __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F000000)));
+    __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(0.707106781186547524f));
+    e = _mm_sub_ps(e, _mm_and_ps(small, _mm_set1_ps(1.f)));
+    m = _mm_sub_ps(_mm_add_ps(m, _mm_and_ps(small, m)), _mm_set1_ps(1.f));
+    __m128 z = _mm_mul_ps(m, m);
+    __m128 p = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(7.0376836292e-2f), m), _mm_set1_ps(1.1514610310e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(1.1676998740e-1f));
+    p = _mm_sub_ps(_mm_mul_ps(p, m), _mm_set1_ps(1.2420140846e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(1.4249322787e-1f));
+    p = _mm_sub_ps(_mm_mul_ps(p, m), _mm_set1_ps(1.6668057665e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(2.0000714765e-1f));
+    p = _mm_sub_ps(_mm_mul_ps(p, m), _mm_set1_ps(2.4999993993e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, m), _mm_set1_ps(3.3333331174e-1f));
+    p = _mm_mul_ps(_mm_mul_ps(p, m), z);
+    p = _mm_add_ps(p, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+    p = _mm_sub_ps(p, _mm_mul_ps(_mm_set1_ps(0.5f), z));
+    return _mm_add_ps(_mm_add_ps(m, p), _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+}
+
+// r' = r * (1.5 - 0.5 * x * r * r) on the hardware estimate
+AGL_INLINE __m128 agl_rsqrt4(__m128 x) {
+    __m128 r = _mm_rsqrt_ps(x);
+    __m128 xrr = _mm_mul_ps(_mm_mul_ps(x, r), r);
+    return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.f), xrr));
+}
+
+AGL_INLINE __m128 agl_sqrt4(__m128 x) {
+    __m128 nonzero = _mm_cmpgt_ps(x, _mm_setzero_ps());
+    return _mm_and_ps(nonzero, _mm_mul_ps(x, agl_rsqrt4(x)));
+}
+
+AGL_INLINE AGL_TARGET_AVX2 void agl_sincos8(__m256 x, __m256 *s, __m256 *c) {
+    const __m256 signmask = _mm256_set1_ps(-0.f);
+    __m256 signsin = _mm256_and_ps(x, signmask);
+    x = _mm256_andnot_ps(signmask, x);
+    __m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(1.27323954473516f)));
+    j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+    __m256 y = _mm256_cvtepi32_ps(j);
+    x = _mm256_fnmadd_ps(y, _mm256_set1_ps(0.78515625f), x);
+    x = _mm256_fnmadd_ps(y, _mm256_set1_ps(2.4187564849853515625e-4f), x);
+    x = _mm256_fnmadd_ps(y, _mm256_set1_ps(3.77489497744594108e-8f), x);
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(2)));
+    signsin = _mm256_xor_ps(signsin, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29)));
+    __m256 signcos = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+    __m256 z = _mm256_mul_ps(x, x);
+    __m256 pc = _mm256_fmadd_ps(_mm256_set1_ps(2.443315711809948e-5f), z, _mm256_set1_ps(-1.388731625493765e-3f));
+    pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(4.166664568298827e-2f));
+    pc = _mm256_fmadd_ps(_mm256_mul_ps(pc, z), z, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, _mm256_set1_ps(1.f)));
+    __m256 ps = _mm256_fmadd_ps(_mm256_set1_ps(-1.9515295891e-4f), z, _mm256_set1_ps(8.3321608736e-3f));
+    ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(-1.6666654611e-1f));
+    ps = _mm256_fmadd_ps(_mm256_mul_ps(ps, z), x, x);
+    *s = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, swap), signsin);
+    *c = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, swap), signcos);
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 agl_sin8(__m256 x) {
+    __m256 s, c;
+    agl_sincos8(x, &s, &c);
+    return s;
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 agl_cos8(__m256 x) {
+    __m256 s, c;
+    agl_sincos8(x, &s, &c);
+    return c;
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 agl_acos8(__m256 x) {
+    __m256 a = _mm256_andnot_ps(_mm256_set1_ps(-0.f), x);
+    __m256 big = _mm256_cmp_ps(a, _mm256_set1_ps(0.5f), _CMP_GT_OQ);
+    __m256 zbig = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_sub_ps(_mm256_set1_ps(1.f), a));
+    __m256 z = _mm256_blendv_ps(_mm256_mul_ps(a, a), zbig, big);
+    __m256 s = _mm256_blendv_ps(a, _mm256_sqrt_ps(zbig), big);
+    __m256 p = _mm256_fmadd_ps(_mm256_set1_ps(4.2163199048e-2f), z, _mm256_set1_ps(2.4181311049e-2f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(4.5470025998e-2f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(7.4953002686e-2f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(1.6666752422e-1f));
+    __m256 r = _mm256_fmadd_ps(_mm256_mul_ps(p, z), s, s);
+    r = _mm256_blendv_ps(_mm256_sub_ps(_mm256_set1_ps(1.57079632679f), r), _mm256_add_ps(r, r), big);
+    return _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(3.14159265359f), r), x);
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 agl_atan2_8(__m256 y, __m256 x) {
+    const __m256 signmask = _mm256_set1_ps(-0.f);
+    __m256 ax = _mm256_andnot_ps(signmask, x), ay = _mm256_andnot_ps(signmask, y);
+    __m256 hi = _mm256_max_ps(ax, ay), lo = _mm256_min_ps(ax, ay);
+    __m256 zero = _mm256_cmp_ps(hi, _mm256_setzero_ps(), _CMP_EQ_OQ);
+    __m256 a = _mm256_div_ps(lo, _mm256_blendv_ps(hi, _mm256_set1_ps(1.f), zero));
+    __m256 mid = _mm256_cmp_ps(a, _mm256_set1_ps(0.414213562373f), _CMP_GT_OQ);
+    __m256 am = _mm256_div_ps(_mm256_sub_ps(a, _mm256_set1_ps(1.f)), _mm256_add_ps(a, _mm256_set1_ps(1.f)));
+    a = _mm256_blendv_ps(a, am, mid);
+    __m256 z = _mm256_mul_ps(a, a);
+    __m256 p = _mm256_fmsub_ps(_mm256_set1_ps(8.05374449538e-2f), z, _mm256_set1_ps(1.38776856032e-1f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(1.99777106478e-1f));
+    p = _mm256_fmsub_ps(p, z, _mm256_set1_ps(3.33329491539e-1f));
+    __m256 r = _mm256_fmadd_ps(_mm256_mul_ps(p, z), a, a);
+    r = _mm256_add_ps(r, _mm256_and_ps(mid, _mm256_set1_ps(0.785398163397f)));
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(1.57079632679f), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(3.14159265359f), r), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+    return _mm256_xor_ps(r, _mm256_and_ps(y, signmask));
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 agl_exp8(__m256 x) {
+    __m256 under = _mm256_cmp_ps(x, _mm256_set1_ps(-87.3365447505f), _CMP_LT_OQ);
+    __m256 over = _mm256_cmp_ps(x, _mm256_set1_ps(88.7228391117f), _CMP_GT_OQ);
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3365447505f)), _mm256_set1_ps(88.7228391117f));
+    __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504089f), _mm256_set1_ps(0.5f)));
+    x = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    x = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), x);
+    __m256 p = _mm256_fmadd_ps(_mm256_set1_ps(1.9875691500e-4f), x, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, x, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_add_ps(_mm256_fmadd_ps(_mm256_mul_ps(p, x), x, x), _mm256_set1_ps(1.f));
+    __m256i e = _mm256_cvttps_epi32(n);
+    __m256i e0 = _mm256_srai_epi32(e, 1), e1 = _mm256_sub_epi32(e, e0);
+    p = _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(e0, _mm256_set1_epi32(127)), 23)));
+    p = _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(e1, _mm256_set1_epi32(127)), 23)));
+    p = _mm256_andnot_ps(under, p);
+    return _mm256_blendv_ps(p, _mm256_set1_ps(INFINITY), over);
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 agl_log8(__m256 x) {
+    __m256i bits = _mm256_castps_si256(x);
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F000000)));
+    __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(small, _mm256_set1_ps(1.f)));
+    m = _mm256_sub_ps(_mm256_add_ps(m, _mm256_and_ps(small, m)), _mm256_set1_ps(1.f));
+    __m256 z = _mm256_mul_ps(m, m);
+    __m256 p = _mm256_fmsub_ps(_mm256_set1_ps(7.0376836292e-2f), m, _mm256_set1_ps(1.1514610310e-1f));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(1.1676998740e-1f));
+    p = _mm256_fmsub_ps(p, m, _mm256_set1_ps(1.2420140846e-1f));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(1.4249322787e-1f));
+    p = _mm256_fmsub_ps(p, m, _mm256_set1_ps(1.6668057665e-1f));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(2.0000714765e-1f));
+    p = _mm256_fmsub_ps(p, m, _mm256_set1_ps(2.4999993993e-1f));
+    p = _mm256_fmadd_ps(p, m, _mm256_set1_ps(3.3333331174e-1f));
+    p = _mm256_mul_ps(_mm256_mul_ps(p, m), z);
+    p = _mm256_fmadd_ps(e, _mm256_set1_ps(-2.12194440e-4f), p);
+    p = _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, p);
+    return _mm256_fmadd_ps(e, _mm256_set1_ps(0.693359375f), _mm256_add_ps(m, p));
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 agl_rsqrt8(__m256 x) {
+    __m256 r = _mm256_rsqrt_ps(x);
+    __m256 xrr = _mm256_mul_ps(_mm256_mul_ps(x, r), r);
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), r), _mm256_sub_ps(_mm256_set1_ps(3.f), xrr));
+}
+
+AGL_INLINE AGL_TARGET_AVX2 __m256 agl_sqrt8(__m256 x) {
+    return _mm256_and_ps(_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ), _mm256_mul_ps(x, agl_rsqrt8(x)));
+}
+
+// Array versions and quaternion builders on top of them. `dst` may alias an input.
+AGL_API void agl_sincos(float *s, float *c, const float *x, size_t count);
+// dst[i] = rotation by angle[i] radians about axis[i], like quatf_fromaxisangle
+AGL_API void agl_quat_from_axis_angle(quatf_t *dst, const vec3f_t *axis, const float *angle, size_t count);
+// dst[i] = rotation taking the direction of a[i] to the direction of b[i], like quatf_fromvectors
+AGL_API void agl_quat_from_vectors(quatf_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count);
+
+// Batch fills from the 8 streams of an agl_rng_t, each step of the streams fills a block of 8 elements (16 for
+// gaussians). A count that is not a multiple of the block discards the rest of the last block.
+// Uniform in [lo, hi)
+AGL_API void agl_rng_fill_float(agl_rng_t *rng, float *dst, size_t count, float lo, float hi);
+// Normal distribution, Box-Muller on the approximations above
+AGL_API void agl_rng_fill_gaussian(agl_rng_t *rng, float *dst, size_t count, float mean, float stddev);
+// Uniform in the cube [-1, 1)^3, like vec3f_srand
+AGL_API void agl_rng_fill_in_cube(agl_rng_t *rng, vec3f_t *dst, size_t count);
+// Uniform in the unit ball: a direction scaled by the largest of three uniforms, whose distribution is r^3
+AGL_API void agl_rng_fill_in_sphere(agl_rng_t *rng, vec3f_t *dst, size_t count);
+// Uniform unit vectors
+AGL_API void agl_rng_fill_on_sphere(agl_rng_t *rng, vec3f_t *dst, size_t count);
+
+// Array kernels over spans of `count` vec3f_t, 8 at a time through the types above. `dst` may alias an input.
+AGL_API void agl_vec3_add(vec3f_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count);
+AGL_API void agl_vec3_scale(vec3f_t *dst, const vec3f_t *a, float s, size_t count);
+AGL_API void agl_vec3_dot(float *dst, const vec3f_t *a, const vec3f_t *b, size_t count);
+AGL_API void agl_vec3_cross(vec3f_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count);
+AGL_API void agl_vec3_normalize(vec3f_t *dst, const vec3f_t *a, size_t count);
+// dst[i] = q[i] applied to v[i]
+AGL_API void agl_quat_apply(vec3f_t *dst, const quatf_t *q, const vec3f_t *v, size_t count);
+// dst[i] = m * v[i]
+AGL_API void agl_mat3_mulvec3(vec3f_t *dst, const mat3f_t *m, const vec3f_t *v, size_t count);
+// Affine transforms of points and directions, like mat4v_transform_point and mat4v_transform_vector
+AGL_API void agl_mat4_transform_points(vec3f_t *dst, const mat4f_t *m, const vec3f_t *p, size_t count);
+AGL_API void agl_mat4_transform_vectors(vec3f_t *dst, const mat4f_t *m, const vec3f_t *v, size_t count);
+// Full 4x4 transform of `count` tightly packed xyz points with w = 1, e.g. mesh positions to clip space. `dst` must not alias.
+AGL_API void agl_mat4_project_points(vec4f_t *dst, const mat4f_t *m, const float *points, size_t count);
+// dst[i] = vec3d_rebase(&p[i], origin), e.g. double world positions to a float instance or particle stream
+AGL_API void agl_vec3d_rebase(vec3f_t *dst, const vec3d_t *p, const vec3d_t *origin, size_t count);
+// p[i] += v[i] * dt in double, float velocities moving double positions
+AGL_API void agl_vec3d_integrate(vec3d_t *p, const vec3f_t *v, float dt, size_t count);
+// Instance matrices for agl_gfx_draw_mesh_instanced: the rotation and scale columns of m[i] with the translation
+// column replaced by vec3d_rebase(&translation[i], origin). `dst` may alias `m`.
+AGL_API void agl_mat4_rebase(mat4f_t *dst, const mat4f_t *m, const vec3d_t *translation, const vec3d_t *origin, size_t count);
+
+// Stream conversion
+// Bulk kernels for decoding packed vertex attributes and indices (e.g. glTF accessors) into the float and
+// uint32 streams consumed by agl_gfx_create_mesh. Sources may be strided; destinations are tightly packed.
+
+typedef enum agl_component_type_t {
+    AGL_COMPONENT_TYPE_F32,
+    AGL_COMPONENT_TYPE_F16,
+    AGL_COMPONENT_TYPE_S8,
+    AGL_COMPONENT_TYPE_U8,
+    AGL_COMPONENT_TYPE_S16,
+    AGL_COMPONENT_TYPE_U16,
+    AGL_COMPONENT_TYPE_U32,
+} agl_component_type_t;
+
+AGL_API size_t agl_component_size(agl_component_type_t type);
+// Converts `count` elements of `srcComponents` components each to float. `srcStride` is the distance in bytes
+// between elements. Normalised integers map to [0,1] (unsigned) or [-1,1] (signed). Missing destination
+// components are filled with 0, except the fourth which is filled with 1.
+AGL_API void agl_convert_to_f32(float *dst, int dstComponents, const void *src, size_t srcStride, int srcComponents,
+    agl_component_type_t type, bool normalized, size_t count);
+// Widens `count` unsigned 8/16/32-bit integers (e.g. indices) to uint32.
+AGL_API void agl_convert_to_u32(uint32_t *dst, const void *src, size_t srcStride, agl_component_type_t type, size_t count);
+// The inverse of agl_convert_to_f32, e.g. for half float textures or compact vertex streams. Integers round to nearest
+// and saturate, normalised ones after clamping to [0,1] or [-1,1]; NaN encodes as the low end. F16 rounds to nearest
+// even, overflows to infinity and keeps NaN. `dstStride` is the distance in bytes between destination elements; missing
+// source components are encoded as 0, except the fourth which is encoded as 1. Uses F16C on the AVX2 path.
+AGL_API void agl_convert_from_f32(void *dst, size_t dstStride, int dstComponents, const float *src, int srcComponents,
+    agl_component_type_t type, bool normalized, size_t count);
+
+// Bounding volumes
+// Batched kernels for building bounds and testing many of them at once, e.g. all mesh draws of a frame.
+
+// Component-wise minimum and maximum of `count` (at least 1) tightly packed xyz points.
+AGL_API void agl_bounds_minmax3(float *min, float *max, const float *points, size_t count);
+// Tests `count` spheres, given as separate centre x, y, z and radius arrays, against `planeCount` planes (nx, ny, nz, d)
+// with inward facing normals. visible[i] is set to 1 unless sphere i lies entirely behind one of the planes.
+// Returns the number of visible spheres.
+AGL_API size_t agl_cull_spheres(uint8_t *visible, const float *x, const float *y, const float *z, const float *radius, size_t count,
+    const vec4f_t *planes, int planeCount);
+// Tests `count` boxes against `planeCount` planes with aabbf_in_planes, visible[i] is set to 1 unless box i lies entirely
+// behind one of them. Returns the number of visible boxes.
+AGL_API size_t agl_cull_aabbs(uint8_t *visible, const aabbf_t *boxes, size_t count, const vec4f_t *planes, int planeCount);
+// Casts one ray against `count` boxes, t[i] is the entry distance into box i as in rayf_intersect_aabb or INFINITY when
+// the box is missed within `tmax`. Returns the number of boxes hit.
+AGL_API size_t agl_ray_aabbs(float *t, const rayf_t *ray, const aabbf_t *boxes, size_t count, float tmax);
+// Closest hit of one ray within `tmax` against `triangleCount` triangles of tightly packed xyz `positions`, 3 `indices`
+// per triangle or 3 consecutive vertices when `indices` is NULL. On a hit sets *t and *triangle and returns true. Both
+// faces are hit and ties go to the lowest triangle index, e.g. for picking meshes on the CPU.
+AGL_API bool agl_ray_triangles(float *t, uint32_t *triangle, const rayf_t *ray, const float *positions, const uint32_t *indices,
+    size_t triangleCount, float tmax);
+// Broadphase queries: write the indices of the boxes or spheres overlapping `query` in ascending order and return their
+// number. `indices` needs room for `count` entries.
+AGL_API size_t agl_overlap_aabbs(uint32_t *indices, const aabbf_t *query, const aabbf_t *boxes, size_t count);
+AGL_API size_t agl_overlap_spheres(uint32_t *indices, const spheref_t *query, const spheref_t *spheres, size_t count);
+
+// Skinning
+// Linear blend skinning of tightly packed xyz streams with four influences per vertex. `joints` holds the 4 joint indices
+// of each vertex stored as floats and `weights` the matching 4 weights, as in agl_gfx_mesh_params_t. `palette` holds one
+// column-major 4x4 matrix (16 floats) per joint, indices past `jointCount` are clamped. `normals` and `dstNormals` may be
+// NULL, skinned normals are renormalised.
+AGL_API void agl_skin_vertices(float *dstPositions, float *dstNormals, const float *positions, const float *normals,
+    const float *joints, const float *weights, const float *palette, size_t jointCount, size_t count);
 
 #endif // AGL_MATH_H
 
@@ -450,6 +1545,134 @@ vec4v_t quatv_to_axis_angle(const quatv_t *q);
 #ifndef AGL_MATH_IMPLEMENTED
 #define AGL_MATH_IMPLEMENTED
 
+// External definitions of the inline functions
+// AGL_INLINE is plain C99 inline unless building or using the shared library, and an inline definition alone emits no
+// symbol. These declarations make this translation unit emit the copies that calls the compiler did not inline link to.
+AGL_API bool float_eq(float a, float b, float eps);
+AGL_API void swapf(float *a, float *b);
+AGL_API float clampf(float f, float fmin, float fmax);
+AGL_API uint32_t agl_rng_u32(agl_rng_t *rng);
+AGL_API float agl_rng_float(agl_rng_t *rng);
+AGL_API void vec3f_scale(vec3f_t *v, float s);
+AGL_API void vec3f_add(vec3f_t *v, const vec3f_t *b);
+AGL_API void vec3f_addscaled(vec3f_t *v, const vec3f_t *b, float s);
+AGL_API void vec3f_sub(vec3f_t *v, const vec3f_t *b);
+AGL_API void vec3f_mul(vec3f_t *v, const vec3f_t *b);
+AGL_API void vec3f_div(vec3f_t *v, const vec3f_t *b);
+AGL_API void vec3f_add2(vec3f_t *v, const vec3f_t *a, const vec3f_t *b);
+AGL_API void vec3f_sub2(vec3f_t *v, const vec3f_t *a, const vec3f_t *b);
+AGL_API void vec3f_mul2(vec3f_t *v, const vec3f_t *a, const vec3f_t *b);
+AGL_API void vec3f_div2(vec3f_t *v, const vec3f_t *a, const vec3f_t *b);
+AGL_API float vec3f_dot(const vec3f_t *a, const vec3f_t *b);
+AGL_API float vec3f_sqrlen(const vec3f_t *v);
+AGL_API float vec3f_len(const vec3f_t *v);
+AGL_API void vec3f_normalize(vec3f_t *v);
+AGL_API void vec3f_cross(vec3f_t *v, const vec3f_t *a, const vec3f_t *b);
+AGL_API void vec3f_recip(vec3f_t *vr, const vec3f_t *v);
+AGL_API vec3f_t vec3f_urand();
+AGL_API vec3f_t vec3f_srand();
+AGL_API void quatf_inv(quatf_t *q);
+AGL_API void quatf_add(quatf_t *q, const quatf_t *b);
+AGL_API void quatf_addscaled(quatf_t *q, const quatf_t *b, float s);
+AGL_API void quatf_sub(quatf_t *q, const quatf_t *b);
+AGL_API void quatf_mul2(quatf_t *q, const quatf_t *a, const quatf_t *b);
+AGL_API float quatf_sqrlen(const quatf_t *q);
+AGL_API float quatf_len(const quatf_t *q);
+AGL_API void quatf_normalize(quatf_t *q);
+AGL_API void quatf_apply(vec3f_t *r, const quatf_t *q, const vec3f_t *v);
+AGL_API void quatf_applyinv(vec3f_t *r, const quatf_t *q, const vec3f_t *v);
+AGL_API void quatf_fromaxisangle(quatf_t *q, const vec3f_t *axis, float angle);
+AGL_API void quatf_fromvectors(quatf_t *q, const vec3f_t *a, const vec3f_t *b);
+AGL_API void mat3f_fromquat(mat3f_t *m, const quatf_t *q);
+AGL_API void mat3f_fromdiag(mat3f_t *m, const vec3f_t *v);
+AGL_API void mat3f_fromcols(mat3f_t *m, const vec3f_t *col0, const vec3f_t *col1, const vec3f_t *col2);
+AGL_API void mat3f_transpose(mat3f_t *m);
+AGL_API void mat3f_mul(mat3f_t *m, const mat3f_t *a, const mat3f_t *b);
+AGL_API void mat3f_mulvec3f(vec3f_t *v, const mat3f_t *m, const vec3f_t *b);
+AGL_API void vec3f_mulmat3f(vec3f_t *v, const vec3f_t *a, const mat3f_t *m);
+AGL_API void quatf_frommat3f(quatf_t *q, const mat3f_t *m);
+AGL_API void mat4f_identity(mat4f_t *m);
+AGL_API void mat4f_fromtrs(mat4f_t *m, const vec3f_t *t, const quatf_t *r, const vec3f_t *s);
+AGL_API void mat4f_transpose(mat4f_t *m);
+AGL_API void mat4f_mul(mat4f_t *m, const mat4f_t *a, const mat4f_t *b);
+AGL_API void mat4f_mulvec4f(vec4f_t *v, const mat4f_t *m, const vec4f_t *b);
+AGL_API void mat4f_perspective(mat4f_t *m, float fovY, float aspect, float nearZ, float farZ);
+AGL_API void vec3d_scale(vec3d_t *v, double s);
+AGL_API void vec3d_add(vec3d_t *v, const vec3d_t *b);
+AGL_API void vec3d_addscaled(vec3d_t *v, const vec3d_t *b, double s);
+AGL_API void vec3d_sub(vec3d_t *v, const vec3d_t *b);
+AGL_API double vec3d_dot(const vec3d_t *a, const vec3d_t *b);
+AGL_API double vec3d_sqrlen(const vec3d_t *v);
+AGL_API double vec3d_len(const vec3d_t *v);
+AGL_API vec3d_t vec3d_fromvec3f(const vec3f_t *v);
+AGL_API vec3f_t vec3d_rebase(const vec3d_t *p, const vec3d_t *origin);
+AGL_API bool vec3d_recenter(vec3d_t *origin, const vec3d_t *camera, double radius);
+AGL_API float planef_distance(const vec4f_t *plane, const vec3f_t *p);
+AGL_API void mat4f_frustum_planes(vec4f_t planes[6], const mat4f_t *viewProj);
+AGL_API bool aabbf_overlaps(const aabbf_t *a, const aabbf_t *b);
+AGL_API bool aabbf_contains(const aabbf_t *a, const vec3f_t *p);
+AGL_API bool spheref_overlaps(const spheref_t *a, const spheref_t *b);
+AGL_API bool aabbf_overlaps_sphere(const aabbf_t *a, const spheref_t *s);
+AGL_API bool aabbf_in_planes(const aabbf_t *a, const vec4f_t *planes, int planeCount);
+AGL_API bool spheref_in_planes(const spheref_t *s, const vec4f_t *planes, int planeCount);
+AGL_API bool rayf_intersect_aabb(const rayf_t *r, const aabbf_t *a, float tmax, float *t);
+AGL_API bool rayf_intersect_sphere(const rayf_t *r, const spheref_t *s, float tmax, float *t);
+AGL_API bool rayf_intersect_triangle(const rayf_t *r, const vec3f_t *a, const vec3f_t *b, const vec3f_t *c, float tmax,
+    float *t, float *u, float *v);
+AGL_API AGL_TARGET_AVX2 void agl__transpose8x4_strided(__m256 out[4], const float *p, size_t stride);
+AGL_API AGL_TARGET_AVX2 void agl__transpose8x4(__m256 out[4], const float *p);
+AGL_API AGL_TARGET_AVX2 void agl__untranspose8x4(float *p, __m256 x, __m256 y, __m256 z, __m256 w);
+AGL_API AGL_TARGET_AVX2 vec3x8_t vec3x8_load(const vec3f_t *v);
+AGL_API AGL_TARGET_AVX2 void vec3x8_store(vec3f_t *v, const vec3x8_t *a);
+AGL_API AGL_TARGET_AVX2 vec3x8_t vec3x8_load_packed(const float *p);
+AGL_API AGL_TARGET_AVX2 void vec3x8_store_packed(float *p, const vec3x8_t *a);
+AGL_API AGL_TARGET_AVX2 quatx8_t quatx8_load(const quatf_t *q);
+AGL_API AGL_TARGET_AVX2 void quatx8_store(quatf_t *q, const quatx8_t *a);
+AGL_API AGL_TARGET_AVX2 vec3x8_t vec3x8_add(const vec3x8_t *a, const vec3x8_t *b);
+AGL_API AGL_TARGET_AVX2 vec3x8_t vec3x8_sub(const vec3x8_t *a, const vec3x8_t *b);
+AGL_API AGL_TARGET_AVX2 vec3x8_t vec3x8_scale(const vec3x8_t *a, __m256 s);
+AGL_API AGL_TARGET_AVX2 __m256 vec3x8_dot(const vec3x8_t *a, const vec3x8_t *b);
+AGL_API AGL_TARGET_AVX2 vec3x8_t vec3x8_cross(const vec3x8_t *a, const vec3x8_t *b);
+AGL_API AGL_TARGET_AVX2 vec3x8_t vec3x8_normalize(const vec3x8_t *a);
+AGL_API AGL_TARGET_AVX2 vec3x8_t quatx8_apply(const quatx8_t *q, const vec3x8_t *v);
+AGL_API AGL_TARGET_AVX2 vec3x8_t mat3f_mulvec3x8(const mat3f_t *m, const vec3x8_t *b);
+AGL_API AGL_TARGET_AVX2 vec3x8_t mat4f_mulpoint3x8(const mat4f_t *m, const vec3x8_t *b);
+AGL_API AGL_TARGET_AVX2 vec3dx4_t vec3dx4_load(const vec3d_t *v);
+AGL_API AGL_TARGET_AVX2 void vec3dx4_store(vec3d_t *v, const vec3dx4_t *a);
+AGL_API AGL_TARGET_AVX2 vec3dx4_t vec3dx4_add(const vec3dx4_t *a, const vec3dx4_t *b);
+AGL_API AGL_TARGET_AVX2 vec3dx4_t vec3dx4_sub(const vec3dx4_t *a, const vec3dx4_t *b);
+AGL_API AGL_TARGET_AVX2 vec3dx4_t vec3dx4_scale(const vec3dx4_t *a, __m256d s);
+AGL_API AGL_TARGET_AVX2 __m256d vec3dx4_dot(const vec3dx4_t *a, const vec3dx4_t *b);
+AGL_API AGL_TARGET_AVX2 void vec3dx4_rebase(vec3f_t *dst, const vec3dx4_t *a, const vec3d_t *origin);
+AGL_API AGL_TARGET_AVX2 aabbx8_t aabbx8_load(const aabbf_t *a);
+AGL_API AGL_TARGET_AVX2 spherex8_t spherex8_load(const spheref_t *s);
+AGL_API AGL_TARGET_AVX2 __m256 aabbx8_overlaps(const aabbx8_t *a, const aabbf_t *b);
+AGL_API AGL_TARGET_AVX2 __m256 spherex8_overlaps(const spherex8_t *a, const spheref_t *b);
+AGL_API AGL_TARGET_AVX2 __m256 aabbx8_in_planes(const aabbx8_t *a, const vec4f_t *planes, int planeCount);
+AGL_API AGL_TARGET_AVX2 __m256 spherex8_in_planes(const spherex8_t *s, const vec4f_t *planes, int planeCount);
+AGL_API AGL_TARGET_AVX2 __m256 rayf_intersect_aabbx8(const rayf_t *r, const aabbx8_t *a, __m256 tmax, __m256 *t);
+AGL_API AGL_TARGET_AVX2 __m256 rayf_intersect_spherex8(const rayf_t *r, const spherex8_t *s, __m256 tmax, __m256 *t);
+AGL_API AGL_TARGET_AVX2 __m256 rayf_intersect_trianglex8(const rayf_t *r, const trianglex8_t *tri, __m256 tmax, __m256 *t,
+    __m256 *u, __m256 *v);
+AGL_API void agl_sincos4(__m128 x, __m128 *s, __m128 *c);
+AGL_API __m128 agl_sin4(__m128 x);
+AGL_API __m128 agl_cos4(__m128 x);
+AGL_API __m128 agl_acos4(__m128 x);
+AGL_API __m128 agl_atan2_4(__m128 y, __m128 x);
+AGL_API __m128 agl_exp4(__m128 x);
+AGL_API __m128 agl_log4(__m128 x);
+AGL_API __m128 agl_rsqrt4(__m128 x);
+AGL_API __m128 agl_sqrt4(__m128 x);
+AGL_API AGL_TARGET_AVX2 void agl_sincos8(__m256 x, __m256 *s, __m256 *c);
+AGL_API AGL_TARGET_AVX2 __m256 agl_sin8(__m256 x);
+AGL_API AGL_TARGET_AVX2 __m256 agl_cos8(__m256 x);
+AGL_API AGL_TARGET_AVX2 __m256 agl_acos8(__m256 x);
+AGL_API AGL_TARGET_AVX2 __m256 agl_atan2_8(__m256 y, __m256 x);
+AGL_API AGL_TARGET_AVX2 __m256 agl_exp8(__m256 x);
+AGL_API AGL_TARGET_AVX2 __m256 agl_log8(__m256 x);
+AGL_API AGL_TARGET_AVX2 __m256 agl_rsqrt8(__m256 x);
+AGL_API AGL_TARGET_AVX2 __m256 agl_sqrt8(__m256 x);
+
 #define XCONCAT(x,y) x##y
 #define CONCAT(x,y) XCONCAT(x,y)
 
@@ -505,22 +1728,2208 @@ vec4v_t vec4v_sub(const vec4v_t *a, const vec4v_t *b) {
     return (vec4v_t){ _mm_sub_ps(a->_m, b->_m) };
 }
 
+// The single register API only relies on SSE2: lane w is replaced with masks instead of _mm_blend_ps, and dot products
+// are summed with shuffles instead of _mm_dp_ps, which also has the longer latency
+static __m128 agl__xyz_mask_ps(void) {
+    return _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+}
+
+// xyz of v with w taken from the w lane of `w`
+static __m128 agl__with_w_ps(__m128 v, __m128 w) {
+    __m128 mask = agl__xyz_mask_ps();
+    return _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, w));
+}
+
+// Horizontal sum of the four lanes, in every lane
+static __m128 agl__hsum_ps(__m128 v) {
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,3,0,1)));
+    return _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,0,3,2)));
+}
+
+vec3v_t vec3v_mul(const vec3v_t *a, const vec3v_t *b) {
+    return (vec3v_t){ _mm_mul_ps(a->_m, b->_m) };
+}
+
+vec4v_t vec4v_mul(const vec4v_t *a, const vec4v_t *b) {
+    return (vec4v_t){ _mm_mul_ps(a->_m, b->_m) };
+}
+
+vec3v_t vec3v_scale(const vec3v_t *a, float s) {
+    return (vec3v_t){ _mm_mul_ps(a->_m, _mm_set1_ps(s)) };
+}
+
+vec4v_t vec4v_scale(const vec4v_t *a, float s) {
+    return (vec4v_t){ _mm_mul_ps(a->_m, _mm_set1_ps(s)) };
+}
+
 float vec3v_dot(const vec3v_t *a, const vec3v_t *b) {
-    __m128 dp = _mm_dp_ps(a->_m, b->_m, 0x71);
-    alignas(16) float res[4];
-    _mm_store1_ps(res, dp);
-    return res[0];
+    return _mm_cvtss_f32(agl__hsum_ps(_mm_and_ps(_mm_mul_ps(a->_m, b->_m), agl__xyz_mask_ps())));
+}
+
+void vec3v_dot3(const vec3v_t *a, const vec3v_t *b, vec3v_t *r) {
+    __m128 mask = agl__xyz_mask_ps();
+    r->_m = _mm_and_ps(agl__hsum_ps(_mm_and_ps(_mm_mul_ps(a->_m, b->_m), mask)), mask);
+}
+
+void vec4v_dot(const vec4v_t *a, const vec4v_t *b, vec4v_t *r) {
+    r->_m = _mm_move_ss(_mm_setzero_ps(), agl__hsum_ps(_mm_mul_ps(a->_m, b->_m)));
+}
+
+void vec4v_dot4(const vec4v_t *a, const vec4v_t *b, vec4v_t *r) {
+    r->_m = agl__hsum_ps(_mm_mul_ps(a->_m, b->_m));
+}
+
+// (a.yzx * b.zxy - a.zxy * b.yzx), the w lanes cancel out to 0
+static __m128 agl__cross_ps(__m128 a, __m128 b) {
+    __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3,0,2,1));
+    __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3,0,2,1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3,0,2,1));
+}
+
+void vec3v_cross(const vec3v_t *a, const vec3v_t *b, vec3v_t *r) {
+    r->_m = agl__cross_ps(a->_m, b->_m);
+}
+
+void vec4v_cross(const vec4v_t *a, const vec4v_t *b, vec4v_t *r) {
+    r->_m = agl__cross_ps(a->_m, b->_m);
+}
+
+// x / sqrt(d) with a refined reciprocal square root estimate: r' = r * (1.5 - 0.5 * d * r * r)
+static __m128 agl__normalize_ps(__m128 v, __m128 d) {
+    __m128 r = _mm_rsqrt_ps(d);
+    __m128 rr = _mm_mul_ps(_mm_mul_ps(d, r), r);
+    r = _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_set1_ps(0.5f), rr)));
+    return _mm_mul_ps(v, r);
+}
+
+vec3v_t vec3v_normalize(const vec3v_t *a) {
+    __m128 v = _mm_and_ps(a->_m, agl__xyz_mask_ps());
+    return (vec3v_t){ agl__normalize_ps(v, agl__hsum_ps(_mm_mul_ps(v, v))) };
+}
+
+vec4v_t vec4v_normalize(const vec4v_t *a) {
+    return (vec4v_t){ agl__normalize_ps(a->_m, agl__hsum_ps(_mm_mul_ps(a->_m, a->_m))) };
 }
 
-#define _MM_BLEND(x,y,z,w) ((x)|((y)<<1)|((z)<<2)|((w)<<3))
+vec3v_t mat3f_mulvec3v(const mat3f_t *m, const vec3v_t *v) {
+    // The columns are 3 floats apart, the fourth lane of each load is masked out of the result
+    __m128 c0 = _mm_loadu_ps(m->_m[0]), c1 = _mm_loadu_ps(m->_m[1]), c2 = _mm_set_ps(0.f, m->_m[2][2], m->_m[2][1], m->_m[2][0]);
+    __m128 r = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(c0, _mm_shuffle_ps(v->_m, v->_m, _MM_SHUFFLE(0,0,0,0))),
+        _mm_mul_ps(c1, _mm_shuffle_ps(v->_m, v->_m, _MM_SHUFFLE(1,1,1,1)))),
+        _mm_mul_ps(c2, _mm_shuffle_ps(v->_m, v->_m, _MM_SHUFFLE(2,2,2,2))));
+    return (vec3v_t){ _mm_and_ps(r, agl__xyz_mask_ps()) };
+}
 
 void quatv_conjugate(const quatv_t *q, quatv_t *qc) {
-    const vec3v_t vzero = vec3v_load(((float[]){0.f, 0.f, 0.f, 0.f}));
-    __m128 neg = _mm_sub_ps(vzero._m, q->_m);
-    qc->_m = _mm_blend_ps(neg, q->_m, _MM_BLEND(0,0,0,1));
+    qc->_m = _mm_xor_ps(q->_m, _mm_set_ps(0.f, -0.f, -0.f, -0.f));
 }
 
-#undef STORE_UNALIGNED_IMPL
+quatv_t quatv_mul(const quatv_t *a, const quatv_t *b) {
+    // Each lane of a scales b permuted and sign flipped, e.g. a.x contributes (b.w, -b.z, b.y, -b.x)
+    __m128 bv = b->_m;
+    __m128 aw = _mm_shuffle_ps(a->_m, a->_m, _MM_SHUFFLE(3,3,3,3));
+    __m128 ax = _mm_shuffle_ps(a->_m, a->_m, _MM_SHUFFLE(0,0,0,0));
+    __m128 ay = _mm_shuffle_ps(a->_m, a->_m, _MM_SHUFFLE(1,1,1,1));
+    __m128 az = _mm_shuffle_ps(a->_m, a->_m, _MM_SHUFFLE(2,2,2,2));
+    __m128 bx = _mm_xor_ps(_mm_shuffle_ps(bv, bv, _MM_SHUFFLE(0,1,2,3)), _mm_set_ps(-0.f, 0.f, -0.f, 0.f));
+    __m128 by = _mm_xor_ps(_mm_shuffle_ps(bv, bv, _MM_SHUFFLE(1,0,3,2)), _mm_set_ps(-0.f, -0.f, 0.f, 0.f));
+    __m128 bz = _mm_xor_ps(_mm_shuffle_ps(bv, bv, _MM_SHUFFLE(2,3,0,1)), _mm_set_ps(-0.f, 0.f, 0.f, -0.f));
+    __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bv), _mm_mul_ps(ax, bx)), _mm_add_ps(_mm_mul_ps(ay, by), _mm_mul_ps(az, bz)));
+    return (quatv_t){ r };
+}
+
+quatv_t quatv_normalize(const quatv_t *q) {
+    return (quatv_t){ agl__normalize_ps(q->_m, agl__hsum_ps(_mm_mul_ps(q->_m, q->_m))) };
+}
+
+vec3v_t quatv_apply(const quatv_t *q, const vec3v_t *v) {
+    // v + w * t + q.xyz x t with t = 2 * q.xyz x v
+    __m128 t = agl__cross_ps(q->_m, v->_m);
+    t = _mm_add_ps(t, t);
+    __m128 w = _mm_shuffle_ps(q->_m, q->_m, _MM_SHUFFLE(3,3,3,3));
+    __m128 r = _mm_add_ps(_mm_add_ps(v->_m, _mm_mul_ps(w, t)), agl__cross_ps(q->_m, t));
+    return (vec3v_t){ _mm_and_ps(r, agl__xyz_mask_ps()) };
+}
+
+quatv_t quatv_from_axis_angle(const vec4v_t *axisangle) {
+    __m128 s, c;
+    agl_sincos4(_mm_mul_ps(_mm_shuffle_ps(axisangle->_m, axisangle->_m, _MM_SHUFFLE(3,3,3,3)), _mm_set1_ps(0.5f)), &s, &c);
+    __m128 q = agl__with_w_ps(_mm_mul_ps(axisangle->_m, s), c);
+    return quatv_normalize(&(quatv_t){ q });
+}
+
+vec4v_t quatv_to_axis_angle(const quatv_t *q) {
+    float w = clampf(_mm_cvtss_f32(_mm_shuffle_ps(q->_m, q->_m, _MM_SHUFFLE(3,3,3,3))), -1.f, 1.f);
+    float s = sqrtf(1.f - w * w);
+    __m128 axis = s > 1e-6f ? _mm_div_ps(q->_m, _mm_set1_ps(s)) : _mm_set_ps(0.f, 0.f, 0.f, 1.f);
+    return (vec4v_t){ agl__with_w_ps(axis, _mm_set1_ps(2.f * acosf(w))) };
+}
+
+mat4v_t mat4v_load(const mat4f_t *f) {
+    return (mat4v_t){ { _mm_loadu_ps(f->_m[0]), _mm_loadu_ps(f->_m[1]), _mm_loadu_ps(f->_m[2]), _mm_loadu_ps(f->_m[3]) } };
+}
+
+void mat4v_store(const mat4v_t *v, mat4f_t *f) {
+    for (int c = 0; c < 4; c++)
+        _mm_storeu_ps(f->_m[c], v->_m[c]);
+}
+
+mat4v_t mat4v_transpose(const mat4v_t *m) {
+    mat4v_t r = *m;
+    _MM_TRANSPOSE4_PS(r._m[0], r._m[1], r._m[2], r._m[3]);
+    return r;
+}
+
+// Columns of m weighted by the lanes of v
+static __m128 agl__mat4_mul_ps(const __m128 m[4], __m128 v) {
+    return _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(m[0], _mm_shuffle_ps(v, v, _MM_SHUFFLE(0,0,0,0))),
+        _mm_mul_ps(m[1], _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,1,1,1)))), _mm_add_ps(
+        _mm_mul_ps(m[2], _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,2,2,2))),
+        _mm_mul_ps(m[3], _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,3,3,3)))));
+}
+
+mat4v_t mat4v_mul(const mat4v_t *a, const mat4v_t *b) {
+    mat4v_t r;
+    for (int c = 0; c < 4; c++)
+        r._m[c] = agl__mat4_mul_ps(a->_m, b->_m[c]);
+    return r;
+}
+
+vec4v_t mat4v_mulvec4v(const mat4v_t *m, const vec4v_t *v) {
+    return (vec4v_t){ agl__mat4_mul_ps(m->_m, v->_m) };
+}
+
+vec3v_t mat4v_transform_point(const mat4v_t *m, const vec3v_t *p) {
+    __m128 v = agl__with_w_ps(p->_m, _mm_set1_ps(1.f));
+    return (vec3v_t){ _mm_and_ps(agl__mat4_mul_ps(m->_m, v), agl__xyz_mask_ps()) };
+}
+
+vec3v_t mat4v_transform_vector(const mat4v_t *m, const vec3v_t *v) {
+    __m128 r = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(m->_m[0], _mm_shuffle_ps(v->_m, v->_m, _MM_SHUFFLE(0,0,0,0))),
+        _mm_mul_ps(m->_m[1], _mm_shuffle_ps(v->_m, v->_m, _MM_SHUFFLE(1,1,1,1)))),
+        _mm_mul_ps(m->_m[2], _mm_shuffle_ps(v->_m, v->_m, _MM_SHUFFLE(2,2,2,2))));
+    return (vec3v_t){ _mm_and_ps(r, agl__xyz_mask_ps()) };
+}
+
+mat4v_t mat4v_from_trs(const vec3v_t *t, const quatv_t *r, const vec3v_t *s) {
+    // With q2 = q + q, the diagonal is 1 - (yy2 + zz2, xx2 + zz2, xx2 + yy2) and the off diagonal terms are
+    // (xz2, xy2, yz2) plus or minus (wy2, wz2, wx2), shuffled into place
+    const __m128 mask = agl__xyz_mask_ps();
+    __m128 q = r->_m, q2 = _mm_add_ps(q, q);
+    __m128 sq = _mm_mul_ps(q, q2);
+    __m128 diag = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(1.f),
+        _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(3,0,0,1))), _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(3,1,2,2)));
+    __m128 a = _mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(3,1,0,0)), _mm_shuffle_ps(q2, q2, _MM_SHUFFLE(3,2,1,2)));
+    __m128 b = _mm_mul_ps(_mm_shuffle_ps(q, q, _MM_SHUFFLE(3,3,3,3)), _mm_shuffle_ps(q2, q2, _MM_SHUFFLE(3,0,2,1)));
+    __m128 sum = _mm_add_ps(a, b), diff = _mm_sub_ps(a, b);
+    __m128 c0 = _mm_shuffle_ps(_mm_shuffle_ps(diag, sum, _MM_SHUFFLE(1,1,0,0)), diff, _MM_SHUFFLE(0,0,2,0));
+    __m128 c1 = _mm_shuffle_ps(_mm_shuffle_ps(diff, diag, _MM_SHUFFLE(1,1,1,1)), sum, _MM_SHUFFLE(2,2,2,0));
+    __m128 c2 = _mm_shuffle_ps(_mm_shuffle_ps(sum, diff, _MM_SHUFFLE(2,2,0,0)), diag, _MM_SHUFFLE(2,2,2,0));
+    __m128 sv = s->_m;
+    return (mat4v_t){ {
+        _mm_and_ps(_mm_mul_ps(c0, _mm_shuffle_ps(sv, sv, _MM_SHUFFLE(0,0,0,0))), mask),
+        _mm_and_ps(_mm_mul_ps(c1, _mm_shuffle_ps(sv, sv, _MM_SHUFFLE(1,1,1,1))), mask),
+        _mm_and_ps(_mm_mul_ps(c2, _mm_shuffle_ps(sv, sv, _MM_SHUFFLE(2,2,2,2))), mask),
+        agl__with_w_ps(t->_m, _mm_set1_ps(1.f)),
+    } };
+}
+
+void mat4v_to_trs(const mat4v_t *m, vec3v_t *t, quatv_t *r, vec3v_t *s) {
+    const __m128 mask = agl__xyz_mask_ps();
+    __m128 c[3];
+    float len[3];
+    for (int k = 0; k < 3; k++) {
+        c[k] = _mm_and_ps(m->_m[k], mask);
+        len[k] = sqrtf(_mm_cvtss_f32(agl__hsum_ps(_mm_mul_ps(c[k], c[k]))));
+    }
+    if (_mm_cvtss_f32(agl__hsum_ps(_mm_mul_ps(c[0], agl__cross_ps(c[1], c[2])))) < 0.f)
+        len[0] = -len[0];
+    mat3f_t rot;
+    for (int k = 0; k < 3; k++) {
+        float col[4];
+        _mm_storeu_ps(col, _mm_div_ps(c[k], _mm_set1_ps(len[k])));
+        rot._m[k][0] = col[0];
+        rot._m[k][1] = col[1];
+        rot._m[k][2] = col[2];
+    }
+    quatf_t q;
+    quatf_frommat3f(&q, &rot);
+    t->_m = _mm_and_ps(m->_m[3], mask);
+    r->_m = _mm_loadu_ps(q._m);
+    s->_m = _mm_set_ps(0.f, len[2], len[1], len[0]);
+}
+
+// Builds the inverse from the rows r0, r1, r2 of its 3x3 part: transposes them into columns and maps the translation t through them
+static mat4v_t agl__mat4_inverse_rows(__m128 r0, __m128 r1, __m128 r2, __m128 t) {
+    __m128 r3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    __m128 p = _mm_add_ps(_mm_add_ps(
+        _mm_mul_ps(r0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0,0,0,0))),
+        _mm_mul_ps(r1, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1,1,1,1)))),
+        _mm_mul_ps(r2, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2,2,2,2))));
+    return (mat4v_t){ { r0, r1, r2, agl__with_w_ps(_mm_sub_ps(_mm_setzero_ps(), p), _mm_set1_ps(1.f)) } };
+}
+
+mat4v_t mat4v_inverse_affine(const mat4v_t *m) {
+    const __m128 mask = agl__xyz_mask_ps();
+    __m128 c0 = _mm_and_ps(m->_m[0], mask), c1 = _mm_and_ps(m->_m[1], mask), c2 = _mm_and_ps(m->_m[2], mask);
+    __m128 x12 = agl__cross_ps(c1, c2), x20 = agl__cross_ps(c2, c0), x01 = agl__cross_ps(c0, c1);
+    __m128 det = agl__hsum_ps(_mm_mul_ps(c0, x12));
+    return agl__mat4_inverse_rows(_mm_div_ps(x12, det), _mm_div_ps(x20, det), _mm_div_ps(x01, det), m->_m[3]);
+}
+
+mat4v_t mat4v_inverse_rigid(const mat4v_t *m) {
+    const __m128 mask = agl__xyz_mask_ps();
+    return agl__mat4_inverse_rows(_mm_and_ps(m->_m[0], mask), _mm_and_ps(m->_m[1], mask), _mm_and_ps(m->_m[2], mask), m->_m[3]);
+}
+
+#undef STORE_UNALIGNED_IMPL
+
+#include <string.h>
+
+// CPU dispatch
+// Every kernel has an SSE2 variant, which is also what the wider variants use for their tails. The table is filled on
+// first use by agl_cpu_set_features with the best variant of each kernel the CPU and the OS support.
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+
+static void agl__cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subleaf);
+    memcpy(regs, r, sizeof(r));
+}
+
+static uint64_t agl__xgetbv(void) {
+    return _xgetbv(0);
+}
+#else
+#include <cpuid.h>
+
+static void agl__cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+}
+
+// Not the _xgetbv intrinsic, which would need the xsave target
+static uint64_t agl__xgetbv(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+}
+#endif
+
+static uint32_t agl__cpu_detect(void) {
+    uint32_t r[4];
+    agl__cpuid(0, 0, r);
+    if (r[0] < 7)
+        return 0;
+    agl__cpuid(1, 0, r);
+    const uint32_t ecx1 = r[2];
+    // OSXSAVE and AVX, then XCR0 must show the OS saves the XMM and YMM state
+    if ((ecx1 & (1u << 27)) == 0 || (ecx1 & (1u << 28)) == 0)
+        return 0;
+    const uint64_t xcr0 = agl__xgetbv();
+    if ((xcr0 & 0x6) != 0x6)
+        return 0;
+    agl__cpuid(7, 0, r);
+    const uint32_t ebx7 = r[1];
+    uint32_t features = 0;
+    // AVX2, FMA and F16C
+    if ((ebx7 & (1u << 5)) && (ecx1 & (1u << 12)) && (ecx1 & (1u << 29)))
+        features |= AGL_CPU_FEATURE_AVX2_BIT;
+    // AVX-512 F, DQ, BW and VL, with the opmask and both halves of the ZMM state saved
+    const uint32_t avx512 = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31);
+    if ((features & AGL_CPU_FEATURE_AVX2_BIT) && (ebx7 & avx512) == avx512 && (xcr0 & 0xE6) == 0xE6)
+        features |= AGL_CPU_FEATURE_AVX512_BIT;
+    return features;
+}
+
+typedef struct agl__math_kernels_t {
+    uint32_t features;
+    void (*vec3_add)(vec3f_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count);
+    void (*vec3_scale)(vec3f_t *dst, const vec3f_t *a, float s, size_t count);
+    void (*vec3_dot)(float *dst, const vec3f_t *a, const vec3f_t *b, size_t count);
+    void (*vec3_cross)(vec3f_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count);
+    void (*vec3_normalize)(vec3f_t *dst, const vec3f_t *a, size_t count);
+    void (*quat_apply)(vec3f_t *dst, const quatf_t *q, const vec3f_t *v, size_t count);
+    void (*mat3_mulvec3)(vec3f_t *dst, const mat3f_t *m, const vec3f_t *v, size_t count);
+    void (*mat4_transform_points)(vec3f_t *dst, const mat4f_t *m, const vec3f_t *p, size_t count);
+    void (*mat4_transform_vectors)(vec3f_t *dst, const mat4f_t *m, const vec3f_t *v, size_t count);
+    void (*mat4_project_points)(vec4f_t *dst, const mat4f_t *m, const float *points, size_t count);
+    void (*vec3d_rebase)(vec3f_t *dst, const vec3d_t *p, const vec3d_t *origin, size_t count);
+    void (*vec3d_integrate)(vec3d_t *p, const vec3f_t *v, float dt, size_t count);
+    void (*mat4_rebase)(mat4f_t *dst, const mat4f_t *m, const vec3d_t *translation, const vec3d_t *origin, size_t count);
+    void (*sincos)(float *s, float *c, const float *x, size_t count);
+    void (*quat_from_axis_angle)(quatf_t *dst, const vec3f_t *axis, const float *angle, size_t count);
+    void (*quat_from_vectors)(quatf_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count);
+    void (*rng_fill_float)(agl_rng_t *rng, float *dst, size_t count, float lo, float hi);
+    void (*rng_fill_gaussian)(agl_rng_t *rng, float *dst, size_t count, float mean, float stddev);
+    void (*rng_fill_vec3)(agl_rng_t *rng, vec3f_t *dst, size_t count, int shape);
+    void (*convert_packed_f32)(float *dst, const unsigned char *src, agl_component_type_t type, bool normalized, size_t n);
+    void (*convert_packed_u32)(uint32_t *dst, const unsigned char *src, agl_component_type_t type, size_t n);
+    void (*convert_packed_from_f32)(unsigned char *dst, const float *src, agl_component_type_t type, bool normalized, size_t n);
+    void (*bounds_minmax3)(float *min, float *max, const float *points, size_t count);
+    size_t (*cull_spheres)(uint8_t *visible, const float *x, const float *y, const float *z, const float *radius, size_t count,
+        const vec4f_t *planes, int planeCount);
+    size_t (*cull_aabbs)(uint8_t *visible, const aabbf_t *boxes, size_t count, const vec4f_t *planes, int planeCount);
+    size_t (*ray_aabbs)(float *t, const rayf_t *ray, const aabbf_t *boxes, size_t count, float tmax);
+    bool (*ray_triangles)(float *t, uint32_t *triangle, const rayf_t *ray, const float *positions, const uint32_t *indices,
+        size_t triangleCount, float tmax);
+    size_t (*overlap_aabbs)(uint32_t *indices, const aabbf_t *query, const aabbf_t *boxes, size_t count);
+    size_t (*overlap_spheres)(uint32_t *indices, const spheref_t *query, const spheref_t *spheres, size_t count);
+    void (*skin_vertices)(float *dstPositions, float *dstNormals, const float *positions, const float *normals,
+        const float *joints, const float *weights, const float *palette, size_t jointCount, size_t count);
+} agl__math_kernels_t;
+
+// The table is published through agl__kernels_state: the first caller claims it, fills it and release-stores READY,
+// concurrent first callers spin until then, and every dispatch acquire-loads the state before reading the table
+enum { AGL__KERNELS_EMPTY, AGL__KERNELS_FILLING, AGL__KERNELS_READY };
+
+static agl__math_kernels_t agl__kernels;
+static volatile uint32_t agl__kernels_state;
+
+#if defined(_MSC_VER)
+// x86 does not reorder loads with loads or stores with stores, so only the compiler needs fencing
+static uint32_t agl__load_acquire(volatile uint32_t *p) {
+    uint32_t v = *p;
+    _ReadWriteBarrier();
+    return v;
+}
+
+static void agl__store_release(volatile uint32_t *p, uint32_t v) {
+    _ReadWriteBarrier();
+    *p = v;
+}
+
+static bool agl__compare_exchange(volatile uint32_t *p, uint32_t expected, uint32_t desired) {
+    return (uint32_t)_InterlockedCompareExchange((volatile long*)p, (long)desired, (long)expected) == expected;
+}
+#else
+static uint32_t agl__load_acquire(volatile uint32_t *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void agl__store_release(volatile uint32_t *p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static bool agl__compare_exchange(volatile uint32_t *p, uint32_t expected, uint32_t desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#endif
+
+static void agl__math_init_kernels(void) {
+    if (agl__compare_exchange(&agl__kernels_state, AGL__KERNELS_EMPTY, AGL__KERNELS_FILLING)) {
+        agl_cpu_set_features(~0u);
+        return;
+    }
+    while (agl__load_acquire(&agl__kernels_state) != AGL__KERNELS_READY)
+        _mm_pause();
+}
+
+static const agl__math_kernels_t *agl__math_dispatch(void) {
+    if (agl__load_acquire(&agl__kernels_state) != AGL__KERNELS_READY)
+        agl__math_init_kernels();
+    return &agl__kernels;
+}
+
+static uint32_t agl__popcount(uint32_t v) {
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    return (((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+// The array kernels below keep one vec3f_t per register for SSE2, the padding lane is cleared on store like vec3x8_store
+static void agl__vec3_add_sse2(vec3f_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    const __m128 mask = agl__xyz_mask_ps();
+    for (size_t i = 0; i < count; i++)
+        _mm_storeu_ps(dst[i]._m, _mm_and_ps(_mm_add_ps(_mm_loadu_ps(a[i]._m), _mm_loadu_ps(b[i]._m)), mask));
+}
+
+static AGL_TARGET_AVX2 void agl__vec3_add_avx2(vec3f_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t va = vec3x8_load(a + i), vb = vec3x8_load(b + i);
+        vec3x8_t r = vec3x8_add(&va, &vb);
+        vec3x8_store(dst + i, &r);
+    }
+    agl__vec3_add_sse2(dst + i, a + i, b + i, count - i);
+}
+
+void agl_vec3_add(vec3f_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    agl__math_dispatch()->vec3_add(dst, a, b, count);
+}
+
+static void agl__vec3_scale_sse2(vec3f_t *dst, const vec3f_t *a, float s, size_t count) {
+    const __m128 scale = _mm_and_ps(_mm_set1_ps(s), agl__xyz_mask_ps());
+    for (size_t i = 0; i < count; i++)
+        _mm_storeu_ps(dst[i]._m, _mm_mul_ps(_mm_loadu_ps(a[i]._m), scale));
+}
+
+static AGL_TARGET_AVX2 void agl__vec3_scale_avx2(vec3f_t *dst, const vec3f_t *a, float s, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t va = vec3x8_load(a + i);
+        vec3x8_t r = vec3x8_scale(&va, _mm256_set1_ps(s));
+        vec3x8_store(dst + i, &r);
+    }
+    agl__vec3_scale_sse2(dst + i, a + i, s, count - i);
+}
+
+void agl_vec3_scale(vec3f_t *dst, const vec3f_t *a, float s, size_t count) {
+    agl__math_dispatch()->vec3_scale(dst, a, s, count);
+}
+
+static void agl__vec3_dot_sse2(float *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    const __m128 mask = agl__xyz_mask_ps();
+    for (size_t i = 0; i < count; i++)
+        dst[i] = _mm_cvtss_f32(agl__hsum_ps(_mm_and_ps(_mm_mul_ps(_mm_loadu_ps(a[i]._m), _mm_loadu_ps(b[i]._m)), mask)));
+}
+
+static AGL_TARGET_AVX2 void agl__vec3_dot_avx2(float *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t va = vec3x8_load(a + i), vb = vec3x8_load(b + i);
+        _mm256_storeu_ps(dst + i, vec3x8_dot(&va, &vb));
+    }
+    agl__vec3_dot_sse2(dst + i, a + i, b + i, count - i);
+}
+
+void agl_vec3_dot(float *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    agl__math_dispatch()->vec3_dot(dst, a, b, count);
+}
+
+static void agl__vec3_cross_sse2(vec3f_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    const __m128 mask = agl__xyz_mask_ps();
+    for (size_t i = 0; i < count; i++)
+        _mm_storeu_ps(dst[i]._m, _mm_and_ps(agl__cross_ps(_mm_loadu_ps(a[i]._m), _mm_loadu_ps(b[i]._m)), mask));
+}
+
+static AGL_TARGET_AVX2 void agl__vec3_cross_avx2(vec3f_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t va = vec3x8_load(a + i), vb = vec3x8_load(b + i);
+        vec3x8_t r = vec3x8_cross(&va, &vb);
+        vec3x8_store(dst + i, &r);
+    }
+    agl__vec3_cross_sse2(dst + i, a + i, b + i, count - i);
+}
+
+void agl_vec3_cross(vec3f_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    agl__math_dispatch()->vec3_cross(dst, a, b, count);
+}
+
+// Exact square root and division, like vec3f_normalize
+static void agl__vec3_normalize_sse2(vec3f_t *dst, const vec3f_t *a, size_t count) {
+    const __m128 mask = agl__xyz_mask_ps();
+    for (size_t i = 0; i < count; i++) {
+        __m128 v = _mm_and_ps(_mm_loadu_ps(a[i]._m), mask);
+        __m128 len = _mm_sqrt_ps(agl__hsum_ps(_mm_mul_ps(v, v)));
+        _mm_storeu_ps(dst[i]._m, _mm_div_ps(v, len));
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__vec3_normalize_avx2(vec3f_t *dst, const vec3f_t *a, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t va = vec3x8_load(a + i);
+        vec3x8_t r = vec3x8_normalize(&va);
+        vec3x8_store(dst + i, &r);
+    }
+    agl__vec3_normalize_sse2(dst + i, a + i, count - i);
+}
+
+void agl_vec3_normalize(vec3f_t *dst, const vec3f_t *a, size_t count) {
+    agl__math_dispatch()->vec3_normalize(dst, a, count);
+}
+
+static void agl__quat_apply_sse2(vec3f_t *dst, const quatf_t *q, const vec3f_t *v, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        quatv_t vq = { _mm_loadu_ps(q[i]._m) };
+        vec3v_t vv = { _mm_loadu_ps(v[i]._m) };
+        _mm_storeu_ps(dst[i]._m, quatv_apply(&vq, &vv)._m);
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__quat_apply_avx2(vec3f_t *dst, const quatf_t *q, const vec3f_t *v, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        quatx8_t vq = quatx8_load(q + i);
+        vec3x8_t vv = vec3x8_load(v + i);
+        vec3x8_t r = quatx8_apply(&vq, &vv);
+        vec3x8_store(dst + i, &r);
+    }
+    agl__quat_apply_sse2(dst + i, q + i, v + i, count - i);
+}
+
+void agl_quat_apply(vec3f_t *dst, const quatf_t *q, const vec3f_t *v, size_t count) {
+    agl__math_dispatch()->quat_apply(dst, q, v, count);
+}
+
+static void agl__mat3_mulvec3_sse2(vec3f_t *dst, const mat3f_t *m, const vec3f_t *v, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        vec3v_t vv = { _mm_loadu_ps(v[i]._m) };
+        _mm_storeu_ps(dst[i]._m, mat3f_mulvec3v(m, &vv)._m);
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__mat3_mulvec3_avx2(vec3f_t *dst, const mat3f_t *m, const vec3f_t *v, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t vv = vec3x8_load(v + i);
+        vec3x8_t r = mat3f_mulvec3x8(m, &vv);
+        vec3x8_store(dst + i, &r);
+    }
+    agl__mat3_mulvec3_sse2(dst + i, m, v + i, count - i);
+}
+
+void agl_mat3_mulvec3(vec3f_t *dst, const mat3f_t *m, const vec3f_t *v, size_t count) {
+    agl__math_dispatch()->mat3_mulvec3(dst, m, v, count);
+}
+
+static void agl__mat4_transform_points_sse2(vec3f_t *dst, const mat4f_t *m, const vec3f_t *p, size_t count) {
+    mat4v_t vm = mat4v_load(m);
+    for (size_t i = 0; i < count; i++) {
+        vec3v_t vp = { _mm_loadu_ps(p[i]._m) };
+        _mm_storeu_ps(dst[i]._m, mat4v_transform_point(&vm, &vp)._m);
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__mat4_transform_points_avx2(vec3f_t *dst, const mat4f_t *m, const vec3f_t *p, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t vp = vec3x8_load(p + i);
+        vec3x8_t r = mat4f_mulpoint3x8(m, &vp);
+        vec3x8_store(dst + i, &r);
+    }
+    agl__mat4_transform_points_sse2(dst + i, m, p + i, count - i);
+}
+
+void agl_mat4_transform_points(vec3f_t *dst, const mat4f_t *m, const vec3f_t *p, size_t count) {
+    agl__math_dispatch()->mat4_transform_points(dst, m, p, count);
+}
+
+static void agl__mat4_transform_vectors_sse2(vec3f_t *dst, const mat4f_t *m, const vec3f_t *v, size_t count) {
+    mat4v_t vm = mat4v_load(m);
+    for (size_t i = 0; i < count; i++) {
+        vec3v_t vv = { _mm_loadu_ps(v[i]._m) };
+        _mm_storeu_ps(dst[i]._m, mat4v_transform_vector(&vm, &vv)._m);
+    }
+}
+
+// mat3f_mulvec3x8 takes the 3x3 part as a mat3f_t
+static AGL_TARGET_AVX2 void agl__mat4_transform_vectors_avx2(vec3f_t *dst, const mat4f_t *m, const vec3f_t *v, size_t count) {
+    mat3f_t rot;
+    for (int c = 0; c < 3; c++)
+        memcpy(rot._m[c], m->_m[c], sizeof(rot._m[c]));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t vv = vec3x8_load(v + i);
+        vec3x8_t r = mat3f_mulvec3x8(&rot, &vv);
+        vec3x8_store(dst + i, &r);
+    }
+    agl__mat4_transform_vectors_sse2(dst + i, m, v + i, count - i);
+}
+
+void agl_mat4_transform_vectors(vec3f_t *dst, const mat4f_t *m, const vec3f_t *v, size_t count) {
+    agl__math_dispatch()->mat4_transform_vectors(dst, m, v, count);
+}
+
+static void agl__mat4_project_points_sse2(vec4f_t *dst, const mat4f_t *m, const float *points, size_t count) {
+    mat4v_t vm = mat4v_load(m);
+    for (size_t i = 0; i < count; i++) {
+        const float *p = points + 3 * i;
+        _mm_storeu_ps(dst[i]._m, agl__mat4_mul_ps(vm._m, _mm_set_ps(1.f, p[2], p[1], p[0])));
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__mat4_project_points_avx2(vec4f_t *dst, const mat4f_t *m, const float *points, size_t count) {
+    size_t i = 0;
+    // The packed load reads 24 floats ahead
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t p = vec3x8_load_packed(points + 3 * i);
+        __m256 r[4];
+        for (int k = 0; k < 4; k++) {
+            r[k] = _mm256_fmadd_ps(_mm256_set1_ps(m->_m[0][k]), p.x, _mm256_fmadd_ps(_mm256_set1_ps(m->_m[1][k]), p.y,
+                _mm256_fmadd_ps(_mm256_set1_ps(m->_m[2][k]), p.z, _mm256_set1_ps(m->_m[3][k]))));
+        }
+        agl__untranspose8x4(dst[i]._m, r[0], r[1], r[2], r[3]);
+    }
+    agl__mat4_project_points_sse2(dst + i, m, points + 3 * i, count - i);
+}
+
+void agl_mat4_project_points(vec4f_t *dst, const mat4f_t *m, const float *points, size_t count) {
+    agl__math_dispatch()->mat4_project_points(dst, m, points, count);
+}
+
+// The double kernels take one vec3d_t per iteration, in two SSE2 registers or one AVX register, so they have no tails
+static void agl__vec3d_rebase_sse2(vec3f_t *dst, const vec3d_t *p, const vec3d_t *origin, size_t count) {
+    const __m128d oxy = _mm_loadu_pd(origin->_m), oz = _mm_load_sd(&origin->_m[2]);
+    for (size_t i = 0; i < count; i++) {
+        __m128 xy = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(p[i]._m), oxy));
+        __m128 z = _mm_cvtpd_ps(_mm_sub_sd(_mm_load_sd(&p[i]._m[2]), oz));
+        _mm_storeu_ps(dst[i]._m, _mm_movelh_ps(xy, z));
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__vec3d_rebase_avx2(vec3f_t *dst, const vec3d_t *p, const vec3d_t *origin, size_t count) {
+    const __m256d o = _mm256_loadu_pd(origin->_m);
+    const __m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    for (size_t i = 0; i < count; i++)
+        _mm_storeu_ps(dst[i]._m, _mm_and_ps(_mm256_cvtpd_ps(_mm256_sub_pd(_mm256_loadu_pd(p[i]._m), o)), xyz));
+}
+
+void agl_vec3d_rebase(vec3f_t *dst, const vec3d_t *p, const vec3d_t *origin, size_t count) {
+    agl__math_dispatch()->vec3d_rebase(dst, p, origin, count);
+}
+
+// float * float is exact in double, so the FMA of the AVX2 variant gives the same result
+static void agl__vec3d_integrate_sse2(vec3d_t *p, const vec3f_t *v, float dt, size_t count) {
+    const __m128d step = _mm_set1_pd(dt), stepz = _mm_set_sd(dt);
+    for (size_t i = 0; i < count; i++) {
+        __m128 vf = _mm_loadu_ps(v[i]._m);
+        __m128d xy = _mm_mul_pd(_mm_cvtps_pd(vf), step), z = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(vf, vf)), stepz);
+        _mm_storeu_pd(p[i]._m, _mm_add_pd(_mm_loadu_pd(p[i]._m), xy));
+        _mm_storeu_pd(p[i]._m + 2, _mm_add_pd(_mm_loadu_pd(p[i]._m + 2), z));
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__vec3d_integrate_avx2(vec3d_t *p, const vec3f_t *v, float dt, size_t count) {
+    const __m256d step = _mm256_set_pd(0.0, dt, dt, dt);
+    for (size_t i = 0; i < count; i++) {
+        __m256d d = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(v[i]._m)), step, _mm256_loadu_pd(p[i]._m));
+        _mm256_storeu_pd(p[i]._m, d);
+    }
+}
+
+void agl_vec3d_integrate(vec3d_t *p, const vec3f_t *v, float dt, size_t count) {
+    agl__math_dispatch()->vec3d_integrate(p, v, dt, count);
+}
+
+static void agl__mat4_rebase_sse2(mat4f_t *dst, const mat4f_t *m, const vec3d_t *translation, const vec3d_t *origin, size_t count) {
+    const __m128d oxy = _mm_loadu_pd(origin->_m), oz = _mm_load_sd(&origin->_m[2]), one = _mm_set1_pd(1.0);
+    for (size_t i = 0; i < count; i++) {
+        __m128 c0 = _mm_loadu_ps(m[i]._m[0]), c1 = _mm_loadu_ps(m[i]._m[1]), c2 = _mm_loadu_ps(m[i]._m[2]);
+        __m128 xy = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(translation[i]._m), oxy));
+        __m128 zw = _mm_cvtpd_ps(_mm_sub_sd(_mm_loadl_pd(one, &translation[i]._m[2]), oz));
+        _mm_storeu_ps(dst[i]._m[0], c0);
+        _mm_storeu_ps(dst[i]._m[1], c1);
+        _mm_storeu_ps(dst[i]._m[2], c2);
+        _mm_storeu_ps(dst[i]._m[3], _mm_movelh_ps(xy, zw));
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__mat4_rebase_avx2(mat4f_t *dst, const mat4f_t *m, const vec3d_t *translation, const vec3d_t *origin, size_t count) {
+    const __m256d o = _mm256_loadu_pd(origin->_m), one = _mm256_set1_pd(1.0);
+    for (size_t i = 0; i < count; i++) {
+        __m256 c01 = _mm256_loadu_ps(m[i]._m[0]);
+        __m128 c2 = _mm_loadu_ps(m[i]._m[2]);
+        __m256d t = _mm256_blend_pd(_mm256_sub_pd(_mm256_loadu_pd(translation[i]._m), o), one, 0x8);
+        _mm256_storeu_ps(dst[i]._m[0], c01);
+        _mm256_storeu_ps(dst[i]._m[2], _mm256_insertf128_ps(_mm256_castps128_ps256(c2), _mm256_cvtpd_ps(t), 1));
+    }
+}
+
+void agl_mat4_rebase(mat4f_t *dst, const mat4f_t *m, const vec3d_t *translation, const vec3d_t *origin, size_t count) {
+    agl__math_dispatch()->mat4_rebase(dst, m, translation, origin, count);
+}
+
+static void agl__sincos_sse2(float *s, float *c, const float *x, size_t count) {
+    size_t i = 0;
+    __m128 vs, vc;
+    for (; i + 4 <= count; i += 4) {
+        agl_sincos4(_mm_loadu_ps(x + i), &vs, &vc);
+        _mm_storeu_ps(s + i, vs);
+        _mm_storeu_ps(c + i, vc);
+    }
+    if (i < count) {
+        float in[4] = { 0.f }, outs[4], outc[4];
+        memcpy(in, x + i, (count - i) * sizeof(float));
+        agl_sincos4(_mm_loadu_ps(in), &vs, &vc);
+        _mm_storeu_ps(outs, vs);
+        _mm_storeu_ps(outc, vc);
+        memcpy(s + i, outs, (count - i) * sizeof(float));
+        memcpy(c + i, outc, (count - i) * sizeof(float));
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__sincos_avx2(float *s, float *c, const float *x, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 vs, vc;
+        agl_sincos8(_mm256_loadu_ps(x + i), &vs, &vc);
+        _mm256_storeu_ps(s + i, vs);
+        _mm256_storeu_ps(c + i, vc);
+    }
+    agl__sincos_sse2(s + i, c + i, x + i, count - i);
+}
+
+void agl_sincos(float *s, float *c, const float *x, size_t count) {
+    agl__math_dispatch()->sincos(s, c, x, count);
+}
+
+// The quaternion builders work on 4 elements transposed into x, y, z (and w) registers, a short tail is padded with 0
+static void agl__load_vec3x4(__m128 v[3], const vec3f_t *p, size_t n) {
+    __m128 r[4];
+    for (size_t k = 0; k < 4; k++)
+        r[k] = k < n ? _mm_loadu_ps(p[k]._m) : _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+    v[0] = r[0];
+    v[1] = r[1];
+    v[2] = r[2];
+}
+
+static void agl__store_quatx4(quatf_t *q, const __m128 v[4], size_t n) {
+    __m128 r0 = v[0], r1 = v[1], r2 = v[2], r3 = v[3];
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    __m128 r[4] = { r0, r1, r2, r3 };
+    for (size_t k = 0; k < n; k++)
+        _mm_storeu_ps(q[k]._m, r[k]);
+}
+
+// (sin(angle / 2) * axis, cos(angle / 2)) normalised, like quatf_fromaxisangle
+static void agl__quat_from_axis_angle4(__m128 q[4], const __m128 axis[3], __m128 angle) {
+    __m128 s, c;
+    agl_sincos4(_mm_mul_ps(angle, _mm_set1_ps(0.5f)), &s, &c);
+    q[0] = _mm_mul_ps(axis[0], s);
+    q[1] = _mm_mul_ps(axis[1], s);
+    q[2] = _mm_mul_ps(axis[2], s);
+    q[3] = c;
+    __m128 r = agl_rsqrt4(_mm_add_ps(_mm_add_ps(_mm_mul_ps(q[0], q[0]), _mm_mul_ps(q[1], q[1])),
+        _mm_add_ps(_mm_mul_ps(q[2], q[2]), _mm_mul_ps(q[3], q[3]))));
+    for (int k = 0; k < 4; k++)
+        q[k] = _mm_mul_ps(q[k], r);
+}
+
+static AGL_TARGET_AVX2 void agl__quat_from_axis_angle8(quatx8_t *q, const vec3x8_t *axis, __m256 angle) {
+    __m256 s, c;
+    agl_sincos8(_mm256_mul_ps(angle, _mm256_set1_ps(0.5f)), &s, &c);
+    vec3x8_t v = vec3x8_scale(axis, s);
+    __m256 r = agl_rsqrt8(_mm256_fmadd_ps(c, c, vec3x8_dot(&v, &v)));
+    *q = (quatx8_t){ _mm256_mul_ps(v.x, r), _mm256_mul_ps(v.y, r), _mm256_mul_ps(v.z, r), _mm256_mul_ps(c, r) };
+}
+
+static void agl__quat_from_axis_angle_sse2(quatf_t *dst, const vec3f_t *axis, const float *angle, size_t count) {
+    for (size_t i = 0; i < count; i += 4) {
+        size_t n = count - i < 4 ? count - i : 4;
+        float a[4] = { 0.f };
+        memcpy(a, angle + i, n * sizeof(float));
+        __m128 v[3], q[4];
+        agl__load_vec3x4(v, axis + i, n);
+        agl__quat_from_axis_angle4(q, v, _mm_loadu_ps(a));
+        agl__store_quatx4(dst + i, q, n);
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__quat_from_axis_angle_avx2(quatf_t *dst, const vec3f_t *axis, const float *angle, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t v = vec3x8_load(axis + i);
+        quatx8_t q;
+        agl__quat_from_axis_angle8(&q, &v, _mm256_loadu_ps(angle + i));
+        quatx8_store(dst + i, &q);
+    }
+    agl__quat_from_axis_angle_sse2(dst + i, axis + i, angle + i, count - i);
+}
+
+void agl_quat_from_axis_angle(quatf_t *dst, const vec3f_t *axis, const float *angle, size_t count) {
+    agl__math_dispatch()->quat_from_axis_angle(dst, axis, angle, count);
+}
+
+// The axis and angle of quatf_fromvectors. Opposite vectors have no cross product and turn about u x z instead, or
+// u x x when u is along z; parallel ones end up with a zero axis and angle, the identity.
+static void agl__quat_from_vectors4(__m128 q[4], const __m128 a[3], const __m128 b[3]) {
+    __m128 ra = agl_rsqrt4(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], a[0]), _mm_mul_ps(a[1], a[1])), _mm_mul_ps(a[2], a[2])));
+    __m128 rb = agl_rsqrt4(_mm_add_ps(_mm_add_ps(_mm_mul_ps(b[0], b[0]), _mm_mul_ps(b[1], b[1])), _mm_mul_ps(b[2], b[2])));
+    __m128 u[3] = { _mm_mul_ps(a[0], ra), _mm_mul_ps(a[1], ra), _mm_mul_ps(a[2], ra) };
+    __m128 v[3] = { _mm_mul_ps(b[0], rb), _mm_mul_ps(b[1], rb), _mm_mul_ps(b[2], rb) };
+    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u[0], v[0]), _mm_mul_ps(u[1], v[1])), _mm_mul_ps(u[2], v[2]));
+    __m128 axis[3] = {
+        _mm_sub_ps(_mm_mul_ps(u[1], v[2]), _mm_mul_ps(u[2], v[1])),
+        _mm_sub_ps(_mm_mul_ps(u[2], v[0]), _mm_mul_ps(u[0], v[2])),
+        _mm_sub_ps(_mm_mul_ps(u[0], v[1]), _mm_mul_ps(u[1], v[0])),
+    };
+    __m128 opposite = _mm_cmplt_ps(d, _mm_set1_ps(-1.f + 1e-6f));
+    __m128 alongz = _mm_cmpgt_ps(u[2], _mm_set1_ps(1.f - FLT_EPSILON));
+    __m128 perp[3] = {
+        _mm_andnot_ps(alongz, u[1]),
+        _mm_or_ps(_mm_and_ps(alongz, u[2]), _mm_andnot_ps(alongz, _mm_sub_ps(_mm_setzero_ps(), u[0]))),
+        _mm_and_ps(alongz, _mm_sub_ps(_mm_setzero_ps(), u[1])),
+    };
+    for (int k = 0; k < 3; k++)
+        axis[k] = _mm_or_ps(_mm_and_ps(opposite, perp[k]), _mm_andnot_ps(opposite, axis[k]));
+    __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(axis[0], axis[0]), _mm_mul_ps(axis[1], axis[1])), _mm_mul_ps(axis[2], axis[2]));
+    __m128 r = _mm_and_ps(_mm_cmpgt_ps(len2, _mm_set1_ps(1e-30f)), agl_rsqrt4(len2));
+    for (int k = 0; k < 3; k++)
+        axis[k] = _mm_mul_ps(axis[k], r);
+    d = _mm_min_ps(_mm_max_ps(d, _mm_set1_ps(-1.f)), _mm_set1_ps(1.f));
+    agl__quat_from_axis_angle4(q, axis, agl_acos4(d));
+}
+
+static AGL_TARGET_AVX2 void agl__quat_from_vectors8(quatx8_t *q, const vec3x8_t *a, const vec3x8_t *b) {
+    __m256 ra = agl_rsqrt8(vec3x8_dot(a, a)), rb = agl_rsqrt8(vec3x8_dot(b, b));
+    vec3x8_t u = vec3x8_scale(a, ra), v = vec3x8_scale(b, rb);
+    __m256 d = vec3x8_dot(&u, &v);
+    vec3x8_t axis = vec3x8_cross(&u, &v);
+    __m256 opposite = _mm256_cmp_ps(d, _mm256_set1_ps(-1.f + 1e-6f), _CMP_LT_OQ);
+    __m256 alongz = _mm256_cmp_ps(u.z, _mm256_set1_ps(1.f - FLT_EPSILON), _CMP_GT_OQ);
+    __m256 zero = _mm256_setzero_ps();
+    vec3x8_t perp = {
+        _mm256_blendv_ps(u.y, zero, alongz),
+        _mm256_blendv_ps(_mm256_sub_ps(zero, u.x), u.z, alongz),
+        _mm256_blendv_ps(zero, _mm256_sub_ps(zero, u.y), alongz),
+    };
+    axis.x = _mm256_blendv_ps(axis.x, perp.x, opposite);
+    axis.y = _mm256_blendv_ps(axis.y, perp.y, opposite);
+    axis.z = _mm256_blendv_ps(axis.z, perp.z, opposite);
+    __m256 len2 = vec3x8_dot(&axis, &axis);
+    axis = vec3x8_scale(&axis, _mm256_and_ps(_mm256_cmp_ps(len2, _mm256_set1_ps(1e-30f), _CMP_GT_OQ), agl_rsqrt8(len2)));
+    d = _mm256_min_ps(_mm256_max_ps(d, _mm256_set1_ps(-1.f)), _mm256_set1_ps(1.f));
+    agl__quat_from_axis_angle8(q, &axis, agl_acos8(d));
+}
+
+static void agl__quat_from_vectors_sse2(quatf_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    for (size_t i = 0; i < count; i += 4) {
+        size_t n = count - i < 4 ? count - i : 4;
+        __m128 va[3], vb[3], q[4];
+        agl__load_vec3x4(va, a + i, n);
+        agl__load_vec3x4(vb, b + i, n);
+        agl__quat_from_vectors4(q, va, vb);
+        agl__store_quatx4(dst + i, q, n);
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__quat_from_vectors_avx2(quatf_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        vec3x8_t va = vec3x8_load(a + i), vb = vec3x8_load(b + i);
+        quatx8_t q;
+        agl__quat_from_vectors8(&q, &va, &vb);
+        quatx8_store(dst + i, &q);
+    }
+    agl__quat_from_vectors_sse2(dst + i, a + i, b + i, count - i);
+}
+
+void agl_quat_from_vectors(quatf_t *dst, const vec3f_t *a, const vec3f_t *b, size_t count) {
+    agl__math_dispatch()->quat_from_vectors(dst, a, b, count);
+}
+
+// Random numbers
+
+#if defined(_MSC_VER)
+#define AGL__THREAD_LOCAL __declspec(thread)
+#elif defined(__cplusplus)
+#define AGL__THREAD_LOCAL thread_local
+#else
+#define AGL__THREAD_LOCAL _Thread_local
+#endif
+
+void agl_rng_seed(agl_rng_t *rng, uint64_t seed) {
+    // splitmix64, two state words per output
+    for (int k = 0; k < 8; k++) {
+        for (int j = 0; j < 4; j += 2) {
+            uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            z ^= z >> 31;
+            rng->s[j][k] = (uint32_t)z;
+            rng->s[j + 1][k] = (uint32_t)(z >> 32);
+        }
+    }
+}
+
+static volatile uint32_t agl__rng_threads;
+
+agl_rng_t *agl_rng_thread(void) {
+    static AGL__THREAD_LOCAL agl_rng_t rng;
+    static AGL__THREAD_LOCAL bool seeded;
+    if (!seeded) {
+#if defined(_MSC_VER)
+        uint32_t index = (uint32_t)_InterlockedIncrement((volatile long*)&agl__rng_threads) - 1;
+#else
+        uint32_t index = __atomic_fetch_add(&agl__rng_threads, 1, __ATOMIC_RELAXED);
+#endif
+        agl_rng_seed(&rng, index);
+        seeded = true;
+    }
+    return &rng;
+}
+
+// The SSE2 fills run the two halves of the streams one after the other, the element layout is the same as for 8 lanes
+static void agl__rng_load4(__m128i s[4], const agl_rng_t *rng, int half) {
+    for (int j = 0; j < 4; j++)
+        s[j] = _mm_loadu_si128((const __m128i*)&rng->s[j][4 * half]);
+}
+
+static void agl__rng_store4(agl_rng_t *rng, const __m128i s[4], int half) {
+    for (int j = 0; j < 4; j++)
+        _mm_storeu_si128((__m128i*)&rng->s[j][4 * half], s[j]);
+}
+
+// One xoshiro128+ step of 4 streams, the top 24 bits of s0 + s3 as floats in [0, 1)
+static __m128 agl__rng_next4(__m128i s[4]) {
+    __m128i r = _mm_add_epi32(s[0], s[3]);
+    __m128i t = _mm_slli_epi32(s[1], 9);
+    s[2] = _mm_xor_si128(s[2], s[0]);
+    s[3] = _mm_xor_si128(s[3], s[1]);
+    s[1] = _mm_xor_si128(s[1], s[2]);
+    s[0] = _mm_xor_si128(s[0], s[3]);
+    s[2] = _mm_xor_si128(s[2], t);
+    s[3] = _mm_or_si128(_mm_slli_epi32(s[3], 11), _mm_srli_epi32(s[3], 21));
+    return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(r, 8)), _mm_set1_ps(1.f / 16777216.f));
+}
+
+static AGL_TARGET_AVX2 __m256 agl__rng_next8(__m256i s[4]) {
+    __m256i r = _mm256_add_epi32(s[0], s[3]);
+    __m256i t = _mm256_slli_epi32(s[1], 9);
+    s[2] = _mm256_xor_si256(s[2], s[0]);
+    s[3] = _mm256_xor_si256(s[3], s[1]);
+    s[1] = _mm256_xor_si256(s[1], s[2]);
+    s[0] = _mm256_xor_si256(s[0], s[3]);
+    s[2] = _mm256_xor_si256(s[2], t);
+    s[3] = _mm256_or_si256(_mm256_slli_epi32(s[3], 11), _mm256_srli_epi32(s[3], 21));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(r, 8)), _mm256_set1_ps(1.f / 16777216.f));
+}
+
+// Stores the lanes of v that fall before `end`
+static void agl__store_ps_until(float *dst, size_t i, size_t end, __m128 v) {
+    if (i + 4 <= end) {
+        _mm_storeu_ps(dst + i, v);
+    } else if (i < end) {
+        float tmp[4];
+        _mm_storeu_ps(tmp, v);
+        memcpy(dst + i, tmp, (end - i) * sizeof(float));
+    }
+}
+
+static void agl__store_vec3_until(vec3f_t *dst, size_t i, size_t end, __m128 x, __m128 y, __m128 z) {
+    __m128 w = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    __m128 r[4] = { x, y, z, w };
+    for (size_t k = 0; k < 4 && i + k < end; k++)
+        _mm_storeu_ps(dst[i + k]._m, r[k]);
+}
+
+static void agl__rng_fill_float_sse2(agl_rng_t *rng, float *dst, size_t count, float lo, float hi) {
+    const __m128 scale = _mm_set1_ps(hi - lo), offset = _mm_set1_ps(lo);
+    for (int h = 0; h < 2; h++) {
+        __m128i s[4];
+        agl__rng_load4(s, rng, h);
+        for (size_t b = 0; b < (count + 7) / 8; b++)
+            agl__store_ps_until(dst, 8 * b + 4 * h, count, _mm_add_ps(_mm_mul_ps(agl__rng_next4(s), scale), offset));
+        agl__rng_store4(rng, s, h);
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__rng_fill_float_avx2(agl_rng_t *rng, float *dst, size_t count, float lo, float hi) {
+    const __m256 scale = _mm256_set1_ps(hi - lo), offset = _mm256_set1_ps(lo);
+    __m256i s[4];
+    for (int j = 0; j < 4; j++)
+        s[j] = _mm256_loadu_si256((const __m256i*)rng->s[j]);
+    for (size_t i = 0; i < count; i += 8) {
+        __m256 v = _mm256_fmadd_ps(agl__rng_next8(s), scale, offset);
+        if (i + 8 <= count) {
+            _mm256_storeu_ps(dst + i, v);
+        } else {
+            float tmp[8];
+            _mm256_storeu_ps(tmp, v);
+            memcpy(dst + i, tmp, (count - i) * sizeof(float));
+        }
+    }
+    for (int j = 0; j < 4; j++)
+        _mm256_storeu_si256((__m256i*)rng->s[j], s[j]);
+}
+
+void agl_rng_fill_float(agl_rng_t *rng, float *dst, size_t count, float lo, float hi) {
+    agl__math_dispatch()->rng_fill_float(rng, dst, count, lo, hi);
+}
+
+// Box-Muller: sqrt(-2 log u1) times the cos and sin of 2 pi u2, with u1 in (0, 1]. Each step fills the cos results of
+// a block of 16 and then the sin results.
+static void agl__rng_fill_gaussian_sse2(agl_rng_t *rng, float *dst, size_t count, float mean, float stddev) {
+    const __m128 m = _mm_set1_ps(mean), sd = _mm_set1_ps(stddev);
+    for (int h = 0; h < 2; h++) {
+        __m128i s[4];
+        agl__rng_load4(s, rng, h);
+        for (size_t b = 0; b < (count + 15) / 16; b++) {
+            __m128 u1 = _mm_sub_ps(_mm_set1_ps(1.f), agl__rng_next4(s)), u2 = agl__rng_next4(s);
+            __m128 r = _mm_mul_ps(_mm_sqrt_ps(_mm_mul_ps(_mm_set1_ps(-2.f), agl_log4(u1))), sd);
+            __m128 sn, cs;
+            agl_sincos4(_mm_mul_ps(u2, _mm_set1_ps(6.28318530718f)), &sn, &cs);
+            agl__store_ps_until(dst, 16 * b + 4 * h, count, _mm_add_ps(_mm_mul_ps(r, cs), m));
+            agl__store_ps_until(dst, 16 * b + 8 + 4 * h, count, _mm_add_ps(_mm_mul_ps(r, sn), m));
+        }
+        agl__rng_store4(rng, s, h);
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__rng_fill_gaussian_avx2(agl_rng_t *rng, float *dst, size_t count, float mean, float stddev) {
+    const __m256 m = _mm256_set1_ps(mean), sd = _mm256_set1_ps(stddev);
+    __m256i s[4];
+    for (int j = 0; j < 4; j++)
+        s[j] = _mm256_loadu_si256((const __m256i*)rng->s[j]);
+    for (size_t i = 0; i < count; i += 16) {
+        __m256 u1 = _mm256_sub_ps(_mm256_set1_ps(1.f), agl__rng_next8(s)), u2 = agl__rng_next8(s);
+        __m256 r = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(-2.f), agl_log8(u1))), sd);
+        __m256 sn, cs;
+        agl_sincos8(_mm256_mul_ps(u2, _mm256_set1_ps(6.28318530718f)), &sn, &cs);
+        float tmp[16];
+        float *out = i + 16 <= count ? dst + i : tmp;
+        _mm256_storeu_ps(out, _mm256_fmadd_ps(r, cs, m));
+        _mm256_storeu_ps(out + 8, _mm256_fmadd_ps(r, sn, m));
+        if (out == tmp)
+            memcpy(dst + i, tmp, (count - i) * sizeof(float));
+    }
+    for (int j = 0; j < 4; j++)
+        _mm256_storeu_si256((__m256i*)rng->s[j], s[j]);
+}
+
+void agl_rng_fill_gaussian(agl_rng_t *rng, float *dst, size_t count, float mean, float stddev) {
+    agl__math_dispatch()->rng_fill_gaussian(rng, dst, count, mean, stddev);
+}
+
+enum { AGL__RNG_IN_CUBE, AGL__RNG_IN_SPHERE, AGL__RNG_ON_SPHERE };
+
+// Directions take z = 2 u - 1 and a uniform longitude, the ball scales them by max(u3, u4, u5)
+static void agl__rng_fill_vec3_sse2(agl_rng_t *rng, vec3f_t *dst, size_t count, int shape) {
+    const __m128 one = _mm_set1_ps(1.f), two = _mm_set1_ps(2.f);
+    for (int h = 0; h < 2; h++) {
+        __m128i s[4];
+        agl__rng_load4(s, rng, h);
+        for (size_t b = 0; b < (count + 7) / 8; b++) {
+            __m128 x = agl__rng_next4(s), y = agl__rng_next4(s), z;
+            if (shape == AGL__RNG_IN_CUBE) {
+                z = _mm_sub_ps(_mm_mul_ps(agl__rng_next4(s), two), one);
+                x = _mm_sub_ps(_mm_mul_ps(x, two), one);
+                y = _mm_sub_ps(_mm_mul_ps(y, two), one);
+            } else {
+                z = _mm_sub_ps(_mm_mul_ps(x, two), one);
+                __m128 r = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(one, _mm_mul_ps(z, z)), _mm_setzero_ps()));
+                agl_sincos4(_mm_mul_ps(y, _mm_set1_ps(6.28318530718f)), &y, &x);
+                x = _mm_mul_ps(x, r);
+                y = _mm_mul_ps(y, r);
+                if (shape == AGL__RNG_IN_SPHERE) {
+                    __m128 u3 = agl__rng_next4(s), u4 = agl__rng_next4(s), u5 = agl__rng_next4(s);
+                    __m128 radius = _mm_max_ps(_mm_max_ps(u3, u4), u5);
+                    x = _mm_mul_ps(x, radius);
+                    y = _mm_mul_ps(y, radius);
+                    z = _mm_mul_ps(z, radius);
+                }
+            }
+            agl__store_vec3_until(dst, 8 * b + 4 * h, count, x, y, z);
+        }
+        agl__rng_store4(rng, s, h);
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__rng_fill_vec3_avx2(agl_rng_t *rng, vec3f_t *dst, size_t count, int shape) {
+    const __m256 one = _mm256_set1_ps(1.f), two = _mm256_set1_ps(2.f);
+    __m256i s[4];
+    for (int j = 0; j < 4; j++)
+        s[j] = _mm256_loadu_si256((const __m256i*)rng->s[j]);
+    for (size_t i = 0; i < count; i += 8) {
+        vec3x8_t v;
+        v.x = agl__rng_next8(s);
+        v.y = agl__rng_next8(s);
+        if (shape == AGL__RNG_IN_CUBE) {
+            v.z = _mm256_fmsub_ps(agl__rng_next8(s), two, one);
+            v.x = _mm256_fmsub_ps(v.x, two, one);
+            v.y = _mm256_fmsub_ps(v.y, two, one);
+        } else {
+            v.z = _mm256_fmsub_ps(v.x, two, one);
+            __m256 r = _mm256_sqrt_ps(_mm256_max_ps(_mm256_fnmadd_ps(v.z, v.z, one), _mm256_setzero_ps()));
+            agl_sincos8(_mm256_mul_ps(v.y, _mm256_set1_ps(6.28318530718f)), &v.y, &v.x);
+            v.x = _mm256_mul_ps(v.x, r);
+            v.y = _mm256_mul_ps(v.y, r);
+            if (shape == AGL__RNG_IN_SPHERE) {
+                __m256 u3 = agl__rng_next8(s), u4 = agl__rng_next8(s), u5 = agl__rng_next8(s);
+                v = vec3x8_scale(&v, _mm256_max_ps(_mm256_max_ps(u3, u4), u5));
+            }
+        }
+        if (i + 8 <= count) {
+            vec3x8_store(dst + i, &v);
+        } else {
+            vec3f_t tmp[8];
+            vec3x8_store(tmp, &v);
+            memcpy(dst + i, tmp, (count - i) * sizeof(vec3f_t));
+        }
+    }
+    for (int j = 0; j < 4; j++)
+        _mm256_storeu_si256((__m256i*)rng->s[j], s[j]);
+}
+
+void agl_rng_fill_in_cube(agl_rng_t *rng, vec3f_t *dst, size_t count) {
+    agl__math_dispatch()->rng_fill_vec3(rng, dst, count, AGL__RNG_IN_CUBE);
+}
+
+void agl_rng_fill_in_sphere(agl_rng_t *rng, vec3f_t *dst, size_t count) {
+    agl__math_dispatch()->rng_fill_vec3(rng, dst, count, AGL__RNG_IN_SPHERE);
+}
+
+void agl_rng_fill_on_sphere(agl_rng_t *rng, vec3f_t *dst, size_t count) {
+    agl__math_dispatch()->rng_fill_vec3(rng, dst, count, AGL__RNG_ON_SPHERE);
+}
+
+#define AGL__CONVERT_BATCH 64
+#define AGL__CONVERT_MAX_COMPONENTS 16
+
+static const float agl__component_norm_scale[] = {
+    1.0f,               // F32
+    1.0f,               // F16
+    1.0f / 127.0f,      // S8
+    1.0f / 255.0f,      // U8
+    1.0f / 32767.0f,    // S16
+    1.0f / 65535.0f,    // U16
+    1.0f,               // U32
+};
+
+size_t agl_component_size(agl_component_type_t type) {
+    switch (type) {
+    case AGL_COMPONENT_TYPE_S8:
+    case AGL_COMPONENT_TYPE_U8: return 1;
+    case AGL_COMPONENT_TYPE_F16:
+    case AGL_COMPONENT_TYPE_S16:
+    case AGL_COMPONENT_TYPE_U16: return 2;
+    case AGL_COMPONENT_TYPE_F32:
+    case AGL_COMPONENT_TYPE_U32: return 4;
+    default: return 0;
+    }
+}
+
+// Rebias the half exponent by multiplying with 2^112, which also handles denormals; Inf/NaN get their exponent saturated
+static float agl__half_to_float(uint16_t h) {
+    union { uint32_t u; float f; } em, magic, r;
+    em.u = (uint32_t)(h & 0x7FFF) << 13;
+    magic.u = 0x77800000;
+    r.f = em.f * magic.f;
+    if (em.u >= 0x0F800000)
+        r.u |= 0x7F800000;
+    r.u |= (uint32_t)(h & 0x8000) << 16;
+    return r.f;
+}
+
+// The same for 4 halves already widened to 32 bits
+static __m128 agl__half4_to_float(__m128i x) {
+    __m128i sign = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x8000)), 16);
+    __m128i em = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x7FFF)), 13);
+    __m128 f = _mm_mul_ps(_mm_castsi128_ps(em), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+    __m128i infnan = _mm_cmpgt_epi32(em, _mm_set1_epi32(0x0F7FFFFF));
+    f = _mm_or_ps(f, _mm_castsi128_ps(_mm_and_si128(infnan, _mm_set1_epi32(0x7F800000))));
+    return _mm_or_ps(f, _mm_castsi128_ps(sign));
+}
+
+// F16C, which comes with every AVX2 CPU
+static AGL_TARGET_AVX2 __m256 agl__half8_to_float(__m128i h) {
+    return _mm256_cvtph_ps(h);
+}
+
+static float agl__load_component(const unsigned char *p, agl_component_type_t type, bool normalized) {
+    const float scale = normalized ? agl__component_norm_scale[type] : 1.0f;
+    switch (type) {
+    case AGL_COMPONENT_TYPE_F32: { float v; memcpy(&v, p, 4); return v; }
+    case AGL_COMPONENT_TYPE_F16: { uint16_t v; memcpy(&v, p, 2); return agl__half_to_float(v); }
+    case AGL_COMPONENT_TYPE_S8: { float v = (float)(int8_t)*p * scale; return (normalized && v < -1.0f) ? -1.0f : v; }
+    case AGL_COMPONENT_TYPE_U8: return (float)*p * scale;
+    case AGL_COMPONENT_TYPE_S16: { int16_t v; memcpy(&v, p, 2); float f = (float)v * scale; return (normalized && f < -1.0f) ? -1.0f : f; }
+    case AGL_COMPONENT_TYPE_U16: { uint16_t v; memcpy(&v, p, 2); return (float)v * scale; }
+    case AGL_COMPONENT_TYPE_U32: { uint32_t v; memcpy(&v, p, 4); return (float)v; }
+    default: return 0.0f;
+    }
+}
+
+static __m128i agl__load4_bytes(const unsigned char *p) {
+    int32_t v;
+    memcpy(&v, p, 4);
+    return _mm_cvtsi32_si128(v);
+}
+
+// Converts n tightly packed scalars, 4 at a time. SSE2 has no sign or zero extending loads, the narrow integers are
+// unpacked into the high bits of each lane and shifted back down.
+static void agl__convert_packed_f32_sse2(float *dst, const unsigned char *src, agl_component_type_t type, bool normalized, size_t n) {
+    const __m128 scale = _mm_set1_ps(normalized ? agl__component_norm_scale[type] : 1.0f);
+    const __m128 lo = _mm_set1_ps(normalized ? -1.0f : -FLT_MAX);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    switch (type) {
+    case AGL_COMPONENT_TYPE_F32:
+        memcpy(dst, src, n * sizeof(float));
+        return;
+    case AGL_COMPONENT_TYPE_F16:
+        for (; i + 4 <= n; i += 4) {
+            __m128i h = _mm_loadl_epi64((const __m128i*)(src + 2 * i));
+            _mm_storeu_ps(dst + i, agl__half4_to_float(_mm_unpacklo_epi16(h, zero)));
+        }
+        break;
+    case AGL_COMPONENT_TYPE_S8:
+        for (; i + 4 <= n; i += 4) {
+            __m128i b = agl__load4_bytes(src + i);
+            b = _mm_unpacklo_epi8(b, b);
+            __m128 f = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(b, b), 24));
+            _mm_storeu_ps(dst + i, _mm_max_ps(_mm_mul_ps(f, scale), lo));
+        }
+        break;
+    case AGL_COMPONENT_TYPE_U8:
+        for (; i + 4 <= n; i += 4) {
+            __m128i b = _mm_unpacklo_epi16(_mm_unpacklo_epi8(agl__load4_bytes(src + i), zero), zero);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+        }
+        break;
+    case AGL_COMPONENT_TYPE_S16:
+        for (; i + 4 <= n; i += 4) {
+            __m128i s = _mm_loadl_epi64((const __m128i*)(src + 2 * i));
+            __m128 f = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+            _mm_storeu_ps(dst + i, _mm_max_ps(_mm_mul_ps(f, scale), lo));
+        }
+        break;
+    case AGL_COMPONENT_TYPE_U16:
+        for (; i + 4 <= n; i += 4) {
+            __m128i s = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(src + 2 * i)), zero);
+            _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(s), scale));
+        }
+        break;
+    default:
+        break;
+    }
+    const size_t size = agl_component_size(type);
+    for (; i < n; ++i)
+        dst[i] = agl__load_component(src + i * size, type, normalized);
+}
+
+// 8 at a time, the remainder goes through the SSE2 variant
+static AGL_TARGET_AVX2 void agl__convert_packed_f32_avx2(float *dst, const unsigned char *src, agl_component_type_t type, bool normalized, size_t n) {
+    const __m256 scale = _mm256_set1_ps(normalized ? agl__component_norm_scale[type] : 1.0f);
+    const __m256 lo = _mm256_set1_ps(normalized ? -1.0f : -FLT_MAX);
+    size_t i = 0;
+    switch (type) {
+    case AGL_COMPONENT_TYPE_F32:
+        memcpy(dst, src, n * sizeof(float));
+        return;
+    case AGL_COMPONENT_TYPE_F16:
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dst + i, agl__half8_to_float(_mm_loadu_si128((const __m128i*)(src + 2 * i))));
+        break;
+    case AGL_COMPONENT_TYPE_S8:
+        for (; i + 8 <= n; i += 8) {
+            __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(src + i))));
+            _mm256_storeu_ps(dst + i, _mm256_max_ps(_mm256_mul_ps(f, scale), lo));
+        }
+        break;
+    case AGL_COMPONENT_TYPE_U8:
+        for (; i + 8 <= n; i += 8) {
+            __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i))));
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(f, scale));
+        }
+        break;
+    case AGL_COMPONENT_TYPE_S16:
+        for (; i + 8 <= n; i += 8) {
+            __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + 2 * i))));
+            _mm256_storeu_ps(dst + i, _mm256_max_ps(_mm256_mul_ps(f, scale), lo));
+        }
+        break;
+    case AGL_COMPONENT_TYPE_U16:
+        for (; i + 8 <= n; i += 8) {
+            __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + 2 * i))));
+            _mm256_storeu_ps(dst + i, _mm256_mul_ps(f, scale));
+        }
+        break;
+    default:
+        break;
+    }
+    const size_t size = agl_component_size(type);
+    agl__convert_packed_f32_sse2(dst + i, src + i * size, type, normalized, n - i);
+}
+
+void agl_convert_to_f32(float *dst, int dstComponents, const void *src, size_t srcStride, int srcComponents,
+    agl_component_type_t type, bool normalized, size_t count) {
+    agl_math_assert(srcComponents > 0 && srcComponents <= AGL__CONVERT_MAX_COMPONENTS);
+    agl_math_assert(dstComponents > 0 && dstComponents <= AGL__CONVERT_MAX_COMPONENTS);
+    const agl__math_kernels_t *kernels = agl__math_dispatch();
+    const unsigned char *bytes = (const unsigned char*)src;
+    const size_t elemSize = agl_component_size(type) * srcComponents;
+    if (srcStride == elemSize && srcComponents == dstComponents) {
+        kernels->convert_packed_f32(dst, bytes, type, normalized, count * srcComponents);
+        return;
+    }
+    // Gather a batch of strided elements into a packed staging block, then convert it in one go
+    alignas(32) unsigned char raw[AGL__CONVERT_BATCH * AGL__CONVERT_MAX_COMPONENTS * 4];
+    alignas(32) float staging[AGL__CONVERT_BATCH * AGL__CONVERT_MAX_COMPONENTS];
+    const int copied = (srcComponents < dstComponents) ? srcComponents : dstComponents;
+    for (size_t base = 0; base < count; base += AGL__CONVERT_BATCH) {
+        const size_t n = (count - base < AGL__CONVERT_BATCH) ? count - base : AGL__CONVERT_BATCH;
+        for (size_t i = 0; i < n; ++i)
+            memcpy(raw + i * elemSize, bytes + (base + i) * srcStride, elemSize);
+        float *out = dst + base * dstComponents;
+        if (srcComponents == dstComponents) {
+            kernels->convert_packed_f32(out, raw, type, normalized, n * srcComponents);
+            continue;
+        }
+        kernels->convert_packed_f32(staging, raw, type, normalized, n * srcComponents);
+        for (size_t i = 0; i < n; ++i) {
+            int c = 0;
+            for (; c < copied; ++c)
+                out[i * dstComponents + c] = staging[i * srcComponents + c];
+            for (; c < dstComponents; ++c)
+                out[i * dstComponents + c] = (c == 3) ? 1.0f : 0.0f;
+        }
+    }
+}
+
+// Round to nearest even, NaN becomes a quiet NaN and overflow becomes infinity. Denormal results are rounded by the
+// FPU when adding 0.5, whose exponent lines the half denormal mantissa up with the bottom of the float mantissa.
+static uint16_t agl__float_to_half(float f) {
+    uint32_t u;
+    memcpy(&u, &f, 4);
+    uint32_t sign = (u >> 16) & 0x8000;
+    u &= 0x7FFFFFFF;
+    uint32_t h;
+    if (u >= 0x47800000) {
+        h = u > 0x7F800000 ? 0x7E00 : 0x7C00;
+    } else if (u < 0x38800000) {
+        float d;
+        memcpy(&d, &u, 4);
+        d += 0.5f;
+        memcpy(&h, &d, 4);
+        h -= 0x3F000000;
+    } else {
+        // Rebias the exponent and round the 13 dropped bits, adding the kept lsb breaks ties to even
+        h = (u + 0xC8000FFF + ((u >> 13) & 1)) >> 13;
+    }
+    return (uint16_t)(h | sign);
+}
+
+// The same for 4 floats, each half in the low bits of its lane
+static __m128i agl__float4_to_half(__m128 f) {
+    __m128i u = _mm_castps_si128(f);
+    __m128i sign = _mm_and_si128(_mm_srli_epi32(u, 16), _mm_set1_epi32(0x8000));
+    u = _mm_and_si128(u, _mm_set1_epi32(0x7FFFFFFF));
+    __m128i denorm = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(u), _mm_set1_ps(0.5f))), _mm_set1_epi32(0x3F000000));
+    __m128i odd = _mm_and_si128(_mm_srli_epi32(u, 13), _mm_set1_epi32(1));
+    __m128i norm = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(u, _mm_set1_epi32((int)0xC8000FFF)), odd), 13);
+    __m128i nan = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x7F800000));
+    __m128i inf = _mm_or_si128(_mm_set1_epi32(0x7C00), _mm_and_si128(nan, _mm_set1_epi32(0x0200)));
+    __m128i small = _mm_cmplt_epi32(u, _mm_set1_epi32(0x38800000));
+    __m128i big = _mm_cmpgt_epi32(u, _mm_set1_epi32(0x477FFFFF));
+    __m128i h = _mm_or_si128(_mm_and_si128(small, denorm), _mm_andnot_si128(small, norm));
+    h = _mm_or_si128(_mm_and_si128(big, inf), _mm_andnot_si128(big, h));
+    return _mm_or_si128(h, sign);
+}
+
+// Packs the low 16 bits of each lane, SSE2 only packs with signed saturation so the lanes are sign extended first
+static __m128i agl__pack_lo16(__m128i a, __m128i b) {
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    return _mm_packs_epi32(a, b);
+}
+
+// Scale and saturation range for encoding floats to an integer type. Normalised values are clamped to [0,1] or
+// [-1,1] first, so snorm never produces the most negative integer, matching the decoder.
+static void agl__component_encode_range(agl_component_type_t type, bool normalized, float *scale, float *lo, float *hi) {
+    static const float maxv[] = { 0.0f, 0.0f, 127.0f, 255.0f, 32767.0f, 65535.0f, 4294967295.0f };
+    static const float minv[] = { 0.0f, 0.0f, -128.0f, 0.0f, -32768.0f, 0.0f, 0.0f };
+    const bool norm = normalized && type != AGL_COMPONENT_TYPE_U32;
+    *scale = norm ? maxv[type] : 1.0f;
+    *lo = (norm && minv[type] < 0.0f) ? -maxv[type] : minv[type];
+    *hi = maxv[type];
+}
+
+// Integers round to nearest even like cvtps2dq, NaN saturates to the low end like maxps
+static void agl__store_component(unsigned char *p, float v, agl_component_type_t type, float scale, float lo, float hi) {
+    switch (type) {
+    case AGL_COMPONENT_TYPE_F32: memcpy(p, &v, 4); return;
+    case AGL_COMPONENT_TYPE_F16: { uint16_t h = agl__float_to_half(v); memcpy(p, &h, 2); return; }
+    default: break;
+    }
+    v *= scale;
+    v = v > lo ? v : lo;
+    v = v < hi ? v : hi;
+    switch (type) {
+    case AGL_COMPONENT_TYPE_S8: { int8_t x = (int8_t)rintf(v); memcpy(p, &x, 1); break; }
+    case AGL_COMPONENT_TYPE_U8: *p = (unsigned char)rintf(v); break;
+    case AGL_COMPONENT_TYPE_S16: { int16_t x = (int16_t)rintf(v); memcpy(p, &x, 2); break; }
+    case AGL_COMPONENT_TYPE_U16: { uint16_t x = (uint16_t)rintf(v); memcpy(p, &x, 2); break; }
+    case AGL_COMPONENT_TYPE_U32: { uint32_t x = v >= 4294967296.0f ? UINT32_MAX : (uint32_t)rint((double)v); memcpy(p, &x, 4); break; }
+    default: break;
+    }
+}
+
+static __m128i agl__encode4(const float *src, __m128 scale, __m128 lo, __m128 hi) {
+    return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src), scale), lo), hi));
+}
+
+// Encodes n tightly packed scalars, 8 at a time
+static void agl__convert_packed_from_f32_sse2(unsigned char *dst, const float *src, agl_component_type_t type, bool normalized, size_t n) {
+    float scale, lo, hi;
+    agl__component_encode_range(type, normalized, &scale, &lo, &hi);
+    const __m128 vscale = _mm_set1_ps(scale), vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    switch (type) {
+    case AGL_COMPONENT_TYPE_F32:
+        memcpy(dst, src, n * sizeof(float));
+        return;
+    case AGL_COMPONENT_TYPE_F16:
+        for (; i + 8 <= n; i += 8) {
+            __m128i a = agl__float4_to_half(_mm_loadu_ps(src + i)), b = agl__float4_to_half(_mm_loadu_ps(src + i + 4));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i), agl__pack_lo16(a, b));
+        }
+        break;
+    case AGL_COMPONENT_TYPE_S8:
+        for (; i + 8 <= n; i += 8) {
+            __m128i s = _mm_packs_epi32(agl__encode4(src + i, vscale, vlo, vhi), agl__encode4(src + i + 4, vscale, vlo, vhi));
+            _mm_storel_epi64((__m128i*)(dst + i), _mm_packs_epi16(s, zero));
+        }
+        break;
+    case AGL_COMPONENT_TYPE_U8:
+        for (; i + 8 <= n; i += 8) {
+            __m128i s = _mm_packs_epi32(agl__encode4(src + i, vscale, vlo, vhi), agl__encode4(src + i + 4, vscale, vlo, vhi));
+            _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(s, zero));
+        }
+        break;
+    case AGL_COMPONENT_TYPE_S16:
+        for (; i + 8 <= n; i += 8) {
+            __m128i s = _mm_packs_epi32(agl__encode4(src + i, vscale, vlo, vhi), agl__encode4(src + i + 4, vscale, vlo, vhi));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i), s);
+        }
+        break;
+    case AGL_COMPONENT_TYPE_U16:
+        for (; i + 8 <= n; i += 8) {
+            __m128i s = agl__pack_lo16(agl__encode4(src + i, vscale, vlo, vhi), agl__encode4(src + i + 4, vscale, vlo, vhi));
+            _mm_storeu_si128((__m128i*)(dst + 2 * i), s);
+        }
+        break;
+    default:
+        break;
+    }
+    const size_t size = agl_component_size(type);
+    for (; i < n; ++i)
+        agl__store_component(dst + i * size, src[i], type, scale, lo, hi);
+}
+
+// F16C for halves, 8 at a time, the remainder goes through the SSE2 variant
+static AGL_TARGET_AVX2 void agl__convert_packed_from_f32_avx2(unsigned char *dst, const float *src, agl_component_type_t type, bool normalized, size_t n) {
+    float scale, lo, hi;
+    agl__component_encode_range(type, normalized, &scale, &lo, &hi);
+    const __m256 vscale = _mm256_set1_ps(scale), vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+    size_t i = 0;
+    if (type == AGL_COMPONENT_TYPE_F32) {
+        memcpy(dst, src, n * sizeof(float));
+        return;
+    }
+    if (type == AGL_COMPONENT_TYPE_F16) {
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    } else if (type != AGL_COMPONENT_TYPE_U32) {
+        for (; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), vscale), vlo), vhi);
+            __m256i x = _mm256_cvtps_epi32(v);
+            __m128i a = _mm256_castsi256_si128(x), b = _mm256_extracti128_si256(x, 1);
+            switch (type) {
+            case AGL_COMPONENT_TYPE_S8: _mm_storel_epi64((__m128i*)(dst + i), _mm_packs_epi16(_mm_packs_epi32(a, b), a)); break;
+            case AGL_COMPONENT_TYPE_U8: _mm_storel_epi64((__m128i*)(dst + i), _mm_packus_epi16(_mm_packs_epi32(a, b), a)); break;
+            case AGL_COMPONENT_TYPE_S16: _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_packs_epi32(a, b)); break;
+            default: _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_packus_epi32(a, b)); break;
+            }
+        }
+    }
+    agl__convert_packed_from_f32_sse2(dst + i * agl_component_size(type), src + i, type, normalized, n - i);
+}
+
+void agl_convert_from_f32(void *dst, size_t dstStride, int dstComponents, const float *src, int srcComponents,
+    agl_component_type_t type, bool normalized, size_t count) {
+    agl_math_assert(srcComponents > 0 && srcComponents <= AGL__CONVERT_MAX_COMPONENTS);
+    agl_math_assert(dstComponents > 0 && dstComponents <= AGL__CONVERT_MAX_COMPONENTS);
+    const agl__math_kernels_t *kernels = agl__math_dispatch();
+    unsigned char *bytes = (unsigned char*)dst;
+    const size_t elemSize = agl_component_size(type) * dstComponents;
+    if (dstStride == elemSize && srcComponents == dstComponents) {
+        kernels->convert_packed_from_f32(bytes, src, type, normalized, count * dstComponents);
+        return;
+    }
+    // Encode a batch into a packed staging block, then scatter it to the strided destination
+    alignas(32) unsigned char raw[AGL__CONVERT_BATCH * AGL__CONVERT_MAX_COMPONENTS * 4];
+    alignas(32) float staging[AGL__CONVERT_BATCH * AGL__CONVERT_MAX_COMPONENTS];
+    const int copied = (srcComponents < dstComponents) ? srcComponents : dstComponents;
+    for (size_t base = 0; base < count; base += AGL__CONVERT_BATCH) {
+        const size_t n = (count - base < AGL__CONVERT_BATCH) ? count - base : AGL__CONVERT_BATCH;
+        const float *in = src + base * srcComponents;
+        if (srcComponents != dstComponents) {
+            for (size_t i = 0; i < n; ++i) {
+                int c = 0;
+                for (; c < copied; ++c)
+                    staging[i * dstComponents + c] = in[i * srcComponents + c];
+                for (; c < dstComponents; ++c)
+                    staging[i * dstComponents + c] = (c == 3) ? 1.0f : 0.0f;
+            }
+            in = staging;
+        }
+        kernels->convert_packed_from_f32(raw, in, type, normalized, n * dstComponents);
+        for (size_t i = 0; i < n; ++i)
+            memcpy(bytes + (base + i) * dstStride, raw + i * elemSize, elemSize);
+    }
+}
+
+// Tightly packed U8 or U16, 8 at a time
+static void agl__convert_packed_u32_sse2(uint32_t *dst, const unsigned char *src, agl_component_type_t type, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i s = type == AGL_COMPONENT_TYPE_U8
+            ? _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(src + i)), zero)
+            : _mm_loadu_si128((const __m128i*)(src + 2 * i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi16(s, zero));
+        _mm_storeu_si128((__m128i*)(dst + i + 4), _mm_unpackhi_epi16(s, zero));
+    }
+    for (; i < n; ++i) {
+        if (type == AGL_COMPONENT_TYPE_U8) {
+            dst[i] = src[i];
+        } else {
+            uint16_t v;
+            memcpy(&v, src + 2 * i, 2);
+            dst[i] = v;
+        }
+    }
+}
+
+static AGL_TARGET_AVX2 void agl__convert_packed_u32_avx2(uint32_t *dst, const unsigned char *src, agl_component_type_t type, size_t n) {
+    size_t i = 0;
+    if (type == AGL_COMPONENT_TYPE_U8) {
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i))));
+    } else {
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + 2 * i))));
+    }
+    agl__convert_packed_u32_sse2(dst + i, src + i * agl_component_size(type), type, n - i);
+}
+
+void agl_convert_to_u32(uint32_t *dst, const void *src, size_t srcStride, agl_component_type_t type, size_t count) {
+    agl_math_assert(type == AGL_COMPONENT_TYPE_U8 || type == AGL_COMPONENT_TYPE_U16 || type == AGL_COMPONENT_TYPE_U32);
+    const unsigned char *bytes = (const unsigned char*)src;
+    const size_t size = agl_component_size(type);
+    if (srcStride == size) {
+        if (type == AGL_COMPONENT_TYPE_U32)
+            memcpy(dst, bytes, count * sizeof(uint32_t));
+        else
+            agl__math_dispatch()->convert_packed_u32(dst, bytes, type, count);
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const unsigned char *p = bytes + i * srcStride;
+        switch (type) {
+        case AGL_COMPONENT_TYPE_U8: dst[i] = *p; break;
+        case AGL_COMPONENT_TYPE_U16: { uint16_t v; memcpy(&v, p, 2); dst[i] = v; } break;
+        case AGL_COMPONENT_TYPE_U32: memcpy(&dst[i], p, 4); break;
+        default: dst[i] = 0; break;
+        }
+    }
+}
+
+#undef AGL__CONVERT_BATCH
+#undef AGL__CONVERT_MAX_COMPONENTS
+
+// Reduces `lanes` (a multiple of 3) running minima and maxima, where lane k holds component k % 3, then adds the
+// `count` remaining points
+static void agl__bounds_finish(float *min, float *max, const float *lo, const float *hi, int lanes, const float *points, size_t count) {
+    min[0] = min[1] = min[2] = FLT_MAX;
+    max[0] = max[1] = max[2] = -FLT_MAX;
+    for (int k = 0; k < lanes; k++) {
+        min[k % 3] = lo[k] < min[k % 3] ? lo[k] : min[k % 3];
+        max[k % 3] = hi[k] > max[k % 3] ? hi[k] : max[k % 3];
+    }
+    for (size_t i = 0; i < count; i++) {
+        for (int k = 0; k < 3; k++) {
+            float v = points[3 * i + k];
+            min[k] = v < min[k] ? v : min[k];
+            max[k] = v > max[k] ? v : max[k];
+        }
+    }
+}
+
+// 4 points are 12 floats, so each of the three registers always sees the same component in a given lane
+static void agl__bounds_minmax3_sse2(float *min, float *max, const float *points, size_t count) {
+    __m128 lo0 = _mm_set1_ps(FLT_MAX), lo1 = lo0, lo2 = lo0;
+    __m128 hi0 = _mm_set1_ps(-FLT_MAX), hi1 = hi0, hi2 = hi0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const float *p = points + 3 * i;
+        __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+        lo0 = _mm_min_ps(lo0, a); hi0 = _mm_max_ps(hi0, a);
+        lo1 = _mm_min_ps(lo1, b); hi1 = _mm_max_ps(hi1, b);
+        lo2 = _mm_min_ps(lo2, c); hi2 = _mm_max_ps(hi2, c);
+    }
+    alignas(16) float lo[12], hi[12];
+    _mm_store_ps(lo, lo0); _mm_store_ps(lo + 4, lo1); _mm_store_ps(lo + 8, lo2);
+    _mm_store_ps(hi, hi0); _mm_store_ps(hi + 4, hi1); _mm_store_ps(hi + 8, hi2);
+    agl__bounds_finish(min, max, lo, hi, 12, points + 3 * i, count - i);
+}
+
+// Likewise 8 points are 24 floats
+static AGL_TARGET_AVX2 void agl__bounds_minmax3_avx2(float *min, float *max, const float *points, size_t count) {
+    __m256 lo0 = _mm256_set1_ps(FLT_MAX), lo1 = lo0, lo2 = lo0;
+    __m256 hi0 = _mm256_set1_ps(-FLT_MAX), hi1 = hi0, hi2 = hi0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const float *p = points + 3 * i;
+        __m256 a = _mm256_loadu_ps(p), b = _mm256_loadu_ps(p + 8), c = _mm256_loadu_ps(p + 16);
+        lo0 = _mm256_min_ps(lo0, a); hi0 = _mm256_max_ps(hi0, a);
+        lo1 = _mm256_min_ps(lo1, b); hi1 = _mm256_max_ps(hi1, b);
+        lo2 = _mm256_min_ps(lo2, c); hi2 = _mm256_max_ps(hi2, c);
+    }
+    alignas(32) float lo[24], hi[24];
+    _mm256_store_ps(lo, lo0); _mm256_store_ps(lo + 8, lo1); _mm256_store_ps(lo + 16, lo2);
+    _mm256_store_ps(hi, hi0); _mm256_store_ps(hi + 8, hi1); _mm256_store_ps(hi + 16, hi2);
+    agl__bounds_finish(min, max, lo, hi, 24, points + 3 * i, count - i);
+}
+
+// And 16 points are 48 floats
+static AGL_TARGET_AVX512 void agl__bounds_minmax3_avx512(float *min, float *max, const float *points, size_t count) {
+    __m512 lo0 = _mm512_set1_ps(FLT_MAX), lo1 = lo0, lo2 = lo0;
+    __m512 hi0 = _mm512_set1_ps(-FLT_MAX), hi1 = hi0, hi2 = hi0;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const float *p = points + 3 * i;
+        __m512 a = _mm512_loadu_ps(p), b = _mm512_loadu_ps(p + 16), c = _mm512_loadu_ps(p + 32);
+        lo0 = _mm512_min_ps(lo0, a); hi0 = _mm512_max_ps(hi0, a);
+        lo1 = _mm512_min_ps(lo1, b); hi1 = _mm512_max_ps(hi1, b);
+        lo2 = _mm512_min_ps(lo2, c); hi2 = _mm512_max_ps(hi2, c);
+    }
+    alignas(64) float lo[48], hi[48];
+    _mm512_store_ps(lo, lo0); _mm512_store_ps(lo + 16, lo1); _mm512_store_ps(lo + 32, lo2);
+    _mm512_store_ps(hi, hi0); _mm512_store_ps(hi + 16, hi1); _mm512_store_ps(hi + 32, hi2);
+    agl__bounds_finish(min, max, lo, hi, 48, points + 3 * i, count - i);
+}
+
+void agl_bounds_minmax3(float *min, float *max, const float *points, size_t count) {
+    agl__math_dispatch()->bounds_minmax3(min, max, points, count);
+}
+
+// 4 spheres at a time. The variants sum the plane distances in the same order, only spheres touching a plane to within
+// rounding can be classified differently once the compiler fuses the multiply-adds of the wider ones.
+static size_t agl__cull_spheres_sse2(uint8_t *visible, const float *x, const float *y, const float *z, const float *radius, size_t count,
+    const vec4f_t *planes, int planeCount) {
+    size_t visibleCount = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+        __m128 negr = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < planeCount; p++) {
+            __m128 d = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p]._m[0]), px), _mm_mul_ps(_mm_set1_ps(planes[p]._m[1]), py)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p]._m[2]), pz), _mm_set1_ps(planes[p]._m[3])));
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negr));
+        }
+        unsigned mask = (unsigned)_mm_movemask_ps(inside);
+        for (int k = 0; k < 4; k++)
+            visible[i + k] = (uint8_t)((mask >> k) & 1);
+        visibleCount += agl__popcount(mask);
+    }
+    for (; i < count; i++) {
+        bool inside = true;
+        for (int p = 0; p < planeCount && inside; p++)
+            inside = (planes[p]._m[0] * x[i] + planes[p]._m[1] * y[i]) + (planes[p]._m[2] * z[i] + planes[p]._m[3]) > -radius[i];
+        visible[i] = inside ? 1 : 0;
+        visibleCount += inside ? 1 : 0;
+    }
+    return visibleCount;
+}
+
+static AGL_TARGET_AVX2 size_t agl__cull_spheres_avx2(uint8_t *visible, const float *x, const float *y, const float *z, const float *radius, size_t count,
+    const vec4f_t *planes, int planeCount) {
+    size_t visibleCount = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+        __m256 negr = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < planeCount; p++) {
+            __m256 d = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p]._m[0]), px), _mm256_mul_ps(_mm256_set1_ps(planes[p]._m[1]), py)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p]._m[2]), pz), _mm256_set1_ps(planes[p]._m[3])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negr, _CMP_GT_OQ));
+        }
+        unsigned mask = (unsigned)_mm256_movemask_ps(inside);
+        for (int k = 0; k < 8; k++)
+            visible[i + k] = (uint8_t)((mask >> k) & 1);
+        visibleCount += agl__popcount(mask);
+    }
+    return visibleCount + agl__cull_spheres_sse2(visible + i, x + i, y + i, z + i, radius + i, count - i, planes, planeCount);
+}
+
+// 16 spheres at a time, the plane tests accumulate in a mask register which also writes the 16 visibility bytes at once
+static AGL_TARGET_AVX512 size_t agl__cull_spheres_avx512(uint8_t *visible, const float *x, const float *y, const float *z, const float *radius, size_t count,
+    const vec4f_t *planes, int planeCount) {
+    size_t visibleCount = 0;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512 px = _mm512_loadu_ps(x + i), py = _mm512_loadu_ps(y + i), pz = _mm512_loadu_ps(z + i);
+        __m512 negr = _mm512_sub_ps(_mm512_setzero_ps(), _mm512_loadu_ps(radius + i));
+        __mmask16 inside = 0xFFFF;
+        for (int p = 0; p < planeCount; p++) {
+            __m512 d = _mm512_add_ps(
+                _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(planes[p]._m[0]), px), _mm512_mul_ps(_mm512_set1_ps(planes[p]._m[1]), py)),
+                _mm512_add_ps(_mm512_mul_ps(_mm512_set1_ps(planes[p]._m[2]), pz), _mm512_set1_ps(planes[p]._m[3])));
+            inside = _mm512_mask_cmp_ps_mask(inside, d, negr, _CMP_GT_OQ);
+        }
+        _mm_storeu_si128((__m128i*)(visible + i), _mm_maskz_set1_epi8(inside, 1));
+        visibleCount += agl__popcount(inside);
+    }
+    return visibleCount + agl__cull_spheres_sse2(visible + i, x + i, y + i, z + i, radius + i, count - i, planes, planeCount);
+}
+
+size_t agl_cull_spheres(uint8_t *visible, const float *x, const float *y, const float *z, const float *radius, size_t count,
+    const vec4f_t *planes, int planeCount) {
+    return agl__math_dispatch()->cull_spheres(visible, x, y, z, radius, count, planes, planeCount);
+}
+
+// Loads 4 boxes as the x, y and z registers of their minimum and maximum corners
+static void agl__aabb_load4(__m128 lo[3], __m128 hi[3], const aabbf_t *a) {
+    __m128 l0 = _mm_loadu_ps(a[0].min._m), l1 = _mm_loadu_ps(a[1].min._m), l2 = _mm_loadu_ps(a[2].min._m), l3 = _mm_loadu_ps(a[3].min._m);
+    __m128 h0 = _mm_loadu_ps(a[0].max._m), h1 = _mm_loadu_ps(a[1].max._m), h2 = _mm_loadu_ps(a[2].max._m), h3 = _mm_loadu_ps(a[3].max._m);
+    _MM_TRANSPOSE4_PS(l0, l1, l2, l3);
+    _MM_TRANSPOSE4_PS(h0, h1, h2, h3);
+    lo[0] = l0; lo[1] = l1; lo[2] = l2;
+    hi[0] = h0; hi[1] = h1; hi[2] = h2;
+}
+
+// The box and ray kernels below repeat the arithmetic of the single item tests, which handle the tails, so the variants
+// only disagree on queries touching to within rounding once the compiler fuses multiply-adds.
+static size_t agl__cull_aabbs_sse2(uint8_t *visible, const aabbf_t *boxes, size_t count, const vec4f_t *planes, int planeCount) {
+    size_t visibleCount = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 lo[3], hi[3];
+        agl__aabb_load4(lo, hi, boxes + i);
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < planeCount; p++) {
+            const float *n = planes[p]._m;
+            __m128 x = n[0] >= 0.f ? hi[0] : lo[0];
+            __m128 y = n[1] >= 0.f ? hi[1] : lo[1];
+            __m128 z = n[2] >= 0.f ? hi[2] : lo[2];
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(n[0]), x), _mm_mul_ps(_mm_set1_ps(n[1]), y)),
+                _mm_mul_ps(_mm_set1_ps(n[2]), z)), _mm_set1_ps(n[3]));
+            inside = _mm_and_ps(inside, _mm_cmpnlt_ps(d, _mm_setzero_ps()));
+        }
+        unsigned mask = (unsigned)_mm_movemask_ps(inside);
+        for (int k = 0; k < 4; k++)
+            visible[i + k] = (uint8_t)((mask >> k) & 1);
+        visibleCount += agl__popcount(mask);
+    }
+    for (; i < count; i++) {
+        bool inside = aabbf_in_planes(boxes + i, planes, planeCount);
+        visible[i] = inside ? 1 : 0;
+        visibleCount += inside ? 1 : 0;
+    }
+    return visibleCount;
+}
+
+static AGL_TARGET_AVX2 size_t agl__cull_aabbs_avx2(uint8_t *visible, const aabbf_t *boxes, size_t count, const vec4f_t *planes, int planeCount) {
+    size_t visibleCount = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        aabbx8_t a = aabbx8_load(boxes + i);
+        unsigned mask = (unsigned)_mm256_movemask_ps(aabbx8_in_planes(&a, planes, planeCount));
+        for (int k = 0; k < 8; k++)
+            visible[i + k] = (uint8_t)((mask >> k) & 1);
+        visibleCount += agl__popcount(mask);
+    }
+    return visibleCount + agl__cull_aabbs_sse2(visible + i, boxes + i, count - i, planes, planeCount);
+}
+
+size_t agl_cull_aabbs(uint8_t *visible, const aabbf_t *boxes, size_t count, const vec4f_t *planes, int planeCount) {
+    return agl__math_dispatch()->cull_aabbs(visible, boxes, count, planes, planeCount);
+}
+
+static size_t agl__ray_aabbs_sse2(float *t, const rayf_t *ray, const aabbf_t *boxes, size_t count, float tmax) {
+    __m128 inv[3], o[3];
+    for (int k = 0; k < 3; k++) {
+        inv[k] = _mm_set1_ps(1.f / ray->dir._m[k]);
+        o[k] = _mm_set1_ps(ray->origin._m[k]);
+    }
+    const __m128 miss = _mm_set1_ps(INFINITY);
+    size_t hits = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 lo[3], hi[3];
+        agl__aabb_load4(lo, hi, boxes + i);
+        __m128 tnear = _mm_setzero_ps(), tfar = _mm_set1_ps(tmax);
+        for (int k = 0; k < 3; k++) {
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(lo[k], o[k]), inv[k]), t1 = _mm_mul_ps(_mm_sub_ps(hi[k], o[k]), inv[k]);
+            tnear = _mm_max_ps(_mm_min_ps(t1, t0), tnear);
+            tfar = _mm_min_ps(_mm_max_ps(t0, t1), tfar);
+        }
+        __m128 hit = _mm_cmple_ps(tnear, tfar);
+        _mm_storeu_ps(t + i, _mm_or_ps(_mm_and_ps(hit, tnear), _mm_andnot_ps(hit, miss)));
+        hits += agl__popcount((uint32_t)_mm_movemask_ps(hit));
+    }
+    for (; i < count; i++) {
+        float hit;
+        bool found = rayf_intersect_aabb(ray, boxes + i, tmax, &hit);
+        t[i] = found ? hit : INFINITY;
+        hits += found ? 1 : 0;
+    }
+    return hits;
+}
+
+static AGL_TARGET_AVX2 size_t agl__ray_aabbs_avx2(float *t, const rayf_t *ray, const aabbf_t *boxes, size_t count, float tmax) {
+    const __m256 miss = _mm256_set1_ps(INFINITY), tmax8 = _mm256_set1_ps(tmax);
+    size_t hits = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        aabbx8_t a = aabbx8_load(boxes + i);
+        __m256 tnear;
+        __m256 hit = rayf_intersect_aabbx8(ray, &a, tmax8, &tnear);
+        _mm256_storeu_ps(t + i, _mm256_blendv_ps(miss, tnear, hit));
+        hits += agl__popcount((uint32_t)_mm256_movemask_ps(hit));
+    }
+    return hits + agl__ray_aabbs_sse2(t + i, ray, boxes + i, count - i, tmax);
+}
+
+size_t agl_ray_aabbs(float *t, const rayf_t *ray, const aabbf_t *boxes, size_t count, float tmax) {
+    return agl__math_dispatch()->ray_aabbs(t, ray, boxes, count, tmax);
+}
+
+// One triangle at a time with the single item test, without gathers the vertex fetches through the index buffer cost
+// about as much as the test itself
+static bool agl__ray_triangles_sse2(float *t, uint32_t *triangle, const rayf_t *ray, const float *positions, const uint32_t *indices,
+    size_t triangleCount, float tmax) {
+    bool found = false;
+    float best = tmax;
+    for (size_t i = 0; i < triangleCount; i++) {
+        size_t i0 = indices ? indices[3 * i + 0] : 3 * i + 0;
+        size_t i1 = indices ? indices[3 * i + 1] : 3 * i + 1;
+        size_t i2 = indices ? indices[3 * i + 2] : 3 * i + 2;
+        vec3f_t a = vec3f(positions[3 * i0], positions[3 * i0 + 1], positions[3 * i0 + 2]);
+        vec3f_t b = vec3f(positions[3 * i1], positions[3 * i1 + 1], positions[3 * i1 + 2]);
+        vec3f_t c = vec3f(positions[3 * i2], positions[3 * i2 + 1], positions[3 * i2 + 2]);
+        float hit;
+        if (rayf_intersect_triangle(ray, &a, &b, &c, best, &hit, NULL, NULL) && (!found || hit < best)) {
+            best = hit;
+            *triangle = (uint32_t)i;
+            found = true;
+        }
+    }
+    if (found)
+        *t = best;
+    return found;
+}
+
+// 8 triangles at a time, gathering indices and vertices. Lanes are scanned in order and only a strictly closer hit
+// replaces the best one, so ties go to the lower index as in the SSE2 variant.
+static AGL_TARGET_AVX2 bool agl__ray_triangles_avx2(float *t, uint32_t *triangle, const rayf_t *ray, const float *positions, const uint32_t *indices,
+    size_t triangleCount, float tmax) {
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), one = _mm256_set1_epi32(1);
+    bool found = false;
+    float best = tmax;
+    size_t i = 0;
+    for (; i + 8 <= triangleCount; i += 8) {
+        __m256i base = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_set1_epi32((int)i), lane), _mm256_set1_epi32(3));
+        __m256i v[3] = { base, _mm256_add_epi32(base, one), _mm256_add_epi32(base, _mm256_add_epi32(one, one)) };
+        trianglex8_t tri;
+        vec3x8_t *corner[3] = { &tri.a, &tri.b, &tri.c };
+        for (int k = 0; k < 3; k++) {
+            if (indices)
+                v[k] = _mm256_i32gather_epi32((const int*)indices, v[k], 4);
+            __m256i offset = _mm256_mullo_epi32(v[k], _mm256_set1_epi32(3));
+            corner[k]->x = _mm256_i32gather_ps(positions + 0, offset, 4);
+            corner[k]->y = _mm256_i32gather_ps(positions + 1, offset, 4);
+            corner[k]->z = _mm256_i32gather_ps(positions + 2, offset, 4);
+        }
+        __m256 hit;
+        unsigned mask = (unsigned)_mm256_movemask_ps(rayf_intersect_trianglex8(ray, &tri, _mm256_set1_ps(best), &hit, NULL, NULL));
+        if (!mask)
+            continue;
+        float hits[8];
+        _mm256_storeu_ps(hits, hit);
+        for (int k = 0; k < 8; k++) {
+            if (((mask >> k) & 1) && (!found || hits[k] < best)) {
+                best = hits[k];
+                *triangle = (uint32_t)(i + k);
+                found = true;
+            }
+        }
+    }
+    float tailHit;
+    uint32_t tailTriangle;
+    if (agl__ray_triangles_sse2(&tailHit, &tailTriangle, ray, indices ? positions : positions + 9 * i, indices ? indices + 3 * i : NULL,
+        triangleCount - i, best) && (!found || tailHit < best)) {
+        best = tailHit;
+        *triangle = (uint32_t)(i + tailTriangle);
+        found = true;
+    }
+    if (found)
+        *t = best;
+    return found;
+}
+
+bool agl_ray_triangles(float *t, uint32_t *triangle, const rayf_t *ray, const float *positions, const uint32_t *indices,
+    size_t triangleCount, float tmax) {
+    return agl__math_dispatch()->ray_triangles(t, triangle, ray, positions, indices, triangleCount, tmax);
+}
+
+static size_t agl__overlap_aabbs_sse2(uint32_t *indices, const aabbf_t *query, const aabbf_t *boxes, size_t count) {
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 lo[3], hi[3];
+        agl__aabb_load4(lo, hi, boxes + i);
+        __m128 overlap = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int k = 0; k < 3; k++) {
+            overlap = _mm_and_ps(overlap, _mm_and_ps(_mm_cmple_ps(lo[k], _mm_set1_ps(query->max._m[k])),
+                _mm_cmpge_ps(hi[k], _mm_set1_ps(query->min._m[k]))));
+        }
+        unsigned mask = (unsigned)_mm_movemask_ps(overlap);
+        for (int k = 0; k < 4; k++) {
+            if ((mask >> k) & 1)
+                indices[n++] = (uint32_t)(i + k);
+        }
+    }
+    for (; i < count; i++) {
+        if (aabbf_overlaps(boxes + i, query))
+            indices[n++] = (uint32_t)i;
+    }
+    return n;
+}
+
+static AGL_TARGET_AVX2 size_t agl__overlap_aabbs_avx2(uint32_t *indices, const aabbf_t *query, const aabbf_t *boxes, size_t count) {
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        aabbx8_t a = aabbx8_load(boxes + i);
+        unsigned mask = (unsigned)_mm256_movemask_ps(aabbx8_overlaps(&a, query));
+        for (int k = 0; k < 8; k++) {
+            if ((mask >> k) & 1)
+                indices[n++] = (uint32_t)(i + k);
+        }
+    }
+    size_t tail = agl__overlap_aabbs_sse2(indices + n, query, boxes + i, count - i);
+    for (size_t k = n; k < n + tail; k++)
+        indices[k] += (uint32_t)i;
+    return n + tail;
+}
+
+size_t agl_overlap_aabbs(uint32_t *indices, const aabbf_t *query, const aabbf_t *boxes, size_t count) {
+    return agl__math_dispatch()->overlap_aabbs(indices, query, boxes, count);
+}
+
+static size_t agl__overlap_spheres_sse2(uint32_t *indices, const spheref_t *query, const spheref_t *spheres, size_t count) {
+    const __m128 qx = _mm_set1_ps(query->_m[0]), qy = _mm_set1_ps(query->_m[1]), qz = _mm_set1_ps(query->_m[2]), qr = _mm_set1_ps(query->_m[3]);
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(spheres[i + 0]._m), y = _mm_loadu_ps(spheres[i + 1]._m);
+        __m128 z = _mm_loadu_ps(spheres[i + 2]._m), r = _mm_loadu_ps(spheres[i + 3]._m);
+        _MM_TRANSPOSE4_PS(x, y, z, r);
+        __m128 dx = _mm_sub_ps(x, qx), dy = _mm_sub_ps(y, qy), dz = _mm_sub_ps(z, qz), rr = _mm_add_ps(r, qr);
+        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        unsigned mask = (unsigned)_mm_movemask_ps(_mm_cmple_ps(d2, _mm_mul_ps(rr, rr)));
+        for (int k = 0; k < 4; k++) {
+            if ((mask >> k) & 1)
+                indices[n++] = (uint32_t)(i + k);
+        }
+    }
+    for (; i < count; i++) {
+        if (spheref_overlaps(spheres + i, query))
+            indices[n++] = (uint32_t)i;
+    }
+    return n;
+}
+
+static AGL_TARGET_AVX2 size_t agl__overlap_spheres_avx2(uint32_t *indices, const spheref_t *query, const spheref_t *spheres, size_t count) {
+    size_t n = 0;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        spherex8_t s = spherex8_load(spheres + i);
+        unsigned mask = (unsigned)_mm256_movemask_ps(spherex8_overlaps(&s, query));
+        for (int k = 0; k < 8; k++) {
+            if ((mask >> k) & 1)
+                indices[n++] = (uint32_t)(i + k);
+        }
+    }
+    size_t tail = agl__overlap_spheres_sse2(indices + n, query, spheres + i, count - i);
+    for (size_t k = n; k < n + tail; k++)
+        indices[k] += (uint32_t)i;
+    return n + tail;
+}
+
+size_t agl_overlap_spheres(uint32_t *indices, const spheref_t *query, const spheref_t *spheres, size_t count) {
+    return agl__math_dispatch()->overlap_spheres(indices, query, spheres, count);
+}
+
+// Palette matrix of one influence, joint indices are stored as floats and clamped to the palette
+static const float *agl__skin_joint(const float *palette, float joint, size_t jointCount) {
+    size_t j = joint > 0.f ? (size_t)joint : 0;
+    return palette + 16 * (j < jointCount ? j : jointCount - 1);
+}
+
+// Stores the first three lanes without touching the float after them
+static void agl__store_xyz(float *dst, __m128 v) {
+    _mm_storel_pi((__m64*)dst, v);
+    _mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+}
+
+// One vertex at a time: the four palette columns are blended as whole registers, then the position and normal transformed
+static void agl__skin_vertices_sse2(float *dstPositions, float *dstNormals, const float *positions, const float *normals,
+    const float *joints, const float *weights, const float *palette, size_t jointCount, size_t count) {
+    const bool skinNormals = normals && dstNormals;
+    for (size_t i = 0; i < count; i++) {
+        __m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+        for (int k = 0; k < 4; k++) {
+            const float *m = agl__skin_joint(palette, joints[4 * i + k], jointCount);
+            __m128 w = _mm_set1_ps(weights[4 * i + k]);
+            c0 = _mm_add_ps(c0, _mm_mul_ps(w, _mm_loadu_ps(m)));
+            c1 = _mm_add_ps(c1, _mm_mul_ps(w, _mm_loadu_ps(m + 4)));
+            c2 = _mm_add_ps(c2, _mm_mul_ps(w, _mm_loadu_ps(m + 8)));
+            c3 = _mm_add_ps(c3, _mm_mul_ps(w, _mm_loadu_ps(m + 12)));
+        }
+        const float *p = positions + 3 * i;
+        __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p[0])), _mm_mul_ps(c1, _mm_set1_ps(p[1]))),
+            _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p[2])), c3));
+        agl__store_xyz(dstPositions + 3 * i, v);
+        if (!skinNormals)
+            continue;
+        const float *n = normals + 3 * i;
+        v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(n[0])), _mm_mul_ps(c1, _mm_set1_ps(n[1]))),
+            _mm_mul_ps(c2, _mm_set1_ps(n[2])));
+        float xyz[4];
+        _mm_storeu_ps(xyz, v);
+        float len2 = xyz[0] * xyz[0] + xyz[1] * xyz[1] + xyz[2] * xyz[2];
+        float inv = len2 > 0.f ? 1.f / sqrtf(len2) : 0.f;
+        agl__store_xyz(dstNormals + 3 * i, _mm_mul_ps(v, _mm_set1_ps(inv)));
+    }
+}
+
+// VEX encoded copies of the helpers above. When they are not inlined (debug builds), calling legacy SSE code from AVX2
+// code pays an SSE/AVX transition on every call.
+static AGL_TARGET_AVX2 void agl__store_xyz_avx2(float *dst, __m128 v) {
+    _mm_storel_pi((__m64*)dst, v);
+    _mm_store_ss(dst + 2, _mm_movehl_ps(v, v));
+}
+
+static AGL_TARGET_AVX2 const float *agl__skin_joint_avx2(const float *palette, float joint, size_t jointCount) {
+    size_t j = joint > 0.f ? (size_t)joint : 0;
+    return palette + 16 * (j < jointCount ? j : jointCount - 1);
+}
+
+static AGL_TARGET_AVX2 __m256 agl__skin_column2(const float *a, const float *b) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(a)), _mm_loadu_ps(b), 1);
+}
+
+static AGL_TARGET_AVX2 __m256 agl__skin_broadcast2(float a, float b) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a)), _mm_set1_ps(b), 1);
+}
+
+// Two vertices per iteration, one per 128-bit half. Palette columns are contiguous, so plain loads beat gathering
+// the 48 scalars an 8-wide SoA blend needs per influence.
+static AGL_TARGET_AVX2 void agl__skin_vertices_avx2(float *dstPositions, float *dstNormals, const float *positions, const float *normals,
+    const float *joints, const float *weights, const float *palette, size_t jointCount, size_t count) {
+    const bool skinNormals = normals && dstNormals;
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m256 c0 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps(), c2 = _mm256_setzero_ps(), c3 = _mm256_setzero_ps();
+        for (int k = 0; k < 4; k++) {
+            const float *ma = agl__skin_joint_avx2(palette, joints[4 * i + k], jointCount);
+            const float *mb = agl__skin_joint_avx2(palette, joints[4 * i + 4 + k], jointCount);
+            __m256 w = agl__skin_broadcast2(weights[4 * i + k], weights[4 * i + 4 + k]);
+            c0 = _mm256_fmadd_ps(w, agl__skin_column2(ma, mb), c0);
+            c1 = _mm256_fmadd_ps(w, agl__skin_column2(ma + 4, mb + 4), c1);
+            c2 = _mm256_fmadd_ps(w, agl__skin_column2(ma + 8, mb + 8), c2);
+            c3 = _mm256_fmadd_ps(w, agl__skin_column2(ma + 12, mb + 12), c3);
+        }
+        const float *p = positions + 3 * i;
+        __m256 v = _mm256_fmadd_ps(c0, agl__skin_broadcast2(p[0], p[3]), _mm256_fmadd_ps(c1, agl__skin_broadcast2(p[1], p[4]),
+            _mm256_fmadd_ps(c2, agl__skin_broadcast2(p[2], p[5]), c3)));
+        agl__store_xyz_avx2(dstPositions + 3 * i, _mm256_castps256_ps128(v));
+        agl__store_xyz_avx2(dstPositions + 3 * i + 3, _mm256_extractf128_ps(v, 1));
+        if (!skinNormals)
+            continue;
+        const float *n = normals + 3 * i;
+        v = _mm256_fmadd_ps(c0, agl__skin_broadcast2(n[0], n[3]), _mm256_fmadd_ps(c1, agl__skin_broadcast2(n[1], n[4]),
+            _mm256_mul_ps(c2, agl__skin_broadcast2(n[2], n[5]))));
+        // Squared length of each half's xyz in all of its lanes, the w row of the palette is masked out
+        __m256 sq = _mm256_blend_ps(_mm256_mul_ps(v, v), _mm256_setzero_ps(), 0x88);
+        sq = _mm256_add_ps(sq, _mm256_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+        __m256 len2 = _mm256_add_ps(sq, _mm256_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 0, 3, 2)));
+        // Degenerate normals stay zero rather than turning into NaNs
+        __m256 inv = _mm256_and_ps(_mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(len2)),
+            _mm256_cmp_ps(len2, _mm256_setzero_ps(), _CMP_GT_OQ));
+        v = _mm256_mul_ps(v, inv);
+        agl__store_xyz_avx2(dstNormals + 3 * i, _mm256_castps256_ps128(v));
+        agl__store_xyz_avx2(dstNormals + 3 * i + 3, _mm256_extractf128_ps(v, 1));
+    }
+    agl__skin_vertices_sse2(dstPositions + 3 * i, skinNormals ? dstNormals + 3 * i : NULL, positions + 3 * i,
+        skinNormals ? normals + 3 * i : NULL, joints + 4 * i, weights + 4 * i, palette, jointCount, count - i);
+}
+
+void agl_skin_vertices(float *dstPositions, float *dstNormals, const float *positions, const float *normals,
+    const float *joints, const float *weights, const float *palette, size_t jointCount, size_t count) {
+    if (jointCount == 0)
+        return;
+    agl__math_dispatch()->skin_vertices(dstPositions, dstNormals, positions, normals, joints, weights, palette, jointCount, count);
+}
+
+uint32_t agl_cpu_set_features(uint32_t mask) {
+    agl__math_kernels_t k = {
+        agl__cpu_detect() & mask,
+        agl__vec3_add_sse2, agl__vec3_scale_sse2, agl__vec3_dot_sse2, agl__vec3_cross_sse2, agl__vec3_normalize_sse2,
+        agl__quat_apply_sse2, agl__mat3_mulvec3_sse2,
+        agl__mat4_transform_points_sse2, agl__mat4_transform_vectors_sse2, agl__mat4_project_points_sse2,
+        agl__vec3d_rebase_sse2, agl__vec3d_integrate_sse2, agl__mat4_rebase_sse2,
+        agl__sincos_sse2, agl__quat_from_axis_angle_sse2, agl__quat_from_vectors_sse2,
+        agl__rng_fill_float_sse2, agl__rng_fill_gaussian_sse2, agl__rng_fill_vec3_sse2,
+        agl__convert_packed_f32_sse2, agl__convert_packed_u32_sse2, agl__convert_packed_from_f32_sse2,
+        agl__bounds_minmax3_sse2, agl__cull_spheres_sse2,
+        agl__cull_aabbs_sse2, agl__ray_aabbs_sse2, agl__ray_triangles_sse2, agl__overlap_aabbs_sse2, agl__overlap_spheres_sse2,
+        agl__skin_vertices_sse2,
+    };
+    if (k.features & AGL_CPU_FEATURE_AVX2_BIT) {
+        k.vec3_add = agl__vec3_add_avx2;
+        k.vec3_scale = agl__vec3_scale_avx2;
+        k.vec3_dot = agl__vec3_dot_avx2;
+        k.vec3_cross = agl__vec3_cross_avx2;
+        k.vec3_normalize = agl__vec3_normalize_avx2;
+        k.quat_apply = agl__quat_apply_avx2;
+        k.mat3_mulvec3 = agl__mat3_mulvec3_avx2;
+        k.mat4_transform_points = agl__mat4_transform_points_avx2;
+        k.mat4_transform_vectors = agl__mat4_transform_vectors_avx2;
+        k.mat4_project_points = agl__mat4_project_points_avx2;
+        k.vec3d_rebase = agl__vec3d_rebase_avx2;
+        k.vec3d_integrate = agl__vec3d_integrate_avx2;
+        k.mat4_rebase = agl__mat4_rebase_avx2;
+        k.sincos = agl__sincos_avx2;
+        k.quat_from_axis_angle = agl__quat_from_axis_angle_avx2;
+        k.quat_from_vectors = agl__quat_from_vectors_avx2;
+        k.rng_fill_float = agl__rng_fill_float_avx2;
+        k.rng_fill_gaussian = agl__rng_fill_gaussian_avx2;
+        k.rng_fill_vec3 = agl__rng_fill_vec3_avx2;
+        k.convert_packed_f32 = agl__convert_packed_f32_avx2;
+        k.convert_packed_u32 = agl__convert_packed_u32_avx2;
+        k.convert_packed_from_f32 = agl__convert_packed_from_f32_avx2;
+        k.bounds_minmax3 = agl__bounds_minmax3_avx2;
+        k.cull_spheres = agl__cull_spheres_avx2;
+        k.cull_aabbs = agl__cull_aabbs_avx2;
+        k.ray_aabbs = agl__ray_aabbs_avx2;
+        k.ray_triangles = agl__ray_triangles_avx2;
+        k.overlap_aabbs = agl__overlap_aabbs_avx2;
+        k.overlap_spheres = agl__overlap_spheres_avx2;
+        k.skin_vertices = agl__skin_vertices_avx2;
+    }
+    if (k.features & AGL_CPU_FEATURE_AVX512_BIT) {
+        k.bounds_minmax3 = agl__bounds_minmax3_avx512;
+        k.cull_spheres = agl__cull_spheres_avx512;
+    }
+    agl__kernels = k;
+    agl__store_release(&agl__kernels_state, AGL__KERNELS_READY);
+    return k.features;
+}
+
+uint32_t agl_cpu_features(void) {
+    return agl__math_dispatch()->features;
+}
 
 #endif // AGL_MATH_IMPLEMENTED
 
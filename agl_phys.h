@@ -0,0 +1,2955 @@
+// agl_phys.h - v0.1.0 - AGL Physics Library
+//
+// PURPOSE
+//   Particle simulation sized for about a million particles per frame. Particle state is stored as separate x[], y[], z[] ...
+//   arrays and integrated 8 at a time. The position, size and colour arrays come first in one block of storage that can be
+//   a persistently mapped agl_gfx buffer, which agl_gfx_draw_particles draws straight from without a copy.
+//   Rigid boxes and spheres live in an agl_phys_world_t, stepped with a sequential impulse solver that caches contacts
+//   between steps, puts resting islands of bodies to sleep and solves separate islands on separate threads, splitting
+//   large islands between the threads colour by colour.
+//   The broadphases behind it, a dynamic AABB tree and a multithreaded sweep and prune, are usable on their own, and the
+//   world answers batched raycasts and box queries through its tree.
+//
+// USAGE
+//   #define AGL_PHYS_IMPLEMENTATION before including this file in *one* C or C++ file to create the implementation.
+//   Live particles are packed at the front of the arrays, [0, count). Spawning appends, and killing a particle moves the
+//   last one into its slot, so indices change whenever a particle dies. agl_phys_particles_update integrates every
+//   particle and then removes the ones whose life ran out. agl_phys_particles_integrate works on a range, so disjoint
+//   ranges can be integrated on different threads before a single agl_phys_particles_compact.
+//   Rigid bodies are named by the handles agl_phys_body_create returns, which stay valid until agl_phys_body_destroy.
+//   agl_phys_world_step finds the contacts, groups touching bodies into islands and solves the awake ones, splitting
+//   them between params.threadCount threads. Results do not depend on the thread count. An island sleeps once all of its
+//   bodies stay slow for params.sleepTime seconds, and wakes when an awake body touches it or a velocity is set.
+//
+//
+// MIT License
+//   Copyright (c) 2026 Athang Gupte
+//   Permission is hereby granted, free of charge, to any person obtaining a copy
+//   of this software and associated documentation files (the "Software"), to deal
+//   in the Software without restriction, including without limitation the rights
+//   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//   copies of the Software, and to permit persons to whom the Software is
+//   furnished to do so, subject to the following conditions:
+//   The above copyright notice and this permission notice shall be included in all
+//   copies or substantial portions of the Software.
+//   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//   SOFTWARE.
+
+#ifndef AGL_PHYS_H
+#define AGL_PHYS_H
+
+#ifndef	AGL_API
+#	if defined(_WIN32)
+#		if defined(AGL_EXPORTS)
+#			define AGL_API __declspec(dllexport)
+#		elif defined(AGL_IMPORTS)
+#			define AGL_API __declspec(dllimport)
+#		else
+#			define AGL_API extern
+#		endif
+#	else
+#		define AGL_API extern
+#	endif
+#endif // AGL_API
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "agl_math.h"
+
+typedef enum agl_phys_integrator_t {
+    AGL_PHYS_INTEGRATOR_EULER, // semi-implicit Euler: v += g * dt, then x += v * dt
+    AGL_PHYS_INTEGRATOR_VERLET, // velocity Verlet: x += v * dt + g * dt^2 / 2, then v += g * dt. Exact under gravity alone
+} agl_phys_integrator_t;
+
+// The arrays agl_gfx_draw_particles reads, in storage order
+typedef enum agl_phys_stream_t {
+    AGL_PHYS_STREAM_X,
+    AGL_PHYS_STREAM_Y,
+    AGL_PHYS_STREAM_Z,
+    AGL_PHYS_STREAM_SIZE,
+    AGL_PHYS_STREAM_COLOR,
+} agl_phys_stream_t;
+
+typedef struct agl_phys_particles_params_t {
+    uint32_t capacity; // most particles alive at once
+    void *storage; // agl_phys_particles_storage_size(capacity) bytes, e.g. a mapped agl_gfx buffer, or NULL to allocate
+    float gravity[3];
+    float drag; // velocities decay by exp(-drag * dt)
+    agl_phys_integrator_t integrator;
+} agl_phys_particles_params_t;
+
+// Particle state, one array per component. The arrays hold `capacity` entries, the requested capacity rounded up to 8.
+// gravity, drag and integrator may be changed between updates.
+typedef struct agl_phys_particles_t {
+    uint32_t count;
+    uint32_t capacity;
+    float *x, *y, *z;
+    float *size; // world space width of the billboard
+    uint32_t *color; // RGBA8 with red in the low byte, like agl_color
+    float *vx, *vy, *vz;
+    float *life; // seconds left, the particle is removed by the next compaction once it reaches 0
+    float gravity[3];
+    float drag;
+    agl_phys_integrator_t integrator;
+    void *storage;
+    uint32_t ownsStorage;
+} agl_phys_particles_t;
+
+typedef struct agl_phys_particle_t {
+    float pos[3];
+    float vel[3];
+    float life;
+    float size;
+    uint32_t color;
+} agl_phys_particle_t;
+
+// Spawns particles uniformly inside the sphere of `radius` around `pos`, moving at `vel` plus a random velocity uniform in
+// the ball of radius `spread`, with a life uniform in [lifeMin, lifeMax)
+typedef struct agl_phys_emitter_t {
+    float pos[3];
+    float radius;
+    float vel[3];
+    float spread;
+    float lifeMin, lifeMax;
+    float size;
+    uint32_t color;
+} agl_phys_emitter_t;
+
+// Bytes of storage for `capacity` particles, and the byte offset of one of the render streams within it
+AGL_API size_t agl_phys_particles_storage_size(uint32_t capacity);
+AGL_API size_t agl_phys_particles_stream_offset(uint32_t capacity, agl_phys_stream_t stream);
+
+AGL_API agl_phys_particles_t *agl_phys_particles_create(const agl_phys_particles_params_t *params);
+AGL_API void agl_phys_particles_destroy(agl_phys_particles_t *particles);
+// Appends up to `count` particles, fewer once the capacity is reached. Returns the number spawned.
+AGL_API uint32_t agl_phys_particles_spawn(agl_phys_particles_t *particles, const agl_phys_particle_t *src, uint32_t count);
+// Appends up to `count` particles from an emitter, drawn from the calling thread's agl_rng. Returns the number spawned.
+AGL_API uint32_t agl_phys_particles_emit(agl_phys_particles_t *particles, const agl_phys_emitter_t *emitter, uint32_t count);
+// Removes particle `index` at once, the last particle moves into its slot
+AGL_API void agl_phys_particles_kill(agl_phys_particles_t *particles, uint32_t index);
+// Advances particles [first, first + count) by `dt` seconds and ages them, without removing any
+AGL_API void agl_phys_particles_integrate(agl_phys_particles_t *particles, uint32_t first, uint32_t count, float dt);
+// Removes every particle whose life ran out, returns the number removed
+AGL_API uint32_t agl_phys_particles_compact(agl_phys_particles_t *particles);
+// Integrates all particles, then compacts. Returns the number removed.
+AGL_API uint32_t agl_phys_particles_update(agl_phys_particles_t *particles, float dt);
+
+// Rigid bodies
+
+#define AGL_PHYS_INVALID_BODY 0xFFFFFFFFu
+#define AGL_PHYS_MAX_THREADS 16
+
+typedef enum agl_phys_shape_t {
+    AGL_PHYS_SHAPE_SPHERE,
+    AGL_PHYS_SHAPE_BOX,
+} agl_phys_shape_t;
+
+// How the world finds the bodies that may touch. All three find the same pairs.
+typedef enum agl_phys_broadphase_t {
+    AGL_PHYS_BROADPHASE_GRID, // hashed uniform grid rebuilt every step, best when bodies are of similar size
+    AGL_PHYS_BROADPHASE_TREE, // the dynamic AABB tree the world keeps for queries, costs little when few bodies move
+    AGL_PHYS_BROADPHASE_SAP, // sweep and prune over all bodies, on all world threads
+} agl_phys_broadphase_t;
+
+typedef struct agl_phys_world_params_t {
+    uint32_t maxBodies;
+    vec3f_t gravity;
+    uint32_t threadCount; // threads islands and contacts are processed on, the calling thread included. 0 for 1, at most AGL_PHYS_MAX_THREADS
+    uint32_t iterations; // velocity iterations per step, 0 for 8
+    float sleepTime; // seconds a whole island must stay nearly at rest before it sleeps, 0 for 0.5. Negative disables sleeping
+    agl_phys_broadphase_t broadphase;
+} agl_phys_world_params_t;
+
+typedef struct agl_phys_body_desc_t {
+    agl_phys_shape_t shape;
+    vec3f_t halfExtents; // box half sizes, the radius in x for spheres
+    vec3f_t pos;
+    quatf_t rot;
+    vec3f_t linearVelocity;
+    vec3f_t angularVelocity; // radians per second, world space
+    float mass; // 0 for static bodies, which never move
+    float friction; // Coulomb coefficient, pairs use the geometric mean
+} agl_phys_body_desc_t;
+
+typedef struct agl_phys_world_stats_t {
+    uint32_t bodies;
+    uint32_t awakeBodies; // dynamic bodies simulated in the last step
+    uint32_t islands; // islands solved in the last step
+    uint32_t manifolds; // touching pairs
+    uint32_t contacts;
+} agl_phys_world_stats_t;
+
+typedef struct agl_phys_ray_hit_t {
+    uint32_t body; // AGL_PHYS_INVALID_BODY when the ray hit nothing
+    float t; // distance in units of the ray direction, 0 when the ray starts inside the body
+    vec3f_t normal; // unit surface normal at the hit, zero when the ray starts inside
+} agl_phys_ray_hit_t;
+
+typedef struct agl_phys_world_t agl_phys_world_t;
+
+AGL_API agl_phys_world_t *agl_phys_world_create(const agl_phys_world_params_t *params);
+AGL_API void agl_phys_world_destroy(agl_phys_world_t *world);
+// Advances the world by `dt` seconds: collision detection, then every awake island is solved on its own, in parallel when the
+// world has more than one thread. Results do not depend on the thread count.
+AGL_API void agl_phys_world_step(agl_phys_world_t *world, float dt);
+AGL_API void agl_phys_world_get_stats(const agl_phys_world_t *world, agl_phys_world_stats_t *stats);
+
+// Returns AGL_PHYS_INVALID_BODY once maxBodies bodies exist. Dynamic bodies start awake.
+AGL_API uint32_t agl_phys_body_create(agl_phys_world_t *world, const agl_phys_body_desc_t *desc);
+AGL_API void agl_phys_body_destroy(agl_phys_world_t *world, uint32_t body);
+AGL_API void agl_phys_body_get_transform(const agl_phys_world_t *world, uint32_t body, vec3f_t *pos, quatf_t *rot);
+AGL_API void agl_phys_body_get_velocity(const agl_phys_world_t *world, uint32_t body, vec3f_t *linear, vec3f_t *angular);
+// Sets the velocity of a dynamic body and wakes it
+AGL_API void agl_phys_body_set_velocity(agl_phys_world_t *world, uint32_t body, const vec3f_t *linear, const vec3f_t *angular);
+AGL_API bool agl_phys_body_is_sleeping(const agl_phys_world_t *world, uint32_t body);
+
+// Closest body each of `count` rays hits within `tmax`, against the exact box and sphere shapes, e.g. for gameplay raycasts
+// and picking. Returns the number of rays that hit something.
+AGL_API uint32_t agl_phys_world_raycast(const agl_phys_world_t *world, agl_phys_ray_hit_t *hits, const rayf_t *rays, uint32_t count,
+    float tmax);
+// Bodies whose bounds overlap each of `count` boxes, written as agl_phys_tree_query writes proxies
+AGL_API uint32_t agl_phys_world_query(const agl_phys_world_t *world, uint32_t *bodies, uint32_t *starts, uint32_t capacity,
+    const aabbf_t *boxes, uint32_t count);
+
+// Broadphase
+// A dynamic AABB tree that is updated as boxes move and answers queries, and a sweep and prune that finds all overlapping
+// pairs of a box array at once. The world finds its pairs with either of them or with its grid, and both work on their
+// own as well, e.g. for triggers or particles against level geometry.
+
+#define AGL_PHYS_INVALID_PROXY 0xFFFFFFFFu
+
+typedef struct agl_phys_pair_t {
+    uint32_t a, b; // a < b
+} agl_phys_pair_t;
+
+typedef struct agl_phys_tree_params_t {
+    uint32_t capacity; // proxies to make room for up front, the tree grows past it
+    float margin; // boxes are stored grown by this much so small moves need no update, 0 for 0.1
+} agl_phys_tree_params_t;
+
+typedef struct agl_phys_tree_stats_t {
+    uint32_t proxies;
+    uint32_t height; // of the root, leaves are 0
+    float areaRatio; // surface area of all internal nodes over that of the root, lower means cheaper queries
+    size_t memory; // bytes
+} agl_phys_tree_stats_t;
+
+typedef struct agl_phys_tree_t agl_phys_tree_t;
+
+AGL_API agl_phys_tree_t *agl_phys_tree_create(const agl_phys_tree_params_t *params);
+AGL_API void agl_phys_tree_destroy(agl_phys_tree_t *tree);
+// Adds `box` and returns its proxy, which stays valid until it is removed, or AGL_PHYS_INVALID_PROXY when out of memory
+AGL_API uint32_t agl_phys_tree_insert(agl_phys_tree_t *tree, const aabbf_t *box, uint32_t user);
+AGL_API void agl_phys_tree_remove(agl_phys_tree_t *tree, uint32_t proxy);
+// Nothing happens while `box` stays inside the proxy's stored box. Otherwise the proxy is reinserted with a new stored box,
+// grown by the margin and stretched by `displacement`, the motion expected before the next move, and true is returned.
+AGL_API bool agl_phys_tree_move(agl_phys_tree_t *tree, uint32_t proxy, const aabbf_t *box, const vec3f_t *displacement);
+// The stored box, which contains the one last given
+AGL_API aabbf_t agl_phys_tree_get_box(const agl_phys_tree_t *tree, uint32_t proxy);
+AGL_API uint32_t agl_phys_tree_get_user(const agl_phys_tree_t *tree, uint32_t proxy);
+AGL_API void agl_phys_tree_get_stats(const agl_phys_tree_t *tree, agl_phys_tree_stats_t *stats);
+// Proxies whose stored boxes overlap each of `count` boxes. Those of box i are written to proxies[starts[i], starts[i + 1]),
+// `starts` has count + 1 entries. Results past `capacity` are dropped and the return value is the number found, so a
+// return value above `capacity` means the call should be repeated with more room.
+AGL_API uint32_t agl_phys_tree_query(const agl_phys_tree_t *tree, uint32_t *proxies, uint32_t *starts, uint32_t capacity,
+    const aabbf_t *boxes, uint32_t count);
+// Proxies whose stored boxes each of `count` rays hits within `tmax`, written as agl_phys_tree_query writes them
+AGL_API uint32_t agl_phys_tree_raycast(const agl_phys_tree_t *tree, uint32_t *proxies, uint32_t *starts, uint32_t capacity,
+    const rayf_t *rays, uint32_t count, float tmax);
+// Every pair of proxies whose stored boxes overlap. Returns the number found, writing at most `capacity`.
+AGL_API uint32_t agl_phys_tree_find_pairs(const agl_phys_tree_t *tree, agl_phys_pair_t *pairs, uint32_t capacity);
+
+typedef struct agl_phys_sap_params_t {
+    uint32_t threadCount; // threads the sweep is split between, the calling thread included. 0 for 1, at most AGL_PHYS_MAX_THREADS
+} agl_phys_sap_params_t;
+
+typedef struct agl_phys_sap_stats_t {
+    uint32_t boxes;
+    uint32_t pairs;
+    uint32_t axis; // the sweep axis, the one the box centres spread furthest along
+    uint32_t swaps; // moves made re-sorting the previous order, 0 when the boxes were sorted from scratch
+    bool resorted; // true when the boxes were sorted from scratch
+    size_t memory; // bytes
+} agl_phys_sap_stats_t;
+
+typedef struct agl_phys_sap_t agl_phys_sap_t;
+
+AGL_API agl_phys_sap_t *agl_phys_sap_create(const agl_phys_sap_params_t *params);
+AGL_API void agl_phys_sap_destroy(agl_phys_sap_t *sap);
+// Finds every overlapping pair of `boxes`, as indices into the array, and returns their number. Boxes with min > max
+// overlap nothing, e.g. for unused slots. The sorted order is kept between calls, so while `count` and the axis stay the
+// same, boxes that moved a little are re-sorted in close to linear time. Returns 0 when out of memory.
+AGL_API uint32_t agl_phys_sap_find_pairs(agl_phys_sap_t *sap, const aabbf_t *boxes, uint32_t count);
+// The pairs of the last agl_phys_sap_find_pairs, in the same order for any thread count
+AGL_API const agl_phys_pair_t *agl_phys_sap_get_pairs(const agl_phys_sap_t *sap);
+AGL_API void agl_phys_sap_get_stats(const agl_phys_sap_t *sap, agl_phys_sap_stats_t *stats);
+
+#endif // AGL_PHYS_H
+
+#ifdef AGL_PHYS_IMPLEMENTATION
+
+#ifndef AGL_PHYS_IMPLEMENTED
+#define AGL_PHYS_IMPLEMENTED
+
+#include <immintrin.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#   ifndef WIN32_LEAN_AND_MEAN
+#   define WIN32_LEAN_AND_MEAN 1
+#   endif
+#   include <windows.h>
+#else
+#   include <pthread.h>
+#endif
+
+#define AGL__PHYS_STREAM_COUNT 9
+#define AGL__PHYS_EMIT_BATCH 256
+
+static uint32_t agl__PhysPadCapacity(uint32_t capacity) {
+    return (capacity + 7) & ~7u;
+}
+
+size_t agl_phys_particles_storage_size(uint32_t capacity) {
+    return (size_t)agl__PhysPadCapacity(capacity) * AGL__PHYS_STREAM_COUNT * sizeof(float);
+}
+
+size_t agl_phys_particles_stream_offset(uint32_t capacity, agl_phys_stream_t stream) {
+    return (size_t)agl__PhysPadCapacity(capacity) * (size_t)stream * sizeof(float);
+}
+
+agl_phys_particles_t *agl_phys_particles_create(const agl_phys_particles_params_t *params) {
+    agl_phys_particles_t *p = (agl_phys_particles_t*)calloc(1, sizeof(agl_phys_particles_t));
+    if (!p)
+        return NULL;
+    uint32_t capacity = agl__PhysPadCapacity(params->capacity);
+    p->storage = params->storage;
+    if (!p->storage) {
+        p->storage = calloc(1, agl_phys_particles_storage_size(capacity));
+        p->ownsStorage = 1;
+        if (!p->storage) {
+            free(p);
+            return NULL;
+        }
+    }
+    // The render streams come first, in agl_phys_stream_t order
+    float *stream = (float*)p->storage;
+    p->x = stream; stream += capacity;
+    p->y = stream; stream += capacity;
+    p->z = stream; stream += capacity;
+    p->size = stream; stream += capacity;
+    p->color = (uint32_t*)stream; stream += capacity;
+    p->vx = stream; stream += capacity;
+    p->vy = stream; stream += capacity;
+    p->vz = stream; stream += capacity;
+    p->life = stream;
+    p->count = 0;
+    p->capacity = capacity;
+    memcpy(p->gravity, params->gravity, sizeof(p->gravity));
+    p->drag = params->drag;
+    p->integrator = params->integrator;
+    return p;
+}
+
+void agl_phys_particles_destroy(agl_phys_particles_t *p) {
+    if (!p)
+        return;
+    if (p->ownsStorage)
+        free(p->storage);
+    free(p);
+}
+
+uint32_t agl_phys_particles_spawn(agl_phys_particles_t *p, const agl_phys_particle_t *src, uint32_t count) {
+    uint32_t n = p->capacity - p->count < count ? p->capacity - p->count : count;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t j = p->count + i;
+        p->x[j] = src[i].pos[0];
+        p->y[j] = src[i].pos[1];
+        p->z[j] = src[i].pos[2];
+        p->vx[j] = src[i].vel[0];
+        p->vy[j] = src[i].vel[1];
+        p->vz[j] = src[i].vel[2];
+        p->life[j] = src[i].life;
+        p->size[j] = src[i].size;
+        p->color[j] = src[i].color;
+    }
+    p->count += n;
+    return n;
+}
+
+uint32_t agl_phys_particles_emit(agl_phys_particles_t *p, const agl_phys_emitter_t *e, uint32_t count) {
+    uint32_t n = p->capacity - p->count < count ? p->capacity - p->count : count;
+    agl_rng_t *rng = agl_rng_thread();
+    vec3f_t offsets[AGL__PHYS_EMIT_BATCH];
+    for (uint32_t done = 0; done < n; done += AGL__PHYS_EMIT_BATCH) {
+        uint32_t batch = n - done < AGL__PHYS_EMIT_BATCH ? n - done : AGL__PHYS_EMIT_BATCH;
+        uint32_t first = p->count + done;
+        agl_rng_fill_in_sphere(rng, offsets, batch);
+        for (uint32_t i = 0; i < batch; i++) {
+            p->x[first + i] = e->pos[0] + offsets[i]._m[0] * e->radius;
+            p->y[first + i] = e->pos[1] + offsets[i]._m[1] * e->radius;
+            p->z[first + i] = e->pos[2] + offsets[i]._m[2] * e->radius;
+        }
+        agl_rng_fill_in_sphere(rng, offsets, batch);
+        for (uint32_t i = 0; i < batch; i++) {
+            p->vx[first + i] = e->vel[0] + offsets[i]._m[0] * e->spread;
+            p->vy[first + i] = e->vel[1] + offsets[i]._m[1] * e->spread;
+            p->vz[first + i] = e->vel[2] + offsets[i]._m[2] * e->spread;
+            p->size[first + i] = e->size;
+            p->color[first + i] = e->color;
+        }
+        agl_rng_fill_float(rng, p->life + first, batch, e->lifeMin, e->lifeMax);
+    }
+    p->count += n;
+    return n;
+}
+
+static void agl__PhysParticlesMove(agl_phys_particles_t *p, uint32_t dst, uint32_t src) {
+    p->x[dst] = p->x[src];
+    p->y[dst] = p->y[src];
+    p->z[dst] = p->z[src];
+    p->size[dst] = p->size[src];
+    p->color[dst] = p->color[src];
+    p->vx[dst] = p->vx[src];
+    p->vy[dst] = p->vy[src];
+    p->vz[dst] = p->vz[src];
+    p->life[dst] = p->life[src];
+}
+
+void agl_phys_particles_kill(agl_phys_particles_t *p, uint32_t index) {
+    if (index >= p->count)
+        return;
+    agl__PhysParticlesMove(p, index, --p->count);
+}
+
+// Per step constants shared by the scalar, SSE2 and AVX2 paths so they round the same way
+typedef struct agl__phys_step_t {
+    float dv[3]; // g * dt
+    float dx[3]; // g * dt^2 / 2 for Verlet, 0 for Euler
+    float damp;
+    float dt;
+} agl__phys_step_t;
+
+static void agl__PhysParticlesIntegrateScalar(agl_phys_particles_t *p, const agl__phys_step_t *s, uint32_t first, uint32_t last) {
+    const bool verlet = p->integrator == AGL_PHYS_INTEGRATOR_VERLET;
+    float *const pos[3] = { p->x, p->y, p->z };
+    float *const vel[3] = { p->vx, p->vy, p->vz };
+    for (uint32_t i = first; i < last; i++) {
+        for (int c = 0; c < 3; c++) {
+            float v = vel[c][i];
+            if (verlet)
+                pos[c][i] = pos[c][i] + (v * s->dt + s->dx[c]);
+            v = (v + s->dv[c]) * s->damp;
+            if (!verlet)
+                pos[c][i] = pos[c][i] + v * s->dt;
+            vel[c][i] = v;
+        }
+        p->life[i] = p->life[i] - s->dt;
+    }
+}
+
+static uint32_t agl__PhysParticlesIntegrateSse2(agl_phys_particles_t *p, const agl__phys_step_t *s, uint32_t first, uint32_t last) {
+    const bool verlet = p->integrator == AGL_PHYS_INTEGRATOR_VERLET;
+    float *const pos[3] = { p->x, p->y, p->z };
+    float *const vel[3] = { p->vx, p->vy, p->vz };
+    const __m128 dt = _mm_set1_ps(s->dt), damp = _mm_set1_ps(s->damp);
+    __m128 dv[3], dx[3];
+    for (int c = 0; c < 3; c++) {
+        dv[c] = _mm_set1_ps(s->dv[c]);
+        dx[c] = _mm_set1_ps(s->dx[c]);
+    }
+    uint32_t i = first;
+    for (; i + 4 <= last; i += 4) {
+        for (int c = 0; c < 3; c++) {
+            __m128 x = _mm_loadu_ps(pos[c] + i), v = _mm_loadu_ps(vel[c] + i);
+            if (verlet)
+                x = _mm_add_ps(x, _mm_add_ps(_mm_mul_ps(v, dt), dx[c]));
+            v = _mm_mul_ps(_mm_add_ps(v, dv[c]), damp);
+            if (!verlet)
+                x = _mm_add_ps(x, _mm_mul_ps(v, dt));
+            _mm_storeu_ps(pos[c] + i, x);
+            _mm_storeu_ps(vel[c] + i, v);
+        }
+        _mm_storeu_ps(p->life + i, _mm_sub_ps(_mm_loadu_ps(p->life + i), dt));
+    }
+    return i;
+}
+
+static AGL_TARGET_AVX2 uint32_t agl__PhysParticlesIntegrateAvx2(agl_phys_particles_t *p, const agl__phys_step_t *s, uint32_t first, uint32_t last) {
+    const bool verlet = p->integrator == AGL_PHYS_INTEGRATOR_VERLET;
+    const __m256 dt = _mm256_set1_ps(s->dt), damp = _mm256_set1_ps(s->damp);
+    const vec3x8_t dv = { _mm256_set1_ps(s->dv[0]), _mm256_set1_ps(s->dv[1]), _mm256_set1_ps(s->dv[2]) };
+    const vec3x8_t dx = { _mm256_set1_ps(s->dx[0]), _mm256_set1_ps(s->dx[1]), _mm256_set1_ps(s->dx[2]) };
+    uint32_t i = first;
+    for (; i + 8 <= last; i += 8) {
+        vec3x8_t x = { _mm256_loadu_ps(p->x + i), _mm256_loadu_ps(p->y + i), _mm256_loadu_ps(p->z + i) };
+        vec3x8_t v = { _mm256_loadu_ps(p->vx + i), _mm256_loadu_ps(p->vy + i), _mm256_loadu_ps(p->vz + i) };
+        vec3x8_t step;
+        if (verlet) {
+            step = vec3x8_scale(&v, dt);
+            step = vec3x8_add(&step, &dx);
+            x = vec3x8_add(&x, &step);
+        }
+        v = vec3x8_add(&v, &dv);
+        v = vec3x8_scale(&v, damp);
+        if (!verlet) {
+            step = vec3x8_scale(&v, dt);
+            x = vec3x8_add(&x, &step);
+        }
+        _mm256_storeu_ps(p->x + i, x.x);
+        _mm256_storeu_ps(p->y + i, x.y);
+        _mm256_storeu_ps(p->z + i, x.z);
+        _mm256_storeu_ps(p->vx + i, v.x);
+        _mm256_storeu_ps(p->vy + i, v.y);
+        _mm256_storeu_ps(p->vz + i, v.z);
+        _mm256_storeu_ps(p->life + i, _mm256_sub_ps(_mm256_loadu_ps(p->life + i), dt));
+    }
+    return i;
+}
+
+void agl_phys_particles_integrate(agl_phys_particles_t *p, uint32_t first, uint32_t count, float dt) {
+    uint32_t last = first + count < p->count ? first + count : p->count;
+    if (first >= last)
+        return;
+    agl__phys_step_t s;
+    const bool verlet = p->integrator == AGL_PHYS_INTEGRATOR_VERLET;
+    for (int c = 0; c < 3; c++) {
+        s.dv[c] = p->gravity[c] * dt;
+        s.dx[c] = verlet ? 0.5f * p->gravity[c] * dt * dt : 0.f;
+    }
+    s.damp = expf(-p->drag * dt);
+    s.dt = dt;
+    // The tail is left to the scalar loop rather than padded, a padded store could race with a thread integrating the next range
+    if (agl_cpu_features() & AGL_CPU_FEATURE_AVX2_BIT)
+        first = agl__PhysParticlesIntegrateAvx2(p, &s, first, last);
+    else
+        first = agl__PhysParticlesIntegrateSse2(p, &s, first, last);
+    agl__PhysParticlesIntegrateScalar(p, &s, first, last);
+}
+
+uint32_t agl_phys_particles_compact(agl_phys_particles_t *p) {
+    uint32_t before = p->count;
+    uint32_t i = 0;
+    while (i < p->count) {
+        // Skip live particles 4 at a time, dead ones are rare in most frames
+        if (i + 4 <= p->count && _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(p->life + i), _mm_setzero_ps())) == 0) {
+            i += 4;
+            continue;
+        }
+        if (p->life[i] <= 0.f)
+            agl__PhysParticlesMove(p, i, --p->count); // the moved particle is tested next
+        else
+            i++;
+    }
+    return before - p->count;
+}
+
+uint32_t agl_phys_particles_update(agl_phys_particles_t *p, float dt) {
+    agl_phys_particles_integrate(p, 0, p->count, dt);
+    return agl_phys_particles_compact(p);
+}
+
+// Rigid bodies
+
+#define AGL__PHYS_MARGIN 0.02f // contacts are kept up to this separation, and matched to cached ones within it
+#define AGL__PHYS_SLOP 0.005f // penetration left uncorrected so resting contacts stay touching
+#define AGL__PHYS_BAUMGARTE 0.2f
+#define AGL__PHYS_MAX_CORRECTION 4.f // fastest push out of penetration, in m/s
+#define AGL__PHYS_SLEEP_LINEAR 0.05f
+#define AGL__PHYS_SLEEP_ANGULAR 0.05f
+
+enum {
+    AGL__PHYS_BODY_ALIVE = 1,
+    AGL__PHYS_BODY_SLEEPING = 2,
+};
+
+typedef struct agl__phys_body_t {
+    vec3f_t pos;
+    quatf_t rot;
+    vec3f_t v, w;
+    vec3f_t halfExtents;
+    vec3f_t invInertiaLocal; // principal axes of boxes and spheres are the local axes
+    mat3f_t axes; // rotation matrix of rot, columns are the local axes
+    mat3f_t invInertia; // world space, axes * diag(invInertiaLocal) * axes^T
+    float invMass;
+    float friction;
+    float restTime; // seconds spent below the sleep thresholds
+    uint32_t shape;
+    uint32_t flags;
+    uint32_t proxy; // in the world's tree
+} agl__phys_body_t;
+
+typedef struct agl__phys_contact_t {
+    vec3f_t point; // world space, halfway between the surfaces
+    vec3f_t localA; // point in A's frame, matched against next step's contacts to carry the impulses over
+    float separation; // negative when penetrating
+    float normalImpulse;
+} agl__phys_contact_t;
+
+typedef struct agl__phys_manifold_t {
+    uint32_t a, b; // a < b
+    uint32_t count;
+    vec3f_t normal; // from a to b
+    float friction;
+    vec3f_t frictionImpulse; // at the centre of the points, world space
+    float twistImpulse;
+    agl__phys_contact_t contacts[4];
+} agl__phys_manifold_t;
+
+typedef struct agl__phys_cell_entry_t {
+    aabbf_t box; // copied so the neighbour search reads one array
+    int32_t cell[3];
+    uint32_t dyn; // index into the dynamic body arrays
+    uint32_t hash;
+} agl__phys_cell_entry_t;
+
+typedef struct agl__phys_solver_body_t {
+    vec3f_t v, w;
+} agl__phys_solver_body_t;
+
+// One row of four manifolds, one per lane, as [axis][lane]
+typedef struct agl__phys_row_t {
+    float rAxd[3][4], rBxd[3][4]; // angular jacobians
+    float iArAxd[3][4], iBrBxd[3][4]; // the same through the inverse inertias
+    float mass[4];
+    float impulse[4];
+} agl__phys_row_t;
+
+// Four manifolds of one colour
+typedef struct agl__phys_bundle_t {
+    uint32_t a[4], b[4]; // solver bodies, unused lanes point at the static stand-in
+    float invMassA[4], invMassB[4];
+    float friction[4];
+    float twistRadius[4]; // mean distance of the points from their centre, scales the twist friction
+    float normalDir[3][4];
+    float tangentDir[2][3][4];
+    float bias[4][4];
+    agl__phys_row_t normal[4]; // rows of unused points are all zero
+    agl__phys_row_t tangent[2];
+    agl__phys_row_t twist;
+    agl__phys_manifold_t *manifold[4]; // NULL in unused lanes
+} agl__phys_bundle_t;
+
+// Per thread solver memory, grown to the largest island the thread meets
+typedef struct agl__phys_scratch_t {
+    agl__phys_solver_body_t *bodies;
+    uint32_t bodyCapacity;
+    uint64_t *colors;
+    uint32_t colorCapacity;
+    agl__phys_bundle_t *bundles;
+    uint32_t bundleCapacity;
+    uint32_t *lanes; // manifold of each bundle lane within its island, UINT32_MAX for unused lanes
+    uint32_t laneCapacity;
+} agl__phys_scratch_t;
+
+struct agl_phys_world_t {
+    vec3f_t gravity;
+    uint32_t threadCount;
+    uint32_t iterations;
+    float sleepTime;
+    float dt;
+    agl_phys_broadphase_t broadphase;
+    agl__phys_body_t *bodies;
+    uint32_t bodyCount; // slots in use, destroyed ones included
+    uint32_t maxBodies;
+    uint32_t *freeBodies;
+    uint32_t freeCount;
+    // Broadphase, the tree is kept for queries whichever finds the pairs
+    agl_phys_tree_t *tree;
+    agl_phys_sap_t *sap;
+    agl_phys_pair_t *treePairs; // proxy pairs from the tree
+    uint32_t treePairCapacity;
+    aabbf_t *aabbs; // bounds of every body slot, empty for unused ones
+    aabbf_t *dynAabbs;
+    uint32_t *dynBodies;
+    uint32_t *overlaps;
+    agl__phys_cell_entry_t *cellEntries, *sortedEntries; // one per dynamic body, by body and by hash bucket
+    uint32_t *cellStarts;
+    uint32_t cellTableCapacity;
+    agl_phys_pair_t *pairs;
+    uint32_t pairCount, pairCapacity;
+    // Contacts: this step's manifolds, and last step's with a table from body pair to manifold
+    agl__phys_manifold_t *manifolds, *prevManifolds;
+    uint32_t manifoldCount, prevManifoldCount, manifoldCapacity;
+    uint32_t *manifoldTable;
+    uint32_t manifoldTableMask;
+    // Islands, their bodies and manifolds stored contiguously
+    uint32_t *parent;
+    uint32_t *islandOf;
+    uint32_t *islandBodyStart, *islandBodies;
+    uint32_t *islandManifoldStart, *islandManifolds;
+    uint32_t islandManifoldCapacity;
+    uint32_t islandCount;
+    uint32_t *islandAwake;
+    uint32_t *solverIndex; // body to solver body within its island
+    agl__phys_scratch_t scratch[AGL_PHYS_MAX_THREADS];
+    agl_phys_world_stats_t stats;
+};
+
+static bool agl__PhysReserve(void **ptr, uint32_t *capacity, uint32_t needed, size_t size) {
+    if (needed <= *capacity)
+        return true;
+    uint32_t grown = needed > 2 * *capacity ? needed : 2 * *capacity;
+    void *p = realloc(*ptr, (size_t)grown * size);
+    if (!p)
+        return false;
+    *ptr = p;
+    *capacity = grown;
+    return true;
+}
+
+static vec3f_t agl__PhysAxis(const mat3f_t *m, int i) {
+    return vec3f(m->_m[i][0], m->_m[i][1], m->_m[i][2]);
+}
+
+static void agl__PhysUpdateBody(agl__phys_body_t *b) {
+    mat3f_fromquat(&b->axes, &b->rot);
+    mat3f_t scaled = b->axes, axesT = b->axes;
+    for (int c = 0; c < 3; c++)
+        for (int r = 0; r < 3; r++)
+            scaled._m[c][r] *= b->invInertiaLocal._m[c];
+    mat3f_transpose(&axesT);
+    mat3f_mul(&b->invInertia, &scaled, &axesT);
+}
+
+static aabbf_t agl__PhysBodyBounds(const agl__phys_body_t *b) {
+    vec3f_t e = b->halfExtents;
+    if (b->shape == AGL_PHYS_SHAPE_BOX) {
+        for (int i = 0; i < 3; i++)
+            e._m[i] = fabsf(b->axes._m[0][i]) * b->halfExtents._m[0] + fabsf(b->axes._m[1][i]) * b->halfExtents._m[1] +
+                fabsf(b->axes._m[2][i]) * b->halfExtents._m[2];
+    }
+    aabbf_t box;
+    for (int i = 0; i < 3; i++) {
+        box.min._m[i] = b->pos._m[i] - e._m[i] - AGL__PHYS_MARGIN;
+        box.max._m[i] = b->pos._m[i] + e._m[i] + AGL__PHYS_MARGIN;
+    }
+    box.min._m[3] = box.max._m[3] = 0.f;
+    return box;
+}
+
+agl_phys_world_t *agl_phys_world_create(const agl_phys_world_params_t *params) {
+    agl_phys_world_t *w = (agl_phys_world_t*)calloc(1, sizeof(agl_phys_world_t));
+    if (!w)
+        return NULL;
+    uint32_t n = params->maxBodies;
+    w->gravity = params->gravity;
+    w->threadCount = params->threadCount == 0 ? 1 : params->threadCount > AGL_PHYS_MAX_THREADS ? AGL_PHYS_MAX_THREADS : params->threadCount;
+    w->iterations = params->iterations ? params->iterations : 8;
+    w->sleepTime = params->sleepTime == 0.f ? 0.5f : params->sleepTime;
+    w->broadphase = params->broadphase;
+    w->maxBodies = n;
+    w->tree = agl_phys_tree_create(&(agl_phys_tree_params_t){ n, 0.1f });
+    if (w->broadphase == AGL_PHYS_BROADPHASE_SAP)
+        w->sap = agl_phys_sap_create(&(agl_phys_sap_params_t){ w->threadCount });
+    w->bodies = (agl__phys_body_t*)malloc(n * sizeof(agl__phys_body_t));
+    w->freeBodies = (uint32_t*)malloc(n * sizeof(uint32_t));
+    w->aabbs = (aabbf_t*)malloc(n * sizeof(aabbf_t));
+    w->dynAabbs = (aabbf_t*)malloc(n * sizeof(aabbf_t));
+    w->dynBodies = (uint32_t*)malloc(n * sizeof(uint32_t));
+    w->cellEntries = (agl__phys_cell_entry_t*)malloc(n * sizeof(agl__phys_cell_entry_t));
+    w->sortedEntries = (agl__phys_cell_entry_t*)malloc(n * sizeof(agl__phys_cell_entry_t));
+    w->overlaps = (uint32_t*)malloc(n * sizeof(uint32_t));
+    w->parent = (uint32_t*)malloc(n * sizeof(uint32_t));
+    w->islandOf = (uint32_t*)malloc(n * sizeof(uint32_t));
+    w->islandBodyStart = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+    w->islandBodies = (uint32_t*)malloc(n * sizeof(uint32_t));
+    w->islandManifoldStart = (uint32_t*)malloc((n + 1) * sizeof(uint32_t));
+    w->islandAwake = (uint32_t*)malloc(n * sizeof(uint32_t));
+    w->solverIndex = (uint32_t*)malloc(n * sizeof(uint32_t));
+    if (!w->tree || (w->broadphase == AGL_PHYS_BROADPHASE_SAP && !w->sap) || !w->bodies || !w->freeBodies || !w->aabbs || !w->dynAabbs || !w->dynBodies || !w->cellEntries || !w->sortedEntries || !w->overlaps || !w->parent ||
+        !w->islandOf || !w->islandBodyStart || !w->islandBodies || !w->islandManifoldStart || !w->islandAwake || !w->solverIndex) {
+        agl_phys_world_destroy(w);
+        return NULL;
+    }
+    return w;
+}
+
+void agl_phys_world_destroy(agl_phys_world_t *w) {
+    if (!w)
+        return;
+    for (uint32_t t = 0; t < AGL_PHYS_MAX_THREADS; t++) {
+        free(w->scratch[t].bodies);
+        free(w->scratch[t].colors);
+        free(w->scratch[t].bundles);
+        free(w->scratch[t].lanes);
+    }
+    agl_phys_tree_destroy(w->tree);
+    agl_phys_sap_destroy(w->sap);
+    free(w->bodies);
+    free(w->freeBodies);
+    free(w->aabbs);
+    free(w->dynAabbs);
+    free(w->dynBodies);
+    free(w->overlaps);
+    free(w->cellEntries);
+    free(w->sortedEntries);
+    free(w->cellStarts);
+    free(w->pairs);
+    free(w->treePairs);
+    free(w->manifolds);
+    free(w->prevManifolds);
+    free(w->manifoldTable);
+    free(w->parent);
+    free(w->islandOf);
+    free(w->islandBodyStart);
+    free(w->islandBodies);
+    free(w->islandManifoldStart);
+    free(w->islandManifolds);
+    free(w->islandAwake);
+    free(w->solverIndex);
+    free(w);
+}
+
+uint32_t agl_phys_body_create(agl_phys_world_t *w, const agl_phys_body_desc_t *desc) {
+    uint32_t index;
+    if (w->freeCount)
+        index = w->freeBodies[--w->freeCount];
+    else if (w->bodyCount < w->maxBodies)
+        index = w->bodyCount++;
+    else
+        return AGL_PHYS_INVALID_BODY;
+    agl__phys_body_t *b = &w->bodies[index];
+    memset(b, 0, sizeof(*b));
+    b->shape = desc->shape;
+    b->halfExtents = desc->halfExtents;
+    if (desc->shape == AGL_PHYS_SHAPE_SPHERE)
+        b->halfExtents = vec3f(desc->halfExtents._m[0], desc->halfExtents._m[0], desc->halfExtents._m[0]);
+    b->pos = desc->pos;
+    b->rot = desc->rot;
+    quatf_normalize(&b->rot);
+    b->friction = desc->friction;
+    b->flags = AGL__PHYS_BODY_ALIVE;
+    if (desc->mass > 0.f) {
+        float x = b->halfExtents._m[0], y = b->halfExtents._m[1], z = b->halfExtents._m[2];
+        b->invMass = 1.f / desc->mass;
+        if (desc->shape == AGL_PHYS_SHAPE_SPHERE) {
+            float i = 0.4f * desc->mass * x * x;
+            b->invInertiaLocal = vec3f(1.f / i, 1.f / i, 1.f / i);
+        } else {
+            // Solid box of full sizes 2x, 2y, 2z: m (b^2 + c^2) / 12 about each axis
+            float m = desc->mass / 3.f;
+            b->invInertiaLocal = vec3f(1.f / (m * (y * y + z * z)), 1.f / (m * (x * x + z * z)), 1.f / (m * (x * x + y * y)));
+        }
+        b->v = desc->linearVelocity;
+        b->w = desc->angularVelocity;
+    }
+    agl__PhysUpdateBody(b);
+    w->aabbs[index] = agl__PhysBodyBounds(b);
+    b->proxy = agl_phys_tree_insert(w->tree, &w->aabbs[index], index);
+    if (b->proxy == AGL_PHYS_INVALID_PROXY) {
+        b->flags = 0;
+        w->freeBodies[w->freeCount++] = index;
+        return AGL_PHYS_INVALID_BODY;
+    }
+    return index;
+}
+
+void agl_phys_body_destroy(agl_phys_world_t *w, uint32_t body) {
+    if (body >= w->bodyCount || !(w->bodies[body].flags & AGL__PHYS_BODY_ALIVE))
+        return;
+    // Bodies touching it wake up and fall, and a body created in its slot does not inherit its contacts
+    for (uint32_t i = 0; i < w->prevManifoldCount; i++) {
+        agl__phys_manifold_t *m = &w->prevManifolds[i];
+        if (m->count && (m->a == body || m->b == body)) {
+            w->bodies[m->a].flags &= ~AGL__PHYS_BODY_SLEEPING;
+            w->bodies[m->b].flags &= ~AGL__PHYS_BODY_SLEEPING;
+            m->count = 0;
+        }
+    }
+    agl_phys_tree_remove(w->tree, w->bodies[body].proxy);
+    w->bodies[body].flags = 0;
+    w->aabbs[body] = (aabbf_t){ vec3f(FLT_MAX, FLT_MAX, FLT_MAX), vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+    w->freeBodies[w->freeCount++] = body;
+}
+
+void agl_phys_body_get_transform(const agl_phys_world_t *w, uint32_t body, vec3f_t *pos, quatf_t *rot) {
+    const agl__phys_body_t *b = &w->bodies[body];
+    if (pos)
+        *pos = b->pos;
+    if (rot)
+        *rot = b->rot;
+}
+
+void agl_phys_body_get_velocity(const agl_phys_world_t *w, uint32_t body, vec3f_t *linear, vec3f_t *angular) {
+    const agl__phys_body_t *b = &w->bodies[body];
+    if (linear)
+        *linear = b->v;
+    if (angular)
+        *angular = b->w;
+}
+
+void agl_phys_body_set_velocity(agl_phys_world_t *w, uint32_t body, const vec3f_t *linear, const vec3f_t *angular) {
+    agl__phys_body_t *b = &w->bodies[body];
+    if (b->invMass == 0.f)
+        return;
+    b->v = *linear;
+    b->w = *angular;
+    b->restTime = 0.f;
+    b->flags &= ~AGL__PHYS_BODY_SLEEPING;
+}
+
+bool agl_phys_body_is_sleeping(const agl_phys_world_t *w, uint32_t body) {
+    return (w->bodies[body].flags & AGL__PHYS_BODY_SLEEPING) != 0;
+}
+
+void agl_phys_world_get_stats(const agl_phys_world_t *w, agl_phys_world_stats_t *stats) {
+    *stats = w->stats;
+}
+
+// Threads
+//
+// Each pass runs `fn` once per thread with the thread index, the calling thread taking index 0. Threads are started and
+// joined per pass like the gfx occlusion worker, and every task works out its own share of the items from its index,
+// so the results never depend on scheduling. Passes that go through stages together wait for each other at a barrier.
+
+typedef void (*agl__phys_task_fn)(void *ctx, uint32_t thread);
+
+typedef struct agl__phys_barrier_t {
+#if defined(_WIN32)
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE cond;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+    uint32_t count; // threads taking part
+    uint32_t arrived;
+    uint32_t generation; // bumped each time the barrier opens
+} agl__phys_barrier_t;
+
+static void agl__PhysBarrierInit(agl__phys_barrier_t *b, uint32_t count) {
+#if defined(_WIN32)
+    InitializeCriticalSection(&b->lock);
+    InitializeConditionVariable(&b->cond);
+#else
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->cond, NULL);
+#endif
+    b->count = count;
+    b->arrived = 0;
+    b->generation = 0;
+}
+
+static void agl__PhysBarrierDestroy(agl__phys_barrier_t *b) {
+#if defined(_WIN32)
+    DeleteCriticalSection(&b->lock);
+#else
+    pthread_mutex_destroy(&b->lock);
+    pthread_cond_destroy(&b->cond);
+#endif
+}
+
+static void agl__PhysBarrierLock(agl__phys_barrier_t *b) {
+#if defined(_WIN32)
+    EnterCriticalSection(&b->lock);
+#else
+    pthread_mutex_lock(&b->lock);
+#endif
+}
+
+static void agl__PhysBarrierUnlock(agl__phys_barrier_t *b) {
+#if defined(_WIN32)
+    LeaveCriticalSection(&b->lock);
+#else
+    pthread_mutex_unlock(&b->lock);
+#endif
+}
+
+// Returns once all b->count threads have called it
+static void agl__PhysBarrierWait(agl__phys_barrier_t *b) {
+    agl__PhysBarrierLock(b);
+    uint32_t generation = b->generation;
+    if (++b->arrived == b->count) {
+        b->arrived = 0;
+        b->generation++;
+#if defined(_WIN32)
+        WakeAllConditionVariable(&b->cond);
+#else
+        pthread_cond_broadcast(&b->cond);
+#endif
+    } else {
+        while (generation == b->generation) {
+#if defined(_WIN32)
+            SleepConditionVariableCS(&b->cond, &b->lock, INFINITE);
+#else
+            pthread_cond_wait(&b->cond, &b->lock);
+#endif
+        }
+    }
+    agl__PhysBarrierUnlock(b);
+}
+
+typedef struct agl__phys_task_t {
+    void *ctx;
+    agl__phys_task_fn fn;
+    uint32_t thread;
+} agl__phys_task_t;
+
+#if defined(_WIN32)
+static DWORD WINAPI agl__PhysTaskThread(LPVOID param) {
+    agl__phys_task_t *task = (agl__phys_task_t*)param;
+    task->fn(task->ctx, task->thread);
+    return 0;
+}
+#else
+static void *agl__PhysTaskThread(void *param) {
+    agl__phys_task_t *task = (agl__phys_task_t*)param;
+    task->fn(task->ctx, task->thread);
+    return NULL;
+}
+#endif
+
+// A thread that cannot be started has its share run on the calling thread afterwards. That cannot work for tasks that wait
+// at `barrier`, so then the pass runs on the threads started so far, and barrier->count is set to their number before
+// the calling thread reaches the barrier. Such tasks split their work by barrier->count once past it.
+static void agl__PhysRunTasks(void *ctx, uint32_t threadCount, agl__phys_task_fn fn, agl__phys_barrier_t *barrier) {
+    agl__phys_task_t tasks[AGL_PHYS_MAX_THREADS];
+#if defined(_WIN32)
+    HANDLE threads[AGL_PHYS_MAX_THREADS];
+#else
+    pthread_t threads[AGL_PHYS_MAX_THREADS];
+#endif
+    bool started[AGL_PHYS_MAX_THREADS] = { false };
+    for (uint32_t t = 1; t < threadCount; t++) {
+        tasks[t] = (agl__phys_task_t){ ctx, fn, t };
+#if defined(_WIN32)
+        threads[t] = CreateThread(NULL, 0, agl__PhysTaskThread, &tasks[t], 0, NULL);
+        started[t] = threads[t] != NULL;
+#else
+        started[t] = pthread_create(&threads[t], NULL, agl__PhysTaskThread, &tasks[t]) == 0;
+#endif
+        if (!started[t] && barrier) {
+            agl__PhysBarrierLock(barrier);
+            barrier->count = t;
+            agl__PhysBarrierUnlock(barrier);
+            threadCount = t;
+            break;
+        }
+    }
+    fn(ctx, 0);
+    for (uint32_t t = 1; t < threadCount; t++) {
+        if (!started[t]) {
+            fn(ctx, t); // could not start a thread, do its share here
+            continue;
+        }
+#if defined(_WIN32)
+        WaitForSingleObject(threads[t], INFINITE);
+        CloseHandle(threads[t]);
+#else
+        pthread_join(threads[t], NULL);
+#endif
+    }
+}
+
+// Dynamic AABB tree
+//
+// A binary tree of boxes in the style of Box2D's. Leaves are the proxies and keep their node index for life; internal
+// nodes come and go as leaves are inserted and removed. A leaf goes down to the sibling that grows the surface area of
+// the tree least. On the way back up each node swaps a child with a grandchild when that shrinks the nodes below it
+// (Kopta et al., as in Box2D 3), and a node whose subtrees got too far apart in height rotates the taller one up, which
+// bounds the height. Proxies store their box grown by a margin, so only boxes leaving it are reinserted, and pairs are
+// found by descending the tree against itself.
+
+#define AGL__PHYS_NULL_NODE 0xFFFFFFFFu
+#define AGL__PHYS_TREE_MAX_IMBALANCE 4 // most a node's subtrees may differ in height, which keeps the height below 2.5 log2(n)
+#define AGL__PHYS_TREE_STACK 256 // deeper than such a tree of 2^32 leaves
+
+typedef struct agl__phys_tree_node_t {
+    aabbf_t box;
+    uint32_t parent; // next free node while unused
+    uint32_t child[2]; // AGL__PHYS_NULL_NODE in leaves
+    int32_t height; // 0 for leaves, -1 while unused
+    uint32_t user;
+} agl__phys_tree_node_t;
+
+struct agl_phys_tree_t {
+    agl__phys_tree_node_t *nodes;
+    uint32_t capacity;
+    uint32_t root;
+    uint32_t freeList;
+    uint32_t proxyCount;
+    float margin;
+};
+
+static aabbf_t agl__PhysUnion(const aabbf_t *a, const aabbf_t *b) {
+    aabbf_t u;
+    for (int i = 0; i < 4; i++) {
+        u.min._m[i] = fminf(a->min._m[i], b->min._m[i]);
+        u.max._m[i] = fmaxf(a->max._m[i], b->max._m[i]);
+    }
+    return u;
+}
+
+// Half the surface area
+static float agl__PhysArea(const aabbf_t *a) {
+    float x = a->max._m[0] - a->min._m[0], y = a->max._m[1] - a->min._m[1], z = a->max._m[2] - a->min._m[2];
+    return x * y + y * z + z * x;
+}
+
+static bool agl__PhysTreeGrow(agl_phys_tree_t *t, uint32_t capacity) {
+    agl__phys_tree_node_t *nodes = (agl__phys_tree_node_t*)realloc(t->nodes, capacity * sizeof(agl__phys_tree_node_t));
+    if (!nodes)
+        return false;
+    for (uint32_t i = t->capacity; i < capacity; i++) {
+        nodes[i].parent = i + 1 < capacity ? i + 1 : t->freeList;
+        nodes[i].height = -1;
+    }
+    t->freeList = t->capacity;
+    t->nodes = nodes;
+    t->capacity = capacity;
+    return true;
+}
+
+// May move the node array
+static uint32_t agl__PhysTreeAlloc(agl_phys_tree_t *t) {
+    if (t->freeList == AGL__PHYS_NULL_NODE && !agl__PhysTreeGrow(t, t->capacity ? 2 * t->capacity : 16))
+        return AGL__PHYS_NULL_NODE;
+    uint32_t i = t->freeList;
+    agl__phys_tree_node_t *n = &t->nodes[i];
+    t->freeList = n->parent;
+    n->parent = n->child[0] = n->child[1] = AGL__PHYS_NULL_NODE;
+    n->height = 0;
+    n->user = 0;
+    return i;
+}
+
+static void agl__PhysTreeFree(agl_phys_tree_t *t, uint32_t i) {
+    t->nodes[i].parent = t->freeList;
+    t->nodes[i].height = -1;
+    t->freeList = i;
+}
+
+static void agl__PhysTreeReplaceChild(agl_phys_tree_t *t, uint32_t parent, uint32_t oldChild, uint32_t newChild) {
+    if (parent == AGL__PHYS_NULL_NODE)
+        t->root = newChild;
+    else
+        t->nodes[parent].child[t->nodes[parent].child[0] == oldChild ? 0 : 1] = newChild;
+}
+
+// Rotates the taller child of `ia` above it when the children differ in height by more than AGL__PHYS_TREE_MAX_IMBALANCE,
+// and returns the node now in its place. The taller grandchild stays with the child that moved up.
+static uint32_t agl__PhysTreeBalance(agl_phys_tree_t *t, uint32_t ia) {
+    agl__phys_tree_node_t *n = t->nodes, *a = &n[ia];
+    if (a->height == 0)
+        return ia;
+    int32_t balance = n[a->child[1]].height - n[a->child[0]].height;
+    if (balance >= -AGL__PHYS_TREE_MAX_IMBALANCE && balance <= AGL__PHYS_TREE_MAX_IMBALANCE)
+        return ia;
+    int up = balance > 1 ? 1 : 0; // the child moving up, the other one stays below a
+    uint32_t ib = a->child[up], ic = a->child[1 - up];
+    agl__phys_tree_node_t *b = &n[ib], *c = &n[ic];
+    uint32_t id = b->child[0], ie = b->child[1];
+    if (n[id].height > n[ie].height) {
+        uint32_t swap = id;
+        id = ie;
+        ie = swap;
+    }
+    // b takes a's place with a and its taller child ie below it, a keeps c and takes the shorter child id
+    b->parent = a->parent;
+    agl__PhysTreeReplaceChild(t, a->parent, ia, ib);
+    b->child[0] = ia;
+    b->child[1] = ie;
+    a->parent = ib;
+    a->child[up] = id;
+    n[id].parent = ia;
+    a->box = agl__PhysUnion(&c->box, &n[id].box);
+    a->height = 1 + (c->height > n[id].height ? c->height : n[id].height);
+    b->box = agl__PhysUnion(&a->box, &n[ie].box);
+    b->height = 1 + (a->height > n[ie].height ? a->height : n[ie].height);
+    return ib;
+}
+
+// Swaps a child of `ia` with a grandchild under its other child when that shrinks the internal nodes below `ia` the most.
+// The boxes of `ia` and of the grandchild's new sibling stay the same, only the node they now share changes.
+static bool agl__PhysTreeRotate(agl_phys_tree_t *t, uint32_t ia) {
+    agl__phys_tree_node_t *n = t->nodes, *a = &n[ia];
+    if (a->height < 2)
+        return false;
+    float area[2], best = 0.f;
+    for (int k = 0; k < 2; k++) {
+        area[k] = n[a->child[k]].height > 0 ? agl__PhysArea(&n[a->child[k]].box) : 0.f;
+        best += area[k];
+    }
+    int bestX = -1, bestY = 0;
+    aabbf_t bestBox;
+    for (int x = 0; x < 2; x++) {
+        const agl__phys_tree_node_t *o = &n[a->child[1 - x]];
+        if (o->height == 0)
+            continue;
+        for (int y = 0; y < 2; y++) {
+            // x moves down next to the other grandchild, y moves up in its place
+            aabbf_t box = agl__PhysUnion(&n[a->child[x]].box, &n[o->child[1 - y]].box);
+            float cost = area[x] + agl__PhysArea(&box);
+            if (cost < best) {
+                best = cost;
+                bestX = x;
+                bestY = y;
+                bestBox = box;
+            }
+        }
+    }
+    if (bestX < 0)
+        return false;
+    uint32_t ix = a->child[bestX], io = a->child[1 - bestX];
+    agl__phys_tree_node_t *o = &n[io];
+    uint32_t iy = o->child[bestY], kept = o->child[1 - bestY];
+    a->child[bestX] = iy;
+    o->child[bestY] = ix;
+    n[ix].parent = io;
+    n[iy].parent = ia;
+    o->box = bestBox;
+    o->height = 1 + (n[ix].height > n[kept].height ? n[ix].height : n[kept].height);
+    a->height = 1 + (o->height > n[iy].height ? o->height : n[iy].height);
+    return true;
+}
+
+// Refits the ancestors of a changed node, from `i` up, rotating each one that got too unbalanced or that a rotation makes
+// cheaper. Stops at the first node left as it was, since nothing above it changes either.
+static void agl__PhysTreeFixUp(agl_phys_tree_t *t, uint32_t i) {
+    while (i != AGL__PHYS_NULL_NODE) {
+        uint32_t balanced = agl__PhysTreeBalance(t, i);
+        agl__phys_tree_node_t *n = &t->nodes[balanced], *c0 = &t->nodes[n->child[0]], *c1 = &t->nodes[n->child[1]];
+        int32_t height = 1 + (c0->height > c1->height ? c0->height : c1->height);
+        aabbf_t box = agl__PhysUnion(&c0->box, &c1->box);
+        bool changed = balanced != i || height != n->height || memcmp(&box, &n->box, sizeof(box)) != 0;
+        n->height = height;
+        n->box = box;
+        changed = agl__PhysTreeRotate(t, balanced) || changed;
+        if (!changed)
+            break;
+        i = n->parent;
+    }
+}
+
+// `parent` is allocated by the caller beforehand, since allocating may move the nodes
+static void agl__PhysTreeInsertLeaf(agl_phys_tree_t *t, uint32_t leaf, uint32_t parent) {
+    agl__phys_tree_node_t *n = t->nodes;
+    if (t->root == AGL__PHYS_NULL_NODE) {
+        t->root = leaf;
+        n[leaf].parent = AGL__PHYS_NULL_NODE;
+        agl__PhysTreeFree(t, parent);
+        return;
+    }
+    // Descend while pushing the leaf further down is cheaper than pairing it with the current node. Every ancestor of
+    // the new parent grows to hold the leaf, which is the inherited cost.
+    const aabbf_t *box = &n[leaf].box;
+    uint32_t i = t->root;
+    while (n[i].height > 0) {
+        aabbf_t combined = agl__PhysUnion(&n[i].box, box);
+        float combinedArea = agl__PhysArea(&combined);
+        float cost = 2.f * combinedArea;
+        float inherited = 2.f * (combinedArea - agl__PhysArea(&n[i].box));
+        float childCost[2];
+        for (int k = 0; k < 2; k++) {
+            const agl__phys_tree_node_t *c = &n[n[i].child[k]];
+            aabbf_t grown = agl__PhysUnion(&c->box, box);
+            childCost[k] = agl__PhysArea(&grown) + inherited - (c->height > 0 ? agl__PhysArea(&c->box) : 0.f);
+        }
+        if (cost < childCost[0] && cost < childCost[1])
+            break;
+        i = n[i].child[childCost[1] < childCost[0] ? 1 : 0];
+    }
+    uint32_t oldParent = n[i].parent;
+    n[parent].parent = oldParent;
+    n[parent].child[0] = i;
+    n[parent].child[1] = leaf;
+    n[parent].box = agl__PhysUnion(box, &n[i].box);
+    n[parent].height = n[i].height + 1;
+    agl__PhysTreeReplaceChild(t, oldParent, i, parent);
+    n[i].parent = parent;
+    n[leaf].parent = parent;
+    agl__PhysTreeFixUp(t, oldParent);
+}
+
+static void agl__PhysTreeRemoveLeaf(agl_phys_tree_t *t, uint32_t leaf) {
+    agl__phys_tree_node_t *n = t->nodes;
+    if (leaf == t->root) {
+        t->root = AGL__PHYS_NULL_NODE;
+        return;
+    }
+    uint32_t parent = n[leaf].parent, grandParent = n[parent].parent;
+    uint32_t sibling = n[parent].child[n[parent].child[0] == leaf ? 1 : 0];
+    agl__PhysTreeReplaceChild(t, grandParent, parent, sibling);
+    n[sibling].parent = grandParent;
+    agl__PhysTreeFree(t, parent);
+    agl__PhysTreeFixUp(t, grandParent);
+}
+
+agl_phys_tree_t *agl_phys_tree_create(const agl_phys_tree_params_t *params) {
+    agl_phys_tree_t *t = (agl_phys_tree_t*)calloc(1, sizeof(agl_phys_tree_t));
+    if (!t)
+        return NULL;
+    t->root = t->freeList = AGL__PHYS_NULL_NODE;
+    t->margin = params->margin == 0.f ? 0.1f : params->margin;
+    // n leaves need n - 1 internal nodes
+    if (params->capacity && !agl__PhysTreeGrow(t, 2 * params->capacity)) {
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void agl_phys_tree_destroy(agl_phys_tree_t *t) {
+    if (!t)
+        return;
+    free(t->nodes);
+    free(t);
+}
+
+static void agl__PhysTreeSetBox(agl_phys_tree_t *t, uint32_t leaf, const aabbf_t *box, const vec3f_t *displacement) {
+    aabbf_t *fat = &t->nodes[leaf].box;
+    for (int i = 0; i < 3; i++) {
+        float d = displacement ? displacement->_m[i] : 0.f;
+        fat->min._m[i] = box->min._m[i] - t->margin + (d < 0.f ? d : 0.f);
+        fat->max._m[i] = box->max._m[i] + t->margin + (d > 0.f ? d : 0.f);
+    }
+    fat->min._m[3] = fat->max._m[3] = 0.f;
+}
+
+uint32_t agl_phys_tree_insert(agl_phys_tree_t *t, const aabbf_t *box, uint32_t user) {
+    uint32_t leaf = agl__PhysTreeAlloc(t);
+    if (leaf == AGL__PHYS_NULL_NODE)
+        return AGL_PHYS_INVALID_PROXY;
+    uint32_t parent = agl__PhysTreeAlloc(t);
+    if (parent == AGL__PHYS_NULL_NODE) {
+        agl__PhysTreeFree(t, leaf);
+        return AGL_PHYS_INVALID_PROXY;
+    }
+    agl__PhysTreeSetBox(t, leaf, box, NULL);
+    t->nodes[leaf].user = user;
+    agl__PhysTreeInsertLeaf(t, leaf, parent);
+    t->proxyCount++;
+    return leaf;
+}
+
+void agl_phys_tree_remove(agl_phys_tree_t *t, uint32_t proxy) {
+    agl__PhysTreeRemoveLeaf(t, proxy);
+    agl__PhysTreeFree(t, proxy);
+    t->proxyCount--;
+}
+
+bool agl_phys_tree_move(agl_phys_tree_t *t, uint32_t proxy, const aabbf_t *box, const vec3f_t *displacement) {
+    const aabbf_t *fat = &t->nodes[proxy].box;
+    if (fat->min._m[0] <= box->min._m[0] && fat->min._m[1] <= box->min._m[1] && fat->min._m[2] <= box->min._m[2]
+        && fat->max._m[0] >= box->max._m[0] && fat->max._m[1] >= box->max._m[1] && fat->max._m[2] >= box->max._m[2])
+        return false;
+    if (proxy == t->root) {
+        agl__PhysTreeSetBox(t, proxy, box, displacement);
+        return true;
+    }
+    // Removing the leaf frees exactly the internal node inserting it takes, so this never allocates
+    agl__PhysTreeRemoveLeaf(t, proxy);
+    uint32_t parent = agl__PhysTreeAlloc(t);
+    agl__PhysTreeSetBox(t, proxy, box, displacement);
+    agl__PhysTreeInsertLeaf(t, proxy, parent);
+    return true;
+}
+
+aabbf_t agl_phys_tree_get_box(const agl_phys_tree_t *t, uint32_t proxy) {
+    return t->nodes[proxy].box;
+}
+
+uint32_t agl_phys_tree_get_user(const agl_phys_tree_t *t, uint32_t proxy) {
+    return t->nodes[proxy].user;
+}
+
+void agl_phys_tree_get_stats(const agl_phys_tree_t *t, agl_phys_tree_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->proxies = t->proxyCount;
+    stats->memory = sizeof(*t) + t->capacity * sizeof(agl__phys_tree_node_t);
+    if (t->root == AGL__PHYS_NULL_NODE)
+        return;
+    stats->height = (uint32_t)t->nodes[t->root].height;
+    float internal = 0.f;
+    for (uint32_t i = 0; i < t->capacity; i++)
+        internal += t->nodes[i].height > 0 ? agl__PhysArea(&t->nodes[i].box) : 0.f;
+    float root = agl__PhysArea(&t->nodes[t->root].box);
+    stats->areaRatio = root > 0.f ? internal / root : 0.f;
+}
+
+// Results past the capacity are counted but not written
+typedef struct agl__phys_results_t {
+    uint32_t *items;
+    uint32_t capacity;
+    uint32_t count;
+} agl__phys_results_t;
+
+static void agl__PhysResultsAdd(agl__phys_results_t *r, uint32_t item) {
+    if (r->count < r->capacity)
+        r->items[r->count] = item;
+    r->count++;
+}
+
+// Calls `visit` for every leaf whose box overlaps `box`
+typedef void (*agl__phys_tree_visit_fn)(void *ctx, uint32_t proxy);
+
+static void agl__PhysTreeQueryBox(const agl_phys_tree_t *t, const aabbf_t *box, agl__phys_tree_visit_fn visit, void *ctx) {
+    uint32_t stack[AGL__PHYS_TREE_STACK];
+    uint32_t top = 0;
+    if (t->root != AGL__PHYS_NULL_NODE)
+        stack[top++] = t->root;
+    while (top) {
+        const agl__phys_tree_node_t *n = &t->nodes[stack[--top]];
+        if (!aabbf_overlaps(&n->box, box))
+            continue;
+        if (n->height == 0) {
+            visit(ctx, (uint32_t)(n - t->nodes));
+            continue;
+        }
+        stack[top++] = n->child[0];
+        stack[top++] = n->child[1];
+    }
+}
+
+// Calls `hit` for every leaf whose box the ray enters within `tmax`, nearer subtrees first. `hit` returns the new tmax,
+// so a closest hit search can stop looking past the best hit found so far.
+typedef float (*agl__phys_tree_hit_fn)(void *ctx, uint32_t proxy, float t, float tmax);
+
+static void agl__PhysTreeRay(const agl_phys_tree_t *t, const rayf_t *ray, float tmax, agl__phys_tree_hit_fn hit, void *ctx) {
+    uint32_t stack[AGL__PHYS_TREE_STACK];
+    float entry[AGL__PHYS_TREE_STACK];
+    uint32_t top = 0;
+    float tnear;
+    if (t->root != AGL__PHYS_NULL_NODE && rayf_intersect_aabb(ray, &t->nodes[t->root].box, tmax, &tnear)) {
+        stack[top] = t->root;
+        entry[top++] = tnear;
+    }
+    while (top) {
+        top--;
+        if (entry[top] > tmax)
+            continue;
+        const agl__phys_tree_node_t *n = &t->nodes[stack[top]];
+        if (n->height == 0) {
+            tmax = hit(ctx, stack[top], entry[top], tmax);
+            continue;
+        }
+        float tc[2];
+        bool hc[2];
+        for (int k = 0; k < 2; k++)
+            hc[k] = rayf_intersect_aabb(ray, &t->nodes[n->child[k]].box, tmax, &tc[k]);
+        int first = hc[1] && (!hc[0] || tc[1] < tc[0]) ? 1 : 0; // pushed last, visited first
+        uint32_t c0 = n->child[first], c1 = n->child[1 - first];
+        if (hc[1 - first]) {
+            stack[top] = c1;
+            entry[top++] = tc[1 - first];
+        }
+        if (hc[first]) {
+            stack[top] = c0;
+            entry[top++] = tc[first];
+        }
+    }
+}
+
+static void agl__PhysTreeCollect(void *ctx, uint32_t proxy) {
+    agl__PhysResultsAdd((agl__phys_results_t*)ctx, proxy);
+}
+
+static float agl__PhysTreeCollectHit(void *ctx, uint32_t proxy, float t, float tmax) {
+    (void)t;
+    agl__PhysResultsAdd((agl__phys_results_t*)ctx, proxy);
+    return tmax;
+}
+
+uint32_t agl_phys_tree_query(const agl_phys_tree_t *t, uint32_t *proxies, uint32_t *starts, uint32_t capacity,
+    const aabbf_t *boxes, uint32_t count) {
+    agl__phys_results_t out = { proxies, capacity, 0 };
+    starts[0] = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        agl__PhysTreeQueryBox(t, &boxes[i], agl__PhysTreeCollect, &out);
+        starts[i + 1] = out.count < capacity ? out.count : capacity;
+    }
+    return out.count;
+}
+
+uint32_t agl_phys_tree_raycast(const agl_phys_tree_t *t, uint32_t *proxies, uint32_t *starts, uint32_t capacity,
+    const rayf_t *rays, uint32_t count, float tmax) {
+    agl__phys_results_t out = { proxies, capacity, 0 };
+    starts[0] = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        agl__PhysTreeRay(t, &rays[i], tmax, agl__PhysTreeCollectHit, &out);
+        starts[i + 1] = out.count < capacity ? out.count : capacity;
+    }
+    return out.count;
+}
+
+// Descends the tree against itself: a node pairs its two children, and a pair of overlapping nodes splits the one with
+// the larger box, so every internal pair is visited once instead of once per leaf below it
+uint32_t agl_phys_tree_find_pairs(const agl_phys_tree_t *t, agl_phys_pair_t *pairs, uint32_t capacity) {
+    uint32_t count = 0;
+    if (t->root == AGL__PHYS_NULL_NODE)
+        return 0;
+    // An entry with a == b stands for the pairs within that subtree
+    agl_phys_pair_t stack[4 * AGL__PHYS_TREE_STACK];
+    uint32_t top = 0;
+    stack[top++] = (agl_phys_pair_t){ t->root, t->root };
+    while (top) {
+        agl_phys_pair_t p = stack[--top];
+        const agl__phys_tree_node_t *a = &t->nodes[p.a], *b = &t->nodes[p.b];
+        if (p.a == p.b) {
+            if (a->height > 0) {
+                stack[top++] = (agl_phys_pair_t){ a->child[0], a->child[0] };
+                stack[top++] = (agl_phys_pair_t){ a->child[1], a->child[1] };
+                stack[top++] = (agl_phys_pair_t){ a->child[0], a->child[1] };
+            }
+            continue;
+        }
+        if (!aabbf_overlaps(&a->box, &b->box))
+            continue;
+        if (a->height == 0 && b->height == 0) {
+            if (count < capacity)
+                pairs[count] = p.a < p.b ? p : (agl_phys_pair_t){ p.b, p.a };
+            count++;
+        } else if (b->height == 0 || (a->height > 0 && agl__PhysArea(&a->box) >= agl__PhysArea(&b->box))) {
+            stack[top++] = (agl_phys_pair_t){ a->child[0], p.b };
+            stack[top++] = (agl_phys_pair_t){ a->child[1], p.b };
+        } else {
+            stack[top++] = (agl_phys_pair_t){ p.a, b->child[0] };
+            stack[top++] = (agl_phys_pair_t){ p.a, b->child[1] };
+        }
+    }
+    return count;
+}
+
+// Sweep and prune
+//
+// Boxes are sorted by their minimum along the axis the centres spread furthest along, and each box is tested against the
+// ones after it that start before it ends. The order is kept between calls: while the box count and the axis stay the
+// same it is fixed up with an insertion sort, which is close to linear when boxes moved a little, and once that has made
+// too many moves the boxes are radix sorted from scratch. Each thread sweeps a range of the sorted boxes into its own
+// list, and the lists are joined in thread order.
+
+#define AGL__PHYS_SAP_MAX_SWAPS 8 // insertion sort moves per box before sorting from scratch instead
+#define AGL__PHYS_SAP_THREAD_BOXES 4096 // fewest boxes worth starting another thread for
+
+typedef struct agl__phys_sap_list_t {
+    agl_phys_pair_t *pairs;
+    uint32_t count, capacity;
+    bool failed;
+} agl__phys_sap_list_t;
+
+struct agl_phys_sap_t {
+    uint32_t threadCount;
+    uint32_t sweepThreads; // of the last call
+    uint32_t count; // boxes in the last call
+    uint32_t axis;
+    uint32_t capacity;
+    uint32_t *order; // box indices by their minimum along the axis
+    uint32_t *keys, *tmpOrder, *tmpKeys; // radix sort
+    float *bounds; // minimum and maximum along the sweep axis, then along the other two, each array in sorted order
+    uint32_t stride; // floats per bounds array, with room for a block of 4 past the end
+    agl_phys_pair_t *pairs;
+    uint32_t pairCount, pairCapacity;
+    agl__phys_sap_list_t lists[AGL_PHYS_MAX_THREADS];
+    agl_phys_sap_stats_t stats;
+};
+
+agl_phys_sap_t *agl_phys_sap_create(const agl_phys_sap_params_t *params) {
+    agl_phys_sap_t *sap = (agl_phys_sap_t*)calloc(1, sizeof(agl_phys_sap_t));
+    if (!sap)
+        return NULL;
+    sap->threadCount = params->threadCount == 0 ? 1 : params->threadCount > AGL_PHYS_MAX_THREADS ? AGL_PHYS_MAX_THREADS : params->threadCount;
+    return sap;
+}
+
+void agl_phys_sap_destroy(agl_phys_sap_t *sap) {
+    if (!sap)
+        return;
+    for (uint32_t t = 0; t < AGL_PHYS_MAX_THREADS; t++)
+        free(sap->lists[t].pairs);
+    free(sap->order);
+    free(sap->keys);
+    free(sap->tmpOrder);
+    free(sap->tmpKeys);
+    free(sap->bounds);
+    free(sap->pairs);
+    free(sap);
+}
+
+// Float bits that sort as unsigned integers in the order of the floats
+static uint32_t agl__PhysSortKey(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u ^ ((u >> 31) ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+// Sorts all box indices by their minimum along the axis, one byte per pass
+static void agl__PhysSapRadixSort(agl_phys_sap_t *sap, const aabbf_t *boxes, uint32_t count) {
+    uint32_t *order = sap->order, *keys = sap->keys, *tmpOrder = sap->tmpOrder, *tmpKeys = sap->tmpKeys;
+    if (count == 0)
+        return;
+    for (uint32_t i = 0; i < count; i++) {
+        order[i] = i;
+        keys[i] = agl__PhysSortKey(boxes[i].min._m[sap->axis]);
+    }
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t offsets[256] = { 0 };
+        for (uint32_t i = 0; i < count; i++)
+            offsets[(keys[i] >> shift) & 0xFF]++;
+        if (offsets[(keys[0] >> shift) & 0xFF] == count)
+            continue; // every key has the same byte here
+        for (uint32_t b = 0, sum = 0; b < 256; b++) {
+            uint32_t c = offsets[b];
+            offsets[b] = sum;
+            sum += c;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t dst = offsets[(keys[i] >> shift) & 0xFF]++;
+            tmpKeys[dst] = keys[i];
+            tmpOrder[dst] = order[i];
+        }
+        uint32_t *swap = order;
+        order = tmpOrder;
+        tmpOrder = swap;
+        swap = keys;
+        keys = tmpKeys;
+        tmpKeys = swap;
+    }
+    if (order != sap->order)
+        memcpy(sap->order, order, count * sizeof(uint32_t));
+}
+
+// Fixes up the previous order, or returns false once it has made more than AGL__PHYS_SAP_MAX_SWAPS moves per box
+static bool agl__PhysSapInsertionSort(agl_phys_sap_t *sap, const aabbf_t *boxes, uint32_t count) {
+    uint32_t *order = sap->order;
+    float *mins = sap->bounds; // scratch until the bounds are gathered
+    uint64_t swaps = 0, maxSwaps = (uint64_t)AGL__PHYS_SAP_MAX_SWAPS * count;
+    for (uint32_t i = 0; i < count; i++)
+        mins[i] = boxes[order[i]].min._m[sap->axis];
+    for (uint32_t i = 1; i < count; i++) {
+        float key = mins[i];
+        uint32_t index = order[i], j = i;
+        while (j > 0 && mins[j - 1] > key) {
+            mins[j] = mins[j - 1];
+            order[j] = order[j - 1];
+            j--;
+        }
+        mins[j] = key;
+        order[j] = index;
+        swaps += i - j;
+        if (swaps > maxSwaps)
+            return false;
+    }
+    sap->stats.swaps = (uint32_t)swaps;
+    return true;
+}
+
+static void agl__PhysSapSweepTask(void *ctx, uint32_t thread) {
+    agl_phys_sap_t *sap = (agl_phys_sap_t*)ctx;
+    agl__phys_sap_list_t *list = &sap->lists[thread];
+    list->count = 0;
+    list->failed = false;
+    uint32_t n = sap->count, stride = sap->stride;
+    uint32_t first = (uint32_t)((uint64_t)n * thread / sap->sweepThreads);
+    uint32_t last = (uint32_t)((uint64_t)n * (thread + 1) / sap->sweepThreads);
+    const float *lo0 = sap->bounds, *hi0 = lo0 + stride, *lo1 = hi0 + stride, *hi1 = lo1 + stride, *lo2 = hi1 + stride, *hi2 = lo2 + stride;
+    for (uint32_t i = first; i < last; i++) {
+        __m128 end = _mm_set1_ps(hi0[i]), start = _mm_set1_ps(lo0[i]);
+        __m128 min1 = _mm_set1_ps(lo1[i]), max1 = _mm_set1_ps(hi1[i]), min2 = _mm_set1_ps(lo2[i]), max2 = _mm_set1_ps(hi2[i]);
+        // The boxes after i that start before it ends, 4 at a time, tested as aabbf_overlaps does
+        for (uint32_t j = i + 1;; j += 4) {
+            __m128 started = _mm_cmple_ps(_mm_loadu_ps(lo0 + j), end);
+            __m128 hit = _mm_and_ps(started, _mm_cmpge_ps(_mm_loadu_ps(hi0 + j), start));
+            hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(lo1 + j), max1), _mm_cmpge_ps(_mm_loadu_ps(hi1 + j), min1)));
+            hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(lo2 + j), max2), _mm_cmpge_ps(_mm_loadu_ps(hi2 + j), min2)));
+            int mask = _mm_movemask_ps(hit);
+            for (int k = 0; mask; k++, mask >>= 1) {
+                if (!(mask & 1))
+                    continue;
+                if (!agl__PhysReserve((void**)&list->pairs, &list->capacity, list->count + 1, sizeof(agl_phys_pair_t))) {
+                    list->failed = true;
+                    return;
+                }
+                uint32_t ia = sap->order[i], ib = sap->order[j + k];
+                list->pairs[list->count++] = ia < ib ? (agl_phys_pair_t){ ia, ib } : (agl_phys_pair_t){ ib, ia };
+            }
+            if (_mm_movemask_ps(started) != 0xF)
+                break;
+        }
+    }
+}
+
+uint32_t agl_phys_sap_find_pairs(agl_phys_sap_t *sap, const aabbf_t *boxes, uint32_t count) {
+    sap->pairCount = 0;
+    if (count > sap->capacity || !sap->bounds) {
+        free(sap->order);
+        free(sap->keys);
+        free(sap->tmpOrder);
+        free(sap->tmpKeys);
+        free(sap->bounds);
+        sap->order = (uint32_t*)malloc(count * sizeof(uint32_t));
+        sap->keys = (uint32_t*)malloc(count * sizeof(uint32_t));
+        sap->tmpOrder = (uint32_t*)malloc(count * sizeof(uint32_t));
+        sap->tmpKeys = (uint32_t*)malloc(count * sizeof(uint32_t));
+        sap->stride = (count + 4 + 3) & ~3u;
+        sap->bounds = (float*)malloc(6 * sap->stride * sizeof(float));
+        sap->capacity = count;
+        sap->count = 0; // the old order is gone
+        if (!sap->order || !sap->keys || !sap->tmpOrder || !sap->tmpKeys || !sap->bounds) {
+            sap->capacity = 0;
+            return 0;
+        }
+    }
+    // Sweep along the axis of most spread, keeping the current one unless another is clearly better so the order survives
+    double sum[3] = { 0.0 }, sumSq[3] = { 0.0 };
+    uint32_t valid = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const aabbf_t *b = &boxes[i];
+        if (!(b->min._m[0] <= b->max._m[0]))
+            continue;
+        valid++;
+        for (int k = 0; k < 3; k++) {
+            double c = 0.5 * ((double)b->min._m[k] + b->max._m[k]);
+            sum[k] += c;
+            sumSq[k] += c * c;
+        }
+    }
+    double variance[3];
+    uint32_t axis = 0;
+    for (int k = 0; k < 3; k++) {
+        variance[k] = valid ? sumSq[k] - sum[k] * sum[k] / valid : 0.0;
+        if (variance[k] > variance[axis])
+            axis = (uint32_t)k;
+    }
+    if (sap->count == count && variance[axis] < 1.2 * variance[sap->axis])
+        axis = sap->axis;
+    bool keepOrder = sap->count == count && axis == sap->axis;
+    sap->axis = axis;
+    sap->stats.swaps = 0;
+    if (!keepOrder || !agl__PhysSapInsertionSort(sap, boxes, count)) {
+        agl__PhysSapRadixSort(sap, boxes, count);
+        sap->stats.swaps = 0;
+        keepOrder = false;
+    }
+    sap->count = count;
+    for (uint32_t k = 0; k < 3; k++) {
+        uint32_t c = (axis + k) % 3;
+        float *lo = sap->bounds + 2 * k * sap->stride, *hi = lo + sap->stride;
+        for (uint32_t i = 0; i < count; i++) {
+            lo[i] = boxes[sap->order[i]].min._m[c];
+            hi[i] = boxes[sap->order[i]].max._m[c];
+        }
+        // NaN fails every comparison, which ends the sweep at the last box
+        for (uint32_t i = count; i < count + 4; i++)
+            lo[i] = hi[i] = NAN;
+    }
+
+    sap->sweepThreads = 1 + count / AGL__PHYS_SAP_THREAD_BOXES;
+    if (sap->sweepThreads > sap->threadCount)
+        sap->sweepThreads = sap->threadCount;
+    agl__PhysRunTasks(sap, sap->sweepThreads, agl__PhysSapSweepTask, NULL);
+    uint32_t total = 0;
+    for (uint32_t t = 0; t < sap->sweepThreads; t++) {
+        if (sap->lists[t].failed)
+            return 0;
+        total += sap->lists[t].count;
+    }
+    if (!agl__PhysReserve((void**)&sap->pairs, &sap->pairCapacity, total, sizeof(agl_phys_pair_t)))
+        return 0;
+    for (uint32_t t = 0; t < sap->sweepThreads && total; t++) {
+        memcpy(sap->pairs + sap->pairCount, sap->lists[t].pairs, sap->lists[t].count * sizeof(agl_phys_pair_t));
+        sap->pairCount += sap->lists[t].count;
+    }
+
+    sap->stats.boxes = count;
+    sap->stats.pairs = sap->pairCount;
+    sap->stats.axis = axis;
+    sap->stats.resorted = !keepOrder;
+    sap->stats.memory = sizeof(*sap) + sap->capacity * 4 * sizeof(uint32_t) + 6 * sap->stride * sizeof(float) + sap->pairCapacity * sizeof(agl_phys_pair_t);
+    for (uint32_t t = 0; t < AGL_PHYS_MAX_THREADS; t++)
+        sap->stats.memory += sap->lists[t].capacity * sizeof(agl_phys_pair_t);
+    return sap->pairCount;
+}
+
+const agl_phys_pair_t *agl_phys_sap_get_pairs(const agl_phys_sap_t *sap) {
+    return sap->pairs;
+}
+
+void agl_phys_sap_get_stats(const agl_phys_sap_t *sap, agl_phys_sap_stats_t *stats) {
+    *stats = sap->stats;
+}
+
+// Pair finding
+//
+// Every step starts by refreshing the bounds of all bodies and moving the dynamic ones in the world's tree, which only
+// touches the tree for bodies that left their stored boxes. One of three methods then finds the overlapping pairs.
+//
+// The grid tests static bodies against all dynamic boxes with agl_overlap_aabbs, and puts dynamic bodies into a hashed
+// uniform grid by the cell of their centre. Cells are as large as the largest dynamic box, so two boxes can only overlap
+// when their cells are neighbours, and each body looks for partners in its own cell and the 13 neighbours after it.
+// The tree and sweep and prune find the overlapping pairs of all bodies, from which the pairs of two static bodies are
+// dropped.
+
+static uint32_t agl__PhysCellHash(const int32_t cell[3]) {
+    return ((uint32_t)cell[0] * 73856093u) ^ ((uint32_t)cell[1] * 19349663u) ^ ((uint32_t)cell[2] * 83492791u);
+}
+
+static void agl__PhysAddPair(agl_phys_world_t *w, uint32_t a, uint32_t b) {
+    if (!agl__PhysReserve((void**)&w->pairs, &w->pairCapacity, w->pairCount + 1, sizeof(agl_phys_pair_t)))
+        return;
+    w->pairs[w->pairCount++] = a < b ? (agl_phys_pair_t){ a, b } : (agl_phys_pair_t){ b, a };
+}
+
+static void agl__PhysFindPairsGrid(agl_phys_world_t *w, uint32_t dynCount) {
+    float cellSize = 0.f;
+    for (uint32_t d = 0; d < dynCount; d++)
+        for (int c = 0; c < 3; c++)
+            cellSize = fmaxf(cellSize, w->dynAabbs[d].max._m[c] - w->dynAabbs[d].min._m[c]);
+    // Static against dynamic
+    for (uint32_t i = 0; i < w->bodyCount; i++) {
+        const agl__phys_body_t *b = &w->bodies[i];
+        if (!(b->flags & AGL__PHYS_BODY_ALIVE) || b->invMass != 0.f)
+            continue;
+        size_t n = agl_overlap_aabbs(w->overlaps, &w->aabbs[i], w->dynAabbs, dynCount);
+        for (size_t k = 0; k < n; k++)
+            agl__PhysAddPair(w, i, w->dynBodies[w->overlaps[k]]);
+    }
+    // Counting sort of the dynamic bodies by the hash of their cell
+    float invCell = 1.f / cellSize;
+    uint32_t tableSize = 64;
+    while (tableSize < 2 * dynCount)
+        tableSize *= 2;
+    if (!agl__PhysReserve((void**)&w->cellStarts, &w->cellTableCapacity, tableSize + 1, sizeof(uint32_t)))
+        return;
+    memset(w->cellStarts, 0, (tableSize + 1) * sizeof(uint32_t));
+    for (uint32_t d = 0; d < dynCount; d++) {
+        agl__phys_cell_entry_t *e = &w->cellEntries[d];
+        for (int c = 0; c < 3; c++)
+            e->cell[c] = (int32_t)floorf((w->dynAabbs[d].min._m[c] + w->dynAabbs[d].max._m[c]) * 0.5f * invCell);
+        e->box = w->dynAabbs[d];
+        e->dyn = d;
+        e->hash = agl__PhysCellHash(e->cell) & (tableSize - 1);
+        w->cellStarts[e->hash + 1]++;
+    }
+    for (uint32_t t = 0; t < tableSize; t++)
+        w->cellStarts[t + 1] += w->cellStarts[t];
+    for (uint32_t d = 0; d < dynCount; d++)
+        w->sortedEntries[w->cellStarts[w->cellEntries[d].hash]++] = w->cellEntries[d];
+    // cellStarts[t] now holds the end of bucket t, so bucket t starts at cellStarts[t - 1]
+    static const int8_t forward[14][3] = {
+        { 0, 0, 0 }, { 1, 0, 0 }, { -1, 1, 0 }, { 0, 1, 0 }, { 1, 1, 0 },
+        { -1, -1, 1 }, { 0, -1, 1 }, { 1, -1, 1 }, { -1, 0, 1 }, { 0, 0, 1 }, { 1, 0, 1 }, { -1, 1, 1 }, { 0, 1, 1 }, { 1, 1, 1 },
+    };
+    for (uint32_t d = 0; d < dynCount; d++) {
+        const int32_t *cell = w->cellEntries[d].cell;
+        for (int k = 0; k < 14; k++) {
+            int32_t other[3] = { cell[0] + forward[k][0], cell[1] + forward[k][1], cell[2] + forward[k][2] };
+            uint32_t hash = agl__PhysCellHash(other) & (tableSize - 1);
+            uint32_t begin = hash ? w->cellStarts[hash - 1] : 0, end = w->cellStarts[hash];
+            for (uint32_t i = begin; i < end; i++) {
+                const agl__phys_cell_entry_t *e = &w->sortedEntries[i];
+                if (e->cell[0] != other[0] || e->cell[1] != other[1] || e->cell[2] != other[2] || (k == 0 && e->dyn <= d))
+                    continue;
+                if (aabbf_overlaps(&w->dynAabbs[d], &e->box))
+                    agl__PhysAddPair(w, w->dynBodies[d], w->dynBodies[e->dyn]);
+            }
+        }
+    }
+}
+
+static void agl__PhysFindPairsTree(agl_phys_world_t *w) {
+    uint32_t n = agl_phys_tree_find_pairs(w->tree, w->treePairs, w->treePairCapacity);
+    if (n > w->treePairCapacity) {
+        if (!agl__PhysReserve((void**)&w->treePairs, &w->treePairCapacity, n, sizeof(agl_phys_pair_t)))
+            return;
+        agl_phys_tree_find_pairs(w->tree, w->treePairs, w->treePairCapacity);
+    }
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t a = agl_phys_tree_get_user(w->tree, w->treePairs[k].a), b = agl_phys_tree_get_user(w->tree, w->treePairs[k].b);
+        // The tree holds grown boxes, the other methods test the bounds themselves
+        if ((w->bodies[a].invMass != 0.f || w->bodies[b].invMass != 0.f) && aabbf_overlaps(&w->aabbs[a], &w->aabbs[b]))
+            agl__PhysAddPair(w, a, b);
+    }
+}
+
+static void agl__PhysFindPairsSap(agl_phys_world_t *w) {
+    uint32_t n = agl_phys_sap_find_pairs(w->sap, w->aabbs, w->bodyCount);
+    const agl_phys_pair_t *pairs = agl_phys_sap_get_pairs(w->sap);
+    for (uint32_t k = 0; k < n; k++) {
+        if (w->bodies[pairs[k].a].invMass != 0.f || w->bodies[pairs[k].b].invMass != 0.f)
+            agl__PhysAddPair(w, pairs[k].a, pairs[k].b);
+    }
+}
+
+static void agl__PhysFindPairs(agl_phys_world_t *w) {
+    w->pairCount = 0;
+    uint32_t dynCount = 0;
+    for (uint32_t i = 0; i < w->bodyCount; i++) {
+        const agl__phys_body_t *b = &w->bodies[i];
+        if (!(b->flags & AGL__PHYS_BODY_ALIVE))
+            continue;
+        w->aabbs[i] = agl__PhysBodyBounds(b);
+        if (b->invMass == 0.f)
+            continue;
+        // Stretched by two steps of motion so a body moving steadily is reinserted every few steps at most
+        vec3f_t displacement = b->v;
+        vec3f_scale(&displacement, 2.f * w->dt);
+        agl_phys_tree_move(w->tree, b->proxy, &w->aabbs[i], &displacement);
+        w->dynAabbs[dynCount] = w->aabbs[i];
+        w->dynBodies[dynCount++] = i;
+    }
+    if (dynCount == 0)
+        return;
+    if (w->broadphase == AGL_PHYS_BROADPHASE_TREE)
+        agl__PhysFindPairsTree(w);
+    else if (w->broadphase == AGL_PHYS_BROADPHASE_SAP)
+        agl__PhysFindPairsSap(w);
+    else
+        agl__PhysFindPairsGrid(w, dynCount);
+}
+
+// World queries
+
+typedef struct agl__phys_ray_query_t {
+    const agl_phys_world_t *world;
+    const rayf_t *ray;
+    agl_phys_ray_hit_t *hit;
+} agl__phys_ray_query_t;
+
+// Tests the exact shape of the body behind a leaf the ray entered, boxes in their own frame
+static float agl__PhysRayBody(void *ctx, uint32_t proxy, float t, float tmax) {
+    (void)t;
+    agl__phys_ray_query_t *q = (agl__phys_ray_query_t*)ctx;
+    uint32_t body = agl_phys_tree_get_user(q->world->tree, proxy);
+    const agl__phys_body_t *b = &q->world->bodies[body];
+    float hit;
+    vec3f_t normal = vec3f(0.f, 0.f, 0.f);
+    if (b->shape == AGL_PHYS_SHAPE_SPHERE) {
+        spheref_t s = spheref(b->pos._m[0], b->pos._m[1], b->pos._m[2], b->halfExtents._m[0]);
+        if (!rayf_intersect_sphere(q->ray, &s, tmax, &hit))
+            return tmax;
+        if (hit > 0.f) {
+            vec3f_t p = q->ray->origin;
+            vec3f_addscaled(&p, &q->ray->dir, hit);
+            vec3f_sub2(&normal, &p, &b->pos);
+            vec3f_scale(&normal, 1.f / b->halfExtents._m[0]);
+        }
+    } else {
+        rayf_t local;
+        vec3f_t d;
+        vec3f_sub2(&d, &q->ray->origin, &b->pos);
+        vec3f_mulmat3f(&local.origin, &d, &b->axes);
+        vec3f_mulmat3f(&local.dir, &q->ray->dir, &b->axes);
+        aabbf_t box = { b->halfExtents, b->halfExtents };
+        vec3f_scale(&box.min, -1.f);
+        if (!rayf_intersect_aabb(&local, &box, tmax, &hit))
+            return tmax;
+        if (hit > 0.f) {
+            // The face the hit point lies furthest out on
+            vec3f_t p = local.origin, localNormal = vec3f(0.f, 0.f, 0.f);
+            vec3f_addscaled(&p, &local.dir, hit);
+            int face = 0;
+            for (int i = 1; i < 3; i++)
+                face = fabsf(p._m[i]) / b->halfExtents._m[i] > fabsf(p._m[face]) / b->halfExtents._m[face] ? i : face;
+            localNormal._m[face] = p._m[face] < 0.f ? -1.f : 1.f;
+            mat3f_mulvec3f(&normal, &b->axes, &localNormal);
+        }
+    }
+    if (q->hit->body != AGL_PHYS_INVALID_BODY && (hit > q->hit->t || (hit == q->hit->t && body > q->hit->body)))
+        return tmax;
+    q->hit->body = body;
+    q->hit->t = hit;
+    q->hit->normal = normal;
+    return hit;
+}
+
+uint32_t agl_phys_world_raycast(const agl_phys_world_t *w, agl_phys_ray_hit_t *hits, const rayf_t *rays, uint32_t count, float tmax) {
+    uint32_t hitCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        hits[i] = (agl_phys_ray_hit_t){ AGL_PHYS_INVALID_BODY, tmax, vec3f(0.f, 0.f, 0.f) };
+        agl__phys_ray_query_t q = { w, &rays[i], &hits[i] };
+        agl__PhysTreeRay(w->tree, &rays[i], tmax, agl__PhysRayBody, &q);
+        hitCount += hits[i].body != AGL_PHYS_INVALID_BODY;
+    }
+    return hitCount;
+}
+
+typedef struct agl__phys_box_query_t {
+    const agl_phys_world_t *world;
+    const aabbf_t *box;
+    agl__phys_results_t *out;
+} agl__phys_box_query_t;
+
+// Keeps the bodies whose own bounds overlap, the tree holds grown boxes
+static void agl__PhysQueryBody(void *ctx, uint32_t proxy) {
+    agl__phys_box_query_t *q = (agl__phys_box_query_t*)ctx;
+    uint32_t body = agl_phys_tree_get_user(q->world->tree, proxy);
+    if (aabbf_overlaps(&q->world->aabbs[body], q->box))
+        agl__PhysResultsAdd(q->out, body);
+}
+
+uint32_t agl_phys_world_query(const agl_phys_world_t *w, uint32_t *bodies, uint32_t *starts, uint32_t capacity, const aabbf_t *boxes,
+    uint32_t count) {
+    agl__phys_results_t out = { bodies, capacity, 0 };
+    starts[0] = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        agl__phys_box_query_t q = { w, &boxes[i], &out };
+        agl__PhysTreeQueryBox(w->tree, &boxes[i], agl__PhysQueryBody, &q);
+        starts[i + 1] = out.count < capacity ? out.count : capacity;
+    }
+    return out.count;
+}
+
+// Narrowphase
+//
+// Every test reports up to 4 points with the normal from A to B, the separation along it, and the point halfway between
+// the surfaces. Points separated by up to AGL__PHYS_MARGIN are kept so the solver can stop bodies before they touch.
+
+typedef struct agl__phys_point_t {
+    vec3f_t point;
+    float separation;
+} agl__phys_point_t;
+
+static uint32_t agl__PhysSphereSphere(const agl__phys_body_t *a, const agl__phys_body_t *b, vec3f_t *normal, agl__phys_point_t *out) {
+    vec3f_t d;
+    vec3f_sub2(&d, &b->pos, &a->pos);
+    float dist = vec3f_len(&d);
+    float ra = a->halfExtents._m[0], rb = b->halfExtents._m[0];
+    float separation = dist - ra - rb;
+    if (separation > AGL__PHYS_MARGIN)
+        return 0;
+    *normal = dist > 1e-6f ? vec3f(d._m[0] / dist, d._m[1] / dist, d._m[2] / dist) : vec3f(0.f, 1.f, 0.f);
+    out->point = a->pos;
+    vec3f_addscaled(&out->point, normal, ra + 0.5f * separation);
+    out->separation = separation;
+    return 1;
+}
+
+// `box` is A, the normal points from the box to the sphere
+static uint32_t agl__PhysBoxSphere(const agl__phys_body_t *box, const agl__phys_body_t *sphere, vec3f_t *normal, agl__phys_point_t *out) {
+    vec3f_t d, local, clamped;
+    vec3f_sub2(&d, &sphere->pos, &box->pos);
+    vec3f_mulmat3f(&local, &d, &box->axes);
+    float r = sphere->halfExtents._m[0];
+    bool inside = true;
+    for (int i = 0; i < 3; i++) {
+        float h = box->halfExtents._m[i];
+        clamped._m[i] = local._m[i] < -h ? -h : local._m[i] > h ? h : local._m[i];
+        inside = inside && clamped._m[i] == local._m[i];
+    }
+    clamped._m[3] = 0.f;
+    vec3f_t localNormal;
+    float separation;
+    if (inside) {
+        // Centre inside the box: push out through the nearest face
+        int face = 0;
+        float best = FLT_MAX;
+        for (int i = 0; i < 3; i++) {
+            float depth = box->halfExtents._m[i] - fabsf(local._m[i]);
+            if (depth < best) {
+                best = depth;
+                face = i;
+            }
+        }
+        localNormal = vec3f(0.f, 0.f, 0.f);
+        localNormal._m[face] = local._m[face] < 0.f ? -1.f : 1.f;
+        clamped._m[face] = localNormal._m[face] * box->halfExtents._m[face];
+        separation = -best - r;
+    } else {
+        vec3f_sub2(&localNormal, &local, &clamped);
+        float dist = vec3f_len(&localNormal);
+        separation = dist - r;
+        if (separation > AGL__PHYS_MARGIN)
+            return 0;
+        vec3f_scale(&localNormal, 1.f / dist);
+    }
+    mat3f_mulvec3f(normal, &box->axes, &localNormal);
+    vec3f_t surface;
+    mat3f_mulvec3f(&surface, &box->axes, &clamped);
+    vec3f_add(&surface, &box->pos);
+    out->point = surface;
+    vec3f_addscaled(&out->point, normal, 0.5f * separation);
+    out->separation = separation;
+    return 1;
+}
+
+typedef struct agl__phys_obb_t {
+    vec3f_t c;
+    vec3f_t u[3];
+    float h[3];
+} agl__phys_obb_t;
+
+// Clips polygon `in` against the plane dot(n, x) <= d, returns the new vertex count
+static uint32_t agl__PhysClipPolygon(vec3f_t *out, const vec3f_t *in, uint32_t count, const vec3f_t *n, float d) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const vec3f_t *p = &in[i], *q = &in[(i + 1) % count];
+        float dp = vec3f_dot(n, p) - d, dq = vec3f_dot(n, q) - d;
+        if (dp <= 0.f)
+            out[kept++] = *p;
+        if ((dp < 0.f && dq > 0.f) || (dp > 0.f && dq < 0.f)) {
+            float t = dp / (dp - dq);
+            vec3f_t x = *p;
+            vec3f_t pq;
+            vec3f_sub2(&pq, q, p);
+            vec3f_addscaled(&x, &pq, t);
+            out[kept++] = x;
+        }
+    }
+    return kept;
+}
+
+// Clips the face of `inc` most facing `ref` against the side planes of face `axis` of `ref`, whose outward normal is `n`
+static uint32_t agl__PhysClipFaces(const agl__phys_obb_t *ref, const agl__phys_obb_t *inc, int axis, const vec3f_t *n, agl__phys_point_t *out) {
+    int j = 0;
+    float best = -1.f;
+    for (int k = 0; k < 3; k++) {
+        float d = fabsf(vec3f_dot(n, &inc->u[k]));
+        if (d > best) {
+            best = d;
+            j = k;
+        }
+    }
+    int u = (j + 1) % 3, v = (j + 2) % 3;
+    vec3f_t face = inc->c;
+    vec3f_addscaled(&face, &inc->u[j], vec3f_dot(n, &inc->u[j]) > 0.f ? -inc->h[j] : inc->h[j]);
+    vec3f_t polygon[2][8];
+    const float su[4] = { 1.f, -1.f, -1.f, 1.f }, sv[4] = { 1.f, 1.f, -1.f, -1.f };
+    for (int k = 0; k < 4; k++) {
+        polygon[0][k] = face;
+        vec3f_addscaled(&polygon[0][k], &inc->u[u], su[k] * inc->h[u]);
+        vec3f_addscaled(&polygon[0][k], &inc->u[v], sv[k] * inc->h[v]);
+    }
+    uint32_t count = 4;
+    int cur = 0;
+    for (int k = 1; k < 3 && count; k++) {
+        int side = (axis + k) % 3;
+        vec3f_t sn = ref->u[side], snNeg = ref->u[side];
+        vec3f_scale(&snNeg, -1.f);
+        float offset = vec3f_dot(&sn, &ref->c);
+        count = agl__PhysClipPolygon(polygon[1 - cur], polygon[cur], count, &sn, offset + ref->h[side]);
+        cur = 1 - cur;
+        count = agl__PhysClipPolygon(polygon[1 - cur], polygon[cur], count, &snNeg, -offset + ref->h[side]);
+        cur = 1 - cur;
+    }
+    float faceOffset = vec3f_dot(n, &ref->c) + ref->h[axis];
+    agl__phys_point_t points[8];
+    uint32_t kept = 0;
+    for (uint32_t k = 0; k < count; k++) {
+        float separation = vec3f_dot(n, &polygon[cur][k]) - faceOffset;
+        if (separation > AGL__PHYS_MARGIN)
+            continue;
+        points[kept].point = polygon[cur][k];
+        vec3f_addscaled(&points[kept].point, n, -0.5f * separation);
+        points[kept++].separation = separation;
+    }
+    if (kept <= 4) {
+        memcpy(out, points, kept * sizeof(agl__phys_point_t));
+        return kept;
+    }
+    // Keep the deepest point, the one farthest from it, then the two spanning the largest triangles on either side
+    uint32_t keep[4] = { 0, 0, 0, 0 };
+    for (uint32_t k = 1; k < kept; k++)
+        if (points[k].separation < points[keep[0]].separation)
+            keep[0] = k;
+    float far = -1.f;
+    for (uint32_t k = 0; k < kept; k++) {
+        vec3f_t d;
+        vec3f_sub2(&d, &points[k].point, &points[keep[0]].point);
+        if (vec3f_sqrlen(&d) > far) {
+            far = vec3f_sqrlen(&d);
+            keep[1] = k;
+        }
+    }
+    float areaPos = 0.f, areaNeg = 0.f;
+    keep[2] = keep[3] = keep[0];
+    vec3f_t edge;
+    vec3f_sub2(&edge, &points[keep[1]].point, &points[keep[0]].point);
+    for (uint32_t k = 0; k < kept; k++) {
+        vec3f_t d, c;
+        vec3f_sub2(&d, &points[k].point, &points[keep[0]].point);
+        vec3f_cross(&c, &edge, &d);
+        float area = vec3f_dot(&c, n);
+        if (area > areaPos) {
+            areaPos = area;
+            keep[2] = k;
+        } else if (area < areaNeg) {
+            areaNeg = area;
+            keep[3] = k;
+        }
+    }
+    uint32_t n4 = 0;
+    for (uint32_t k = 0; k < 4; k++) {
+        bool dup = false;
+        for (uint32_t m = 0; m < k; m++)
+            dup = dup || keep[m] == keep[k];
+        if (!dup)
+            out[n4++] = points[keep[k]];
+    }
+    return n4;
+}
+
+// Separating axis test over the 3 + 3 face normals and 9 edge cross products, worked out in A's frame from the relative
+// rotation R = A^T B. Then face clipping, or the closest points of the two edges. Face axes are preferred unless an edge axis
+// separates clearly more, which keeps resting contacts stable.
+static uint32_t agl__PhysBoxBox(const agl__phys_body_t *a, const agl__phys_body_t *b, vec3f_t *normal, agl__phys_point_t *out) {
+    agl__phys_obb_t A, B;
+    A.c = a->pos;
+    B.c = b->pos;
+    for (int i = 0; i < 3; i++) {
+        A.u[i] = agl__PhysAxis(&a->axes, i);
+        B.u[i] = agl__PhysAxis(&b->axes, i);
+        A.h[i] = a->halfExtents._m[i];
+        B.h[i] = b->halfExtents._m[i];
+    }
+    vec3f_t d;
+    vec3f_sub2(&d, &B.c, &A.c);
+    float R[3][3], absR[3][3], t[3];
+    for (int i = 0; i < 3; i++) {
+        t[i] = vec3f_dot(&d, &A.u[i]);
+        for (int j = 0; j < 3; j++) {
+            R[i][j] = vec3f_dot(&A.u[i], &B.u[j]);
+            absR[i][j] = fabsf(R[i][j]) + 1e-6f;
+        }
+    }
+    float faceA = -FLT_MAX, faceB = -FLT_MAX, edge = -FLT_MAX;
+    int faceAxisA = 0, faceAxisB = 0, edgeA = 0, edgeB = 0;
+    for (int i = 0; i < 3; i++) {
+        float s = fabsf(t[i]) - A.h[i] - (B.h[0] * absR[i][0] + B.h[1] * absR[i][1] + B.h[2] * absR[i][2]);
+        if (s > AGL__PHYS_MARGIN)
+            return 0;
+        if (s > faceA) {
+            faceA = s;
+            faceAxisA = i;
+        }
+    }
+    for (int j = 0; j < 3; j++) {
+        float s = fabsf(t[0] * R[0][j] + t[1] * R[1][j] + t[2] * R[2][j]) - B.h[j] - (A.h[0] * absR[0][j] + A.h[1] * absR[1][j] + A.h[2] * absR[2][j]);
+        if (s > AGL__PHYS_MARGIN)
+            return 0;
+        if (s > faceB) {
+            faceB = s;
+            faceAxisB = j;
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+        for (int j = 0; j < 3; j++) {
+            int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+            // |A_i x B_j| = sin of the angle between the edges
+            float len = sqrtf(R[i1][j] * R[i1][j] + R[i2][j] * R[i2][j]);
+            if (len < 1e-3f)
+                continue; // parallel edges, covered by the face axes
+            float dist = fabsf(t[i2] * R[i1][j] - t[i1] * R[i2][j]);
+            float ra = A.h[i1] * absR[i2][j] + A.h[i2] * absR[i1][j];
+            float rb = B.h[j1] * absR[i][j2] + B.h[j2] * absR[i][j1];
+            float s = (dist - ra - rb) / len;
+            if (s > AGL__PHYS_MARGIN)
+                return 0;
+            if (s > edge) {
+                edge = s;
+                edgeA = i;
+                edgeB = j;
+            }
+        }
+    }
+    const float relTol = 0.95f, absTol = 0.01f * fminf(fminf(A.h[0], A.h[1]), A.h[2]);
+    float face = faceA;
+    if (faceB > relTol * faceA + absTol)
+        face = faceB;
+    if (edge > relTol * face + absTol) {
+        vec3f_t n = vec3f(0.f, 0.f, 0.f);
+        vec3f_cross(&n, &A.u[edgeA], &B.u[edgeB]);
+        vec3f_normalize(&n);
+        if (vec3f_dot(&n, &d) < 0.f)
+            vec3f_scale(&n, -1.f);
+        // Support edges: A's furthest along n, B's furthest along -n
+        vec3f_t ca = A.c, cb = B.c;
+        for (int k = 0; k < 3; k++) {
+            if (k != edgeA)
+                vec3f_addscaled(&ca, &A.u[k], vec3f_dot(&A.u[k], &n) > 0.f ? A.h[k] : -A.h[k]);
+            if (k != edgeB)
+                vec3f_addscaled(&cb, &B.u[k], vec3f_dot(&B.u[k], &n) > 0.f ? -B.h[k] : B.h[k]);
+        }
+        vec3f_t r;
+        vec3f_sub2(&r, &ca, &cb);
+        float bb = R[edgeA][edgeB], c = vec3f_dot(&A.u[edgeA], &r), f = vec3f_dot(&B.u[edgeB], &r);
+        float denom = 1.f - bb * bb;
+        float s = denom > 1e-6f ? (bb * f - c) / denom : 0.f;
+        s = s < -A.h[edgeA] ? -A.h[edgeA] : s > A.h[edgeA] ? A.h[edgeA] : s;
+        float u = bb * s + f;
+        u = u < -B.h[edgeB] ? -B.h[edgeB] : u > B.h[edgeB] ? B.h[edgeB] : u;
+        vec3f_addscaled(&ca, &A.u[edgeA], s);
+        vec3f_addscaled(&cb, &B.u[edgeB], u);
+        *normal = n;
+        out->point = vec3f(0.5f * (ca._m[0] + cb._m[0]), 0.5f * (ca._m[1] + cb._m[1]), 0.5f * (ca._m[2] + cb._m[2]));
+        out->separation = edge;
+        return 1;
+    }
+    if (face == faceA) {
+        vec3f_t n = A.u[faceAxisA];
+        if (t[faceAxisA] < 0.f)
+            vec3f_scale(&n, -1.f);
+        *normal = n;
+        return agl__PhysClipFaces(&A, &B, faceAxisA, &n, out);
+    }
+    // B is the reference, its face normal points towards A
+    vec3f_t n = B.u[faceAxisB];
+    if (vec3f_dot(&n, &d) > 0.f)
+        vec3f_scale(&n, -1.f);
+    *normal = n;
+    vec3f_scale(normal, -1.f);
+    return agl__PhysClipFaces(&B, &A, faceAxisB, &n, out);
+}
+
+static uint32_t agl__PhysCollide(const agl__phys_body_t *a, const agl__phys_body_t *b, vec3f_t *normal, agl__phys_point_t *out) {
+    if (a->shape == AGL_PHYS_SHAPE_SPHERE && b->shape == AGL_PHYS_SHAPE_SPHERE)
+        return agl__PhysSphereSphere(a, b, normal, out);
+    if (a->shape == AGL_PHYS_SHAPE_BOX && b->shape == AGL_PHYS_SHAPE_BOX)
+        return agl__PhysBoxBox(a, b, normal, out);
+    if (a->shape == AGL_PHYS_SHAPE_BOX)
+        return agl__PhysBoxSphere(a, b, normal, out);
+    uint32_t count = agl__PhysBoxSphere(b, a, normal, out);
+    vec3f_scale(normal, -1.f);
+    return count;
+}
+
+static const agl__phys_manifold_t *agl__PhysFindPrevManifold(const agl_phys_world_t *w, uint32_t a, uint32_t b) {
+    if (!w->manifoldTable)
+        return NULL;
+    uint64_t key = ((uint64_t)a << 32) | b;
+    uint32_t slot = (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & w->manifoldTableMask;
+    for (;;) {
+        uint32_t index = w->manifoldTable[slot];
+        if (index == AGL_PHYS_INVALID_BODY)
+            return NULL;
+        const agl__phys_manifold_t *m = &w->prevManifolds[index];
+        if (m->a == a && m->b == b)
+            return m;
+        slot = (slot + 1) & w->manifoldTableMask;
+    }
+}
+
+static void agl__PhysBuildManifoldTable(agl_phys_world_t *w) {
+    uint32_t size = 64;
+    while (size < 2 * w->prevManifoldCount)
+        size *= 2;
+    if (w->manifoldTableMask + 1 < size || !w->manifoldTable) {
+        free(w->manifoldTable);
+        w->manifoldTable = (uint32_t*)malloc(size * sizeof(uint32_t));
+        w->manifoldTableMask = size - 1;
+    }
+    memset(w->manifoldTable, 0xFF, (w->manifoldTableMask + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < w->prevManifoldCount; i++) {
+        if (w->prevManifolds[i].count == 0)
+            continue;
+        uint64_t key = ((uint64_t)w->prevManifolds[i].a << 32) | w->prevManifolds[i].b;
+        uint32_t slot = (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & w->manifoldTableMask;
+        while (w->manifoldTable[slot] != AGL_PHYS_INVALID_BODY)
+            slot = (slot + 1) & w->manifoldTableMask;
+        w->manifoldTable[slot] = i;
+    }
+}
+
+static bool agl__PhysBodyAwake(const agl__phys_body_t *b) {
+    return b->invMass != 0.f && !(b->flags & AGL__PHYS_BODY_SLEEPING);
+}
+
+// One manifold per pair, written to the pair's slot. Contacts within AGL__PHYS_MARGIN of last step's take over their normal
+// impulses, and the manifold keeps its friction impulses.
+static void agl__PhysCollideTask(void *ctx, uint32_t thread) {
+    agl_phys_world_t *w = (agl_phys_world_t*)ctx;
+    uint32_t first = (uint32_t)((uint64_t)w->pairCount * thread / w->threadCount);
+    uint32_t last = (uint32_t)((uint64_t)w->pairCount * (thread + 1) / w->threadCount);
+    for (uint32_t p = first; p < last; p++) {
+        const agl__phys_body_t *a = &w->bodies[w->pairs[p].a], *b = &w->bodies[w->pairs[p].b];
+        agl__phys_manifold_t *m = &w->manifolds[p];
+        const agl__phys_manifold_t *prev = agl__PhysFindPrevManifold(w, w->pairs[p].a, w->pairs[p].b);
+        if (!agl__PhysBodyAwake(a) && !agl__PhysBodyAwake(b)) {
+            // Neither body moved, the cached manifold still holds and keeps the sleeping island together
+            if (prev)
+                *m = *prev;
+            else
+                m->count = 0;
+            continue;
+        }
+        agl__phys_point_t points[4];
+        vec3f_t normal;
+        m->a = w->pairs[p].a;
+        m->b = w->pairs[p].b;
+        m->count = agl__PhysCollide(a, b, &normal, points);
+        m->normal = normal;
+        m->friction = sqrtf(a->friction * b->friction);
+        m->frictionImpulse = prev ? prev->frictionImpulse : vec3f(0.f, 0.f, 0.f);
+        m->twistImpulse = prev ? prev->twistImpulse : 0.f;
+        for (uint32_t k = 0; k < m->count; k++) {
+            agl__phys_contact_t *c = &m->contacts[k];
+            vec3f_t d;
+            vec3f_sub2(&d, &points[k].point, &a->pos);
+            vec3f_mulmat3f(&c->localA, &d, &a->axes);
+            c->point = points[k].point;
+            c->separation = points[k].separation;
+            c->normalImpulse = 0.f;
+            if (!prev)
+                continue;
+            float best = AGL__PHYS_MARGIN * AGL__PHYS_MARGIN;
+            for (uint32_t j = 0; j < prev->count; j++) {
+                vec3f_sub2(&d, &c->localA, &prev->contacts[j].localA);
+                float dist2 = vec3f_sqrlen(&d);
+                if (dist2 < best) {
+                    best = dist2;
+                    c->normalImpulse = prev->contacts[j].normalImpulse;
+                }
+            }
+        }
+    }
+}
+
+// Islands
+
+static uint32_t agl__PhysFindRoot(uint32_t *parent, uint32_t i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+// Groups the dynamic bodies connected by touching manifolds. An island with an awake body wakes as a whole.
+static void agl__PhysBuildIslands(agl_phys_world_t *w) {
+    for (uint32_t i = 0; i < w->bodyCount; i++)
+        w->parent[i] = i;
+    for (uint32_t m = 0; m < w->manifoldCount; m++) {
+        const agl__phys_manifold_t *man = &w->manifolds[m];
+        if (man->count == 0 || w->bodies[man->a].invMass == 0.f || w->bodies[man->b].invMass == 0.f)
+            continue;
+        uint32_t ra = agl__PhysFindRoot(w->parent, man->a), rb = agl__PhysFindRoot(w->parent, man->b);
+        if (ra != rb)
+            w->parent[ra > rb ? ra : rb] = ra < rb ? ra : rb;
+    }
+    // Number the islands in order of their lowest body, so the layout only depends on the scene
+    w->islandCount = 0;
+    for (uint32_t i = 0; i < w->bodyCount; i++) {
+        const agl__phys_body_t *b = &w->bodies[i];
+        w->islandOf[i] = AGL_PHYS_INVALID_BODY;
+        if (!(b->flags & AGL__PHYS_BODY_ALIVE) || b->invMass == 0.f)
+            continue;
+        uint32_t root = agl__PhysFindRoot(w->parent, i);
+        if (root == i) {
+            w->islandAwake[w->islandCount] = 0;
+            w->islandBodyStart[w->islandCount + 1] = 0;
+            w->islandManifoldStart[w->islandCount + 1] = 0;
+            w->islandOf[i] = w->islandCount++;
+        } else {
+            w->islandOf[i] = w->islandOf[root]; // roots are the lowest body of their island, already numbered
+        }
+        w->islandBodyStart[w->islandOf[i] + 1]++;
+        w->islandAwake[w->islandOf[i]] |= !(b->flags & AGL__PHYS_BODY_SLEEPING);
+    }
+    w->islandBodyStart[0] = w->islandManifoldStart[0] = 0;
+    for (uint32_t m = 0; m < w->manifoldCount; m++) {
+        const agl__phys_manifold_t *man = &w->manifolds[m];
+        if (man->count)
+            w->islandManifoldStart[w->islandOf[w->bodies[man->a].invMass != 0.f ? man->a : man->b] + 1]++;
+    }
+    for (uint32_t i = 0; i < w->islandCount; i++) {
+        w->islandBodyStart[i + 1] += w->islandBodyStart[i];
+        w->islandManifoldStart[i + 1] += w->islandManifoldStart[i];
+    }
+    // Scatter, then shift the starts back
+    for (uint32_t i = 0; i < w->bodyCount; i++)
+        if (w->islandOf[i] != AGL_PHYS_INVALID_BODY)
+            w->islandBodies[w->islandBodyStart[w->islandOf[i]]++] = i;
+    for (uint32_t m = 0; m < w->manifoldCount; m++) {
+        const agl__phys_manifold_t *man = &w->manifolds[m];
+        if (man->count)
+            w->islandManifolds[w->islandManifoldStart[w->islandOf[w->bodies[man->a].invMass != 0.f ? man->a : man->b]]++] = m;
+    }
+    for (uint32_t i = w->islandCount; i > 0; i--) {
+        w->islandBodyStart[i] = w->islandBodyStart[i - 1];
+        w->islandManifoldStart[i] = w->islandManifoldStart[i - 1];
+    }
+    w->islandBodyStart[0] = w->islandManifoldStart[0] = 0;
+}
+
+// Solver
+//
+// Sequential impulses with warm starting from the contact cache. Each manifold has a normal row per point, and friction
+// acts once at the centre of its points: two tangent rows bounded by the summed normal impulse, and a twist row about the
+// normal. Penetration deeper than AGL__PHYS_SLOP is removed with a Baumgarte velocity bias, and a positive separation lets
+// the contact close exactly the gap in one step (speculative contact).
+//
+// Manifolds are coloured so no two of a colour share a dynamic body, and each colour is solved 4 manifolds at a time, one per
+// SSE lane. Solving manifold after manifold would wait on the velocities the previous one just wrote.
+//
+// Small islands are handed out whole, one run of islands per thread. A large one, like a pile where every body rests on
+// another, would leave the other threads idle, so all threads solve it together: each colour's bundles are split between
+// them, with a barrier before the next colour. The static stand-in body is never written, so the threads of a colour share
+// no memory, and solving the bundles of a colour in any order gives the same velocities.
+
+#define AGL__PHYS_COLORS 64 // manifolds of bodies touching more than this many others are solved one per bundle
+#define AGL__PHYS_WIDE_MANIFOLDS 1024 // fewest manifolds in an island worth splitting between the threads
+
+static void agl__PhysGather(const agl__phys_solver_body_t *bodies, const uint32_t index[4], __m128 v[3], __m128 w[3]) {
+    __m128 r0 = _mm_loadu_ps(bodies[index[0]].v._m), r1 = _mm_loadu_ps(bodies[index[1]].v._m);
+    __m128 r2 = _mm_loadu_ps(bodies[index[2]].v._m), r3 = _mm_loadu_ps(bodies[index[3]].v._m);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    v[0] = r0, v[1] = r1, v[2] = r2;
+    r0 = _mm_loadu_ps(bodies[index[0]].w._m), r1 = _mm_loadu_ps(bodies[index[1]].w._m);
+    r2 = _mm_loadu_ps(bodies[index[2]].w._m), r3 = _mm_loadu_ps(bodies[index[3]].w._m);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    w[0] = r0, w[1] = r1, w[2] = r2;
+}
+
+// Lanes of the static stand-in `standIn` are dropped, it keeps a zero velocity
+static void agl__PhysScatter(agl__phys_solver_body_t *bodies, const uint32_t index[4], uint32_t standIn, const __m128 v[3],
+    const __m128 w[3]) {
+    __m128 rv[4] = { v[0], v[1], v[2], _mm_setzero_ps() }, rw[4] = { w[0], w[1], w[2], _mm_setzero_ps() };
+    _MM_TRANSPOSE4_PS(rv[0], rv[1], rv[2], rv[3]);
+    _MM_TRANSPOSE4_PS(rw[0], rw[1], rw[2], rw[3]);
+    for (int lane = 0; lane < 4; lane++) {
+        if (index[lane] == standIn)
+            continue;
+        _mm_storeu_ps(bodies[index[lane]].v._m, rv[lane]);
+        _mm_storeu_ps(bodies[index[lane]].w._m, rw[lane]);
+    }
+}
+
+static __m128 agl__PhysDot3(const float a[3][4], const __m128 b[3]) {
+    __m128 r = _mm_mul_ps(_mm_loadu_ps(a[0]), b[0]);
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(a[1]), b[1]));
+    return _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(a[2]), b[2]));
+}
+
+// Velocity of B relative to A along a row, `dir` is NULL for rows without a linear part
+static __m128 agl__PhysRowVelocity(const agl__phys_row_t *row, const float (*dir)[4], const __m128 vA[3], const __m128 wA[3],
+    const __m128 vB[3], const __m128 wB[3]) {
+    __m128 dv = _mm_sub_ps(agl__PhysDot3(row->rBxd, wB), agl__PhysDot3(row->rAxd, wA));
+    if (dir)
+        dv = _mm_add_ps(dv, _mm_sub_ps(agl__PhysDot3(dir, vB), agl__PhysDot3(dir, vA)));
+    return dv;
+}
+
+static void agl__PhysApplyRow(const agl__phys_row_t *row, const float (*dir)[4], __m128 delta, __m128 mA, __m128 mB, __m128 vA[3],
+    __m128 wA[3], __m128 vB[3], __m128 wB[3]) {
+    __m128 dA = _mm_mul_ps(delta, mA), dB = _mm_mul_ps(delta, mB);
+    for (int i = 0; i < 3; i++) {
+        if (dir) {
+            __m128 d = _mm_loadu_ps(dir[i]);
+            vA[i] = _mm_sub_ps(vA[i], _mm_mul_ps(d, dA));
+            vB[i] = _mm_add_ps(vB[i], _mm_mul_ps(d, dB));
+        }
+        wA[i] = _mm_sub_ps(wA[i], _mm_mul_ps(_mm_loadu_ps(row->iArAxd[i]), delta));
+        wB[i] = _mm_add_ps(wB[i], _mm_mul_ps(_mm_loadu_ps(row->iBrBxd[i]), delta));
+    }
+}
+
+// Solves one row with its accumulated impulse clamped to [lo, hi], or applies the cached impulse when `warmStart` is set
+static void agl__PhysSolveRow(agl__phys_row_t *row, const float (*dir)[4], __m128 bias, __m128 lo, __m128 hi, bool warmStart,
+    __m128 mA, __m128 mB, __m128 vA[3], __m128 wA[3], __m128 vB[3], __m128 wB[3]) {
+    __m128 old = _mm_loadu_ps(row->impulse), delta = old;
+    if (!warmStart) {
+        __m128 dv = _mm_add_ps(agl__PhysRowVelocity(row, dir, vA, wA, vB, wB), bias);
+        __m128 total = _mm_sub_ps(old, _mm_mul_ps(_mm_loadu_ps(row->mass), dv));
+        total = _mm_min_ps(_mm_max_ps(total, lo), hi);
+        _mm_storeu_ps(row->impulse, total);
+        delta = _mm_sub_ps(total, old);
+    }
+    agl__PhysApplyRow(row, dir, delta, mA, mB, vA, wA, vB, wB);
+}
+
+static void agl__PhysSolveBundle(agl__phys_solver_body_t *bodies, uint32_t standIn, agl__phys_bundle_t *c, bool warmStart) {
+    __m128 vA[3], wA[3], vB[3], wB[3];
+    agl__PhysGather(bodies, c->a, vA, wA);
+    agl__PhysGather(bodies, c->b, vB, wB);
+    __m128 mA = _mm_loadu_ps(c->invMassA), mB = _mm_loadu_ps(c->invMassB), zero = _mm_setzero_ps();
+    __m128 pressure = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(c->normal[0].impulse), _mm_loadu_ps(c->normal[1].impulse)),
+        _mm_add_ps(_mm_loadu_ps(c->normal[2].impulse), _mm_loadu_ps(c->normal[3].impulse)));
+    __m128 limit = _mm_mul_ps(_mm_loadu_ps(c->friction), pressure);
+    __m128 twistLimit = _mm_mul_ps(_mm_loadu_ps(c->twistRadius), limit);
+    agl__PhysSolveRow(&c->twist, NULL, zero, _mm_sub_ps(zero, twistLimit), twistLimit, warmStart, mA, mB, vA, wA, vB, wB);
+    for (int k = 0; k < 2; k++)
+        agl__PhysSolveRow(&c->tangent[k], c->tangentDir[k], zero, _mm_sub_ps(zero, limit), limit, warmStart, mA, mB, vA, wA, vB, wB);
+    __m128 unbounded = _mm_set1_ps(FLT_MAX);
+    for (int k = 0; k < 4; k++)
+        agl__PhysSolveRow(&c->normal[k], c->normalDir, _mm_loadu_ps(c->bias[k]), zero, unbounded, warmStart, mA, mB, vA, wA, vB, wB);
+    agl__PhysScatter(bodies, c->a, standIn, vA, wA);
+    agl__PhysScatter(bodies, c->b, standIn, vB, wB);
+}
+
+static void agl__PhysTangents(const vec3f_t *n, vec3f_t *t0, vec3f_t *t1) {
+    if (fabsf(n->_m[0]) >= 0.57735f)
+        *t0 = vec3f(n->_m[1], -n->_m[0], 0.f);
+    else
+        *t0 = vec3f(0.f, n->_m[2], -n->_m[1]);
+    vec3f_normalize(t0);
+    *t1 = vec3f(0.f, 0.f, 0.f);
+    vec3f_cross(t1, n, t0);
+}
+
+// Fills lane `lane` of a row, `rA` and `rB` are the lever arms of the row's point, or NULL for a purely angular row
+static void agl__PhysSetRow(agl__phys_row_t *row, int lane, const agl__phys_body_t *a, const agl__phys_body_t *b, const vec3f_t *dir,
+    const vec3f_t *rA, const vec3f_t *rB, float impulse) {
+    vec3f_t rAxd = *dir, rBxd = *dir, iA, iB;
+    float k = 0.f;
+    if (rA) {
+        vec3f_cross(&rAxd, rA, dir);
+        vec3f_cross(&rBxd, rB, dir);
+        k = a->invMass + b->invMass;
+    }
+    mat3f_mulvec3f(&iA, &a->invInertia, &rAxd);
+    mat3f_mulvec3f(&iB, &b->invInertia, &rBxd);
+    k += vec3f_dot(&rAxd, &iA) + vec3f_dot(&rBxd, &iB);
+    row->mass[lane] = k > 0.f ? 1.f / k : 0.f;
+    row->impulse[lane] = impulse;
+    for (int i = 0; i < 3; i++) {
+        row->rAxd[i][lane] = rAxd._m[i];
+        row->rBxd[i][lane] = rBxd._m[i];
+        row->iArAxd[i][lane] = iA._m[i];
+        row->iBrBxd[i][lane] = iB._m[i];
+    }
+}
+
+static uint32_t agl__PhysLowestZero(uint64_t mask) {
+    uint32_t bit = 0;
+    while (mask & 1) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+}
+
+// One island's solve: its bodies and manifolds, and the bundle layout in the scratch memory of the thread that prepared it
+typedef struct agl__phys_island_solve_t {
+    agl__phys_scratch_t *s;
+    const uint32_t *bodies, *manifolds;
+    uint32_t bodyCount, manifoldCount; // the last solver body, at bodyCount, stands in for every static body
+    uint32_t bundleCount;
+    uint32_t bundleStart[AGL__PHYS_COLORS + 2]; // bundles of each colour, then of the manifolds past the colours
+} agl__phys_island_solve_t;
+
+static uint32_t agl__PhysSplit(uint32_t count, uint32_t part, uint32_t parts) {
+    return (uint32_t)((uint64_t)count * part / parts);
+}
+
+// Sets up the solver bodies with gravity applied, colours the manifolds and assigns each one a bundle lane
+static bool agl__PhysPrepareIsland(agl_phys_world_t *w, agl__phys_island_solve_t *is, agl__phys_scratch_t *s, uint32_t island) {
+    const float dt = w->dt;
+    const uint32_t *bodies = w->islandBodies + w->islandBodyStart[island];
+    uint32_t bodyCount = w->islandBodyStart[island + 1] - w->islandBodyStart[island];
+    const uint32_t *manifolds = w->islandManifolds + w->islandManifoldStart[island];
+    uint32_t manifoldCount = w->islandManifoldStart[island + 1] - w->islandManifoldStart[island];
+    if (!agl__PhysReserve((void**)&s->bodies, &s->bodyCapacity, bodyCount + 1, sizeof(agl__phys_solver_body_t)) ||
+        !agl__PhysReserve((void**)&s->colors, &s->colorCapacity, manifoldCount + bodyCount + 1, sizeof(uint64_t)) ||
+        !agl__PhysReserve((void**)&s->bundles, &s->bundleCapacity, manifoldCount + AGL__PHYS_COLORS, sizeof(agl__phys_bundle_t)) ||
+        !agl__PhysReserve((void**)&s->lanes, &s->laneCapacity, 4 * (manifoldCount + AGL__PHYS_COLORS), sizeof(uint32_t)))
+        return false;
+    is->s = s;
+    is->bodies = bodies;
+    is->bodyCount = bodyCount;
+    is->manifolds = manifolds;
+    is->manifoldCount = manifoldCount;
+    for (uint32_t i = 0; i < bodyCount; i++) {
+        agl__phys_body_t *b = &w->bodies[bodies[i]];
+        agl__phys_solver_body_t *sb = &s->bodies[i];
+        b->flags &= ~AGL__PHYS_BODY_SLEEPING;
+        sb->v = b->v;
+        vec3f_addscaled(&sb->v, &w->gravity, dt);
+        sb->w = b->w;
+        w->solverIndex[bodies[i]] = i;
+    }
+    memset(&s->bodies[bodyCount], 0, sizeof(agl__phys_solver_body_t));
+    // Greedy colouring in manifold order: the body masks come first in `colors`, then the colour of each manifold
+    uint64_t *bodyColors = s->colors, *manifoldColors = s->colors + bodyCount + 1;
+    uint32_t colorCount[AGL__PHYS_COLORS + 1] = { 0 };
+    memset(bodyColors, 0, (bodyCount + 1) * sizeof(uint64_t));
+    for (uint32_t m = 0; m < manifoldCount; m++) {
+        const agl__phys_manifold_t *man = &w->manifolds[manifolds[m]];
+        uint32_t ia = w->bodies[man->a].invMass != 0.f ? w->solverIndex[man->a] : bodyCount;
+        uint32_t ib = w->bodies[man->b].invMass != 0.f ? w->solverIndex[man->b] : bodyCount;
+        uint64_t used = (ia != bodyCount ? bodyColors[ia] : 0) | (ib != bodyCount ? bodyColors[ib] : 0);
+        uint32_t color = agl__PhysLowestZero(used);
+        if (color < AGL__PHYS_COLORS) {
+            bodyColors[ia] |= 1ull << color;
+            bodyColors[ib] |= 1ull << color;
+        }
+        manifoldColors[m] = color;
+        colorCount[color]++;
+    }
+    is->bundleStart[0] = 0;
+    for (uint32_t c = 0; c < AGL__PHYS_COLORS; c++)
+        is->bundleStart[c + 1] = is->bundleStart[c] + (colorCount[c] + 3) / 4;
+    is->bundleStart[AGL__PHYS_COLORS + 1] = is->bundleStart[AGL__PHYS_COLORS] + colorCount[AGL__PHYS_COLORS];
+    is->bundleCount = is->bundleStart[AGL__PHYS_COLORS + 1];
+    // Each manifold in its colour's next free lane
+    memset(s->lanes, 0xFF, 4 * is->bundleCount * sizeof(uint32_t));
+    memset(colorCount, 0, sizeof(colorCount));
+    for (uint32_t m = 0; m < manifoldCount; m++) {
+        uint32_t color = (uint32_t)manifoldColors[m], slot = colorCount[color]++;
+        s->lanes[4 * is->bundleStart[color] + (color < AGL__PHYS_COLORS ? slot : 4 * slot)] = m;
+    }
+    return true;
+}
+
+// Fills bundles [first, last) from the manifolds in their lanes
+static void agl__PhysFillBundles(agl_phys_world_t *w, const agl__phys_island_solve_t *is, uint32_t first, uint32_t last) {
+    const float invDt = 1.f / w->dt;
+    const uint32_t bodyCount = is->bodyCount;
+    agl__phys_bundle_t *bundles = is->s->bundles;
+    memset(&bundles[first], 0, (last - first) * sizeof(agl__phys_bundle_t));
+    for (uint32_t i = first; i < last; i++) {
+        agl__phys_bundle_t *c = &bundles[i];
+        for (int lane = 0; lane < 4; lane++) {
+            c->a[lane] = c->b[lane] = bodyCount;
+            uint32_t m = is->s->lanes[4 * i + lane];
+            if (m == UINT32_MAX)
+                continue;
+            agl__phys_manifold_t *man = &w->manifolds[is->manifolds[m]];
+            const agl__phys_body_t *a = &w->bodies[man->a], *b = &w->bodies[man->b];
+            c->a[lane] = a->invMass != 0.f ? w->solverIndex[man->a] : bodyCount;
+            c->b[lane] = b->invMass != 0.f ? w->solverIndex[man->b] : bodyCount;
+            c->invMassA[lane] = a->invMass;
+            c->invMassB[lane] = b->invMass;
+            c->friction[lane] = man->friction;
+            c->manifold[lane] = man;
+            vec3f_t tangent[2], center = vec3f(0.f, 0.f, 0.f), rA, rB;
+            agl__PhysTangents(&man->normal, &tangent[0], &tangent[1]);
+            for (int k = 0; k < 3; k++) {
+                c->normalDir[k][lane] = man->normal._m[k];
+                c->tangentDir[0][k][lane] = tangent[0]._m[k];
+                c->tangentDir[1][k][lane] = tangent[1]._m[k];
+            }
+            for (uint32_t k = 0; k < man->count; k++) {
+                const agl__phys_contact_t *contact = &man->contacts[k];
+                vec3f_sub2(&rA, &contact->point, &a->pos);
+                vec3f_sub2(&rB, &contact->point, &b->pos);
+                agl__PhysSetRow(&c->normal[k], lane, a, b, &man->normal, &rA, &rB, contact->normalImpulse);
+                float sep = contact->separation;
+                c->bias[k][lane] = sep > 0.f ? sep * invDt : fmaxf(AGL__PHYS_BAUMGARTE * invDt * fminf(sep + AGL__PHYS_SLOP, 0.f), -AGL__PHYS_MAX_CORRECTION);
+                vec3f_addscaled(&center, &contact->point, 1.f / man->count);
+            }
+            float radius = 0.f;
+            for (uint32_t k = 0; k < man->count; k++) {
+                vec3f_t d;
+                vec3f_sub2(&d, &man->contacts[k].point, &center);
+                radius += vec3f_len(&d) / man->count;
+            }
+            c->twistRadius[lane] = radius;
+            vec3f_sub2(&rA, &center, &a->pos);
+            vec3f_sub2(&rB, &center, &b->pos);
+            for (int k = 0; k < 2; k++)
+                agl__PhysSetRow(&c->tangent[k], lane, a, b, &tangent[k], &rA, &rB, vec3f_dot(&man->frictionImpulse, &tangent[k]));
+            agl__PhysSetRow(&c->twist, lane, a, b, &man->normal, NULL, NULL, man->twistImpulse);
+        }
+    }
+}
+
+static void agl__PhysSolveBundles(const agl__phys_island_solve_t *is, uint32_t first, uint32_t last, bool warmStart) {
+    for (uint32_t i = first; i < last; i++)
+        agl__PhysSolveBundle(is->s->bodies, is->bodyCount, &is->s->bundles[i], warmStart);
+}
+
+// Keeps the impulses of bundles [first, last) for the next step, friction as a world vector since the tangents follow the normal
+static void agl__PhysStoreImpulses(const agl__phys_island_solve_t *is, uint32_t first, uint32_t last) {
+    for (uint32_t i = first; i < last; i++) {
+        const agl__phys_bundle_t *c = &is->s->bundles[i];
+        for (int lane = 0; lane < 4; lane++) {
+            agl__phys_manifold_t *man = c->manifold[lane];
+            if (!man)
+                continue;
+            for (uint32_t k = 0; k < man->count; k++)
+                man->contacts[k].normalImpulse = c->normal[k].impulse[lane];
+            vec3f_t t0 = vec3f(c->tangentDir[0][0][lane], c->tangentDir[0][1][lane], c->tangentDir[0][2][lane]);
+            vec3f_t t1 = vec3f(c->tangentDir[1][0][lane], c->tangentDir[1][1][lane], c->tangentDir[1][2][lane]);
+            man->frictionImpulse = vec3f(0.f, 0.f, 0.f);
+            vec3f_addscaled(&man->frictionImpulse, &t0, c->tangent[0].impulse[lane]);
+            vec3f_addscaled(&man->frictionImpulse, &t1, c->tangent[1].impulse[lane]);
+            man->twistImpulse = c->twist.impulse[lane];
+        }
+    }
+}
+
+// Integrates solver bodies [first, last), returns the shortest rest time among them
+static float agl__PhysIntegrateBodies(agl_phys_world_t *w, const agl__phys_island_solve_t *is, uint32_t first, uint32_t last) {
+    const float dt = w->dt;
+    float minRest = FLT_MAX;
+    for (uint32_t i = first; i < last; i++) {
+        agl__phys_body_t *b = &w->bodies[is->bodies[i]];
+        const agl__phys_solver_body_t *sb = &is->s->bodies[i];
+        b->v = sb->v;
+        b->w = sb->w;
+        vec3f_addscaled(&b->pos, &b->v, dt);
+        quatf_t spin = quatf(b->w._m[0], b->w._m[1], b->w._m[2], 0.f), dq;
+        quatf_mul2(&dq, &spin, &b->rot);
+        quatf_addscaled(&b->rot, &dq, 0.5f * dt);
+        quatf_normalize(&b->rot);
+        agl__PhysUpdateBody(b);
+        if (vec3f_sqrlen(&b->v) < AGL__PHYS_SLEEP_LINEAR * AGL__PHYS_SLEEP_LINEAR && vec3f_sqrlen(&b->w) < AGL__PHYS_SLEEP_ANGULAR * AGL__PHYS_SLEEP_ANGULAR)
+            b->restTime += dt;
+        else
+            b->restTime = 0.f;
+        minRest = fminf(minRest, b->restTime);
+    }
+    return minRest;
+}
+
+// Puts the island to sleep once every body has rested long enough
+static void agl__PhysSleepIsland(agl_phys_world_t *w, const agl__phys_island_solve_t *is, float minRest) {
+    if (w->sleepTime < 0.f || minRest < w->sleepTime)
+        return;
+    for (uint32_t i = 0; i < is->bodyCount; i++) {
+        agl__phys_body_t *b = &w->bodies[is->bodies[i]];
+        b->flags |= AGL__PHYS_BODY_SLEEPING;
+        b->v = b->w = vec3f(0.f, 0.f, 0.f);
+    }
+}
+
+static void agl__PhysSolveIsland(agl_phys_world_t *w, agl__phys_scratch_t *s, uint32_t island) {
+    agl__phys_island_solve_t is;
+    if (!agl__PhysPrepareIsland(w, &is, s, island))
+        return;
+    agl__PhysFillBundles(w, &is, 0, is.bundleCount);
+    for (uint32_t it = 0; it <= w->iterations; it++)
+        agl__PhysSolveBundles(&is, 0, is.bundleCount, it == 0);
+    agl__PhysStoreImpulses(&is, 0, is.bundleCount);
+    agl__PhysSleepIsland(w, &is, agl__PhysIntegrateBodies(w, &is, 0, is.bodyCount));
+}
+
+static bool agl__PhysIslandIsWide(const agl_phys_world_t *w, uint32_t island) {
+    return w->threadCount > 1 && w->islandManifoldStart[island + 1] - w->islandManifoldStart[island] >= AGL__PHYS_WIDE_MANIFOLDS;
+}
+
+// Splits the awake islands into runs of about equal contact and body count, one per thread, in island order. Wide islands
+// are left to agl__PhysSolveWide.
+static void agl__PhysSolveTask(void *ctx, uint32_t thread) {
+    agl_phys_world_t *w = (agl_phys_world_t*)ctx;
+    uint64_t total = (uint64_t)w->islandBodyStart[w->islandCount] + w->islandManifoldStart[w->islandCount];
+    uint64_t begin = total * thread / w->threadCount, end = total * (thread + 1) / w->threadCount;
+    for (uint32_t i = 0; i < w->islandCount; i++) {
+        uint64_t at = (uint64_t)w->islandBodyStart[i] + w->islandManifoldStart[i];
+        if (at < begin || at >= end)
+            continue;
+        if (w->islandAwake[i] && !agl__PhysIslandIsWide(w, i))
+            agl__PhysSolveIsland(w, &w->scratch[thread], i);
+    }
+}
+
+typedef struct agl__phys_wide_solve_t {
+    agl_phys_world_t *w;
+    uint32_t island;
+    bool prepared;
+    agl__phys_island_solve_t is;
+    agl__phys_barrier_t barrier;
+    float minRest[AGL_PHYS_MAX_THREADS];
+} agl__phys_wide_solve_t;
+
+// The same steps as agl__PhysSolveIsland, each split between the threads
+static void agl__PhysSolveWideTask(void *ctx, uint32_t thread) {
+    agl__phys_wide_solve_t *wide = (agl__phys_wide_solve_t*)ctx;
+    agl_phys_world_t *w = wide->w;
+    agl__phys_island_solve_t *is = &wide->is;
+    if (thread == 0)
+        wide->prepared = agl__PhysPrepareIsland(w, is, &w->scratch[0], wide->island);
+    agl__PhysBarrierWait(&wide->barrier);
+    if (!wide->prepared)
+        return;
+    const uint32_t threads = wide->barrier.count;
+    agl__PhysFillBundles(w, is, agl__PhysSplit(is->bundleCount, thread, threads), agl__PhysSplit(is->bundleCount, thread + 1, threads));
+    agl__PhysBarrierWait(&wide->barrier);
+    for (uint32_t it = 0; it <= w->iterations; it++) {
+        for (uint32_t c = 0; c < AGL__PHYS_COLORS; c++) {
+            uint32_t first = is->bundleStart[c], count = is->bundleStart[c + 1] - first;
+            if (count == 0)
+                continue;
+            agl__PhysSolveBundles(is, first + agl__PhysSplit(count, thread, threads), first + agl__PhysSplit(count, thread + 1, threads), it == 0);
+            agl__PhysBarrierWait(&wide->barrier);
+        }
+        // Manifolds past the colours may share bodies, so they are solved in order on one thread
+        if (is->bundleStart[AGL__PHYS_COLORS + 1] > is->bundleStart[AGL__PHYS_COLORS]) {
+            if (thread == 0)
+                agl__PhysSolveBundles(is, is->bundleStart[AGL__PHYS_COLORS], is->bundleStart[AGL__PHYS_COLORS + 1], it == 0);
+            agl__PhysBarrierWait(&wide->barrier);
+        }
+    }
+    agl__PhysStoreImpulses(is, agl__PhysSplit(is->bundleCount, thread, threads), agl__PhysSplit(is->bundleCount, thread + 1, threads));
+    wide->minRest[thread] = agl__PhysIntegrateBodies(w, is, agl__PhysSplit(is->bodyCount, thread, threads),
+        agl__PhysSplit(is->bodyCount, thread + 1, threads));
+}
+
+static void agl__PhysSolveWide(agl_phys_world_t *w, uint32_t island) {
+    agl__phys_wide_solve_t wide;
+    wide.w = w;
+    wide.island = island;
+    wide.prepared = false;
+    agl__PhysBarrierInit(&wide.barrier, w->threadCount);
+    agl__PhysRunTasks(&wide, w->threadCount, agl__PhysSolveWideTask, &wide.barrier);
+    if (wide.prepared) {
+        float minRest = FLT_MAX;
+        for (uint32_t t = 0; t < wide.barrier.count; t++)
+            minRest = fminf(minRest, wide.minRest[t]);
+        agl__PhysSleepIsland(w, &wide.is, minRest);
+    }
+    agl__PhysBarrierDestroy(&wide.barrier);
+}
+
+void agl_phys_world_step(agl_phys_world_t *w, float dt) {
+    if (dt <= 0.f)
+        return;
+    w->dt = dt;
+    agl__PhysFindPairs(w);
+    if (!agl__PhysReserve((void**)&w->manifolds, &w->manifoldCapacity, w->pairCount, sizeof(agl__phys_manifold_t)))
+        return;
+    w->prevManifolds = (agl__phys_manifold_t*)realloc(w->prevManifolds, w->manifoldCapacity * sizeof(agl__phys_manifold_t));
+    agl__PhysRunTasks(w, w->threadCount, agl__PhysCollideTask, NULL);
+    // Manifolds stay in their pair's slot, the ones of pairs that do not touch are empty
+    w->manifoldCount = w->pairCount;
+    if (!agl__PhysReserve((void**)&w->islandManifolds, &w->islandManifoldCapacity, w->pairCount + 1, sizeof(uint32_t)))
+        return;
+    agl__PhysBuildIslands(w);
+    agl__PhysRunTasks(w, w->threadCount, agl__PhysSolveTask, NULL);
+    for (uint32_t i = 0; i < w->islandCount; i++)
+        if (w->islandAwake[i] && agl__PhysIslandIsWide(w, i))
+            agl__PhysSolveWide(w, i);
+    // This step's manifolds, with the impulses the solver left in them, are next step's cache
+    agl__phys_manifold_t *swap = w->prevManifolds;
+    w->prevManifolds = w->manifolds;
+    w->manifolds = swap;
+    w->prevManifoldCount = w->manifoldCount;
+    w->manifoldCount = 0;
+    agl__PhysBuildManifoldTable(w);
+
+    agl_phys_world_stats_t *stats = &w->stats;
+    memset(stats, 0, sizeof(*stats));
+    for (uint32_t i = 0; i < w->bodyCount; i++) {
+        const agl__phys_body_t *b = &w->bodies[i];
+        stats->bodies += (b->flags & AGL__PHYS_BODY_ALIVE) != 0;
+    }
+    for (uint32_t i = 0; i < w->islandCount; i++) {
+        if (!w->islandAwake[i])
+            continue;
+        stats->islands++;
+        stats->awakeBodies += w->islandBodyStart[i + 1] - w->islandBodyStart[i];
+    }
+    for (uint32_t i = 0; i < w->prevManifoldCount; i++) {
+        stats->manifolds += w->prevManifolds[i].count != 0;
+        stats->contacts += w->prevManifolds[i].count;
+    }
+}
+
+#undef AGL__PHYS_STREAM_COUNT
+#undef AGL__PHYS_EMIT_BATCH
+#undef AGL__PHYS_MARGIN
+#undef AGL__PHYS_SLOP
+#undef AGL__PHYS_BAUMGARTE
+#undef AGL__PHYS_MAX_CORRECTION
+#undef AGL__PHYS_SLEEP_LINEAR
+#undef AGL__PHYS_SLEEP_ANGULAR
+#undef AGL__PHYS_COLORS
+#undef AGL__PHYS_WIDE_MANIFOLDS
+#undef AGL__PHYS_NULL_NODE
+#undef AGL__PHYS_TREE_MAX_IMBALANCE
+#undef AGL__PHYS_TREE_STACK
+#undef AGL__PHYS_SAP_MAX_SWAPS
+#undef AGL__PHYS_SAP_THREAD_BOXES
+
+#endif // AGL_PHYS_IMPLEMENTED
+
+#endif // AGL_PHYS_IMPLEMENTATION
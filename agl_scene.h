@@ -0,0 +1,372 @@
+// agl_scene.h - v0.1.0 - AGL Scene Library
+//
+// PURPOSE
+//   A lightweight transform hierarchy. Nodes hold a local translation, rotation and scale relative to their parent,
+//   and agl_scene_update turns them into column-major world matrices that can be handed straight to
+//   agl_gfx_draw_mesh_instanced.
+//
+// USAGE
+//   #define AGL_SCENE_IMPLEMENTATION before including this file in *one* C or C++ file to create the implementation.
+//   Node handles stay valid for the lifetime of the scene. Internally the nodes are kept sorted by depth with their
+//   local transforms in separate x[], y[], z[] ... arrays, so an update walks the hierarchy one level at a time and
+//   computes the matrices of the dirty nodes of a level 8 at a time. Only nodes whose local transform changed, and
+//   their descendants, are recomputed.
+//
+//
+// MIT License
+//   Copyright (c) 2026 Athang Gupte
+//   Permission is hereby granted, free of charge, to any person obtaining a copy
+//   of this software and associated documentation files (the "Software"), to deal
+//   in the Software without restriction, including without limitation the rights
+//   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//   copies of the Software, and to permit persons to whom the Software is
+//   furnished to do so, subject to the following conditions:
+//   The above copyright notice and this permission notice shall be included in all
+//   copies or substantial portions of the Software.
+//   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//   SOFTWARE.
+
+#ifndef AGL_SCENE_H
+#define AGL_SCENE_H
+
+#ifndef	AGL_API
+#	if defined(_WIN32)
+#		if defined(AGL_EXPORTS)
+#			define AGL_API __declspec(dllexport)
+#		elif defined(AGL_IMPORTS)
+#			define AGL_API __declspec(dllimport)
+#		else
+#			define AGL_API extern
+#		endif
+#	else
+#		define AGL_API extern
+#	endif
+#endif // AGL_API
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AGL_SCENE_INVALID_NODE 0xFFFFFFFFu
+
+typedef struct agl_scene_t agl_scene_t;
+typedef uint32_t agl_scene_node_t;
+
+// Creates an empty scene, `capacity` is a hint for the number of nodes
+AGL_API agl_scene_t *agl_scene_create(uint32_t capacity);
+AGL_API void agl_scene_destroy(agl_scene_t *scene);
+
+// Adds a node with an identity local transform under `parent`, or as a root for AGL_SCENE_INVALID_NODE
+AGL_API agl_scene_node_t agl_scene_add_node(agl_scene_t *scene, agl_scene_node_t parent);
+AGL_API agl_scene_node_t agl_scene_get_parent(const agl_scene_t *scene, agl_scene_node_t node);
+AGL_API uint32_t agl_scene_node_count(const agl_scene_t *scene);
+
+// Local transform relative to the parent: rotation is a unit quaternion (x, y, z, w), scale is per axis.
+// Setting it marks the node, and with it the whole subtree, for the next agl_scene_update.
+AGL_API void agl_scene_set_local(agl_scene_t *scene, agl_scene_node_t node, const float pos[3], const float rot[4], const float scale[3]);
+AGL_API void agl_scene_get_local(const agl_scene_t *scene, agl_scene_node_t node, float pos[3], float rot[4], float scale[3]);
+
+// Recomputes the world matrices of the dirty subtrees, returns the number of nodes recomputed
+AGL_API uint32_t agl_scene_update(agl_scene_t *scene);
+
+// Column-major 4x4 world matrix of a node as of the last agl_scene_update
+AGL_API const float *agl_scene_get_world(const agl_scene_t *scene, agl_scene_node_t node);
+
+// Copies the world matrices of `count` nodes into `dst` (16 floats each), e.g. the instance transforms of one mesh
+AGL_API void agl_scene_gather_world(const agl_scene_t *scene, const agl_scene_node_t *nodes, uint32_t count, float *dst);
+
+#endif // AGL_SCENE_H
+
+#ifdef AGL_SCENE_IMPLEMENTATION
+
+#ifndef AGL_SCENE_IMPLEMENTED
+#define AGL_SCENE_IMPLEMENTED
+
+#include <immintrin.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "agl_math.h"
+
+// Every array is indexed by slot. Slots are sorted by depth, so parents always come before their children and
+// each level is a contiguous range of slots.
+struct agl_scene_t {
+    uint32_t count;
+    uint32_t capacity;
+    uint8_t sorted;
+    // Local transforms, one array per component
+    float *px, *py, *pz;
+    float *rx, *ry, *rz, *rw;
+    float *sx, *sy, *sz;
+    float (*world)[16];
+    uint32_t *parent; // parent slot, AGL_SCENE_INVALID_NODE for roots
+    uint32_t *depth;
+    uint8_t *dirty;
+    // Handle <-> slot indirection, so handles survive the depth sort
+    uint32_t *nodeToSlot;
+    uint32_t *slotToNode;
+    // Update scratch
+    uint32_t *batch;
+};
+
+static void agl__SceneReserve(agl_scene_t *scene, uint32_t capacity) {
+    if (capacity <= scene->capacity)
+        return;
+    capacity = capacity > 2 * scene->capacity ? capacity : 2 * scene->capacity;
+    float **streams[] = { &scene->px, &scene->py, &scene->pz, &scene->rx, &scene->ry, &scene->rz, &scene->rw, &scene->sx, &scene->sy, &scene->sz };
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++)
+        *streams[i] = (float*)realloc(*streams[i], capacity * sizeof(float));
+    scene->world = (float(*)[16])realloc(scene->world, capacity * sizeof(float[16]));
+    scene->parent = (uint32_t*)realloc(scene->parent, capacity * sizeof(uint32_t));
+    scene->depth = (uint32_t*)realloc(scene->depth, capacity * sizeof(uint32_t));
+    scene->dirty = (uint8_t*)realloc(scene->dirty, capacity);
+    scene->nodeToSlot = (uint32_t*)realloc(scene->nodeToSlot, capacity * sizeof(uint32_t));
+    scene->slotToNode = (uint32_t*)realloc(scene->slotToNode, capacity * sizeof(uint32_t));
+    scene->batch = (uint32_t*)realloc(scene->batch, capacity * sizeof(uint32_t));
+    scene->capacity = capacity;
+}
+
+agl_scene_t *agl_scene_create(uint32_t capacity) {
+    agl_scene_t *scene = (agl_scene_t*)calloc(1, sizeof(agl_scene_t));
+    scene->sorted = 1;
+    agl__SceneReserve(scene, capacity ? capacity : 64);
+    return scene;
+}
+
+void agl_scene_destroy(agl_scene_t *scene) {
+    if (!scene)
+        return;
+    float *streams[] = { scene->px, scene->py, scene->pz, scene->rx, scene->ry, scene->rz, scene->rw, scene->sx, scene->sy, scene->sz };
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++)
+        free(streams[i]);
+    free(scene->world);
+    free(scene->parent);
+    free(scene->depth);
+    free(scene->dirty);
+    free(scene->nodeToSlot);
+    free(scene->slotToNode);
+    free(scene->batch);
+    free(scene);
+}
+
+agl_scene_node_t agl_scene_add_node(agl_scene_t *scene, agl_scene_node_t parent) {
+    agl__SceneReserve(scene, scene->count + 1);
+    uint32_t slot = scene->count++;
+    uint32_t parentSlot = parent == AGL_SCENE_INVALID_NODE ? AGL_SCENE_INVALID_NODE : scene->nodeToSlot[parent];
+    scene->px[slot] = scene->py[slot] = scene->pz[slot] = 0.f;
+    scene->rx[slot] = scene->ry[slot] = scene->rz[slot] = 0.f;
+    scene->rw[slot] = 1.f;
+    scene->sx[slot] = scene->sy[slot] = scene->sz[slot] = 1.f;
+    scene->parent[slot] = parentSlot;
+    scene->depth[slot] = parentSlot == AGL_SCENE_INVALID_NODE ? 0 : scene->depth[parentSlot] + 1;
+    scene->dirty[slot] = 1;
+    scene->nodeToSlot[slot] = slot;
+    scene->slotToNode[slot] = slot;
+    if (slot > 0 && scene->depth[slot] < scene->depth[slot - 1])
+        scene->sorted = 0;
+    return slot; // handles are handed out in creation order, which is the slot order until the first sort
+}
+
+agl_scene_node_t agl_scene_get_parent(const agl_scene_t *scene, agl_scene_node_t node) {
+    uint32_t parentSlot = scene->parent[scene->nodeToSlot[node]];
+    return parentSlot == AGL_SCENE_INVALID_NODE ? AGL_SCENE_INVALID_NODE : scene->slotToNode[parentSlot];
+}
+
+uint32_t agl_scene_node_count(const agl_scene_t *scene) {
+    return scene->count;
+}
+
+void agl_scene_set_local(agl_scene_t *scene, agl_scene_node_t node, const float pos[3], const float rot[4], const float scale[3]) {
+    uint32_t slot = scene->nodeToSlot[node];
+    scene->px[slot] = pos[0]; scene->py[slot] = pos[1]; scene->pz[slot] = pos[2];
+    scene->rx[slot] = rot[0]; scene->ry[slot] = rot[1]; scene->rz[slot] = rot[2]; scene->rw[slot] = rot[3];
+    scene->sx[slot] = scale[0]; scene->sy[slot] = scale[1]; scene->sz[slot] = scale[2];
+    scene->dirty[slot] = 1;
+}
+
+void agl_scene_get_local(const agl_scene_t *scene, agl_scene_node_t node, float pos[3], float rot[4], float scale[3]) {
+    uint32_t slot = scene->nodeToSlot[node];
+    pos[0] = scene->px[slot]; pos[1] = scene->py[slot]; pos[2] = scene->pz[slot];
+    rot[0] = scene->rx[slot]; rot[1] = scene->ry[slot]; rot[2] = scene->rz[slot]; rot[3] = scene->rw[slot];
+    scale[0] = scene->sx[slot]; scale[1] = scene->sy[slot]; scale[2] = scene->sz[slot];
+}
+
+const float *agl_scene_get_world(const agl_scene_t *scene, agl_scene_node_t node) {
+    return scene->world[scene->nodeToSlot[node]];
+}
+
+void agl_scene_gather_world(const agl_scene_t *scene, const agl_scene_node_t *nodes, uint32_t count, float *dst) {
+    for (uint32_t i = 0; i < count; i++)
+        memcpy(dst + 16 * i, scene->world[scene->nodeToSlot[nodes[i]]], sizeof(float[16]));
+}
+
+// Moves element s of `data` to newSlot[s]
+static void agl__ScenePermute(void *data, size_t size, const uint32_t *newSlot, uint32_t count, void *scratch) {
+    for (uint32_t s = 0; s < count; s++)
+        memcpy((char*)scratch + newSlot[s] * size, (const char*)data + s * size, size);
+    memcpy(data, scratch, count * size);
+}
+
+// Stable counting sort of the slots by depth, applying the permutation to every array
+static void agl__SceneSort(agl_scene_t *scene) {
+    uint32_t count = scene->count, maxDepth = 0;
+    for (uint32_t s = 0; s < count; s++)
+        maxDepth = scene->depth[s] > maxDepth ? scene->depth[s] : maxDepth;
+    uint32_t *offsets = (uint32_t*)calloc(maxDepth + 2, sizeof(uint32_t));
+    for (uint32_t s = 0; s < count; s++)
+        offsets[scene->depth[s] + 1]++;
+    for (uint32_t d = 0; d <= maxDepth; d++)
+        offsets[d + 1] += offsets[d];
+    uint32_t *newSlot = (uint32_t*)malloc(count * sizeof(uint32_t));
+    for (uint32_t s = 0; s < count; s++)
+        newSlot[s] = offsets[scene->depth[s]]++;
+    free(offsets);
+    for (uint32_t s = 0; s < count; s++) {
+        if (scene->parent[s] != AGL_SCENE_INVALID_NODE)
+            scene->parent[s] = newSlot[scene->parent[s]];
+    }
+    void *scratch = malloc(count * sizeof(float[16]));
+    float *streams[] = { scene->px, scene->py, scene->pz, scene->rx, scene->ry, scene->rz, scene->rw, scene->sx, scene->sy, scene->sz };
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++)
+        agl__ScenePermute(streams[i], sizeof(float), newSlot, count, scratch);
+    agl__ScenePermute(scene->world, sizeof(float[16]), newSlot, count, scratch);
+    agl__ScenePermute(scene->parent, sizeof(uint32_t), newSlot, count, scratch);
+    agl__ScenePermute(scene->depth, sizeof(uint32_t), newSlot, count, scratch);
+    agl__ScenePermute(scene->dirty, sizeof(uint8_t), newSlot, count, scratch);
+    agl__ScenePermute(scene->slotToNode, sizeof(uint32_t), newSlot, count, scratch);
+    for (uint32_t s = 0; s < count; s++)
+        scene->nodeToSlot[scene->slotToNode[s]] = s;
+    free(scratch);
+    free(newSlot);
+    scene->sorted = 1;
+}
+
+// World matrix of one slot: local = T * R * S from the component arrays, world = parent world * local
+static void agl__SceneUpdateSlot(agl_scene_t *scene, uint32_t s) {
+    float x = scene->rx[s], y = scene->ry[s], z = scene->rz[s], w = scene->rw[s];
+    float sx = scene->sx[s], sy = scene->sy[s], sz = scene->sz[s];
+    float local[4][3] = {
+        { (1.f - 2.f * (y * y + z * z)) * sx, 2.f * (x * y + w * z) * sx, 2.f * (x * z - w * y) * sx },
+        { 2.f * (x * y - w * z) * sy, (1.f - 2.f * (x * x + z * z)) * sy, 2.f * (y * z + w * x) * sy },
+        { 2.f * (x * z + w * y) * sz, 2.f * (y * z - w * x) * sz, (1.f - 2.f * (x * x + y * y)) * sz },
+        { scene->px[s], scene->py[s], scene->pz[s] },
+    };
+    float *m = scene->world[s];
+    const uint32_t parent = scene->parent[s];
+    for (int c = 0; c < 4; c++) {
+        for (int r = 0; r < 3; r++) {
+            if (parent == AGL_SCENE_INVALID_NODE) {
+                m[4 * c + r] = local[c][r];
+            } else {
+                const float *p = scene->world[parent];
+                float v = p[r] * local[c][0] + p[4 + r] * local[c][1] + p[8 + r] * local[c][2];
+                m[4 * c + r] = c == 3 ? v + p[12 + r] : v;
+            }
+        }
+        m[4 * c + 3] = c == 3 ? 1.f : 0.f;
+    }
+}
+
+// The same for up to 8 slots at once. Lanes past `n` repeat the last slot, so gathers stay in bounds and the duplicate
+// results are simply not stored.
+static AGL_TARGET_AVX2 void agl__SceneUpdateBatchAvx2(agl_scene_t *scene, const uint32_t *slots, uint32_t n) {
+    int32_t lane[8];
+    for (uint32_t i = 0; i < 8; i++)
+        lane[i] = (int32_t)slots[i < n ? i : n - 1];
+    __m256i idx = _mm256_loadu_si256((const __m256i*)lane);
+    __m256 x = _mm256_i32gather_ps(scene->rx, idx, 4), y = _mm256_i32gather_ps(scene->ry, idx, 4);
+    __m256 z = _mm256_i32gather_ps(scene->rz, idx, 4), w = _mm256_i32gather_ps(scene->rw, idx, 4);
+    __m256 sx = _mm256_i32gather_ps(scene->sx, idx, 4), sy = _mm256_i32gather_ps(scene->sy, idx, 4);
+    __m256 sz = _mm256_i32gather_ps(scene->sz, idx, 4);
+    const __m256 one = _mm256_set1_ps(1.f), two = _mm256_set1_ps(2.f);
+    __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+    __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+    __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+    // local[c][r], column-major with the scale applied per column
+    __m256 local[4][3];
+    local[0][0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx);
+    local[0][1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+    local[0][2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+    local[1][0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+    local[1][1] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy);
+    local[1][2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+    local[2][0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+    local[2][1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+    local[2][2] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz);
+    local[3][0] = _mm256_i32gather_ps(scene->px, idx, 4);
+    local[3][1] = _mm256_i32gather_ps(scene->py, idx, 4);
+    local[3][2] = _mm256_i32gather_ps(scene->pz, idx, 4);
+    // Every node of a batch is at the same depth, so either all of them are roots or none are
+    __m256 world[4][3];
+    if (scene->parent[slots[0]] == AGL_SCENE_INVALID_NODE) {
+        memcpy(world, local, sizeof(world));
+    } else {
+        int32_t parentLane[8];
+        for (uint32_t i = 0; i < 8; i++)
+            parentLane[i] = (int32_t)(16 * scene->parent[lane[i]]);
+        __m256i pidx = _mm256_loadu_si256((const __m256i*)parentLane);
+        const float *base = &scene->world[0][0];
+        __m256 parent[4][3];
+        for (int c = 0; c < 4; c++) for (int r = 0; r < 3; r++)
+            parent[c][r] = _mm256_i32gather_ps(base + 4 * c + r, pidx, 4);
+        // Both matrices are affine, the bottom rows are (0, 0, 0, 1)
+        for (int c = 0; c < 4; c++) for (int r = 0; r < 3; r++) {
+            __m256 v = _mm256_mul_ps(parent[0][r], local[c][0]);
+            v = _mm256_fmadd_ps(parent[1][r], local[c][1], v);
+            v = _mm256_fmadd_ps(parent[2][r], local[c][2], v);
+            if (c == 3)
+                v = _mm256_add_ps(v, parent[3][r]);
+            world[c][r] = v;
+        }
+    }
+    float out[4][3][8];
+    for (int c = 0; c < 4; c++) for (int r = 0; r < 3; r++)
+        _mm256_storeu_ps(out[c][r], world[c][r]);
+    for (uint32_t i = 0; i < n; i++) {
+        float *m = scene->world[slots[i]];
+        for (int c = 0; c < 4; c++) {
+            m[4 * c + 0] = out[c][0][i];
+            m[4 * c + 1] = out[c][1][i];
+            m[4 * c + 2] = out[c][2][i];
+            m[4 * c + 3] = c == 3 ? 1.f : 0.f;
+        }
+    }
+}
+
+uint32_t agl_scene_update(agl_scene_t *scene) {
+    if (!scene->sorted)
+        agl__SceneSort(scene);
+    const bool avx2 = (agl_cpu_features() & AGL_CPU_FEATURE_AVX2_BIT) != 0;
+    uint32_t updated = 0;
+    uint32_t begin = 0;
+    while (begin < scene->count) {
+        // One level at a time: a node is recomputed when it changed or its parent was recomputed by this update
+        uint32_t depth = scene->depth[begin], end = begin, n = 0;
+        for (; end < scene->count && scene->depth[end] == depth; end++) {
+            uint32_t parent = scene->parent[end];
+            if (scene->dirty[end] || (parent != AGL_SCENE_INVALID_NODE && scene->dirty[parent])) {
+                scene->dirty[end] = 1;
+                scene->batch[n++] = end;
+            }
+        }
+        if (avx2) {
+            for (uint32_t i = 0; i < n; i += 8)
+                agl__SceneUpdateBatchAvx2(scene, scene->batch + i, n - i < 8 ? n - i : 8);
+        } else {
+            for (uint32_t i = 0; i < n; i++)
+                agl__SceneUpdateSlot(scene, scene->batch[i]);
+        }
+        updated += n;
+        begin = end;
+    }
+    memset(scene->dirty, 0, scene->count);
+    return updated;
+}
+
+#endif // AGL_SCENE_IMPLEMENTED
+
+#endif // AGL_SCENE_IMPLEMENTATION
@@ -38,6 +38,7 @@ ffi.cdef[[
 		uint32_t bufferPoolSize;
 		uint32_t meshPoolSize;
 		uint32_t quadPoolSize;
+		uint32_t meshDrawPoolSize;
 		struct {
 			void *allocationBase;
 			uint64_t allocationSize;
@@ -65,17 +66,75 @@ ffi.cdef[[
 		float *uvData;
 		float *normalData;
 		float *colorData;
+		float *jointData;
+		float *weightData;
 		uint32_t *indexData;
+		uint32_t flags;
 	} agl_gfx_mesh_params_t;
 
+	typedef struct agl_gfx_draw_stats_t {
+		uint32_t meshesSubmitted;
+		uint32_t meshesCulled;
+		uint32_t meshesOccluded;
+		uint32_t meshletsSubmitted;
+		uint32_t meshletsCulled;
+	} agl_gfx_draw_stats_t;
+
 	typedef struct agl_gfx_loader_t agl_gfx_loader_t;
 	typedef struct agl_gfx_load_params_t agl_gfx_load_params_t;
 	typedef void (*agl_gfx_loader_mesh_callback_func)(agl_gfx_context_t context, const agl_gfx_mesh_params_t *params, const char *name);
 	typedef void (*agl_gfx_loader_image_callback_func)(agl_gfx_context_t context, const agl_gfx_image_params_t *params, const char *name);
+	typedef struct agl_gfx_node_params_t {
+		int parent;
+		float pos[3];
+		float rot[4];
+		float scale[3];
+		int firstMesh;
+		uint32_t meshCount;
+		int skin;
+	} agl_gfx_node_params_t;
+	typedef void (*agl_gfx_loader_node_callback_func)(agl_gfx_context_t context, const agl_gfx_node_params_t *params, const char *name);
+	typedef struct agl_gfx_skin_params_t {
+		uint32_t jointCount;
+		const int *jointNodes;
+		const float *inverseBindMatrices;
+	} agl_gfx_skin_params_t;
+	typedef void (*agl_gfx_loader_skin_callback_func)(agl_gfx_context_t context, const agl_gfx_skin_params_t *params, const char *name);
+	typedef struct agl_gfx_animation_channel_t {
+		int node;
+		uint32_t path;
+		uint32_t interpolation;
+		uint32_t keyCount;
+		const float *times;
+		const float *values;
+	} agl_gfx_animation_channel_t;
+	typedef struct agl_gfx_animation_params_t {
+		uint32_t channelCount;
+		const agl_gfx_animation_channel_t *channels;
+	} agl_gfx_animation_params_t;
+	typedef void (*agl_gfx_loader_animation_callback_func)(agl_gfx_context_t context, const agl_gfx_animation_params_t *params, const char *name);
+
+	enum agl_gfx_load_flag_bits {
+		AGL_GFX_LOAD_FLAG_CACHE_BIT = 0x0001,
+		AGL_GFX_LOAD_FLAG_OPTIMIZE_BIT = 0x0002,
+		AGL_GFX_LOAD_FLAG_OPTIMIZE_OVERDRAW_BIT = 0x0004,
+		AGL_GFX_LOAD_FLAG_GENERATE_LODS_BIT = 0x0008,
+		AGL_GFX_LOAD_FLAG_MESHLETS_BIT = 0x0010,
+	};
+
+	enum agl_gfx_mesh_flag_bits {
+		AGL_GFX_MESH_FLAG_GENERATE_LODS_BIT = 0x0001,
+		AGL_GFX_MESH_FLAG_OCCLUDER_BIT = 0x0002,
+		AGL_GFX_MESH_FLAG_MESHLETS_BIT = 0x0004,
+	};
 
 	struct agl_gfx_load_params_t {
 		agl_gfx_loader_mesh_callback_func meshCallback;
 		agl_gfx_loader_image_callback_func imageCallback;
+		uint32_t flags;
+		agl_gfx_loader_node_callback_func nodeCallback;
+		agl_gfx_loader_skin_callback_func skinCallback;
+		agl_gfx_loader_animation_callback_func animationCallback;
 	};
 
 	typedef enum agl_gfx_key_t {
@@ -177,7 +236,11 @@ ffi.cdef[[
 	
 	void agl_gfx_draw_screen_quad(agl_gfx_canvas_t canvas, const float pos[2], const float size[2], float angle, uint32_t color, agl_gfx_image_t texture);
 	void agl_gfx_draw_mesh(agl_gfx_canvas_t canvas, agl_gfx_mesh_t mesh, const float pos[3], const float rot[4], float scale, const float color[4]);
+	void agl_gfx_draw_mesh_instanced(agl_gfx_canvas_t canvas, agl_gfx_mesh_t mesh, const float *transforms, uint32_t count, const float color[4]);
+	void agl_gfx_draw_skinned_mesh(agl_gfx_canvas_t canvas, agl_gfx_mesh_t mesh, const float pos[3], const float rot[4], float scale, const float color[4], const float *joints, uint32_t jointCount);
 	void agl_gfx_draw_text(agl_gfx_canvas_t canvas, const float startpos[2], float height, uint32_t color, const char *text);
+	void agl_gfx_set_occlusion_culling(agl_gfx_canvas_t canvas, bool enabled);
+	void agl_gfx_get_draw_stats(agl_gfx_canvas_t canvas, agl_gfx_draw_stats_t *stats);
 
 	int agl_gfx_context_init_plugins(agl_gfx_context_t context);
 	int agl_gfx_load_file(agl_gfx_context_t context, const char *path, agl_gfx_load_params_t *params);
@@ -187,6 +250,8 @@ ffi.cdef[[
 	typedef struct vec4f_t { float x, y, z, w; } vec4f_t;
 	typedef struct quatf_t { float x, y, z, w; } quatf_t;
 	typedef struct mat3f_t { float _m[4][3]; } mat3f_t;
+	typedef struct aabbf_t { vec3f_t min, max; } aabbf_t;
+	typedef struct rayf_t { vec3f_t origin, dir; } rayf_t;
 
 	void quatf_inv(quatf_t *q);
 	void quatf_add(quatf_t *q, const quatf_t *b);
@@ -195,6 +260,7 @@ ffi.cdef[[
 	void quatf_mul2(quatf_t *q, const quatf_t *a, const quatf_t *b);
 	void quatf_fromaxisangle(quatf_t *q, const vec3f_t *axis, float angle);
 	void quatf_fromvectors(quatf_t *q, const vec3f_t *a, const vec3f_t *b);
+	size_t agl_ray_aabbs(float *t, const rayf_t *ray, const aabbf_t *boxes, size_t count, float tmax);
 ]]
 
 local agl = ffi.load("agl")
@@ -204,6 +270,7 @@ local config = {
 	BUFFER_POOL_SIZE = 1024, -- Max number of buffers that can be allocated at once
 	MESH_POOL_SIZE = 1024, -- Max number of meshes that can be loaded at once
 	QUAD_POOL_SIZE = 1024, -- Max number of quads that can be rendered at once
+	MESH_DRAW_POOL_SIZE = 1024, -- Max number of mesh draws culled in one batch
 	SCRATCH_MEMORY_SIZE = 512 * 1024, -- 512 KiB of scratch memory
 }
 
@@ -262,7 +329,7 @@ local context_mt = {
 				flags = flags,
 			})))
 		end,
-		createMesh = function(self, vertexCount, indexCount, positionData, uvData, normalData, colorData, indexData)
+		createMesh = function(self, vertexCount, indexCount, positionData, uvData, normalData, colorData, indexData, flags)
 			return ffi.new("agl_gfx_mesh_wrapper_t", agl.agl_gfx_create_mesh(self.unwrapped, ffi.new("agl_gfx_mesh_params_t", {
 				vertexCount = vertexCount,
 				indexCount = indexCount,
@@ -271,9 +338,10 @@ local context_mt = {
 				normalData = normalData,
 				colorData = colorData,
 				indexData = indexData,
+				flags = flags or 0,
 			})))
 		end,
-		loadMeshes = function(self, path)
+		loadMeshes = function(self, path, flags)
 			local meshes = {}
 			local loadParams = ffi.new("agl_gfx_load_params_t", {
 				meshCallback = function(context, params, name)
@@ -283,6 +351,7 @@ local context_mt = {
 					meshes[name] = meshWrapper
 				end,
 				imageCallback = nil,
+				flags = flags or 0,
 			})
 			local result = agl.agl_gfx_load_file(self.unwrapped, path, loadParams)
 			if result ~= 1 then
@@ -320,9 +389,26 @@ local canvas_mt = {
 		drawMesh = function(self, mesh, pos, rot, scale, r, g, b, a)
 			agl.agl_gfx_draw_mesh(self.unwrapped, mesh.unwrapped, ffi.cast("float*", pos), ffi.cast("float*", rot), scale, ffi.new("float[4]", {r, g, b, a}))
 		end,
+		-- transforms: count column-major 4x4 matrices, 16 floats each (e.g. from agl_scene_gather_world)
+		drawMeshInstanced = function(self, mesh, transforms, count, r, g, b, a)
+			agl.agl_gfx_draw_mesh_instanced(self.unwrapped, mesh.unwrapped, ffi.cast("float*", transforms), count, ffi.new("float[4]", {r, g, b, a}))
+		end,
+		-- joints: jointCount column-major 4x4 palette matrices, 16 floats each
+		drawSkinnedMesh = function(self, mesh, pos, rot, scale, joints, jointCount, r, g, b, a)
+			agl.agl_gfx_draw_skinned_mesh(self.unwrapped, mesh.unwrapped, ffi.cast("float*", pos), ffi.cast("float*", rot), scale,
+				ffi.new("float[4]", {r, g, b, a}), ffi.cast("float*", joints), jointCount)
+		end,
 		drawText = function(self, text, x, y, height, color)
 			agl.agl_gfx_canvas_draw_text(self.unwrapped, text, x, y, height, color)
 		end,
+		getDrawStats = function(self)
+			local stats = ffi.new("agl_gfx_draw_stats_t")
+			agl.agl_gfx_get_draw_stats(self.unwrapped, stats)
+			return stats.meshesSubmitted, stats.meshesCulled, stats.meshesOccluded, stats.meshletsSubmitted, stats.meshletsCulled
+		end,
+		setOcclusionCulling = function(self, enabled)
+			agl.agl_gfx_set_occlusion_culling(self.unwrapped, enabled)
+		end,
 	},
 }
 ffi.metatype("agl_gfx_canvas_wrapper_t", canvas_mt)
@@ -372,8 +458,45 @@ local quatf_mt = {
 }
 ffi.metatype("quatf_t", quatf_mt)
 
+local aabbf_mt = {
+	__index = {
+		new = function(minX, minY, minZ, maxX, maxY, maxZ)
+			return ffi.new("aabbf_t", { { minX, minY, minZ, 0 }, { maxX, maxY, maxZ, 0 } })
+		end,
+		newArray = function(count)
+			return ffi.new("aabbf_t[?]", count)
+		end,
+	},
+}
+ffi.metatype("aabbf_t", aabbf_mt)
+
+local rayf_mt = {
+	__index = {
+		new = function(originX, originY, originZ, dirX, dirY, dirZ)
+			return ffi.new("rayf_t", { { originX, originY, originZ, 0 }, { dirX, dirY, dirZ, 0 } })
+		end,
+		-- Distance to the closest of `count` boxes hit within tmax and its 0-based index, or nil when all are missed
+		castAabbs = function(self, boxes, count, tmax)
+			local t = ffi.new("float[?]", count)
+			if agl.agl_ray_aabbs(t, self, boxes, count, tmax) == 0 then
+				return nil
+			end
+			local closest = 0
+			for i = 1, count - 1 do
+				if t[i] < t[closest] then
+					closest = i
+				end
+			end
+			return t[closest], closest
+		end,
+	},
+}
+ffi.metatype("rayf_t", rayf_mt)
+
 local math = {
+	aabbf = aabbf_mt.__index,
 	quatf = quatf_mt.__index,
+	rayf = rayf_mt.__index,
 	vec3f = vec3f_mt.__index,
 }
 
@@ -405,6 +528,7 @@ return {
 			bufferPoolSize = config.BUFFER_POOL_SIZE,
 			meshPoolSize = config.MESH_POOL_SIZE,
 			quadPoolSize = config.QUAD_POOL_SIZE,
+			meshDrawPoolSize = config.MESH_DRAW_POOL_SIZE,
 			scratchMemory = {
 				allocationBase = nil,
 				allocationSize = config.SCRATCH_MEMORY_SIZE,
@@ -433,6 +557,14 @@ return {
 	KEY_A = agl.AGL_GFX_KEY_A,
 	KEY_S = agl.AGL_GFX_KEY_S,
 	KEY_D = agl.AGL_GFX_KEY_D,
+	LOAD_CACHE = agl.AGL_GFX_LOAD_FLAG_CACHE_BIT,
+	LOAD_OPTIMIZE = agl.AGL_GFX_LOAD_FLAG_OPTIMIZE_BIT,
+	LOAD_OPTIMIZE_OVERDRAW = agl.AGL_GFX_LOAD_FLAG_OPTIMIZE_OVERDRAW_BIT,
+	LOAD_GENERATE_LODS = agl.AGL_GFX_LOAD_FLAG_GENERATE_LODS_BIT,
+	LOAD_MESHLETS = agl.AGL_GFX_LOAD_FLAG_MESHLETS_BIT,
+	MESH_GENERATE_LODS = agl.AGL_GFX_MESH_FLAG_GENERATE_LODS_BIT,
+	MESH_OCCLUDER = agl.AGL_GFX_MESH_FLAG_OCCLUDER_BIT,
+	MESH_MESHLETS = agl.AGL_GFX_MESH_FLAG_MESHLETS_BIT,
 	-- Utility functions
 	screenToNdc = function(x, y, screenWidth, screenHeight)
 		return (x / screenWidth) * 2 - 1, 1 - (y / screenHeight) * 2
@@ -33,21 +33,33 @@ local plyPosX, plyPosY = 7.5, 7.5
 local plyVelX, plyVelY = 0, 0
 local plyShouldJump = false
 
-local function distanceToGround(x, y)
-	local tileX, tileY = math.floor(x), math.floor(y)
-	if tileX < 0 or tileX >= 16 or tileY < 0 or tileY >= 16 then
-		return 0
-	end
-	if groundTileAt(tileX, tileY) == 1 then
-		return 0
-	else
-		for checkY = tileY - 1, 0, -1 do
-			if groundTileAt(tileX, checkY) == 1 then
-				return y - (checkY + 1)
+-- The solid tiles as unit boxes, for casting rays against the level
+local groundBoxCount = 0
+for i = 1, #ground do
+	groundBoxCount = groundBoxCount + ground[i]
+end
+local groundBoxes = agl.math.aabbf.newArray(groundBoxCount)
+do
+	local n = 0
+	for y = 0, 15 do
+		for x = 0, 15 do
+			if groundTileAt(x, y) == 1 then
+				local box = groundBoxes[n]
+				box.min.x, box.min.y, box.min.z = x, y, -0.5
+				box.max.x, box.max.y, box.max.z = x + 1, y + 1, 0.5
+				n = n + 1
 			end
 		end
 	end
-	
+end
+
+-- Casts straight down, 0 when standing on or inside a solid tile
+local function distanceToGround(x, y)
+	if x < 0 or x >= 16 or y < 0 or y >= 16 then
+		return 0
+	end
+	local ray = agl.math.rayf.new(x, y, 0, 0, -1, 0)
+	return ray:castAabbs(groundBoxes, groundBoxCount, y) or y
 end
 
 local function drawTile(canvas, x, y, color)
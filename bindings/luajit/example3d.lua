@@ -3,7 +3,6 @@ agl.title = "AGL LuaJIT 3D Demo"
 agl.width = 1280
 agl.height = 720
 agl.plugins = { "fps_counter.dll", "gltf_loader.dll" }
-agl.memconfig.SCRATCH_MEMORY_SIZE = 6 * 1024 * 1024 -- Increase scratch memory to 6 MiB for testing
 
 local vec3f = agl.math.vec3f
 local quatf = agl.math.quatf
@@ -12,7 +11,7 @@ local game = {}
 
 function agl.load(ctx)
 	local meshes, err
-	meshes, err = ctx:loadMeshes("demon_rigged.glb")
+	meshes, err = ctx:loadMeshes("demon_rigged.glb", bit.bor(agl.LOAD_CACHE, agl.LOAD_OPTIMIZE, agl.LOAD_GENERATE_LODS))
 	assert(meshes, err)
 	print("Loaded "..#meshes.." mesh(es)")
 	game.meshes = meshes
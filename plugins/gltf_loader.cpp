@@ -1,20 +1,846 @@
-#define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#define TINYGLTF_NOEXCEPTION
 #define JSON_NOEXCEPTION
-#include "tiny_gltf.h"
+#include "json.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 extern "C" {
 #include "agl_gfx.h"
+// Scalar helpers are compiled locally, only the stream conversion kernels are imported from agl
+#define AGL_INLINE inline
+#include "agl_math.h"
+}
+
+using json = nlohmann::json;
+
+#define GLTF_COMPONENT_TYPE_BYTE           5120
+#define GLTF_COMPONENT_TYPE_UNSIGNED_BYTE  5121
+#define GLTF_COMPONENT_TYPE_SHORT          5122
+#define GLTF_COMPONENT_TYPE_UNSIGNED_SHORT 5123
+#define GLTF_COMPONENT_TYPE_UNSIGNED_INT   5125
+#define GLTF_COMPONENT_TYPE_FLOAT          5126
+
+#define GLB_MAGIC      0x46546C67 // "glTF"
+#define GLB_CHUNK_JSON 0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN  0x004E4942 // "BIN\0"
+
+// Minimal in-memory view of a glTF 2.0 document.
+// Buffer contents are never copied: the GLB BIN chunk and external .bin files are memory-mapped and
+// the accessors point straight into the mappings. Only base64 data URIs are decoded into owned memory.
+
+struct GltfBuffer {
+	const unsigned char *data;
+	size_t size;
+};
+
+struct GltfBufferView {
+	int buffer;
+	size_t byteOffset;
+	size_t byteLength;
+	size_t byteStride;
+};
+
+struct GltfAccessor {
+	int bufferView;
+	size_t byteOffset;
+	size_t count;
+	int componentType;
+	int components;
+	bool normalized;
+};
+
+struct GltfAttribute {
+	std::string name;
+	int accessor;
+};
+
+struct GltfPrimitive {
+	std::vector<GltfAttribute> attributes;
+	int indices;
+	int mode;
+};
+
+struct GltfMesh {
+	std::string name;
+	std::vector<GltfPrimitive> primitives;
+};
+
+struct GltfNode {
+	std::string name;
+	int mesh;
+	int skin;
+	std::vector<int> children;
+	float translation[3];
+	float rotation[4]; // x, y, z, w
+	float scale[3];
+};
+
+struct GltfSkin {
+	std::string name;
+	std::vector<int> joints;
+	int inverseBindMatrices;
+};
+
+struct GltfAnimationSampler {
+	int input;
+	int output;
+	agl_uint interpolation; // 0 linear, 1 step, 2 cubic spline, as in agl_gfx_animation_channel_t
+};
+
+struct GltfAnimationChannel {
+	int sampler;
+	int node;
+	agl_uint path; // 0 translation, 1 rotation, 2 scale
+};
+
+struct GltfAnimation {
+	std::string name;
+	std::vector<GltfAnimationSampler> samplers;
+	std::vector<GltfAnimationChannel> channels;
+};
+
+struct GltfDocument {
+	std::vector<agl_gfx_file_map_t> files;
+	std::vector<std::string> externalPaths; // external buffers, reported to the mesh cache as dependencies
+	std::vector<std::vector<unsigned char>> decodedBuffers;
+	std::vector<GltfBuffer> buffers;
+	std::vector<GltfBufferView> bufferViews;
+	std::vector<GltfAccessor> accessors;
+	std::vector<GltfMesh> meshes;
+	std::vector<GltfNode> nodes;
+	std::vector<GltfSkin> skins;
+	std::vector<GltfAnimation> animations;
+
+	~GltfDocument() {
+		for (agl_gfx_file_map_t &file : files) {
+			agl_gfx_unmap_file(&file);
+		}
+	}
+};
+
+static size_t GetSize(const json &j, const char *key, size_t def) {
+	json::const_iterator it = j.find(key);
+	return (it != j.end() && it->is_number_unsigned()) ? it->get<size_t>() : def;
+}
+
+static int GetInt(const json &j, const char *key, int def) {
+	json::const_iterator it = j.find(key);
+	return (it != j.end() && it->is_number_integer()) ? it->get<int>() : def;
+}
+
+static bool GetBool(const json &j, const char *key, bool def) {
+	json::const_iterator it = j.find(key);
+	return (it != j.end() && it->is_boolean()) ? it->get<bool>() : def;
+}
+
+// Returns the array under `key`, or an empty one when the key is missing or holds anything else
+static const json &GetArray(const json &j, const char *key) {
+	static const json empty = json::array();
+	json::const_iterator it = j.find(key);
+	return (it != j.end() && it->is_array()) ? *it : empty;
+}
+
+static std::string GetString(const json &j, const char *key) {
+	json::const_iterator it = j.find(key);
+	return (it != j.end() && it->is_string()) ? it->get<std::string>() : std::string();
+}
+
+// Reads a fixed size array of numbers, leaving `out` untouched unless the key holds exactly `count` of them
+static bool GetFloats(const json &j, const char *key, float *out, size_t count) {
+	json::const_iterator it = j.find(key);
+	if (it == j.end() || !it->is_array() || it->size() != count)
+		return false;
+	for (size_t i = 0; i < count; ++i) {
+		if (!(*it)[i].is_number())
+			return false;
+	}
+	for (size_t i = 0; i < count; ++i)
+		out[i] = (*it)[i].get<float>();
+	return true;
+}
+
+// Splits a column-major TRS matrix, as glTF requires node matrices to be, into translation, rotation and scale
+static void DecomposeMatrix(const float m[16], GltfNode *node) {
+	float r[3][3];
+	for (int c = 0; c < 3; ++c) {
+		node->translation[c] = m[12 + c];
+		node->scale[c] = sqrtf(m[4 * c] * m[4 * c] + m[4 * c + 1] * m[4 * c + 1] + m[4 * c + 2] * m[4 * c + 2]);
+		for (int k = 0; k < 3; ++k)
+			r[c][k] = node->scale[c] > 0.f ? m[4 * c + k] / node->scale[c] : 0.f;
+	}
+	// r[c][k] is row k of column c, quaternion from the largest diagonal term (Shepperd)
+	float trace = r[0][0] + r[1][1] + r[2][2];
+	float *q = node->rotation;
+	if (trace > 0.f) {
+		float t = sqrtf(trace + 1.f) * 2.f;
+		q[3] = 0.25f * t;
+		q[0] = (r[1][2] - r[2][1]) / t;
+		q[1] = (r[2][0] - r[0][2]) / t;
+		q[2] = (r[0][1] - r[1][0]) / t;
+	} else if (r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+		float t = sqrtf(1.f + r[0][0] - r[1][1] - r[2][2]) * 2.f;
+		q[3] = (r[1][2] - r[2][1]) / t;
+		q[0] = 0.25f * t;
+		q[1] = (r[1][0] + r[0][1]) / t;
+		q[2] = (r[2][0] + r[0][2]) / t;
+	} else if (r[1][1] > r[2][2]) {
+		float t = sqrtf(1.f + r[1][1] - r[0][0] - r[2][2]) * 2.f;
+		q[3] = (r[2][0] - r[0][2]) / t;
+		q[0] = (r[1][0] + r[0][1]) / t;
+		q[1] = 0.25f * t;
+		q[2] = (r[2][1] + r[1][2]) / t;
+	} else {
+		float t = sqrtf(1.f + r[2][2] - r[0][0] - r[1][1]) * 2.f;
+		q[3] = (r[0][1] - r[1][0]) / t;
+		q[0] = (r[2][0] + r[0][2]) / t;
+		q[1] = (r[2][1] + r[1][2]) / t;
+		q[2] = 0.25f * t;
+	}
+}
+
+static int GetComponentCount(const std::string &type) {
+	if (type == "SCALAR") return 1;
+	if (type == "VEC2") return 2;
+	if (type == "VEC3") return 3;
+	if (type == "VEC4") return 4;
+	if (type == "MAT2") return 4;
+	if (type == "MAT3") return 9;
+	if (type == "MAT4") return 16;
+	return 0;
+}
+
+static size_t GetComponentSize(int componentType) {
+	switch (componentType) {
+	case GLTF_COMPONENT_TYPE_BYTE:
+	case GLTF_COMPONENT_TYPE_UNSIGNED_BYTE: return 1;
+	case GLTF_COMPONENT_TYPE_SHORT:
+	case GLTF_COMPONENT_TYPE_UNSIGNED_SHORT: return 2;
+	case GLTF_COMPONENT_TYPE_UNSIGNED_INT:
+	case GLTF_COMPONENT_TYPE_FLOAT: return 4;
+	default: return 0;
+	}
+}
+
+static bool DecodeBase64(std::vector<unsigned char> *out, const char *src, size_t len) {
+	static const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	unsigned int acc = 0;
+	int bits = 0;
+	out->reserve(len / 4 * 3);
+	for (size_t i = 0; i < len && src[i] != '='; i++) {
+		const char *p = strchr(alphabet, src[i]);
+		if (p == nullptr || *p == '\0')
+			return false;
+		acc = (acc << 6) | (unsigned int)(p - alphabet);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			out->push_back((unsigned char)((acc >> bits) & 0xFF));
+		}
+	}
+	return true;
+}
+
+static std::string DecodeUri(const std::string &uri) {
+	std::string out;
+	for (size_t i = 0; i < uri.size(); i++) {
+		if (uri[i] == '%' && i + 2 < uri.size()) {
+			out += (char)strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+			i += 2;
+		} else {
+			out += uri[i];
+		}
+	}
+	return out;
+}
+
+static bool LoadBuffer(GltfDocument *doc, const json &jbuffer, const unsigned char *bin, size_t binSize, const std::string &baseDir) {
+	size_t byteLength = GetSize(jbuffer, "byteLength", 0);
+	std::string uri = GetString(jbuffer, "uri");
+	GltfBuffer buffer = { nullptr, 0 };
+	if (uri.empty()) {
+		// GLB-stored buffer, references the BIN chunk
+		if (bin == nullptr || byteLength > binSize) {
+			printf("Buffer references missing or truncated GLB BIN chunk\n");
+			return false;
+		}
+		buffer.data = bin;
+		buffer.size = byteLength;
+	} else if (uri.compare(0, 5, "data:") == 0) {
+		size_t comma = uri.find(";base64,");
+		if (comma == std::string::npos) {
+			printf("Unsupported data URI in buffer\n");
+			return false;
+		}
+		comma += strlen(";base64,");
+		doc->decodedBuffers.emplace_back();
+		std::vector<unsigned char> &decoded = doc->decodedBuffers.back();
+		if (!DecodeBase64(&decoded, uri.c_str() + comma, uri.size() - comma) || decoded.size() < byteLength) {
+			printf("Failed to decode data URI in buffer\n");
+			return false;
+		}
+		buffer.data = decoded.data();
+		buffer.size = byteLength;
+	} else {
+		std::string path = baseDir + DecodeUri(uri);
+		agl_gfx_file_map_t file;
+		if (agl_gfx_map_file(path.c_str(), &file) != AGL_GFX_SUCCESS || file.size < byteLength) {
+			agl_gfx_unmap_file(&file);
+			printf("Failed to map external buffer: %s\n", path.c_str());
+			return false;
+		}
+		doc->files.push_back(file);
+		doc->externalPaths.push_back(path);
+		buffer.data = (const unsigned char*)file.data;
+		buffer.size = byteLength;
+	}
+	doc->buffers.push_back(buffer);
+	return true;
+}
+
+static bool ParseDocument(GltfDocument *doc, const char *text, size_t textSize, const unsigned char *bin, size_t binSize, const std::string &baseDir) {
+	json root = json::parse(text, text + textSize, nullptr, false);
+	if (root.is_discarded() || !root.is_object()) {
+		printf("Failed to parse GLTF JSON\n");
+		return false;
+	}
+	for (const json &jbuffer : GetArray(root, "buffers")) {
+		if (!LoadBuffer(doc, jbuffer, bin, binSize, baseDir))
+			return false;
+	}
+	for (const json &jview : GetArray(root, "bufferViews")) {
+		GltfBufferView view;
+		view.buffer = GetInt(jview, "buffer", -1);
+		view.byteOffset = GetSize(jview, "byteOffset", 0);
+		view.byteLength = GetSize(jview, "byteLength", 0);
+		view.byteStride = GetSize(jview, "byteStride", 0);
+		if (view.buffer < 0 || view.buffer >= (int)doc->buffers.size() ||
+			view.byteOffset + view.byteLength > doc->buffers[view.buffer].size) {
+			printf("Invalid buffer view\n");
+			return false;
+		}
+		doc->bufferViews.push_back(view);
+	}
+	for (const json &jaccessor : GetArray(root, "accessors")) {
+		GltfAccessor accessor;
+		accessor.bufferView = GetInt(jaccessor, "bufferView", -1);
+		accessor.byteOffset = GetSize(jaccessor, "byteOffset", 0);
+		accessor.count = GetSize(jaccessor, "count", 0);
+		accessor.componentType = GetInt(jaccessor, "componentType", 0);
+		accessor.components = GetComponentCount(GetString(jaccessor, "type"));
+		accessor.normalized = GetBool(jaccessor, "normalized", false);
+		doc->accessors.push_back(accessor);
+	}
+	for (const json &jmesh : GetArray(root, "meshes")) {
+		GltfMesh mesh;
+		mesh.name = GetString(jmesh, "name");
+		for (const json &jprim : GetArray(jmesh, "primitives")) {
+			GltfPrimitive prim;
+			prim.indices = GetInt(jprim, "indices", -1);
+			prim.mode = GetInt(jprim, "mode", 4);
+			json::const_iterator attributes = jprim.find("attributes");
+			if (attributes != jprim.end() && attributes->is_object()) {
+				for (json::const_iterator it = attributes->begin(); it != attributes->end(); ++it) {
+					if (it->is_number_integer())
+						prim.attributes.push_back({ it.key(), it->get<int>() });
+				}
+			}
+			mesh.primitives.push_back(prim);
+		}
+		doc->meshes.push_back(mesh);
+	}
+	for (const json &jnode : GetArray(root, "nodes")) {
+		GltfNode node;
+		node.name = GetString(jnode, "name");
+		node.mesh = GetInt(jnode, "mesh", -1);
+		node.skin = GetInt(jnode, "skin", -1);
+		for (const json &jchild : GetArray(jnode, "children")) {
+			if (jchild.is_number_integer())
+				node.children.push_back(jchild.get<int>());
+		}
+		float matrix[16];
+		if (GetFloats(jnode, "matrix", matrix, 16)) {
+			DecomposeMatrix(matrix, &node);
+		} else {
+			const float identityRotation[4] = { 0.f, 0.f, 0.f, 1.f };
+			std::fill(node.translation, node.translation + 3, 0.f);
+			std::copy(identityRotation, identityRotation + 4, node.rotation);
+			std::fill(node.scale, node.scale + 3, 1.f);
+			GetFloats(jnode, "translation", node.translation, 3);
+			GetFloats(jnode, "rotation", node.rotation, 4);
+			GetFloats(jnode, "scale", node.scale, 3);
+		}
+		doc->nodes.push_back(node);
+	}
+	for (const json &jskin : GetArray(root, "skins")) {
+		GltfSkin skin;
+		skin.name = GetString(jskin, "name");
+		skin.inverseBindMatrices = GetInt(jskin, "inverseBindMatrices", -1);
+		for (const json &jjoint : GetArray(jskin, "joints")) {
+			skin.joints.push_back(jjoint.is_number_integer() ? jjoint.get<int>() : -1);
+		}
+		doc->skins.push_back(skin);
+	}
+	for (const json &janimation : GetArray(root, "animations")) {
+		GltfAnimation animation;
+		animation.name = GetString(janimation, "name");
+		for (const json &jsampler : GetArray(janimation, "samplers")) {
+			GltfAnimationSampler sampler;
+			sampler.input = GetInt(jsampler, "input", -1);
+			sampler.output = GetInt(jsampler, "output", -1);
+			std::string interpolation = GetString(jsampler, "interpolation");
+			sampler.interpolation = interpolation == "STEP" ? 1 : interpolation == "CUBICSPLINE" ? 2 : 0;
+			animation.samplers.push_back(sampler);
+		}
+		for (const json &jchannel : GetArray(janimation, "channels")) {
+			json::const_iterator target = jchannel.find("target");
+			if (target == jchannel.end() || !target->is_object())
+				continue;
+			// Morph target "weights" have nothing to drive in agl, they are skipped like unknown paths
+			std::string path = GetString(*target, "path");
+			GltfAnimationChannel channel;
+			channel.sampler = GetInt(jchannel, "sampler", -1);
+			channel.node = GetInt(*target, "node", -1);
+			if (path == "translation")
+				channel.path = 0;
+			else if (path == "rotation")
+				channel.path = 1;
+			else if (path == "scale")
+				channel.path = 2;
+			else
+				continue;
+			animation.channels.push_back(channel);
+		}
+		doc->animations.push_back(animation);
+	}
+	return true;
+}
+
+static bool LoadDocument(GltfDocument *doc, const char *path, bool isBinary) {
+	std::string baseDir(path);
+	size_t slash = baseDir.find_last_of("/\\");
+	baseDir = (slash == std::string::npos) ? std::string() : baseDir.substr(0, slash + 1);
+
+	agl_gfx_file_map_t file;
+	if (agl_gfx_map_file(path, &file) != AGL_GFX_SUCCESS) {
+		printf("Failed to map file: %s\n", path);
+		return false;
+	}
+	doc->files.push_back(file);
+	const unsigned char *bytes = (const unsigned char*)file.data;
+	if (!isBinary) {
+		return ParseDocument(doc, (const char*)bytes, (size_t)file.size, nullptr, 0, baseDir);
+	}
+	// GLB container: 12 byte header followed by a JSON chunk and an optional BIN chunk
+	uint32_t header[3];
+	if (file.size < 20) {
+		printf("Invalid GLB file: %s\n", path);
+		return false;
+	}
+	memcpy(header, bytes, sizeof(header));
+	if (header[0] != GLB_MAGIC || header[1] != 2 || header[2] > file.size) {
+		printf("Invalid GLB header: %s\n", path);
+		return false;
+	}
+	const char *text = nullptr;
+	size_t textSize = 0;
+	const unsigned char *bin = nullptr;
+	size_t binSize = 0;
+	size_t offset = 12;
+	while (offset + 8 <= header[2]) {
+		uint32_t chunk[2];
+		memcpy(chunk, bytes + offset, sizeof(chunk));
+		offset += 8;
+		if (offset + chunk[0] > header[2]) {
+			printf("Truncated GLB chunk: %s\n", path);
+			return false;
+		}
+		if (chunk[1] == GLB_CHUNK_JSON && text == nullptr) {
+			text = (const char*)(bytes + offset);
+			textSize = chunk[0];
+		} else if (chunk[1] == GLB_CHUNK_BIN && bin == nullptr) {
+			bin = bytes + offset;
+			binSize = chunk[0];
+		}
+		offset += (chunk[0] + 3) & ~3u;
+	}
+	if (text == nullptr) {
+		printf("GLB file has no JSON chunk: %s\n", path);
+		return false;
+	}
+	return ParseDocument(doc, text, textSize, bin, binSize, baseDir);
+}
+
+static const unsigned char *GetAccessorData(const GltfDocument &doc, const GltfAccessor &accessor, size_t *stride) {
+	if (accessor.bufferView < 0 || accessor.bufferView >= (int)doc.bufferViews.size())
+		return nullptr;
+	const GltfBufferView &view = doc.bufferViews[accessor.bufferView];
+	size_t elemSize = GetComponentSize(accessor.componentType) * accessor.components;
+	*stride = view.byteStride ? view.byteStride : elemSize;
+	if (accessor.count == 0 || elemSize == 0 ||
+		accessor.byteOffset + (accessor.count - 1) * *stride + elemSize > view.byteLength) {
+		return nullptr;
+	}
+	return doc.buffers[view.buffer].data + view.byteOffset + accessor.byteOffset;
+}
+
+static const GltfAccessor *FindAttribute(const GltfDocument &doc, const GltfPrimitive &prim, const char *name) {
+	for (const GltfAttribute &attribute : prim.attributes) {
+		if (attribute.name == name && attribute.accessor >= 0 && attribute.accessor < (int)doc.accessors.size())
+			return &doc.accessors[attribute.accessor];
+	}
+	return nullptr;
+}
+
+static bool GetComponentType(int componentType, agl_component_type_t *type) {
+	switch (componentType) {
+	case GLTF_COMPONENT_TYPE_BYTE: *type = AGL_COMPONENT_TYPE_S8; return true;
+	case GLTF_COMPONENT_TYPE_UNSIGNED_BYTE: *type = AGL_COMPONENT_TYPE_U8; return true;
+	case GLTF_COMPONENT_TYPE_SHORT: *type = AGL_COMPONENT_TYPE_S16; return true;
+	case GLTF_COMPONENT_TYPE_UNSIGNED_SHORT: *type = AGL_COMPONENT_TYPE_U16; return true;
+	case GLTF_COMPONENT_TYPE_UNSIGNED_INT: *type = AGL_COMPONENT_TYPE_U32; return true;
+	case GLTF_COMPONENT_TYPE_FLOAT: *type = AGL_COMPONENT_TYPE_F32; return true;
+	default: return false;
+	}
+}
+
+// Linear arena for converted streams. Every conversion is reserved up front on the loading thread, so the
+// workers decode into disjoint slices without locking, and everything is released in one go after the
+// mesh callbacks have consumed it.
+struct GltfArena {
+	std::unique_ptr<unsigned char[]> memory;
+	unsigned char *base = nullptr;
+	size_t used = 0;
+
+	size_t Reserve(size_t bytes) {
+		size_t offset = used;
+		used += (bytes + 31) & ~(size_t)31;
+		return offset;
+	}
+	void Commit() {
+		if (used == 0)
+			return;
+		memory.reset(new unsigned char[used + 31]);
+		base = (unsigned char*)(((uintptr_t)memory.get() + 31) & ~(uintptr_t)31);
+	}
+	void *At(size_t offset) const {
+		return base + offset;
+	}
+};
+
+// A vertex or index stream of a primitive. Tightly packed float / uint32 data is used in place from the file
+// mapping, anything else is converted into the arena.
+struct GltfStream {
+	const GltfAccessor *accessor = nullptr;
+	const unsigned char *src = nullptr;
+	size_t stride = 0;
+	agl_component_type_t type = AGL_COMPONENT_TYPE_F32;
+	int components = 0;
+	bool convert = false;
+	size_t offset = 0;
+};
+
+static bool PlanStream(const GltfDocument &doc, const GltfAccessor *accessor, int components, GltfArena *arena, GltfStream *stream) {
+	stream->accessor = accessor;
+	stream->components = components;
+	stream->src = GetAccessorData(doc, *accessor, &stream->stride);
+	if (stream->src == nullptr || !GetComponentType(accessor->componentType, &stream->type))
+		return false;
+	stream->convert = stream->type != AGL_COMPONENT_TYPE_F32 || accessor->components != components ||
+		stream->stride != sizeof(agl_float) * components || ((uintptr_t)stream->src % alignof(agl_float)) != 0;
+	if (stream->convert)
+		stream->offset = arena->Reserve(sizeof(agl_float) * components * accessor->count);
+	return true;
+}
+
+static bool PlanIndexStream(const GltfDocument &doc, const GltfAccessor *accessor, GltfArena *arena, GltfStream *stream) {
+	stream->accessor = accessor;
+	stream->components = 1;
+	stream->src = GetAccessorData(doc, *accessor, &stream->stride);
+	if (stream->src == nullptr || accessor->components != 1 || !GetComponentType(accessor->componentType, &stream->type))
+		return false;
+	if (stream->type != AGL_COMPONENT_TYPE_U8 && stream->type != AGL_COMPONENT_TYPE_U16 && stream->type != AGL_COMPONENT_TYPE_U32)
+		return false;
+	stream->convert = stream->type != AGL_COMPONENT_TYPE_U32 || stream->stride != sizeof(agl_uint) ||
+		((uintptr_t)stream->src % alignof(agl_uint)) != 0;
+	if (stream->convert)
+		stream->offset = arena->Reserve(sizeof(agl_uint) * accessor->count);
+	return true;
+}
+
+static agl_float *DecodeStream(const GltfStream &stream, const GltfArena &arena) {
+	if (stream.accessor == nullptr)
+		return nullptr;
+	if (!stream.convert)
+		return (agl_float*)stream.src;
+	agl_float *dst = (agl_float*)arena.At(stream.offset);
+	agl_convert_to_f32(dst, stream.components, stream.src, stream.stride, stream.accessor->components,
+		stream.type, stream.accessor->normalized, stream.accessor->count);
+	return dst;
+}
+
+static agl_uint *DecodeIndexStream(const GltfStream &stream, const GltfArena &arena) {
+	if (stream.accessor == nullptr)
+		return nullptr;
+	if (!stream.convert)
+		return (agl_uint*)stream.src;
+	agl_uint *dst = (agl_uint*)arena.At(stream.offset);
+	agl_convert_to_u32(dst, stream.src, stream.stride, stream.type, stream.accessor->count);
+	return dst;
+}
+
+// One decode job per primitive
+struct GltfPrimitiveJob {
+	std::string name;
+	bool valid = false;
+	GltfStream position;
+	GltfStream uv;
+	GltfStream normal;
+	GltfStream color;
+	GltfStream joints;
+	GltfStream weights;
+	GltfStream index;
+	agl_gfx_mesh_params_t params;
+};
+
+static bool PlanPrimitive(const GltfDocument &doc, const GltfMesh &mesh, int primitive, GltfArena *arena, GltfPrimitiveJob *job) {
+	const GltfPrimitive &prim = mesh.primitives[primitive];
+	if (prim.mode != 4) {
+		printf("Skipping primitive %d of mesh %s: only triangle lists are supported (mode %d)\n", primitive, mesh.name.c_str(), prim.mode);
+		return false;
+	}
+	// POSITION
+	const GltfAccessor *posAccessor = FindAttribute(doc, prim, "POSITION");
+	if (posAccessor == nullptr || !PlanStream(doc, posAccessor, 3, arena, &job->position)) {
+		printf("Missing or invalid POSITION attribute in mesh: %s\n", mesh.name.c_str());
+		return false;
+	}
+	// NORMAL, TEXCOORD_0, COLOR_0 are optional and dropped if malformed
+	const GltfAccessor *normAccessor = FindAttribute(doc, prim, "NORMAL");
+	if (normAccessor && normAccessor->count == posAccessor->count && !PlanStream(doc, normAccessor, 3, arena, &job->normal))
+		job->normal = GltfStream();
+	const GltfAccessor *uvAccessor = FindAttribute(doc, prim, "TEXCOORD_0");
+	if (uvAccessor && uvAccessor->count == posAccessor->count && !PlanStream(doc, uvAccessor, 2, arena, &job->uv))
+		job->uv = GltfStream();
+	const GltfAccessor *colorAccessor = FindAttribute(doc, prim, "COLOR_0");
+	if (colorAccessor && colorAccessor->count == posAccessor->count && !PlanStream(doc, colorAccessor, 4, arena, &job->color))
+		job->color = GltfStream();
+	// JOINTS_0 and WEIGHTS_0 only make sense together. Joint indices are converted to whole floats, like every other stream.
+	const GltfAccessor *jointAccessor = FindAttribute(doc, prim, "JOINTS_0");
+	const GltfAccessor *weightAccessor = FindAttribute(doc, prim, "WEIGHTS_0");
+	if (jointAccessor && weightAccessor && jointAccessor->count == posAccessor->count && weightAccessor->count == posAccessor->count &&
+		!jointAccessor->normalized && !(PlanStream(doc, jointAccessor, 4, arena, &job->joints) && PlanStream(doc, weightAccessor, 4, arena, &job->weights))) {
+		job->joints = GltfStream();
+		job->weights = GltfStream();
+	}
+	// INDICES
+	if (prim.indices >= 0) {
+		if (prim.indices >= (int)doc.accessors.size() || !PlanIndexStream(doc, &doc.accessors[prim.indices], arena, &job->index)) {
+			printf("Unsupported index accessor in mesh: %s\n", mesh.name.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+// Returns false if an index is out of range, the CPU mesh passes would otherwise read and write past the vertex streams
+static bool DecodePrimitive(const GltfArena &arena, GltfPrimitiveJob *job) {
+	agl_gfx_mesh_params_t &meshParams = job->params;
+	meshParams.vertexCount = static_cast<agl_uint>(job->position.accessor->count);
+	meshParams.positionData = DecodeStream(job->position, arena);
+	meshParams.normalData = DecodeStream(job->normal, arena);
+	meshParams.uvData = DecodeStream(job->uv, arena);
+	meshParams.colorData = DecodeStream(job->color, arena);
+	meshParams.jointData = DecodeStream(job->joints, arena);
+	meshParams.weightData = DecodeStream(job->weights, arena);
+	meshParams.indexCount = job->index.accessor ? static_cast<agl_uint>(job->index.accessor->count) : 0;
+	meshParams.indexData = DecodeIndexStream(job->index, arena);
+	meshParams.flags = 0;
+	if (meshParams.indexData != nullptr) {
+		agl_uint maxIndex = 0;
+		for (agl_uint i = 0; i < meshParams.indexCount; ++i)
+			maxIndex = std::max(maxIndex, meshParams.indexData[i]);
+		if (meshParams.indexCount > 0 && maxIndex >= meshParams.vertexCount) {
+			printf("Index %u out of range of %u vertices in primitive: %s\n", maxIndex, meshParams.vertexCount, job->name.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+static void DecodePrimitives(const GltfArena &arena, std::vector<GltfPrimitiveJob> &jobs) {
+	std::atomic<size_t> next(0);
+	auto worker = [&arena, &jobs, &next]() {
+		for (size_t i = next.fetch_add(1); i < jobs.size(); i = next.fetch_add(1)) {
+			if (jobs[i].valid)
+				jobs[i].valid = DecodePrimitive(arena, &jobs[i]);
+		}
+	};
+	size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), jobs.size());
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount - 1);
+	for (size_t i = 1; i < threadCount; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread &thread : threads)
+		thread.join();
+}
+
+// Copies the inverse bind matrices of a skin, leaving `out` empty when the skin has none (identity)
+static bool GetInverseBindMatrices(const GltfDocument &doc, const GltfSkin &skin, std::vector<float> *out) {
+	out->clear();
+	if (skin.inverseBindMatrices < 0)
+		return true;
+	if (skin.inverseBindMatrices >= (int)doc.accessors.size())
+		return false;
+	const GltfAccessor &accessor = doc.accessors[skin.inverseBindMatrices];
+	size_t stride;
+	const unsigned char *src = GetAccessorData(doc, accessor, &stride);
+	if (src == nullptr || accessor.componentType != GLTF_COMPONENT_TYPE_FLOAT || accessor.components != 16 || accessor.count < skin.joints.size())
+		return false;
+	out->resize(16 * skin.joints.size());
+	for (size_t j = 0; j < skin.joints.size(); ++j)
+		memcpy(out->data() + 16 * j, src + j * stride, 16 * sizeof(float));
+	return true;
+}
+
+// Converts a whole accessor to floats, normalized integers included (quantized rotations are common in animations)
+static bool GetAccessorFloats(const GltfDocument &doc, int index, int components, std::vector<float> *out) {
+	if (index < 0 || index >= (int)doc.accessors.size())
+		return false;
+	const GltfAccessor &accessor = doc.accessors[index];
+	agl_component_type_t type;
+	size_t stride;
+	const unsigned char *src = GetAccessorData(doc, accessor, &stride);
+	if (src == nullptr || accessor.components != components || !GetComponentType(accessor.componentType, &type))
+		return false;
+	out->resize(components * accessor.count);
+	agl_convert_to_f32(out->data(), components, src, stride, accessor.components, type, accessor.normalized, accessor.count);
+	return true;
+}
+
+// Reports the animations whose channels target reported nodes, converting the sampler streams once per animation
+static void EmitAnimations(agl_gfx_context_t context, const GltfDocument &doc, agl_gfx_load_params_t *params, const std::vector<int> &reported) {
+	for (size_t a = 0; a < doc.animations.size(); ++a) {
+		const GltfAnimation &animation = doc.animations[a];
+		std::vector<std::vector<float>> times(animation.samplers.size()), values(animation.samplers.size());
+		std::vector<agl_gfx_animation_channel_t> channels;
+		for (const GltfAnimationChannel &channel : animation.channels) {
+			if (channel.sampler < 0 || channel.sampler >= (int)animation.samplers.size() ||
+				channel.node < 0 || channel.node >= (int)reported.size() || reported[channel.node] < 0)
+				continue;
+			const GltfAnimationSampler &sampler = animation.samplers[channel.sampler];
+			int components = channel.path == 1 ? 4 : 3;
+			size_t valuesPerKey = sampler.interpolation == 2 ? 3 : 1;
+			std::vector<float> &input = times[channel.sampler], &output = values[channel.sampler];
+			// A sampler shared by channels of different paths would need two conversions, glTF exporters do not do that
+			if (input.empty() && !(GetAccessorFloats(doc, sampler.input, 1, &input) && GetAccessorFloats(doc, sampler.output, components, &output))) {
+				input.clear();
+				continue;
+			}
+			if (output.size() != input.size() * valuesPerKey * components)
+				continue;
+			agl_gfx_animation_channel_t out;
+			out.node = reported[channel.node];
+			out.path = channel.path;
+			out.interpolation = sampler.interpolation;
+			out.keyCount = (agl_uint)input.size();
+			out.times = input.data();
+			out.values = output.data();
+			channels.push_back(out);
+		}
+		if (channels.empty()) {
+			printf("Skipping animation %d without valid channels\n", (int)a);
+			continue;
+		}
+		agl_gfx_animation_params_t animationParams;
+		animationParams.channelCount = (agl_uint)channels.size();
+		animationParams.channels = channels.data();
+		std::string name = animation.name.empty() ? "animation" + std::to_string(a) : animation.name;
+		params->animationCallback(context, &animationParams, name.c_str());
+	}
+}
+
+// Reports the node hierarchy breadth first from the roots, so parents are always reported before their children, then the skins
+// whose joints are all among those nodes, then the animations. `meshOrdinals[m]` is the index of mesh m's first primitive among the mesh callbacks,
+// `meshCounts[m]` how many it got.
+static void EmitHierarchy(agl_gfx_context_t context, const GltfDocument &doc, agl_gfx_load_params_t *params,
+	const std::vector<int> &meshOrdinals, const std::vector<agl_uint> &meshCounts) {
+	const int nodeCount = (int)doc.nodes.size();
+	std::vector<int> parents(nodeCount, -1);
+	for (int n = 0; n < nodeCount; ++n) {
+		for (int child : doc.nodes[n].children) {
+			if (child >= 0 && child < nodeCount && child != n && parents[child] < 0)
+				parents[child] = n;
+		}
+	}
+	std::vector<int> order;
+	std::vector<int> reported(nodeCount, -1); // node -> index among the reported nodes
+	for (int n = 0; n < nodeCount; ++n) {
+		if (parents[n] < 0) {
+			reported[n] = (int)order.size();
+			order.push_back(n);
+		}
+	}
+	for (size_t i = 0; i < order.size(); ++i) {
+		for (int child : doc.nodes[order[i]].children) {
+			if (child >= 0 && child < nodeCount && parents[child] == order[i] && reported[child] < 0) {
+				reported[child] = (int)order.size();
+				order.push_back(child);
+			}
+		}
+	}
+	std::vector<int> skinOrdinals(doc.skins.size(), -1);
+	std::vector<std::vector<int>> skinJoints(doc.skins.size());
+	std::vector<std::vector<float>> skinMatrices(doc.skins.size());
+	int skinCount = 0;
+	for (size_t s = 0; s < doc.skins.size() && params->skinCallback != nullptr; ++s) {
+		const GltfSkin &skin = doc.skins[s];
+		bool valid = !skin.joints.empty() && GetInverseBindMatrices(doc, skin, &skinMatrices[s]);
+		for (int joint : skin.joints) {
+			valid = valid && joint >= 0 && joint < nodeCount && reported[joint] >= 0;
+			skinJoints[s].push_back(valid ? reported[joint] : -1);
+		}
+		if (!valid) {
+			printf("Skipping invalid skin %d\n", (int)s);
+			continue;
+		}
+		skinOrdinals[s] = skinCount++;
+	}
+	for (size_t i = 0; i < order.size() && params->nodeCallback != nullptr; ++i) {
+		const GltfNode &node = doc.nodes[order[i]];
+		agl_gfx_node_params_t nodeParams;
+		nodeParams.parent = parents[order[i]] < 0 ? -1 : reported[parents[order[i]]];
+		std::copy(node.translation, node.translation + 3, nodeParams.pos);
+		std::copy(node.rotation, node.rotation + 4, nodeParams.rot);
+		std::copy(node.scale, node.scale + 3, nodeParams.scale);
+		bool hasMesh = node.mesh >= 0 && node.mesh < (int)meshCounts.size() && meshCounts[node.mesh] > 0;
+		nodeParams.firstMesh = hasMesh ? meshOrdinals[node.mesh] : -1;
+		nodeParams.meshCount = hasMesh ? meshCounts[node.mesh] : 0;
+		nodeParams.skin = (node.skin >= 0 && node.skin < (int)skinOrdinals.size()) ? skinOrdinals[node.skin] : -1;
+		std::string name = node.name.empty() ? "node" + std::to_string(order[i]) : node.name;
+		params->nodeCallback(context, &nodeParams, name.c_str());
+	}
+	for (size_t s = 0; s < doc.skins.size(); ++s) {
+		if (skinOrdinals[s] < 0)
+			continue;
+		agl_gfx_skin_params_t skinParams;
+		skinParams.jointCount = (agl_uint)skinJoints[s].size();
+		skinParams.jointNodes = skinJoints[s].data();
+		skinParams.inverseBindMatrices = skinMatrices[s].empty() ? nullptr : skinMatrices[s].data();
+		std::string name = doc.skins[s].name.empty() ? "skin" + std::to_string(s) : doc.skins[s].name;
+		params->skinCallback(context, &skinParams, name.c_str());
+	}
+	if (params->animationCallback != nullptr)
+		EmitAnimations(context, doc, params, reported);
 }
 
 static int LoadGltf(agl_gfx_context_t context, const char *path, agl_gfx_load_params_t *params) {
-	agl_gfx_mesh_params_t meshParams;
-	tinygltf::Model model;
-	tinygltf::TinyGLTF loader;
-	std::string err, warn;
+	GltfDocument doc;
+	GltfArena arena;
 
 	if (path == nullptr) {
 		printf("Invalid arguments to load_gltf. File path cannot be null!\n");
@@ -33,110 +859,76 @@ static int LoadGltf(agl_gfx_context_t context, const char *path, agl_gfx_load_pa
 	}
 	const char *ext = strrchr(path, '.');
 	bool isBinary = false;
-	if (_stricmp(ext, ".gltf") == 0) {
+	if (ext != nullptr && _stricmp(ext, ".gltf") == 0) {
 		isBinary = false;
-	} else if (_stricmp(ext, ".glb") == 0) {
+	} else if (ext != nullptr && _stricmp(ext, ".glb") == 0) {
 		isBinary = true;
 	} else {
-		printf("Unsupported file extension: %s\n", ext);
+		printf("Unsupported file extension: %s\n", ext ? ext : "");
 		return 0;
 	}
-	bool ret;
-	if (isBinary) {
-		ret = loader.LoadBinaryFromFile(&model, &err, &warn, path);
-	} else {
-		ret = loader.LoadASCIIFromFile(&model, &err, &warn, path);
-	}
-	if (!warn.empty()) {
-		printf("Warn: %s\n", warn.c_str());
-	}
-	if (!err.empty()) {
-		printf("Err: %s\n", err.c_str());
-	}
-	if (!ret) {
+	if (!LoadDocument(&doc, path, isBinary)) {
 		printf("Failed to load GLTF: %s\n", path);
 		return 0;
 	}
-	if (model.meshes.empty()) {
+	if (doc.meshes.empty()) {
 		printf("No meshes found in GLTF: %s\n", path);
 		return 0;
 	}
-	// For simplicity, we only load the first mesh
-	const tinygltf::Mesh &mesh = model.meshes[0];
-	if (mesh.primitives.empty()) {
-		printf("No primitives found in mesh: %s\n", mesh.name.c_str());
+	for (const std::string &externalPath : doc.externalPaths)
+		agl_gfx_loader_add_dependency(context, externalPath.c_str());
+	std::vector<GltfPrimitiveJob> jobs;
+	std::vector<size_t> meshFirstJob(doc.meshes.size());
+	for (size_t m = 0; m < doc.meshes.size(); ++m) {
+		const GltfMesh &mesh = doc.meshes[m];
+		meshFirstJob[m] = jobs.size();
+		for (size_t p = 0; p < mesh.primitives.size(); ++p) {
+			jobs.emplace_back();
+			GltfPrimitiveJob &job = jobs.back();
+			job.name = mesh.name.empty() ? "mesh" + std::to_string(m) : mesh.name;
+			if (mesh.primitives.size() > 1)
+				job.name += "." + std::to_string(p);
+			job.valid = PlanPrimitive(doc, mesh, (int)p, &arena, &job);
+		}
+	}
+	if (jobs.empty()) {
+		printf("No primitives found in GLTF: %s\n", path);
 		return 0;
 	}
-	const tinygltf::Primitive &prim = mesh.primitives[0];
-	// POSITION
-	const tinygltf::Accessor &posAccessor = model.accessors[prim.attributes.find("POSITION")->second];
-	const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-	const tinygltf::Buffer &posBuffer = model.buffers[posView.buffer];
-	meshParams.vertexCount = static_cast<agl_uint>(posAccessor.count);
-	meshParams.positionData = (agl_float*)(posBuffer.data.data() + posView.byteOffset + posAccessor.byteOffset);
-	// NORMAL
-	if (prim.attributes.count("NORMAL")) {
-		const tinygltf::Accessor &normAccessor = model.accessors[prim.attributes.find("NORMAL")->second];
-		const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-		const tinygltf::Buffer &normBuffer = model.buffers[normView.buffer];
-		meshParams.normalData = (agl_float*)(normBuffer.data.data() + normView.byteOffset + normAccessor.byteOffset);
-	} else {
-		meshParams.normalData = nullptr;
-	}
-	// TEXCOORD_0
-	if (prim.attributes.count("TEXCOORD_0")) {
-		const tinygltf::Accessor &uvAccessor = model.accessors[prim.attributes.find("TEXCOORD_0")->second];
-		const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-		const tinygltf::Buffer &uvBuffer = model.buffers[uvView.buffer];
-		meshParams.uvData = (agl_float*)(uvBuffer.data.data() + uvView.byteOffset + uvAccessor.byteOffset);
-	} else {
-		meshParams.uvData = nullptr;
-	}
-	// COLOR_0
-	if (prim.attributes.count("COLOR_0")) {
-		const tinygltf::Accessor &colorAccessor = model.accessors[prim.attributes.find("COLOR_0")->second];
-		const tinygltf::BufferView &colorView = model.bufferViews[colorAccessor.bufferView];
-		const tinygltf::Buffer &colorBuffer = model.buffers[colorView.buffer];
-		meshParams.colorData = (agl_float*)(colorBuffer.data.data() + colorView.byteOffset + colorAccessor.byteOffset);
-	} else {
-		meshParams.colorData = nullptr;
+	arena.Commit();
+	DecodePrimitives(arena, jobs);
+
+	// Callbacks create GPU resources, so they run on the calling thread in file order
+	int loaded = 0;
+	std::vector<int> jobOrdinals(jobs.size(), -1);
+	for (size_t j = 0; j < jobs.size(); ++j) {
+		if (!jobs[j].valid)
+			continue;
+		params->meshCallback(context, &jobs[j].params, jobs[j].name.c_str());
+		jobOrdinals[j] = loaded++;
 	}
-	// INDICES
-	if (prim.indices >= 0) {
-		const tinygltf::Accessor &idxAccessor = model.accessors[prim.indices];
-		const tinygltf::BufferView &idxView = model.bufferViews[idxAccessor.bufferView];
-		const tinygltf::Buffer &idxBuffer = model.buffers[idxView.buffer];
-		meshParams.indexCount = static_cast<agl_uint>(idxAccessor.count);
-		if (idxAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT) {
-			meshParams.indexData = (agl_uint*)(idxBuffer.data.data() + idxView.byteOffset + idxAccessor.byteOffset);
-		} else if (idxAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT) {
-			// Need to convert to uint
-			const uint16_t *src = (const uint16_t*)(idxBuffer.data.data() + idxView.byteOffset + idxAccessor.byteOffset);
-			agl_uint *dst = new agl_uint[idxAccessor.count];
-			for (size_t i = 0; i < idxAccessor.count; ++i) {
-				dst[i] = static_cast<agl_uint>(src[i]);
+	printf("Successfully loaded %d/%d GLTF primitives from: %s\n", loaded, (int)jobs.size(), path);
+
+	if ((params->nodeCallback != nullptr || params->skinCallback != nullptr || params->animationCallback != nullptr) && loaded > 0) {
+		std::vector<int> meshOrdinals(doc.meshes.size(), -1);
+		std::vector<agl_uint> meshCounts(doc.meshes.size(), 0);
+		for (size_t m = 0; m < doc.meshes.size(); ++m) {
+			for (size_t j = meshFirstJob[m]; j < meshFirstJob[m] + doc.meshes[m].primitives.size(); ++j) {
+				if (jobOrdinals[j] < 0)
+					continue;
+				if (meshOrdinals[m] < 0)
+					meshOrdinals[m] = jobOrdinals[j];
+				meshCounts[m]++;
 			}
-			// TODO: We should free this memory when the mesh is destroyed
-			meshParams.indexData = dst;
-		} else {
-			printf("Unsupported index component type: %d\n", idxAccessor.componentType);
-			meshParams.indexCount = 0;
-			meshParams.indexData = nullptr;
-			return 0;
 		}
-	} else {
-		meshParams.indexCount = 0;
-		meshParams.indexData = nullptr;
+		EmitHierarchy(context, doc, params, meshOrdinals, meshCounts);
 	}
 
-	params->meshCallback(context, &meshParams, mesh.name.c_str());
-	printf("Successfully loaded GLTF mesh: %s\n", mesh.name.c_str());
-
-	return 1;
+	return loaded > 0;
 }
 
 extern "C" {
-	
+
 #include "agl_plugin.h"
 
 static int load_gltf(agl_gfx_context_t context, const char *path, agl_gfx_load_params_t *params) {
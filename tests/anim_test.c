@@ -0,0 +1,191 @@
+#include "agl_anim.h"
+#include "agl_math.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Unlike agl_math_assert this does not depend on _DEBUG or __debugbreak
+#define test_assert(cond) do { if (!(cond)) { fprintf(stderr, "(%s:%d) Assertion failed: %s\n", __FILE__, __LINE__, #cond); abort(); } } while (0)
+
+#define KEY_COUNT 61
+
+static float quat_angle(const float a[4], const float b[4]) {
+	float d = fabsf(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+	return 2.f * acosf(d < 1.f ? d : 1.f);
+}
+
+// A straight line needs only its end keys, a wave keeps more but stays within the tolerance
+void test_anim_clip() {
+	static float times[KEY_COUNT], line[KEY_COUNT * 3], wave[KEY_COUNT * 4];
+	for (int i = 0; i < KEY_COUNT; i++) {
+		times[i] = (float)i / 30.f;
+		line[3 * i + 0] = times[i] * 2.f;
+		line[3 * i + 1] = 1.f;
+		line[3 * i + 2] = -times[i];
+		float angle = sinf(times[i] * 2.f);
+		wave[4 * i + 0] = 0.f;
+		wave[4 * i + 1] = sinf(angle / 2.f);
+		wave[4 * i + 2] = 0.f;
+		wave[4 * i + 3] = cosf(angle / 2.f);
+	}
+	agl_anim_track_desc_t tracks[2] = {
+		{ 1, AGL_ANIM_PATH_TRANSLATION, AGL_ANIM_INTERPOLATION_LINEAR, KEY_COUNT, times, line, 0.f },
+		{ 0, AGL_ANIM_PATH_ROTATION, AGL_ANIM_INTERPOLATION_LINEAR, KEY_COUNT, times, wave, 0.f },
+	};
+	agl_anim_clip_params_t params = { 0.f, 1e-3f, 2e-3f, 0.f };
+	agl_anim_clip_t *clip = agl_anim_clip_create(2, tracks, 2, &params);
+	test_assert(clip != NULL);
+	test_assert(float_eq(agl_anim_clip_duration(clip), 2.f, 1e-6f));
+	uint32_t keys = agl_anim_clip_key_count(clip);
+	test_assert(keys > 2 && keys < KEY_COUNT);
+	test_assert(agl_anim_clip_size(clip) < sizeof(times) + sizeof(line) + sizeof(wave));
+
+	agl_anim_pose_t *pose = agl_anim_pose_create(3);
+	test_assert(pose->capacity == 8);
+	for (int i = 0; i < 4 * KEY_COUNT; i++) {
+		float t = (float)i / 120.f;
+		if (t >= 2.f)
+			break;
+		agl_anim_sample(clip, t, pose);
+		float pos[3], rot[4], scale[3];
+		agl_anim_pose_get_joint(pose, 1, pos, rot, scale);
+		test_assert(float_eq(pos[0], t * 2.f, 2e-3f));
+		test_assert(float_eq(pos[1], 1.f, 2e-3f));
+		test_assert(float_eq(pos[2], -t, 2e-3f));
+		test_assert(rot[3] == 1.f && scale[0] == 1.f);
+		// Between source keys the clip follows their nlerp rather than the sine, which stays within a few milliradians
+		float angle = sinf(t * 2.f);
+		float expected[4] = { 0.f, sinf(angle / 2.f), 0.f, cosf(angle / 2.f) };
+		agl_anim_pose_get_joint(pose, 0, pos, rot, scale);
+		test_assert(quat_angle(rot, expected) < 5e-3f);
+		// Joint 2 has no tracks and keeps the identity
+		agl_anim_pose_get_joint(pose, 2, pos, rot, scale);
+		test_assert(pos[0] == 0.f && rot[3] == 1.f && scale[2] == 1.f);
+	}
+	// Time wraps around the duration
+	float a[3], b[3], rot[4], scale[3];
+	agl_anim_sample(clip, 0.5f, pose);
+	agl_anim_pose_get_joint(pose, 1, a, rot, scale);
+	agl_anim_sample(clip, 2.5f, pose);
+	agl_anim_pose_get_joint(pose, 1, b, rot, scale);
+	test_assert(float_eq(a[0], b[0], 1e-5f) && float_eq(a[2], b[2], 1e-5f));
+
+	agl_anim_pose_destroy(pose);
+	agl_anim_clip_destroy(clip);
+
+	// Invalid joint
+	test_assert(agl_anim_clip_create(1, tracks, 2, NULL) == NULL);
+}
+
+void test_anim_step() {
+	float times[3] = { 0.f, 1.f, 2.f };
+	float values[9] = { 1.f, 1.f, 1.f, 2.f, 2.f, 2.f, 3.f, 3.f, 3.f };
+	agl_anim_track_desc_t track = { 0, AGL_ANIM_PATH_SCALE, AGL_ANIM_INTERPOLATION_STEP, 3, times, values, 0.f };
+	agl_anim_clip_t *clip = agl_anim_clip_create(1, &track, 1, NULL);
+	agl_anim_pose_t *pose = agl_anim_pose_create(1);
+	float pos[3], rot[4], scale[3];
+	agl_anim_sample(clip, 0.9f, pose);
+	agl_anim_pose_get_joint(pose, 0, pos, rot, scale);
+	test_assert(float_eq(scale[1], 1.f, 1e-4f));
+	agl_anim_sample(clip, 1.5f, pose);
+	agl_anim_pose_get_joint(pose, 0, pos, rot, scale);
+	test_assert(float_eq(scale[1], 2.f, 1e-4f));
+	agl_anim_pose_destroy(pose);
+	agl_anim_clip_destroy(clip);
+}
+
+void test_anim_blend() {
+	agl_anim_pose_t *a = agl_anim_pose_create(9), *b = agl_anim_pose_create(9);
+	float half = 0.70710678f;
+	float pa[3] = { 0.f, 0.f, 0.f }, ra[4] = { 0.f, 0.f, 0.f, 1.f }, sa[3] = { 1.f, 1.f, 1.f };
+	// The same 90 degree turn about y, stored with the opposite sign, so the blend has to take the short arc
+	float pb[3] = { 2.f, 4.f, -2.f }, rb[4] = { 0.f, -half, 0.f, -half }, sb[3] = { 3.f, 3.f, 3.f };
+	agl_anim_pose_set_joint(a, 8, pa, ra, sa);
+	agl_anim_pose_set_joint(b, 8, pb, rb, sb);
+	agl_anim_blend(a, a, b, 0.5f);
+	float pos[3], rot[4], scale[3];
+	agl_anim_pose_get_joint(a, 8, pos, rot, scale);
+	test_assert(float_eq(pos[0], 1.f, 1e-6f) && float_eq(pos[1], 2.f, 1e-6f) && float_eq(pos[2], -1.f, 1e-6f));
+	test_assert(float_eq(scale[0], 2.f, 1e-6f));
+	float expected[4] = { 0.f, sinf(0.3926991f), 0.f, cosf(0.3926991f) };
+	test_assert(quat_angle(rot, expected) < 1e-3f);
+	agl_anim_pose_get_joint(a, 0, pos, rot, scale);
+	test_assert(rot[3] == 1.f && scale[0] == 1.f);
+	agl_anim_pose_destroy(a);
+	agl_anim_pose_destroy(b);
+}
+
+// A 64 joint clip with a rotation and a translation per joint, the size of a typical character skeleton
+void bench_anim() {
+	enum { JOINTS = 64, CHARACTERS = 1000, FRAMES = 100 };
+	static float times[KEY_COUNT], rotations[JOINTS][KEY_COUNT * 4], translations[JOINTS][KEY_COUNT * 3];
+	static agl_anim_track_desc_t tracks[2 * JOINTS];
+	for (int i = 0; i < KEY_COUNT; i++)
+		times[i] = (float)i / 30.f;
+	for (int j = 0; j < JOINTS; j++) {
+		for (int i = 0; i < KEY_COUNT; i++) {
+			float angle = 0.8f * sinf(times[i] * (float)(1 + j % 5) + (float)j);
+			rotations[j][4 * i + 0] = 0.6f * sinf(angle / 2.f);
+			rotations[j][4 * i + 1] = 0.8f * sinf(angle / 2.f);
+			rotations[j][4 * i + 2] = 0.f;
+			rotations[j][4 * i + 3] = cosf(angle / 2.f);
+			translations[j][3 * i + 0] = 0.1f * (float)j;
+			translations[j][3 * i + 1] = 0.05f * sinf(3.f * times[i]);
+			translations[j][3 * i + 2] = 0.f;
+		}
+		tracks[2 * j] = (agl_anim_track_desc_t){ j, AGL_ANIM_PATH_ROTATION, AGL_ANIM_INTERPOLATION_LINEAR, KEY_COUNT, times, rotations[j], 0.f };
+		tracks[2 * j + 1] = (agl_anim_track_desc_t){ j, AGL_ANIM_PATH_TRANSLATION, AGL_ANIM_INTERPOLATION_LINEAR, KEY_COUNT, times, translations[j], 0.f };
+	}
+	agl_anim_clip_t *clip = agl_anim_clip_create(JOINTS, tracks, 2 * JOINTS, NULL);
+	size_t raw = sizeof(rotations) + sizeof(translations) + 2 * JOINTS * sizeof(times);
+	printf("anim clip (%d joints, %d keys per track): %.1f KB, raw keys %.1f KB, %u of %u keys kept\n", JOINTS, KEY_COUNT,
+		agl_anim_clip_size(clip) / 1024.0, raw / 1024.0, agl_anim_clip_key_count(clip), 2 * JOINTS * KEY_COUNT);
+
+	static agl_anim_pose_t *poses[CHARACTERS];
+	static float clock_times[CHARACTERS];
+	for (int i = 0; i < CHARACTERS; i++)
+		poses[i] = agl_anim_pose_create(JOINTS);
+	for (int pass = 0; pass < 2; pass++) {
+		uint32_t features = agl_cpu_set_features(pass == 0 ? 0 : ~0u);
+		for (int i = 0; i < CHARACTERS; i++)
+			clock_times[i] = 0.0137f * (float)i;
+		clock_t t0 = clock();
+		for (int f = 0; f < FRAMES; f++) {
+			for (int i = 0; i < CHARACTERS; i++)
+				clock_times[i] += 1.f / 60.f;
+			agl_anim_sample_many(clip, clock_times, poses, CHARACTERS);
+		}
+		clock_t t1 = clock();
+		for (int f = 0; f < FRAMES; f++) {
+			for (int i = 0; i + 1 < CHARACTERS; i += 2)
+				agl_anim_blend(poses[i], poses[i], poses[i + 1], 0.3f);
+		}
+		clock_t t2 = clock();
+		double sampleMs = 1e3 * (double)(t1 - t0) / CLOCKS_PER_SEC / FRAMES;
+		double blendMs = 1e3 * (double)(t2 - t1) / CLOCKS_PER_SEC / FRAMES;
+		printf("anim (features 0x%x): sampling %d characters %.2f ms/frame (%.1f M joints/s), blending %d pose pairs %.3f ms\n",
+			features, CHARACTERS, sampleMs, CHARACTERS * JOINTS / (sampleMs + 1e-9) / 1e3, CHARACTERS / 2, blendMs);
+	}
+	for (int i = 0; i < CHARACTERS; i++)
+		agl_anim_pose_destroy(poses[i]);
+	agl_anim_clip_destroy(clip);
+}
+
+int main() {
+	// Once on the SSE2 baseline, then with the best path the CPU supports
+	for (int pass = 0; pass < 2; pass++) {
+		agl_cpu_set_features(pass == 0 ? 0 : ~0u);
+		test_anim_clip();
+		test_anim_step();
+		test_anim_blend();
+	}
+	bench_anim();
+	return 0;
+}
+
+#define AGL_ANIM_IMPLEMENTATION
+#include "agl_anim.h"
+#define AGL_MATH_IMPLEMENTATION
+#include "agl_math.h"
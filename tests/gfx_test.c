@@ -104,7 +104,16 @@ int main() {
         meshParams.colorData = &colors[0][0];
         // meshParams.indexCount = NELEM(indices);
         // meshParams.indexData = indices;
-        cube = agl_gfx_create_mesh(context, &meshParams);
+        // Weld the per-face duplicates and index the cube
+        agl_gfx_mesh_params_t optimized;
+        agl_gfx_mesh_optimize_stats_t stats;
+        if (agl_gfx_optimize_mesh(&meshParams, 0, &optimized, &stats) == AGL_GFX_SUCCESS) {
+            printf("Cube: %u -> %u vertices, ACMR %.3f -> %.3f\n", stats.vertexCountBefore, stats.vertexCountAfter, stats.acmrBefore, stats.acmrAfter);
+            cube = agl_gfx_create_mesh(context, &optimized);
+            agl_gfx_free_optimized_mesh(&optimized);
+        } else {
+            cube = agl_gfx_create_mesh(context, &meshParams);
+        }
 
         #undef V0
         #undef V1
@@ -142,4 +151,6 @@ int main() {
 
 #define AGL_GFX_IMPLEMENTATION
 #define AGL_GFX_ENABLE_ASSERTS 1
-#include "agl_gfx.h"
\ No newline at end of file
+#include "agl_gfx.h"
+#define AGL_MATH_IMPLEMENTATION
+#include "agl_math.h"
\ No newline at end of file
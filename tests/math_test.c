@@ -1,48 +1,56 @@
 #include "agl_math.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Test checks, active in every build unlike agl_math_assert
+#define test_assert(cond) do { if (!(cond)) { fprintf(stderr, "(%s:%d) Assertion failed: %s\n", __FILE__, __LINE__, #cond); abort(); } } while (0)
+
 void test_vec3f_add() {
 	vec3f_t a = {1, 2, 3};
 	vec3f_t b = {4, 5, 6};
 	vec3f_add(&a, &b);
-	agl_math_assert(float_eq(a._m[0], 5.f, 1e-6f));
-	agl_math_assert(float_eq(a._m[1], 7.f, 1e-6f));
-	agl_math_assert(float_eq(a._m[2], 9.f, 1e-6f));
+	test_assert(float_eq(a._m[0], 5.f, 1e-6f));
+	test_assert(float_eq(a._m[1], 7.f, 1e-6f));
+	test_assert(float_eq(a._m[2], 9.f, 1e-6f));
 }
 
 void test_vec3f_addscaled() {
 	vec3f_t a = {1, 2, 3};
 	vec3f_t b = {4, 5, 6};
 	vec3f_addscaled(&a, &b, 0.5f);
-	agl_math_assert(float_eq(a._m[0], 3.f, 1e-6f));
-	agl_math_assert(float_eq(a._m[1], 4.5f, 1e-6f));
-	agl_math_assert(float_eq(a._m[2], 6.f, 1e-6f));
+	test_assert(float_eq(a._m[0], 3.f, 1e-6f));
+	test_assert(float_eq(a._m[1], 4.5f, 1e-6f));
+	test_assert(float_eq(a._m[2], 6.f, 1e-6f));
 }
 
 void test_vec3f_sub() {
 	vec3f_t a = {1, 2, 3};
 	vec3f_t b = {4, 5, 6};
 	vec3f_sub(&a, &b);
-	agl_math_assert(float_eq(a._m[0], -3.f, 1e-6f));
-	agl_math_assert(float_eq(a._m[1], -3.f, 1e-6f));
-	agl_math_assert(float_eq(a._m[2], -3.f, 1e-6f));
+	test_assert(float_eq(a._m[0], -3.f, 1e-6f));
+	test_assert(float_eq(a._m[1], -3.f, 1e-6f));
+	test_assert(float_eq(a._m[2], -3.f, 1e-6f));
 }
 
 void test_vec3f_mul() {
 	vec3f_t a = {1, 2, 3};
 	vec3f_t b = {4, 5, 6};
 	vec3f_mul(&a, &b);
-	agl_math_assert(float_eq(a._m[0], 4.f, 1e-6f));
-	agl_math_assert(float_eq(a._m[1], 10.f, 1e-6f));
-	agl_math_assert(float_eq(a._m[2], 18.f, 1e-6f));
+	test_assert(float_eq(a._m[0], 4.f, 1e-6f));
+	test_assert(float_eq(a._m[1], 10.f, 1e-6f));
+	test_assert(float_eq(a._m[2], 18.f, 1e-6f));
 }
 
 void test_vec3f_div() {
 	vec3f_t a = {4, 10, 18};
 	vec3f_t b = {2, 5, 6};
 	vec3f_div(&a, &b);
-	agl_math_assert(float_eq(a._m[0], 2.f, 1e-6f));
-	agl_math_assert(float_eq(a._m[1], 2.f, 1e-6f));
-	agl_math_assert(float_eq(a._m[2], 3.f, 1e-6f));
+	test_assert(float_eq(a._m[0], 2.f, 1e-6f));
+	test_assert(float_eq(a._m[1], 2.f, 1e-6f));
+	test_assert(float_eq(a._m[2], 3.f, 1e-6f));
 }
 
 void test_quatf_fromaxisangle() {
@@ -53,9 +61,9 @@ void test_quatf_fromaxisangle() {
 	vec3f_t v = {1, 0, 0};
 	vec3f_t r;
 	quatf_apply(&r, &q, &v);
-	agl_math_assert(float_eq(r._m[0], 0.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[1], 0.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[2], -1.f, 1e-6f));
+	test_assert(float_eq(r._m[0], 0.f, 1e-6f));
+	test_assert(float_eq(r._m[1], 0.f, 1e-6f));
+	test_assert(float_eq(r._m[2], -1.f, 1e-6f));
 }
 
 void test_quatf_fromvectors() {
@@ -65,9 +73,9 @@ void test_quatf_fromvectors() {
 	quatf_fromvectors(&q, &a, &b);
 	vec3f_t r;
 	quatf_apply(&r, &q, &a);
-	agl_math_assert(float_eq(r._m[0], 0.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[1], 1.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[2], 0.f, 1e-6f));
+	test_assert(float_eq(r._m[0], 0.f, 1e-6f));
+	test_assert(float_eq(r._m[1], 1.f, 1e-6f));
+	test_assert(float_eq(r._m[2], 0.f, 1e-6f));
 }
 
 void test_quatf_fromvectors_parallel() {
@@ -77,9 +85,9 @@ void test_quatf_fromvectors_parallel() {
 	quatf_fromvectors(&q, &a, &b);
 	vec3f_t r;
 	quatf_apply(&r, &q, &a);
-	agl_math_assert(float_eq(r._m[0], 1.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[1], 0.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[2], 0.f, 1e-6f));
+	test_assert(float_eq(r._m[0], 1.f, 1e-6f));
+	test_assert(float_eq(r._m[1], 0.f, 1e-6f));
+	test_assert(float_eq(r._m[2], 0.f, 1e-6f));
 }
 
 void test_quatf_fromvectors_antiparallel() {
@@ -89,9 +97,9 @@ void test_quatf_fromvectors_antiparallel() {
 	quatf_fromvectors(&q, &a, &b);
 	vec3f_t r;
 	quatf_apply(&r, &q, &a);
-	agl_math_assert(float_eq(r._m[0], -1.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[1], 0.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[2], 0.f, 1e-6f));
+	test_assert(float_eq(r._m[0], -1.f, 1e-6f));
+	test_assert(float_eq(r._m[1], 0.f, 1e-6f));
+	test_assert(float_eq(r._m[2], 0.f, 1e-6f));
 }
 
 void test_mat3f_mul() {
@@ -99,15 +107,15 @@ void test_mat3f_mul() {
 	mat3f_t b = {{{9, 8, 7}, {6, 5, 4}, {3, 2, 1}}};
 	mat3f_t m;
 	mat3f_mul(&m, &a, &b);
-	agl_math_assert(float_eq(m._m[0][0], 90.f, 1e-6f));
-	agl_math_assert(float_eq(m._m[0][1], 114.f, 1e-6f));
-	agl_math_assert(float_eq(m._m[0][2], 138.f, 1e-6f));
-	agl_math_assert(float_eq(m._m[1][0], 54.f, 1e-6f));
-	agl_math_assert(float_eq(m._m[1][1], 69.f, 1e-6f));
-	agl_math_assert(float_eq(m._m[1][2], 84.f, 1e-6f));
-	agl_math_assert(float_eq(m._m[2][0], 18.f, 1e-6f));
-	agl_math_assert(float_eq(m._m[2][1], 24.f, 1e-6f));
-	agl_math_assert(float_eq(m._m[2][2], 30.f, 1e-6f));
+	test_assert(float_eq(m._m[0][0], 90.f, 1e-6f));
+	test_assert(float_eq(m._m[0][1], 114.f, 1e-6f));
+	test_assert(float_eq(m._m[0][2], 138.f, 1e-6f));
+	test_assert(float_eq(m._m[1][0], 54.f, 1e-6f));
+	test_assert(float_eq(m._m[1][1], 69.f, 1e-6f));
+	test_assert(float_eq(m._m[1][2], 84.f, 1e-6f));
+	test_assert(float_eq(m._m[2][0], 18.f, 1e-6f));
+	test_assert(float_eq(m._m[2][1], 24.f, 1e-6f));
+	test_assert(float_eq(m._m[2][2], 30.f, 1e-6f));
 }
 
 void test_mat3f_mulvec3f() {
@@ -115,9 +123,9 @@ void test_mat3f_mulvec3f() {
 	vec3f_t v = {1, 2, 3};
 	vec3f_t r;
 	mat3f_mulvec3f(&r, &m, &v);
-	agl_math_assert(float_eq(r._m[0], 30.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[1], 36.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[2], 42.f, 1e-6f));
+	test_assert(float_eq(r._m[0], 30.f, 1e-6f));
+	test_assert(float_eq(r._m[1], 36.f, 1e-6f));
+	test_assert(float_eq(r._m[2], 42.f, 1e-6f));
 }
 
 void test_vec3f_mulmat3f() {
@@ -125,9 +133,9 @@ void test_vec3f_mulmat3f() {
 	mat3f_t m = {{{1, 2, 3}, {4, 5, 6}, {7, 8, 9}}};
 	vec3f_t r;
 	vec3f_mulmat3f(&r, &v, &m);
-	agl_math_assert(float_eq(r._m[0], 14.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[1], 32.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[2], 50.f, 1e-6f));
+	test_assert(float_eq(r._m[0], 14.f, 1e-6f));
+	test_assert(float_eq(r._m[1], 32.f, 1e-6f));
+	test_assert(float_eq(r._m[2], 50.f, 1e-6f));
 }
 
 void test_mat3f_fromquat() {
@@ -138,14 +146,1460 @@ void test_mat3f_fromquat() {
 	vec3f_t v = {1, 0, 0};
 	vec3f_t r;
 	mat3f_mulvec3f(&r, &m, &v);
-	agl_math_assert(float_eq(r._m[0], 0.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[1], 0.f, 1e-6f));
-	agl_math_assert(float_eq(r._m[2], -1.f, 1e-6f));
+	test_assert(float_eq(r._m[0], 0.f, 1e-6f));
+	test_assert(float_eq(r._m[1], 0.f, 1e-6f));
+	test_assert(float_eq(r._m[2], -1.f, 1e-6f));
 	vec3f_t r1;
 	quatf_apply(&r1, &q, &v);
-	agl_math_assert(float_eq(r1._m[0], r._m[0], 1e-6f));
-	agl_math_assert(float_eq(r1._m[1], r._m[1], 1e-6f));
-	agl_math_assert(float_eq(r1._m[2], r._m[2], 1e-6f));
+	test_assert(float_eq(r1._m[0], r._m[0], 1e-6f));
+	test_assert(float_eq(r1._m[1], r._m[1], 1e-6f));
+	test_assert(float_eq(r1._m[2], r._m[2], 1e-6f));
+}
+
+void test_mat4f_fromtrs() {
+	quatf_t q;
+	quatf_fromaxisangle(&q, &(vec3f_t){0, 1, 0}, M_PI / 2);
+	mat4f_t m;
+	mat4f_fromtrs(&m, &(vec3f_t){1, 2, 3}, &q, &(vec3f_t){2, 3, 4});
+	// (1, 1, 1) scales to (2, 3, 4), turns to (4, 3, -2) and moves to (5, 5, 1)
+	vec4f_t r;
+	mat4f_mulvec4f(&r, &m, &(vec4f_t){1, 1, 1, 1});
+	test_assert(float_eq(r._m[0], 5.f, 1e-5f));
+	test_assert(float_eq(r._m[1], 5.f, 1e-5f));
+	test_assert(float_eq(r._m[2], 1.f, 1e-5f));
+	test_assert(float_eq(r._m[3], 1.f, 1e-6f));
+	quatf_t back;
+	mat3f_t rot;
+	mat3f_fromquat(&rot, &q);
+	quatf_frommat3f(&back, &rot);
+	for (int k = 0; k < 4; k++)
+		test_assert(float_eq(back._m[k], q._m[k], 1e-5f));
+}
+
+void test_mat4f_perspective() {
+	mat4f_t m;
+	mat4f_perspective(&m, M_PI / 2, 2.f, 0.5f, 100.f);
+	vec4f_t r;
+	// The near and far planes map to -1 and 1, the edge of the view to 1
+	mat4f_mulvec4f(&r, &m, &(vec4f_t){0, 0, -0.5f, 1});
+	test_assert(float_eq(r._m[2] / r._m[3], -1.f, 1e-5f));
+	mat4f_mulvec4f(&r, &m, &(vec4f_t){0, 100, -100, 1});
+	test_assert(float_eq(r._m[2] / r._m[3], 1.f, 1e-5f));
+	test_assert(float_eq(r._m[1] / r._m[3], 1.f, 1e-5f));
+	mat4f_mulvec4f(&r, &m, &(vec4f_t){20, 0, -10, 1});
+	test_assert(float_eq(r._m[0] / r._m[3], 1.f, 1e-5f));
+}
+
+void test_convert_unorm8_strided() {
+	// 20 RGB colours with 4 byte stride, expanded to RGBA
+	unsigned char src[20 * 4];
+	for (int i = 0; i < 20; i++) {
+		src[i * 4 + 0] = (unsigned char)(i * 10);
+		src[i * 4 + 1] = 255;
+		src[i * 4 + 2] = 0;
+		src[i * 4 + 3] = 0xCD;
+	}
+	float dst[20 * 4];
+	agl_convert_to_f32(dst, 4, src, 4, 3, AGL_COMPONENT_TYPE_U8, true, 20);
+	for (int i = 0; i < 20; i++) {
+		test_assert(float_eq(dst[i * 4 + 0], i * 10 / 255.f, 1e-6f));
+		test_assert(float_eq(dst[i * 4 + 1], 1.f, 1e-6f));
+		test_assert(float_eq(dst[i * 4 + 2], 0.f, 1e-6f));
+		test_assert(float_eq(dst[i * 4 + 3], 1.f, 1e-6f));
+	}
+}
+
+void test_convert_snorm16() {
+	short src[19];
+	for (int i = 0; i < 19; i++)
+		src[i] = (short)(-32768 + i * 3641);
+	float dst[19];
+	agl_convert_to_f32(dst, 1, src, sizeof(short), 1, AGL_COMPONENT_TYPE_S16, true, 19);
+	test_assert(float_eq(dst[0], -1.f, 1e-6f));
+	for (int i = 1; i < 19; i++)
+		test_assert(float_eq(dst[i], src[i] / 32767.f, 1e-6f));
+}
+
+void test_convert_half() {
+	// 1.0, -2.0, 0.5, 65504, smallest denormal, 0, -0, +inf, 0.333
+	unsigned short src[9] = { 0x3C00, 0xC000, 0x3800, 0x7BFF, 0x0001, 0x0000, 0x8000, 0x7C00, 0x3555 };
+	float dst[9];
+	agl_convert_to_f32(dst, 1, src, sizeof(unsigned short), 1, AGL_COMPONENT_TYPE_F16, false, 9);
+	test_assert(dst[0] == 1.f);
+	test_assert(dst[1] == -2.f);
+	test_assert(dst[2] == 0.5f);
+	test_assert(dst[3] == 65504.f);
+	test_assert(dst[4] == ldexpf(1.f, -24));
+	test_assert(dst[5] == 0.f);
+	test_assert(dst[6] == 0.f && signbit(dst[6]));
+	test_assert(isinf(dst[7]));
+	test_assert(float_eq(dst[8], 0.333f, 1e-3f));
+}
+
+void test_convert_encode_half() {
+	// 1, -2, 65504, rounds up to +inf, smallest denormal, half of it ties to 0, 1 + 2^-11 ties to even, 1 + 3 * 2^-11
+	// ties up, -0, NaN, then a run long enough for the 8-wide loop
+	float src[27] = { 1.f, -2.f, 65504.f, 65520.f, ldexpf(1.f, -24), ldexpf(1.f, -25), 1.f + ldexpf(1.f, -11),
+		1.f + 3.f * ldexpf(1.f, -11), -0.f, NAN };
+	for (int i = 10; i < 27; i++)
+		src[i] = (float)(i - 18) * 0.37f;
+	unsigned short dst[27];
+	agl_convert_from_f32(dst, sizeof(unsigned short), 1, src, 1, AGL_COMPONENT_TYPE_F16, false, 27);
+	unsigned short expected[9] = { 0x3C00, 0xC000, 0x7BFF, 0x7C00, 0x0001, 0x0000, 0x3C00, 0x3C02, 0x8000 };
+	for (int i = 0; i < 9; i++)
+		test_assert(dst[i] == expected[i]);
+	test_assert((dst[9] & 0x7C00) == 0x7C00 && (dst[9] & 0x03FF) != 0);
+	// Round trip through the decoder within half a half ulp
+	float back[27];
+	agl_convert_to_f32(back, 1, dst, sizeof(unsigned short), 1, AGL_COMPONENT_TYPE_F16, false, 27);
+	for (int i = 10; i < 27; i++)
+		test_assert(fabsf(back[i] - src[i]) <= fabsf(src[i]) * ldexpf(1.f, -11));
+}
+
+void test_convert_encode_norm() {
+	// unorm8 saturates, rounds 127.5 to even and maps NaN to 0
+	float colors[19] = { -0.5f, 0.5f, 1.2f, NAN, 1.f, 0.f };
+	for (int i = 6; i < 19; i++)
+		colors[i] = (float)i / 18.f;
+	unsigned char u8[19];
+	agl_convert_from_f32(u8, 1, 1, colors, 1, AGL_COMPONENT_TYPE_U8, true, 19);
+	test_assert(u8[0] == 0 && u8[1] == 128 && u8[2] == 255 && u8[3] == 0 && u8[4] == 255 && u8[5] == 0);
+	for (int i = 6; i < 19; i++)
+		test_assert(u8[i] == (unsigned char)lrintf(colors[i] * 255.f));
+
+	// snorm stops at -127, plain integers saturate to the type range
+	float values[11] = { -1.5f, -1.f, 1.f, 0.25f, 40000.f, -40000.f, 2.5f, 3.5f, -7.f, 0.f, 1.f };
+	signed char s8[11];
+	short s16[11];
+	unsigned short u16[11];
+	uint32_t u32[11];
+	agl_convert_from_f32(s8, 1, 1, values, 1, AGL_COMPONENT_TYPE_S8, true, 11);
+	test_assert(s8[0] == -127 && s8[1] == -127 && s8[2] == 127 && s8[3] == 32);
+	agl_convert_from_f32(s16, sizeof(short), 1, values, 1, AGL_COMPONENT_TYPE_S16, false, 11);
+	test_assert(s16[4] == 32767 && s16[5] == -32768 && s16[6] == 2 && s16[7] == 4 && s16[8] == -7);
+	agl_convert_from_f32(u16, sizeof(unsigned short), 1, values, 1, AGL_COMPONENT_TYPE_U16, true, 11);
+	test_assert(u16[0] == 0 && u16[2] == 65535 && u16[3] == 16384);
+	values[4] = 5e9f;
+	agl_convert_from_f32(u32, sizeof(uint32_t), 1, values, 1, AGL_COMPONENT_TYPE_U32, false, 11);
+	test_assert(u32[4] == UINT32_MAX && u32[5] == 0 && u32[6] == 2 && u32[8] == 0);
+
+	// RGB to strided RGBA, the missing alpha encodes as 1
+	unsigned char rgba[20 * 8];
+	memset(rgba, 0xCD, sizeof(rgba));
+	float rgb[20 * 3];
+	for (int i = 0; i < 20 * 3; i++)
+		rgb[i] = (float)(i % 7) / 6.f;
+	agl_convert_from_f32(rgba, 8, 4, rgb, 3, AGL_COMPONENT_TYPE_U8, true, 20);
+	for (int i = 0; i < 20; i++) {
+		for (int c = 0; c < 3; c++)
+			test_assert(rgba[i * 8 + c] == (unsigned char)lrintf(rgb[i * 3 + c] * 255.f));
+		test_assert(rgba[i * 8 + 3] == 255 && rgba[i * 8 + 4] == 0xCD);
+	}
+}
+
+void test_convert_indices() {
+	unsigned short src16[21];
+	unsigned char src8[21];
+	for (int i = 0; i < 21; i++) {
+		src16[i] = (unsigned short)(65535 - i);
+		src8[i] = (unsigned char)(255 - i);
+	}
+	uint32_t dst[21];
+	agl_convert_to_u32(dst, src16, sizeof(unsigned short), AGL_COMPONENT_TYPE_U16, 21);
+	for (int i = 0; i < 21; i++)
+		test_assert(dst[i] == 65535u - i);
+	agl_convert_to_u32(dst, src8, 1, AGL_COMPONENT_TYPE_U8, 21);
+	for (int i = 0; i < 21; i++)
+		test_assert(dst[i] == 255u - i);
+}
+
+void test_bounds_minmax3() {
+	// 21 points so both the 8-wide loop and the tail contribute an extreme
+	float points[21 * 3];
+	for (int i = 0; i < 21; i++) {
+		points[i * 3 + 0] = (float)i;
+		points[i * 3 + 1] = (float)(10 - i);
+		points[i * 3 + 2] = (float)((i * 7) % 5) - 2.f;
+	}
+	points[5 * 3 + 2] = 42.f;
+	points[20 * 3 + 2] = -42.f;
+	float lo[3], hi[3];
+	agl_bounds_minmax3(lo, hi, points, 21);
+	test_assert(lo[0] == 0.f && hi[0] == 20.f);
+	test_assert(lo[1] == -10.f && hi[1] == 10.f);
+	test_assert(lo[2] == -42.f && hi[2] == 42.f);
+}
+
+void test_cull_spheres() {
+	// Unit box around the origin, spheres along x from -3 to 3
+	vec4f_t planes[6] = {
+		vec4f( 1, 0, 0, 1), vec4f(-1, 0, 0, 1),
+		vec4f( 0, 1, 0, 1), vec4f( 0,-1, 0, 1),
+		vec4f( 0, 0, 1, 1), vec4f( 0, 0,-1, 1),
+	};
+	float x[13], y[13], z[13], r[13];
+	uint8_t visible[13];
+	for (int i = 0; i < 13; i++) {
+		x[i] = -3.f + 0.5f * i;
+		y[i] = 0.f;
+		z[i] = i == 6 ? 5.f : 0.f; // centre sphere pushed out along z
+		r[i] = 0.75f;
+	}
+	size_t count = agl_cull_spheres(visible, x, y, z, r, 13, planes, 6);
+	size_t expected = 0;
+	for (int i = 0; i < 13; i++) {
+		bool inside = fabsf(x[i]) < 1.75f && z[i] < 1.75f;
+		test_assert(visible[i] == (inside ? 1 : 0));
+		expected += inside;
+	}
+	test_assert(count == expected);
+}
+
+void test_skin_vertices() {
+	// Identity, a translation and a 90 degree turn about z with a scale of 2
+	float palette[3][16] = {
+		{ 1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 },
+		{ 1,0,0,0, 0,1,0,0, 0,0,1,0, 1,2,3,1 },
+		{ 0,2,0,0, -2,0,0,0, 0,0,2,0, 0,0,0,1 },
+	};
+	// 19 vertices so both the 8-wide loop and the tail run
+	float pos[19 * 3], nrm[19 * 3], joints[19 * 4], weights[19 * 4];
+	for (int i = 0; i < 19; i++) {
+		pos[3 * i + 0] = (float)i;
+		pos[3 * i + 1] = (float)(i % 5) - 2.f;
+		pos[3 * i + 2] = 0.5f * (float)(i % 3);
+		nrm[3 * i + 0] = 0.f;
+		nrm[3 * i + 1] = (i & 1) ? 1.f : 0.f;
+		nrm[3 * i + 2] = (i & 1) ? 0.f : 1.f;
+		float w = (float)(i % 4) / 4.f;
+		float j[4] = { (float)(i % 3), (float)((i + 1) % 3), 0.f, i == 17 ? 7.f : 2.f }; // joint 7 clamps to 2
+		float wt[4] = { w, 1.f - w - 0.25f, 0.f, 0.25f };
+		memcpy(joints + 4 * i, j, sizeof(j));
+		memcpy(weights + 4 * i, wt, sizeof(wt));
+	}
+	float outPos[19 * 3], outNrm[19 * 3];
+	agl_skin_vertices(outPos, outNrm, pos, nrm, joints, weights, &palette[0][0], 3, 19);
+	for (int i = 0; i < 19; i++) {
+		float p[3] = { 0, 0, 0 }, n[3] = { 0, 0, 0 };
+		for (int k = 0; k < 4; k++) {
+			int j = (int)joints[4 * i + k];
+			const float *m = palette[j > 2 ? 2 : j];
+			for (int r = 0; r < 3; r++) {
+				p[r] += weights[4 * i + k] * (m[r] * pos[3 * i] + m[4 + r] * pos[3 * i + 1] + m[8 + r] * pos[3 * i + 2] + m[12 + r]);
+				n[r] += weights[4 * i + k] * (m[r] * nrm[3 * i] + m[4 + r] * nrm[3 * i + 1] + m[8 + r] * nrm[3 * i + 2]);
+			}
+		}
+		float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int r = 0; r < 3; r++) {
+			test_assert(float_eq(outPos[3 * i + r], p[r], 1e-4f));
+			test_assert(float_eq(outNrm[3 * i + r], n[r] / len, 1e-4f));
+		}
+	}
+}
+
+// The x8 types need AVX2, main only calls this when the CPU has it
+AGL_TARGET_AVX2 void test_vec3x8_transpose() {
+	float packed[24], back[24];
+	vec3f_t v[8], out[8];
+	for (int i = 0; i < 24; i++)
+		packed[i] = (float)i;
+	for (int i = 0; i < 8; i++)
+		v[i] = vec3f(packed[3 * i], packed[3 * i + 1], packed[3 * i + 2]);
+	vec3x8_t a = vec3x8_load_packed(packed), b = vec3x8_load(v);
+	alignas(32) float x[8], y[8], z[8];
+	_mm256_store_ps(x, a.x); _mm256_store_ps(y, a.y); _mm256_store_ps(z, a.z);
+	for (int i = 0; i < 8; i++)
+		test_assert(x[i] == 3.f * i && y[i] == 3.f * i + 1.f && z[i] == 3.f * i + 2.f);
+	vec3x8_store_packed(back, &b);
+	vec3x8_store(out, &a);
+	for (int i = 0; i < 24; i++)
+		test_assert(back[i] == packed[i]);
+	for (int i = 0; i < 8; i++)
+		test_assert(out[i]._m[0] == v[i]._m[0] && out[i]._m[1] == v[i]._m[1] && out[i]._m[2] == v[i]._m[2] && out[i]._m[3] == 0.f);
+}
+
+AGL_TARGET_AVX2 void test_vec3dx4() {
+	vec3d_t v[4], out[4], origin = vec3d(20000.0, -5000.0, 1e6);
+	vec3f_t rebased[4];
+	for (int i = 0; i < 4; i++)
+		v[i] = vec3d(20000.0 + i * 0.001, -5000.0 - i, 1e6 + i * 1e-3);
+	vec3dx4_t a = vec3dx4_load(v);
+	vec3dx4_t b = vec3dx4_add(&a, &a);
+	b = vec3dx4_sub(&b, &a);
+	b = vec3dx4_scale(&b, _mm256_set1_pd(2.0));
+	vec3dx4_store(out, &b);
+	alignas(32) double dot[4];
+	_mm256_store_pd(dot, vec3dx4_dot(&a, &a));
+	vec3dx4_rebase(rebased, &a, &origin);
+	for (int i = 0; i < 4; i++) {
+		for (int k = 0; k < 3; k++)
+			test_assert(out[i]._m[k] == 2.0 * v[i]._m[k]);
+		test_assert(out[i]._m[3] == 0.0);
+		test_assert(fabs(dot[i] - vec3d_dot(&v[i], &v[i])) <= 1e-15 * dot[i]);
+		vec3f_t expected = vec3d_rebase(&v[i], &origin);
+		test_assert(memcmp(&rebased[i], &expected, sizeof(expected)) == 0);
+	}
+}
+
+AGL_TARGET_AVX2 void test_geometry_x8() {
+	aabbf_t boxes[8];
+	spheref_t spheres[8];
+	vec3f_t corners[24];
+	for (int i = 0; i < 8; i++) {
+		vec3f_t c = vec3f_srand(), e = vec3f_urand();
+		vec3f_scale(&c, 3.f);
+		boxes[i] = (aabbf_t){ vec3f(c._m[0] - e._m[0], c._m[1] - e._m[1], c._m[2] - e._m[2]), vec3f(c._m[0] + e._m[0], c._m[1] + e._m[1], c._m[2] + e._m[2]) };
+		spheres[i] = spheref(c._m[0], c._m[1], c._m[2], e._m[1]);
+		for (int k = 0; k < 3; k++) {
+			corners[8 * k + i] = vec3f_srand();
+			vec3f_add(&corners[8 * k + i], &c);
+		}
+	}
+	aabbx8_t a = aabbx8_load(boxes);
+	spherex8_t s = spherex8_load(spheres);
+	trianglex8_t tri = { vec3x8_load(corners), vec3x8_load(corners + 8), vec3x8_load(corners + 16) };
+	alignas(32) float x[8], r[8];
+	_mm256_store_ps(x, a.max.y);
+	_mm256_store_ps(r, s.r);
+	for (int i = 0; i < 8; i++)
+		test_assert(x[i] == boxes[i].max._m[1] && r[i] == spheres[i]._m[3]);
+	vec4f_t planes[3] = { vec4f(1, 0, 0, 1), vec4f(0, -0.6f, 0.8f, 0.5f), vec4f(0, 0, -1, 2) };
+	for (int q = 0; q < 16; q++) {
+		rayf_t ray = { vec3f_srand(), vec3f_srand() };
+		vec3f_scale(&ray.origin, 4.f);
+		aabbf_t query = { ray.origin, ray.origin };
+		vec3f_add(&query.max, &(vec3f_t){ 1.5f, 1.5f, 1.5f });
+		spheref_t sq = spheref(ray.origin._m[0], ray.origin._m[1], ray.origin._m[2], 1.5f);
+		__m256 tb, ts, tt, tu, tv;
+		unsigned masks[7] = {
+			(unsigned)_mm256_movemask_ps(aabbx8_overlaps(&a, &query)),
+			(unsigned)_mm256_movemask_ps(spherex8_overlaps(&s, &sq)),
+			(unsigned)_mm256_movemask_ps(aabbx8_in_planes(&a, planes, 3)),
+			(unsigned)_mm256_movemask_ps(spherex8_in_planes(&s, planes, 3)),
+			(unsigned)_mm256_movemask_ps(rayf_intersect_aabbx8(&ray, &a, _mm256_set1_ps(6.f), &tb)),
+			(unsigned)_mm256_movemask_ps(rayf_intersect_spherex8(&ray, &s, _mm256_set1_ps(6.f), &ts)),
+			(unsigned)_mm256_movemask_ps(rayf_intersect_trianglex8(&ray, &tri, _mm256_set1_ps(6.f), &tt, &tu, &tv)),
+		};
+		alignas(32) float hb[8], hs[8], ht[8], hu[8], hv[8];
+		_mm256_store_ps(hb, tb); _mm256_store_ps(hs, ts); _mm256_store_ps(ht, tt); _mm256_store_ps(hu, tu); _mm256_store_ps(hv, tv);
+		for (int i = 0; i < 8; i++) {
+			float hit, u, v;
+			test_assert(((masks[0] >> i) & 1) == aabbf_overlaps(&boxes[i], &query));
+			test_assert(((masks[1] >> i) & 1) == spheref_overlaps(&spheres[i], &sq));
+			test_assert(((masks[2] >> i) & 1) == aabbf_in_planes(&boxes[i], planes, 3));
+			test_assert(((masks[3] >> i) & 1) == spheref_in_planes(&spheres[i], planes, 3));
+			bool h = rayf_intersect_aabb(&ray, &boxes[i], 6.f, &hit);
+			test_assert(((masks[4] >> i) & 1) == h && (!h || float_eq(hb[i], hit, 1e-5f)));
+			h = rayf_intersect_sphere(&ray, &spheres[i], 6.f, &hit);
+			test_assert(((masks[5] >> i) & 1) == h && (!h || float_eq(hs[i], hit, 1e-5f)));
+			h = rayf_intersect_triangle(&ray, &corners[i], &corners[8 + i], &corners[16 + i], 6.f, &hit, &u, &v);
+			test_assert(((masks[6] >> i) & 1) == h);
+			test_assert(!h || (float_eq(ht[i], hit, 1e-5f) && float_eq(hu[i], u, 1e-5f) && float_eq(hv[i], v, 1e-5f)));
+		}
+	}
+}
+
+// Every variant must match the SSE2 one on inputs long enough for the 16-wide loops
+void test_kernel_variants(uint32_t features) {
+	enum { N = 203 };
+	static float x[N], y[N], z[N], r[N], points[N * 3], joints[N * 4], weights[N * 4], palette[4][16];
+	static float pos[2][N * 3], nrm[2][N * 3];
+	static uint8_t visible[2][N];
+	static unsigned short half[2][N * 3], unorm16[2][N * 3];
+	static signed char snorm8[2][N * 3];
+	vec4f_t planes[3] = { vec4f(1, 0, 0, 2), vec4f(0, 0.6f, 0.8f, 1), vec4f(-0.8f, 0, -0.6f, 3) };
+	srand(11);
+	for (int i = 0; i < N; i++) {
+		x[i] = (float)(rand() % 1000) / 100.f - 5.f;
+		y[i] = (float)(rand() % 1000) / 100.f - 5.f;
+		z[i] = (float)(rand() % 1000) / 100.f - 5.f;
+		r[i] = (float)(rand() % 100) / 100.f;
+		points[3 * i + 0] = x[i]; points[3 * i + 1] = y[i]; points[3 * i + 2] = z[i];
+		for (int k = 0; k < 4; k++) {
+			joints[4 * i + k] = (float)(rand() % 4);
+			weights[4 * i + k] = 0.25f;
+		}
+	}
+	for (int j = 0; j < 4; j++)
+		for (int k = 0; k < 16; k++)
+			palette[j][k] = (k % 5 == 0) ? 1.f : (float)(rand() % 100) / 100.f;
+	float lo[2][3], hi[2][3];
+	size_t count[2];
+	for (int v = 0; v < 2; v++) {
+		agl_cpu_set_features(v == 0 ? 0 : features);
+		agl_bounds_minmax3(lo[v], hi[v], points, N);
+		count[v] = agl_cull_spheres(visible[v], x, y, z, r, N, planes, 3);
+		agl_skin_vertices(pos[v], nrm[v], points, points, joints, weights, &palette[0][0], 4, N);
+		agl_convert_from_f32(half[v], 2, 1, points, 1, AGL_COMPONENT_TYPE_F16, false, N * 3);
+		agl_convert_from_f32(unorm16[v], 2, 1, points, 1, AGL_COMPONENT_TYPE_U16, true, N * 3);
+		agl_convert_from_f32(snorm8[v], 1, 1, points, 1, AGL_COMPONENT_TYPE_S8, true, N * 3);
+	}
+	test_assert(memcmp(half[0], half[1], sizeof(half[0])) == 0);
+	test_assert(memcmp(unorm16[0], unorm16[1], sizeof(unorm16[0])) == 0);
+	test_assert(memcmp(snorm8[0], snorm8[1], sizeof(snorm8[0])) == 0);
+	test_assert(count[0] == count[1] && memcmp(visible[0], visible[1], N) == 0);
+	for (int k = 0; k < 3; k++)
+		test_assert(lo[0][k] == lo[1][k] && hi[0][k] == hi[1][k]);
+	for (int i = 0; i < N * 3; i++) {
+		test_assert(float_eq(pos[0][i], pos[1][i], 1e-5f));
+		test_assert(float_eq(nrm[0][i], nrm[1][i], 1e-5f));
+	}
+}
+
+void test_vec3_kernels() {
+	// 19 elements so both the 8-wide loop and the tail run, each result is checked against the scalar function
+	vec3f_t a[19], b[19], r[19];
+	quatf_t q[19];
+	float dot[19];
+	mat3f_t m = mat3f(1, 2, 3, -1, 0.5f, 2, 0, 4, -2);
+	srand(3);
+	for (int i = 0; i < 19; i++) {
+		a[i] = vec3f_srand();
+		b[i] = vec3f_srand();
+		vec3f_t axis = vec3f_srand();
+		vec3f_normalize(&axis);
+		quatf_fromaxisangle(&q[i], &axis, (float)i * 0.3f);
+	}
+	agl_vec3_add(r, a, b, 19);
+	for (int i = 0; i < 19; i++) {
+		vec3f_t e = a[i];
+		vec3f_add(&e, &b[i]);
+		for (int k = 0; k < 3; k++)
+			test_assert(float_eq(r[i]._m[k], e._m[k], 1e-6f));
+	}
+	agl_vec3_scale(r, a, -2.5f, 19);
+	for (int i = 0; i < 19; i++) {
+		for (int k = 0; k < 3; k++)
+			test_assert(float_eq(r[i]._m[k], a[i]._m[k] * -2.5f, 1e-6f));
+	}
+	agl_vec3_dot(dot, a, b, 19);
+	for (int i = 0; i < 19; i++)
+		test_assert(float_eq(dot[i], vec3f_dot(&a[i], &b[i]), 1e-6f));
+	agl_vec3_cross(r, a, b, 19);
+	for (int i = 0; i < 19; i++) {
+		vec3f_t e;
+		vec3f_cross(&e, &a[i], &b[i]);
+		for (int k = 0; k < 3; k++)
+			test_assert(float_eq(r[i]._m[k], e._m[k], 1e-6f));
+	}
+	agl_vec3_normalize(r, a, 19);
+	for (int i = 0; i < 19; i++) {
+		vec3f_t e = a[i];
+		vec3f_normalize(&e);
+		for (int k = 0; k < 3; k++)
+			test_assert(float_eq(r[i]._m[k], e._m[k], 1e-6f));
+	}
+	agl_quat_apply(r, q, a, 19);
+	for (int i = 0; i < 19; i++) {
+		vec3f_t e;
+		quatf_apply(&e, &q[i], &a[i]);
+		for (int k = 0; k < 3; k++)
+			test_assert(float_eq(r[i]._m[k], e._m[k], 1e-5f));
+	}
+	agl_mat3_mulvec3(r, &m, a, 19);
+	for (int i = 0; i < 19; i++) {
+		vec3f_t e;
+		mat3f_mulvec3f(&e, &m, &a[i]);
+		for (int k = 0; k < 3; k++)
+			test_assert(float_eq(r[i]._m[k], e._m[k], 1e-5f));
+	}
+	// In place
+	memcpy(r, a, sizeof(a));
+	agl_vec3_add(a, a, b, 19);
+	for (int i = 0; i < 19; i++) {
+		for (int k = 0; k < 3; k++)
+			test_assert(a[i]._m[k] == r[i]._m[k] + b[i]._m[k]);
+	}
+}
+
+// A millimetre 30 km out survives rebasing, where float world positions would round it away
+void test_vec3d() {
+	vec3d_t p = vec3d(30000.0015, -12000.25, 0.5), origin = vec3d(30000.0, -12000.0, 0.0);
+	vec3f_t r = vec3d_rebase(&p, &origin);
+	test_assert(float_eq(r._m[0], 0.0015f, 1e-7f) && r._m[1] == -0.25f && r._m[2] == 0.5f && r._m[3] == 0.f);
+	test_assert((float)p._m[0] - (float)origin._m[0] != r._m[0]);
+	vec3d_t d = p;
+	vec3d_sub(&d, &origin);
+	vec3d_scale(&d, 2.0);
+	vec3d_addscaled(&d, &origin, 1.0);
+	test_assert(fabs(d._m[0] - 30000.003) < 1e-9 && d._m[1] == -12000.5 && d._m[2] == 1.0);
+	d = vec3d(3.0, 4.0, 12.0);
+	test_assert(vec3d_len(&d) == 13.0 && vec3d_dot(&d, &p) == 3.0 * p._m[0] + 4.0 * p._m[1] + 6.0);
+
+	vec3d_t camera = vec3d(100.0, 0.0, 0.0), center = vec3d(0.0, 0.0, 0.0);
+	test_assert(!vec3d_recenter(&center, &camera, 500.0) && center._m[0] == 0.0);
+	camera._m[0] = 600.0;
+	test_assert(vec3d_recenter(&center, &camera, 500.0) && center._m[0] == 600.0);
+}
+
+void test_geometry() {
+	mat4f_t proj;
+	vec4f_t planes[6];
+	mat4f_perspective(&proj, 1.2f, 1.5f, 0.1f, 100.f);
+	mat4f_frustum_planes(planes, &proj);
+	vec3f_t ahead = vec3f(0, 0, -10), behind = vec3f(0, 0, 10);
+	for (int i = 0; i < 6; i++) {
+		test_assert(float_eq(vec3f_len(&(vec3f_t){ planes[i]._m[0], planes[i]._m[1], planes[i]._m[2] }), 1.f, 1e-5f));
+		test_assert(planef_distance(&planes[i], &ahead) > 0.f);
+	}
+	test_assert(planef_distance(&planes[4], &behind) < 0.f);
+	test_assert(float_eq(planef_distance(&planes[4], &(vec3f_t){ 0, 0, -0.1f }), 0.f, 1e-5f));
+
+	aabbf_t a = { vec3f(0, 0, 0), vec3f(1, 1, 1) }, b = { vec3f(1, 0.5f, -1), vec3f(2, 2, 0) }, c = { vec3f(1.5f, 0, 0), vec3f(2, 1, 1) };
+	test_assert(aabbf_overlaps(&a, &b) && aabbf_overlaps(&b, &a)); // touching faces
+	test_assert(!aabbf_overlaps(&a, &c));
+	test_assert(aabbf_contains(&a, &(vec3f_t){ 1, 0.5f, 0 }) && !aabbf_contains(&a, &(vec3f_t){ 1.01f, 0.5f, 0 }));
+	spheref_t s = spheref(0, 0, 3, 1), t = spheref(0, 2, 3, 1);
+	test_assert(spheref_overlaps(&s, &t) && !spheref_overlaps(&s, &spheref(0, 2.1f, 3, 1)));
+	test_assert(aabbf_overlaps_sphere(&a, &spheref(0.5f, 0.5f, 0.5f, 0.1f)));
+	test_assert(aabbf_overlaps_sphere(&a, &spheref(2, 2, 0.5f, 1.42f)));
+	test_assert(!aabbf_overlaps_sphere(&a, &spheref(2, 2, 0.5f, 1.41f)));
+	aabbf_t far = { vec3f(-1, -1, -101), vec3f(1, 1, -100.5f) }, side = { vec3f(50, -1, -11), vec3f(52, 1, -9) };
+	test_assert(!aabbf_in_planes(&a, planes, 6) && !aabbf_in_planes(&far, planes, 6));
+	test_assert(aabbf_in_planes(&(aabbf_t){ vec3f(-1, -1, -11), vec3f(1, 1, -9) }, planes, 6) && !aabbf_in_planes(&side, planes, 6));
+	test_assert(spheref_in_planes(&spheref(0, 0, -5, 0.5f), planes, 6) && !spheref_in_planes(&s, planes, 6));
+
+	float hit, u, v;
+	rayf_t ray = { vec3f(-1, 0.5f, 0.5f), vec3f(2, 0, 0) };
+	test_assert(rayf_intersect_aabb(&ray, &a, 10.f, &hit) && hit == 0.5f);
+	test_assert(!rayf_intersect_aabb(&ray, &a, 0.25f, &hit));
+	test_assert(rayf_intersect_aabb(&ray, &c, 10.f, &hit) && hit == 1.25f);
+	ray.origin = vec3f(0.5f, 0.5f, 0.5f);
+	test_assert(rayf_intersect_aabb(&ray, &a, 10.f, &hit) && hit == 0.f);
+	ray.dir = vec3f(-1, 0, 0);
+	test_assert(!rayf_intersect_aabb(&ray, &c, 10.f, &hit));
+	// Along the faces the ray doesn't move through, including the zero over zero slabs
+	ray = (rayf_t){ vec3f(0, 1, -2), vec3f(0, 0, 1) };
+	test_assert(rayf_intersect_aabb(&ray, &a, 10.f, &hit) && hit == 2.f);
+	ray.origin = vec3f(1.001f, 1, -2);
+	test_assert(!rayf_intersect_aabb(&ray, &a, 10.f, &hit));
+
+	ray = (rayf_t){ vec3f(0, 0, 0), vec3f(0, 0, 2) };
+	test_assert(rayf_intersect_sphere(&ray, &s, 10.f, &hit) && float_eq(hit, 1.f, 1e-6f));
+	test_assert(!rayf_intersect_sphere(&ray, &s, 0.9f, &hit));
+	test_assert(rayf_intersect_sphere(&(rayf_t){ vec3f(0, 0, 3.5f), vec3f(1, 0, 0) }, &s, 10.f, &hit) && hit == 0.f);
+	test_assert(!rayf_intersect_sphere(&(rayf_t){ vec3f(0, 0, 5), vec3f(0, 0, 1) }, &s, 10.f, &hit));
+	test_assert(!rayf_intersect_sphere(&(rayf_t){ vec3f(0, 1.01f, 0), vec3f(0, 0, 1) }, &s, 10.f, &hit));
+
+	vec3f_t p0 = vec3f(0, 0, 5), p1 = vec3f(4, 0, 5), p2 = vec3f(0, 2, 5);
+	ray = (rayf_t){ vec3f(1, 0.5f, 0), vec3f(0, 0, 1) };
+	test_assert(rayf_intersect_triangle(&ray, &p0, &p1, &p2, 10.f, &hit, &u, &v));
+	test_assert(float_eq(hit, 5.f, 1e-6f) && float_eq(u, 0.25f, 1e-6f) && float_eq(v, 0.25f, 1e-6f));
+	test_assert(rayf_intersect_triangle(&ray, &p0, &p2, &p1, 10.f, &hit, NULL, NULL) && float_eq(hit, 5.f, 1e-6f));
+	test_assert(!rayf_intersect_triangle(&ray, &p0, &p1, &p2, 4.f, &hit, NULL, NULL));
+	ray.origin = vec3f(3, 1, 0);
+	test_assert(!rayf_intersect_triangle(&ray, &p0, &p1, &p2, 10.f, &hit, NULL, NULL));
+	ray = (rayf_t){ vec3f(-1, 0.5f, 5), vec3f(1, 0, 0) }; // in the plane of the triangle
+	test_assert(!rayf_intersect_triangle(&ray, &p0, &p1, &p2, 10.f, &hit, NULL, NULL));
+}
+
+// Random boxes, spheres and triangles around the origin, 21 of each so the wide loops and the tails both run. Every
+// kernel is checked against the single item tests.
+void test_geometry_kernels() {
+	enum { N = 21 };
+	aabbf_t boxes[N];
+	spheref_t spheres[N];
+	float positions[3 * N * 3];
+	uint32_t indices[3 * N], found[N];
+	for (int i = 0; i < N; i++) {
+		vec3f_t c = vec3f_srand(), e = vec3f_urand();
+		vec3f_scale(&c, 4.f);
+		boxes[i] = (aabbf_t){ vec3f(c._m[0] - e._m[0], c._m[1] - e._m[1], c._m[2] - e._m[2]), vec3f(c._m[0] + e._m[0], c._m[1] + e._m[1], c._m[2] + e._m[2]) };
+		spheres[i] = spheref(c._m[0], c._m[1], c._m[2], e._m[0]);
+		for (int k = 0; k < 3; k++) {
+			vec3f_t p = vec3f_srand();
+			positions[9 * i + 3 * k + 0] = c._m[0] + p._m[0] * e._m[0];
+			positions[9 * i + 3 * k + 1] = c._m[1] + p._m[1] * e._m[1];
+			positions[9 * i + 3 * k + 2] = c._m[2] + p._m[2] * e._m[2];
+			indices[3 * (N - 1 - i) + k] = (uint32_t)(3 * i + k); // reversed triangle order
+		}
+	}
+	mat4f_t proj, view, viewProj;
+	vec4f_t planes[6];
+	mat4f_perspective(&proj, 1.f, 1.f, 0.5f, 20.f);
+	mat4f_fromtrs(&view, &(vec3f_t){ 0, 0, -6 }, &(quatf_t){ 0, 0, 0, 1 }, &(vec3f_t){ 1, 1, 1 });
+	mat4f_mul(&viewProj, &proj, &view);
+	mat4f_frustum_planes(planes, &viewProj);
+	uint8_t visible[N];
+	size_t count = agl_cull_aabbs(visible, boxes, N, planes, 6), expected = 0;
+	for (int i = 0; i < N; i++) {
+		test_assert(visible[i] == (aabbf_in_planes(&boxes[i], planes, 6) ? 1 : 0));
+		expected += visible[i];
+	}
+	test_assert(count == expected && count > 0 && count < N);
+
+	size_t boxHits = 0, triangleHits = 0, overlaps = 0;
+	for (int r = 0; r < 16; r++) {
+		// Aimed at the centroid of triangle r, which is inside box r, except for one axis aligned ray
+		rayf_t ray = { vec3f_srand(), vec3f(0, 0, 1) };
+		vec3f_scale(&ray.origin, 6.f);
+		if (r > 0) {
+			for (int k = 0; k < 3; k++)
+				ray.dir._m[k] = (positions[9 * r + k] + positions[9 * r + 3 + k] + positions[9 * r + 6 + k]) / 3.f - ray.origin._m[k];
+		}
+		float t[N], hit;
+		size_t hits = agl_ray_aabbs(t, &ray, boxes, N, 8.f);
+		expected = 0;
+		for (int i = 0; i < N; i++) {
+			bool h = rayf_intersect_aabb(&ray, &boxes[i], 8.f, &hit);
+			test_assert(h ? float_eq(t[i], hit, 1e-5f) : t[i] == INFINITY);
+			expected += h;
+		}
+		test_assert(hits == expected);
+		boxHits += hits;
+
+		float best = INFINITY, tri = INFINITY;
+		uint32_t bestIndex = 0, triangle = 0, triangleIndexed = 0;
+		for (int i = 0; i < N; i++) {
+			vec3f_t *p = (vec3f_t[3]){ vec3f(positions[9 * i], positions[9 * i + 1], positions[9 * i + 2]),
+				vec3f(positions[9 * i + 3], positions[9 * i + 4], positions[9 * i + 5]), vec3f(positions[9 * i + 6], positions[9 * i + 7], positions[9 * i + 8]) };
+			if (rayf_intersect_triangle(&ray, &p[0], &p[1], &p[2], 8.f, &hit, NULL, NULL) && hit < best) {
+				best = hit;
+				bestIndex = (uint32_t)i;
+			}
+		}
+		bool any = agl_ray_triangles(&tri, &triangle, &ray, positions, NULL, N, 8.f);
+		test_assert(any == (best != INFINITY));
+		triangleHits += any;
+		if (any)
+			test_assert(triangle == bestIndex && float_eq(tri, best, 1e-5f));
+		any = agl_ray_triangles(&tri, &triangleIndexed, &ray, positions, indices, N, 8.f);
+		test_assert(any == (best != INFINITY));
+		if (any)
+			test_assert(triangleIndexed == N - 1 - bestIndex && float_eq(tri, best, 1e-5f));
+
+		aabbf_t query = { ray.origin, ray.origin };
+		vec3f_sub(&query.min, &(vec3f_t){ 2, 2, 2 });
+		vec3f_add(&query.max, &(vec3f_t){ 2, 2, 2 });
+		count = agl_overlap_aabbs(found, &query, boxes, N);
+		expected = 0;
+		for (int i = 0; i < N; i++) {
+			if (aabbf_overlaps(&boxes[i], &query))
+				test_assert(expected < count && found[expected++] == (uint32_t)i);
+		}
+		test_assert(count == expected);
+		spheref_t sq = spheref(ray.origin._m[0], ray.origin._m[1], ray.origin._m[2], 2.f);
+		count = agl_overlap_spheres(found, &sq, spheres, N);
+		expected = 0;
+		for (int i = 0; i < N; i++) {
+			if (spheref_overlaps(&spheres[i], &sq))
+				test_assert(expected < count && found[expected++] == (uint32_t)i);
+		}
+		test_assert(count == expected);
+		overlaps += count;
+	}
+	test_assert(boxHits >= 15 && triangleHits >= 15 && overlaps > 0);
+}
+
+// 19 elements of each double kernel against the scalar functions, all exact
+void test_vec3d_kernels() {
+	vec3d_t p[19], q[19], origin = vec3d(-40000.125, 8000.5, 123456.75);
+	vec3f_t v[19], r[19];
+	mat4f_t m[19], out[19];
+	for (int i = 0; i < 19; i++) {
+		vec3f_t u = vec3f_srand();
+		p[i] = vec3d(origin._m[0] + u._m[0] * 3000.0, origin._m[1] - u._m[1] * 1e-3, 1e7 * u._m[2]);
+		v[i] = vec3f_srand();
+		for (int c = 0; c < 4; c++)
+			for (int k = 0; k < 4; k++)
+				m[i]._m[c][k] = (float)(c * 4 + k + i);
+	}
+	agl_vec3d_rebase(r, p, &origin, 19);
+	for (int i = 0; i < 19; i++) {
+		vec3f_t expected = vec3d_rebase(&p[i], &origin);
+		test_assert(memcmp(&r[i], &expected, sizeof(expected)) == 0);
+	}
+	memcpy(q, p, sizeof(p));
+	agl_vec3d_integrate(q, v, 1.f / 60.f, 19);
+	for (int i = 0; i < 19; i++) {
+		for (int k = 0; k < 3; k++)
+			test_assert(q[i]._m[k] == p[i]._m[k] + (double)v[i]._m[k] * (double)(1.f / 60.f));
+		test_assert(q[i]._m[3] == p[i]._m[3]);
+	}
+	agl_mat4_rebase(out, m, p, &origin, 19);
+	agl_mat4_rebase(m, m, p, &origin, 19);
+	for (int i = 0; i < 19; i++) {
+		vec3f_t t = vec3d_rebase(&p[i], &origin);
+		for (int c = 0; c < 3; c++)
+			for (int k = 0; k < 4; k++)
+				test_assert(out[i]._m[c][k] == (float)(c * 4 + k + i));
+		test_assert(out[i]._m[3][0] == t._m[0] && out[i]._m[3][1] == t._m[1] && out[i]._m[3][2] == t._m[2]);
+		test_assert(out[i]._m[3][3] == 1.f);
+		test_assert(memcmp(&out[i], &m[i], sizeof(mat4f_t)) == 0);
+	}
+}
+
+void test_mat4_kernels() {
+	// 19 elements so both the 8-wide loop and the tail run, checked against mat4f_mulvec4f
+	vec3f_t a[19], r[19];
+	vec4f_t clip[19];
+	float packed[19 * 3];
+	mat4f_t m, proj, mvp;
+	quatf_t q;
+	vec3f_t axis = vec3f(1, 2, -1);
+	vec3f_normalize(&axis);
+	quatf_fromaxisangle(&q, &axis, 0.7f);
+	mat4f_fromtrs(&m, &(vec3f_t){1, -2, -8}, &q, &(vec3f_t){1.5f, 0.5f, 2});
+	mat4f_perspective(&proj, 1.f, 1.5f, 0.1f, 50.f);
+	mat4f_mul(&mvp, &proj, &m);
+	srand(5);
+	for (int i = 0; i < 19; i++) {
+		a[i] = vec3f_srand();
+		for (int k = 0; k < 3; k++)
+			packed[3 * i + k] = a[i]._m[k];
+	}
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 0)
+			agl_mat4_transform_points(r, &m, a, 19);
+		else
+			agl_mat4_transform_vectors(r, &m, a, 19);
+		for (int i = 0; i < 19; i++) {
+			vec4f_t e;
+			mat4f_mulvec4f(&e, &m, &(vec4f_t){a[i]._m[0], a[i]._m[1], a[i]._m[2], pass == 0 ? 1.f : 0.f});
+			for (int k = 0; k < 3; k++)
+				test_assert(float_eq(r[i]._m[k], e._m[k], 1e-5f));
+			test_assert(r[i]._m[3] == 0.f);
+		}
+	}
+	agl_mat4_project_points(clip, &mvp, packed, 19);
+	for (int i = 0; i < 19; i++) {
+		vec4f_t e;
+		mat4f_mulvec4f(&e, &mvp, &(vec4f_t){a[i]._m[0], a[i]._m[1], a[i]._m[2], 1.f});
+		for (int k = 0; k < 4; k++)
+			test_assert(float_eq(clip[i]._m[k], e._m[k], 1e-5f));
+	}
+}
+
+#define PARITY_COUNT 1000
+
+static quatf_t random_quat() {
+	vec3f_t axis = vec3f_srand();
+	quatf_t q;
+	vec3f_normalize(&axis);
+	quatf_fromaxisangle(&q, &axis, (float)rand() / (float)RAND_MAX * 6.2831853f);
+	return q;
+}
+
+static void assert_lanes(__m128 v, const float *expected, int lanes, float eps) {
+	alignas(16) float r[4];
+	_mm_store_ps(r, v);
+	for (int k = 0; k < lanes; k++)
+		test_assert(float_eq(r[k], expected[k], eps));
+}
+
+// Every SIMD operation against its scalar reference on random inputs
+void test_vecv_parity() {
+	srand(11);
+	for (int i = 0; i < PARITY_COUNT; i++) {
+		vec3f_t a = vec3f_srand(), b = vec3f_srand();
+		vec3f_scale(&a, 10.f);
+		vec3v_t va = vec3v_load(a._m), vb = vec3v_load(b._m), r;
+		vec3f_t e;
+
+		vec3f_add2(&e, &a, &b);
+		assert_lanes(vec3v_add(&va, &vb)._m, e._m, 3, 1e-5f);
+		vec3f_sub2(&e, &a, &b);
+		assert_lanes(vec3v_sub(&va, &vb)._m, e._m, 3, 1e-5f);
+		vec3f_mul2(&e, &a, &b);
+		assert_lanes(vec3v_mul(&va, &vb)._m, e._m, 3, 1e-5f);
+		e = a;
+		vec3f_scale(&e, 0.25f);
+		assert_lanes(vec3v_scale(&va, 0.25f)._m, e._m, 3, 1e-5f);
+
+		float dot = vec3f_dot(&a, &b);
+		float dots[4] = { dot, dot, dot, 0.f };
+		test_assert(float_eq(vec3v_dot(&va, &vb), dot, 1e-4f));
+		vec3v_dot3(&va, &vb, &r);
+		assert_lanes(r._m, dots, 4, 1e-4f);
+
+		vec3f_cross(&e, &a, &b);
+		e._m[3] = 0.f;
+		vec3v_cross(&va, &vb, &r);
+		assert_lanes(r._m, e._m, 4, 1e-4f);
+		vec4v_t ra;
+		vec4f_t a4 = vec4f(a._m[0], a._m[1], a._m[2], 3.f), b4 = vec4f(b._m[0], b._m[1], b._m[2], -2.f);
+		vec4v_t va4 = vec4v_load(a4._m), vb4 = vec4v_load(b4._m);
+		vec4v_cross(&va4, &vb4, &ra);
+		assert_lanes(ra._m, e._m, 4, 1e-4f);
+		float dot4 = dot - 6.f;
+		float dots4[4] = { dot4, dot4, dot4, dot4 }, dot4x[4] = { dot4, 0.f, 0.f, 0.f };
+		vec4v_dot4(&va4, &vb4, &ra);
+		assert_lanes(ra._m, dots4, 4, 1e-4f);
+		vec4v_dot(&va4, &vb4, &ra);
+		assert_lanes(ra._m, dot4x, 4, 1e-4f);
+
+		e = a;
+		vec3f_normalize(&e);
+		assert_lanes(vec3v_normalize(&va)._m, e._m, 3, 1e-6f);
+
+		mat3f_t m;
+		quatf_t mq = random_quat();
+		mat3f_fromquat(&m, &mq);
+		m._m[1][2] += 0.5f;
+		mat3f_mulvec3f(&e, &m, &a);
+		e._m[3] = 0.f;
+		assert_lanes(mat3f_mulvec3v(&m, &va)._m, e._m, 4, 1e-4f);
+
+		quatf_t p = random_quat(), q = random_quat(), pq;
+		quatv_t vp = quatv_load(p._m), vq = quatv_load(q._m);
+		quatf_mul2(&pq, &p, &q);
+		assert_lanes(quatv_mul(&vp, &vq)._m, pq._m, 4, 1e-5f);
+		quatf_t qc = q;
+		quatf_inv(&qc);
+		quatv_t vqc;
+		quatv_conjugate(&vq, &vqc);
+		assert_lanes(vqc._m, qc._m, 4, 0.f);
+
+		quatf_apply(&e, &q, &a);
+		e._m[3] = 0.f;
+		assert_lanes(quatv_apply(&vq, &va)._m, e._m, 4, 1e-4f);
+
+		quatf_t scaled = q;
+		for (int k = 0; k < 4; k++)
+			scaled._m[k] *= 3.f;
+		quatv_t vs = quatv_load(scaled._m);
+		assert_lanes(quatv_normalize(&vs)._m, q._m, 4, 1e-6f);
+
+		// Round trip through axis-angle, with w >= 0 so the angle is in [0, pi]
+		if (q._m[3] < 0.f) {
+			for (int k = 0; k < 4; k++)
+				q._m[k] = -q._m[k];
+		}
+		vq = quatv_load(q._m);
+		vec4v_t aa = quatv_to_axis_angle(&vq);
+		quatv_t back = quatv_from_axis_angle(&aa);
+		assert_lanes(back._m, q._m, 4, 1e-3f);
+		alignas(16) float axisangle[4];
+		_mm_store_ps(axisangle, aa._m);
+		vec3f_t axis = vec3f(axisangle[0], axisangle[1], axisangle[2]);
+		quatf_t ref;
+		quatf_fromaxisangle(&ref, &axis, axisangle[3]);
+		assert_lanes(back._m, ref._m, 4, 1e-5f);
+	}
+}
+
+// Prints the cost of the SIMD quaternion rotation and normalization against the scalar references
+static bool mat4_eq(const mat4f_t *a, const mat4f_t *b, float eps) {
+	for (int c = 0; c < 4; c++)
+		for (int k = 0; k < 4; k++)
+			if (!float_eq(a->_m[c][k], b->_m[c][k], eps))
+				return false;
+	return true;
+}
+
+// The mat4v_t operations against mat4f_t references on random transforms
+void test_mat4v_parity() {
+	mat4f_t identity;
+	mat4f_identity(&identity);
+	srand(13);
+	for (int i = 0; i < PARITY_COUNT; i++) {
+		vec3f_t t = vec3f_srand(), s = vec3f_urand();
+		vec3f_scale(&t, 10.f);
+		vec3f_add(&s, &(vec3f_t){0.5f, 0.5f, 0.5f});
+		quatf_t q = random_quat(), q2 = random_quat();
+		mat4f_t ma, mb, e, r;
+		mat4f_fromtrs(&ma, &t, &q, &s);
+		mat4f_fromtrs(&mb, &s, &q2, &(vec3f_t){1, 1, 1});
+		vec3v_t vt = vec3v_load(t._m), vs = vec3v_load(s._m), tr, sr;
+		quatv_t vq = quatv_load(q._m), qr;
+		mat4v_t va = mat4v_from_trs(&vt, &vq, &vs), vb = mat4v_load(&mb);
+		mat4v_store(&va, &r);
+		test_assert(mat4_eq(&r, &ma, 1e-5f));
+
+		mat4v_t vm = mat4v_mul(&va, &vb);
+		mat4f_mul(&e, &ma, &mb);
+		mat4v_store(&vm, &r);
+		test_assert(mat4_eq(&r, &e, 1e-4f));
+		vm = mat4v_transpose(&va);
+		mat4v_store(&vm, &r);
+		e = ma;
+		mat4f_transpose(&e);
+		test_assert(mat4_eq(&r, &e, 1e-5f));
+
+		vec4f_t p = vec4f(1.f, -2.f, 3.f, 1.f), pe;
+		mat4f_mulvec4f(&pe, &ma, &p);
+		vec4v_t vp = vec4v_load(p._m);
+		assert_lanes(mat4v_mulvec4v(&va, &vp)._m, pe._m, 4, 1e-4f);
+		vec3v_t v3 = vec3v_load(p._m);
+		assert_lanes(mat4v_transform_point(&va, &v3)._m, pe._m, 3, 1e-4f);
+		p._m[3] = 0.f;
+		mat4f_mulvec4f(&pe, &ma, &p);
+		assert_lanes(mat4v_transform_vector(&va, &v3)._m, pe._m, 3, 1e-4f);
+
+		// Both inverses undo the transform, the rigid one only without scale
+		vm = mat4v_inverse_affine(&va);
+		vm = mat4v_mul(&vm, &va);
+		mat4v_store(&vm, &r);
+		test_assert(mat4_eq(&r, &identity, 1e-4f));
+		vm = mat4v_inverse_rigid(&vb);
+		vm = mat4v_mul(&vb, &vm);
+		mat4v_store(&vm, &r);
+		test_assert(mat4_eq(&r, &identity, 1e-4f));
+
+		mat4v_to_trs(&va, &tr, &qr, &sr);
+		assert_lanes(tr._m, t._m, 4, 1e-5f);
+		assert_lanes(sr._m, s._m, 4, 1e-4f);
+		alignas(16) float qa[4];
+		_mm_store_ps(qa, qr._m);
+		float d = qa[0] * q._m[0] + qa[1] * q._m[1] + qa[2] * q._m[2] + qa[3] * q._m[3];
+		test_assert(float_eq(fabsf(d), 1.f, 1e-4f));
+	}
+	// A mirror in y comes back as a negative x scale with a half turn about z
+	mat4v_t mirror = mat4v_from_trs(&(vec3v_t){ _mm_setzero_ps() }, &(quatv_t){ _mm_set_ps(1.f, 0.f, 0.f, 0.f) },
+		&(vec3v_t){ _mm_set_ps(0.f, 1.f, -1.f, 2.f) });
+	vec3v_t tr, sr;
+	quatv_t qr;
+	mat4v_to_trs(&mirror, &tr, &qr, &sr);
+	assert_lanes(sr._m, (const float[]){ -2.f, 1.f, 1.f, 0.f }, 4, 1e-6f);
+	assert_lanes(_mm_mul_ps(qr._m, qr._m), (const float[]){ 0.f, 0.f, 1.f, 0.f }, 4, 1e-6f);
+}
+
+// Distance in representable floats between a and the correctly rounded reference
+static double ulp_error(float a, double reference) {
+	float r = (float)reference;
+	int32_t ia, ir;
+	memcpy(&ia, &a, sizeof(ia));
+	memcpy(&ir, &r, sizeof(ir));
+	int64_t oa = ia < 0 ? (int64_t)INT32_MIN - ia : ia, or = ir < 0 ? (int64_t)INT32_MIN - ir : ir;
+	return fabs((double)(oa - or));
+}
+
+enum { APPROX_SIN, APPROX_COS, APPROX_ACOS, APPROX_EXP, APPROX_LOG, APPROX_RSQRT, APPROX_SQRT, APPROX_COUNT };
+
+static const struct { float lo, hi, ulps; } approx_ranges[APPROX_COUNT] = {
+	{ -3.14159265f, 3.14159265f, 2 }, { -3.14159265f, 3.14159265f, 2 }, { -1.f, 1.f, 2 },
+	{ -87.f, 88.f, 2 }, { 1e-30f, 1e30f, 2 }, { 1e-30f, 1e30f, 4 }, { 1e-30f, 1e30f, 4 },
+};
+
+static double approx_reference(int f, double x) {
+	switch (f) {
+	case APPROX_SIN: return sin(x);
+	case APPROX_COS: return cos(x);
+	case APPROX_ACOS: return acos(x);
+	case APPROX_EXP: return exp(x);
+	case APPROX_LOG: return log(x);
+	case APPROX_RSQRT: return 1.0 / sqrt(x);
+	default: return sqrt(x);
+	}
+}
+
+static __m128 approx4(int f, __m128 x) {
+	switch (f) {
+	case APPROX_SIN: return agl_sin4(x);
+	case APPROX_COS: return agl_cos4(x);
+	case APPROX_ACOS: return agl_acos4(x);
+	case APPROX_EXP: return agl_exp4(x);
+	case APPROX_LOG: return agl_log4(x);
+	case APPROX_RSQRT: return agl_rsqrt4(x);
+	default: return agl_sqrt4(x);
+	}
+}
+
+static AGL_TARGET_AVX2 void approx8(int f, float *r, const float *x) {
+	__m256 v = _mm256_loadu_ps(x);
+	switch (f) {
+	case APPROX_SIN: v = agl_sin8(v); break;
+	case APPROX_COS: v = agl_cos8(v); break;
+	case APPROX_ACOS: v = agl_acos8(v); break;
+	case APPROX_EXP: v = agl_exp8(v); break;
+	case APPROX_LOG: v = agl_log8(v); break;
+	case APPROX_RSQRT: v = agl_rsqrt8(v); break;
+	default: v = agl_sqrt8(v); break;
+	}
+	_mm256_storeu_ps(r, v);
+}
+
+static AGL_TARGET_AVX2 void atan2_8(float *r, const float *y, const float *x) {
+	_mm256_storeu_ps(r, agl_atan2_8(_mm256_loadu_ps(y), _mm256_loadu_ps(x)));
+}
+
+// The error bounds documented in agl_math.h, over evenly spaced inputs
+void test_approx(bool avx2) {
+	enum { N = 1 << 18 };
+	for (int f = 0; f < APPROX_COUNT; f++) {
+		float lo = approx_ranges[f].lo, hi = approx_ranges[f].hi;
+		for (int i = 0; i < N; i += 8) {
+			float x[8], r[8];
+			for (int k = 0; k < 8; k++)
+				x[k] = lo + (hi - lo) * (float)(i + k) / (float)(N - 1);
+			if (avx2) {
+				approx8(f, r, x);
+			} else {
+				_mm_storeu_ps(r, approx4(f, _mm_loadu_ps(x)));
+				_mm_storeu_ps(r + 4, approx4(f, _mm_loadu_ps(x + 4)));
+			}
+			for (int k = 0; k < 8; k++)
+				test_assert(ulp_error(r[k], approx_reference(f, x[k])) <= approx_ranges[f].ulps);
+		}
+	}
+	// Far from the origin sin and cos keep a small absolute error
+	for (int i = 0; i < N; i += 4) {
+		float x[4], s[4], c[4];
+		for (int k = 0; k < 4; k++)
+			x[k] = -8192.f + 16384.f * (float)(i + k) / (float)(N - 1);
+		__m128 vs, vc;
+		agl_sincos4(_mm_loadu_ps(x), &vs, &vc);
+		_mm_storeu_ps(s, vs);
+		_mm_storeu_ps(c, vc);
+		for (int k = 0; k < 4; k++)
+			test_assert(fabs(s[k] - sin(x[k])) < 1e-7 && fabs(c[k] - cos(x[k])) < 1e-7);
+	}
+	for (int i = 0; i < 512; i++) {
+		for (int j = 0; j < 512; j += 8) {
+			float y[8], x[8], r[8];
+			for (int k = 0; k < 8; k++) {
+				y[k] = -10.f + 20.f * (float)i / 511.f;
+				x[k] = -10.f + 20.f * (float)(j + k) / 511.f;
+			}
+			if (avx2) {
+				atan2_8(r, y, x);
+			} else {
+				_mm_storeu_ps(r, agl_atan2_4(_mm_loadu_ps(y), _mm_loadu_ps(x)));
+				_mm_storeu_ps(r + 4, agl_atan2_4(_mm_loadu_ps(y + 4), _mm_loadu_ps(x + 4)));
+			}
+			for (int k = 0; k < 8; k++)
+				test_assert(ulp_error(r[k], atan2(y[k], x[k])) <= 3);
+		}
+	}
+	float edge[4];
+	_mm_storeu_ps(edge, agl_exp4(_mm_set_ps(-100.f, 100.f, 0.f, -0.f)));
+	test_assert(edge[0] == 1.f && edge[1] == 1.f && edge[2] == INFINITY && edge[3] == 0.f);
+	// The smallest input of the gaussian fill
+	_mm_storeu_ps(edge, agl_log4(_mm_set_ps(0.5f, 2.f, 1.f, 1.f / 16777216.f)));
+	test_assert(float_eq(edge[0], -16.6355323f, 1e-5f) && edge[1] == 0.f);
+	_mm_storeu_ps(edge, agl_sqrt4(_mm_set_ps(0.f, 4.f, 1.f, 0.f)));
+	test_assert(edge[0] == 0.f && edge[3] == 0.f);
+	_mm_storeu_ps(edge, agl_atan2_4(_mm_setzero_ps(), _mm_setzero_ps()));
+	test_assert(edge[0] == 0.f);
+}
+
+// Uniforms in range with the right mean, points on or inside the unit sphere, gaussians with the requested moments
+void test_rng() {
+	enum { N = 100003 };
+	static float u[N], g[N];
+	static vec3f_t p[N];
+	agl_rng_t rng;
+	agl_rng_seed(&rng, 1);
+	agl_rng_fill_float(&rng, u, N, -2.f, 6.f);
+	double sum = 0.0;
+	for (int i = 0; i < N; i++) {
+		test_assert(u[i] >= -2.f && u[i] < 6.f);
+		sum += u[i];
+	}
+	test_assert(fabs(sum / N - 2.0) < 0.05);
+
+	agl_rng_fill_gaussian(&rng, g, N, 3.f, 0.5f);
+	double mean = 0.0, var = 0.0;
+	for (int i = 0; i < N; i++)
+		mean += g[i];
+	mean /= N;
+	for (int i = 0; i < N; i++)
+		var += (g[i] - mean) * (g[i] - mean);
+	var /= N - 1;
+	test_assert(fabs(mean - 3.0) < 0.01 && fabs(var - 0.25) < 0.01);
+
+	agl_rng_fill_in_cube(&rng, p, N);
+	sum = 0.0;
+	for (int i = 0; i < N; i++) {
+		for (int k = 0; k < 3; k++)
+			test_assert(p[i]._m[k] >= -1.f && p[i]._m[k] < 1.f);
+		sum += p[i]._m[0] + p[i]._m[1] + p[i]._m[2];
+	}
+	test_assert(fabs(sum / N) < 0.02);
+
+	agl_rng_fill_on_sphere(&rng, p, N);
+	double centroid[3] = { 0.0, 0.0, 0.0 };
+	for (int i = 0; i < N; i++) {
+		test_assert(float_eq(vec3f_len(&p[i]), 1.f, 1e-5f));
+		for (int k = 0; k < 3; k++)
+			centroid[k] += p[i]._m[k];
+	}
+	for (int k = 0; k < 3; k++)
+		test_assert(fabs(centroid[k] / N) < 0.01);
+
+	// The cube of the radius is uniform for points uniform in the ball
+	agl_rng_fill_in_sphere(&rng, p, N);
+	sum = 0.0;
+	for (int i = 0; i < N; i++) {
+		float r = vec3f_len(&p[i]);
+		test_assert(r <= 1.f + 1e-5f);
+		sum += (double)r * r * r;
+	}
+	test_assert(fabs(sum / N - 0.5) < 0.01);
+
+	// The same seed gives the same sequence, and calls that end mid-block continue from the next one
+	float a[13], b[16];
+	agl_rng_seed(&rng, 42);
+	agl_rng_fill_float(&rng, a, 5, 0.f, 1.f);
+	agl_rng_fill_float(&rng, a + 5, 8, 0.f, 1.f);
+	agl_rng_seed(&rng, 42);
+	agl_rng_fill_float(&rng, b, 16, 0.f, 1.f);
+	test_assert(memcmp(a, b, 5 * sizeof(float)) == 0 && memcmp(a + 5, b + 8, 8 * sizeof(float)) == 0);
+}
+
+// Every variant draws the same numbers from the same seed
+void test_rng_variants(uint32_t features) {
+	enum { N = 37 };
+	float u[2][N], g[2][N];
+	vec3f_t cube[2][N], ball[2][N], dir[2][N];
+	for (int v = 0; v < 2; v++) {
+		agl_cpu_set_features(v == 0 ? 0 : features);
+		agl_rng_t rng;
+		agl_rng_seed(&rng, 99);
+		agl_rng_fill_float(&rng, u[v], N, 0.f, 1.f);
+		agl_rng_fill_gaussian(&rng, g[v], N, 0.f, 1.f);
+		agl_rng_fill_in_cube(&rng, cube[v], N);
+		agl_rng_fill_in_sphere(&rng, ball[v], N);
+		agl_rng_fill_on_sphere(&rng, dir[v], N);
+	}
+	test_assert(memcmp(u[0], u[1], sizeof(u[0])) == 0);
+	for (int i = 0; i < N; i++) {
+		test_assert(float_eq(g[0][i], g[1][i], 1e-5f));
+		for (int k = 0; k < 3; k++) {
+			test_assert(float_eq(cube[0][i]._m[k], cube[1][i]._m[k], 1e-6f));
+			test_assert(float_eq(ball[0][i]._m[k], ball[1][i]._m[k], 1e-5f));
+			test_assert(float_eq(dir[0][i]._m[k], dir[1][i]._m[k], 1e-5f));
+		}
+	}
+}
+
+void test_quat_builders() {
+	// 19 elements so both the 8-wide loop and the tail run, with parallel, opposite and along z pairs among them
+	vec3f_t axis[19], a[19], b[19];
+	float angle[19];
+	quatf_t q[19];
+	srand(17);
+	for (int i = 0; i < 19; i++) {
+		axis[i] = vec3f_srand();
+		vec3f_normalize(&axis[i]);
+		angle[i] = (float)rand() / (float)RAND_MAX * 20.f - 10.f;
+		a[i] = vec3f_srand();
+		b[i] = vec3f_srand();
+	}
+	b[3] = a[3];
+	vec3f_scale(&b[3], 2.f);
+	b[9] = a[9];
+	vec3f_scale(&b[9], -0.5f);
+	a[17] = vec3f(0, 0, 3);
+	b[17] = vec3f(0, 0, -1);
+	agl_quat_from_axis_angle(q, axis, angle, 19);
+	for (int i = 0; i < 19; i++) {
+		quatf_t e;
+		quatf_fromaxisangle(&e, &axis[i], angle[i]);
+		for (int k = 0; k < 4; k++)
+			test_assert(float_eq(q[i]._m[k], e._m[k], 1e-5f));
+	}
+	agl_quat_from_vectors(q, a, b, 19);
+	for (int i = 0; i < 19; i++) {
+		// The rotation, not the quaternion, is compared: opposite pairs may pick another axis
+		vec3f_t u = a[i], v = b[i], r;
+		vec3f_normalize(&u);
+		vec3f_normalize(&v);
+		quatf_apply(&r, &q[i], &u);
+		for (int k = 0; k < 3; k++)
+			test_assert(float_eq(r._m[k], v._m[k], 1e-3f));
+		test_assert(float_eq(quatf_len(&q[i]), 1.f, 1e-5f));
+		quatf_t e;
+		quatf_fromvectors(&e, &a[i], &b[i]);
+		if (i != 9 && i != 17) {
+			for (int k = 0; k < 4; k++)
+				test_assert(float_eq(q[i]._m[k], e._m[k], 1e-3f));
+		}
+	}
+}
+
+void bench_approx() {
+	enum { N = 4096 };
+	static float x[N], s[N], c[N];
+	static vec3f_t axis[N];
+	static quatf_t q[N];
+	for (int i = 0; i < N; i++) {
+		x[i] = (float)rand() / (float)RAND_MAX * 12.f - 6.f;
+		axis[i] = vec3f_srand();
+		vec3f_normalize(&axis[i]);
+	}
+	const int rounds = 500;
+	clock_t t0 = clock();
+	for (int r = 0; r < rounds; r++) {
+		x[r & (N - 1)] += 1e-3f;
+		for (int i = 0; i < N; i++) {
+			s[i] = sinf(x[i]);
+			c[i] = cosf(x[i]);
+		}
+	}
+	clock_t t1 = clock();
+	for (int r = 0; r < rounds; r++) {
+		x[r & (N - 1)] += 1e-3f;
+		agl_sincos(s, c, x, N);
+	}
+	clock_t t2 = clock();
+	for (int r = 0; r < rounds; r++) {
+		x[r & (N - 1)] += 1e-3f;
+		for (int i = 0; i < N; i++)
+			quatf_fromaxisangle(&q[i], &axis[i], x[i]);
+	}
+	clock_t t3 = clock();
+	for (int r = 0; r < rounds; r++) {
+		x[r & (N - 1)] += 1e-3f;
+		agl_quat_from_axis_angle(q, axis, x, N);
+	}
+	clock_t t4 = clock();
+	double ns = 1e9 / CLOCKS_PER_SEC / (rounds * (double)N);
+	printf("sincos: libm %.2f ns, agl_sincos %.2f ns\n", (t1 - t0) * ns, (t2 - t1) * ns);
+	printf("quat from axis angle: scalar %.2f ns, agl_quat_from_axis_angle %.2f ns\n", (t3 - t2) * ns, (t4 - t3) * ns);
+}
+
+void bench_rebase() {
+	enum { N = 4096 };
+	static vec3d_t p[N];
+	static vec3f_t r[N];
+	vec3d_t origin = vec3d(25000.0, 0.0, -25000.0);
+	for (int i = 0; i < N; i++) {
+		vec3f_t u = vec3f_srand();
+		p[i] = vec3d(25000.0 + u._m[0] * 1000.0, u._m[1] * 100.0, -25000.0 + u._m[2] * 1000.0);
+	}
+	const int rounds = 500;
+	clock_t t0 = clock();
+	for (int k = 0; k < rounds; k++) {
+		origin._m[1] += 1e-3;
+		for (int i = 0; i < N; i++)
+			r[i] = vec3d_rebase(&p[i], &origin);
+	}
+	clock_t t1 = clock();
+	for (int k = 0; k < rounds; k++) {
+		origin._m[1] += 1e-3;
+		agl_vec3d_rebase(r, p, &origin, N);
+	}
+	clock_t t2 = clock();
+	double ns = 1e9 / CLOCKS_PER_SEC / (rounds * (double)N);
+	printf("vec3d rebase: scalar %.2f ns, agl_vec3d_rebase %.2f ns\n", (t1 - t0) * ns, (t2 - t1) * ns);
+}
+
+// Rays against 4096 boxes and closest hits against 4096 triangles, scalar and batched, which must agree
+void bench_geometry() {
+	enum { N = 4096, RAYS = 500 };
+	static aabbf_t boxes[N];
+	static float t[N], positions[9 * N];
+	static rayf_t rays[RAYS];
+	for (int i = 0; i < N; i++) {
+		vec3f_t c = vec3f_srand(), e = vec3f_urand();
+		vec3f_scale(&c, 20.f);
+		boxes[i] = (aabbf_t){ vec3f(c._m[0] - e._m[0], c._m[1] - e._m[1], c._m[2] - e._m[2]), vec3f(c._m[0] + e._m[0], c._m[1] + e._m[1], c._m[2] + e._m[2]) };
+		for (int k = 0; k < 9; k++)
+			positions[9 * i + k] = c._m[k % 3] + 2.f * (float)rand() / (float)RAND_MAX;
+	}
+	// Rays start inside the scene so they cross some of the boxes and triangles on the way out
+	for (int r = 0; r < RAYS; r++) {
+		rays[r].origin = vec3f_srand();
+		vec3f_scale(&rays[r].origin, 20.f);
+		rays[r].dir = vec3f_srand();
+		vec3f_normalize(&rays[r].dir);
+	}
+	const float tmax = 80.f;
+	size_t scalarHits = 0, hits = 0, scalarTriangleHits = 0, triangleHits = 0;
+	clock_t t0 = clock();
+	for (int r = 0; r < RAYS; r++) {
+		for (int i = 0; i < N; i++) {
+			float hit;
+			bool h = rayf_intersect_aabb(&rays[r], &boxes[i], tmax, &hit);
+			t[i] = h ? hit : INFINITY;
+			scalarHits += h;
+		}
+	}
+	clock_t t1 = clock();
+	for (int r = 0; r < RAYS; r++)
+		hits += agl_ray_aabbs(t, &rays[r], boxes, N, tmax);
+	clock_t t2 = clock();
+	for (int r = 0; r < RAYS; r++) {
+		float best = tmax, hit;
+		bool found = false;
+		for (int i = 0; i < N; i++) {
+			const vec3f_t a = vec3f(positions[9 * i], positions[9 * i + 1], positions[9 * i + 2]);
+			const vec3f_t b = vec3f(positions[9 * i + 3], positions[9 * i + 4], positions[9 * i + 5]);
+			const vec3f_t c = vec3f(positions[9 * i + 6], positions[9 * i + 7], positions[9 * i + 8]);
+			if (rayf_intersect_triangle(&rays[r], &a, &b, &c, best, &hit, NULL, NULL)) {
+				best = hit;
+				found = true;
+			}
+		}
+		scalarTriangleHits += found;
+	}
+	clock_t t3 = clock();
+	for (int r = 0; r < RAYS; r++) {
+		float best;
+		uint32_t triangle;
+		triangleHits += agl_ray_triangles(&best, &triangle, &rays[r], positions, NULL, N, tmax);
+	}
+	clock_t t4 = clock();
+	test_assert(hits == scalarHits);
+	test_assert(triangleHits == scalarTriangleHits);
+	double ns = 1e9 / CLOCKS_PER_SEC / (RAYS * (double)N);
+	printf("ray vs aabb: scalar %.2f ns, agl_ray_aabbs %.2f ns (%zu hits), "
+		"ray vs triangle: scalar %.2f ns, agl_ray_triangles %.2f ns (%zu of %d rays hit)\n",
+		(t1 - t0) * ns, (t2 - t1) * ns, hits, (t3 - t2) * ns, (t4 - t3) * ns, triangleHits, (int)RAYS);
+}
+
+// Throughput of the half and unorm8 conversions on the SSE2 path and the best one
+void bench_convert() {
+	enum { N = 1 << 16 };
+	static float src[N], back[N];
+	static unsigned short half[N];
+	static unsigned char unorm[N];
+	agl_rng_fill_float(agl_rng_thread(), src, N, -100.f, 100.f);
+	const int rounds = 200;
+	for (int v = 0; v < 2; v++) {
+		uint32_t features = agl_cpu_set_features(v == 0 ? 0 : ~0u);
+		clock_t t0 = clock();
+		for (int r = 0; r < rounds; r++)
+			agl_convert_from_f32(half, 2, 1, src, 1, AGL_COMPONENT_TYPE_F16, false, N);
+		clock_t t1 = clock();
+		for (int r = 0; r < rounds; r++)
+			agl_convert_to_f32(back, 1, half, 2, 1, AGL_COMPONENT_TYPE_F16, false, N);
+		clock_t t2 = clock();
+		for (int r = 0; r < rounds; r++)
+			agl_convert_from_f32(unorm, 1, 1, src, 1, AGL_COMPONENT_TYPE_U8, true, N);
+		clock_t t3 = clock();
+		double gbs = (double)rounds * N * sizeof(float) * CLOCKS_PER_SEC / 1e9;
+		printf("convert (features 0x%x): f32->f16 %.1f GB/s, f16->f32 %.1f GB/s, f32->unorm8 %.1f GB/s\n", features,
+			gbs / (double)(t1 - t0 + 1), gbs / (double)(t2 - t1 + 1), gbs / (double)(t3 - t2 + 1));
+	}
+}
+
+void bench_rng() {
+	enum { N = 4096 };
+	static float u[N];
+	static vec3f_t p[N];
+	const int rounds = 500;
+	clock_t t0 = clock();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < N; i++)
+			u[i] = (float)rand() / (float)RAND_MAX;
+	}
+	clock_t t1 = clock();
+	for (int r = 0; r < rounds; r++)
+		agl_rng_fill_float(agl_rng_thread(), u, N, 0.f, 1.f);
+	clock_t t2 = clock();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < N; i++)
+			p[i] = vec3f_srand();
+	}
+	clock_t t3 = clock();
+	for (int r = 0; r < rounds; r++)
+		agl_rng_fill_in_cube(agl_rng_thread(), p, N);
+	clock_t t4 = clock();
+	double ns = 1e9 / CLOCKS_PER_SEC / (rounds * (double)N);
+	printf("uniform float: rand %.2f ns, agl_rng_fill_float %.2f ns\n", (t1 - t0) * ns, (t2 - t1) * ns);
+	printf("vec3 in cube: vec3f_srand %.2f ns, agl_rng_fill_in_cube %.2f ns\n", (t3 - t2) * ns, (t4 - t3) * ns);
+}
+
+// Plain C linear blend skinning, the baseline for bench_skinning
+static void skin_scalar(float *dstPos, float *dstNrm, const float *pos, const float *nrm, const float *joints, const float *weights,
+	const float *palette, int count) {
+	for (int i = 0; i < count; i++) {
+		float p[3] = { 0, 0, 0 }, n[3] = { 0, 0, 0 };
+		for (int k = 0; k < 4; k++) {
+			const float *m = palette + 16 * (int)joints[4 * i + k];
+			float w = weights[4 * i + k];
+			for (int r = 0; r < 3; r++) {
+				p[r] += w * (m[r] * pos[3 * i] + m[4 + r] * pos[3 * i + 1] + m[8 + r] * pos[3 * i + 2] + m[12 + r]);
+				if (nrm)
+					n[r] += w * (m[r] * nrm[3 * i] + m[4 + r] * nrm[3 * i + 1] + m[8 + r] * nrm[3 * i + 2]);
+			}
+		}
+		memcpy(dstPos + 3 * i, p, sizeof(p));
+		if (nrm) {
+			float inv = 1.f / sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int r = 0; r < 3; r++)
+				dstNrm[3 * i + r] = n[r] * inv;
+		}
+	}
+}
+
+// Hundreds of characters sharing one mesh, each with its own palette, as a crowd would be skinned on the CPU
+void bench_skinning() {
+	enum { CHARACTERS = 300, VERTICES = 8000, JOINTS = 64 };
+	float *pos = malloc(VERTICES * 3 * sizeof(float)), *nrm = malloc(VERTICES * 3 * sizeof(float));
+	float *joints = malloc(VERTICES * 4 * sizeof(float)), *weights = malloc(VERTICES * 4 * sizeof(float));
+	float *outPos = malloc(VERTICES * 3 * sizeof(float)), *outNrm = malloc(VERTICES * 3 * sizeof(float));
+	float *palettes = malloc(CHARACTERS * JOINTS * 16 * sizeof(float));
+	agl_rng_fill_float(agl_rng_thread(), pos, VERTICES * 3, -1.f, 1.f);
+	agl_rng_fill_float(agl_rng_thread(), nrm, VERTICES * 3, -1.f, 1.f);
+	agl_rng_fill_float(agl_rng_thread(), palettes, CHARACTERS * JOINTS * 16, -1.f, 1.f);
+	for (int i = 0; i < VERTICES * 4; i++) {
+		joints[i] = (float)(agl_rng_u32(agl_rng_thread()) % JOINTS);
+		weights[i] = 0.25f;
+	}
+	double mverts = (double)CHARACTERS * VERTICES / 1e6;
+	for (int normals = 0; normals < 2; normals++) {
+		const float *srcNrm = normals ? nrm : NULL;
+		float *dstNrm = normals ? outNrm : NULL;
+		clock_t t0 = clock();
+		for (int c = 0; c < CHARACTERS; c++)
+			skin_scalar(outPos, dstNrm, pos, srcNrm, joints, weights, palettes + c * JOINTS * 16, VERTICES);
+		clock_t t1 = clock();
+		agl_cpu_set_features(0);
+		for (int c = 0; c < CHARACTERS; c++)
+			agl_skin_vertices(outPos, dstNrm, pos, srcNrm, joints, weights, palettes + c * JOINTS * 16, JOINTS, VERTICES);
+		clock_t t2 = clock();
+		uint32_t features = agl_cpu_set_features(~0u);
+		for (int c = 0; c < CHARACTERS; c++)
+			agl_skin_vertices(outPos, dstNrm, pos, srcNrm, joints, weights, palettes + c * JOINTS * 16, JOINTS, VERTICES);
+		clock_t t3 = clock();
+		printf("skinning %s (%d characters x %d vertices, %d joints): scalar %.1f M/s, sse2 %.1f M/s, features 0x%x %.1f M/s\n",
+			normals ? "positions+normals" : "positions", CHARACTERS, VERTICES, JOINTS,
+			mverts * CLOCKS_PER_SEC / (double)(t1 - t0 + 1), mverts * CLOCKS_PER_SEC / (double)(t2 - t1 + 1), features,
+			mverts * CLOCKS_PER_SEC / (double)(t3 - t2 + 1));
+	}
+	free(pos);
+	free(nrm);
+	free(joints);
+	free(weights);
+	free(outPos);
+	free(outNrm);
+	free(palettes);
+}
+
+void bench_vecv() {
+	static vec3f_t v[1024], out[1024];
+	static quatf_t q[1024];
+	for (int i = 0; i < 1024; i++) {
+		v[i] = vec3f_srand();
+		q[i] = random_quat();
+	}
+	const int rounds = 2000;
+	clock_t t0 = clock();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < 1024; i++)
+			quatf_apply(&out[i], &q[(i + r) & 1023], &v[i]);
+	}
+	clock_t t1 = clock();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < 1024; i++) {
+			quatv_t vq = quatv_load(q[(i + r) & 1023]._m);
+			vec3v_t vv = vec3v_load(v[i]._m);
+			vec3v_t res = quatv_apply(&vq, &vv);
+			vec3v_store(&res, out[i]._m);
+		}
+	}
+	clock_t t2 = clock();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < 1024; i++) {
+			out[i] = v[(i + r) & 1023];
+			vec3f_normalize(&out[i]);
+		}
+	}
+	clock_t t3 = clock();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < 1024; i++) {
+			vec3v_t vv = vec3v_load(v[(i + r) & 1023]._m);
+			vec3v_t res = vec3v_normalize(&vv);
+			vec3v_store(&res, out[i]._m);
+		}
+	}
+	clock_t t4 = clock();
+	double ns = 1e9 / CLOCKS_PER_SEC / (rounds * 1024.0);
+	printf("quat apply: scalar %.2f ns, simd %.2f ns\n", (t1 - t0) * ns, (t2 - t1) * ns);
+	printf("vec3 normalize: scalar %.2f ns, simd %.2f ns\n", (t3 - t2) * ns, (t4 - t3) * ns);
 }
 
 int main() {
@@ -162,6 +1616,55 @@ int main() {
 	test_mat3f_mulvec3f();
 	test_vec3f_mulmat3f();
 	test_mat3f_fromquat();
+	test_mat4f_fromtrs();
+	test_mat4f_perspective();
+	test_vec3d();
+	test_geometry();
+	// The kernel tests run once for each variant the CPU supports, from the SSE2 baseline up
+	uint32_t detected = agl_cpu_features();
+	uint32_t variants[3] = { 0, AGL_CPU_FEATURE_AVX2_BIT, AGL_CPU_FEATURE_AVX2_BIT | AGL_CPU_FEATURE_AVX512_BIT };
+	for (int v = 0; v < 3; v++) {
+		if ((detected & variants[v]) != variants[v])
+			continue;
+		test_assert(agl_cpu_set_features(variants[v]) == variants[v]);
+		test_convert_unorm8_strided();
+		test_convert_snorm16();
+		test_convert_half();
+		test_convert_encode_half();
+		test_convert_encode_norm();
+		test_convert_indices();
+		test_bounds_minmax3();
+		test_cull_spheres();
+		test_geometry_kernels();
+		test_skin_vertices();
+		test_vec3_kernels();
+		test_mat4_kernels();
+		test_vec3d_kernels();
+		test_quat_builders();
+		test_rng();
+		if (v > 0) {
+			test_kernel_variants(variants[v]);
+			test_rng_variants(variants[v]);
+		}
+	}
+	test_assert(agl_cpu_set_features(~0u) == detected);
+	printf("cpu features: 0x%x\n", detected);
+	test_approx(false);
+	if (detected & AGL_CPU_FEATURE_AVX2_BIT) {
+		test_vec3x8_transpose();
+		test_vec3dx4();
+		test_geometry_x8();
+		test_approx(true);
+	}
+	test_vecv_parity();
+	test_mat4v_parity();
+	bench_vecv();
+	bench_skinning();
+	bench_approx();
+	bench_rng();
+	bench_convert();
+	bench_rebase();
+	bench_geometry();
 	return 0;
 }
 
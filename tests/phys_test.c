@@ -0,0 +1,654 @@
+#include "agl_phys.h"
+#include "agl_math.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// agl_math_assert compiles out without _DEBUG, the checks here run in every configuration
+#define test_assert(cond) do { if (!(cond)) { fprintf(stderr, "(%s:%d) Assertion failed: %s\n", __FILE__, __LINE__, #cond); abort(); } } while (0)
+
+static agl_phys_particles_t *make_particles(uint32_t capacity, agl_phys_integrator_t integrator, float drag) {
+	agl_phys_particles_params_t params = { capacity, NULL, { 0.f, -9.81f, 0.f }, drag, integrator };
+	return agl_phys_particles_create(&params);
+}
+
+// Spawning stops at the capacity, kills and compaction swap the last particle into the freed slot
+void test_particles_lifetime() {
+	agl_phys_particles_t *p = make_particles(13, AGL_PHYS_INTEGRATOR_EULER, 0.f);
+	test_assert(p->capacity == 16);
+	test_assert(agl_phys_particles_storage_size(13) == 16 * 9 * sizeof(float));
+	test_assert((char*)p->size - (char*)p->storage == (ptrdiff_t)agl_phys_particles_stream_offset(13, AGL_PHYS_STREAM_SIZE));
+	test_assert((char*)p->color - (char*)p->storage == (ptrdiff_t)agl_phys_particles_stream_offset(13, AGL_PHYS_STREAM_COLOR));
+
+	agl_phys_particle_t src[20];
+	for (int i = 0; i < 20; i++)
+		src[i] = (agl_phys_particle_t){ { (float)i, 0.f, 0.f }, { 0.f, 0.f, 0.f }, (i % 3) ? 10.f : 0.5f, 1.f, (uint32_t)i };
+	test_assert(agl_phys_particles_spawn(p, src, 20) == 16);
+	test_assert(p->count == 16);
+
+	agl_phys_particles_kill(p, 2);
+	test_assert(p->count == 15);
+	test_assert(p->color[2] == 15 && p->x[2] == 15.f);
+
+	// Particles 0, 3, 6, 9, 12 and 15 expire, leaving the others in some order
+	test_assert(agl_phys_particles_update(p, 1.f) == 6);
+	test_assert(p->count == 9);
+	uint32_t seen = 0;
+	for (uint32_t i = 0; i < p->count; i++) {
+		test_assert(p->color[i] % 3 != 0 && p->life[i] > 0.f);
+		test_assert(p->x[i] == (float)p->color[i]);
+		seen |= 1u << p->color[i];
+	}
+	test_assert(seen == 0x6DB2); // 1, 4, 5, 7, 8, 10, 11, 13, 14
+	agl_phys_particles_destroy(p);
+}
+
+// Under gravity alone Verlet lands on the parabola, semi-implicit Euler drifts by g * dt * t / 2
+void test_particles_integrators() {
+	const float dt = 1.f / 64.f, v0 = 5.f;
+	const int steps = 64;
+	agl_phys_particles_t *euler = make_particles(37, AGL_PHYS_INTEGRATOR_EULER, 0.f);
+	agl_phys_particles_t *verlet = make_particles(37, AGL_PHYS_INTEGRATOR_VERLET, 0.f);
+	agl_phys_particle_t src = { { 0.f, 0.f, 0.f }, { 1.f, v0, 0.f }, 100.f, 1.f, 0xFFFFFFFF };
+	for (int i = 0; i < 37; i++) {
+		agl_phys_particles_spawn(euler, &src, 1);
+		agl_phys_particles_spawn(verlet, &src, 1);
+	}
+	for (int s = 0; s < steps; s++) {
+		agl_phys_particles_update(euler, dt);
+		agl_phys_particles_update(verlet, dt);
+	}
+	float t = steps * dt;
+	float y = v0 * t - 0.5f * 9.81f * t * t;
+	for (int i = 0; i < 37; i++) {
+		test_assert(float_eq(verlet->y[i], y, 1e-4f));
+		test_assert(float_eq(verlet->x[i], t, 1e-5f));
+		test_assert(float_eq(verlet->vy[i], v0 - 9.81f * t, 1e-4f));
+		test_assert(float_eq(euler->y[i], y - 0.5f * 9.81f * dt * t, 1e-4f));
+		test_assert(float_eq(euler->life[i], 99.f, 1e-4f));
+	}
+	agl_phys_particles_destroy(euler);
+	agl_phys_particles_destroy(verlet);
+
+	// Drag alone decays the velocity exponentially
+	agl_phys_particles_t *drag = make_particles(8, AGL_PHYS_INTEGRATOR_EULER, 2.f);
+	drag->gravity[1] = 0.f;
+	agl_phys_particles_spawn(drag, &src, 1);
+	for (int s = 0; s < steps; s++)
+		agl_phys_particles_update(drag, dt);
+	test_assert(float_eq(drag->vy[0], v0 * expf(-2.f * t), 1e-4f));
+	agl_phys_particles_destroy(drag);
+}
+
+// Integrating in uneven ranges gives the same result as one call, and caller storage is used in place
+void test_particles_ranges() {
+	enum { N = 1003 };
+	static float storage[(N + 7) / 8 * 8 * 9];
+	agl_phys_particles_params_t params = { N, storage, { 0.f, -9.81f, 0.f }, 0.1f, AGL_PHYS_INTEGRATOR_VERLET };
+	agl_phys_particles_t *a = agl_phys_particles_create(&params);
+	agl_phys_particles_t *b = make_particles(N, AGL_PHYS_INTEGRATOR_VERLET, 0.1f);
+	test_assert(a->x == storage);
+	agl_phys_emitter_t emitter = { { 1.f, 2.f, 3.f }, 0.5f, { 0.f, 4.f, 0.f }, 1.f, 1.f, 2.f, 0.25f, 0xFF0000FF };
+	test_assert(agl_phys_particles_emit(a, &emitter, N) == N);
+	for (uint32_t i = 0; i < N; i++) {
+		float dx = a->x[i] - 1.f, dy = a->y[i] - 2.f, dz = a->z[i] - 3.f;
+		test_assert(dx * dx + dy * dy + dz * dz <= 0.25f + 1e-5f);
+		test_assert(a->life[i] >= 1.f && a->life[i] < 2.f);
+	}
+	memcpy(b->storage, a->storage, agl_phys_particles_storage_size(N));
+	b->count = a->count;
+	agl_phys_particles_integrate(a, 0, 5, 0.1f);
+	agl_phys_particles_integrate(a, 5, 500, 0.1f);
+	agl_phys_particles_integrate(a, 505, 1000, 0.1f);
+	agl_phys_particles_integrate(b, 0, N, 0.1f);
+	test_assert(memcmp(a->storage, b->storage, agl_phys_particles_storage_size(N)) == 0);
+	agl_phys_particles_destroy(a);
+	agl_phys_particles_destroy(b);
+	test_assert(storage[0] != 0.f);
+}
+
+void bench_particles() {
+	enum { N = 1 << 20 };
+	agl_phys_particles_t *p = make_particles(N, AGL_PHYS_INTEGRATOR_VERLET, 0.1f);
+	agl_phys_emitter_t emitter = { { 0.f, 0.f, 0.f }, 1.f, { 0.f, 10.f, 0.f }, 3.f, 1e3f, 2e3f, 0.1f, 0xFFFFFFFF };
+	agl_phys_particles_emit(p, &emitter, N);
+	const int frames = 50;
+	clock_t t0 = clock();
+	for (int f = 0; f < frames; f++)
+		agl_phys_particles_update(p, 1.f / 60.f);
+	clock_t t1 = clock();
+	// Kill a percent of the particles per frame, refilled by the emitter
+	for (int f = 0; f < frames; f++) {
+		for (uint32_t i = f; i < p->count; i += 100)
+			p->life[i] = 0.f;
+		agl_phys_particles_update(p, 1.f / 60.f);
+		agl_phys_particles_emit(p, &emitter, N - p->count);
+	}
+	clock_t t2 = clock();
+	double ms = 1e3 / CLOCKS_PER_SEC / frames;
+	printf("particles (%d): update %.2f ms, update with 1%% respawned %.2f ms\n", N, (t1 - t0) * ms, (t2 - t1) * ms);
+	agl_phys_particles_destroy(p);
+}
+
+static agl_phys_world_t *make_world(uint32_t maxBodies, uint32_t threads, agl_phys_broadphase_t broadphase) {
+	agl_phys_world_params_t params = { maxBodies, vec3f(0.f, -9.81f, 0.f), threads, 0, 0.f, broadphase };
+	agl_phys_world_t *w = agl_phys_world_create(&params);
+	agl_phys_body_desc_t ground = { .shape = AGL_PHYS_SHAPE_BOX, .halfExtents = vec3f(50.f, 1.f, 50.f), .pos = vec3f(0.f, -1.f, 0.f),
+		.rot = quatf(0.f, 0.f, 0.f, 1.f), .friction = 0.6f };
+	agl_phys_body_create(w, &ground);
+	return w;
+}
+
+static uint32_t add_body(agl_phys_world_t *w, agl_phys_shape_t shape, vec3f_t halfExtents, vec3f_t pos, quatf_t rot) {
+	agl_phys_body_desc_t desc = { .shape = shape, .halfExtents = halfExtents, .pos = pos, .rot = rot, .mass = 1.f, .friction = 0.6f };
+	return agl_phys_body_create(w, &desc);
+}
+
+// A dropped sphere comes to rest on the ground and falls asleep, and the slot of a destroyed body is reused
+void test_rigid_sphere_rest(agl_phys_broadphase_t broadphase) {
+	agl_phys_world_t *w = make_world(3, 1, broadphase);
+	uint32_t ball = add_body(w, AGL_PHYS_SHAPE_SPHERE, vec3f(0.5f, 0.f, 0.f), vec3f(0.f, 2.f, 0.f), quatf(0.f, 0.f, 0.f, 1.f));
+	test_assert(ball == 1);
+	for (int s = 0; s < 240; s++)
+		agl_phys_world_step(w, 1.f / 60.f);
+	vec3f_t pos;
+	agl_phys_body_get_transform(w, ball, &pos, NULL);
+	test_assert(fabsf(pos._m[1] - 0.5f) < 0.02f);
+	test_assert(fabsf(pos._m[0]) < 1e-4f && fabsf(pos._m[2]) < 1e-4f);
+	test_assert(agl_phys_body_is_sleeping(w, ball));
+	agl_phys_world_stats_t stats;
+	agl_phys_world_get_stats(w, &stats);
+	test_assert(stats.bodies == 2 && stats.awakeBodies == 0 && stats.manifolds == 1);
+
+	test_assert(add_body(w, AGL_PHYS_SHAPE_SPHERE, vec3f(0.5f, 0.f, 0.f), vec3f(3.f, 2.f, 0.f), quatf(0.f, 0.f, 0.f, 1.f)) == 2);
+	test_assert(add_body(w, AGL_PHYS_SHAPE_SPHERE, vec3f(0.5f, 0.f, 0.f), vec3f(6.f, 2.f, 0.f), quatf(0.f, 0.f, 0.f, 1.f)) == AGL_PHYS_INVALID_BODY);
+	agl_phys_body_destroy(w, ball);
+	test_assert(add_body(w, AGL_PHYS_SHAPE_SPHERE, vec3f(0.5f, 0.f, 0.f), vec3f(6.f, 2.f, 0.f), quatf(0.f, 0.f, 0.f, 1.f)) == ball);
+	agl_phys_world_destroy(w);
+}
+
+// Five stacked boxes stay upright and in place, then sleep; a sleeping box wakes when hit
+void test_rigid_stack(agl_phys_broadphase_t broadphase) {
+	agl_phys_world_t *w = make_world(8, 1, broadphase);
+	uint32_t boxes[5];
+	for (int i = 0; i < 5; i++)
+		boxes[i] = add_body(w, AGL_PHYS_SHAPE_BOX, vec3f(0.5f, 0.5f, 0.5f), vec3f(0.f, 0.5f + i * 1.001f, 0.f), quatf(0.f, 0.f, 0.f, 1.f));
+	for (int s = 0; s < 300; s++)
+		agl_phys_world_step(w, 1.f / 60.f);
+	for (int i = 0; i < 5; i++) {
+		vec3f_t pos;
+		quatf_t rot;
+		agl_phys_body_get_transform(w, boxes[i], &pos, &rot);
+		test_assert(fabsf(pos._m[0]) < 0.01f && fabsf(pos._m[2]) < 0.01f);
+		test_assert(fabsf(pos._m[1] - (0.5f + i)) < 0.05f);
+		test_assert(fabsf(rot._m[3]) > 0.9999f);
+		test_assert(agl_phys_body_is_sleeping(w, boxes[i]));
+	}
+
+	// A sphere thrown at the top box wakes the whole stack
+	uint32_t ball = add_body(w, AGL_PHYS_SHAPE_SPHERE, vec3f(0.25f, 0.f, 0.f), vec3f(-3.f, 4.5f, 0.f), quatf(0.f, 0.f, 0.f, 1.f));
+	agl_phys_body_set_velocity(w, ball, &vec3f(20.f, 0.f, 0.f), &vec3f(0.f, 0.f, 0.f));
+	bool woke = false;
+	for (int s = 0; s < 30; s++) {
+		agl_phys_world_step(w, 1.f / 60.f);
+		woke = woke || !agl_phys_body_is_sleeping(w, boxes[0]);
+	}
+	vec3f_t top, v;
+	agl_phys_body_get_transform(w, boxes[4], &top, NULL);
+	agl_phys_body_get_velocity(w, boxes[4], &v, NULL);
+	test_assert(woke && top._m[0] > 0.05f);
+	agl_phys_world_destroy(w);
+}
+
+// A box dropped on its edge tips over and settles flat on a face
+void test_rigid_tilted_box() {
+	agl_phys_world_t *w = make_world(2, 1, AGL_PHYS_BROADPHASE_GRID);
+	quatf_t tilt;
+	quatf_fromaxisangle(&tilt, &vec3f(0.f, 0.f, 1.f), 0.6f);
+	uint32_t box = add_body(w, AGL_PHYS_SHAPE_BOX, vec3f(0.5f, 0.25f, 0.5f), vec3f(0.f, 1.f, 0.f), tilt);
+	for (int s = 0; s < 360; s++)
+		agl_phys_world_step(w, 1.f / 60.f);
+	vec3f_t pos, up;
+	quatf_t rot;
+	agl_phys_body_get_transform(w, box, &pos, &rot);
+	mat3f_t axes;
+	mat3f_fromquat(&axes, &rot);
+	up = vec3f(axes._m[1][0], axes._m[1][1], axes._m[1][2]);
+	test_assert(fabsf(up._m[1]) > 0.999f);
+	test_assert(fabsf(pos._m[1] - 0.25f) < 0.02f);
+	test_assert(agl_phys_body_is_sleeping(w, box));
+	agl_phys_world_destroy(w);
+}
+
+static agl_phys_world_t *make_pile(int columns, int height, uint32_t threads, agl_phys_broadphase_t broadphase) {
+	agl_phys_world_t *w = make_world(columns * columns * height + 1, threads, broadphase);
+	for (int y = 0; y < height; y++)
+		for (int z = 0; z < columns; z++)
+			for (int x = 0; x < columns; x++) {
+				// Every other layer is offset and turned a little, so the columns lean and topple into each other
+				float offset = (y & 1) * 0.3f;
+				quatf_t rot;
+				quatf_fromaxisangle(&rot, &vec3f(0.f, 1.f, 0.f), (float)((x + z + y) % 5) * 0.1f);
+				add_body(w, AGL_PHYS_SHAPE_BOX, vec3f(0.5f, 0.5f, 0.5f), vec3f(x * 1.2f + offset, 0.5f + y * 1.05f, z * 1.2f + offset), rot);
+			}
+	return w;
+}
+
+// Boxes packed face to face, one island of a few thousand manifolds that every thread solves together
+static agl_phys_world_t *make_block(int size, int height, uint32_t threads) {
+	agl_phys_world_t *w = make_world(size * size * height + 1, threads, AGL_PHYS_BROADPHASE_GRID);
+	for (int y = 0; y < height; y++)
+		for (int z = 0; z < size; z++)
+			for (int x = 0; x < size; x++)
+				add_body(w, AGL_PHYS_SHAPE_BOX, vec3f(0.5f, 0.5f, 0.5f), vec3f(x * 1.f, 0.5f + y * 1.f, z * 1.f), quatf(0.f, 0.f, 0.f, 1.f));
+	// Knock a top corner so the block does not just settle
+	agl_phys_body_set_velocity(w, size * size * height, &vec3f(-4.f, 0.f, -3.f), &vec3f(0.f, 2.f, 0.f));
+	return w;
+}
+
+// The thread count only changes who solves an island, or a colour of a large one, not the result
+void test_rigid_threads() {
+	for (int scene = 0; scene < 2; scene++) {
+		uint32_t count = scene == 0 ? 4 * 4 * 6 : 12 * 12 * 4;
+		agl_phys_world_t *a = scene == 0 ? make_pile(4, 6, 1, AGL_PHYS_BROADPHASE_GRID) : make_block(12, 4, 1);
+		agl_phys_world_t *b = scene == 0 ? make_pile(4, 6, 4, AGL_PHYS_BROADPHASE_GRID) : make_block(12, 4, 3);
+		uint32_t largest = 0;
+		for (int s = 0; s < 120; s++) {
+			agl_phys_world_step(a, 1.f / 60.f);
+			agl_phys_world_step(b, 1.f / 60.f);
+			agl_phys_world_stats_t stats;
+			agl_phys_world_get_stats(b, &stats);
+			if (stats.islands == 1 && stats.manifolds > largest)
+				largest = stats.manifolds;
+		}
+		agl_phys_world_stats_t sa, sb;
+		agl_phys_world_get_stats(a, &sa);
+		agl_phys_world_get_stats(b, &sb);
+		test_assert(memcmp(&sa, &sb, sizeof(sa)) == 0);
+		test_assert(sa.bodies == count + 1 && sa.contacts > 0);
+		test_assert(scene == 0 || largest >= 1024);
+		for (uint32_t i = 1; i <= count; i++) {
+			vec3f_t pa, pb;
+			quatf_t ra, rb;
+			agl_phys_body_get_transform(a, i, &pa, &ra);
+			agl_phys_body_get_transform(b, i, &pb, &rb);
+			test_assert(memcmp(&pa, &pb, sizeof(pa)) == 0 && memcmp(&ra, &rb, sizeof(ra)) == 0);
+		}
+		agl_phys_world_destroy(a);
+		agl_phys_world_destroy(b);
+	}
+}
+
+// The same pairs come out of every broadphase, so the first step finds the same contacts
+void test_rigid_broadphases() {
+	agl_phys_world_stats_t first[3];
+	for (int broadphase = AGL_PHYS_BROADPHASE_GRID; broadphase <= AGL_PHYS_BROADPHASE_SAP; broadphase++) {
+		// A block of touching boxes, with a few boxes and spheres on top
+		agl_phys_world_t *w = make_world(128, 2, (agl_phys_broadphase_t)broadphase);
+		for (int i = 0; i < 64; i++)
+			add_body(w, AGL_PHYS_SHAPE_BOX, vec3f(0.5f, 0.5f, 0.5f), vec3f((float)(i % 4), 0.5f + (float)(i / 16), (float)(i / 4 % 4)), quatf(0.f, 0.f, 0.f, 1.f));
+		for (int i = 0; i < 8; i++)
+			add_body(w, i & 1 ? AGL_PHYS_SHAPE_SPHERE : AGL_PHYS_SHAPE_BOX, vec3f(0.3f, 0.3f, 0.3f), vec3f(0.4f * i, 4.3f, 0.2f * i), quatf(0.f, 0.f, 0.f, 1.f));
+		agl_phys_world_step(w, 1.f / 60.f);
+		agl_phys_world_get_stats(w, &first[broadphase]);
+		agl_phys_world_destroy(w);
+	}
+	test_assert(first[0].manifolds > 3 * 48);
+	for (int i = 1; i < 3; i++)
+		test_assert(first[i].manifolds == first[0].manifolds && first[i].contacts == first[0].contacts);
+}
+
+// Rays hit the closest exact shape with its surface normal, box queries find the bodies whose bounds overlap
+void test_world_queries() {
+	agl_phys_world_t *w = make_world(4, 1, AGL_PHYS_BROADPHASE_TREE);
+	quatf_t turn;
+	quatf_fromaxisangle(&turn, &vec3f(0.f, 1.f, 0.f), 0.25f * 3.14159265f);
+	uint32_t box = add_body(w, AGL_PHYS_SHAPE_BOX, vec3f(0.5f, 0.5f, 0.5f), vec3f(0.f, 0.5f, 0.f), turn);
+	uint32_t ball = add_body(w, AGL_PHYS_SHAPE_SPHERE, vec3f(0.5f, 0.f, 0.f), vec3f(3.f, 0.5f, 0.f), quatf(0.f, 0.f, 0.f, 1.f));
+	rayf_t rays[6] = {
+		{ vec3f(0.f, 5.f, 0.f), vec3f(0.f, -1.f, 0.f) },
+		{ vec3f(-5.f, 0.5f, 0.2f), vec3f(1.f, 0.f, 0.f) },
+		{ vec3f(3.f, 5.f, 0.f), vec3f(0.f, -2.f, 0.f) },
+		{ vec3f(10.f, 5.f, 10.f), vec3f(0.f, -1.f, 0.f) },
+		{ vec3f(100.f, 5.f, 0.f), vec3f(0.f, -1.f, 0.f) },
+		{ vec3f(3.1f, 0.5f, 0.f), vec3f(1.f, 0.f, 0.f) },
+	};
+	agl_phys_ray_hit_t hits[6];
+	test_assert(agl_phys_world_raycast(w, hits, rays, 6, 100.f) == 5);
+	test_assert(hits[0].body == box && fabsf(hits[0].t - 4.f) < 1e-4f && fabsf(hits[0].normal._m[1] - 1.f) < 1e-4f);
+	test_assert(hits[1].body == box && fabsf(hits[1].t - (5.f - sqrtf(0.5f) + 0.2f)) < 1e-4f);
+	test_assert(fabsf(hits[1].normal._m[0] + sqrtf(0.5f)) < 1e-4f && fabsf(hits[1].normal._m[2] - sqrtf(0.5f)) < 1e-4f);
+	test_assert(hits[2].body == ball && fabsf(hits[2].t - 2.f) < 1e-4f && fabsf(hits[2].normal._m[1] - 1.f) < 1e-4f);
+	test_assert(hits[3].body == 0 && fabsf(hits[3].t - 5.f) < 1e-4f);
+	test_assert(hits[4].body == AGL_PHYS_INVALID_BODY);
+	test_assert(hits[5].body == ball && hits[5].t == 0.f && hits[5].normal._m[0] == 0.f);
+	// Too short to reach anything
+	test_assert(agl_phys_world_raycast(w, hits, rays, 1, 3.f) == 0);
+
+	aabbf_t boxes[2] = {
+		{ vec3f(2.9f, 0.4f, -0.1f), vec3f(3.1f, 0.6f, 0.1f) },
+		{ vec3f(-10.f, -10.f, -10.f), vec3f(10.f, 10.f, 10.f) },
+	};
+	uint32_t bodies[4], starts[3];
+	test_assert(agl_phys_world_query(w, bodies, starts, 4, boxes, 2) == 4);
+	test_assert(starts[0] == 0 && starts[1] == 1 && starts[2] == 4 && bodies[0] == ball);
+	test_assert(bodies[1] + bodies[2] + bodies[3] == 0 + box + ball);
+	// Results that do not fit are counted but not written
+	test_assert(agl_phys_world_query(w, bodies, starts, 2, boxes, 2) == 4 && starts[2] == 2);
+
+	agl_phys_body_destroy(w, ball);
+	test_assert(agl_phys_world_query(w, bodies, starts, 4, boxes, 1) == 0);
+	test_assert(agl_phys_world_raycast(w, hits, rays + 2, 1, 100.f) == 1 && hits[0].body == 0 && fabsf(hits[0].t - 2.5f) < 1e-4f);
+	agl_phys_world_destroy(w);
+}
+
+static aabbf_t random_box(agl_rng_t *rng, float extent, float size) {
+	aabbf_t b;
+	for (int c = 0; c < 3; c++) {
+		float centre = agl_rng_float(rng) * extent, half = (0.2f + 0.8f * agl_rng_float(rng)) * size * 0.5f;
+		b.min._m[c] = centre - half;
+		b.max._m[c] = centre + half;
+	}
+	b.min._m[3] = b.max._m[3] = 0.f;
+	return b;
+}
+
+static int compare_pairs(const void *a, const void *b) {
+	const agl_phys_pair_t *pa = (const agl_phys_pair_t*)a, *pb = (const agl_phys_pair_t*)b;
+	return pa->a != pb->a ? (pa->a < pb->a ? -1 : 1) : (pa->b < pb->b ? -1 : pa->b > pb->b);
+}
+
+static int compare_uint(const void *a, const void *b) {
+	uint32_t ua = *(const uint32_t*)a, ub = *(const uint32_t*)b;
+	return ua < ub ? -1 : ua > ub;
+}
+
+// Every overlapping pair of boxes, labelled with ids[i] or i when ids is NULL, sorted
+static uint32_t brute_force_pairs(agl_phys_pair_t *pairs, const aabbf_t *boxes, const uint32_t *ids, uint32_t count) {
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < count; i++)
+		for (uint32_t j = i + 1; j < count; j++)
+			if (aabbf_overlaps(&boxes[i], &boxes[j])) {
+				uint32_t a = ids ? ids[i] : i, b = ids ? ids[j] : j;
+				pairs[n++] = a < b ? (agl_phys_pair_t){ a, b } : (agl_phys_pair_t){ b, a };
+			}
+	qsort(pairs, n, sizeof(*pairs), compare_pairs);
+	return n;
+}
+
+// Through moves, teleports and removals the tree keeps containing every box and answers like testing each stored box
+void test_broadphase_tree() {
+	enum { N = 500, QUERIES = 16, MAX_PAIRS = 8192 };
+	static agl_phys_pair_t pairs[MAX_PAIRS], expected[MAX_PAIRS];
+	static uint32_t proxies[N], found[N * QUERIES], starts[QUERIES + 1], indices[N];
+	static aabbf_t boxes[N], stored[N];
+	static float t[N];
+	agl_rng_t rng;
+	agl_rng_seed(&rng, 7);
+	agl_phys_tree_t *tree = agl_phys_tree_create(&(agl_phys_tree_params_t){ 0, 0.05f });
+	for (uint32_t i = 0; i < N; i++) {
+		boxes[i] = random_box(&rng, 10.f, 2.f);
+		proxies[i] = agl_phys_tree_insert(tree, &boxes[i], i);
+	}
+	for (int round = 0; round < 4; round++) {
+		for (uint32_t i = 0; i < N; i++) {
+			// Small steps, then everything teleports, then churn: a tenth of the boxes are removed and added again
+			vec3f_t d = vec3f(0.f, 0.f, 0.f);
+			if (round == 2) {
+				boxes[i] = random_box(&rng, 10.f, 2.f);
+			} else {
+				d = vec3f(agl_rng_float(&rng) - 0.5f, agl_rng_float(&rng) - 0.5f, agl_rng_float(&rng) - 0.5f);
+				vec3f_scale(&d, 0.2f);
+				vec3f_add(&boxes[i].min, &d);
+				vec3f_add(&boxes[i].max, &d);
+			}
+			if (round == 3 && i % 10 == 3) {
+				agl_phys_tree_remove(tree, proxies[i]);
+				proxies[i] = agl_phys_tree_insert(tree, &boxes[i], i);
+			} else {
+				agl_phys_tree_move(tree, proxies[i], &boxes[i], &d);
+			}
+		}
+		for (uint32_t i = 0; i < N; i++) {
+			stored[i] = agl_phys_tree_get_box(tree, proxies[i]);
+			test_assert(agl_phys_tree_get_user(tree, proxies[i]) == i);
+			test_assert(aabbf_contains(&stored[i], &boxes[i].min) && aabbf_contains(&stored[i], &boxes[i].max));
+		}
+		agl_phys_tree_stats_t stats;
+		agl_phys_tree_get_stats(tree, &stats);
+		test_assert(stats.proxies == N && stats.height >= 9 && stats.height <= 20 && stats.areaRatio > 1.f);
+
+		uint32_t n = agl_phys_tree_find_pairs(tree, pairs, MAX_PAIRS);
+		test_assert(n > N / 2 && n <= MAX_PAIRS);
+		qsort(pairs, n, sizeof(*pairs), compare_pairs);
+		test_assert(brute_force_pairs(expected, stored, proxies, N) == n);
+		test_assert(memcmp(pairs, expected, n * sizeof(*pairs)) == 0);
+
+		aabbf_t queries[QUERIES];
+		rayf_t rays[QUERIES];
+		for (int q = 0; q < QUERIES; q++) {
+			queries[q] = random_box(&rng, 10.f, 4.f);
+			rays[q].origin = vec3f(agl_rng_float(&rng) * 10.f, agl_rng_float(&rng) * 10.f, -1.f);
+			rays[q].dir = vec3f(agl_rng_float(&rng) - 0.5f, agl_rng_float(&rng) - 0.5f, 1.f);
+		}
+		uint32_t total = agl_phys_tree_query(tree, found, starts, N * QUERIES, queries, QUERIES);
+		test_assert(total == starts[QUERIES]);
+		for (int q = 0; q < QUERIES; q++) {
+			size_t count = agl_overlap_aabbs(indices, &queries[q], stored, N);
+			for (size_t k = 0; k < count; k++)
+				indices[k] = proxies[indices[k]];
+			qsort(found + starts[q], starts[q + 1] - starts[q], sizeof(uint32_t), compare_uint);
+			qsort(indices, count, sizeof(uint32_t), compare_uint);
+			test_assert(starts[q + 1] - starts[q] == count && memcmp(found + starts[q], indices, count * sizeof(uint32_t)) == 0);
+		}
+		total = agl_phys_tree_raycast(tree, found, starts, N * QUERIES, rays, QUERIES, 15.f);
+		test_assert(total == starts[QUERIES] && total > 0);
+		for (int q = 0; q < QUERIES; q++) {
+			size_t count = 0;
+			agl_ray_aabbs(t, &rays[q], stored, N, 15.f);
+			for (uint32_t i = 0; i < N; i++)
+				if (t[i] != INFINITY)
+					indices[count++] = proxies[i];
+			qsort(found + starts[q], starts[q + 1] - starts[q], sizeof(uint32_t), compare_uint);
+			qsort(indices, count, sizeof(uint32_t), compare_uint);
+			test_assert(starts[q + 1] - starts[q] == count && memcmp(found + starts[q], indices, count * sizeof(uint32_t)) == 0);
+		}
+		// Too little room: the count is still exact
+		test_assert(agl_phys_tree_query(tree, found, starts, 1, queries, QUERIES) == agl_phys_tree_query(tree, found, starts, N * QUERIES, queries, QUERIES));
+		test_assert(agl_phys_tree_find_pairs(tree, pairs, 1) == n);
+	}
+	// A box moving inside its stored box leaves the tree alone
+	aabbf_t inside = boxes[0];
+	test_assert(!agl_phys_tree_move(tree, proxies[0], &inside, &vec3f(0.f, 0.f, 0.f)));
+	for (uint32_t i = 0; i < N; i++)
+		agl_phys_tree_remove(tree, proxies[i]);
+	agl_phys_tree_stats_t stats;
+	agl_phys_tree_get_stats(tree, &stats);
+	test_assert(stats.proxies == 0 && stats.height == 0);
+	test_assert(agl_phys_tree_find_pairs(tree, pairs, MAX_PAIRS) == 0);
+	agl_phys_tree_destroy(tree);
+}
+
+// Sweep and prune finds every overlapping pair, in the same order for any thread count, and keeps its order when the boxes
+// barely move
+void test_broadphase_sap() {
+	enum { N = 9000, MAX_PAIRS = 65536 };
+	static agl_phys_pair_t sorted[MAX_PAIRS], expected[MAX_PAIRS];
+	static aabbf_t boxes[N];
+	agl_rng_t rng;
+	agl_rng_seed(&rng, 11);
+	for (uint32_t i = 0; i < N; i++)
+		boxes[i] = random_box(&rng, 20.f, 1.f);
+	agl_phys_sap_t *single = agl_phys_sap_create(&(agl_phys_sap_params_t){ 1 });
+	agl_phys_sap_t *multi = agl_phys_sap_create(&(agl_phys_sap_params_t){ 3 });
+	for (int round = 0; round < 4; round++) {
+		if (round == 1) {
+			for (uint32_t i = 0; i < N; i++) {
+				vec3f_t d = vec3f(agl_rng_float(&rng) - 0.5f, agl_rng_float(&rng) - 0.5f, agl_rng_float(&rng) - 0.5f);
+				vec3f_scale(&d, 0.05f);
+				vec3f_add(&boxes[i].min, &d);
+				vec3f_add(&boxes[i].max, &d);
+			}
+		} else if (round == 2) {
+			// Unused slots
+			for (uint32_t i = 0; i < N; i += 7)
+				boxes[i] = (aabbf_t){ vec3f(FLT_MAX, FLT_MAX, FLT_MAX), vec3f(-FLT_MAX, -FLT_MAX, -FLT_MAX) };
+		} else if (round == 3) {
+			for (uint32_t i = 0; i < N; i++)
+				boxes[i] = random_box(&rng, 20.f, 1.f);
+		}
+		uint32_t n = agl_phys_sap_find_pairs(single, boxes, N);
+		test_assert(agl_phys_sap_find_pairs(multi, boxes, N) == n);
+		test_assert(memcmp(agl_phys_sap_get_pairs(single), agl_phys_sap_get_pairs(multi), n * sizeof(agl_phys_pair_t)) == 0);
+		test_assert(n > N / 2 && n <= MAX_PAIRS);
+		memcpy(sorted, agl_phys_sap_get_pairs(single), n * sizeof(agl_phys_pair_t));
+		qsort(sorted, n, sizeof(*sorted), compare_pairs);
+		test_assert(brute_force_pairs(expected, boxes, NULL, N) == n && memcmp(sorted, expected, n * sizeof(*sorted)) == 0);
+		agl_phys_sap_stats_t stats;
+		agl_phys_sap_get_stats(multi, &stats);
+		test_assert(stats.boxes == N && stats.pairs == n && stats.memory > N * sizeof(aabbf_t));
+		// Teleports fall back to sorting from scratch
+		test_assert(round == 1 ? !stats.resorted && stats.swaps > 0 : stats.resorted);
+	}
+	test_assert(agl_phys_sap_find_pairs(single, boxes, 0) == 0);
+	agl_phys_sap_destroy(single);
+	agl_phys_sap_destroy(multi);
+}
+
+// clock() adds up the time of every thread
+static double wall_time() {
+	struct timespec t;
+	timespec_get(&t, TIME_UTC);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+void bench_rigid_bodies() {
+	const int columns = 20, height = 25, steps = 120;
+	for (uint32_t threads = 1; threads <= 4; threads *= 4) {
+		agl_phys_world_t *w = make_pile(columns, height, threads, AGL_PHYS_BROADPHASE_GRID);
+		double t0 = wall_time();
+		for (int s = 0; s < steps; s++)
+			agl_phys_world_step(w, 1.f / 60.f);
+		double t1 = wall_time();
+		agl_phys_world_stats_t stats;
+		agl_phys_world_get_stats(w, &stats);
+		printf("rigid bodies (%u boxes, %u threads): step %.2f ms, %u awake in %u islands, %u contacts\n", stats.bodies - 1, threads,
+			(t1 - t0) * 1e3 / steps, stats.awakeBodies, stats.islands, stats.contacts);
+		agl_phys_world_destroy(w);
+	}
+}
+
+// 20k boxes drifting through a volume, with 1% teleported every frame as churn
+void bench_broadphase() {
+	enum { N = 20000, FRAMES = 30, RAYS = 10000, MAX_PAIRS = 1 << 17 };
+	static aabbf_t boxes[N];
+	static vec3f_t velocity[N];
+	static uint32_t proxies[N], hits[1 << 18], starts[RAYS + 1];
+	static agl_phys_pair_t pairs[MAX_PAIRS];
+	static rayf_t rays[RAYS];
+	static float t[N];
+	const float extent = 30.f, dt = 1.f / 60.f;
+	agl_rng_t rng;
+	agl_rng_seed(&rng, 3);
+	for (uint32_t i = 0; i < N; i++) {
+		boxes[i] = random_box(&rng, extent, 1.f);
+		velocity[i] = vec3f(agl_rng_float(&rng) - 0.5f, agl_rng_float(&rng) - 0.5f, agl_rng_float(&rng) - 0.5f);
+		vec3f_scale(&velocity[i], 4.f);
+	}
+
+	agl_phys_tree_t *tree = agl_phys_tree_create(&(agl_phys_tree_params_t){ N, 0.1f });
+	agl_phys_sap_t *sap[2] = { agl_phys_sap_create(&(agl_phys_sap_params_t){ 1 }), agl_phys_sap_create(&(agl_phys_sap_params_t){ 4 }) };
+	double t0 = wall_time();
+	for (uint32_t i = 0; i < N; i++)
+		proxies[i] = agl_phys_tree_insert(tree, &boxes[i], i);
+	double build = wall_time() - t0, update = 0.0, treePairs = 0.0, sapPairs[2] = { 0.0, 0.0 };
+	uint32_t reinserted = 0, treeCount = 0, sapCount = 0;
+	for (int f = 0; f < FRAMES; f++) {
+		for (uint32_t i = 0; i < N; i++) {
+			vec3f_t d = velocity[i];
+			vec3f_scale(&d, dt);
+			if (agl_rng_float(&rng) < 0.01f) {
+				aabbf_t b = random_box(&rng, extent, 1.f);
+				vec3f_sub2(&d, &b.min, &boxes[i].min);
+				boxes[i] = b;
+			} else {
+				vec3f_add(&boxes[i].min, &d);
+				vec3f_add(&boxes[i].max, &d);
+			}
+		}
+		t0 = wall_time();
+		for (uint32_t i = 0; i < N; i++) {
+			vec3f_t d = velocity[i];
+			vec3f_scale(&d, 2.f * dt);
+			reinserted += agl_phys_tree_move(tree, proxies[i], &boxes[i], &d);
+		}
+		double t1 = wall_time();
+		treeCount = agl_phys_tree_find_pairs(tree, pairs, MAX_PAIRS);
+		double t2 = wall_time();
+		update += t1 - t0;
+		treePairs += t2 - t1;
+		for (int s = 0; s < 2; s++) {
+			t0 = wall_time();
+			sapCount = agl_phys_sap_find_pairs(sap[s], boxes, N);
+			sapPairs[s] += wall_time() - t0;
+		}
+	}
+	for (int r = 0; r < RAYS; r++) {
+		rays[r].origin = vec3f(agl_rng_float(&rng) * extent, agl_rng_float(&rng) * extent, -1.f);
+		rays[r].dir = vec3f(agl_rng_float(&rng) - 0.5f, agl_rng_float(&rng) - 0.5f, 1.f);
+	}
+	t0 = wall_time();
+	uint32_t rayHits = agl_phys_tree_raycast(tree, hits, starts, 1 << 18, rays, RAYS, 10.f);
+	double treeRays = wall_time() - t0;
+	t0 = wall_time();
+	for (int r = 0; r < RAYS / 100; r++)
+		agl_ray_aabbs(t, &rays[r], boxes, N, 10.f);
+	double bruteRays = (wall_time() - t0) * 100.0;
+
+	agl_phys_tree_stats_t ts;
+	agl_phys_sap_stats_t ss;
+	agl_phys_tree_get_stats(tree, &ts);
+	agl_phys_sap_get_stats(sap[1], &ss);
+	printf("broadphase tree (%u boxes): build %.2f ms, update %.2f ms with %.1f%% reinserted, pairs %.2f ms (%u, %.1f M/s), "
+		"height %u, area ratio %.1f, %zu KB\n", N, build * 1e3, update * 1e3 / FRAMES, 100.0 * reinserted / ((double)N * FRAMES),
+		treePairs * 1e3 / FRAMES, treeCount, treeCount * FRAMES / treePairs * 1e-6, ts.height, ts.areaRatio, ts.memory / 1024);
+	for (int s = 0; s < 2; s++)
+		printf("broadphase sap (%u boxes, %u threads): pairs %.2f ms (%u, %.1f M/s), %zu KB\n", N, s ? 4 : 1, sapPairs[s] * 1e3 / FRAMES,
+			sapCount, sapCount * FRAMES / sapPairs[s] * 1e-6, ss.memory / 1024);
+	printf("broadphase rays (%u rays): tree %.2f ms (%u hits), testing every box %.2f ms\n", RAYS, treeRays * 1e3, rayHits, bruteRays * 1e3);
+	agl_phys_tree_destroy(tree);
+	agl_phys_sap_destroy(sap[0]);
+	agl_phys_sap_destroy(sap[1]);
+}
+
+int main() {
+	// Once on the SSE2 baseline, then with the best path the CPU supports
+	for (int pass = 0; pass < 2; pass++) {
+		agl_cpu_set_features(pass == 0 ? 0 : ~0u);
+		test_particles_lifetime();
+		test_particles_integrators();
+		test_particles_ranges();
+		bench_particles();
+	}
+	for (int broadphase = AGL_PHYS_BROADPHASE_GRID; broadphase <= AGL_PHYS_BROADPHASE_SAP; broadphase++) {
+		test_rigid_sphere_rest((agl_phys_broadphase_t)broadphase);
+		test_rigid_stack((agl_phys_broadphase_t)broadphase);
+	}
+	test_rigid_tilted_box();
+	test_rigid_threads();
+	test_rigid_broadphases();
+	test_world_queries();
+	test_broadphase_tree();
+	test_broadphase_sap();
+	bench_rigid_bodies();
+	bench_broadphase();
+	return 0;
+}
+
+#define AGL_PHYS_IMPLEMENTATION
+#include "agl_phys.h"
+#define AGL_MATH_IMPLEMENTATION
+#include "agl_math.h"
@@ -0,0 +1,124 @@
+#include "agl_scene.h"
+#include "agl_math.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Always checked, agl_math_assert compiles out without _DEBUG
+#define test_assert(cond) do { if (!(cond)) { fprintf(stderr, "(%s:%d) Assertion failed: %s\n", __FILE__, __LINE__, #cond); abort(); } } while (0)
+
+#define NODE_COUNT 200
+
+// Reference T * R * S, column-major
+static void make_trs(float m[16], const float p[3], const float q[4], const float s[3]) {
+	float x = q[0], y = q[1], z = q[2], w = q[3];
+	float r[9] = {
+		1 - 2 * (y * y + z * z), 2 * (x * y + w * z), 2 * (x * z - w * y),
+		2 * (x * y - w * z), 1 - 2 * (x * x + z * z), 2 * (y * z + w * x),
+		2 * (x * z + w * y), 2 * (y * z - w * x), 1 - 2 * (x * x + y * y),
+	};
+	for (int c = 0; c < 3; c++) {
+		for (int k = 0; k < 3; k++)
+			m[4 * c + k] = r[3 * c + k] * s[c];
+		m[4 * c + 3] = 0.f;
+	}
+	m[12] = p[0]; m[13] = p[1]; m[14] = p[2]; m[15] = 1.f;
+}
+
+static void mul(float out[16], const float a[16], const float b[16]) {
+	float t[16];
+	for (int c = 0; c < 4; c++) for (int r = 0; r < 4; r++) {
+		t[4 * c + r] = 0.f;
+		for (int k = 0; k < 4; k++)
+			t[4 * c + r] += a[4 * k + r] * b[4 * c + k];
+	}
+	for (int i = 0; i < 16; i++)
+		out[i] = t[i];
+}
+
+static int parents[NODE_COUNT];
+static float P[NODE_COUNT][3], Q[NODE_COUNT][4], S[NODE_COUNT][3];
+
+static void check_world(agl_scene_t *scene, const agl_scene_node_t *nodes) {
+	float world[NODE_COUNT][16];
+	for (int i = 0; i < NODE_COUNT; i++) {
+		float local[16];
+		make_trs(local, P[i], Q[i], S[i]);
+		if (parents[i] < 0) {
+			for (int k = 0; k < 16; k++)
+				world[i][k] = local[k];
+		} else {
+			mul(world[i], world[parents[i]], local);
+		}
+		const float *m = agl_scene_get_world(scene, nodes[i]);
+		for (int k = 0; k < 16; k++)
+			test_assert(float_eq(m[k], world[i][k], 1e-3f));
+	}
+}
+
+// Random forest whose nodes are created depth-first, so the depth sort has to reorder them
+void test_scene_update() {
+	agl_scene_t *scene = agl_scene_create(4);
+	agl_scene_node_t nodes[NODE_COUNT];
+	srand(7);
+	for (int i = 0; i < NODE_COUNT; i++) {
+		parents[i] = (i == 0 || rand() % 8 == 0) ? -1 : rand() % i;
+		nodes[i] = agl_scene_add_node(scene, parents[i] < 0 ? AGL_SCENE_INVALID_NODE : nodes[parents[i]]);
+		float angle = (float)(rand() % 628) / 100.f;
+		vec3f_t axis = vec3f((float)(rand() % 9) - 4.f, (float)(rand() % 9) - 4.f, 1.f);
+		quatf_t q;
+		vec3f_normalize(&axis);
+		quatf_fromaxisangle(&q, &axis, angle);
+		for (int k = 0; k < 3; k++) {
+			P[i][k] = (float)(rand() % 100) / 10.f - 5.f;
+			S[i][k] = 0.5f + (float)(rand() % 100) / 100.f;
+			Q[i][k] = q._m[k];
+		}
+		Q[i][3] = q._m[3];
+		agl_scene_set_local(scene, nodes[i], P[i], Q[i], S[i]);
+	}
+	test_assert(agl_scene_node_count(scene) == NODE_COUNT);
+	test_assert(agl_scene_update(scene) == NODE_COUNT);
+	check_world(scene, nodes);
+	for (int i = 0; i < NODE_COUNT; i++)
+		test_assert(agl_scene_get_parent(scene, nodes[i]) == (parents[i] < 0 ? AGL_SCENE_INVALID_NODE : nodes[parents[i]]));
+
+	// Nothing changed, nothing recomputed
+	test_assert(agl_scene_update(scene) == 0);
+
+	// Moving one node recomputes exactly its subtree
+	int target = 1;
+	uint32_t subtree = 0;
+	for (int i = 0; i < NODE_COUNT; i++) {
+		int n = i;
+		while (n >= 0 && n != target)
+			n = parents[n];
+		subtree += n == target;
+	}
+	P[target][1] += 2.f;
+	agl_scene_set_local(scene, nodes[target], P[target], Q[target], S[target]);
+	test_assert(agl_scene_update(scene) == subtree);
+	check_world(scene, nodes);
+
+	float gathered[32];
+	agl_scene_gather_world(scene, &nodes[3], 2, gathered);
+	for (int k = 0; k < 16; k++) {
+		test_assert(gathered[k] == agl_scene_get_world(scene, nodes[3])[k]);
+		test_assert(gathered[16 + k] == agl_scene_get_world(scene, nodes[4])[k]);
+	}
+	agl_scene_destroy(scene);
+}
+
+int main() {
+	// Once on the SSE2 baseline, then with the best path the CPU supports
+	agl_cpu_set_features(0);
+	test_scene_update();
+	agl_cpu_set_features(~0u);
+	test_scene_update();
+	return 0;
+}
+
+#define AGL_SCENE_IMPLEMENTATION
+#include "agl_scene.h"
+#define AGL_MATH_IMPLEMENTATION
+#include "agl_math.h"